@@ -0,0 +1,668 @@
+// Load generator and latency benchmark for the chat server.
+// Drives N simulated users through the real wire protocol and reports throughput and
+// p50/p99/p999 end-to-end latency, so server changes can be compared against a baseline.
+//
+// Usage: chatbench [options] <server_ip> <port>   (see printBenchUsage)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "../shared/protocol.h"
+#include "../shared/utils.h"
+
+#define BENCH_DEFAULT_USERS 50
+#define BENCH_DEFAULT_MESSAGES 100        // Per user: broadcasts sent, pings sent, or login cycles
+#define BENCH_DEFAULT_FILES 2             // Per sending user in the file scenario
+#define BENCH_DEFAULT_FILE_SIZE (64 * 1024)
+#define BENCH_MAX_ROOM_MEMBERS 15         // Server room capacity (MAX_MEMBERS_PER_ROOM)
+#define BENCH_RECEIVE_TIMEOUT_SECONDS 10  // A user waiting longer than this for traffic gives up
+#define BENCH_IO_CHUNK_SIZE 65536
+
+typedef enum BenchScenario
+{
+    SCENARIO_LOGIN,     // Login storm: connect, log in, disconnect
+    SCENARIO_BROADCAST, // Room broadcast fan-out
+    SCENARIO_WHISPER,   // Whisper ping-pong between pairs of users
+    SCENARIO_FILE,      // Concurrent file transfers between pairs of users
+    SCENARIO_COUNT
+} BenchScenario;
+
+static const char *scenario_names[SCENARIO_COUNT] = {"login", "broadcast", "whisper", "file"};
+
+typedef struct BenchConfig
+{
+    char server_ip[64];
+    int port;
+    int user_count;
+    int messages_per_user;
+    int files_per_user;
+    size_t file_size;
+    int interval_us;      // Pause between a user's sends (0 = as fast as possible)
+    int wire_protocol;    // Highest protocol advertised at login
+    int run_scenario[SCENARIO_COUNT];
+} BenchConfig;
+
+// Latency samples in nanoseconds, one array per user so recording never contends.
+typedef struct LatencySamples
+{
+    unsigned long long *values;
+    size_t count;
+    size_t capacity;
+} LatencySamples;
+
+typedef struct BenchUser
+{
+    int index;
+    char username[USERNAME_BUF_SIZE];
+    int socket_fd;
+    LatencySamples samples;
+    unsigned long long messages_sent;
+    unsigned long long messages_received; // Units of work that completed (deliveries, pongs, files, logins)
+    unsigned long long expected_receives; // Broadcast scenario: deliveries this user should see
+    unsigned long long bytes_received;
+    int failed;
+} BenchUser;
+
+typedef struct BenchRun
+{
+    const BenchConfig *config;
+    BenchScenario scenario;
+    BenchUser *users;
+    pthread_barrier_t start_barrier; // All users logged in and placed before the timed phase
+    unsigned long long started_ns;
+    unsigned long long finished_ns;
+} BenchRun;
+
+typedef struct BenchThreadArgs
+{
+    BenchRun *run;
+    BenchUser *user;
+} BenchThreadArgs;
+
+static unsigned long long monotonicNanos(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+}
+
+static void recordLatency(LatencySamples *samples, unsigned long long nanos)
+{
+    if (samples->count == samples->capacity)
+    {
+        size_t new_capacity = samples->capacity ? samples->capacity * 2 : 256;
+        unsigned long long *grown = realloc(samples->values, new_capacity * sizeof(*grown));
+        if (!grown)
+            return; // Sample lost; the totals stay correct
+        samples->values = grown;
+        samples->capacity = new_capacity;
+    }
+    samples->values[samples->count++] = nanos;
+}
+
+static int compareNanos(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *)a, y = *(const unsigned long long *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted values, in microseconds.
+static double percentileMicros(const unsigned long long *sorted, size_t count, double percentile)
+{
+    if (count == 0)
+        return 0.0;
+    size_t rank = (size_t)(percentile / 100.0 * (double)count + 0.999999);
+    if (rank < 1)
+        rank = 1;
+    if (rank > count)
+        rank = count;
+    return (double)sorted[rank - 1] / 1000.0;
+}
+
+// Connects and logs in as user->username, negotiating the wire protocol.
+// Returns 1 on success, 0 on failure (socket closed).
+static int connectAndLogin(const BenchConfig *config, BenchUser *user)
+{
+    struct sockaddr_in server_address;
+    memset(&server_address, 0, sizeof(server_address));
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons((unsigned short)config->port);
+    if (inet_pton(AF_INET, config->server_ip, &server_address.sin_addr) <= 0)
+        return 0;
+
+    user->socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (user->socket_fd < 0)
+        return 0;
+    int one = 1;
+    setsockopt(user->socket_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Latency, not bandwidth
+    struct timeval receive_timeout = {BENCH_RECEIVE_TIMEOUT_SECONDS, 0};
+    setsockopt(user->socket_fd, SOL_SOCKET, SO_RCVTIMEO, &receive_timeout, sizeof(receive_timeout));
+    if (connect(user->socket_fd, (struct sockaddr *)&server_address, sizeof(server_address)) < 0)
+        goto fail;
+
+    Message login_msg;
+    memset(&login_msg, 0, sizeof(login_msg));
+    login_msg.type = MSG_LOGIN;
+    strncpy(login_msg.sender, user->username, USERNAME_BUF_SIZE - 1);
+    login_msg.file_size = (size_t)config->wire_protocol;
+    Message reply;
+    if (!sendMessageWithProtocol(user->socket_fd, &login_msg, WIRE_PROTOCOL_FIXED) ||
+        !receiveMessage(user->socket_fd, &reply) || reply.type != MSG_LOGIN_SUCCESS)
+        goto fail;
+    setSocketWireProtocol(user->socket_fd, reply.file_size == WIRE_PROTOCOL_FRAMED ? WIRE_PROTOCOL_FRAMED : WIRE_PROTOCOL_FIXED);
+    return 1;
+
+fail:
+    close(user->socket_fd);
+    user->socket_fd = -1;
+    return 0;
+}
+
+static void disconnectUser(BenchUser *user)
+{
+    if (user->socket_fd < 0)
+        return;
+    Message bye;
+    memset(&bye, 0, sizeof(bye));
+    bye.type = MSG_DISCONNECT;
+    strncpy(bye.sender, user->username, USERNAME_BUF_SIZE - 1);
+    sendMessage(user->socket_fd, &bye);
+    shutdown(user->socket_fd, SHUT_WR);
+    char drain[4096];
+    while (recv(user->socket_fd, drain, sizeof(drain), 0) > 0)
+    { // Wait for the server to close so the next run does not meet this user's name
+    }
+    setSocketWireProtocol(user->socket_fd, WIRE_PROTOCOL_FIXED);
+    close(user->socket_fd);
+    user->socket_fd = -1;
+}
+
+static int sendTextMessage(BenchUser *user, MessageType type, const char *room, const char *receiver, const char *content)
+{
+    Message msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.type = type;
+    strncpy(msg.sender, user->username, USERNAME_BUF_SIZE - 1);
+    if (room)
+        strncpy(msg.room, room, ROOM_NAME_BUF_SIZE - 1);
+    if (receiver)
+        strncpy(msg.receiver, receiver, USERNAME_BUF_SIZE - 1);
+    if (content)
+        strncpy(msg.content, content, MESSAGE_BUF_SIZE - 1);
+    if (!sendMessage(user->socket_fd, &msg))
+        return 0;
+    user->messages_sent++;
+    return 1;
+}
+
+// Receives and discards length raw bytes (file contents following MSG_FILE_TRANSFER_DATA).
+static int discardRawBytes(BenchUser *user, size_t length)
+{
+    char chunk[BENCH_IO_CHUNK_SIZE];
+    while (length > 0)
+    {
+        ssize_t got = recv(user->socket_fd, chunk, length < sizeof(chunk) ? length : sizeof(chunk), 0);
+        if (got < 0 && errno == EINTR)
+            continue;
+        if (got <= 0)
+            return 0;
+        length -= (size_t)got;
+        user->bytes_received += (size_t)got;
+    }
+    return 1;
+}
+
+static int sendRawBytes(BenchUser *user, size_t length)
+{
+    static const char filler[BENCH_IO_CHUNK_SIZE]; // Zero bytes; the contents do not matter
+    while (length > 0)
+    {
+        ssize_t sent = send(user->socket_fd, filler, length < sizeof(filler) ? length : sizeof(filler), MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return 0;
+        length -= (size_t)sent;
+    }
+    return 1;
+}
+
+static void pauseBetweenSends(const BenchConfig *config)
+{
+    if (config->interval_us > 0)
+        usleep((useconds_t)config->interval_us);
+}
+
+static int roomCountFor(const BenchConfig *config)
+{
+    return (config->user_count + BENCH_MAX_ROOM_MEMBERS - 1) / BENCH_MAX_ROOM_MEMBERS;
+}
+
+// --- Scenarios (each runs in its user's thread) ---
+
+// Login storm: every user connects and logs in messages_per_user times as fast as it can.
+static void runLoginUser(BenchRun *run, BenchUser *user)
+{
+    pthread_barrier_wait(&run->start_barrier);
+    for (int cycle = 0; cycle < run->config->messages_per_user; ++cycle)
+    {
+        snprintf(user->username, USERNAME_BUF_SIZE, "bl%dc%d", user->index, cycle);
+        unsigned long long started = monotonicNanos();
+        if (!connectAndLogin(run->config, user))
+        {
+            user->failed++;
+            continue;
+        }
+        recordLatency(&user->samples, monotonicNanos() - started);
+        user->messages_received++;
+        disconnectUser(user);
+    }
+}
+
+// Reader side of the broadcast scenario: counts deliveries and measures their latency.
+static void *broadcastReaderThread(void *arg)
+{
+    BenchUser *user = (BenchUser *)arg;
+    Message msg;
+    while (user->messages_received < user->expected_receives && receiveMessage(user->socket_fd, &msg))
+    {
+        unsigned long long sent_at;
+        if (msg.type == MSG_BROADCAST && sscanf(msg.content, "bench %llu", &sent_at) == 1)
+        {
+            recordLatency(&user->samples, monotonicNanos() - sent_at);
+            user->messages_received++;
+        }
+        else if (msg.type == MSG_FILE_TRANSFER_DATA && !discardRawBytes(user, msg.file_size))
+            break;
+    }
+    return NULL;
+}
+
+// Broadcast fan-out: users fill rooms of up to 15, then everyone broadcasts to their room.
+static void runBroadcastUser(BenchRun *run, BenchUser *user)
+{
+    const BenchConfig *config = run->config;
+    int room_count = roomCountFor(config);
+    int room_index = user->index % room_count;
+    int room_size = 0;
+    for (int i = room_index; i < config->user_count; i += room_count)
+        ++room_size;
+    user->expected_receives = (unsigned long long)config->messages_per_user * (unsigned long long)(room_size - 1);
+
+    char room_name[ROOM_NAME_BUF_SIZE];
+    snprintf(room_name, sizeof(room_name), "benchroom%d", room_index);
+    int ready = sendTextMessage(user, MSG_JOIN_ROOM, room_name, NULL, NULL);
+    pthread_barrier_wait(&run->start_barrier); // Joins sent by all; give them a moment to land
+    if (!ready)
+    {
+        user->failed++;
+        return;
+    }
+    usleep(200 * 1000);
+    user->messages_sent = 0;
+
+    pthread_t reader_thread;
+    if (pthread_create(&reader_thread, NULL, broadcastReaderThread, user) != 0)
+    {
+        user->failed++;
+        return;
+    }
+    char content[64];
+    for (int i = 0; i < config->messages_per_user; ++i)
+    {
+        snprintf(content, sizeof(content), "bench %llu", monotonicNanos());
+        if (!sendTextMessage(user, MSG_BROADCAST, room_name, NULL, content))
+        {
+            user->failed++;
+            break;
+        }
+        pauseBetweenSends(config);
+    }
+    pthread_join(reader_thread, NULL);
+}
+
+// Whisper ping-pong: even users ping their odd partner, which echoes each ping back.
+static void runWhisperUser(BenchRun *run, BenchUser *user)
+{
+    const BenchConfig *config = run->config;
+    int is_pinger = (user->index % 2 == 0);
+    BenchUser *partner = &run->users[is_pinger ? user->index + 1 : user->index - 1];
+    pthread_barrier_wait(&run->start_barrier);
+
+    Message msg;
+    char content[64];
+    for (int i = 0; i < config->messages_per_user; ++i)
+    {
+        if (is_pinger)
+        {
+            unsigned long long started = monotonicNanos();
+            snprintf(content, sizeof(content), "ping %llu", started);
+            if (!sendTextMessage(user, MSG_WHISPER, NULL, partner->username, content))
+                break;
+        }
+        // Wait for the whisper this step expects (the server also sends acknowledgements)
+        int got_whisper = 0;
+        while (!got_whisper && receiveMessage(user->socket_fd, &msg))
+            got_whisper = (msg.type == MSG_WHISPER);
+        if (!got_whisper)
+        {
+            user->failed++;
+            break;
+        }
+        unsigned long long sent_at;
+        if (is_pinger)
+        {
+            if (sscanf(msg.content, "ping %llu", &sent_at) == 1)
+                recordLatency(&user->samples, monotonicNanos() - sent_at); // Round trip
+            user->messages_received++;
+            pauseBetweenSends(config);
+        }
+        else if (!sendTextMessage(user, MSG_WHISPER, NULL, partner->username, msg.content))
+            break;
+    }
+}
+
+// File transfers: even users upload files_per_user files to their odd partner.
+// Latency runs from the upload request to the last byte arriving at the recipient.
+static void runFileUser(BenchRun *run, BenchUser *user)
+{
+    const BenchConfig *config = run->config;
+    int is_sender = (user->index % 2 == 0);
+    BenchUser *partner = &run->users[is_sender ? user->index + 1 : user->index - 1];
+    pthread_barrier_wait(&run->start_barrier);
+
+    Message msg;
+    for (int i = 0; i < config->files_per_user; ++i)
+    {
+        if (is_sender)
+        {
+            Message request;
+            memset(&request, 0, sizeof(request));
+            request.type = MSG_FILE_TRANSFER_REQUEST;
+            strncpy(request.sender, user->username, USERNAME_BUF_SIZE - 1);
+            strncpy(request.receiver, partner->username, USERNAME_BUF_SIZE - 1);
+            // The start time travels in the filename so the recipient can measure end to end.
+            snprintf(request.filename, FILENAME_BUF_SIZE, "bench_%d_%d_%llu.txt", user->index, i, monotonicNanos());
+            request.file_size = config->file_size;
+            if (!sendMessage(user->socket_fd, &request))
+                break;
+            user->messages_sent++;
+
+            int verdict = -1;
+            while (verdict < 0 && receiveMessage(user->socket_fd, &msg))
+            {
+                if (msg.type == MSG_FILE_TRANSFER_ACCEPT || msg.type == MSG_FILE_TRANSFER_REJECT || msg.type == MSG_ERROR)
+                    verdict = msg.type;
+            }
+            if (verdict != MSG_FILE_TRANSFER_ACCEPT || !sendRawBytes(user, config->file_size))
+            {
+                user->failed++;
+                continue;
+            }
+            pauseBetweenSends(config);
+        }
+        else
+        {
+            int got_file = 0;
+            while (!got_file && receiveMessage(user->socket_fd, &msg))
+                got_file = (msg.type == MSG_FILE_TRANSFER_DATA);
+            if (!got_file || !discardRawBytes(user, msg.file_size))
+            {
+                user->failed++;
+                break;
+            }
+            int sender_index, file_index;
+            unsigned long long sent_at;
+            if (sscanf(msg.filename, "bench_%d_%d_%llu", &sender_index, &file_index, &sent_at) == 3)
+                recordLatency(&user->samples, monotonicNanos() - sent_at);
+            user->messages_received++;
+        }
+    }
+}
+
+static void *benchUserThread(void *arg)
+{
+    BenchThreadArgs *args = (BenchThreadArgs *)arg;
+    BenchRun *run = args->run;
+    BenchUser *user = args->user;
+
+    if (run->scenario == SCENARIO_LOGIN)
+    {
+        runLoginUser(run, user);
+        return NULL;
+    }
+
+    snprintf(user->username, USERNAME_BUF_SIZE, "b%c%d", scenario_names[run->scenario][0], user->index);
+    if (!connectAndLogin(run->config, user))
+    {
+        user->failed++;
+        pthread_barrier_wait(&run->start_barrier); // Never leave the others waiting
+        return NULL;
+    }
+
+    switch (run->scenario)
+    {
+    case SCENARIO_BROADCAST:
+        runBroadcastUser(run, user);
+        break;
+    case SCENARIO_WHISPER:
+        runWhisperUser(run, user);
+        break;
+    case SCENARIO_FILE:
+        runFileUser(run, user);
+        break;
+    default:
+        break;
+    }
+    disconnectUser(user);
+    return NULL;
+}
+
+// Prints one result line: throughput of completed operations plus latency percentiles.
+static void reportScenario(const BenchRun *run)
+{
+    const BenchConfig *config = run->config;
+    size_t total_samples = 0;
+    unsigned long long completed = 0, sent = 0, expected = 0, failures = 0, bytes = 0;
+    for (int i = 0; i < config->user_count; ++i)
+    {
+        total_samples += run->users[i].samples.count;
+        completed += run->users[i].messages_received;
+        sent += run->users[i].messages_sent;
+        expected += run->users[i].expected_receives;
+        failures += (unsigned long long)run->users[i].failed;
+        bytes += run->users[i].bytes_received;
+    }
+    unsigned long long *merged = malloc((total_samples ? total_samples : 1) * sizeof(*merged));
+    size_t merged_count = 0;
+    for (int i = 0; merged && i < config->user_count; ++i)
+    {
+        memcpy(merged + merged_count, run->users[i].samples.values, run->users[i].samples.count * sizeof(*merged));
+        merged_count += run->users[i].samples.count;
+    }
+    if (merged)
+        qsort(merged, merged_count, sizeof(*merged), compareNanos);
+
+    double elapsed = (double)(run->finished_ns - run->started_ns) / 1e9;
+    if (elapsed <= 0)
+        elapsed = 1e-9;
+
+    printf("%-10s users=%-5d elapsed=%.3fs ", scenario_names[run->scenario], config->user_count, elapsed);
+    switch (run->scenario)
+    {
+    case SCENARIO_LOGIN:
+        printf("logins=%llu conn/s=%.1f", completed, (double)completed / elapsed);
+        break;
+    case SCENARIO_BROADCAST:
+        printf("sent=%llu delivered=%llu/%llu msg/s(in)=%.1f msg/s(out)=%.1f",
+               sent, completed, expected, (double)sent / elapsed, (double)completed / elapsed);
+        break;
+    case SCENARIO_WHISPER:
+        printf("round_trips=%llu msg/s=%.1f", completed, (double)(2 * completed) / elapsed);
+        break;
+    case SCENARIO_FILE:
+        printf("files=%llu files/s=%.1f MB/s=%.2f", completed, (double)completed / elapsed, (double)bytes / elapsed / 1e6);
+        break;
+    default:
+        break;
+    }
+    printf(" failures=%llu\n", failures);
+    printf("%-10s latency_us p50=%.1f p99=%.1f p999=%.1f max=%.1f%s\n", "",
+           percentileMicros(merged, merged_count, 50.0), percentileMicros(merged, merged_count, 99.0),
+           percentileMicros(merged, merged_count, 99.9), percentileMicros(merged, merged_count, 100.0),
+           run->scenario == SCENARIO_WHISPER ? " (round trip)" : "");
+    fflush(stdout);
+    free(merged);
+}
+
+static int runScenario(const BenchConfig *config, BenchScenario scenario)
+{
+    BenchRun run;
+    memset(&run, 0, sizeof(run));
+    run.config = config;
+    run.scenario = scenario;
+    run.users = calloc((size_t)config->user_count, sizeof(BenchUser));
+    BenchThreadArgs *args = calloc((size_t)config->user_count, sizeof(BenchThreadArgs));
+    pthread_t *threads = calloc((size_t)config->user_count, sizeof(pthread_t));
+    if (!run.users || !args || !threads)
+    {
+        fprintf(stderr, "Out of memory for %d users.\n", config->user_count);
+        free(run.users);
+        free(args);
+        free(threads);
+        return 0;
+    }
+    // The barrier includes the main thread, which starts the clock once everyone is ready.
+    pthread_barrier_init(&run.start_barrier, NULL, (unsigned)config->user_count + 1);
+
+    int started = 0;
+    for (int i = 0; i < config->user_count; ++i)
+    {
+        run.users[i].index = i;
+        run.users[i].socket_fd = -1;
+        args[i].run = &run;
+        args[i].user = &run.users[i];
+        if (pthread_create(&threads[i], NULL, benchUserThread, &args[i]) != 0)
+        {
+            fprintf(stderr, "Could not start user thread %d: %s\n", i, strerror(errno));
+            exit(EXIT_FAILURE); // The barrier would never open
+        }
+        ++started;
+    }
+    pthread_barrier_wait(&run.start_barrier);
+    run.started_ns = monotonicNanos();
+    for (int i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+    run.finished_ns = monotonicNanos();
+
+    reportScenario(&run);
+
+    pthread_barrier_destroy(&run.start_barrier);
+    for (int i = 0; i < config->user_count; ++i)
+        free(run.users[i].samples.values);
+    free(run.users);
+    free(args);
+    free(threads);
+    return 1;
+}
+
+static void printBenchUsage(const char *program)
+{
+    fprintf(stderr, "Usage: %s [options] <server_ip> <port>\n", program);
+    fprintf(stderr, "  --scenario=all|login|broadcast|whisper|file  Scenario to run (repeatable, default: all)\n");
+    fprintf(stderr, "  --users=N         Simulated users (default: %d; even for whisper/file)\n", BENCH_DEFAULT_USERS);
+    fprintf(stderr, "  --messages=N      Per user: login cycles, broadcasts or pings (default: %d)\n", BENCH_DEFAULT_MESSAGES);
+    fprintf(stderr, "  --files=N         Files per sending user (default: %d)\n", BENCH_DEFAULT_FILES);
+    fprintf(stderr, "  --file-size=BYTES Size of each transferred file (default: %d, max %d)\n", BENCH_DEFAULT_FILE_SIZE, MAX_FILE_SIZE);
+    fprintf(stderr, "  --interval-us=N   Pause between a user's sends (default: 0)\n");
+    fprintf(stderr, "  --fixed           Speak the original fixed-size protocol instead of frames\n");
+}
+
+static int parseBenchOptions(int argc, char *argv[], BenchConfig *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->user_count = BENCH_DEFAULT_USERS;
+    config->messages_per_user = BENCH_DEFAULT_MESSAGES;
+    config->files_per_user = BENCH_DEFAULT_FILES;
+    config->file_size = BENCH_DEFAULT_FILE_SIZE;
+    config->wire_protocol = WIRE_PROTOCOL_LATEST;
+
+    int any_scenario = 0, positional = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *arg = argv[i];
+        long value = 0;
+        if (strncmp(arg, "--scenario=", 11) == 0)
+        {
+            int matched = 0;
+            for (int s = 0; s < SCENARIO_COUNT; ++s)
+            {
+                if (strcmp(arg + 11, "all") == 0 || strcmp(arg + 11, scenario_names[s]) == 0)
+                {
+                    config->run_scenario[s] = 1;
+                    matched = 1;
+                }
+            }
+            if (!matched)
+                return 0;
+            any_scenario = 1;
+        }
+        else if (sscanf(arg, "--users=%ld", &value) == 1 && value >= 2 && value <= 100000)
+            config->user_count = (int)value;
+        else if (sscanf(arg, "--messages=%ld", &value) == 1 && value >= 1)
+            config->messages_per_user = (int)value;
+        else if (sscanf(arg, "--files=%ld", &value) == 1 && value >= 1)
+            config->files_per_user = (int)value;
+        else if (sscanf(arg, "--file-size=%ld", &value) == 1 && value >= 1 && value <= MAX_FILE_SIZE)
+            config->file_size = (size_t)value;
+        else if (sscanf(arg, "--interval-us=%ld", &value) == 1 && value >= 0)
+            config->interval_us = (int)value;
+        else if (strcmp(arg, "--fixed") == 0)
+            config->wire_protocol = WIRE_PROTOCOL_FIXED;
+        else if (arg[0] != '-' && positional == 0)
+        {
+            strncpy(config->server_ip, arg, sizeof(config->server_ip) - 1);
+            ++positional;
+        }
+        else if (arg[0] != '-' && positional == 1 && (config->port = atoi(arg)) > 0 && config->port <= 65535)
+            ++positional;
+        else
+            return 0;
+    }
+    if (!any_scenario)
+    {
+        for (int s = 0; s < SCENARIO_COUNT; ++s)
+            config->run_scenario[s] = 1;
+    }
+    if (config->user_count % 2 != 0 && (config->run_scenario[SCENARIO_WHISPER] || config->run_scenario[SCENARIO_FILE]))
+        config->user_count++; // Pairs need an even number of users
+    return positional == 2;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchConfig config;
+    if (!parseBenchOptions(argc, argv, &config))
+    {
+        printBenchUsage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("chatbench: %s:%d, %d users, %s protocol\n", config.server_ip, config.port, config.user_count,
+           config.wire_protocol == WIRE_PROTOCOL_FRAMED ? "framed" : "fixed");
+    for (int s = 0; s < SCENARIO_COUNT; ++s)
+    {
+        if (config.run_scenario[s] && !runScenario(&config, (BenchScenario)s))
+            return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -156,8 +156,7 @@ void processUserCommand(ClientState *client, const char *input)
     }
     else if (strcmp(command_buffer, "/exit") == 0)
     {
-        sendDisconnectSignal(client); // Notify server
-        client->connected = 0;        // Signal main loop and receiver thread to exit
+        client->exit_requested = 1; // The event loop disconnects once queued commands are done
     }
     else if (strcmp(command_buffer, "/help") == 0)
     {
@@ -186,16 +185,19 @@ void sendJoinRoomCommand(ClientState *client, const char *room_name)
     msg.sender[USERNAME_BUF_SIZE - 1] = '\0';
     msg.room[ROOM_NAME_BUF_SIZE - 1] = '\0';
 
-    if (!sendMessage(client->socket_fd, &msg))
+    if (!queueClientMessage(client, &msg))
     {
-        printf("\033[31mFailed to send join command to server. Connection may be lost.\033[0m\n");
-        // Consider setting client->connected = 0 or other more robust error handling for critical failures
+        printf("\033[31mFailed to queue join command for the server.\033[0m\n");
+        return;
     }
+    // Later commands may rely on the new room before the server has answered
+    strncpy(client->expected_room, room_name, ROOM_NAME_BUF_SIZE - 1);
+    client->expected_room[ROOM_NAME_BUF_SIZE - 1] = '\0';
 }
 
 void sendLeaveRoomCommand(ClientState *client)
 {
-    if (strlen(client->current_room) == 0)
+    if (strlen(client->expected_room) == 0)
     {
         printf("\033[31mYou are not currently in any room.\033[0m\n");
         return;
@@ -207,15 +209,17 @@ void sendLeaveRoomCommand(ClientState *client)
     msg.sender[USERNAME_BUF_SIZE - 1] = '\0';
     // Server knows which room the client is in, no need to send client->current_room
 
-    if (!sendMessage(client->socket_fd, &msg))
+    if (!queueClientMessage(client, &msg))
     {
-        printf("\033[31mFailed to send leave command to server. Connection may be lost.\033[0m\n");
+        printf("\033[31mFailed to queue leave command for the server.\033[0m\n");
+        return;
     }
+    memset(client->expected_room, 0, sizeof(client->expected_room));
 }
 
 void sendBroadcastCommand(ClientState *client, const char *message_content)
 {
-    if (strlen(client->current_room) == 0)
+    if (strlen(client->expected_room) == 0)
     {
         printf("\033[31mYou must be in a room to broadcast. Use /join <room_name> first.\033[0m\n");
         return;
@@ -235,16 +239,16 @@ void sendBroadcastCommand(ClientState *client, const char *message_content)
     memset(&msg, 0, sizeof(msg));
     msg.type = MSG_BROADCAST;
     strncpy(msg.sender, client->username, USERNAME_BUF_SIZE - 1);
-    strncpy(msg.room, client->current_room, ROOM_NAME_BUF_SIZE - 1); // Server uses this to route
+    strncpy(msg.room, client->expected_room, ROOM_NAME_BUF_SIZE - 1); // Server uses this to route
     strncpy(msg.content, message_content, MESSAGE_BUF_SIZE - 1);
     // Ensure null termination
     msg.sender[USERNAME_BUF_SIZE - 1] = '\0';
     msg.room[ROOM_NAME_BUF_SIZE - 1] = '\0';
     msg.content[MESSAGE_BUF_SIZE - 1] = '\0';
 
-    if (!sendMessage(client->socket_fd, &msg))
+    if (!queueClientMessage(client, &msg))
     {
-        printf("\033[31mFailed to send broadcast message. Connection may be lost.\033[0m\n");
+        printf("\033[31mFailed to queue broadcast message for the server.\033[0m\n");
     }
 }
 
@@ -282,9 +286,9 @@ void sendWhisperCommand(ClientState *client, const char *target_username, const
     msg.receiver[USERNAME_BUF_SIZE - 1] = '\0';
     msg.content[MESSAGE_BUF_SIZE - 1] = '\0';
 
-    if (!sendMessage(client->socket_fd, &msg))
+    if (!queueClientMessage(client, &msg))
     {
-        printf("\033[31mFailed to send whisper message. Connection may be lost.\033[0m\n");
+        printf("\033[31mFailed to queue whisper message for the server.\033[0m\n");
     }
 }
 
@@ -321,7 +325,7 @@ void sendFileRequestCommand(ClientState *client, const char *filepath, const cha
         return;
     }
 
-    // 1. Send File Transfer Request (Header with metadata only)
+    // 1. Build the File Transfer Request (Header with metadata only)
     Message msg_header;
     memset(&msg_header, 0, sizeof(msg_header));
     msg_header.type = MSG_FILE_TRANSFER_REQUEST;
@@ -335,47 +339,27 @@ void sendFileRequestCommand(ClientState *client, const char *filepath, const cha
     msg_header.receiver[USERNAME_BUF_SIZE - 1] = '\0';
     msg_header.filename[FILENAME_BUF_SIZE - 1] = '\0';
 
-    if (!sendMessage(client->socket_fd, &msg_header))
+    // Open the file now, so the upload sends what was there when the command was typed
+    // even if the file is renamed while earlier commands are still queued.
+    int file_fd = open(filepath, O_RDONLY);
+    if (file_fd < 0)
     {
-        printf("\033[31mFailed to send file transfer request header for '%s'. Connection may be lost.\033[0m\n", filename_ptr);
+        printf("\033[31mCould not open '%s' for upload: %s\033[0m\n", filepath, strerror(errno));
         return;
     }
 
-    // 2. Wait for server's response (Accept or Reject)
-    // This is a blocking receive. The receiver thread handles asynchronous messages.
-    // For simplicity in command flow, this specific response is handled here.
-    // A more complex UI might integrate this into the general message flow.
-    Message server_response;
-    if (!receiveMessage(client->socket_fd, &server_response))
+    // 2. The pipeline sends the request, waits for the server's accept or reject, and on
+    // acceptance streams the raw file bytes right behind it while chat keeps working.
+    if (!queueClientUpload(client, &msg_header, file_fd))
     {
-        printf("\033[31mFailed to receive server response for file transfer request. Connection may be lost.\033[0m\n");
-        // If connection is lost, main loops should handle exit.
+        close(file_fd);
+        printf("\033[31mFailed to queue file transfer request for '%s'.\033[0m\n", filename_ptr);
         return;
     }
-
-    // Process server response (specific to file transfer context)
-    if (server_response.type == MSG_FILE_TRANSFER_REJECT)
-    {
-        // Use red for rejection message from server
-        printf("\033[31m[SERVER]: File transfer rejected: %s (File: '%s')\033[0m\n", server_response.content, server_response.filename);
-    }
-    else if (server_response.type == MSG_FILE_TRANSFER_ACCEPT)
-    {
-        // Use green for acceptance message from server
-        printf("\033[32m[SERVER]: %s (File: '%s' to %s)\033[0m\n", server_response.content, server_response.filename, target_username);
-        // As per Q&A #10, actual binary transfer is not mandatory.
-        // Server handles the "transfer" (simulation) after this acceptance.
-        // Client does not need to send file data chunks.
-    }
-    else
-    {
-        // Unexpected response type from server
-        printf("\033[31m[SERVER]: Unexpected response type %d to file transfer request: %s\033[0m\n",
-               server_response.type, server_response.content);
-    }
+    printf("\033[36m[FILE]: '%s' (%ld bytes) queued for %s.\033[0m\n", filename_ptr, file_size, target_username);
 }
 
-// Sends a disconnect signal to the server.
+// Sends a disconnect signal to the server right away, bypassing the pipeline (used on SIGINT).
 // This is a best-effort notification.
 void sendDisconnectSignal(ClientState *client)
 {
@@ -5,28 +5,100 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <pthread.h>
+#include <time.h>
 #include <signal.h> // For sig_atomic_t, signal handling
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
-#include <fcntl.h>      // For fcntl, if needed for non-blocking
-#include <sys/select.h> // For select
+#include <fcntl.h> // For fcntl (non-blocking socket)
+#include <poll.h>  // For the event loop
 
 // Shared includes from the project
 #include "../shared/protocol.h"
 #include "../shared/utils.h"
 
+#define FILE_IO_CHUNK_SIZE 65536        // Bytes per read/send when streaming file contents
+#define UPLOAD_REPLY_TIMEOUT_SECONDS 10 // How long a /sendfile waits for the server's verdict before warning
+#define PIPELINE_DEPTH 32               // Commands queued or awaiting a reply before input is paused
+#define INPUT_LINE_SIZE (MESSAGE_BUF_SIZE + FILENAME_BUF_SIZE + 20)
+
+// Upload progress of a queued /sendfile
+typedef enum UploadState
+{
+    UPLOAD_SENDING_REQUEST,  // Transfer request not fully written yet
+    UPLOAD_AWAITING_VERDICT, // Request sent; nothing else may be sent until the server answers
+    UPLOAD_STREAMING         // Accepted; raw file bytes follow the request in-band
+} UploadState;
+
+// One command waiting to be written to the server. Items leave strictly in order.
+typedef struct OutboundItem
+{
+    MessageType type;                       // Command carried by unit
+    unsigned char unit[WIRE_UNIT_MAX_SIZE]; // Encoded message in the socket's wire protocol
+    size_t unit_len;
+    size_t unit_sent;
+
+    // Only used when type is MSG_FILE_TRANSFER_REQUEST
+    UploadState upload_state;
+    int file_fd;         // Opened when the command is typed
+    int use_sendfile;    // Cleared if sendfile() cannot be used for this file
+    size_t file_size;    // Bytes announced in the request
+    size_t file_sent;    // Raw bytes streamed so far
+    int progress_step;   // Last progress quarter printed
+    time_t verdict_deadline;
+    int verdict_warned;
+    char filename[FILENAME_BUF_SIZE];
+    char receiver[USERNAME_BUF_SIZE];
+} OutboundItem;
+
+// An incoming file: the raw bytes that follow a MSG_FILE_TRANSFER_DATA header
+typedef struct DownloadState
+{
+    int active;
+    int out_fd;           // -1 if the file could not be created; the data is then discarded
+    int splice_pipe[2];   // socket -> pipe -> file without passing through user space
+    int use_splice;
+    int write_failed;
+    size_t file_size;
+    size_t received;
+    int progress_step;
+    char path[FILENAME_BUF_SIZE + 16];
+    char filename[FILENAME_BUF_SIZE];
+    char sender[USERNAME_BUF_SIZE];
+} DownloadState;
+
 // Client state structure
+// A single thread runs the event loop, so none of this needs locking.
 typedef struct ClientState
 {
-    int socket_fd;                         // Socket descriptor for server connection
+    int socket_fd;                         // Socket descriptor for server connection (non-blocking after login)
     char username[USERNAME_BUF_SIZE];      // Client's chosen username
     char current_room[ROOM_NAME_BUF_SIZE]; // Current room client is in, empty if none
+    char expected_room[ROOM_NAME_BUF_SIZE]; // Room the client will be in once queued /join and /leave are answered
     volatile sig_atomic_t connected;       // Flag indicating connection status (1=connected, 0=disconnecting/disconnected)
-    pthread_t receiver_thread_id;          // Thread ID for the message receiver thread
-    int shutdown_pipe_fds[2];              // Pipe for signaling graceful shutdown between threads [0]=read, [1]=write
+    int shutdown_pipe_fds[2];              // Self-pipe written by the SIGINT handler [0]=read, [1]=write
+
+    // Commands not yet written, oldest first (a ring of PIPELINE_DEPTH items)
+    OutboundItem outbound[PIPELINE_DEPTH];
+    int outbound_head;
+    int outbound_count;
+
+    // Types of the commands sent and still waiting for their one reply, oldest first.
+    // The server answers every command exactly once and in order.
+    MessageType awaiting_replies[PIPELINE_DEPTH];
+    int awaiting_head;
+    int awaiting_count;
+
+    unsigned char inbound_buf[FILE_IO_CHUNK_SIZE]; // Received bytes not yet decoded
+    size_t inbound_len;
+    DownloadState download;
+
+    char input_buf[INPUT_LINE_SIZE]; // Typed bytes not yet ending in a newline
+    size_t input_len;
+    int input_eof;
+    int exit_requested;  // /exit or end of input: disconnect once everything queued is done
+    int disconnect_sent; // MSG_DISCONNECT queued; the server will close the connection
 } ClientState;
 
 // --- Function Declarations ---
@@ -34,25 +106,34 @@ typedef struct ClientState
 // Located in: client/main.c
 void signalHandlerClient(int sig);                     // Handles SIGINT for graceful shutdown
 void cleanupClientResources(ClientState *clientState); // Cleans up client resources (sockets, pipes)
-void *clientMessageReceiverThread(void *arg);          // Thread function to receive messages from server
-void handleUserInputLoop(ClientState *clientState);    // Main loop for handling user input
+void runClientEventLoop(ClientState *clientState);     // Multiplexes user input, server messages and file transfers
 
 // Located in: client/network.c
 int connectClientToServer(ClientState *clientState, const char *server_ip, int port); // Establishes connection to server
 int performClientLogin(ClientState *clientState);                                     // Handles the login process with the server
+int pipelineHasRoom(const ClientState *clientState);         // 1 if another command may be queued
+int pipelineIsIdle(const ClientState *clientState);          // 1 if nothing is queued, awaiting a reply or downloading
+int queueClientMessage(ClientState *clientState, const Message *msg);             // Queues a message behind earlier commands
+int queueClientUpload(ClientState *clientState, const Message *request, int file_fd); // Queues a /sendfile request and its data
+int hasPendingOutput(const ClientState *clientState);        // 1 if the socket should be polled for writing
+int flushClientOutput(ClientState *clientState);             // Writes as much queued output as the socket takes
+int popAwaitingReply(ClientState *clientState);              // Returns the oldest unanswered command type, or -1
+void handleUploadVerdict(ClientState *clientState, int verdict_type); // Starts or drops the upload awaiting a verdict
+void checkUploadVerdictTimeout(ClientState *clientState);    // Warns once about a slow verdict
+void printTransferProgress(const char *verb, const char *filename, size_t done, size_t total, int *progress_step);
 
 // Located in: client/commands.c
 // Utility to trim leading whitespace from a string (internal or for parsing)
 const char *trimLeadingWhitespace(const char *str);
 // Processes a command string entered by the user
 void processUserCommand(ClientState *clientState, const char *input_buffer);
-// Command handlers - these prepare and send specific messages to the server
+// Command handlers - these prepare and queue specific messages for the server
 void sendJoinRoomCommand(ClientState *clientState, const char *room_name);
 void sendLeaveRoomCommand(ClientState *clientState);
 void sendBroadcastCommand(ClientState *clientState, const char *message_content);
 void sendWhisperCommand(ClientState *clientState, const char *target_username, const char *message_content);
 void sendFileRequestCommand(ClientState *clientState, const char *filepath, const char *target_username);
-void sendDisconnectSignal(ClientState *clientState); // Sends a disconnect message to the server
+void sendDisconnectSignal(ClientState *clientState); // Sends a disconnect message to the server right away
 void displayHelpMessage(void);                       // Displays available commands to the user
 
 #endif // CLIENT_COMMON_H
\ No newline at end of file
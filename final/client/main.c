@@ -1,238 +1,523 @@
+#define _GNU_SOURCE // For splice()
 #include "common.h"
 #include <sys/stat.h>
 #include <libgen.h>
 
 static ClientState *g_clientState_ptr = NULL;
 
+// Only wakes the event loop; the disconnect itself is sent from there.
 void signalHandlerClient(int sig)
 {
-    if (sig == SIGINT && g_clientState_ptr != NULL && g_clientState_ptr->connected)
+    if (sig == SIGINT && g_clientState_ptr != NULL && g_clientState_ptr->shutdown_pipe_fds[1] != -1)
     {
-        printf("\n\033[33mSIGINT received. Attempting to disconnect gracefully...\033[0m\n");
-        sendDisconnectSignal(g_clientState_ptr);
-        g_clientState_ptr->connected = 0;
-        if (g_clientState_ptr->shutdown_pipe_fds[1] != -1)
+        int saved_errno = errno;
+        char signal_byte = 's';
+        if (write(g_clientState_ptr->shutdown_pipe_fds[1], &signal_byte, 1) == -1)
         {
-            char signal_byte = 's';
-            if (write(g_clientState_ptr->shutdown_pipe_fds[1], &signal_byte, 1) == -1)
+            // Pipe full: a wakeup is already pending
+        }
+        errno = saved_errno;
+    }
+}
+
+// Picks a local filename for an incoming file in the current directory.
+// Only the base name sent by the server is used; "file.txt" becomes "file_1.txt", "file_2.txt", ...
+// if a file with that name already exists.
+static void chooseDestinationFilename(const char *incoming_name, char *out_path, size_t out_size)
+{
+    const char *base_name = strrchr(incoming_name, '/');
+    base_name = base_name ? base_name + 1 : incoming_name;
+    snprintf(out_path, out_size, "%s", base_name);
+
+    const char *dot = strrchr(base_name, '.');
+    int stem_len = (dot && dot != base_name) ? (int)(dot - base_name) : (int)strlen(base_name);
+    const char *extension = (dot && dot != base_name) ? dot : "";
+
+    struct stat st;
+    for (int collision_num = 1; stat(out_path, &st) == 0; ++collision_num)
+    {
+        snprintf(out_path, out_size, "%.*s_%d%s", stem_len, base_name, collision_num, extension);
+    }
+}
+
+// Moves byte_count bytes that are already in the pipe into out_fd.
+// On a write error the rest is read out of the pipe and discarded. Returns 1 on success, 0 on error.
+static int drainPipeToFile(int pipe_read_fd, int out_fd, size_t byte_count)
+{
+    while (byte_count > 0)
+    {
+        ssize_t moved = splice(pipe_read_fd, NULL, out_fd, NULL, byte_count, SPLICE_F_MOVE);
+        if (moved < 0 && errno == EINTR)
+            continue;
+        if (moved <= 0)
+        {
+            int saved_errno = errno;
+            char discard[FILE_IO_CHUNK_SIZE];
+            while (byte_count > 0)
             {
-                // Non-critical, main loop will eventually see connected flag
+                ssize_t got = read(pipe_read_fd, discard, byte_count < sizeof(discard) ? byte_count : sizeof(discard));
+                if (got <= 0)
+                    break;
+                byte_count -= (size_t)got;
             }
+            errno = saved_errno;
+            return 0;
         }
+        byte_count -= (size_t)moved;
     }
+    return 1;
 }
 
-static void receiveAndSaveFile(ClientState *client, const Message *fileHeaderMsg)
+// Starts receiving the raw file bytes that follow a MSG_FILE_TRANSFER_DATA header.
+// The data is always drained from the socket, even if the file cannot be written,
+// so the message stream stays in sync.
+static void beginDownload(ClientState *client, const Message *fileHeaderMsg)
 {
-    // For simulation, we just acknowledge the receipt of the file transfer *header*
-    // We don't receive actual data or save a file.
+    DownloadState *download = &client->download;
+    memset(download, 0, sizeof(*download));
+    download->splice_pipe[0] = download->splice_pipe[1] = -1;
+    download->file_size = fileHeaderMsg->file_size;
+    strncpy(download->filename, fileHeaderMsg->filename, FILENAME_BUF_SIZE - 1);
+    strncpy(download->sender, fileHeaderMsg->sender, USERNAME_BUF_SIZE - 1);
+    chooseDestinationFilename(fileHeaderMsg->filename, download->path, sizeof(download->path));
+
+    download->out_fd = open(download->path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+    if (download->out_fd < 0)
+    {
+        printf("\033[31m[FILE]: Cannot create '%s': %s. Incoming data will be discarded.\033[0m\n",
+               download->path, strerror(errno));
+    }
+    download->use_splice = (download->out_fd >= 0 && pipe(download->splice_pipe) == 0);
+    download->active = 1;
+    printf("\033[35m[FILE]: Receiving '%s' (%zu bytes) from %s...\033[0m\n",
+           download->filename, download->file_size, download->sender);
+}
 
-    printf("\033[35m[FILE SIMULATION]: Received notification for file '%s' (%zu bytes) from %s.\033[0m\n",
-           fileHeaderMsg->filename, fileHeaderMsg->file_size, fileHeaderMsg->sender);
-    printf("\033[32m[FILE SIMULATION]: This is a simulated transfer. No actual file content was transmitted or saved.\033[0m\n");
+// Closes the finished (or abandoned) download and reports the result.
+static void finishDownload(ClientState *client)
+{
+    DownloadState *download = &client->download;
+    if (download->splice_pipe[0] >= 0)
+    {
+        close(download->splice_pipe[0]);
+        close(download->splice_pipe[1]);
+    }
+    if (download->out_fd >= 0)
+    {
+        close(download->out_fd);
+        if (download->write_failed || download->received != download->file_size)
+            unlink(download->path); // Do not leave a truncated file behind
+        else
+            printf("\r\033[K\033[35m[FILE]: Received '%s' (%zu bytes) from %s, saved as '%s'.\033[0m\n",
+                   download->filename, download->file_size, download->sender, download->path);
+    }
+    download->active = 0;
+}
 
-    // All original logic for buffer allocation, recv loop, file opening, writing is removed.
-    // Client remains connected.
+// Writes file bytes received from the socket to the download.
+static void storeDownloadBytes(ClientState *client, const void *data, size_t len)
+{
+    DownloadState *download = &client->download;
+    if (download->out_fd >= 0 && !download->write_failed && write(download->out_fd, data, len) != (ssize_t)len)
+    {
+        printf("\r\033[K\033[31m[FILE]: Write error on '%s': %s\033[0m\n", download->path, strerror(errno));
+        download->write_failed = 1;
+    }
+    download->received += len;
 }
 
-void *clientMessageReceiverThread(void *arg)
+// Moves one chunk of download data that has not been read from the socket yet straight into
+// the destination file, spliced socket -> pipe -> file without passing through user space;
+// recv()/write() is used if splice() is unavailable or the file could not be created.
+// Returns 1 on progress or if the socket has nothing right now, 0 if the connection is gone.
+static int receiveDownloadChunk(ClientState *client)
 {
-    ClientState *client = (ClientState *)arg;
-    Message received_msg;
+    DownloadState *download = &client->download;
+    size_t wanted = download->file_size - download->received;
+    if (wanted > FILE_IO_CHUNK_SIZE)
+        wanted = FILE_IO_CHUNK_SIZE; // Also keeps each splice within the default pipe capacity
 
-    // printf("\033[36mMessage receiver thread started.\033[0m\n");
+    ssize_t got;
+    if (download->use_splice && !download->write_failed)
+    {
+        got = splice(client->socket_fd, NULL, download->splice_pipe[1], NULL, wanted, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (got < 0 && (errno == EINVAL || errno == ENOSYS))
+        {
+            download->use_splice = 0; // Not supported for this socket/file pair
+            return 1;
+        }
+        if (got > 0)
+        {
+            if (!drainPipeToFile(download->splice_pipe[0], download->out_fd, (size_t)got))
+            {
+                printf("\r\033[K\033[31m[FILE]: Write error on '%s': %s\033[0m\n", download->path, strerror(errno));
+                download->write_failed = 1;
+            }
+            download->received += (size_t)got;
+        }
+    }
+    else
+    {
+        char chunk[FILE_IO_CHUNK_SIZE];
+        got = recv(client->socket_fd, chunk, wanted, MSG_DONTWAIT);
+        if (got > 0)
+            storeDownloadBytes(client, chunk, (size_t)got);
+    }
+    if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return 1;
+    if (got <= 0)
+    {
+        printf("\r\033[K\033[31m[FILE]: Connection lost while receiving '%s' (%zu of %zu bytes).\033[0m\n",
+               download->filename, download->received, download->file_size);
+        finishDownload(client);
+        return 0;
+    }
+    return 1;
+}
 
-    while (client->connected)
+// Reports download progress and closes the download once the last byte is in.
+static void updateDownloadProgress(ClientState *client)
+{
+    DownloadState *download = &client->download;
+    if (download->received < download->file_size)
+        printTransferProgress("Receiving", download->filename, download->received, download->file_size,
+                              &download->progress_step);
+    else
     {
-        fd_set read_fds;
-        FD_ZERO(&read_fds);
-        FD_SET(client->socket_fd, &read_fds);
+        finishDownload(client);
+        printf("> ");
+        fflush(stdout);
+    }
+}
 
-        struct timeval timeout;
-        timeout.tv_sec = 1;
-        timeout.tv_usec = 0;
+// Applies the reply to the oldest unanswered command (every command gets exactly one reply).
+static void handleCommandReply(ClientState *client, const Message *reply)
+{
+    int command_type = popAwaitingReply(client);
+    int succeeded = (reply->type == MSG_SUCCESS || reply->type == MSG_FILE_TRANSFER_ACCEPT);
 
-        int activity = select(client->socket_fd + 1, &read_fds, NULL, NULL, &timeout);
+    if (command_type == MSG_JOIN_ROOM)
+    {
+        if (succeeded && strlen(reply->room) > 0)
+            strncpy(client->current_room, reply->room, ROOM_NAME_BUF_SIZE - 1);
+        else if (!succeeded) // A failed switch leaves the client in no room
+            memset(client->current_room, 0, sizeof(client->current_room));
+    }
+    else if (command_type == MSG_LEAVE_ROOM)
+    {
+        memset(client->current_room, 0, sizeof(client->current_room));
+    }
+    else if (command_type == MSG_FILE_TRANSFER_REQUEST)
+    {
+        handleUploadVerdict(client, reply->type);
+    }
 
-        if (!client->connected)
-            break;
+    // With no /join or /leave still in flight, the server's view is the one to trust
+    int room_change_pending = 0;
+    for (int i = 0; i < client->awaiting_count; ++i)
+    {
+        MessageType type = client->awaiting_replies[(client->awaiting_head + i) % PIPELINE_DEPTH];
+        room_change_pending |= (type == MSG_JOIN_ROOM || type == MSG_LEAVE_ROOM);
+    }
+    for (int i = 0; i < client->outbound_count; ++i)
+    {
+        MessageType type = client->outbound[(client->outbound_head + i) % PIPELINE_DEPTH].type;
+        room_change_pending |= (type == MSG_JOIN_ROOM || type == MSG_LEAVE_ROOM);
+    }
+    if (!room_change_pending)
+        memcpy(client->expected_room, client->current_room, sizeof(client->expected_room));
+}
 
-        if (activity < 0)
+// Prints one message from the server and updates the client state it affects.
+static void handleServerMessage(ClientState *client, const Message *received_msg)
+{
+    fprintf(stdout, "\r\033[K");
+    switch (received_msg->type)
+    {
+    case MSG_BROADCAST:
+        if (strcmp(client->current_room, received_msg->room) == 0)
         {
-            if (errno == EINTR)
-                continue;
-            perror("\033[31mselect() error in receiver thread\033[0m");
+            printf("\033[36m[%s] %s: %s\033[0m\n",
+                   received_msg->room, received_msg->sender, received_msg->content);
+        }
+        break;
+    case MSG_WHISPER:
+        printf("\033[35m[WHISPER from %s]: %s\033[0m\n",
+               received_msg->sender, received_msg->content);
+        break;
+    case MSG_SERVER_NOTIFICATION: // Not a reply: room activity of other users
+        printf("\033[32m[SERVER]: %s\033[0m\n", received_msg->content);
+        break;
+    case MSG_SUCCESS:
+        handleCommandReply(client, received_msg);
+        if (strstr(received_msg->content, "Joined room") && strlen(received_msg->room) > 0)
+        {
+            printf("\033[32m[SERVER]: %s '%s'\033[0m\n", received_msg->content, received_msg->room);
+        }
+        else if (strstr(received_msg->content, "Disconnected. Goodbye!"))
+        {
+            printf("\033[33m[SERVER]: %s\033[0m\n", received_msg->content);
             client->connected = 0;
-            break;
         }
-        if (activity == 0)
+        else
+        {
+            printf("\033[32m[SERVER]: %s\033[0m\n", received_msg->content);
+        }
+        break;
+    case MSG_FILE_TRANSFER_ACCEPT: // Server accepted this client's upload: the data goes out next
+        printf("\033[32m[SERVER]: %s (Filename: %s)\033[0m\n", received_msg->content, received_msg->filename);
+        handleCommandReply(client, received_msg);
+        break;
+    case MSG_ERROR:
+    case MSG_LOGIN_FAILURE:
+    case MSG_FILE_TRANSFER_REJECT: // Server rejected this client's upload
+        printf("\033[31m[SERVER ERROR]: %s\033[0m\n", received_msg->content);
+        if (strstr(received_msg->content, "shutting down"))
+        {
+            client->connected = 0;
+        }
+        else if (!strstr(received_msg->content, "could not store the uploaded file"))
+        {
+            handleCommandReply(client, received_msg); // The storage error comes after an upload, unasked
+        }
+        break;
+    case MSG_FILE_TRANSFER_DATA: // This client is the *recipient*
+        beginDownload(client, received_msg);
+        break;
+    default:
+        printf("\033[33m[DEBUG] Received unhandled message type %d from server: %s\033[0m\n",
+               received_msg->type, received_msg->content);
+        break;
+    }
+    if (client->connected)
+    {
+        printf("> ");
+        fflush(stdout);
+    }
+}
+
+// Decodes every complete message in the inbound buffer. Bytes that belong to a download are
+// written to its file on the way. Returns 1 on success, 0 if the stream is malformed.
+static int processInboundBuffer(ClientState *client)
+{
+    int protocol_version = getSocketWireProtocol(client->socket_fd);
+    size_t offset = 0;
+    while (offset < client->inbound_len && client->connected)
+    {
+        size_t available = client->inbound_len - offset;
+        if (client->download.active)
+        {
+            size_t take = client->download.file_size - client->download.received;
+            if (take > available)
+                take = available;
+            storeDownloadBytes(client, client->inbound_buf + offset, take);
+            offset += take;
+            updateDownloadProgress(client);
             continue;
+        }
 
-        if (FD_ISSET(client->socket_fd, &read_fds))
+        size_t unit_len = messageWireUnitSize(protocol_version, client->inbound_buf + offset, available);
+        if (unit_len == 0)
         {
-            if (receiveMessage(client->socket_fd, &received_msg) <= 0)
-            {
-                if (client->connected)
-                {
-                    fprintf(stdout, "\r\033[K");
-                    printf("\n\033[31mConnection to server lost or server closed connection.\033[0m\n");
-                    client->connected = 0;
-                }
-                break;
-            }
+            printf("\r\033[K\033[31mMalformed message from server. Disconnecting.\033[0m\n");
+            return 0;
+        }
+        if (available < unit_len)
+            break; // Rest of the unit still in flight
 
-            fprintf(stdout, "\r\033[K");
-            switch (received_msg.type)
-            {
-            case MSG_BROADCAST:
-                if (strcmp(client->current_room, received_msg.room) == 0)
-                {
-                    printf("\033[36m[%s] %s: %s\033[0m\n",
-                           received_msg.room, received_msg.sender, received_msg.content);
-                }
-                break;
-            case MSG_WHISPER:
-                printf("\033[35m[WHISPER from %s]: %s\033[0m\n",
-                       received_msg.sender, received_msg.content);
-                break;
-            case MSG_SERVER_NOTIFICATION:
-            case MSG_SUCCESS:
-                if (strstr(received_msg.content, "Joined room") && strlen(received_msg.room) > 0)
-                {
-                    strncpy(client->current_room, received_msg.room, ROOM_NAME_BUF_SIZE - 1);
-                    printf("\033[32m[SERVER]: %s '%s'\033[0m\n", received_msg.content, received_msg.room);
-                }
-                else if (strstr(received_msg.content, "Left room"))
-                {
-                    printf("\033[32m[SERVER]: %s\033[0m\n", received_msg.content);
-                    memset(client->current_room, 0, sizeof(client->current_room));
-                }
-                else if (strstr(received_msg.content, "Disconnected. Goodbye!"))
-                {
-                    printf("\033[33m[SERVER]: %s\033[0m\n", received_msg.content);
-                    client->connected = 0;
-                }
-                else
-                {
-                    printf("\033[32m[SERVER]: %s\033[0m\n", received_msg.content);
-                }
-                break;
-            case MSG_FILE_TRANSFER_ACCEPT: // Server confirms file is queued/being processed for *sending* client
-                printf("\033[32m[SERVER]: %s (Filename: %s)\033[0m\n", received_msg.content, received_msg.filename);
-                break;
-            case MSG_ERROR:
-            case MSG_LOGIN_FAILURE:
-            case MSG_FILE_TRANSFER_REJECT: // Server rejected *sending* client's request
-                printf("\033[31m[SERVER ERROR]: %s\033[0m\n", received_msg.content);
-                if (strstr(received_msg.content, "shutting down"))
-                {
-                    client->connected = 0;
-                }
-                break;
-            case MSG_FILE_TRANSFER_DATA: // This client is the *recipient*
-                handleSimulatedFileReception(client, &received_msg);
-                if (!client->connected)
-                    goto receiver_loop_exit; // Exit if connection dropped during file save
-                break;
-            default:
-                printf("\033[33m[DEBUG] Received unhandled message type %d from server: %s\033[0m\n",
-                       received_msg.type, received_msg.content);
-                break;
-            }
-            if (client->connected)
-            {
-                printf("> ");
-                fflush(stdout);
-            }
+        Message received_msg;
+        if (!decodeMessageWireUnit(protocol_version, client->inbound_buf + offset, unit_len, &received_msg))
+        {
+            printf("\r\033[K\033[31mMalformed message from server. Disconnecting.\033[0m\n");
+            return 0;
         }
-    receiver_loop_exit:;
+        offset += unit_len;
+        handleServerMessage(client, &received_msg);
+        if (client->download.active && client->download.file_size == 0)
+            finishDownload(client);
     }
+    client->inbound_len -= offset;
+    memmove(client->inbound_buf, client->inbound_buf + offset, client->inbound_len);
+    return 1;
+}
 
-    if (client->shutdown_pipe_fds[1] != -1)
+// Reads whatever the server has sent. Download data past the buffered bytes bypasses the
+// buffer entirely. Returns 1 on success, 0 if the connection is gone.
+static int readServerInput(ClientState *client)
+{
+    if (client->download.active && client->inbound_len == 0)
     {
-        char signal_byte = 's';
-        write(client->shutdown_pipe_fds[1], &signal_byte, 1); // Best effort
+        if (!receiveDownloadChunk(client))
+            return 0;
+        updateDownloadProgress(client);
+        return 1;
+    }
+
+    ssize_t got = recv(client->socket_fd, client->inbound_buf + client->inbound_len,
+                       sizeof(client->inbound_buf) - client->inbound_len, MSG_DONTWAIT);
+    if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return 1;
+    if (got <= 0)
+    {
+        if (client->download.active)
+        {
+            printf("\r\033[K\033[31m[FILE]: Connection lost while receiving '%s' (%zu of %zu bytes).\033[0m\n",
+                   client->download.filename, client->download.received, client->download.file_size);
+            finishDownload(client);
+        }
+        return 0;
+    }
+    client->inbound_len += (size_t)got;
+    return processInboundBuffer(client);
+}
+
+// Runs the complete lines typed so far, as long as the pipeline has room for them.
+// At end of input a last line without a newline is run as well.
+static void processBufferedInput(ClientState *client)
+{
+    while (client->input_len > 0 && !client->exit_requested && client->connected && pipelineHasRoom(client))
+    {
+        char *newline = memchr(client->input_buf, '\n', client->input_len);
+        size_t line_len;
+        if (newline)
+            line_len = (size_t)(newline - client->input_buf);
+        else if (client->input_eof || client->input_len == sizeof(client->input_buf))
+            line_len = client->input_len; // Final or overlong line
+        else
+            break;
+
+        char line[INPUT_LINE_SIZE + 1];
+        memcpy(line, client->input_buf, line_len);
+        line[line_len] = '\0';
+        size_t consumed = newline ? line_len + 1 : line_len;
+        client->input_len -= consumed;
+        memmove(client->input_buf, client->input_buf + consumed, client->input_len);
+
+        if (line_len > 0 && line[line_len - 1] == '\r')
+            line[--line_len] = '\0';
+        if (line_len > 0)
+            processUserCommand(client, line);
+        if (client->connected && client->input_len == 0)
+        {
+            printf("> ");
+            fflush(stdout);
+        }
+    }
+}
+
+// Reads what the user typed (or a script piped in) without blocking the loop.
+static void readUserInput(ClientState *client)
+{
+    ssize_t got = read(STDIN_FILENO, client->input_buf + client->input_len, sizeof(client->input_buf) - client->input_len);
+    if (got < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (got <= 0)
+    {
+        client->input_eof = 1;
+        fprintf(stdout, "\r\033[K");
+        if (got == 0)
+            printf("\n\033[33mEOF detected on input. Disconnecting once queued commands are done...\033[0m\n");
+        else
+            printf("\n\033[31mError reading input. Disconnecting...\033[0m\n");
     }
-    if (!client->connected)
-    {                                // If loop exited due to disconnection
-        fprintf(stdout, "\r\033[K"); // Clear any partial input
+    else
+    {
+        client->input_len += (size_t)got;
     }
-    // printf("\033[36mMessage receiver thread stopped.\033[0m\n");
-    return NULL;
+    processBufferedInput(client);
+    if (client->input_eof && client->input_len == 0)
+        client->exit_requested = 1;
+}
+
+// 1 from the first byte of a transfer request to the last byte of its data: nothing else may be sent then.
+static int uploadInProgress(const ClientState *client)
+{
+    if (client->outbound_count == 0)
+        return 0;
+    const OutboundItem *item = &client->outbound[client->outbound_head];
+    return item->type == MSG_FILE_TRANSFER_REQUEST && (item->unit_sent > 0 || item->upload_state != UPLOAD_SENDING_REQUEST);
 }
 
-void handleUserInputLoop(ClientState *client)
+// Single-threaded client: one poll() waits on the socket, stdin and the SIGINT self-pipe.
+// Commands are queued and written as the socket allows, so several can be outstanding at once;
+// uploads and downloads move one chunk per wakeup, so a large transfer never freezes chat.
+void runClientEventLoop(ClientState *client)
 {
-    char input_buffer[MESSAGE_BUF_SIZE + FILENAME_BUF_SIZE + 20];
     printf("> ");
     fflush(stdout);
 
     while (client->connected)
     {
-        fd_set read_fds_input;
-        FD_ZERO(&read_fds_input);
-        FD_SET(STDIN_FILENO, &read_fds_input);
-        FD_SET(client->shutdown_pipe_fds[0], &read_fds_input);
-
-        int max_fd_input = (client->shutdown_pipe_fds[0] > STDIN_FILENO) ? client->shutdown_pipe_fds[0] : STDIN_FILENO;
-        int activity_input = select(max_fd_input + 1, &read_fds_input, NULL, NULL, NULL);
-
-        if (!client->connected)
+        // /exit and end of input wait for queued commands, their replies and running transfers
+        if (client->exit_requested && !client->disconnect_sent && pipelineIsIdle(client))
+        {
+            Message msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.type = MSG_DISCONNECT;
+            strncpy(msg.sender, client->username, USERNAME_BUF_SIZE - 1);
+            if (!queueClientMessage(client, &msg))
+                break;
+            client->disconnect_sent = 1;
+        }
+        if (hasPendingOutput(client) && !flushClientOutput(client))
+        {
+            client->connected = 0;
             break;
+        }
 
-        if (activity_input < 0)
+        struct pollfd fds[3];
+        fds[0].fd = client->socket_fd;
+        fds[0].events = POLLIN | (hasPendingOutput(client) ? POLLOUT : 0);
+        fds[1].fd = client->shutdown_pipe_fds[0];
+        fds[1].events = POLLIN;
+        // Stop reading input while the pipeline is full; the kernel buffers it meanwhile
+        int want_input = !client->input_eof && !client->exit_requested && pipelineHasRoom(client);
+        fds[2].fd = want_input ? STDIN_FILENO : -1;
+        fds[2].events = POLLIN;
+
+        int ready = poll(fds, 3, 1000); // Wakes up once a second for the upload verdict timeout
+        if (ready < 0)
         {
-            if (errno == EINTR && client->connected)
+            if (errno == EINTR)
                 continue;
-            perror("\033[31mselect() error in input loop\033[0m");
+            perror("\033[31mpoll() error in client event loop\033[0m");
             break;
         }
+        checkUploadVerdictTimeout(client);
+        if (ready == 0)
+            continue;
 
-        if (FD_ISSET(client->shutdown_pipe_fds[0], &read_fds_input))
+        if (fds[1].revents & POLLIN)
         {
-            char buf[1];
-            read(client->shutdown_pipe_fds[0], buf, 1); // Consume
+            char buf[16];
+            read(client->shutdown_pipe_fds[0], buf, sizeof(buf)); // Consume
+            printf("\r\033[K\n\033[33mSIGINT received. Attempting to disconnect gracefully...\033[0m\n");
+            // In the middle of a unit or an upload the server would read the disconnect as data
+            const OutboundItem *head = client->outbound_count > 0 ? &client->outbound[client->outbound_head] : NULL;
+            if (!uploadInProgress(client) && (head == NULL || head->unit_sent == 0))
+                sendDisconnectSignal(client);
             client->connected = 0;
             break;
         }
 
-        if (FD_ISSET(STDIN_FILENO, &read_fds_input))
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
         {
-            if (fgets(input_buffer, sizeof(input_buffer), stdin) != NULL)
+            if (!readServerInput(client))
             {
-                input_buffer[strcspn(input_buffer, "\n")] = '\0';
-
-                if (strlen(input_buffer) > 0)
+                if (client->connected && !client->disconnect_sent)
                 {
-                    processUserCommand(client, input_buffer);
-                }
-
-                if (client->connected)
-                {
-                    printf("> ");
-                    fflush(stdout);
-                }
-            }
-            else
-            {
-                fprintf(stdout, "\r\033[K");
-
-                if (feof(stdin))
-                {
-                    printf("\n\033[33mEOF detected on input. Disconnecting...\033[0m\n");
-                }
-                else
-                {
-                    printf("\n\033[31mError reading input. Disconnecting...\033[0m\n");
-                }
-                if (client->connected)
-                {
-                    sendDisconnectSignal(client);
+                    fprintf(stdout, "\r\033[K");
+                    printf("\n\033[31mConnection to server lost or server closed connection.\033[0m\n");
                 }
                 client->connected = 0;
                 break;
             }
         }
+
+        if (fds[2].fd >= 0 && (fds[2].revents & (POLLIN | POLLHUP | POLLERR)))
+            readUserInput(client);
+        else
+            processBufferedInput(client); // Lines held back while the pipeline was full
     }
     fprintf(stdout, "\r\033[K");
     printf("\033[36mInput handling stopped.\033[0m\n");
@@ -241,6 +526,28 @@ void handleUserInputLoop(ClientState *client)
 void cleanupClientResources(ClientState *clientState)
 {
     printf("\033[36mCleaning up client resources...\033[0m\n");
+    while (clientState->outbound_count > 0)
+    { // Close the files of uploads that never ran
+        OutboundItem *item = &clientState->outbound[clientState->outbound_head];
+        if (item->file_fd >= 0)
+            close(item->file_fd);
+        clientState->outbound_head = (clientState->outbound_head + 1) % PIPELINE_DEPTH;
+        clientState->outbound_count--;
+    }
+    if (clientState->download.active)
+    {
+        if (clientState->download.splice_pipe[0] >= 0)
+        {
+            close(clientState->download.splice_pipe[0]);
+            close(clientState->download.splice_pipe[1]);
+        }
+        if (clientState->download.out_fd >= 0)
+        {
+            close(clientState->download.out_fd);
+            unlink(clientState->download.path); // Incomplete
+        }
+        clientState->download.active = 0;
+    }
     if (clientState->socket_fd >= 0)
     {
         shutdown(clientState->socket_fd, SHUT_RDWR);
@@ -280,6 +587,7 @@ int main(int argc, char *argv[])
     clientStateInstance.socket_fd = -1;
     clientStateInstance.shutdown_pipe_fds[0] = -1;
     clientStateInstance.shutdown_pipe_fds[1] = -1;
+    clientStateInstance.download.out_fd = -1;
 
     g_clientState_ptr = &clientStateInstance;
 
@@ -293,6 +601,7 @@ int main(int argc, char *argv[])
     memset(&sa, 0, sizeof(sa));
     sa.sa_handler = signalHandlerClient;
     sigaction(SIGINT, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN); // A dead server shows up as a send error instead
 
     if (!connectClientToServer(&clientStateInstance, server_ip, port))
     {
@@ -308,28 +617,19 @@ int main(int argc, char *argv[])
 
     clientStateInstance.connected = 1;
 
-    if (pthread_create(&clientStateInstance.receiver_thread_id, NULL, clientMessageReceiverThread, &clientStateInstance) != 0)
+    // Login was blocking; from here on the event loop never waits on the socket itself
+    int socket_flags = fcntl(clientStateInstance.socket_fd, F_GETFL, 0);
+    if (socket_flags == -1 || fcntl(clientStateInstance.socket_fd, F_SETFL, socket_flags | O_NONBLOCK) == -1)
     {
-        perror("\033[31mFailed to create message receiver thread\033[0m");
-        clientStateInstance.connected = 0;
+        perror("\033[31mFailed to make the socket non-blocking\033[0m");
         sendDisconnectSignal(&clientStateInstance);
         cleanupClientResources(&clientStateInstance);
         return EXIT_FAILURE;
     }
 
-    handleUserInputLoop(&clientStateInstance);
+    runClientEventLoop(&clientStateInstance);
 
     clientStateInstance.connected = 0; // Ensure flag is set
-    if (clientStateInstance.socket_fd != -1)
-    {
-        shutdown(clientStateInstance.socket_fd, SHUT_RD);
-    }
-
-    if (pthread_join(clientStateInstance.receiver_thread_id, NULL) != 0)
-    {
-        perror("\033[31mError joining message receiver thread\033[0m");
-    }
-
     cleanupClientResources(&clientStateInstance);
     printf("\033[36mClient disconnected. Goodbye!\033[0m\n");
     return EXIT_SUCCESS;
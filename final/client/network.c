@@ -1,4 +1,5 @@
 #include "common.h"
+#include <sys/sendfile.h> // For zero-copy uploads
 
 // Establishes a TCP connection to the server.
 // Returns 1 on successful connection, 0 on failure.
@@ -39,12 +40,39 @@ int connectClientToServer(ClientState *clientState, const char *server_ip, int p
     return 1;
 }
 
+// Reads one line from stdin without stdio buffering, so commands piped in behind the
+// username are left for the event loop. Overlong lines are cut to fit.
+// Returns 1 if a line was read, 0 on EOF or error before any input.
+static int readInputLine(char *line, size_t line_size)
+{
+    size_t len = 0;
+    int got_any = 0;
+    char c;
+    ssize_t n;
+    while ((n = read(STDIN_FILENO, &c, 1)) != 0)
+    {
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        got_any = 1;
+        if (c == '\n')
+            break;
+        if (len < line_size - 1)
+            line[len++] = c;
+    }
+    line[len] = '\0';
+    return got_any;
+}
+
 // Handles the client login process.
 // Prompts user for username, sends login request, and processes server response.
 // Returns 1 on successful login, 0 on failure.
 int performClientLogin(ClientState *clientState)
 {
-    char username_input[USERNAME_BUF_SIZE];
+    char username_input[INPUT_LINE_SIZE]; // Longer than any valid name, so overlong input is rejected
     Message login_req_msg;
     Message server_response_msg;
 
@@ -54,12 +82,11 @@ int performClientLogin(ClientState *clientState)
         printf("Enter your username (alphanumeric, 1-%d chars): ", MAX_USERNAME_LEN);
         fflush(stdout); // Ensure prompt is displayed before input
 
-        if (fgets(username_input, sizeof(username_input), stdin) == NULL)
+        if (!readInputLine(username_input, sizeof(username_input)))
         {
             fprintf(stderr, "\n\033[31mFailed to read username (EOF or input error).\033[0m\n");
             return 0; // Critical input failure
         }
-        username_input[strcspn(username_input, "\n")] = '\0'; // Remove trailing newline
 
         if (isValidUsername(username_input))
         {
@@ -77,6 +104,7 @@ int performClientLogin(ClientState *clientState)
     strncpy(login_req_msg.sender, username_input, USERNAME_BUF_SIZE - 1);
     // Ensure null termination, though strncpy with USERNAME_BUF_SIZE-1 handles it if source is shorter or equal.
     login_req_msg.sender[USERNAME_BUF_SIZE - 1] = '\0';
+    login_req_msg.file_size = WIRE_PROTOCOL_LATEST; // Advertise framed protocol support; login itself stays fixed-size
 
     // Send login request to server
     if (!sendMessage(clientState->socket_fd, &login_req_msg))
@@ -97,6 +125,9 @@ int performClientLogin(ClientState *clientState)
     {
         strncpy(clientState->username, username_input, USERNAME_BUF_SIZE - 1);
         clientState->username[USERNAME_BUF_SIZE - 1] = '\0';        // Ensure null termination
+        // Switch to whatever the server agreed to (0 from servers that predate framing)
+        int agreed_protocol = (server_response_msg.file_size == WIRE_PROTOCOL_FRAMED) ? WIRE_PROTOCOL_FRAMED : WIRE_PROTOCOL_FIXED;
+        setSocketWireProtocol(clientState->socket_fd, agreed_protocol);
         printf("\033[32m%s\033[0m\n", server_response_msg.content); // Display server's success message
         printf("\033[36mWelcome, %s! Type /help for a list of commands.\033[0m\n", clientState->username);
         return 1; // Login successful
@@ -112,4 +143,256 @@ int performClientLogin(ClientState *clientState)
                server_response_msg.type, server_response_msg.content);
         return 0; // Unexpected response
     }
-}
\ No newline at end of file
+}
+// --- Outbound pipeline ---
+// Commands are encoded when typed and written in order as the socket takes them, so several
+// can be outstanding at once. A /sendfile stops the pipeline once its request is out: the server
+// reads whatever follows an accepted request as file data, so nothing else may be sent until
+// the verdict arrives and the last raw byte has been streamed.
+
+int pipelineHasRoom(const ClientState *client)
+{
+    return client->outbound_count + client->awaiting_count < PIPELINE_DEPTH;
+}
+
+int pipelineIsIdle(const ClientState *client)
+{
+    return client->outbound_count == 0 && client->awaiting_count == 0 && !client->download.active;
+}
+
+// Reserves the next outbound slot and encodes msg into it. Returns NULL if the pipeline is full.
+static OutboundItem *appendOutboundItem(ClientState *client, const Message *msg)
+{
+    if (!pipelineHasRoom(client))
+        return NULL;
+    OutboundItem *item = &client->outbound[(client->outbound_head + client->outbound_count) % PIPELINE_DEPTH];
+    memset(item, 0, sizeof(*item));
+    item->type = msg->type;
+    item->file_fd = -1;
+    if (getSocketWireProtocol(client->socket_fd) == WIRE_PROTOCOL_FRAMED)
+    {
+        item->unit_len = encodeMessageFrame(msg, item->unit, sizeof(item->unit));
+        if (item->unit_len == 0)
+            return NULL;
+    }
+    else
+    {
+        memcpy(item->unit, msg, sizeof(Message));
+        item->unit_len = sizeof(Message);
+    }
+    client->outbound_count++;
+    return item;
+}
+
+// Queues a message behind everything typed before it.
+// Returns 1 on success, 0 if the pipeline is full or the message cannot be encoded.
+int queueClientMessage(ClientState *client, const Message *msg)
+{
+    return appendOutboundItem(client, msg) != NULL;
+}
+
+// Queues a file transfer request; file_fd is streamed once the server accepts it and is
+// closed by the pipeline in every case. Returns 1 on success, 0 if nothing was queued.
+int queueClientUpload(ClientState *client, const Message *request, int file_fd)
+{
+    OutboundItem *item = appendOutboundItem(client, request);
+    if (!item)
+        return 0;
+    item->upload_state = UPLOAD_SENDING_REQUEST;
+    item->file_fd = file_fd;
+    item->use_sendfile = 1;
+    item->file_size = request->file_size;
+    strncpy(item->filename, request->filename, FILENAME_BUF_SIZE - 1);
+    item->filename[FILENAME_BUF_SIZE - 1] = '\0';
+    strncpy(item->receiver, request->receiver, USERNAME_BUF_SIZE - 1);
+    item->receiver[USERNAME_BUF_SIZE - 1] = '\0';
+    return 1;
+}
+
+int hasPendingOutput(const ClientState *client)
+{
+    if (client->outbound_count == 0)
+        return 0;
+    const OutboundItem *item = &client->outbound[client->outbound_head];
+    return item->type != MSG_FILE_TRANSFER_REQUEST || item->upload_state != UPLOAD_AWAITING_VERDICT;
+}
+
+static void popOutboundItem(ClientState *client)
+{
+    OutboundItem *item = &client->outbound[client->outbound_head];
+    if (item->file_fd >= 0)
+        close(item->file_fd);
+    item->file_fd = -1;
+    client->outbound_head = (client->outbound_head + 1) % PIPELINE_DEPTH;
+    client->outbound_count--;
+}
+
+static void pushAwaitingReply(ClientState *client, MessageType type)
+{
+    client->awaiting_replies[(client->awaiting_head + client->awaiting_count) % PIPELINE_DEPTH] = type;
+    client->awaiting_count++; // Never overflows: sent commands left the outbound ring first
+}
+
+int popAwaitingReply(ClientState *client)
+{
+    if (client->awaiting_count == 0)
+        return -1;
+    MessageType type = client->awaiting_replies[client->awaiting_head];
+    client->awaiting_head = (client->awaiting_head + 1) % PIPELINE_DEPTH;
+    client->awaiting_count--;
+    return type;
+}
+
+// Prints a progress line each time a transfer passes another quarter of its size.
+void printTransferProgress(const char *verb, const char *filename, size_t done, size_t total, int *progress_step)
+{
+    int step = total > 0 ? (int)((done * 4) / total) : 4;
+    if (step <= *progress_step || step >= 4)
+        return; // Completion is reported by the caller
+    *progress_step = step;
+    printf("\r\033[K\033[36m[FILE]: %s '%s': %d%% (%zu of %zu bytes)\033[0m\n> ", verb, filename, step * 25, done, total);
+    fflush(stdout);
+}
+
+// Streams at most FILE_IO_CHUNK_SIZE bytes of an accepted upload, so a large file shares the
+// event loop with chat. The kernel copies the file with sendfile(); pread()/send() takes over if
+// that is not possible. If the file shrank since it was announced, the rest is zero-padded so
+// the server's read stays in sync.
+// Returns 1 when the upload is complete, 0 if more remains, -1 on a connection error.
+static int streamUploadSlice(ClientState *client, OutboundItem *item)
+{
+    size_t wanted = item->file_size - item->file_sent;
+    if (wanted > FILE_IO_CHUNK_SIZE)
+        wanted = FILE_IO_CHUNK_SIZE;
+
+    ssize_t sent_now = -1;
+    if (item->use_sendfile)
+    {
+        off_t offset = (off_t)item->file_sent;
+        sent_now = sendfile(client->socket_fd, item->file_fd, &offset, wanted);
+        if (sent_now < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return 0;
+        if (sent_now < 0 && errno != EINVAL && errno != ENOSYS)
+            goto connection_error;
+        if (sent_now <= 0)
+            item->use_sendfile = 0; // File shrank, or sendfile() unsupported here
+    }
+    if (!item->use_sendfile)
+    {
+        char chunk[FILE_IO_CHUNK_SIZE];
+        ssize_t got = pread(item->file_fd, chunk, wanted, (off_t)item->file_sent);
+        if (got <= 0)
+        { // EOF or read error before file_size bytes: pad with zeros
+            memset(chunk, 0, wanted);
+            got = (ssize_t)wanted;
+        }
+        sent_now = send(client->socket_fd, chunk, (size_t)got, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent_now < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return 0;
+        if (sent_now <= 0)
+            goto connection_error;
+    }
+    item->file_sent += (size_t)sent_now;
+
+    if (item->file_sent < item->file_size)
+    {
+        printTransferProgress("Uploading", item->filename, item->file_sent, item->file_size, &item->progress_step);
+        return 0;
+    }
+    printf("\r\033[K\033[32mUploaded '%s' (%zu bytes) for %s.\033[0m\n> ", item->filename, item->file_size, item->receiver);
+    fflush(stdout);
+    return 1;
+
+connection_error:
+    printf("\r\033[K\033[31mConnection error while uploading '%s' (%zu of %zu bytes sent).\033[0m\n",
+           item->filename, item->file_sent, item->file_size);
+    return -1;
+}
+
+// Writes queued output until the socket is full, the pipeline waits on an upload verdict,
+// or one upload slice has been sent (the loop comes back for the next one).
+// Returns 1 on success, 0 if the connection failed.
+int flushClientOutput(ClientState *client)
+{
+    while (client->outbound_count > 0)
+    {
+        OutboundItem *item = &client->outbound[client->outbound_head];
+        if (item->unit_sent < item->unit_len)
+        {
+            ssize_t sent_now = send(client->socket_fd, item->unit + item->unit_sent, item->unit_len - item->unit_sent,
+                                    MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent_now < 0 && errno == EINTR)
+                continue;
+            if (sent_now < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                return 1;
+            if (sent_now <= 0)
+            {
+                printf("\r\033[K\033[31mFailed to send to server: %s\033[0m\n", strerror(errno));
+                return 0;
+            }
+            item->unit_sent += (size_t)sent_now;
+            continue;
+        }
+
+        if (item->type != MSG_FILE_TRANSFER_REQUEST)
+        {
+            pushAwaitingReply(client, item->type);
+            popOutboundItem(client);
+            continue;
+        }
+
+        switch (item->upload_state)
+        {
+        case UPLOAD_SENDING_REQUEST:
+            pushAwaitingReply(client, item->type);
+            item->upload_state = UPLOAD_AWAITING_VERDICT;
+            item->verdict_deadline = time(NULL) + UPLOAD_REPLY_TIMEOUT_SECONDS;
+            return 1;
+        case UPLOAD_AWAITING_VERDICT:
+            return 1;
+        case UPLOAD_STREAMING:
+        {
+            int result = streamUploadSlice(client, item);
+            if (result < 0)
+                return 0;
+            if (result == 0)
+                return 1;
+            popOutboundItem(client);
+            break;
+        }
+        }
+    }
+    return 1;
+}
+
+// Applies the server's answer to the /sendfile request at the head of the pipeline:
+// an accept starts streaming, anything else drops the upload.
+void handleUploadVerdict(ClientState *client, int verdict_type)
+{
+    if (client->outbound_count == 0)
+        return;
+    OutboundItem *item = &client->outbound[client->outbound_head];
+    if (item->type != MSG_FILE_TRANSFER_REQUEST || item->upload_state != UPLOAD_AWAITING_VERDICT)
+        return;
+    if (verdict_type == MSG_FILE_TRANSFER_ACCEPT)
+        item->upload_state = UPLOAD_STREAMING;
+    else
+        popOutboundItem(client); // The rejection itself was already printed
+}
+
+// A late verdict still has to be waited for (an accept would turn whatever is sent next into
+// file data), so a slow server only gets a warning.
+void checkUploadVerdictTimeout(ClientState *client)
+{
+    if (client->outbound_count == 0)
+        return;
+    OutboundItem *item = &client->outbound[client->outbound_head];
+    if (item->type == MSG_FILE_TRANSFER_REQUEST && item->upload_state == UPLOAD_AWAITING_VERDICT &&
+        !item->verdict_warned && time(NULL) >= item->verdict_deadline)
+    {
+        item->verdict_warned = 1;
+        printf("\r\033[K\033[33mNo response yet from server to file transfer request for '%s'; still waiting.\033[0m\n> ",
+               item->filename);
+        fflush(stdout);
+    }
+}
@@ -6,7 +6,7 @@ SERVER_PORT="5000"     # Change if your server is on a different port
 NUM_CLIENTS=30         # Number of clients to launch
 CLIENT_EXECUTABLE="./chatclient"
 LOG_PREFIX="client_log_"
-COMMAND_DELAY=1 # Seconds to wait between sending commands for a client
+COMMAND_DELAY=0 # Seconds between commands; the client pipelines them, so 0 sends a burst
 INTER_CLIENT_DELAY=0.1 # Seconds to wait between launching each client
 
 # --- Basic Command Sequences for Clients ---
@@ -40,13 +40,12 @@ run_client() {
 
     echo "Starting client ${client_id} (Username: ${username}) logging to ${log_file}"
 
-    # Use expect or a named pipe for more controlled interaction.
-    # For simplicity here, we'll pipe commands. This is less robust for interactive prompts.
-    # This assumes your client reads commands line by line after login.
+    # Commands are piped in. The client queues whatever arrives while it is still logging in
+    # or waiting for replies, and at /exit (or end of input) it finishes queued commands and
+    # file transfers before disconnecting, so no sleeps are needed for correctness.
 
     (
         echo "${username}" # Send username for login prompt
-        sleep 1 # Wait for login to complete
 
         for cmd in "${commands_to_run[@]}"; do
             # Replace dynamic parts if needed, e.g., for specific recipient in sendfile
@@ -55,7 +54,6 @@ run_client() {
             sleep "${COMMAND_DELAY}"
         done
         echo "/exit"
-        sleep 1 # Give time for exit command to be processed
     ) | "${CLIENT_EXECUTABLE}" "${SERVER_IP}" "${SERVER_PORT}" > "${log_file}" 2>&1 &
     # The '&' runs the client in the background
 }
@@ -81,14 +79,10 @@ for i in $(seq 1 "${NUM_CLIENTS}"); do
 done
 
 echo "All ${NUM_CLIENTS} clients launched. Check client_logs/ directory for individual logs."
-echo "Waiting for clients to finish (this is a rough estimate)..."
-
-# Wait for a while for clients to do their thing.
-# A more robust way would be to monitor PIDs, but this is simpler for now.
-# Adjust the total wait time based on your COMMAND_DELAY and number of commands.
-TOTAL_WAIT_TIME=$(echo "$NUM_CLIENTS * $COMMAND_DELAY * 5 + 10" | bc) # Rough estimate
-echo "Script will exit in approximately ${TOTAL_WAIT_TIME} seconds."
-sleep 15
+echo "Waiting for clients to finish..."
+
+# Each client exits on its own once its commands are done
+wait
 
 echo "Script finished."
 echo "Remember to check server.log and the client_logs/ directory."
\ No newline at end of file
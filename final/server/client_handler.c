@@ -1,5 +1,8 @@
 #include "common.h"
 
+// ClientInfo structures are recycled: a connect/disconnect storm reuses the same few slabs
+static MemoryPool client_info_pool = MEMORY_POOL_INITIALIZER("client_info", sizeof(ClientInfo));
+
 // Registers a new client connection on the server.
 // Allocates ClientInfo, adds to server's list. Does NOT handle login.
 // Returns pointer to ClientInfo on success, NULL on failure (e.g., max clients, malloc error).
@@ -12,7 +15,7 @@ ClientInfo *registerNewClientOnServer(int client_socket_fd, struct sockaddr_in c
         return NULL;
     }
 
-    ClientInfo *new_client_info = malloc(sizeof(ClientInfo));
+    ClientInfo *new_client_info = poolAllocate(&client_info_pool);
     if (!new_client_info)
     {
         logServerEvent("ERROR", "Memory allocation failed for new ClientInfo structure.");
@@ -22,16 +25,29 @@ ClientInfo *registerNewClientOnServer(int client_socket_fd, struct sockaddr_in c
     memset(new_client_info, 0, sizeof(ClientInfo)); // Initialize all fields
 
     new_client_info->socket_fd = client_socket_fd;
+    new_client_info->wire_protocol = WIRE_PROTOCOL_FIXED;
+    setSocketWireProtocol(client_socket_fd, WIRE_PROTOCOL_FIXED); // fd numbers are reused across connections
     new_client_info->client_address = client_address_info;
     new_client_info->is_active = 0; // Client is not active (logged in) yet
     new_client_info->connection_time = time(NULL);
     new_client_info->num_received_files = 0; // For filename collision tracking
+    new_client_info->reference_count = 1;    // Owned by the registry until unregisterClient
+    new_client_info->upload_spool_fd = -1;   // No file upload in progress
+    new_client_info->client_slot_index = -1; // Set once a slot is taken below
 
     // Initialize mutex for this client's received_filenames list
     if (pthread_mutex_init(&new_client_info->received_files_lock, NULL) != 0)
     {
         logServerEvent("ERROR", "Failed to initialize received_files_lock for client_fd %d: %s", client_socket_fd, strerror(errno));
-        free(new_client_info);
+        poolRelease(&client_info_pool, new_client_info);
+        close(client_socket_fd);
+        return NULL;
+    }
+    if (!initializeClientOutboundQueue(new_client_info))
+    {
+        logServerEvent("ERROR", "Failed to initialize outbound queue for client_fd %d: %s", client_socket_fd, strerror(errno));
+        pthread_mutex_destroy(&new_client_info->received_files_lock);
+        poolRelease(&client_info_pool, new_client_info);
         close(client_socket_fd);
         return NULL;
     }
@@ -39,24 +55,28 @@ ClientInfo *registerNewClientOnServer(int client_socket_fd, struct sockaddr_in c
     // Add to the global list of clients
     pthread_mutex_lock(&g_server_state->clients_list_mutex);
     int client_slot_idx = -1;
-    for (int i = 0; i < MAX_SERVER_CLIENTS; ++i)
+    if (g_server_state->free_client_slot_count > 0)
     {
-        if (g_server_state->connected_clients[i] == NULL) // Find an empty slot
-        {
-            g_server_state->connected_clients[i] = new_client_info;
-            client_slot_idx = i;
-            break;
-        }
+        client_slot_idx = g_server_state->free_client_slots[--g_server_state->free_client_slot_count];
+        g_server_state->connected_clients[client_slot_idx] = new_client_info;
+        new_client_info->client_slot_index = client_slot_idx;
     }
     pthread_mutex_unlock(&g_server_state->clients_list_mutex);
 
     if (client_slot_idx == -1) // No available slot
     {
         logServerEvent("WARNING", "Server at maximum client capacity (%d). New connection from %s rejected.",
-                       MAX_SERVER_CLIENTS, inet_ntoa(client_address_info.sin_addr));
-        sendErrorToClient(client_socket_fd, "Server is currently at maximum capacity. Please try again later.");
+                       g_server_state->max_clients, inet_ntoa(client_address_info.sin_addr));
+        // The client never reaches a reactor loop, so reply directly on the socket.
+        Message full_msg;
+        memset(&full_msg, 0, sizeof(full_msg));
+        full_msg.type = MSG_ERROR;
+        strncpy(full_msg.sender, "SERVER", USERNAME_BUF_SIZE - 1);
+        strncpy(full_msg.content, "Server is currently at maximum capacity. Please try again later.", MESSAGE_BUF_SIZE - 1);
+        sendMessage(client_socket_fd, &full_msg);
+        destroyClientOutboundQueue(new_client_info);
         pthread_mutex_destroy(&new_client_info->received_files_lock); // Clean up initialized mutex
-        free(new_client_info);
+        poolRelease(&client_info_pool, new_client_info);
         close(client_socket_fd);
         return NULL;
     }
@@ -73,7 +93,7 @@ int processClientLogin(ClientInfo *client_info, const Message *login_message)
     if (!client_info || !login_message || login_message->type != MSG_LOGIN || !g_server_state)
     {
         if (client_info && client_info->socket_fd >= 0)
-            sendErrorToClient(client_info->socket_fd, "Invalid login sequence or internal server error.");
+            sendErrorToClient(client_info, "Invalid login sequence or internal server error.");
         return 0; // Invalid parameters or state
     }
 
@@ -89,163 +109,63 @@ int processClientLogin(ClientInfo *client_info, const Message *login_message)
         fail_msg.type = MSG_LOGIN_FAILURE;
         strncpy(fail_msg.content, "Invalid username: Must be alphanumeric, 1-16 characters, no spaces.", MESSAGE_BUF_SIZE - 1);
         fail_msg.content[MESSAGE_BUF_SIZE - 1] = '\0';
-        sendMessage(client_info->socket_fd, &fail_msg);
+        queueMessageToClient(client_info, &fail_msg);
         return 0;
     }
 
-    // Check for duplicate username (requires clients_list_mutex)
-    pthread_mutex_lock(&g_server_state->clients_list_mutex);
-    // findClientByUsername checks for active clients with the same name.
-    if (findClientByUsername(login_message->sender) != NULL)
+    // Check for duplicate username. The name's index stripe stays write-locked until the
+    // client is indexed, so two logins with the same name cannot both succeed.
+    // Users of other cluster nodes count too (as far as their announcements have arrived).
+    NameIndex *client_index = &g_server_state->client_name_index;
+    pthread_rwlock_t *stripe_lock = nameIndexLockFor(client_index, login_message->sender);
+    pthread_rwlock_wrlock(stripe_lock);
+    if (nameIndexLookupLocked(client_index, login_message->sender) != NULL ||
+        clusterFindUserNode(login_message->sender) >= 0)
     {
-        pthread_mutex_unlock(&g_server_state->clients_list_mutex);
+        pthread_rwlock_unlock(stripe_lock);
         logEventClientLoginFailed(login_message->sender, client_ip_str, "Duplicate username."); // Matches PDF log
         Message fail_msg;
         memset(&fail_msg, 0, sizeof(fail_msg));
         fail_msg.type = MSG_LOGIN_FAILURE;
         strncpy(fail_msg.content, "Username already taken. Please choose another.", MESSAGE_BUF_SIZE - 1);
         fail_msg.content[MESSAGE_BUF_SIZE - 1] = '\0';
-        sendMessage(client_info->socket_fd, &fail_msg);
+        queueMessageToClient(client_info, &fail_msg);
         return 0;
     }
 
     // Username is valid and unique. Proceed with login.
-    strncpy(client_info->username, login_message->sender, USERNAME_BUF_SIZE - 1);
-    client_info->username[USERNAME_BUF_SIZE - 1] = '\0'; // Ensure null termination
-    client_info->is_active = 1;                          // Mark client as active (logged in)
-    g_server_state->active_client_count++;               // Increment server's active client counter
-    pthread_mutex_unlock(&g_server_state->clients_list_mutex);
+    // Negotiate the wire protocol: the client advertises its highest version in file_size.
+    int agreed_protocol = (login_message->file_size >= WIRE_PROTOCOL_LATEST) ? WIRE_PROTOCOL_LATEST : WIRE_PROTOCOL_FIXED;
 
-    logEventClientConnected(client_info->username, client_ip_str); // Use specific log function
+    // The reply is always a fixed struct, and it must be queued before anything encoded
+    // in the new protocol. Queue it while the client is still invisible to other threads
+    // (not indexed yet, stripe lock held) so no whisper or notification can overtake it.
     Message success_msg;
     memset(&success_msg, 0, sizeof(success_msg));
     success_msg.type = MSG_LOGIN_SUCCESS;
     strncpy(success_msg.content, "Login successful. Welcome to the chat server!", MESSAGE_BUF_SIZE - 1);
     success_msg.content[MESSAGE_BUF_SIZE - 1] = '\0';
-    sendMessage(client_info->socket_fd, &success_msg);
-    return 1; // Login successful
-}
-
-// Main thread function for handling a single client connection.
-// Manages login, message loop, and disconnection.
-void *clientConnectionThreadHandler(void *client_info_ptr_arg)
-{
-    ClientInfo *client = (ClientInfo *)client_info_ptr_arg;
-    Message received_message;
-    int is_unexpected_disconnect = 1; // Assume unexpected until graceful disconnect
-
-    // Detach the thread as per project Q&A, allowing it to clean up its own resources.
-    // The server main thread will not join these client handler threads.
-    pthread_detach(pthread_self());
-
-    if (!g_server_state)
-    {
-        logServerEvent("CRITICAL_THREAD", "g_server_state is NULL in client thread for fd %d. Terminating handler.", client ? client->socket_fd : -1);
-        if (client)
-        { // Minimal cleanup if client struct exists
-            if (client->socket_fd >= 0)
-                close(client->socket_fd);
-            pthread_mutex_destroy(&client->received_files_lock); // Attempt to destroy client-specific mutex
-            free(client);
-        }
-        return NULL;
-    }
-
-    // --- Login Phase ---
-    // Expecting the first message from client to be MSG_LOGIN
-    if (receiveMessage(client->socket_fd, &received_message) <= 0)
-    {
-        // Client disconnected before sending any message, or read error.
-        char client_ip_str[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &client->client_address.sin_addr, client_ip_str, INET_ADDRSTRLEN);
-        logServerEvent("INFO", "Client (fd %d from %s) disconnected before login attempt or initial read error.", client->socket_fd, client_ip_str);
-        unregisterClient(client, 1); // Treat as unexpected, clean up client slot
-        return NULL;
-    }
-
-    if (!processClientLogin(client, &received_message))
-    {
-        // Login failed (e.g., bad username, duplicate). processClientLogin sent error to client.
-        unregisterClient(client, 1); // Clean up client slot
-        return NULL;
-    }
-    // Client is now logged in and active. client->is_active = 1.
+    success_msg.file_size = (size_t)agreed_protocol;
+    queueMessageToClientWithProtocol(client_info, &success_msg, WIRE_PROTOCOL_FIXED);
 
-    // --- Main Message Loop ---
-    while (g_server_state->server_is_running && client->is_active)
-    {
-        fd_set read_fds;
-        FD_ZERO(&read_fds);
-        FD_SET(client->socket_fd, &read_fds);
-        struct timeval timeout = {1, 0}; // 1-second timeout for select
-
-        int activity = select(client->socket_fd + 1, &read_fds, NULL, NULL, &timeout);
-
-        if (!g_server_state->server_is_running || !client->is_active)
-        {
-            // Server shutting down or client explicitly disconnected (/exit)
-            is_unexpected_disconnect = 0; // Mark as graceful or server-initiated
-            break;                        // Exit loop
-        }
-
-        if (activity < 0)
-        { // select() error
-            if (errno == EINTR)
-                continue; // Interrupted by a signal, loop to re-check flags
-            logServerEvent("ERROR", "select() error for client %s (fd %d): %s. Assuming disconnection.",
-                           client->username, client->socket_fd, strerror(errno));
-            is_unexpected_disconnect = 1; // Treat as unexpected network error
-            break;                        // Exit loop
-        }
-
-        if (activity == 0)
-            continue; // Timeout, loop back to check flags and wait again
-
-        // If data is available on the client's socket
-        if (FD_ISSET(client->socket_fd, &read_fds))
-        {
-            if (receiveMessage(client->socket_fd, &received_message) <= 0)
-            {
-                // receiveMessage returns <= 0 on connection closed or error.
-                // If client->is_active is still true here, it's an unexpected disconnect.
-                // If client->is_active became false due to MSG_DISCONNECT processing, it's expected.
-                // The 'is_unexpected_disconnect' flag will be based on client->is_active value *before* this block.
-                // However, the final check before unregisterClient will use current client->is_active.
-                if (client->is_active)
-                { // If still marked active, this is unexpected.
-                    is_unexpected_disconnect = 1;
-                }
-                else
-                { // Was already marked inactive (e.g., by /exit command)
-                    is_unexpected_disconnect = 0;
-                }
-                break; // Exit loop, will proceed to unregisterClient
-            }
-            // Successfully received a message, handle it
-            handleClientMessage(client, &received_message);
-        }
-    } // End of main message loop
+    client_info->wire_protocol = agreed_protocol;
+    setSocketWireProtocol(client_info->socket_fd, agreed_protocol);
+    strncpy(client_info->username, login_message->sender, USERNAME_BUF_SIZE - 1);
+    client_info->username[USERNAME_BUF_SIZE - 1] = '\0'; // Ensure null termination
+    client_info->is_active = 1;                          // Mark client as active (logged in)
+    client_info->name_index_entry.key = client_info->username;
+    client_info->name_index_entry.owner = client_info;
+    nameIndexInsertLocked(client_index, &client_info->name_index_entry);
+    client_info->is_name_indexed = 1;
+    pthread_rwlock_unlock(stripe_lock);
+    clusterAnnouncePresence(client_info->username, 1);
 
-    // --- Cleanup Phase for this client ---
-    // Determine if disconnection was truly unexpected at this final stage
-    if (!client->is_active)
-    {
-        // Client explicitly sent /exit or was marked inactive by a handler.
-        is_unexpected_disconnect = 0;
-    }
-    if (!g_server_state->server_is_running && client->is_active)
-    {
-        // Server is shutting down while client was still active.
-        is_unexpected_disconnect = 0;              // Not client's fault
-        notifyClientOfShutdown(client->socket_fd); // Attempt to notify client
-    }
-    // If loop exited due to network error (select or recv error) and client was active,
-    // is_unexpected_disconnect remains 1.
+    pthread_mutex_lock(&g_server_state->clients_list_mutex);
+    g_server_state->active_client_count++; // Increment server's active client counter
+    pthread_mutex_unlock(&g_server_state->clients_list_mutex);
 
-    unregisterClient(client, is_unexpected_disconnect);
-    // logServerEvent("DEBUG", "Client handler thread for %s (fd %d) terminating.", client_username_before_free, client_socket_fd_before_free);
-    client = NULL; // Avoid dangling pointer if used after free in theory, though thread exits.
-    return NULL;
+    logEventClientConnected(client_info->username, client_ip_str); // Use specific log function
+    return 1; // Login successful
 }
 
 // Dispatches client messages to appropriate handler functions.
@@ -275,27 +195,28 @@ void handleClientMessage(ClientInfo *client, const Message *message)
         break;
     case MSG_DISCONNECT:
         client->is_active = 0; // Mark client as inactive (graceful disconnect initiated by client)
-        // The main loop in clientConnectionThreadHandler will see this and exit.
+        // The owning reactor loop sees this after dispatch and unregisters the client.
         // Confirmation message sent to client.
         Message bye_msg;
         memset(&bye_msg, 0, sizeof(bye_msg));
         bye_msg.type = MSG_SUCCESS; // Or MSG_SERVER_NOTIFICATION
         strncpy(bye_msg.content, "Disconnected. Goodbye!", MESSAGE_BUF_SIZE - 1);
         bye_msg.content[MESSAGE_BUF_SIZE - 1] = '\0';
-        sendMessage(client->socket_fd, &bye_msg);
+        queueMessageToClient(client, &bye_msg); // Flushed (best effort) when the client is unregistered
         // Logging of this graceful disconnect will be handled by unregisterClient
         // when is_unexpected_disconnect is false.
         break;
     default:
         logServerEvent("WARNING", "Client %s (fd %d) sent unhandled or malformed message type: %d",
                        client->username, client->socket_fd, message->type);
-        sendErrorToClient(client->socket_fd, "Unknown or malformed command received by server.");
+        sendErrorToClient(client, "Unknown or malformed command received by server.");
         break;
     }
 }
 
 // Unregisters a client from the server.
-// Cleans up resources: removes from room, closes socket, frees ClientInfo.
+// Cleans up resources: removes from room, closes socket, and drops the registry's reference
+// (the ClientInfo is freed once no other thread still holds one).
 void unregisterClient(ClientInfo *client_to_remove, int is_unexpected_disconnect)
 {
     if (!client_to_remove || !g_server_state)
@@ -311,70 +232,76 @@ void unregisterClient(ClientInfo *client_to_remove, int is_unexpected_disconnect
     }
 
     // 1. Ensure client is marked inactive (should be done by caller or loop exit logic)
+    //    and stop new lookups from finding it; holders of a reference keep it alive.
     client_to_remove->is_active = 0;
+    if (client_to_remove->is_name_indexed)
+    {
+        NameIndex *client_index = &g_server_state->client_name_index;
+        pthread_rwlock_t *stripe_lock = nameIndexLockFor(client_index, client_to_remove->username);
+        pthread_rwlock_wrlock(stripe_lock);
+        nameIndexRemoveLocked(client_index, &client_to_remove->name_index_entry);
+        pthread_rwlock_unlock(stripe_lock);
+        client_to_remove->is_name_indexed = 0;
+        clusterAnnouncePresence(client_to_remove->username, 0);
+    }
 
     // 2. Log disconnection event
     logEventClientDisconnected(client_username_log, is_unexpected_disconnect);
 
-    // 3. Remove client from any room they were in
-    if (strlen(client_to_remove->current_room_name) > 0)
+    // 3. Remove client from any room they were in, or are waiting to join on another node
+    clusterCancelRoomJoin(client_to_remove);
+    if (client_to_remove->current_room)
     {
         // removeClientFromTheirRoom also logs the "left room" part.
         // It's important that room operations are safe even if client is disconnecting.
-        ChatRoom *room_they_were_in = findOrCreateChatRoom(client_to_remove->current_room_name);
-        if (room_they_were_in)
+        // Notify room members that this client has left (due to disconnect)
+        // Check if server is still running to avoid notifications during shutdown flood
+        if (g_server_state->server_is_running)
         {
-            // Notify room members that this client has left (due to disconnect)
-            // Check if server is still running to avoid notifications during shutdown flood
-            if (g_server_state->server_is_running)
-            {
-                notifyRoomOfClientAction(client_to_remove, room_they_were_in, "disconnected and left");
-            }
+            notifyRoomOfClientAction(client_to_remove, client_to_remove->current_room, "disconnected and left");
         }
         removeClientFromTheirRoom(client_to_remove);
     }
 
-    // 4. Close client's socket
+    // 4. Drop an unfinished upload, flush what can still be sent without blocking, then close client's socket
+    abortInboundFileUpload(client_to_remove);
+    closeClientOutboundQueue(client_to_remove);
     if (client_to_remove->socket_fd >= 0)
     {
         shutdown(client_to_remove->socket_fd, SHUT_RDWR); // Gracefully signal other end
+        setSocketWireProtocol(client_to_remove->socket_fd, WIRE_PROTOCOL_FIXED);
         close(client_to_remove->socket_fd);
         client_to_remove->socket_fd = -1; // Mark as closed
     }
 
     // 5. Remove client from the global list and decrement active_client_count
     pthread_mutex_lock(&g_server_state->clients_list_mutex);
-    for (int i = 0; i < MAX_SERVER_CLIENTS; ++i)
+    int client_slot_idx = client_to_remove->client_slot_index;
+    if (client_slot_idx >= 0 && g_server_state->connected_clients[client_slot_idx] == client_to_remove)
     {
-        if (g_server_state->connected_clients[i] == client_to_remove)
+        g_server_state->connected_clients[client_slot_idx] = NULL; // Free up the slot in server's list
+        g_server_state->free_client_slots[g_server_state->free_client_slot_count++] = client_slot_idx;
+        // Only decrement active_client_count if client had successfully logged in (had a username)
+        // and active_client_count is positive.
+        if (strlen(client_to_remove->username) > 0 && g_server_state->active_client_count > 0)
         {
-            g_server_state->connected_clients[i] = NULL; // Free up the slot in server's list
-            // Only decrement active_client_count if client had successfully logged in (had a username)
-            // and active_client_count is positive.
-            if (strlen(client_to_remove->username) > 0 && g_server_state->active_client_count > 0)
-            {
-                g_server_state->active_client_count--;
-            }
-            break; // Found and removed
+            g_server_state->active_client_count--;
         }
     }
     pthread_mutex_unlock(&g_server_state->clients_list_mutex);
 
-    // 6. Destroy client-specific mutex (for received_filenames list)
-    pthread_mutex_destroy(&client_to_remove->received_files_lock);
-
-    // 7. Free the ClientInfo structure itself
-    free(client_to_remove);
-    client_to_remove = NULL; // Avoid dangling pointer for the caller (though thread exits)
+    // 6. Drop the registry's reference; the structure is freed once no worker is using it
+    releaseClient(client_to_remove);
+    client_to_remove = NULL; // Avoid dangling pointer for the caller
 
     // logServerEvent("DEBUG", "Client %s (formerly fd %d) fully unregistered.", client_username_log, client_fd_log);
 }
 
 // Sends a shutdown notification message to a client.
 // Used when server is shutting down and needs to inform connected clients.
-void notifyClientOfShutdown(int client_socket_fd)
+void notifyClientOfShutdown(ClientInfo *client_info)
 {
-    if (client_socket_fd < 0)
+    if (!client_info || client_info->socket_fd < 0)
         return;
 
     Message shutdown_notif_msg;
@@ -386,5 +313,23 @@ void notifyClientOfShutdown(int client_socket_fd)
     strncpy(shutdown_notif_msg.content, "Server is shutting down. You will be disconnected.", MESSAGE_BUF_SIZE - 1);
     shutdown_notif_msg.content[MESSAGE_BUF_SIZE - 1] = '\0';
 
-    sendMessage(client_socket_fd, &shutdown_notif_msg); // Best effort send
+    queueMessageToClient(client_info, &shutdown_notif_msg); // Best effort send
+}
+
+// Takes an extra reference on a client so it stays valid after clients_list_mutex is released.
+// Callers must pair it with releaseClient.
+void retainClient(ClientInfo *client_info)
+{
+    if (client_info)
+        __atomic_add_fetch(&client_info->reference_count, 1, __ATOMIC_RELAXED);
+}
+
+// Drops a reference taken by registration or retainClient; the last one frees the client.
+void releaseClient(ClientInfo *client_info)
+{
+    if (!client_info || __atomic_sub_fetch(&client_info->reference_count, 1, __ATOMIC_ACQ_REL) != 0)
+        return;
+    destroyClientOutboundQueue(client_info);
+    pthread_mutex_destroy(&client_info->received_files_lock);
+    poolRelease(&client_info_pool, client_info);
 }
\ No newline at end of file
@@ -0,0 +1,1315 @@
+#include "common.h"
+#include <netdb.h> // For resolving --cluster host names
+#include <poll.h>  // For the link listener's timed wait
+
+// Cluster mode: several server processes share one user and room namespace.
+// Every node is started with the same --cluster list and its own --node-id. Each pair of
+// nodes is joined by two TCP links, one per direction: a node only writes to the link it
+// opened and only reads from the link its peer opened, so every link has a single writer
+// thread and a single reader thread. Frames use the framed wire format with MessageType
+// values from CLUSTER_OP_HELLO upwards.
+//
+// - Presence: logins and logouts are replicated to every node, so each node keeps a directory
+//   of the users logged in elsewhere (eventually consistent: two nodes logging in the same
+//   name at the same moment can both succeed).
+// - Rooms: a consistent-hash ring assigns every room name to an owning node. The owner holds
+//   the complete member list and admits or refuses joins from every node; other nodes keep a
+//   room of the same name holding their own members. Room messages are handed to the owner,
+//   which forwards one copy to each node with members, so every node sees a room's messages
+//   in the order the owner handled them.
+// - Whispers and files for a user on another node are forwarded to that node. A file travels in
+//   FILE_CHUNK frames that the sender interleaves with the link's other frames, so a large file
+//   does not hold up presence, room or whisper traffic behind it.
+// When a link closes the other side forgets what it learned through it (users, room members);
+// the first thing sent on a new link is a snapshot of the sending node's users and memberships.
+// Membership is static: a node that is down is not replaced, so its rooms are unreachable
+// until it comes back.
+
+enum
+{
+    CLUSTER_OP_HELLO = 100,       // content: sender's node id, file_size: ring fingerprint
+    CLUSTER_OP_PRESENCE_ADD,      // sender: user logged in; room: current room if the receiver owns it
+    CLUSTER_OP_PRESENCE_REMOVE,   // sender: user logged out
+    CLUSTER_OP_JOIN_REQUEST,      // sender, room, file_size: request id
+    CLUSTER_OP_JOIN_REPLY,        // sender, room, file_size: request id, content: joinChatRoom-style result
+    CLUSTER_OP_ROOM_LEAVE,        // sender, room
+    CLUSTER_OP_ROOM_PUBLISH,      // To the owner: sender, room, content, receiver: excluded user, file_size: MessageType
+    CLUSTER_OP_ROOM_DELIVER,      // From the owner, same fields
+    CLUSTER_OP_WHISPER,           // sender, receiver, content
+    CLUSTER_OP_FILE_RELAY,        // Starts a relayed file: sender, receiver, filename, file_size, content: relay id
+    CLUSTER_OP_FILE_CHUNK         // content: relay id, file_size: chunk length; that many raw bytes follow
+};
+
+#define CLUSTER_HANDSHAKE_TIMEOUT_SECONDS 2 // How long a new inbound link may take to say HELLO
+
+// A file being streamed to a peer, one FILE_CHUNK at a time
+typedef struct OutgoingFileRelay
+{
+    size_t relay_id;
+    OutboundBuffer *spool; // Spooled buffer holding the file
+    off_t offset;          // Bytes already sent
+} OutgoingFileRelay;
+
+// A file being received from a peer (only touched by the link's reader thread)
+typedef struct IncomingFileRelay
+{
+    int in_use;
+    size_t relay_id;
+    int spool_fd;   // Receives the chunks, or -1 if the spool could not be written (chunks are discarded)
+    size_t file_size;
+    size_t received; // Bytes of file_size received so far
+    char sender[USERNAME_BUF_SIZE];
+    char receiver[USERNAME_BUF_SIZE];
+    char filename[FILENAME_BUF_SIZE];
+} IncomingFileRelay;
+
+// One other node: the link to it (written by its sender thread) and the link from it.
+typedef struct ClusterPeer
+{
+    int node_id;
+    ClusterNodeAddress address;
+
+    pthread_mutex_t lock;    // Protects socket_fd, is_connected and the queue
+    pthread_cond_t wakeup;   // Signaled when frames are queued or the cluster stops
+    int socket_fd;           // Outbound link, or -1
+    int is_connected;        // 1 once HELLO went out; frames are only queued while connected
+    OutboundBuffer *queue[CLUSTER_LINK_QUEUE_CAPACITY]; // Circular queue of frames to send
+    int queue_head;
+    int queue_count;
+    OutgoingFileRelay outgoing_files[CLUSTER_LINK_MAX_FILES]; // Files sent in chunks whenever the queue is empty
+    int outgoing_file_count;
+    int next_outgoing_file; // Round-robin position among outgoing_files
+    pthread_t sender_thread;
+    int sender_started;
+
+    int inbound_fd; // Link opened by the peer, or -1 (only touched by the accept thread and shutdownCluster)
+    IncomingFileRelay incoming_files[CLUSTER_LINK_MAX_FILES]; // Files arriving on inbound_fd
+    pthread_t reader_thread;
+    int reader_started;
+
+    unsigned long long frames_sent;     // Updated atomically
+    unsigned long long frames_received; // Updated atomically
+    unsigned long long frames_dropped;  // Updated atomically
+    int remote_users;                   // Directory entries of this node, updated atomically
+} ClusterPeer;
+
+// A point of the consistent-hash ring
+typedef struct ClusterRingPoint
+{
+    uint32_t hash;
+    int node_id;
+} ClusterRingPoint;
+
+// A user logged in on another node, in the presence directory
+typedef struct RemoteUser
+{
+    char username[USERNAME_BUF_SIZE];
+    int node_id;
+    NameIndexEntry name_index_entry;
+} RemoteUser;
+
+// A join waiting for the owning node's verdict. The link reader (verdict), the accept thread
+// (timeout) or a lost link records the result and wakes the client's reactor loop, which
+// finishes the join on the thread that owns the client (clusterFinishRoomJoins).
+typedef struct PendingJoin
+{
+    int in_use;
+    size_t request_id;
+    int owner_node;
+    ClientInfo *client;                     // Cancels the entry before it goes away (clusterCancelRoomJoin)
+    int loop_index;                         // The client's reactor loop
+    char username[USERNAME_BUF_SIZE];
+    char room_name[ROOM_NAME_BUF_SIZE];
+    char old_room_name[ROOM_NAME_BUF_SIZE]; // Room the client left for this join ("" if none)
+    struct timespec deadline;               // CLOCK_MONOTONIC time at which the join gives up
+    int is_answered;
+    int result;                             // joinChatRoom-style verdict, -2 if the owner did not answer
+} PendingJoin;
+
+static int cluster_enabled = 0;          // Set once at startup
+static volatile int cluster_running = 0; // Cleared by shutdownCluster
+static int cluster_node_count = 0;
+static int cluster_local_node = 0;
+static ClusterPeer cluster_peers[CLUSTER_MAX_NODES]; // Indexed by node id (the local entry is unused)
+
+static ClusterRingPoint cluster_ring[CLUSTER_MAX_NODES * CLUSTER_VIRTUAL_NODES]; // Sorted by hash
+static int cluster_ring_size = 0;
+static uint32_t cluster_ring_fingerprint = 0; // Nodes refuse links from peers with another --cluster list
+
+static int cluster_listen_fd = -1;
+static pthread_t cluster_accept_thread;
+static int cluster_accept_started = 0;
+
+static NameIndex remote_user_index; // Presence directory: users logged in on other nodes
+static MemoryPool remote_user_pool = MEMORY_POOL_INITIALIZER("remote_user", sizeof(RemoteUser));
+
+static PendingJoin pending_joins[CLUSTER_MAX_PENDING_JOINS];
+static pthread_mutex_t pending_joins_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t next_join_request_id = 0;
+static size_t next_file_relay_id = 0; // Updated atomically
+
+// Spreads the FNV-1a hash over the whole ring; similar names ("node:0:1", "node:0:2") would
+// otherwise land next to each other.
+static uint32_t ringHash(const char *name)
+{
+    uint32_t hash = hashIndexName(name);
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static int compareRingPoints(const void *a, const void *b)
+{
+    const ClusterRingPoint *left = a, *right = b;
+    if (left->hash != right->hash)
+        return left->hash < right->hash ? -1 : 1;
+    return left->node_id - right->node_id;
+}
+
+// Places CLUSTER_VIRTUAL_NODES points per node on the ring and fingerprints the node list.
+static void buildClusterRing(const ServerConfig *config)
+{
+    char point_name[64];
+    cluster_ring_size = 0;
+    for (int node = 0; node < config->cluster_node_count; ++node)
+    {
+        for (int v = 0; v < CLUSTER_VIRTUAL_NODES; ++v)
+        {
+            snprintf(point_name, sizeof(point_name), "node:%d:%d", node, v);
+            cluster_ring[cluster_ring_size].hash = ringHash(point_name);
+            cluster_ring[cluster_ring_size].node_id = node;
+            cluster_ring_size++;
+        }
+    }
+    qsort(cluster_ring, (size_t)cluster_ring_size, sizeof(ClusterRingPoint), compareRingPoints);
+
+    char node_list[CLUSTER_MAX_NODES * (CLUSTER_NODE_HOST_SIZE + 8)] = "";
+    for (int node = 0; node < config->cluster_node_count; ++node)
+    {
+        size_t used = strlen(node_list);
+        snprintf(node_list + used, sizeof(node_list) - used, "%s:%d,",
+                 config->cluster_nodes[node].host, config->cluster_nodes[node].port);
+    }
+    cluster_ring_fingerprint = hashIndexName(node_list);
+}
+
+int clusterIsEnabled(void)
+{
+    return cluster_enabled;
+}
+
+int clusterLocalNodeId(void)
+{
+    return cluster_local_node;
+}
+
+// The owner is the node of the first ring point at or after the name's hash (wrapping around).
+int clusterRoomOwner(const char *room_name)
+{
+    if (!cluster_enabled || !room_name)
+        return cluster_local_node;
+    uint32_t hash = ringHash(room_name);
+    int low = 0, high = cluster_ring_size; // Binary search for the first point >= hash
+    while (low < high)
+    {
+        int mid = low + (high - low) / 2;
+        if (cluster_ring[mid].hash < hash)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return cluster_ring[low < cluster_ring_size ? low : 0].node_id;
+}
+
+// --- Link I/O ---
+
+// Writes all of data to a blocking link socket. Returns 1 on success, 0 on failure.
+static int writeAllToLink(int fd, const void *data, size_t length)
+{
+    const unsigned char *bytes = data;
+    while (length > 0)
+    {
+        ssize_t sent = send(fd, bytes, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return 0;
+        bytes += sent;
+        length -= (size_t)sent;
+    }
+    return 1;
+}
+
+
+// Reads exactly length bytes from a link. Returns 1 on success, 0 on EOF or error.
+static int readExactFromLink(int fd, void *data, size_t length)
+{
+    unsigned char *bytes = data;
+    while (length > 0)
+    {
+        ssize_t received = recv(fd, bytes, length, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return 0;
+        bytes += received;
+        length -= (size_t)received;
+    }
+    return 1;
+}
+
+// Reads and decodes one frame. Returns 1 on success, 0 on EOF, error or a malformed frame.
+static int readFrameFromLink(int fd, Message *msg)
+{
+    unsigned char frame[FRAME_MAX_SIZE];
+    if (!readExactFromLink(fd, frame, FRAME_HEADER_SIZE))
+        return 0;
+    size_t frame_size = messageWireUnitSize(WIRE_PROTOCOL_FRAMED, frame, FRAME_HEADER_SIZE);
+    if (frame_size <= FRAME_HEADER_SIZE || frame_size > sizeof(frame))
+        return 0;
+    if (!readExactFromLink(fd, frame + FRAME_HEADER_SIZE, frame_size - FRAME_HEADER_SIZE))
+        return 0;
+    return decodeMessageWireUnit(WIRE_PROTOCOL_FRAMED, frame, frame_size, msg);
+}
+
+static int writeFrameToLink(int fd, const Message *msg)
+{
+    unsigned char frame[FRAME_MAX_SIZE];
+    size_t frame_len = encodeMessageFrame(msg, frame, sizeof(frame));
+    return frame_len > 0 && writeAllToLink(fd, frame, frame_len);
+}
+
+// Writes the next FILE_CHUNK of a relayed file (its data straight from the spool with sendfile())
+// and advances relay->offset. Returns 1 on success, 0 on failure.
+static int writeFileChunkToLink(int fd, OutgoingFileRelay *relay)
+{
+    size_t remaining = relay->spool->length - (size_t)relay->offset;
+    size_t chunk_len = remaining < FILE_RELAY_CHUNK_SIZE ? remaining : FILE_RELAY_CHUNK_SIZE;
+    Message chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.type = (MessageType)CLUSTER_OP_FILE_CHUNK;
+    snprintf(chunk.content, sizeof(chunk.content), "%zu", relay->relay_id);
+    chunk.file_size = chunk_len;
+    if (!writeFrameToLink(fd, &chunk))
+        return 0;
+
+    off_t chunk_end = relay->offset + (off_t)chunk_len;
+    while (relay->offset < chunk_end)
+    {
+        ssize_t sent = sendfile(fd, relay->spool->spool_fd, &relay->offset, (size_t)(chunk_end - relay->offset));
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return 0;
+    }
+    return 1;
+}
+
+// Queues buffers back to back on the link to a node (each is retained). Frames for a node
+// whose link is down are dropped rather than kept: the node resynchronizes when it reconnects.
+// Returns 1 if queued, 0 if dropped.
+static int enqueueToPeer(int node_id, OutboundBuffer **buffers, int count)
+{
+    if (!cluster_running || node_id < 0 || node_id >= cluster_node_count || node_id == cluster_local_node)
+        return 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (!buffers[i])
+            return 0;
+    }
+    ClusterPeer *peer = &cluster_peers[node_id];
+    pthread_mutex_lock(&peer->lock);
+    if (!peer->is_connected || peer->queue_count + count > CLUSTER_LINK_QUEUE_CAPACITY)
+    {
+        pthread_mutex_unlock(&peer->lock);
+        __atomic_add_fetch(&peer->frames_dropped, (unsigned long long)count, __ATOMIC_RELAXED);
+        return 0;
+    }
+    for (int i = 0; i < count; ++i)
+    {
+        retainOutboundBuffer(buffers[i]);
+        peer->queue[(peer->queue_head + peer->queue_count) % CLUSTER_LINK_QUEUE_CAPACITY] = buffers[i];
+        peer->queue_count++;
+    }
+    pthread_cond_signal(&peer->wakeup);
+    pthread_mutex_unlock(&peer->lock);
+    return 1;
+}
+
+// Encodes a message as a frame and queues it for a node. Returns 1 if queued.
+static int sendToPeer(int node_id, const Message *msg)
+{
+    OutboundBuffer *frame = encodeOutboundMessage(msg, WIRE_PROTOCOL_FRAMED);
+    int queued = enqueueToPeer(node_id, &frame, 1);
+    releaseOutboundBuffer(frame);
+    return queued;
+}
+
+// --- Presence directory ---
+
+static void countRemoteUser(int node_id, int delta)
+{
+    __atomic_add_fetch(&cluster_peers[node_id].remote_users, delta, __ATOMIC_RELAXED);
+}
+
+// Records that a user is logged in on a node; a newer announcement replaces an older one.
+static void addRemoteUser(const char *username, int node_id)
+{
+    if (!isValidUsername(username))
+        return;
+    pthread_rwlock_t *stripe_lock = nameIndexLockFor(&remote_user_index, username);
+    pthread_rwlock_wrlock(stripe_lock);
+    RemoteUser *user = nameIndexLookupLocked(&remote_user_index, username);
+    if (user)
+    {
+        countRemoteUser(user->node_id, -1);
+        user->node_id = node_id;
+        countRemoteUser(node_id, 1);
+    }
+    else if ((user = poolAllocate(&remote_user_pool)) != NULL)
+    {
+        strncpy(user->username, username, USERNAME_BUF_SIZE - 1);
+        user->username[USERNAME_BUF_SIZE - 1] = '\0';
+        user->node_id = node_id;
+        user->name_index_entry.key = user->username;
+        user->name_index_entry.owner = user;
+        nameIndexInsertLocked(&remote_user_index, &user->name_index_entry);
+        countRemoteUser(node_id, 1);
+    }
+    pthread_rwlock_unlock(stripe_lock);
+}
+
+// Forgets a user, unless a later announcement placed them on another node.
+static void removeRemoteUser(const char *username, int node_id)
+{
+    pthread_rwlock_t *stripe_lock = nameIndexLockFor(&remote_user_index, username);
+    pthread_rwlock_wrlock(stripe_lock);
+    RemoteUser *user = nameIndexLookupLocked(&remote_user_index, username);
+    if (user && user->node_id == node_id)
+    {
+        nameIndexRemoveLocked(&remote_user_index, &user->name_index_entry);
+        countRemoteUser(node_id, -1);
+        poolRelease(&remote_user_pool, user);
+    }
+    pthread_rwlock_unlock(stripe_lock);
+}
+
+static int remoteUserIsOnNode(const void *owner, void *context)
+{
+    return ((const RemoteUser *)owner)->node_id == *(const int *)context;
+}
+
+static void releaseRemoteUser(void *owner, void *context)
+{
+    (void)context;
+    countRemoteUser(((RemoteUser *)owner)->node_id, -1);
+    poolRelease(&remote_user_pool, owner);
+}
+
+// Forgets everything learned from a node: its users and its members of rooms owned here.
+static void purgeNode(int node_id)
+{
+    size_t users = nameIndexRemoveMatching(&remote_user_index, remoteUserIsOnNode, releaseRemoteUser, &node_id);
+    removeRemoteRoomMembersOfNode(node_id);
+    if (users > 0)
+        logServerEvent("CLUSTER", "Forgot %zu user(s) of node %d.", users, node_id);
+}
+
+int clusterFindUserNode(const char *username)
+{
+    if (!cluster_enabled || !username)
+        return -1;
+    pthread_rwlock_t *stripe_lock = nameIndexLockFor(&remote_user_index, username);
+    pthread_rwlock_rdlock(stripe_lock);
+    RemoteUser *user = nameIndexLookupLocked(&remote_user_index, username);
+    int node_id = user ? user->node_id : -1;
+    pthread_rwlock_unlock(stripe_lock);
+    return node_id;
+}
+
+void clusterAnnouncePresence(const char *username, int is_online)
+{
+    if (!cluster_enabled)
+        return;
+    Message announcement;
+    memset(&announcement, 0, sizeof(announcement));
+    announcement.type = (MessageType)(is_online ? CLUSTER_OP_PRESENCE_ADD : CLUSTER_OP_PRESENCE_REMOVE);
+    strncpy(announcement.sender, username, USERNAME_BUF_SIZE - 1);
+    OutboundBuffer *frame = encodeOutboundMessage(&announcement, WIRE_PROTOCOL_FRAMED);
+    for (int node = 0; node < cluster_node_count; ++node)
+    {
+        if (node != cluster_local_node)
+            enqueueToPeer(node, &frame, 1);
+    }
+    releaseOutboundBuffer(frame);
+}
+
+// --- Pending joins ---
+
+// Records the result of a pending join and wakes its client's loop. Called with pending_joins_lock.
+static void answerPendingJoinLocked(PendingJoin *pending, int result)
+{
+    pending->is_answered = 1;
+    pending->result = result;
+    reactorWakeLoop(pending->loop_index);
+}
+
+// Gives up on the joins waiting for a node: those past their deadline, or every one of them
+// (node_id >= 0) once a link to it closed and the request or its verdict is lost.
+static void abandonPendingJoins(int node_id)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    pthread_mutex_lock(&pending_joins_lock);
+    for (int i = 0; i < CLUSTER_MAX_PENDING_JOINS; ++i)
+    {
+        PendingJoin *pending = &pending_joins[i];
+        if (!pending->in_use || pending->is_answered)
+            continue;
+        int expired = (now.tv_sec > pending->deadline.tv_sec ||
+                       (now.tv_sec == pending->deadline.tv_sec && now.tv_nsec >= pending->deadline.tv_nsec));
+        if (pending->owner_node != node_id && !expired)
+            continue;
+        answerPendingJoinLocked(pending, -2);
+        logServerEvent("CLUSTER_WARNING", "Join of %s to room '%s' %s node %d.", pending->username, pending->room_name,
+                       expired ? "timed out waiting for" : "failed: lost the link to", pending->owner_node);
+    }
+    pthread_mutex_unlock(&pending_joins_lock);
+}
+
+// --- Outbound links ---
+
+// Opens a connection to a peer's link listener. Returns the socket, or -1.
+static int connectToPeer(const ClusterPeer *peer)
+{
+    char port_text[16];
+    snprintf(port_text, sizeof(port_text), "%d", peer->address.port);
+    struct addrinfo hints, *addresses = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(peer->address.host, port_text, &hints, &addresses) != 0 || !addresses)
+        return -1;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, addresses->ai_addr, addresses->ai_addrlen) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd >= 0)
+    {
+        int opt_nodelay = 1; // Frames are small and latency-sensitive
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt_nodelay, sizeof(opt_nodelay));
+    }
+    return fd;
+}
+
+// Sleeps for CLUSTER_RECONNECT_MS unless the cluster stops first.
+static void waitBeforeReconnect(ClusterPeer *peer)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += CLUSTER_RECONNECT_MS / 1000;
+    deadline.tv_nsec += (long)(CLUSTER_RECONNECT_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&peer->lock);
+    int wait_result = 0;
+    while (cluster_running && wait_result != ETIMEDOUT)
+        wait_result = pthread_cond_timedwait(&peer->wakeup, &peer->lock, &deadline);
+    pthread_mutex_unlock(&peer->lock);
+}
+
+// Sends the local users to a peer that just connected, with their room when the peer owns it.
+// Runs after is_connected is set, so logins and logouts from now on are queued behind it.
+static int sendPresenceSnapshot(ClusterPeer *peer, int fd)
+{
+    Message *snapshot = NULL;
+    int user_count = 0;
+    pthread_mutex_lock(&g_server_state->clients_list_mutex);
+    snapshot = calloc((size_t)(g_server_state->active_client_count + 1), sizeof(Message));
+    for (int i = 0; snapshot && i < g_server_state->max_clients && user_count < g_server_state->active_client_count; ++i)
+    {
+        ClientInfo *client = g_server_state->connected_clients[i];
+        if (!client || !client->is_active || !client->is_name_indexed)
+            continue;
+        Message *announcement = &snapshot[user_count++];
+        announcement->type = (MessageType)CLUSTER_OP_PRESENCE_ADD;
+        strncpy(announcement->sender, client->username, USERNAME_BUF_SIZE - 1);
+        strncpy(announcement->room, client->current_room_name, ROOM_NAME_BUF_SIZE - 1);
+    }
+    pthread_mutex_unlock(&g_server_state->clients_list_mutex);
+    if (!snapshot)
+        return 0;
+
+    int ok = 1;
+    for (int i = 0; ok && i < user_count; ++i)
+    {
+        if (snapshot[i].room[0] && clusterRoomOwner(snapshot[i].room) != peer->node_id)
+            snapshot[i].room[0] = '\0';
+        ok = writeFrameToLink(fd, &snapshot[i]);
+        if (ok)
+            __atomic_add_fetch(&peer->frames_sent, 1, __ATOMIC_RELAXED);
+    }
+    free(snapshot);
+    return ok;
+}
+
+// Drops the outbound link and every frame queued on it.
+static void closePeerLink(ClusterPeer *peer, int fd)
+{
+    pthread_mutex_lock(&peer->lock);
+    peer->is_connected = 0;
+    peer->socket_fd = -1;
+    int discarded = peer->queue_count;
+    while (peer->queue_count > 0)
+    {
+        releaseOutboundBuffer(peer->queue[peer->queue_head]);
+        peer->queue_head = (peer->queue_head + 1) % CLUSTER_LINK_QUEUE_CAPACITY;
+        peer->queue_count--;
+    }
+    int discarded_files = peer->outgoing_file_count;
+    while (peer->outgoing_file_count > 0)
+        releaseOutboundBuffer(peer->outgoing_files[--peer->outgoing_file_count].spool);
+    pthread_mutex_unlock(&peer->lock);
+    if (discarded_files > 0)
+        logServerEvent("CLUSTER_WARNING", "%d file(s) relayed to node %d were cut off by the link loss.", discarded_files, peer->node_id);
+    close(fd);
+    __atomic_add_fetch(&peer->frames_dropped, (unsigned long long)discarded, __ATOMIC_RELAXED);
+    abandonPendingJoins(peer->node_id); // Their requests may have been among the discarded frames
+    if (cluster_running)
+        logServerEvent("CLUSTER_WARNING", "Link to node %d lost (%d queued frame(s) discarded). Reconnecting.",
+                       peer->node_id, discarded);
+}
+
+// Keeps the link to one peer up and writes its queued frames, in order.
+static void *clusterSenderThread(void *arg)
+{
+    ClusterPeer *peer = arg;
+    while (cluster_running)
+    {
+        int fd = connectToPeer(peer);
+        if (fd < 0)
+        {
+            waitBeforeReconnect(peer);
+            continue;
+        }
+
+        Message hello;
+        memset(&hello, 0, sizeof(hello));
+        hello.type = (MessageType)CLUSTER_OP_HELLO;
+        snprintf(hello.content, sizeof(hello.content), "%d", cluster_local_node);
+        hello.file_size = cluster_ring_fingerprint;
+        if (!writeFrameToLink(fd, &hello))
+        {
+            close(fd);
+            waitBeforeReconnect(peer);
+            continue;
+        }
+
+        pthread_mutex_lock(&peer->lock);
+        peer->socket_fd = fd;
+        peer->is_connected = 1;
+        pthread_mutex_unlock(&peer->lock);
+        logServerEvent("CLUSTER", "Link to node %d (%s:%d) established.", peer->node_id, peer->address.host, peer->address.port);
+
+        int link_ok = sendPresenceSnapshot(peer, fd);
+        while (link_ok)
+        {
+            pthread_mutex_lock(&peer->lock);
+            while (cluster_running && peer->is_connected && peer->queue_count == 0 && peer->outgoing_file_count == 0)
+                pthread_cond_wait(&peer->wakeup, &peer->lock);
+            if (!cluster_running || !peer->is_connected)
+            {
+                pthread_mutex_unlock(&peer->lock);
+                break;
+            }
+            if (peer->queue_count > 0)
+            {
+                OutboundBuffer *buffer = peer->queue[peer->queue_head];
+                peer->queue_head = (peer->queue_head + 1) % CLUSTER_LINK_QUEUE_CAPACITY;
+                peer->queue_count--;
+                pthread_mutex_unlock(&peer->lock);
+
+                link_ok = writeAllToLink(fd, buffer->data, buffer->length);
+                if (link_ok)
+                    __atomic_add_fetch(&peer->frames_sent, 1, __ATOMIC_RELAXED);
+                releaseOutboundBuffer(buffer);
+                continue;
+            }
+
+            // Only file data is waiting: send one chunk, then look at the queue again. Other
+            // threads only append to outgoing_files, so the entry stays at its index meanwhile.
+            int file_index = peer->next_outgoing_file % peer->outgoing_file_count;
+            OutgoingFileRelay relay = peer->outgoing_files[file_index];
+            pthread_mutex_unlock(&peer->lock);
+
+            link_ok = writeFileChunkToLink(fd, &relay);
+            if (link_ok)
+                __atomic_add_fetch(&peer->frames_sent, 1, __ATOMIC_RELAXED);
+
+            pthread_mutex_lock(&peer->lock);
+            if (link_ok && (size_t)relay.offset == relay.spool->length)
+            {
+                releaseOutboundBuffer(relay.spool);
+                peer->outgoing_files[file_index] = peer->outgoing_files[--peer->outgoing_file_count];
+            }
+            else
+            {
+                peer->outgoing_files[file_index].offset = relay.offset;
+                peer->next_outgoing_file = file_index + 1;
+            }
+            pthread_mutex_unlock(&peer->lock);
+        }
+        closePeerLink(peer, fd);
+        if (cluster_running)
+            waitBeforeReconnect(peer);
+    }
+    return NULL;
+}
+
+// --- Inbound links ---
+
+// Rebuilds a room message carried by ROOM_PUBLISH / ROOM_DELIVER. Returns 0 for other types.
+static int unpackRoomMessage(const Message *frame, Message *room_msg)
+{
+    if (frame->file_size != MSG_BROADCAST && frame->file_size != MSG_SERVER_NOTIFICATION)
+        return 0;
+    memset(room_msg, 0, sizeof(*room_msg));
+    room_msg->type = (MessageType)frame->file_size;
+    memcpy(room_msg->sender, frame->sender, USERNAME_BUF_SIZE);
+    memcpy(room_msg->room, frame->room, ROOM_NAME_BUF_SIZE);
+    memcpy(room_msg->content, frame->content, MESSAGE_BUF_SIZE);
+    return 1;
+}
+
+static void answerJoinRequest(int node_id, const Message *request)
+{
+    int result = -1;
+    if (clusterRoomOwner(request->room) == cluster_local_node)
+        result = admitRemoteRoomMember(request->sender, node_id, request->room);
+
+    Message reply;
+    memset(&reply, 0, sizeof(reply));
+    reply.type = (MessageType)CLUSTER_OP_JOIN_REPLY;
+    memcpy(reply.sender, request->sender, USERNAME_BUF_SIZE);
+    memcpy(reply.room, request->room, ROOM_NAME_BUF_SIZE);
+    reply.file_size = request->file_size;
+    snprintf(reply.content, sizeof(reply.content), "%d", result);
+    if (!sendToPeer(node_id, &reply) && result > 0)
+        removeRemoteRoomMember(request->sender, node_id, request->room); // The joiner will never know
+}
+
+static void completeJoinRequest(const Message *reply)
+{
+    pthread_mutex_lock(&pending_joins_lock);
+    for (int i = 0; i < CLUSTER_MAX_PENDING_JOINS; ++i)
+    {
+        PendingJoin *pending = &pending_joins[i];
+        if (pending->in_use && !pending->is_answered && pending->request_id == reply->file_size)
+        {
+            answerPendingJoinLocked(pending, atoi(reply->content));
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pending_joins_lock);
+}
+
+static void deliverForwardedWhisper(int node_id, const Message *frame)
+{
+    Message whisper_msg;
+    memset(&whisper_msg, 0, sizeof(whisper_msg));
+    whisper_msg.type = MSG_WHISPER;
+    memcpy(whisper_msg.sender, frame->sender, USERNAME_BUF_SIZE);
+    memcpy(whisper_msg.receiver, frame->receiver, USERNAME_BUF_SIZE);
+    memcpy(whisper_msg.content, frame->content, MESSAGE_BUF_SIZE);
+
+    ClientInfo *receiver_client = acquireClientByUsername(frame->receiver);
+    if (!receiver_client || !queueMessageToClient(receiver_client, &whisper_msg))
+        logServerEvent("CLUSTER_WARNING", "Whisper from %s (node %d) to %s could not be delivered: recipient not here.",
+                       frame->sender, node_id, frame->receiver);
+    releaseClient(receiver_client);
+}
+
+// Drops a file that will not be completed and logs why.
+static void abandonIncomingFile(IncomingFileRelay *relay, const char *reason)
+{
+    if (relay->spool_fd >= 0)
+        close(relay->spool_fd);
+    relay->spool_fd = -1;
+    relay->in_use = 0;
+    logEventFileTransferFailed(relay->sender, relay->receiver, relay->filename, reason);
+}
+
+// Starts receiving a file announced by a FILE_RELAY frame; its chunks follow in FILE_CHUNK frames.
+static void startRelayedFile(ClusterPeer *peer, const Message *frame)
+{
+    if (frame->file_size == 0 || frame->file_size > MAX_FILE_SIZE)
+    {
+        logEventFileTransferFailed(frame->sender, frame->receiver, frame->filename, "Relayed file has an invalid size.");
+        return; // Its chunks find no entry and are discarded
+    }
+    IncomingFileRelay *relay = NULL;
+    for (int i = 0; i < CLUSTER_LINK_MAX_FILES && !relay; ++i)
+    {
+        if (!peer->incoming_files[i].in_use)
+            relay = &peer->incoming_files[i];
+    }
+    if (!relay)
+    {
+        logEventFileTransferFailed(frame->sender, frame->receiver, frame->filename, "Too many files relayed at once.");
+        return;
+    }
+    memset(relay, 0, sizeof(*relay));
+    relay->in_use = 1;
+    relay->relay_id = strtoull(frame->content, NULL, 10);
+    relay->spool_fd = createUploadSpoolFile();
+    relay->file_size = frame->file_size;
+    memcpy(relay->sender, frame->sender, USERNAME_BUF_SIZE);
+    memcpy(relay->receiver, frame->receiver, USERNAME_BUF_SIZE);
+    memcpy(relay->filename, frame->filename, FILENAME_BUF_SIZE);
+}
+
+// Reads the data of a FILE_CHUNK frame into its file's spool and, after the last chunk, queues
+// the file for the local recipient. Returns 0 if the link failed or the chunk is malformed.
+static int receiveRelayedFileChunk(ClusterPeer *peer, int fd, const Message *frame)
+{
+    char chunk[FILE_RELAY_CHUNK_SIZE];
+    size_t chunk_len = frame->file_size;
+    if (chunk_len == 0 || chunk_len > sizeof(chunk) || !readExactFromLink(fd, chunk, chunk_len))
+        return 0;
+
+    size_t relay_id = strtoull(frame->content, NULL, 10);
+    IncomingFileRelay *relay = NULL;
+    for (int i = 0; i < CLUSTER_LINK_MAX_FILES && !relay; ++i)
+    {
+        if (peer->incoming_files[i].in_use && peer->incoming_files[i].relay_id == relay_id)
+            relay = &peer->incoming_files[i];
+    }
+    if (!relay)
+        return 1; // A file refused when it started
+    if (relay->received + chunk_len > relay->file_size)
+    {
+        abandonIncomingFile(relay, "Relayed file is longer than announced.");
+        return 0;
+    }
+    if (relay->spool_fd >= 0 && write(relay->spool_fd, chunk, chunk_len) != (ssize_t)chunk_len)
+    {
+        close(relay->spool_fd);
+        relay->spool_fd = -1; // Its remaining chunks are discarded
+    }
+    relay->received += chunk_len;
+    if (relay->received < relay->file_size)
+        return 1;
+
+    if (relay->spool_fd < 0 ||
+        !addRelayedFileToUploadQueue(relay->filename, relay->sender, relay->receiver, relay->spool_fd, relay->file_size))
+    {
+        abandonIncomingFile(relay, "Relayed file could not be stored.");
+        return 1;
+    }
+    logServerEvent("FILE", "File '%s' (%zu bytes) from %s relayed by node %d for %s.",
+                   relay->filename, relay->file_size, relay->sender, peer->node_id, relay->receiver);
+    relay->in_use = 0; // The upload queue owns the spool now
+    return 1;
+}
+
+// Handles one frame from a peer. Returns 0 if the link must be dropped.
+static int dispatchClusterFrame(ClusterPeer *peer, int fd, const Message *frame)
+{
+    int node_id = peer->node_id;
+    Message room_msg;
+    switch ((int)frame->type)
+    {
+    case CLUSTER_OP_PRESENCE_ADD:
+        addRemoteUser(frame->sender, node_id);
+        if (frame->room[0] && clusterRoomOwner(frame->room) == cluster_local_node)
+            admitRemoteRoomMember(frame->sender, node_id, frame->room); // Rejoin after a reconnect
+        break;
+    case CLUSTER_OP_PRESENCE_REMOVE:
+        removeRemoteUser(frame->sender, node_id);
+        break;
+    case CLUSTER_OP_JOIN_REQUEST:
+        answerJoinRequest(node_id, frame);
+        break;
+    case CLUSTER_OP_JOIN_REPLY:
+        completeJoinRequest(frame);
+        break;
+    case CLUSTER_OP_ROOM_LEAVE:
+        removeRemoteRoomMember(frame->sender, node_id, frame->room);
+        break;
+    case CLUSTER_OP_ROOM_PUBLISH:
+        if (unpackRoomMessage(frame, &room_msg))
+            fanOutPublishedRoomMessage(frame->room, &room_msg, frame->receiver[0] ? frame->receiver : NULL);
+        break;
+    case CLUSTER_OP_ROOM_DELIVER:
+        if (unpackRoomMessage(frame, &room_msg))
+            deliverToLocalRoomMembers(frame->room, &room_msg, frame->receiver[0] ? frame->receiver : NULL);
+        break;
+    case CLUSTER_OP_WHISPER:
+        deliverForwardedWhisper(node_id, frame);
+        break;
+    case CLUSTER_OP_FILE_RELAY:
+        startRelayedFile(peer, frame);
+        break;
+    case CLUSTER_OP_FILE_CHUNK:
+        return receiveRelayedFileChunk(peer, fd, frame);
+    default:
+        logServerEvent("CLUSTER_WARNING", "Ignoring frame of unknown type %d from node %d.", (int)frame->type, node_id);
+        break;
+    }
+    return 1;
+}
+
+// Called when the link from a peer closes: the peer most likely went away, so the link to it
+// is dropped too instead of waiting for the next write to fail (which would lose that frame).
+static void resetPeerLink(ClusterPeer *peer)
+{
+    pthread_mutex_lock(&peer->lock);
+    if (peer->socket_fd >= 0)
+        shutdown(peer->socket_fd, SHUT_RDWR);
+    peer->is_connected = 0;
+    pthread_cond_signal(&peer->wakeup);
+    pthread_mutex_unlock(&peer->lock);
+}
+
+// Reads the link a peer opened to this node until it closes, then forgets what it announced.
+static void *clusterReaderThread(void *arg)
+{
+    ClusterPeer *peer = arg;
+    int fd = peer->inbound_fd;
+    Message frame;
+    while (readFrameFromLink(fd, &frame))
+    {
+        __atomic_add_fetch(&peer->frames_received, 1, __ATOMIC_RELAXED);
+        if (!dispatchClusterFrame(peer, fd, &frame))
+            break;
+    }
+    for (int i = 0; i < CLUSTER_LINK_MAX_FILES; ++i)
+    {
+        if (peer->incoming_files[i].in_use)
+            abandonIncomingFile(&peer->incoming_files[i], "The link to the sending node closed mid-file.");
+    }
+    purgeNode(peer->node_id);
+    abandonPendingJoins(peer->node_id); // Verdicts can only arrive on this link
+    if (cluster_running)
+    {
+        logServerEvent("CLUSTER_WARNING", "Link from node %d closed.", peer->node_id);
+        resetPeerLink(peer);
+    }
+    return NULL;
+}
+
+// Waits for the first frame of a new inbound link. Returns the peer's node id, or -1 if the
+// frame is not a HELLO matching this cluster.
+static int readPeerHello(int fd)
+{
+    struct timeval timeout = {CLUSTER_HANDSHAKE_TIMEOUT_SECONDS, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    Message hello;
+    if (!readFrameFromLink(fd, &hello) || (int)hello.type != CLUSTER_OP_HELLO)
+        return -1;
+    struct timeval no_timeout = {0, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &no_timeout, sizeof(no_timeout));
+
+    char *end = NULL;
+    long node_id = strtol(hello.content, &end, 10);
+    if (end == hello.content || *end != '\0' || node_id < 0 || node_id >= cluster_node_count || node_id == cluster_local_node)
+        return -1;
+    if (hello.file_size != cluster_ring_fingerprint)
+    {
+        logServerEvent("CLUSTER_ERROR", "Refusing link from node %ld: its --cluster list differs from ours.", node_id);
+        return -1;
+    }
+    return (int)node_id;
+}
+
+// Accepts links opened by peers. A new link from a node replaces its previous one. Between
+// accepts, the thread also expires pending joins (at most a handshake timeout late).
+static void *clusterAcceptThread(void *arg)
+{
+    (void)arg;
+    struct pollfd listener = {cluster_listen_fd, POLLIN, 0};
+    while (cluster_running)
+    {
+        abandonPendingJoins(-1); // Expire joins whose owner did not answer in time
+        if (poll(&listener, 1, CLUSTER_SWEEP_INTERVAL_MS) <= 0 || !(listener.revents & POLLIN))
+            continue; // Timeout: re-check cluster_running
+        int fd = accept(cluster_listen_fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+        int node_id = readPeerHello(fd);
+        if (node_id < 0)
+        {
+            close(fd);
+            continue;
+        }
+
+        ClusterPeer *peer = &cluster_peers[node_id];
+        if (peer->reader_started)
+        {
+            shutdown(peer->inbound_fd, SHUT_RDWR); // The old reader purges the node as it exits
+            pthread_join(peer->reader_thread, NULL);
+            close(peer->inbound_fd);
+            peer->reader_started = 0;
+        }
+        peer->inbound_fd = fd;
+        if (pthread_create(&peer->reader_thread, NULL, clusterReaderThread, peer) != 0)
+        {
+            logServerEvent("CLUSTER_ERROR", "Could not start reader for node %d: %s", node_id, strerror(errno));
+            close(fd);
+            peer->inbound_fd = -1;
+            continue;
+        }
+        peer->reader_started = 1;
+        logServerEvent("CLUSTER", "Link from node %d accepted.", node_id);
+    }
+    return NULL;
+}
+
+static int openClusterListener(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    int opt_reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt_reuse, sizeof(opt_reuse));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, CLUSTER_MAX_NODES) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// --- Requests ---
+
+// Records the join and sends the request; clusterFinishRoomJoins completes it on the client's
+// loop. Called on the client's reactor thread. Returns 0 if the owner cannot be asked.
+int clusterRequestRoomJoin(ClientInfo *client, const char *room_name, const char *old_room_name)
+{
+    int owner = clusterRoomOwner(room_name);
+    pthread_mutex_lock(&pending_joins_lock);
+    PendingJoin *pending = NULL;
+    for (int i = 0; i < CLUSTER_MAX_PENDING_JOINS && !pending; ++i)
+    {
+        if (!pending_joins[i].in_use)
+            pending = &pending_joins[i];
+    }
+    if (!pending)
+    {
+        pthread_mutex_unlock(&pending_joins_lock);
+        return 0;
+    }
+    memset(pending, 0, sizeof(*pending));
+    pending->in_use = 1;
+    pending->request_id = ++next_join_request_id;
+    pending->owner_node = owner;
+    pending->client = client;
+    pending->loop_index = client->io_loop_index;
+    strncpy(pending->username, client->username, USERNAME_BUF_SIZE - 1);
+    strncpy(pending->room_name, room_name, ROOM_NAME_BUF_SIZE - 1);
+    strncpy(pending->old_room_name, old_room_name, ROOM_NAME_BUF_SIZE - 1);
+    clock_gettime(CLOCK_MONOTONIC, &pending->deadline);
+    pending->deadline.tv_sec += CLUSTER_REQUEST_TIMEOUT_MS / 1000;
+    pending->deadline.tv_nsec += (long)(CLUSTER_REQUEST_TIMEOUT_MS % 1000) * 1000000L;
+    if (pending->deadline.tv_nsec >= 1000000000L)
+    {
+        pending->deadline.tv_sec++;
+        pending->deadline.tv_nsec -= 1000000000L;
+    }
+    size_t request_id = pending->request_id;
+    pthread_mutex_unlock(&pending_joins_lock);
+
+    Message request;
+    memset(&request, 0, sizeof(request));
+    request.type = (MessageType)CLUSTER_OP_JOIN_REQUEST;
+    strncpy(request.sender, client->username, USERNAME_BUF_SIZE - 1);
+    strncpy(request.room, room_name, ROOM_NAME_BUF_SIZE - 1);
+    request.file_size = request_id;
+    client->pending_room_join = request_id;
+    if (sendToPeer(owner, &request))
+    {
+        // Later commands would be answered before the join: read nothing more until it is.
+        setClientInputPaused(client, 1);
+        return 1;
+    }
+
+    client->pending_room_join = 0;
+    pthread_mutex_lock(&pending_joins_lock);
+    pending->in_use = 0; // Still ours: only this thread frees entries of this client
+    pthread_mutex_unlock(&pending_joins_lock);
+    return 0;
+}
+
+// Takes the entry of a client's pending join out of the table. Returns 1 and fills *out if found.
+static int takePendingJoin(size_t request_id, int loop_index, int answered_only, PendingJoin *out)
+{
+    int found = 0;
+    pthread_mutex_lock(&pending_joins_lock);
+    for (int i = 0; i < CLUSTER_MAX_PENDING_JOINS && !found; ++i)
+    {
+        PendingJoin *pending = &pending_joins[i];
+        if (!pending->in_use || pending->loop_index != loop_index || (answered_only && !pending->is_answered) ||
+            (request_id != 0 && pending->request_id != request_id))
+            continue;
+        *out = *pending;
+        pending->in_use = 0;
+        found = 1;
+    }
+    pthread_mutex_unlock(&pending_joins_lock);
+    return found;
+}
+
+void clusterFinishRoomJoins(int loop_index)
+{
+    PendingJoin done;
+    while (cluster_enabled && takePendingJoin(0, loop_index, 1, &done))
+    {
+        done.client->pending_room_join = 0;
+        if (done.result == -2)
+            clusterSendRoomLeave(done.username, done.room_name); // The verdict may still arrive
+        finishRoomJoin(done.client, done.room_name, done.old_room_name, done.result);
+        setClientInputPaused(done.client, 0); // The join reply is queued ahead of anything read next
+    }
+}
+
+// Called on the client's reactor thread before the client is released, so no entry outlives it.
+void clusterCancelRoomJoin(ClientInfo *client)
+{
+    PendingJoin cancelled;
+    if (!client->pending_room_join)
+        return;
+    if (takePendingJoin(client->pending_room_join, client->io_loop_index, 0, &cancelled) &&
+        (!cancelled.is_answered || cancelled.result > 0))
+        clusterSendRoomLeave(cancelled.username, cancelled.room_name); // Admitted, or may still be
+    client->pending_room_join = 0;
+}
+
+void clusterSendRoomLeave(const char *username, const char *room_name)
+{
+    if (!cluster_enabled)
+        return;
+    Message leave;
+    memset(&leave, 0, sizeof(leave));
+    leave.type = (MessageType)CLUSTER_OP_ROOM_LEAVE;
+    strncpy(leave.sender, username, USERNAME_BUF_SIZE - 1);
+    strncpy(leave.room, room_name, ROOM_NAME_BUF_SIZE - 1);
+    sendToPeer(clusterRoomOwner(room_name), &leave);
+}
+
+static void packRoomMessage(const Message *message, const char *exclude_username, int op, Message *frame)
+{
+    memset(frame, 0, sizeof(*frame));
+    frame->type = (MessageType)op;
+    memcpy(frame->sender, message->sender, USERNAME_BUF_SIZE);
+    memcpy(frame->room, message->room, ROOM_NAME_BUF_SIZE);
+    memcpy(frame->content, message->content, MESSAGE_BUF_SIZE);
+    if (exclude_username)
+        strncpy(frame->receiver, exclude_username, USERNAME_BUF_SIZE - 1);
+    frame->file_size = (size_t)message->type;
+}
+
+int clusterPublishToRoomOwner(const Message *message, const char *exclude_username)
+{
+    Message frame;
+    packRoomMessage(message, exclude_username, CLUSTER_OP_ROOM_PUBLISH, &frame);
+    return sendToPeer(clusterRoomOwner(message->room), &frame);
+}
+
+void clusterDeliverToMemberNodes(ChatRoom *room, const Message *message, const char *exclude_username)
+{
+    if (!cluster_enabled)
+        return;
+    int has_members[CLUSTER_MAX_NODES] = {0};
+    int node_count = 0;
+    pthread_mutex_lock(&room->room_lock);
+    for (int i = 0; i < room->remote_member_count; ++i)
+    {
+        int node = room->remote_members[i].node_id;
+        if (node >= 0 && node < CLUSTER_MAX_NODES && !has_members[node])
+        {
+            has_members[node] = 1;
+            node_count++;
+        }
+    }
+    pthread_mutex_unlock(&room->room_lock);
+    if (node_count == 0)
+        return;
+
+    Message frame;
+    packRoomMessage(message, exclude_username, CLUSTER_OP_ROOM_DELIVER, &frame);
+    OutboundBuffer *encoded = encodeOutboundMessage(&frame, WIRE_PROTOCOL_FRAMED); // Shared by every link
+    for (int node = 0; node < cluster_node_count; ++node)
+    {
+        if (has_members[node])
+            enqueueToPeer(node, &encoded, 1);
+    }
+    releaseOutboundBuffer(encoded);
+}
+
+int clusterForwardWhisper(const Message *whisper_message, int node_id)
+{
+    Message frame = *whisper_message;
+    frame.type = (MessageType)CLUSTER_OP_WHISPER;
+    return sendToPeer(node_id, &frame);
+}
+
+// Queues the file's FILE_RELAY frame and hands its spool to the link's sender thread, which sends
+// the data in chunks between other frames. The spool now belongs to the link.
+int clusterRelayFile(FileTransferTask *task, int node_id)
+{
+    if (!cluster_running || node_id < 0 || node_id >= cluster_node_count || node_id == cluster_local_node)
+        return 0;
+
+    Message header;
+    memset(&header, 0, sizeof(header));
+    header.type = (MessageType)CLUSTER_OP_FILE_RELAY;
+    strncpy(header.sender, task->sender_username, USERNAME_BUF_SIZE - 1);
+    strncpy(header.receiver, task->receiver_username, USERNAME_BUF_SIZE - 1);
+    strncpy(header.filename, task->filename, FILENAME_BUF_SIZE - 1);
+    header.file_size = task->file_size;
+    size_t relay_id = __atomic_add_fetch(&next_file_relay_id, 1, __ATOMIC_RELAXED);
+    snprintf(header.content, sizeof(header.content), "%zu", relay_id);
+
+    OutboundBuffer *frame = encodeOutboundMessage(&header, WIRE_PROTOCOL_FRAMED);
+    OutboundBuffer *spool = createSpooledOutboundBuffer(task->spool_fd, task->file_size);
+    if (spool)
+        task->spool_fd = -1;
+    int queued = 0;
+    ClusterPeer *peer = &cluster_peers[node_id];
+    pthread_mutex_lock(&peer->lock);
+    if (frame && spool && peer->is_connected && peer->queue_count < CLUSTER_LINK_QUEUE_CAPACITY &&
+        peer->outgoing_file_count < CLUSTER_LINK_MAX_FILES)
+    {
+        // The FILE_RELAY frame is queued first and queued frames go before chunks: it arrives first
+        peer->queue[(peer->queue_head + peer->queue_count) % CLUSTER_LINK_QUEUE_CAPACITY] = frame;
+        peer->queue_count++;
+        peer->outgoing_files[peer->outgoing_file_count++] = (OutgoingFileRelay){relay_id, spool, 0};
+        frame = spool = NULL; // Now owned by the link
+        queued = 1;
+        pthread_cond_signal(&peer->wakeup);
+    }
+    pthread_mutex_unlock(&peer->lock);
+    if (!queued)
+        __atomic_add_fetch(&peer->frames_dropped, 1, __ATOMIC_RELAXED);
+    releaseOutboundBuffer(frame);
+    releaseOutboundBuffer(spool);
+    return queued;
+}
+
+int readClusterPeerStats(ClusterPeerStats *stats, int max_peers)
+{
+    int count = 0;
+    for (int node = 0; cluster_enabled && node < cluster_node_count && count < max_peers; ++node)
+    {
+        if (node == cluster_local_node)
+            continue;
+        ClusterPeer *peer = &cluster_peers[node];
+        pthread_mutex_lock(&peer->lock);
+        stats[count].is_connected = peer->is_connected;
+        pthread_mutex_unlock(&peer->lock);
+        stats[count].node_id = node;
+        stats[count].frames_sent = __atomic_load_n(&peer->frames_sent, __ATOMIC_RELAXED);
+        stats[count].frames_received = __atomic_load_n(&peer->frames_received, __ATOMIC_RELAXED);
+        stats[count].frames_dropped = __atomic_load_n(&peer->frames_dropped, __ATOMIC_RELAXED);
+        stats[count].remote_users = __atomic_load_n(&peer->remote_users, __ATOMIC_RELAXED);
+        count++;
+    }
+    return count;
+}
+
+// --- Lifecycle ---
+
+int initializeCluster(const ServerConfig *config)
+{
+    if (config->cluster_node_count == 0)
+        return 1;
+
+    cluster_node_count = config->cluster_node_count;
+    cluster_local_node = config->cluster_node_id;
+    buildClusterRing(config);
+    if (!initializeNameIndex(&remote_user_index, (size_t)g_server_state->max_clients))
+    {
+        logServerEvent("CRITICAL", "Failed to allocate the cluster presence directory.");
+        return 0;
+    }
+
+    int link_port = config->cluster_nodes[cluster_local_node].port;
+    cluster_listen_fd = openClusterListener(link_port);
+    if (cluster_listen_fd < 0)
+    {
+        logServerEvent("CRITICAL", "Cluster link listener could not bind port %d: %s", link_port, strerror(errno));
+        return 0;
+    }
+
+    cluster_enabled = 1;
+    cluster_running = 1;
+    for (int node = 0; node < cluster_node_count; ++node)
+    {
+        ClusterPeer *peer = &cluster_peers[node];
+        peer->node_id = node;
+        peer->address = config->cluster_nodes[node];
+        peer->socket_fd = -1;
+        peer->inbound_fd = -1;
+        pthread_mutex_init(&peer->lock, NULL);
+        pthread_cond_init(&peer->wakeup, NULL);
+        if (node != cluster_local_node && pthread_create(&peer->sender_thread, NULL, clusterSenderThread, peer) == 0)
+            peer->sender_started = 1;
+    }
+    if (pthread_create(&cluster_accept_thread, NULL, clusterAcceptThread, NULL) == 0)
+        cluster_accept_started = 1;
+
+    logServerEvent("CLUSTER", "Node %d of %d: links on port %d, %d ring points per node.",
+                   cluster_local_node, cluster_node_count, link_port, CLUSTER_VIRTUAL_NODES);
+    return 1;
+}
+
+// Stops accepting links, closes every link and joins the cluster threads. Cluster calls made
+// afterwards (e.g. by clients being disconnected) find no links and do nothing.
+void shutdownCluster(void)
+{
+    if (!cluster_enabled || !cluster_running)
+        return;
+    cluster_running = 0;
+
+    if (cluster_accept_started)
+        pthread_join(cluster_accept_thread, NULL);
+    close(cluster_listen_fd);
+    cluster_listen_fd = -1;
+
+    for (int node = 0; node < cluster_node_count; ++node)
+    {
+        ClusterPeer *peer = &cluster_peers[node];
+        pthread_mutex_lock(&peer->lock);
+        if (peer->socket_fd >= 0)
+            shutdown(peer->socket_fd, SHUT_RDWR); // Unblocks a send to a stalled peer
+        pthread_cond_broadcast(&peer->wakeup);
+        pthread_mutex_unlock(&peer->lock);
+        if (peer->sender_started)
+            pthread_join(peer->sender_thread, NULL);
+        if (peer->reader_started)
+        {
+            shutdown(peer->inbound_fd, SHUT_RDWR);
+            pthread_join(peer->reader_thread, NULL);
+            close(peer->inbound_fd);
+            peer->inbound_fd = -1;
+        }
+        peer->sender_started = peer->reader_started = 0;
+    }
+
+    logServerEvent("CLUSTER", "Cluster links closed.");
+}
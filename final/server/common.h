@@ -11,40 +11,194 @@
 #include <time.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>  // For TCP_NODELAY on client sockets
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <sys/select.h> // For fd_set (though mostly used in .c files)
+#include <sys/select.h>   // For fd_set (though mostly used in .c files)
+#include <sys/epoll.h>    // For the I/O reactor event loops
+#include <sys/eventfd.h>  // For waking reactor threads on shutdown
+#include <sys/resource.h> // For RLIMIT_NOFILE (connection capacity)
+#include <sys/sendfile.h> // For zero-copy delivery of spooled files
+#include <stdint.h>       // For uint32_t name hashes
 
 // Shared project includes
 #include "../shared/protocol.h"
 #include "../shared/utils.h"
+#include "../shared/pool.h"
 
 // Server-specific configuration and limits
-#define MAX_SERVER_CLIENTS 30            // Project: "Supports at least 15 concurrent clients"
-#define MAX_ROOMS MAX_SERVER_CLIENTS     // A reasonable upper bound, can be adjusted
+#define MAX_SERVER_CLIENTS 30            // Project: "Supports at least 15 concurrent clients" (minimum capacity)
+#define MAX_SERVER_CONNECTIONS 65536     // Hard cap on connection slots; the real limit comes from RLIMIT_NOFILE
+#define SERVER_RESERVED_FDS 64           // Descriptors kept back for log file, listen socket, epoll/event fds
+#define SERVER_IO_THREADS 4              // Fixed number of reactor threads that own all client sockets
+#define REACTOR_MAX_EVENTS 64            // Events fetched per epoll_wait() call
+#define REACTOR_MESSAGES_PER_WAKEUP 16   // Messages handled per client per wakeup (fairness between clients)
+#define CLIENT_OUTBOUND_QUEUE_CAPACITY 256      // Max queued outbound buffers per client
+#define CLIENT_OUTBOUND_MAX_BYTES (1024 * 1024) // Max unsent chat bytes per client before the slow-consumer policy applies
+#define OUTBOUND_BULK_WAIT_SECONDS 10           // How long file delivery waits for queue space or completion
+#define FILE_RELAY_CHUNK_SIZE 65536             // Bytes moved per read/write when relaying file data
+#define FILE_SPOOL_TEMPLATE "/tmp/chatserver_spool_XXXXXX" // mkstemp() template for upload spool files
+#define REGISTRY_LOCK_STRIPES 64         // Read-write locks guarding the buckets of each name index
 #define MAX_MEMBERS_PER_ROOM 15          // As per PDF: "Each room has a max capacity of 15 users"
-#define MAX_UPLOAD_QUEUE_SIZE 5          // PDF: "max 5 uploads at a time" (concurrent processing slots)
+#define MAX_UPLOAD_QUEUE_SIZE 5          // PDF: "max 5 uploads at a time" (default number of file workers)
+#define MAX_FILE_WORKERS 64              // Upper bound for --file-workers
+#define DEFAULT_FILE_PROCESSING_DELAY_MS 0 // Simulated per-file processing time (--file-delay-ms)
+#define FILE_SCHEDULER_AGING_BYTES_PER_SECOND (256 * 1024) // Smallest-first: each second in queue counts as this many bytes less
 #define SERVER_LOG_FILENAME "server.log" // Name of the server log file
+#define LOG_RING_CAPACITY 2048           // Pending log records (power of two); producers never block on I/O
+#define LOG_RECORD_MAX_LENGTH 1536       // Longest formatted log line, including the newline
+#define LOG_WRITE_BATCH 64               // Records handed to one writev() call
+#define DEFAULT_LOG_FLUSH_INTERVAL_MS 50 // How often the log writer flushes (--log-flush-ms)
+#define METRICS_MAX_THREAD_SHARDS 128    // Threads with a private counter shard; later ones share shard 0
+#define METRICS_HISTOGRAM_BUCKETS 32     // Power-of-two latency buckets (bucket b holds values below 2^b)
+#define METRICS_SNAPSHOT_MAX_SIZE 8192   // Longest text snapshot served on the admin socket
 #define MAX_RECEIVED_FILES_TRACKED 50    // For Test Scenario 9: Same Filename Collision (per user)
+#define CLUSTER_MAX_NODES 8              // Nodes listed in --cluster
+#define CLUSTER_NODE_HOST_SIZE 64        // Longest host name of a --cluster entry, including the terminator
+#define CLUSTER_VIRTUAL_NODES 64         // Points per node on the consistent-hash ring of rooms
+#define CLUSTER_LINK_QUEUE_CAPACITY 4096 // Frames queued on one peer link; more are dropped
+#define CLUSTER_LINK_MAX_FILES 16        // Files relayed over one peer link at the same time; more are refused
+#define CLUSTER_RECONNECT_MS 1000        // Pause between attempts to (re)connect a peer link
+#define CLUSTER_REQUEST_TIMEOUT_MS 2000  // How long a join waits for the verdict of the room's owning node
+#define CLUSTER_SWEEP_INTERVAL_MS 250    // How often the link accept thread expires unanswered joins
+#define CLUSTER_MAX_PENDING_JOINS 64     // Joins waiting for a remote verdict at the same time
 
 // Forward declarations for structs
 typedef struct ClientInfo ClientInfo;
 typedef struct ChatRoom ChatRoom;
 typedef struct FileTransferTask FileTransferTask;
 
+// Link of a name index bucket chain, embedded in the structure that owns the name
+typedef struct NameIndexEntry
+{
+    const char *key;             // The owner's name buffer
+    void *owner;                 // The ClientInfo or ChatRoom carrying this entry
+    struct NameIndexEntry *next; // Next entry in the same bucket
+} NameIndexEntry;
+
+// Hash index from names to owners with striped read-write locking (see server/registry.c)
+typedef struct NameIndex
+{
+    NameIndexEntry **buckets;                            // Power-of-two bucket array
+    size_t bucket_mask;                                  // Bucket count - 1
+    pthread_rwlock_t stripe_locks[REGISTRY_LOCK_STRIPES]; // Bucket i is guarded by stripe i % REGISTRY_LOCK_STRIPES
+} NameIndex;
+
+// What to do with a client whose outbound queue is full
+typedef enum SlowConsumerPolicy
+{
+    SLOW_CONSUMER_DROP,      // Drop the new message and keep the client (default)
+    SLOW_CONSUMER_DISCONNECT // Disconnect the client
+} SlowConsumerPolicy;
+
+// Order in which file workers take queued transfers
+typedef enum FileSchedulingPolicy
+{
+    FILE_SCHEDULE_SMALLEST_FIRST, // Smallest file first, with aging so large files are not starved (default)
+    FILE_SCHEDULE_FIFO            // Arrival order
+} FileSchedulingPolicy;
+
+// Severity of a log tag; events below the configured level are not logged
+typedef enum LogLevel
+{
+    LOG_LEVEL_DEBUG,   // DEBUG* tags
+    LOG_LEVEL_INFO,    // Regular events (INFO, CONNECT, COMMAND, FILE, ...) (default threshold)
+    LOG_LEVEL_WARNING, // WARNING*, REJECTED, LOGIN_FAIL
+    LOG_LEVEL_ERROR    // *ERROR*, CRITICAL*
+} LogLevel;
+
+// Address of one node of the cluster (an entry of --cluster)
+typedef struct ClusterNodeAddress
+{
+    char host[CLUSTER_NODE_HOST_SIZE]; // Host name or IPv4 address
+    int port;                          // Port of the node's inter-node link listener
+} ClusterNodeAddress;
+
+// Runtime configuration, parsed from the command line in server/main.c
+typedef struct ServerConfig
+{
+    SlowConsumerPolicy slow_consumer_policy;     // Applied when a client's outbound queue is full
+    int file_worker_count;                       // Number of file transfer worker threads
+    int file_processing_delay_ms;                // Simulated processing time per file before delivery
+    FileSchedulingPolicy file_scheduling_policy; // How workers pick the next queued file
+    LogLevel log_level;                          // Minimum severity written to console and server.log
+    int log_flush_interval_ms;                   // Maximum time a log record waits in the ring (0 = flush at once)
+    int stats_interval_seconds;                  // Period of the STATS line in server.log (0 = off)
+    char admin_socket_path[108];                 // Unix socket serving metrics snapshots (empty = off)
+    int cluster_node_count;                      // Nodes in --cluster (0 = single node)
+    int cluster_node_id;                         // This node's index in cluster_nodes (--node-id)
+    ClusterNodeAddress cluster_nodes[CLUSTER_MAX_NODES]; // Every node, in the same order on all nodes
+} ServerConfig;
+
+// Delivery state of a queued outbound buffer
+enum
+{
+    OUTBOUND_PENDING,   // Still queued or partially sent
+    OUTBOUND_DELIVERED, // Fully handed to the kernel
+    OUTBOUND_DISCARDED  // Dropped because the connection closed
+};
+
+// Encoded bytes waiting to be sent. Refcounted so one encoded broadcast can sit in many queues.
+// A spooled buffer has no data in memory: its bytes go from spool_fd to the socket via sendfile().
+typedef struct OutboundBuffer
+{
+    int reference_count;         // Updated atomically; freed when it reaches 0
+    size_t length;               // Number of bytes to send
+    unsigned char *data;         // Points at inline_data (NULL for spooled buffers)
+    int spool_fd;                // Spool file owned by the buffer (closed on free), or -1
+    volatile int delivery_state; // OUTBOUND_* (only meaningful with a single recipient)
+    int message_type;            // MessageType of an encoded message (for metrics), -1 for raw data
+    MemoryPool *pool;            // Size class the buffer came from, NULL if malloc'd
+    unsigned char inline_data[]; // Storage for small encoded messages
+} OutboundBuffer;
+
 // Structure representing a connected client on the server side
 struct ClientInfo
 {
     int socket_fd;                              // Client's socket descriptor
     char username[USERNAME_BUF_SIZE];           // Client's authenticated username
     char current_room_name[ROOM_NAME_BUF_SIZE]; // Name of the room client is currently in
+    ChatRoom *current_room;                     // That room (valid while the client is a member), or NULL
     struct sockaddr_in client_address;          // Client's network address (for logging IP)
-    pthread_t thread_id;                        // Thread ID handling this client's connection
+    pthread_t thread_id;                        // Reactor thread ID that owns this client's socket
+    int io_loop_index;                          // Index of the owning reactor loop in ServerMainState.io_loops
     volatile sig_atomic_t is_active;            // Flag: 1 if client is logged in and active, 0 otherwise
     time_t connection_time;                     // Timestamp of initial connection
+    int client_slot_index;                      // Position in ServerMainState.connected_clients
+    int reference_count;                        // Registry reference plus one per in-flight user (retainClient)
+    NameIndexEntry name_index_entry;            // Link in the username index (while logged in)
+    int is_name_indexed;                        // 1 while the username is in the index
+    size_t pending_room_join;                   // Cluster join awaiting the owner's verdict, or 0 (owning reactor thread only)
+
+    // Outbound queue: every send to this client goes through it (see server/outbound_queue.c)
+    pthread_mutex_t outbound_lock;                                  // Protects the outbound fields and sends on socket_fd
+    pthread_cond_t outbound_progress_cond;                          // Signaled when queued data is sent or discarded
+    OutboundBuffer *outbound_ring[CLIENT_OUTBOUND_QUEUE_CAPACITY];  // Circular queue of buffers to send
+    int outbound_head;                                              // Index of the oldest queued buffer
+    int outbound_count;                                             // Number of queued buffers
+    size_t outbound_head_offset;                                    // Bytes of the head buffer already sent
+    size_t outbound_queued_bytes;                                   // Unsent bytes across the queue
+    int outbound_write_armed;                                       // 1 while EPOLLOUT is registered for the socket
+    int input_paused;                                               // 1 while EPOLLIN is withheld (set by the owning reactor thread)
+    int outbound_closed;                                            // 1 once the connection is closing (nothing more is sent)
+    unsigned long outbound_dropped_messages;                        // Messages dropped by the slow-consumer policy
+
+    // Partially received inbound message (only touched by the owning reactor thread)
+    int wire_protocol;                                // Negotiated WIRE_PROTOCOL_* for this connection
+    unsigned char inbound_buffer[WIRE_UNIT_MAX_SIZE]; // Raw bytes of the wire unit being assembled
+    size_t inbound_bytes_received;                    // Number of bytes of inbound_buffer filled so far
+    Message inbound_message;                          // Last decoded message, passed to the handlers
+
+    // File upload streaming in from this client (only touched by the owning reactor thread)
+    int upload_spool_fd;                     // Unlinked temp file receiving the upload, or -1
+    size_t upload_file_size;                 // Announced size of the upload
+    size_t upload_bytes_remaining;           // Raw bytes still expected on the socket (0 = no upload)
+    int upload_write_failed;                 // Spool write failed; the rest is drained and discarded
+    char upload_filename[FILENAME_BUF_SIZE]; // Name of the file being uploaded
+    char upload_receiver[USERNAME_BUF_SIZE]; // Intended recipient
 
     // For Test Scenario 9: Filename collision detection
     char received_filenames[MAX_RECEIVED_FILES_TRACKED][FILENAME_BUF_SIZE]; // Tracks names of files received by this user
@@ -52,13 +206,29 @@ struct ClientInfo
     pthread_mutex_t received_files_lock;                                    // Mutex to protect access to received_filenames list
 };
 
+// A room member logged in on another node (cluster mode)
+typedef struct RemoteRoomMember
+{
+    char username[USERNAME_BUF_SIZE];
+    int node_id; // Node the member's connection lives on
+} RemoteRoomMember;
+
 // Structure representing a chat room
+// Rooms live in reusable slots: a room is removed from the index when its last member leaves
+// and its slot goes back to the free list.
+// In cluster mode the node owning a room (see server/cluster.c) holds the complete member list:
+// its local members plus remote_members. Other nodes keep a room of the same name holding only
+// their own members, used to deliver what the owner fans out.
 struct ChatRoom
 {
     char name[ROOM_NAME_BUF_SIZE];             // Name of the chat room
     ClientInfo *members[MAX_MEMBERS_PER_ROOM]; // Array of pointers to members in this room
     int member_count;                          // Current number of members in the room
+    RemoteRoomMember remote_members[MAX_MEMBERS_PER_ROOM]; // Members on other nodes (owning node only)
+    int remote_member_count;                   // Entries in remote_members; counts toward MAX_MEMBERS_PER_ROOM
     pthread_mutex_t room_lock;                 // Mutex to protect members list and member_count
+    NameIndexEntry name_index_entry;           // Link in the room name index
+    int slot_index;                            // Position in ServerMainState.chat_rooms
 };
 
 // Structure representing a file transfer task in the server's queue
@@ -68,7 +238,10 @@ struct FileTransferTask
     char sender_username[USERNAME_BUF_SIZE];   // Username of the file sender
     char receiver_username[USERNAME_BUF_SIZE]; // Username of the file recipient
     size_t file_size;                          // Size of the file
+    int spool_fd;                              // Spool file holding the upload (owned by the task, closed after delivery)
     time_t enqueue_timestamp;                  // Timestamp when task was added to queue (for wait duration logging)
+    struct timespec enqueue_monotonic;         // Same moment on CLOCK_MONOTONIC (for the queue wait histogram)
+    int is_relayed;                            // Relayed by another node that already processed it: no delay
     struct FileTransferTask *next_task;        // Pointer for linked list implementation of the queue
 };
 
@@ -80,72 +253,171 @@ typedef struct FileUploadQueue
     int current_queue_length; // Number of tasks currently in the queue (waiting for a worker)
 
     pthread_mutex_t queue_access_mutex;  // Mutex to protect queue (head, tail, length)
-    pthread_cond_t queue_not_empty_cond; // Condition variable to signal workers when queue has tasks
-    sem_t available_upload_slots_sem;    // Semaphore limiting concurrent file processing workers
+    pthread_cond_t queue_not_empty_cond; // Signaled when a task is queued, broadcast on shutdown
+    pthread_cond_t shutdown_cond;        // Broadcast on shutdown to cut processing delays short
 } FileUploadQueue;
 
+// One reactor event loop: an epoll instance served by a single I/O thread
+typedef struct IoReactorLoop
+{
+    int epoll_fd;        // epoll instance holding this loop's client sockets
+    int wakeup_event_fd; // eventfd used to wake the loop (e.g., for shutdown)
+    pthread_t thread_id; // I/O thread running the loop
+    int loop_index;      // Position of this loop in ServerMainState.io_loops
+} IoReactorLoop;
+
 // Structure for the overall server state
 typedef struct ServerMainState
 {
-    ClientInfo *connected_clients[MAX_SERVER_CLIENTS]; // Array of pointers to client structures
-    ChatRoom chat_rooms[MAX_ROOMS];                    // Array of chat room structures
+    ClientInfo **connected_clients; // Array of max_clients pointers to client structures
+    int max_clients;                // Connection slots, derived from the process fd limit
+    int *free_client_slots;         // Stack of unused slot indices into connected_clients
+    int free_client_slot_count;     // Number of entries on free_client_slots
+    ChatRoom *chat_rooms;           // Array of max_rooms reusable room slots
+    int max_rooms;                  // Room slots; every listed room has a member, so max_clients suffices
+    int *free_room_slots;           // Stack of unused slot indices into chat_rooms
+    int free_room_slot_count;       // Number of entries on free_room_slots
+
+    NameIndex client_name_index; // Username -> logged-in ClientInfo
+    NameIndex room_name_index;   // Room name -> listed ChatRoom
 
     int active_client_count; // Count of currently logged-in (active) clients
     int current_room_count;  // Count of currently active (created) rooms
 
     FileUploadQueue file_transfer_manager; // Manages the file upload queue and workers
 
-    pthread_mutex_t clients_list_mutex; // Mutex for connected_clients array and active_client_count
-    pthread_mutex_t rooms_list_mutex;   // Mutex for chat_rooms array and current_room_count
+    pthread_mutex_t clients_list_mutex; // Mutex for connected_clients, free_client_slots and active_client_count
+    pthread_mutex_t rooms_list_mutex;   // Mutex for free_room_slots and current_room_count
 
     int server_listen_socket_fd;                             // Listening socket for incoming connections
     volatile sig_atomic_t server_is_running;                 // Flag for graceful server shutdown (1=running, 0=shutting down)
-    pthread_t file_worker_thread_ids[MAX_UPLOAD_QUEUE_SIZE]; // IDs of file processing worker threads
+    pthread_t *file_worker_thread_ids;                       // IDs of the config.file_worker_count file worker threads
+
+    IoReactorLoop io_loops[SERVER_IO_THREADS]; // Reactor loops that own all client sockets
+    unsigned int next_io_loop;                 // Round-robin cursor for assigning new clients to loops
+
+    ServerConfig config; // Runtime configuration (command-line options)
 } ServerMainState;
 
+// Counters of one peer link, read by the metrics snapshot
+typedef struct ClusterPeerStats
+{
+    int node_id;
+    int is_connected;                   // Outbound link established
+    unsigned long long frames_sent;     // Frames written to the outbound link
+    unsigned long long frames_received; // Frames read from the peer's link to this node
+    unsigned long long frames_dropped;  // Frames not sent: link down or its queue full
+    int remote_users;                   // Users the peer reported as logged in
+} ClusterPeerStats;
+
 // Global pointer to the server state instance
 extern ServerMainState *g_server_state;
 
 // --- Function Declarations ---
 
 // Located in: server/main.c
-void initializeServerState(void);              // Initializes the global server state structure and subsystems
+void initializeServerState(const ServerConfig *config); // Initializes the global server state structure and subsystems
 int setupServerListeningSocket(int port);      // Sets up and binds the main listening socket
 void acceptClientConnectionsLoop(void);        // Main loop for accepting new client connections
 void cleanupServerResources(void);             // Cleans up all server resources on shutdown
 void sigintShutdownHandler(int signal_number); // Handles SIGINT for graceful server shutdown
 
+// Located in: server/reactor.c
+int initializeIoReactor(void);                // Creates the epoll loops and starts the fixed pool of I/O threads
+int reactorAddClient(ClientInfo *client);     // Hands a registered client socket to one of the reactor loops
+void *ioReactorLoopThread(void *loopPtrArg);  // Thread function running one reactor loop
+void shutdownIoReactor(void);                 // Wakes and joins all I/O threads, closes epoll/event fds
+void reactorWakeLoop(int loop_index);         // Wakes one loop so it finishes the cluster joins answered for its clients
+
 // Located in: server/client_handler.c
-void *clientConnectionThreadHandler(void *clientInfoPtrArg);                                    // Thread function for handling a single client connection
 ClientInfo *registerNewClientOnServer(int client_socket_fd, struct sockaddr_in client_address); // Adds a new client to server list (pre-login)
 int processClientLogin(ClientInfo *clientInfo, const Message *login_message);                   // Processes a login request from a client
 void handleClientMessage(ClientInfo *clientInfo, const Message *message);                       // Main dispatcher for client messages
 void unregisterClient(ClientInfo *clientInfo, int is_unexpected_disconnect);                    // Removes client from server, cleans up resources
-void notifyClientOfShutdown(int client_socket_fd);                                              // Sends a shutdown notification to a client
+void notifyClientOfShutdown(ClientInfo *clientInfo);                                            // Sends a shutdown notification to a client
+void retainClient(ClientInfo *clientInfo);                                                      // Keeps a client structure alive outside the registry lock
+void releaseClient(ClientInfo *clientInfo);                                                     // Drops a reference; frees the client on the last one
+
+// Located in: server/outbound_queue.c
+OutboundBuffer *createOutboundBuffer(size_t length);                                         // Allocates a buffer with inline storage
+OutboundBuffer *createSpooledOutboundBuffer(int spool_fd, size_t length);                   // Sends a spool file from offset 0 (takes ownership)
+OutboundBuffer *encodeOutboundMessage(const Message *msg, int protocol_version);             // Serializes a message once for queuing
+void retainOutboundBuffer(OutboundBuffer *buffer);                                           // Adds a reference
+void releaseOutboundBuffer(OutboundBuffer *buffer);                                          // Drops a reference, freeing on the last one
+int initializeClientOutboundQueue(ClientInfo *client);                                       // Sets up a new client's queue
+void destroyClientOutboundQueue(ClientInfo *client);                                         // Destroys the queue's sync objects
+int enqueueOutboundBuffers(ClientInfo *client, OutboundBuffer **buffers, int count, int is_bulk); // Queues buffers back to back and starts sending
+int queueMessageToClient(ClientInfo *client, const Message *msg);                            // Encodes in the client's protocol and queues
+int queueMessageToClientWithProtocol(ClientInfo *client, const Message *msg, int protocol);  // Encodes in an explicit protocol and queues
+void flushClientOutboundQueue(ClientInfo *client);                                           // Sends what the socket accepts (on EPOLLOUT)
+void setClientInputPaused(ClientInfo *client, int paused);                                   // Stops or resumes reading the client (owning reactor thread)
+int waitForOutboundDelivery(ClientInfo *client, OutboundBuffer *buffer, int timeout_seconds); // Waits until a queued buffer is sent or dropped
+void closeClientOutboundQueue(ClientInfo *client);                                           // Last non-blocking flush, then discards the rest
+
+// Located in: server/registry.c
+uint32_t hashIndexName(const char *name);                               // FNV-1a hash of a name (also places rooms on the cluster ring)
+int initializeNameIndex(NameIndex *index, size_t expected_entries);     // Allocates buckets and stripe locks
+void destroyNameIndex(NameIndex *index);                                // Frees buckets and destroys stripe locks
+pthread_rwlock_t *nameIndexLockFor(NameIndex *index, const char *key);  // Stripe lock guarding key's bucket
+void *nameIndexLookupLocked(NameIndex *index, const char *key);         // Finds key's owner (stripe lock HELD)
+void nameIndexInsertLocked(NameIndex *index, NameIndexEntry *entry);    // Adds an entry (stripe lock HELD for writing)
+void nameIndexRemoveLocked(NameIndex *index, NameIndexEntry *entry);    // Removes an entry (stripe lock HELD for writing)
+size_t nameIndexRemoveMatching(NameIndex *index, int (*matches)(const void *owner, void *context),
+                               void (*on_removed)(void *owner, void *context), void *context); // Removes entries whose owner matches (takes the stripe locks)
 
 // Located in: server/room_manager.c
 void initializeRoomSystem(void);                                                                                  // Initializes the chat room management system
-ChatRoom *findOrCreateChatRoom(const char *room_name_to_find);                                                    // Finds an existing room or creates a new one
-int addClientToRoom(ClientInfo *client, ChatRoom *room);                                                          // Adds a client to a specified room
+void cleanupRoomSystem(void);                                                                                     // Releases room slots and the room index on shutdown
+int joinChatRoom(ClientInfo *client, const char *room_name, ChatRoom **out_room);                                 // Finds or creates a room and adds the client
 void removeClientFromTheirRoom(ClientInfo *client);                                                               // Removes a client from their current room
 void handleJoinRoomRequest(ClientInfo *client, const char *room_name_requested);                                  // Handles a client's /join request
+void finishRoomJoin(ClientInfo *client, const char *room_name, const char *old_room_name, int join_result);        // Completes a join once admitted (1), refused (0/-1) or unreachable (-2)
 void handleLeaveRoomRequest(ClientInfo *client);                                                                  // Handles a client's /leave request
 void handleBroadcastRequest(ClientInfo *client_sender, const char *message_content);                              // Handles a /broadcast request
 void handleWhisperRequest(ClientInfo *client_sender, const char *receiver_username, const char *message_content); // Handles /whisper
 void broadcastMessageToRoomMembers(ChatRoom *room, const Message *message_to_send, const char *exclude_username); // Sends msg to room
 void notifyRoomOfClientAction(ClientInfo *acting_client, ChatRoom *room, const char *action_verb);                // Notifies room members of a client's action (e.g., joined, left, disconnected)
+int publishRoomMessage(ChatRoom *room, const Message *message_to_send, const char *exclude_username);             // Sends msg to every member on every node; 0 if the owner is unreachable
+void deliverToLocalRoomMembers(const char *room_name, const Message *message_to_send, const char *exclude_username);  // Sends a message the owner fanned out to this node's members
+void fanOutPublishedRoomMessage(const char *room_name, const Message *message_to_send, const char *exclude_username); // Owner: publishes a message handed over by another node
+int admitRemoteRoomMember(const char *username, int node_id, const char *room_name);                             // Owner: adds a member of another node (1, 0 if full, -1)
+void removeRemoteRoomMember(const char *username, int node_id, const char *room_name);                           // Owner: removes a member of another node
+void removeRemoteRoomMembersOfNode(int node_id);                                                                  // Owner: drops every member of a node whose link closed
 
 // Located in: server/file_transfer.c
 void initializeFileTransferSystem(void);     // Initializes the file transfer queue and worker threads
 void *fileProcessingWorkerThread(void *arg); // Thread function for a file processing worker
 int addFileToUploadQueue(const char *filename, const char *sender_user, const char *receiver_user,
-                         size_t file_size_val);                                            // Adds a file (metadata) to the upload queue (simulation)
+                         int spool_fd, size_t file_size_val);                              // Adds a received file to the upload queue (takes ownership of spool_fd)
+int addRelayedFileToUploadQueue(const char *filename, const char *sender_user, const char *receiver_user,
+                                int spool_fd, size_t file_size_val);                       // Queues a file relayed by another node for local delivery
+int createUploadSpoolFile(void);                                                           // Unlinked temp file for incoming file data, or -1
 void handleFileTransferRequest(ClientInfo *sender_client, const Message *file_req_header); // Handles /sendfile request
-void executeFileTransferToRecipient(FileTransferTask *task);                               // Simulates the actual file transfer to recipient
+int receiveFileUploadChunk(ClientInfo *sender_client);                                     // Moves one chunk of an in-progress upload to its spool file
+void abortInboundFileUpload(ClientInfo *sender_client);                                    // Drops an unfinished upload (sender disconnected)
+void executeFileTransferToRecipient(FileTransferTask *task);                               // Sends the queued file to its recipient
 void cleanupFileTransferSystem(void);                                                      // Cleans up file transfer system resources on shutdown
 
+// Located in: server/cluster.c
+int initializeCluster(const ServerConfig *config);        // Builds the room ring and starts the peer links (no-op without --cluster)
+void shutdownCluster(void);                               // Closes the peer links and joins their threads
+int clusterIsEnabled(void);                               // 1 while this node is part of a running cluster
+int clusterLocalNodeId(void);                             // This node's id (0 when not clustered)
+int clusterRoomOwner(const char *room_name);              // Node owning a room on the consistent-hash ring
+int clusterFindUserNode(const char *username);            // Node a user on another node is logged in on, or -1
+void clusterAnnouncePresence(const char *username, int is_online);                  // Replicates a login or logout to every peer
+int clusterRequestRoomJoin(ClientInfo *client, const char *room_name, const char *old_room_name); // Asks the owner to admit a local user; 0 if it cannot be asked
+void clusterFinishRoomJoins(int loop_index);                                        // Reactor loop: finishes the answered joins of its clients
+void clusterCancelRoomJoin(ClientInfo *client);                                     // Drops a client's pending join (client is disconnecting)
+void clusterSendRoomLeave(const char *username, const char *room_name);             // Tells the owner a local user left its room
+int clusterPublishToRoomOwner(const Message *message, const char *exclude_username); // Hands a room message to the owner for fan-out
+void clusterDeliverToMemberNodes(ChatRoom *room, const Message *message, const char *exclude_username); // Owner: forwards to nodes with members
+int clusterForwardWhisper(const Message *whisper_message, int node_id);             // Sends a whisper to the recipient's node
+int clusterRelayFile(FileTransferTask *task, int node_id);                          // Streams a queued file to the recipient's node in chunks (takes the spool)
+int readClusterPeerStats(ClusterPeerStats *stats, int max_peers);                   // Fills per-peer link counters, returns the count
+
 // Located in: server/logging.c
-int initializeServerLogging(const char *log_filename);                 // Initializes the server logging mechanism
+int initializeServerLogging(const char *log_filename, const ServerConfig *config); // Opens the log file and starts the writer thread
 void finalizeServerLogging(void);                                      // Finalizes logging, flushes and closes log file
 void logServerEvent(const char *tag, const char *details_format, ...); // General purpose logging function
 // Specific event logging functions for consistent formatting (as per PDF examples)
@@ -163,19 +435,31 @@ void logEventFileTransferInitiated(const char *sender_username, const char *rece
 void logEventFileQueued(const char *sender_username, const char *filename, int current_q_size);
 void logEventFileRejectedOversized(const char *sender_username, const char *filename, size_t attempted_size);
 void logEventFileTransferProcessingStart(const char *sender_username, const char *filename, long wait_time_seconds);
-void logEventFileTransferCompleted(const char *sender_username, const char *receiver_username, const char *filename);
+void logEventFileTransferCompleted(const char *sender_username, const char *receiver_username, const char *filename,
+                                   size_t bytes_sent, double elapsed_seconds);
 void logEventFileTransferFailed(const char *sender_username, const char *receiver_username, const char *filename, const char *reason);
 void logEventFileCollision(const char *original_name, const char *new_name, const char *recipient_user, const char *sender_user);
 void logEventSigintShutdown(int num_clients_at_shutdown);
 
+// Located in: server/metrics.c
+int initializeServerMetrics(const ServerConfig *config);                // Starts the stats/admin thread if enabled
+void shutdownServerMetrics(void);                                       // Stops that thread and removes the admin socket
+void metricsCountMessageIn(int message_type);                           // A decoded client message
+void metricsCountMessageOut(int message_type);                          // A message queued to one client
+void metricsCountSendFailure(void);                                     // A socket send error that closed a connection
+void metricsCountOutboundDrop(void);                                    // A message refused by a full outbound queue
+void metricsRecordBroadcastFanout(unsigned long long micros, int recipients); // Time to queue one broadcast to a room
+void metricsRecordFileQueueWait(unsigned long long millis);             // Time a file spent in FileUploadQueue
+size_t formatServerMetrics(char *out, size_t out_size);                 // Writes a text snapshot, returns its length
+
 // Located in: server/utils_server.c
-// Finds an active client by username. Expects clients_list_mutex to be HELD by the caller.
-ClientInfo *findClientByUsername(const char *username_to_find);
+// Finds a logged-in client by username and retains it. Release with releaseClient.
+ClientInfo *acquireClientByUsername(const char *username_to_find);
 // Helper functions to send standardized messages to clients
-void sendErrorToClient(int client_socket_fd, const char *error_message);
-void sendSuccessToClient(int client_socket_fd, const char *success_message);
-void sendSuccessWithRoomToClient(int client_socket_fd, const char *message, const char *room_name);
-void sendServerNotificationToClient(int client_socket_fd, const char *notification_message, const char *room_context);
+void sendErrorToClient(ClientInfo *client, const char *error_message);
+void sendSuccessToClient(ClientInfo *client, const char *success_message);
+void sendSuccessWithRoomToClient(ClientInfo *client, const char *message, const char *room_name);
+void sendServerNotificationToClient(ClientInfo *client, const char *notification_message, const char *room_context);
 // Generates a new filename in case of collision (e.g., file.txt -> file_1.txt)
 void generate_collided_filename(const char *original_filename, int collision_num, char *output_buffer, size_t buffer_size);
 
@@ -1,17 +1,20 @@
 #include "common.h"
 
-static int validateFileTransferMeta(ClientInfo *sender_client, const Message *file_req_header, ClientInfo **out_receiver_client)
+// Queued uploads are allocated on the reactor threads and freed by the file workers
+static MemoryPool file_task_pool = MEMORY_POOL_INITIALIZER("file_task", sizeof(FileTransferTask));
+
+static int validateFileTransferMeta(ClientInfo *sender_client, const Message *file_req_header)
 {
     logEventFileTransferInitiated(sender_client->username, file_req_header->receiver, file_req_header->filename);
 
     if (!isValidFileType(file_req_header->filename))
     {
-        sendErrorToClient(sender_client->socket_fd, "Invalid file type. Supported: .txt, .pdf, .jpg, .png");
+        sendErrorToClient(sender_client, "Invalid file type. Supported: .txt, .pdf, .jpg, .png");
         return 0;
     }
     if (file_req_header->file_size == 0)
     {
-        sendErrorToClient(sender_client->socket_fd, "Cannot transfer an empty file.");
+        sendErrorToClient(sender_client, "Cannot transfer an empty file.");
         return 0;
     }
     if (file_req_header->file_size > MAX_FILE_SIZE)
@@ -19,27 +22,143 @@ static int validateFileTransferMeta(ClientInfo *sender_client, const Message *fi
         logEventFileRejectedOversized(sender_client->username, file_req_header->filename, file_req_header->file_size);
         char err_msg[MESSAGE_BUF_SIZE];
         snprintf(err_msg, sizeof(err_msg), "File '%.50s' is too large (max %dMB).", file_req_header->filename, MAX_FILE_SIZE / (1024 * 1024));
-        sendErrorToClient(sender_client->socket_fd, err_msg);
+        sendErrorToClient(sender_client, err_msg);
         return 0;
     }
 
-    pthread_mutex_lock(&g_server_state->clients_list_mutex);
-    *out_receiver_client = findClientByUsername(file_req_header->receiver);
-    pthread_mutex_unlock(&g_server_state->clients_list_mutex);
+    // Only the recipient's presence matters here; the worker looks it up again at delivery time.
+    // A recipient logged in on another node of the cluster gets the file relayed there.
+    ClientInfo *receiver_client = acquireClientByUsername(file_req_header->receiver);
+    int receiver_is_local = (receiver_client != NULL);
+    releaseClient(receiver_client);
 
-    if (!*out_receiver_client || !(*out_receiver_client)->is_active)
+    if (!receiver_is_local && clusterFindUserNode(file_req_header->receiver) < 0)
     {
-        sendErrorToClient(sender_client->socket_fd, "Recipient user not found or is offline.");
+        sendErrorToClient(sender_client, "Recipient user not found or is offline.");
         return 0;
     }
     if (strcmp(sender_client->username, file_req_header->receiver) == 0)
     {
-        sendErrorToClient(sender_client->socket_fd, "You cannot send a file to yourself.");
+        sendErrorToClient(sender_client, "You cannot send a file to yourself.");
         return 0;
     }
     return 1;
 }
 
+// Creates an anonymous spool file for one upload. The name is unlinked right away, so the
+// data lives only as long as a descriptor refers to it. Returns the fd, or -1 on failure.
+int createUploadSpoolFile(void)
+{
+    char spool_path[] = FILE_SPOOL_TEMPLATE;
+    int spool_fd = mkstemp(spool_path);
+    if (spool_fd < 0)
+        return -1;
+    unlink(spool_path);
+    return spool_fd;
+}
+
+// Writes a whole chunk to the spool file. Returns 1 on success, 0 on failure.
+static int writeChunkToSpool(int spool_fd, const char *chunk, size_t chunk_len)
+{
+    size_t total_written = 0;
+    while (total_written < chunk_len)
+    {
+        ssize_t written_now = write(spool_fd, chunk + total_written, chunk_len - total_written);
+        if (written_now < 0 && errno == EINTR)
+            continue;
+        if (written_now <= 0)
+            return 0;
+        total_written += (size_t)written_now;
+    }
+    return 1;
+}
+
+// Clears the sender's upload state without touching the spool descriptor.
+static void resetInboundFileUpload(ClientInfo *sender_client)
+{
+    sender_client->upload_spool_fd = -1;
+    sender_client->upload_file_size = 0;
+    sender_client->upload_bytes_remaining = 0;
+    sender_client->upload_write_failed = 0;
+    sender_client->upload_filename[0] = '\0';
+    sender_client->upload_receiver[0] = '\0';
+}
+
+// Called once the last byte of an upload is on disk: hands the spool file to the queue.
+static void finishInboundFileUpload(ClientInfo *sender_client)
+{
+    int spool_fd = sender_client->upload_spool_fd;
+    if (sender_client->upload_write_failed)
+    {
+        logServerEvent("FILE_ERROR", "Upload '%s' from %s could not be stored; discarding it.",
+                       sender_client->upload_filename, sender_client->username);
+        close(spool_fd);
+        sendErrorToClient(sender_client, "Server could not store the uploaded file.");
+    }
+    else if (addFileToUploadQueue(sender_client->upload_filename, sender_client->username,
+                                  sender_client->upload_receiver, spool_fd, sender_client->upload_file_size))
+    {
+        logServerEvent("INFO", "File '%s' (%zu bytes) from %s to %s received and queued.",
+                       sender_client->upload_filename, sender_client->upload_file_size,
+                       sender_client->username, sender_client->upload_receiver);
+    }
+    else
+    {
+        logServerEvent("ERROR", "Server failed to enqueue file '%s' from %s internally after receiving data.",
+                       sender_client->upload_filename, sender_client->username);
+        close(spool_fd); // Discard data if not enqueued
+    }
+    resetInboundFileUpload(sender_client);
+}
+
+// Moves at most FILE_RELAY_CHUNK_SIZE bytes of an in-progress upload from the sender's socket
+// to its spool file. Called by the owning reactor loop whenever the socket is readable, so an
+// upload never holds more than one chunk in memory and the sender is paced by our reads.
+// Returns 1 if progress was made, 0 if the socket has nothing right now, -1 if the
+// connection failed (the caller unregisters the client, which drops the upload).
+int receiveFileUploadChunk(ClientInfo *sender_client)
+{
+    char chunk[FILE_RELAY_CHUNK_SIZE];
+    size_t chunk_len = sender_client->upload_bytes_remaining;
+    if (chunk_len > sizeof(chunk))
+        chunk_len = sizeof(chunk);
+
+    ssize_t bytes_now = recv(sender_client->socket_fd, chunk, chunk_len, MSG_DONTWAIT);
+    if (bytes_now < 0)
+    {
+        if (errno == EINTR)
+            return 1;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return 0;
+        return -1;
+    }
+    if (bytes_now == 0)
+        return -1;
+
+    if (!sender_client->upload_write_failed &&
+        !writeChunkToSpool(sender_client->upload_spool_fd, chunk, (size_t)bytes_now))
+    {
+        logServerEvent("FILE_ERROR", "Writing upload '%s' from %s to spool failed: %s",
+                       sender_client->upload_filename, sender_client->username, strerror(errno));
+        sender_client->upload_write_failed = 1; // Keep draining so the stream stays in sync
+    }
+    sender_client->upload_bytes_remaining -= (size_t)bytes_now;
+    if (sender_client->upload_bytes_remaining == 0)
+        finishInboundFileUpload(sender_client);
+    return 1;
+}
+
+// Drops an unfinished upload, e.g. when the sender disconnects mid-transfer.
+void abortInboundFileUpload(ClientInfo *sender_client)
+{
+    if (!sender_client || sender_client->upload_spool_fd < 0)
+        return;
+    logServerEvent("FILE_ERROR", "Upload of '%s' from %s aborted after %zu of %zu bytes: connection closed",
+                   sender_client->upload_filename, sender_client->username,
+                   sender_client->upload_file_size - sender_client->upload_bytes_remaining, sender_client->upload_file_size);
+    close(sender_client->upload_spool_fd);
+    resetInboundFileUpload(sender_client);
+}
 
 void initializeFileTransferSystem()
 {
@@ -49,18 +168,22 @@ void initializeFileTransferSystem()
     memset(ftm, 0, sizeof(FileUploadQueue));
 
     if (pthread_mutex_init(&ftm->queue_access_mutex, NULL) != 0 ||
-        pthread_cond_init(&ftm->queue_not_empty_cond, NULL) != 0)
+        pthread_cond_init(&ftm->queue_not_empty_cond, NULL) != 0 ||
+        pthread_cond_init(&ftm->shutdown_cond, NULL) != 0)
     {
         logServerEvent("CRITICAL", "Failed to initialize mutex/condvar for file transfer queue.");
         exit(EXIT_FAILURE); // Critical failure
     }
-    if (sem_init(&ftm->available_upload_slots_sem, 0, MAX_UPLOAD_QUEUE_SIZE) != 0)
+
+    // The worker count is the concurrency limit: each worker handles one transfer at a time.
+    int worker_count = g_server_state->config.file_worker_count;
+    g_server_state->file_worker_thread_ids = calloc((size_t)worker_count, sizeof(pthread_t));
+    if (!g_server_state->file_worker_thread_ids)
     {
-        logServerEvent("CRITICAL", "Failed to initialize file upload semaphore: %s", strerror(errno));
-        exit(EXIT_FAILURE); // Critical failure
+        logServerEvent("CRITICAL", "Memory allocation failed for %d file worker thread IDs.", worker_count);
+        exit(EXIT_FAILURE);
     }
-
-    for (int i = 0; i < MAX_UPLOAD_QUEUE_SIZE; ++i)
+    for (int i = 0; i < worker_count; ++i)
     {
         if (pthread_create(&g_server_state->file_worker_thread_ids[i], NULL, fileProcessingWorkerThread, NULL) != 0)
         {
@@ -72,7 +195,9 @@ void initializeFileTransferSystem()
         // PDF implies detach is okay, but joining on shutdown is cleaner for resource management.
         // Will join in cleanupFileTransferSystem.
     }
-    logServerEvent("INFO", "File transfer system initialized with %d worker thread(s).", MAX_UPLOAD_QUEUE_SIZE);
+    logServerEvent("INFO", "File transfer system initialized with %d worker thread(s), %d ms processing delay, %s scheduling.",
+                   worker_count, g_server_state->config.file_processing_delay_ms,
+                   g_server_state->config.file_scheduling_policy == FILE_SCHEDULE_FIFO ? "FIFO" : "smallest-first");
 }
 
 void cleanupFileTransferSystem()
@@ -83,16 +208,13 @@ void cleanupFileTransferSystem()
     logServerEvent("INFO", "Cleaning up file transfer system...");
 
     // server_is_running will be set to 0 by sigintShutdownHandler or main exit path
-    // Signal worker threads to wake up and check server_is_running
+    // Wake idle workers and cut any processing delay short so they see server_is_running
     pthread_mutex_lock(&ftm->queue_access_mutex);
     pthread_cond_broadcast(&ftm->queue_not_empty_cond);
+    pthread_cond_broadcast(&ftm->shutdown_cond);
     pthread_mutex_unlock(&ftm->queue_access_mutex);
-    for (int i = 0; i < MAX_UPLOAD_QUEUE_SIZE; ++i)
-    { // Unblock any sem_timedwait
-        sem_post(&ftm->available_upload_slots_sem);
-    }
 
-    for (int i = 0; i < MAX_UPLOAD_QUEUE_SIZE; ++i)
+    for (int i = 0; g_server_state->file_worker_thread_ids && i < g_server_state->config.file_worker_count; ++i)
     {
         if (g_server_state->file_worker_thread_ids[i] != 0)
         { // Check if thread was created
@@ -111,9 +233,9 @@ void cleanupFileTransferSystem()
         FileTransferTask *next_task = current_task->next_task;
         logServerEvent("INFO", "Discarding queued file '%s' for %s due to shutdown.",
                        current_task->filename, current_task->receiver_username);
-        if (current_task->file_data_buffer)
-            free(current_task->file_data_buffer);
-        free(current_task);
+        if (current_task->spool_fd >= 0)
+            close(current_task->spool_fd);
+        poolRelease(&file_task_pool, current_task);
         current_task = next_task;
     }
     ftm->head = ftm->tail = NULL;
@@ -122,14 +244,15 @@ void cleanupFileTransferSystem()
 
     pthread_mutex_destroy(&ftm->queue_access_mutex);
     pthread_cond_destroy(&ftm->queue_not_empty_cond);
-    sem_destroy(&ftm->available_upload_slots_sem);
+    pthread_cond_destroy(&ftm->shutdown_cond);
+    free(g_server_state->file_worker_thread_ids);
+    g_server_state->file_worker_thread_ids = NULL;
     logServerEvent("INFO", "File transfer system resources released.");
 }
 
 void handleFileTransferRequest(ClientInfo *sender_client, const Message *file_req_header)
 {
-    ClientInfo *receiver_client = NULL;
-    if (!validateFileTransferMeta(sender_client, file_req_header, &receiver_client))
+    if (!validateFileTransferMeta(sender_client, file_req_header))
     {
         return; // Validation failed, error sent to client
     }
@@ -143,7 +266,17 @@ void handleFileTransferRequest(ClientInfo *sender_client, const Message *file_re
     const int MAX_TOTAL_QUEUED_FILES = 50; // Example absolute limit for the backlog
     if (queue_length >= MAX_TOTAL_QUEUED_FILES)
     {
-        sendErrorToClient(sender_client->socket_fd, "Server file backlog is full. Try again later.");
+        sendErrorToClient(sender_client, "Server file backlog is full. Try again later.");
+        return;
+    }
+
+    // The data is spooled to disk as it arrives instead of being buffered whole in memory.
+    int spool_fd = createUploadSpoolFile();
+    if (spool_fd < 0)
+    {
+        logServerEvent("FILE_ERROR", "Could not create spool file for '%s' from %s: %s",
+                       file_req_header->filename, sender_client->username, strerror(errno));
+        sendErrorToClient(sender_client, "Server could not prepare storage for the file. Try again later.");
         return;
     }
 
@@ -155,60 +288,45 @@ void handleFileTransferRequest(ClientInfo *sender_client, const Message *file_re
     strncpy(accept_msg.content, "File transfer accepted by server. Preparing to receive data...", MESSAGE_BUF_SIZE - 1);
     strncpy(accept_msg.filename, file_req_header->filename, FILENAME_BUF_SIZE - 1); // Echo filename
 
-    if (!sendMessage(sender_client->socket_fd, &accept_msg))
+    if (!queueMessageToClient(sender_client, &accept_msg))
     {
         logServerEvent("ERROR", "Failed to send file transfer accept message to %s", sender_client->username);
+        close(spool_fd);
         return;
     }
 
-    // Now receive the actual file data
-    char *actual_file_data = receiveFileDataFromServer(sender_client->socket_fd, file_req_header->file_size,
-                                                       file_req_header->filename, sender_client->username);
-    if (!actual_file_data)
-    {
-        // Error logged by helper. Client already got ACCEPT, but data transfer failed.
-        // Server won't queue. Client might eventually timeout or error.
-        return;
-    }
-
-    if (addFileToUploadQueue(file_req_header->filename, sender_client->username,
-                             file_req_header->receiver, actual_file_data, file_req_header->file_size))
-    {
-        logServerEvent("INFO", "File '%s' (%zu bytes) from %s to %s received and queued.",
-                       file_req_header->filename, file_req_header->file_size, sender_client->username, file_req_header->receiver);
-        // The accept_msg content could be updated here to give more specific feedback if needed,
-        // but for now, client gets one "accepted" message.
-        // Example: Server could send another MSG_SUCCESS with "File added to upload queue."
-        // For now, the initial accept is sufficient as per client's expectation.
-    }
-    else
-    {
-        logServerEvent("ERROR", "Server failed to enqueue file '%s' from %s internally after receiving data.",
-                       file_req_header->filename, sender_client->username);
-        free(actual_file_data); // Free data if not enqueued
-        // Client thinks transfer is proceeding, server had an internal issue.
-        // Could send an MSG_ERROR to client if possible, but tricky at this stage.
-    }
+    // From here on the reactor feeds the raw bytes that follow to receiveFileUploadChunk.
+    sender_client->upload_spool_fd = spool_fd;
+    sender_client->upload_file_size = file_req_header->file_size;
+    sender_client->upload_bytes_remaining = file_req_header->file_size;
+    sender_client->upload_write_failed = 0;
+    strncpy(sender_client->upload_filename, file_req_header->filename, FILENAME_BUF_SIZE - 1);
+    sender_client->upload_filename[FILENAME_BUF_SIZE - 1] = '\0';
+    strncpy(sender_client->upload_receiver, file_req_header->receiver, USERNAME_BUF_SIZE - 1);
+    sender_client->upload_receiver[USERNAME_BUF_SIZE - 1] = '\0';
 }
 
-int addFileToUploadQueue(const char *filename, const char *sender_user, const char *receiver_user, char *actual_file_data, size_t file_size_val)
+static int enqueueFileTransferTask(const char *filename, const char *sender_user, const char *receiver_user,
+                                   int spool_fd, size_t file_size_val, int is_relayed)
 {
     if (!g_server_state)
         return 0;
 
-    FileTransferTask *new_task = malloc(sizeof(FileTransferTask));
+    FileTransferTask *new_task = poolAllocate(&file_task_pool);
     if (!new_task)
     {
         logServerEvent("ERROR", "Memory allocation failed for FileTransferTask.");
-        return 0; // Caller must free actual_file_data
+        return 0; // Caller must close spool_fd
     }
 
     strncpy(new_task->filename, filename, FILENAME_BUF_SIZE - 1);
     strncpy(new_task->sender_username, sender_user, USERNAME_BUF_SIZE - 1);
     strncpy(new_task->receiver_username, receiver_user, USERNAME_BUF_SIZE - 1);
     new_task->file_size = file_size_val;
-    new_task->file_data_buffer = actual_file_data; // Ownership transferred
+    new_task->spool_fd = spool_fd; // Ownership transferred
+    new_task->is_relayed = is_relayed;
     new_task->enqueue_timestamp = time(NULL);
+    clock_gettime(CLOCK_MONOTONIC, &new_task->enqueue_monotonic);
     new_task->next_task = NULL;
 
     FileUploadQueue *ftm = &g_server_state->file_transfer_manager;
@@ -223,15 +341,64 @@ int addFileToUploadQueue(const char *filename, const char *sender_user, const ch
         ftm->tail = new_task;
     }
     ftm->current_queue_length++;
-    int q_len = ftm->current_queue_length;
+    // Logged before a worker can pick the task up, so the log shows queueing before processing.
+    // Logging only fills the log ring, so doing it under the lock is cheap.
+    logEventFileQueued(sender_user, filename, ftm->current_queue_length);
 
     pthread_cond_signal(&ftm->queue_not_empty_cond);
     pthread_mutex_unlock(&ftm->queue_access_mutex);
-
-    logEventFileQueued(sender_user, filename, q_len);
     return 1;
 }
 
+int addFileToUploadQueue(const char *filename, const char *sender_user, const char *receiver_user, int spool_fd, size_t file_size_val)
+{
+    return enqueueFileTransferTask(filename, sender_user, receiver_user, spool_fd, file_size_val, 0);
+}
+
+// Queues a file another node of the cluster received and processed, for delivery to a local
+// recipient. It skips the processing delay, which the sender's node already went through.
+int addRelayedFileToUploadQueue(const char *filename, const char *sender_user, const char *receiver_user, int spool_fd, size_t file_size_val)
+{
+    return enqueueFileTransferTask(filename, sender_user, receiver_user, spool_fd, file_size_val, 1);
+}
+
+// Unlinks and returns the task a worker should run next. queue_access_mutex must be HELD
+// and the queue must not be empty.
+// Smallest-first ranks tasks by file size minus FILE_SCHEDULER_AGING_BYTES_PER_SECOND for every
+// second already spent waiting, so small files overtake large ones without starving them.
+static FileTransferTask *takeNextScheduledTask(FileUploadQueue *ftm)
+{
+    FileTransferTask *chosen_prev = NULL;
+    FileTransferTask *chosen = ftm->head;
+    if (g_server_state->config.file_scheduling_policy == FILE_SCHEDULE_SMALLEST_FIRST)
+    {
+        time_t now = time(NULL);
+        double best_rank = 0.0;
+        FileTransferTask *prev = NULL;
+        for (FileTransferTask *task = ftm->head; task != NULL; prev = task, task = task->next_task)
+        {
+            double waited_seconds = difftime(now, task->enqueue_timestamp);
+            double rank = (double)task->file_size - waited_seconds * FILE_SCHEDULER_AGING_BYTES_PER_SECOND;
+            if (task == ftm->head || rank < best_rank) // Ties keep arrival order
+            {
+                best_rank = rank;
+                chosen = task;
+                chosen_prev = prev;
+            }
+        }
+    }
+
+    if (chosen_prev)
+        chosen_prev->next_task = chosen->next_task;
+    else
+        ftm->head = chosen->next_task;
+    if (ftm->tail == chosen)
+        ftm->tail = chosen_prev;
+    chosen->next_task = NULL;
+    ftm->current_queue_length--;
+    return chosen;
+}
+
 void *fileProcessingWorkerThread(void *arg)
 {
     (void)arg;
@@ -245,106 +412,95 @@ void *fileProcessingWorkerThread(void *arg)
     }
     FileUploadQueue *ftm = &g_server_state->file_transfer_manager;
 
+    pthread_mutex_lock(&ftm->queue_access_mutex);
     while (g_server_state->server_is_running)
     {
-        struct timespec timeout_sem;
-        if (clock_gettime(CLOCK_REALTIME, &timeout_sem) == -1)
-        {
-            logServerEvent("ERROR", "Worker %lu: clock_gettime failed for sem wait. Retrying.", tid);
-            sleep(1);
+        if (ftm->head == NULL)
+        { // Idle until addFileToUploadQueue signals or shutdown broadcasts
+            pthread_cond_wait(&ftm->queue_not_empty_cond, &ftm->queue_access_mutex);
             continue;
         }
-        timeout_sem.tv_sec += 1; // 1 second timeout
-
-        int sem_ret = sem_timedwait(&ftm->available_upload_slots_sem, &timeout_sem);
-        if (!g_server_state->server_is_running)
-            break;
-
-        if (sem_ret == -1)
-        {
-            if (errno == EINTR || errno == ETIMEDOUT)
-                continue;
-            logServerEvent("ERROR", "Worker %lu: sem_timedwait error: %s. Stopping.", tid, strerror(errno));
-            break;
-        }
-        // Acquired a processing slot
-
-        FileTransferTask *task_to_process = NULL;
-        pthread_mutex_lock(&ftm->queue_access_mutex);
-        while (ftm->head == NULL && g_server_state->server_is_running)
-        {
-            // Use timedwait on condvar to periodically check server_is_running
-            struct timespec timeout_cond;
-            if (clock_gettime(CLOCK_REALTIME, &timeout_cond) == -1)
-            {
-                logServerEvent("ERROR", "Worker %lu: clock_gettime failed for cond wait. Using untimed.", tid);
-                pthread_cond_wait(&ftm->queue_not_empty_cond, &ftm->queue_access_mutex); // Fallback
-                break;                                                                   // Break inner while to re-check conditions
-            }
-            timeout_cond.tv_sec += 1; // 1 second timeout
-            pthread_cond_timedwait(&ftm->queue_not_empty_cond, &ftm->queue_access_mutex, &timeout_cond);
-        }
-
-        if (!g_server_state->server_is_running)
-        { // Re-check after wake-up or timeout
-            pthread_mutex_unlock(&ftm->queue_access_mutex);
-            sem_post(&ftm->available_upload_slots_sem); // Release slot if shutting down
-            break;
-        }
-
-        if (ftm->head != NULL)
-        {
-            task_to_process = ftm->head;
-            ftm->head = ftm->head->next_task;
-            if (ftm->head == NULL)
-                ftm->tail = NULL;
-            ftm->current_queue_length--;
-        }
+        FileTransferTask *task_to_process = takeNextScheduledTask(ftm);
         pthread_mutex_unlock(&ftm->queue_access_mutex);
 
-        if (task_to_process)
-        {
-            long wait_duration = (long)difftime(time(NULL), task_to_process->enqueue_timestamp);
-            logEventFileTransferProcessingStart(task_to_process->sender_username, task_to_process->filename, wait_duration);
-            executeFileTransferToRecipient(task_to_process);
-
-            if (task_to_process->file_data_buffer)
-                free(task_to_process->file_data_buffer);
-            free(task_to_process);
-            sem_post(&ftm->available_upload_slots_sem); // Release processing slot
-        }
-        else
-        {
-            // No task (spurious wakeup, or server shutdown and queue empty)
-            sem_post(&ftm->available_upload_slots_sem); // Release slot
-        }
+        long wait_duration = (long)difftime(time(NULL), task_to_process->enqueue_timestamp);
+        logEventFileTransferProcessingStart(task_to_process->sender_username, task_to_process->filename, wait_duration);
+        struct timespec started;
+        clock_gettime(CLOCK_MONOTONIC, &started);
+        long long waited_ms = (long long)(started.tv_sec - task_to_process->enqueue_monotonic.tv_sec) * 1000LL +
+                              (started.tv_nsec - task_to_process->enqueue_monotonic.tv_nsec) / 1000000;
+        metricsRecordFileQueueWait((unsigned long long)(waited_ms > 0 ? waited_ms : 0));
+        executeFileTransferToRecipient(task_to_process);
+
+        if (task_to_process->spool_fd >= 0)
+            close(task_to_process->spool_fd);
+        poolRelease(&file_task_pool, task_to_process);
+        pthread_mutex_lock(&ftm->queue_access_mutex);
     }
+    pthread_mutex_unlock(&ftm->queue_access_mutex);
     logServerEvent("INFO", "File worker thread (ID %lu) stopping.", tid);
     return NULL;
 }
 
+// Waits out the configured processing delay. Returns early (with 0) if the server shuts down.
+static int waitFileProcessingDelay(const FileTransferTask *task)
+{
+    int delay_ms = g_server_state->config.file_processing_delay_ms;
+    if (delay_ms <= 0)
+        return 1;
+
+    logServerEvent("DEBUG_DELAY", "Worker for '%s' (sender %s) starting %d ms artificial processing delay.",
+                   task->filename, task->sender_username, delay_ms);
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += delay_ms / 1000;
+    deadline.tv_nsec += (long)(delay_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    FileUploadQueue *ftm = &g_server_state->file_transfer_manager;
+    pthread_mutex_lock(&ftm->queue_access_mutex);
+    int wait_result = 0;
+    while (g_server_state->server_is_running && wait_result != ETIMEDOUT) // Spurious wakeups keep waiting
+        wait_result = pthread_cond_timedwait(&ftm->shutdown_cond, &ftm->queue_access_mutex, &deadline);
+    int still_running = g_server_state->server_is_running;
+    pthread_mutex_unlock(&ftm->queue_access_mutex);
+    if (still_running)
+        logServerEvent("DEBUG_DELAY", "Worker for '%s' (sender %s) finished artificial delay.",
+                       task->filename, task->sender_username);
+    return still_running;
+}
+
 void executeFileTransferToRecipient(FileTransferTask *task)
 {
     if (!task || !g_server_state)
         return;
 
-    int DUMMY_PROCESSING_SECONDS = 5; // Process each file for 5 seconds
-    logServerEvent("DEBUG_DELAY", "Worker for '%s' (sender %s) starting %d-second artificial processing delay.",
-                   task->filename, task->sender_username, DUMMY_PROCESSING_SECONDS);
-    sleep(DUMMY_PROCESSING_SECONDS);
-    logServerEvent("DEBUG_DELAY", "Worker for '%s' (sender %s) finished artificial delay.",
-                   task->filename, task->sender_username);
+    if (!task->is_relayed && !waitFileProcessingDelay(task))
+    {
+        logEventFileTransferFailed(task->sender_username, task->receiver_username, task->filename, "Server shutting down.");
+        return;
+    }
+
+    ClientInfo *recipient = acquireClientByUsername(task->receiver_username); // Kept alive while its queue delivers the file
 
-    int recipient_socket_fd = -1;
-    pthread_mutex_lock(&g_server_state->clients_list_mutex);
-    ClientInfo *recipient = findClientByUsername(task->receiver_username);
-    if (recipient && recipient->is_active)
+    // Not here: hand the file to the node the recipient is logged in on (not for relayed files,
+    // so a user hopping between nodes cannot bounce one back and forth)
+    int recipient_node = (!recipient && !task->is_relayed) ? clusterFindUserNode(task->receiver_username) : -1;
+    if (recipient_node >= 0)
     {
-        recipient_socket_fd = recipient->socket_fd; // Copy fd while holding lock
+        if (clusterRelayFile(task, recipient_node))
+            logServerEvent("FILE", "File '%s' from %s relayed to node %d for %s.",
+                           task->filename, task->sender_username, recipient_node, task->receiver_username);
+        else
+            logEventFileTransferFailed(task->sender_username, task->receiver_username, task->filename, "The recipient's server node is unreachable.");
+        return;
     }
-    pthread_mutex_unlock(&g_server_state->clients_list_mutex);
 
-    if (recipient_socket_fd == -1)
+    if (!recipient)
     {
         logEventFileTransferFailed(task->sender_username, task->receiver_username, task->filename, "Recipient offline or not found during transfer execution.");
         return;
@@ -358,37 +514,39 @@ void executeFileTransferToRecipient(FileTransferTask *task)
     strncpy(file_data_header.filename, task->filename, FILENAME_BUF_SIZE - 1);
     file_data_header.file_size = task->file_size;
 
-    if (!sendMessage(recipient_socket_fd, &file_data_header))
+    // Header and contents are queued back to back so no chat message can land between them.
+    // The queue sends the spool file with sendfile() and owns it from now on.
+    OutboundBuffer *transfer_parts[2];
+    transfer_parts[0] = encodeOutboundMessage(&file_data_header, recipient->wire_protocol);
+    transfer_parts[1] = createSpooledOutboundBuffer(task->spool_fd, task->file_size);
+    if (transfer_parts[1])
+        task->spool_fd = -1;
+
+    struct timespec delivery_start, delivery_end;
+    clock_gettime(CLOCK_MONOTONIC, &delivery_start);
+    int delivery_state = OUTBOUND_DISCARDED;
+    if (transfer_parts[0] && transfer_parts[1] && enqueueOutboundBuffers(recipient, transfer_parts, 2, 1))
+        delivery_state = waitForOutboundDelivery(recipient, transfer_parts[1], OUTBOUND_BULK_WAIT_SECONDS);
+    clock_gettime(CLOCK_MONOTONIC, &delivery_end);
+
+    if (delivery_state == OUTBOUND_DELIVERED)
     {
-        logEventFileTransferFailed(task->sender_username, task->receiver_username, task->filename, "Failed to send file header to recipient.");
-        return;
+        double elapsed_seconds = (double)(delivery_end.tv_sec - delivery_start.tv_sec) +
+                                 (double)(delivery_end.tv_nsec - delivery_start.tv_nsec) / 1e9;
+        logEventFileTransferCompleted(task->sender_username, task->receiver_username, task->filename,
+                                      task->file_size, elapsed_seconds);
     }
-
-    size_t total_bytes_sent = 0;
-    char *current_data_ptr = task->file_data_buffer;
-    while (total_bytes_sent < task->file_size)
-    {
-        // Adjust chunk size if needed, though for memory-to-socket, large sends are often fine.
-        // For very large files, smaller chunks might be better for network buffers.
-        // ssize_t bytes_to_send_this_chunk = (task->file_size - total_bytes_sent > 4096) ? 4096 : (task->file_size - total_bytes_sent);
-        ssize_t bytes_to_send_this_chunk = task->file_size - total_bytes_sent;
-
-        ssize_t bytes_sent_now = send(recipient_socket_fd, current_data_ptr, bytes_to_send_this_chunk, 0);
-        if (bytes_sent_now <= 0)
-        {
-            logEventFileTransferFailed(task->sender_username, task->receiver_username, task->filename, "Socket error while sending file data to recipient.");
-            return;
-        }
-        total_bytes_sent += bytes_sent_now;
-        current_data_ptr += bytes_sent_now;
-    }
-
-    if (total_bytes_sent == task->file_size)
+    else if (delivery_state == OUTBOUND_PENDING)
     {
-        logEventFileTransferCompleted(task->sender_username, task->receiver_username, task->filename);
+        // Still draining to a slow recipient; the queue keeps the data until it is sent or the client leaves.
+        logServerEvent("FILE", "Delivery of '%s' from %s to %s is still in progress after %d seconds.",
+                       task->filename, task->sender_username, task->receiver_username, OUTBOUND_BULK_WAIT_SECONDS);
     }
     else
     {
-        logEventFileTransferFailed(task->sender_username, task->receiver_username, task->filename, "Incomplete data sent to recipient.");
+        logEventFileTransferFailed(task->sender_username, task->receiver_username, task->filename, "Recipient connection closed before the file was delivered.");
     }
+    releaseOutboundBuffer(transfer_parts[0]);
+    releaseOutboundBuffer(transfer_parts[1]);
+    releaseClient(recipient);
 }
\ No newline at end of file
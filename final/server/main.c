@@ -21,32 +21,43 @@ void sigintShutdownHandler(int signal_number)
             g_server_state->server_listen_socket_fd = -1; // Mark as closed
         }
 
-        // Wake up file worker threads so they can check server_is_running and exit.
-        // This is also done in cleanupServerResources, but doing it early helps.
-        if (g_server_state)
-        {
-            FileUploadQueue *ftm = &g_server_state->file_transfer_manager;
-            if (ftm)
-            { // Check if ftm itself is initialized
-                // Check if mutex is valid (e.g. by trying to lock, or assume it is if initialized)
-                // This is simplified; a robust check would involve checking an init flag for ftm.
-                pthread_mutex_lock(&ftm->queue_access_mutex); // Lock to safely broadcast
-                pthread_cond_broadcast(&ftm->queue_not_empty_cond);
-                pthread_mutex_unlock(&ftm->queue_access_mutex);
-                for (int i = 0; i < MAX_UPLOAD_QUEUE_SIZE; ++i)
-                { // Unblock any sem_wait/timedwait
-                    sem_post(&ftm->available_upload_slots_sem);
-                }
-            }
-        }
+        // File workers sleep on condition variables without timeouts. They are woken by
+        // cleanupFileTransferSystem from the main thread; locking their mutex here is not
+        // async-signal-safe (a reactor thread may hold it when the signal arrives).
         // The main loop (acceptClientConnectionsLoop) will detect server_is_running = 0 and exit,
         // then cleanupServerResources will be called.
     }
     // If called again, default SIGINT action (terminate) will likely occur.
 }
 
+// Raises RLIMIT_NOFILE to its hard limit (best effort) and derives how many
+// client connections the server can hold, keeping some descriptors in reserve.
+static int determineClientCapacity(void)
+{
+    struct rlimit fd_limit;
+    if (getrlimit(RLIMIT_NOFILE, &fd_limit) != 0)
+        return MAX_SERVER_CLIENTS;
+
+    rlim_t wanted = (rlim_t)MAX_SERVER_CONNECTIONS + SERVER_RESERVED_FDS;
+    if (fd_limit.rlim_max != RLIM_INFINITY && fd_limit.rlim_max < wanted)
+        wanted = fd_limit.rlim_max;
+    if (fd_limit.rlim_cur != RLIM_INFINITY && fd_limit.rlim_cur < wanted)
+    {
+        fd_limit.rlim_cur = wanted;
+        if (setrlimit(RLIMIT_NOFILE, &fd_limit) != 0)
+            getrlimit(RLIMIT_NOFILE, &fd_limit); // Keep whatever limit is in effect
+    }
+
+    long capacity = (fd_limit.rlim_cur == RLIM_INFINITY) ? MAX_SERVER_CONNECTIONS : (long)fd_limit.rlim_cur - SERVER_RESERVED_FDS;
+    if (capacity > MAX_SERVER_CONNECTIONS)
+        capacity = MAX_SERVER_CONNECTIONS;
+    if (capacity < MAX_SERVER_CLIENTS)
+        capacity = MAX_SERVER_CLIENTS;
+    return (int)capacity;
+}
+
 // Initializes the global server state structure and its subsystems.
-void initializeServerState()
+void initializeServerState(const ServerConfig *config)
 {
     g_server_state = malloc(sizeof(ServerMainState));
     if (!g_server_state)
@@ -61,12 +72,35 @@ void initializeServerState()
     g_server_state->active_client_count = 0;
     g_server_state->current_room_count = 0;
     g_server_state->server_listen_socket_fd = -1; // Initialize listening socket as invalid
+    g_server_state->config = *config;             // Subsystems below read their settings from here
+
+    // Connection capacity is bounded by file descriptors, not threads.
+    // Raise the soft fd limit as far as allowed and size the client table from it.
+    g_server_state->max_clients = determineClientCapacity();
+    g_server_state->connected_clients = calloc((size_t)g_server_state->max_clients, sizeof(ClientInfo *));
+    g_server_state->free_client_slots = malloc((size_t)g_server_state->max_clients * sizeof(int));
+    if (!g_server_state->connected_clients || !g_server_state->free_client_slots ||
+        !initializeNameIndex(&g_server_state->client_name_index, (size_t)g_server_state->max_clients))
+    {
+        fprintf(stderr, "CRITICAL: Failed to allocate client table for %d clients. Exiting.\n", g_server_state->max_clients);
+        free(g_server_state->connected_clients);
+        free(g_server_state->free_client_slots);
+        free(g_server_state);
+        g_server_state = NULL;
+        exit(EXIT_FAILURE);
+    }
+    // Lowest slot on top, so connections fill the table from the front
+    for (int i = 0; i < g_server_state->max_clients; ++i)
+        g_server_state->free_client_slots[i] = g_server_state->max_clients - 1 - i;
+    g_server_state->free_client_slot_count = g_server_state->max_clients;
 
     // Initialize main server-wide mutexes
     if (pthread_mutex_init(&g_server_state->clients_list_mutex, NULL) != 0 ||
         pthread_mutex_init(&g_server_state->rooms_list_mutex, NULL) != 0)
     {
         fprintf(stderr, "CRITICAL: Failed to initialize main server mutexes: %s. Exiting.\n", strerror(errno));
+        free(g_server_state->connected_clients);
+        free(g_server_state->free_client_slots);
         free(g_server_state); // Clean up allocated memory
         g_server_state = NULL;
         exit(EXIT_FAILURE);
@@ -76,6 +110,21 @@ void initializeServerState()
     // These will log their own success/failure.
     initializeRoomSystem();         // Sets up room structures and their mutexes
     initializeFileTransferSystem(); // Sets up file queue, its sync primitives, and starts worker threads
+    if (!initializeIoReactor())     // Creates epoll loops and the fixed pool of I/O threads
+    {
+        fprintf(stderr, "CRITICAL: Failed to initialize the I/O reactor. Exiting.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!initializeCluster(config)) // Links to the other nodes, if --cluster was given
+    {
+        fprintf(stderr, "CRITICAL: Failed to initialize the cluster links. Exiting.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (!initializeServerMetrics(config)) // Stats dump / admin socket, if enabled
+    {
+        fprintf(stderr, "CRITICAL: Failed to initialize server metrics. Exiting.\n");
+        exit(EXIT_FAILURE);
+    }
 
     logServerEvent("INFO", "Server state and all subsystems initialized successfully.");
 }
@@ -120,8 +169,8 @@ int setupServerListeningSocket(int port)
     }
 
     // Start listening for incoming connections
-    // MAX_SERVER_CLIENTS is used as backlog here, common practice.
-    if (listen(g_server_state->server_listen_socket_fd, MAX_SERVER_CLIENTS) < 0)
+    // Use the system maximum backlog so bursts of logins are queued instead of refused.
+    if (listen(g_server_state->server_listen_socket_fd, SOMAXCONN) < 0)
     {
         logServerEvent("CRITICAL", "Socket listen failed: %s", strerror(errno));
         close(g_server_state->server_listen_socket_fd);
@@ -133,7 +182,7 @@ int setupServerListeningSocket(int port)
 }
 
 // Main loop for accepting new client connections.
-// Creates a new thread for each accepted client.
+// Hands each accepted client to one of the reactor I/O loops.
 void acceptClientConnectionsLoop()
 {
     if (!g_server_state || g_server_state->server_listen_socket_fd < 0)
@@ -144,7 +193,6 @@ void acceptClientConnectionsLoop()
 
     struct sockaddr_in client_address_info;
     socklen_t client_addr_len = sizeof(client_address_info);
-    pthread_t client_thread_id_temp; // Temporary variable for thread creation
 
     logServerEvent("INFO", "Server is now accepting client connections on fd %d.", g_server_state->server_listen_socket_fd);
     while (g_server_state->server_is_running)
@@ -174,6 +222,7 @@ void acceptClientConnectionsLoop()
             continue; // Timeout, no incoming connection, loop to check server_is_running
 
         // If select indicates activity on the listening socket, proceed to accept
+        client_addr_len = sizeof(client_address_info);
         int new_client_socket_fd = accept(g_server_state->server_listen_socket_fd,
                                           (struct sockaddr *)&client_address_info, &client_addr_len);
 
@@ -194,19 +243,13 @@ void acceptClientConnectionsLoop()
         ClientInfo *new_client_data = registerNewClientOnServer(new_client_socket_fd, client_address_info);
         if (new_client_data)
         {
-            // Create a new thread to handle this client's connection
-            if (pthread_create(&client_thread_id_temp, NULL, clientConnectionThreadHandler, new_client_data) != 0)
+            // The reactor loop now owns the socket; the first message it reads must be the login.
+            if (!reactorAddClient(new_client_data))
             {
-                logServerEvent("ERROR", "Failed to create thread for new client %s (fd %d): %s",
-                               inet_ntoa(client_address_info.sin_addr), new_client_socket_fd, strerror(errno));
-                // If thread creation fails, unregister the client and close their socket.
+                logServerEvent("ERROR", "Failed to hand new client %s (fd %d) to an I/O loop.",
+                               inet_ntoa(client_address_info.sin_addr), new_client_socket_fd);
                 unregisterClient(new_client_data, 1); // is_unexpected = true
             }
-            else
-            {
-                new_client_data->thread_id = client_thread_id_temp; // Store thread ID (mainly for reference)
-                // Client handler thread will detach itself (pthread_detach(pthread_self())).
-            }
         }
         // If new_client_data is NULL, registerNewClientOnServer failed (e.g., max clients),
         // it already logged the issue, sent error to client, and closed the socket.
@@ -215,7 +258,7 @@ void acceptClientConnectionsLoop()
 }
 
 // Cleans up all server resources during shutdown.
-// Notifies clients, joins worker threads, destroys mutexes/semaphores, frees memory.
+// Notifies clients, joins worker threads, destroys mutexes, frees memory.
 void cleanupServerResources()
 {
     if (!g_server_state)
@@ -235,74 +278,48 @@ void cleanupServerResources()
         g_server_state->server_listen_socket_fd = -1;
     }
 
-    // 3. Clean up file transfer system (signals and joins worker threads, clears queue, destroys sync objects)
+    // 3. Stop the metrics thread (it reads the file queue), close the cluster links (their readers
+    //    queue relayed files), then clean up file transfer system
+    //    (signals and joins worker threads, clears queue, destroys sync objects)
+    shutdownServerMetrics();
+    shutdownCluster();
     cleanupFileTransferSystem();
 
-    // 4. Notify and attempt to gracefully close active client connections.
-    // Client handler threads are detached, so we can't join them here.
-    // We trigger their shutdown by closing their sockets. They should then call unregisterClient.
+    // 4. Notify active clients, stop the I/O threads, then release every remaining connection.
+    // Once the reactor threads are joined nothing else touches the client structures.
     logServerEvent("INFO", "Server Shutdown: Notifying and closing active client sockets...");
-    ClientInfo *clients_to_notify[MAX_SERVER_CLIENTS] = {NULL};
-    int num_to_notify = 0;
-
     pthread_mutex_lock(&g_server_state->clients_list_mutex);
-    for (int i = 0; i < MAX_SERVER_CLIENTS; ++i)
+    for (int i = 0; i < g_server_state->max_clients; ++i)
     {
-        if (g_server_state->connected_clients[i] != NULL && g_server_state->connected_clients[i]->is_active)
+        ClientInfo *client = g_server_state->connected_clients[i];
+        if (client != NULL && client->is_active && client->socket_fd >= 0)
         {
-            // Store a reference; do not operate directly on shared list while iterating without holding lock for long
-            clients_to_notify[num_to_notify++] = g_server_state->connected_clients[i];
+            notifyClientOfShutdown(client); // Best effort send
         }
     }
     pthread_mutex_unlock(&g_server_state->clients_list_mutex);
 
-    for (int i = 0; i < num_to_notify; ++i)
+    shutdownIoReactor();
+
+    for (int i = 0; i < g_server_state->max_clients; ++i)
     {
-        if (clients_to_notify[i] && clients_to_notify[i]->socket_fd >= 0)
+        // unregisterClient takes clients_list_mutex itself and clears the slot.
+        pthread_mutex_lock(&g_server_state->clients_list_mutex);
+        ClientInfo *client = g_server_state->connected_clients[i];
+        pthread_mutex_unlock(&g_server_state->clients_list_mutex);
+        if (client != NULL)
         {
-            notifyClientOfShutdown(clients_to_notify[i]->socket_fd); // Best effort send
-            shutdown(clients_to_notify[i]->socket_fd, SHUT_RDWR);    // Signal client thread's select/recv
-            close(clients_to_notify[i]->socket_fd);                  // Close socket
-            // The client's handler thread should detect this and call unregisterClient.
-            // We mark the socket as -1 here to prevent double close if unregisterClient is slow.
-            // However, client_info struct itself is managed by its thread.
-            // This is slightly risky if unregisterClient hasn't run yet and tries to use the fd.
-            // A safer model might involve signalling threads then joining, but detached threads complicate this.
-            // Let's assume client handler sets its own fd to -1 in unregisterClient.
+            unregisterClient(client, 0); // Server-initiated, not the client's fault
         }
     }
 
-    // Give client handler threads a moment to process their shutdown and call unregisterClient.
-    // This is a pragmatic approach for detached threads.
-    logServerEvent("INFO", "Server Shutdown: Allowing a moment for client threads to self-terminate...");
-    sleep(2); // Adjust as needed, or implement a more robust join/signal mechanism for client threads.
-
     // 5. Log final SIGINT summary (using the count from *before* client thread cleanup started)
     logEventSigintShutdown(clients_at_shutdown_commence);
 
-    // 6. Clean up room mutexes
-    // Assuming all client threads have exited and no longer hold room_locks.
-    // pthread_mutex_lock(&g_server_state->rooms_list_mutex); // Lock the list itself before iterating
-    // For loop based on MAX_ROOMS as rooms might not be contiguous if some were deleted (not implemented)
-    for (int i = 0; i < MAX_ROOMS; ++i)
-    {
-        // Only destroy if initialized (e.g., check name or use a flag, but init does all)
-        // if (strlen(g_server_state->chat_rooms[i].name) > 0 || i < g_server_state->current_room_count) {
-        if (pthread_mutex_destroy(&g_server_state->chat_rooms[i].room_lock) != 0)
-        {
-            if (errno == EBUSY)
-            {
-                logServerEvent("WARNING_SHUTDOWN", "Room mutex for slot %d ('%s') is busy during cleanup. Forcing destroy.", i, g_server_state->chat_rooms[i].name);
-                // Force destroy might be bad, but server is exiting.
-            }
-            else if (errno == EINVAL)
-            {
-                // logServerEvent("WARNING_SHUTDOWN", "Room mutex for slot %d ('%s') was invalid/not init for destroy.", i, g_server_state->chat_rooms[i].name);
-            }
-        }
-        // }
-    }
-    // pthread_mutex_unlock(&g_server_state->rooms_list_mutex);
+    // 6. Release room slots and the name indexes
+    // All client threads have exited, so no room_lock or index stripe is held anymore.
+    cleanupRoomSystem();
+    destroyNameIndex(&g_server_state->client_name_index);
 
     // 7. Destroy main server mutexes
     // Ensure these are not held by any lingering threads (should not be if shutdown is orderly).
@@ -316,6 +333,8 @@ void cleanupServerResources()
     }
 
     // 8. Free the global server state structure itself
+    free(g_server_state->connected_clients);
+    free(g_server_state->free_client_slots);
     free(g_server_state);
     g_server_state = NULL;
 
@@ -323,13 +342,149 @@ void cleanupServerResources()
     finalizeServerLogging(); // Close the log file as the very last step.
 }
 
+// Parses a non-negative integer option value. Returns 1 on success, 0 if it is not a number in [min, max].
+static int parseIntOptionValue(const char *value_text, long min_value, long max_value, int *out_value)
+{
+    char *end_ptr = NULL;
+    errno = 0;
+    long value = strtol(value_text, &end_ptr, 10);
+    if (errno != 0 || end_ptr == value_text || *end_ptr != '\0' || value < min_value || value > max_value)
+        return 0;
+    *out_value = (int)value;
+    return 1;
+}
+
+// Parses --cluster=HOST:PORT,HOST:PORT,... into config->cluster_nodes.
+// Returns 1 on success, 0 if an entry is malformed or there are too many.
+static int parseClusterNodeList(const char *list_text, ServerConfig *config)
+{
+    config->cluster_node_count = 0;
+    const char *entry = list_text;
+    while (*entry)
+    {
+        const char *entry_end = strchr(entry, ',');
+        size_t entry_len = entry_end ? (size_t)(entry_end - entry) : strlen(entry);
+        const char *colon = memchr(entry, ':', entry_len);
+        if (!colon || colon == entry || (size_t)(colon - entry) >= CLUSTER_NODE_HOST_SIZE ||
+            config->cluster_node_count >= CLUSTER_MAX_NODES)
+            return 0;
+
+        char port_text[8];
+        size_t port_len = entry_len - (size_t)(colon + 1 - entry);
+        if (port_len == 0 || port_len >= sizeof(port_text))
+            return 0;
+        memcpy(port_text, colon + 1, port_len);
+        port_text[port_len] = '\0';
+
+        ClusterNodeAddress *node = &config->cluster_nodes[config->cluster_node_count];
+        if (!parseIntOptionValue(port_text, 1, 65535, &node->port))
+            return 0;
+        memcpy(node->host, entry, (size_t)(colon - entry));
+        node->host[colon - entry] = '\0';
+        config->cluster_node_count++;
+
+        if (!entry_end)
+            break;
+        entry = entry_end + 1;
+    }
+    return config->cluster_node_count > 0;
+}
+
+// Fills config from the options that follow the port, starting from the defaults.
+// Returns 1 on success, 0 on an unknown option or invalid value (already reported).
+static int parseServerOptions(int option_count, char *options[], ServerConfig *config)
+{
+    config->slow_consumer_policy = SLOW_CONSUMER_DROP;
+    config->file_worker_count = MAX_UPLOAD_QUEUE_SIZE;
+    config->file_processing_delay_ms = DEFAULT_FILE_PROCESSING_DELAY_MS;
+    config->file_scheduling_policy = FILE_SCHEDULE_SMALLEST_FIRST;
+    config->log_level = LOG_LEVEL_INFO;
+    config->log_flush_interval_ms = DEFAULT_LOG_FLUSH_INTERVAL_MS;
+    config->stats_interval_seconds = 0;
+    config->admin_socket_path[0] = '\0';
+    config->cluster_node_count = 0;
+    config->cluster_node_id = -1;
+
+    for (int i = 0; i < option_count; ++i)
+    {
+        const char *option = options[i];
+        int valid = 1;
+        if (strcmp(option, "--slow-consumer=drop") == 0)
+            config->slow_consumer_policy = SLOW_CONSUMER_DROP;
+        else if (strcmp(option, "--slow-consumer=disconnect") == 0)
+            config->slow_consumer_policy = SLOW_CONSUMER_DISCONNECT;
+        else if (strncmp(option, "--file-workers=", 15) == 0)
+            valid = parseIntOptionValue(option + 15, 1, MAX_FILE_WORKERS, &config->file_worker_count);
+        else if (strncmp(option, "--file-delay-ms=", 16) == 0)
+            valid = parseIntOptionValue(option + 16, 0, 3600 * 1000, &config->file_processing_delay_ms);
+        else if (strcmp(option, "--file-schedule=smallest") == 0)
+            config->file_scheduling_policy = FILE_SCHEDULE_SMALLEST_FIRST;
+        else if (strcmp(option, "--file-schedule=fifo") == 0)
+            config->file_scheduling_policy = FILE_SCHEDULE_FIFO;
+        else if (strcmp(option, "--log-level=debug") == 0)
+            config->log_level = LOG_LEVEL_DEBUG;
+        else if (strcmp(option, "--log-level=info") == 0)
+            config->log_level = LOG_LEVEL_INFO;
+        else if (strcmp(option, "--log-level=warning") == 0)
+            config->log_level = LOG_LEVEL_WARNING;
+        else if (strcmp(option, "--log-level=error") == 0)
+            config->log_level = LOG_LEVEL_ERROR;
+        else if (strncmp(option, "--log-flush-ms=", 15) == 0)
+            valid = parseIntOptionValue(option + 15, 0, 10 * 1000, &config->log_flush_interval_ms);
+        else if (strncmp(option, "--stats-interval=", 17) == 0)
+            valid = parseIntOptionValue(option + 17, 0, 24 * 3600, &config->stats_interval_seconds);
+        else if (strncmp(option, "--admin-socket=", 15) == 0)
+        {
+            valid = (option[15] != '\0' && strlen(option + 15) < sizeof(config->admin_socket_path));
+            if (valid)
+                strcpy(config->admin_socket_path, option + 15);
+        }
+        else if (strncmp(option, "--cluster=", 10) == 0)
+            valid = parseClusterNodeList(option + 10, config);
+        else if (strncmp(option, "--node-id=", 10) == 0)
+            valid = parseIntOptionValue(option + 10, 0, CLUSTER_MAX_NODES - 1, &config->cluster_node_id);
+        else
+            valid = 0;
+
+        if (!valid)
+        {
+            fprintf(stderr, "Invalid option: %s\n", option);
+            return 0;
+        }
+    }
+
+    // --cluster and --node-id go together, and the id must name an entry of the list
+    if (config->cluster_node_count == 0 && config->cluster_node_id < 0)
+    {
+        config->cluster_node_id = 0;
+        return 1;
+    }
+    if (config->cluster_node_id < 0 || config->cluster_node_id >= config->cluster_node_count)
+    {
+        fprintf(stderr, "--cluster and --node-id must be given together; the node id must be below the number of nodes.\n");
+        return 0;
+    }
+    return 1;
+}
+
 // Main function for the server application.
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    ServerConfig server_config;
+    if (argc < 2 || !parseServerOptions(argc - 2, argv + 2, &server_config))
     {
-        fprintf(stderr, "Usage: %s <port>\n", argv[0]);
-        fprintf(stderr, "Example: %s 5000\n", argv[0]);
+        fprintf(stderr, "Usage: %s <port> [options]\n", argv[0]);
+        fprintf(stderr, "  --slow-consumer=drop|disconnect  Policy for clients whose outbound queue is full (default: drop)\n");
+        fprintf(stderr, "  --file-workers=N                 File transfer worker threads, 1-%d (default: %d)\n", MAX_FILE_WORKERS, MAX_UPLOAD_QUEUE_SIZE);
+        fprintf(stderr, "  --file-delay-ms=N                Simulated processing time per file (default: %d)\n", DEFAULT_FILE_PROCESSING_DELAY_MS);
+        fprintf(stderr, "  --file-schedule=smallest|fifo    Order of queued file transfers (default: smallest)\n");
+        fprintf(stderr, "  --log-level=debug|info|warning|error  Minimum severity logged (default: info)\n");
+        fprintf(stderr, "  --log-flush-ms=N                 Log writer flush interval, 0 = immediate (default: %d)\n", DEFAULT_LOG_FLUSH_INTERVAL_MS);
+        fprintf(stderr, "  --stats-interval=SECONDS         Write a STATS line to the log periodically (default: 0 = off)\n");
+        fprintf(stderr, "  --admin-socket=PATH              Serve metrics snapshots on a Unix socket (default: off)\n");
+        fprintf(stderr, "  --cluster=HOST:PORT,...          Every node of the cluster, with its inter-node link port (default: off)\n");
+        fprintf(stderr, "  --node-id=N                      This node's position in --cluster, counting from 0\n");
+        fprintf(stderr, "Example: %s 5000 --file-workers=5 --file-delay-ms=5000\n", argv[0]);
         return EXIT_FAILURE;
     }
 
@@ -341,7 +496,7 @@ int main(int argc, char *argv[])
     }
 
     // Initialize logging first, so other initializations can log
-    if (!initializeServerLogging(SERVER_LOG_FILENAME))
+    if (!initializeServerLogging(SERVER_LOG_FILENAME, &server_config))
     {
         // If logging fails, cannot proceed reliably.
         fprintf(stderr, "CRITICAL: Server logging could not be initialized. Exiting.\n");
@@ -366,7 +521,7 @@ int main(int argc, char *argv[])
     signal(SIGPIPE, SIG_IGN);
 
     // Initialize server state (allocates g_server_state, inits mutexes, subsystems like rooms/file transfer)
-    initializeServerState();
+    initializeServerState(&server_config);
 
     // Setup the main listening socket
     if (!setupServerListeningSocket(server_port))
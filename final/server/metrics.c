@@ -0,0 +1,442 @@
+#include "common.h"
+#include <stdarg.h>  // For va_list in appendMetricsText
+#include <poll.h>    // For the metrics thread's timed wait
+#include <stdint.h>  // For uint64_t eventfd counters
+#include <sys/un.h>  // For the admin Unix socket
+
+// Hot-path counters live in per-thread shards: each thread claims a cache-line aligned shard
+// on its first update and only ever adds to its own, so counting costs an uncontended relaxed
+// atomic add. Readers sum all shards. Threads beyond METRICS_MAX_THREAD_SHARDS share shard 0,
+// which the atomics keep correct.
+
+#define METRICS_MESSAGE_TYPES (MSG_SERVER_NOTIFICATION + 1)
+
+// Counts of values in power-of-two buckets, plus total count and sum.
+typedef struct MetricsHistogram
+{
+    unsigned long long buckets[METRICS_HISTOGRAM_BUCKETS];
+    unsigned long long count;
+    unsigned long long sum;
+} MetricsHistogram;
+
+typedef struct __attribute__((aligned(64))) MetricsShard
+{
+    unsigned long long messages_in[METRICS_MESSAGE_TYPES];
+    unsigned long long messages_out[METRICS_MESSAGE_TYPES];
+    unsigned long long send_failures;
+    unsigned long long outbound_drops;
+    unsigned long long broadcast_recipients;
+    MetricsHistogram broadcast_fanout_us;
+    MetricsHistogram file_queue_wait_ms;
+} MetricsShard;
+
+static MetricsShard metrics_shards[METRICS_MAX_THREAD_SHARDS];
+static int metrics_shards_claimed = 1; // Shard 0 is the shared overflow shard
+static __thread MetricsShard *thread_metrics_shard = NULL;
+
+static const char *metrics_message_type_names[METRICS_MESSAGE_TYPES] = {
+    "LOGIN", "JOIN_ROOM", "LEAVE_ROOM", "BROADCAST", "WHISPER", "FILE_TRANSFER_REQUEST", "DISCONNECT",
+    "LOGIN_SUCCESS", "LOGIN_FAILURE", "FILE_TRANSFER_DATA", "FILE_TRANSFER_ACCEPT", "FILE_TRANSFER_REJECT",
+    "ERROR", "SUCCESS", "SERVER_NOTIFICATION"};
+
+static int metrics_wakeup_fd = -1;      // eventfd that stops the metrics thread
+static int metrics_admin_fd = -1;       // Listening admin socket, or -1
+static pthread_t metrics_thread_id;
+static int metrics_thread_started = 0;
+static int metrics_stats_interval_seconds = 0;
+static char metrics_admin_path[sizeof(((ServerConfig *)0)->admin_socket_path)];
+
+static MetricsShard *currentMetricsShard(void)
+{
+    if (!thread_metrics_shard)
+    {
+        int claimed = __atomic_fetch_add(&metrics_shards_claimed, 1, __ATOMIC_RELAXED);
+        thread_metrics_shard = &metrics_shards[claimed < METRICS_MAX_THREAD_SHARDS ? claimed : 0];
+    }
+    return thread_metrics_shard;
+}
+
+static void addCounter(unsigned long long *counter, unsigned long long amount)
+{
+    __atomic_fetch_add(counter, amount, __ATOMIC_RELAXED);
+}
+
+static void recordHistogram(MetricsHistogram *histogram, unsigned long long value)
+{
+    int bucket = (value == 0) ? 0 : 64 - __builtin_clzll(value);
+    if (bucket >= METRICS_HISTOGRAM_BUCKETS)
+        bucket = METRICS_HISTOGRAM_BUCKETS - 1;
+    addCounter(&histogram->buckets[bucket], 1);
+    addCounter(&histogram->count, 1);
+    addCounter(&histogram->sum, value);
+}
+
+void metricsCountMessageIn(int message_type)
+{
+    if (message_type >= 0 && message_type < METRICS_MESSAGE_TYPES)
+        addCounter(&currentMetricsShard()->messages_in[message_type], 1);
+}
+
+void metricsCountMessageOut(int message_type)
+{
+    if (message_type >= 0 && message_type < METRICS_MESSAGE_TYPES)
+        addCounter(&currentMetricsShard()->messages_out[message_type], 1);
+}
+
+void metricsCountSendFailure(void)
+{
+    addCounter(&currentMetricsShard()->send_failures, 1);
+}
+
+void metricsCountOutboundDrop(void)
+{
+    addCounter(&currentMetricsShard()->outbound_drops, 1);
+}
+
+void metricsRecordBroadcastFanout(unsigned long long micros, int recipients)
+{
+    MetricsShard *shard = currentMetricsShard();
+    recordHistogram(&shard->broadcast_fanout_us, micros);
+    addCounter(&shard->broadcast_recipients, (unsigned long long)recipients);
+}
+
+void metricsRecordFileQueueWait(unsigned long long millis)
+{
+    recordHistogram(&currentMetricsShard()->file_queue_wait_ms, millis);
+}
+
+// --- Snapshots ---
+
+static unsigned long long readCounter(const unsigned long long *counter)
+{
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+// Sums all shards into total.
+static void collectMetrics(MetricsShard *total)
+{
+    memset(total, 0, sizeof(*total));
+    int shard_count = __atomic_load_n(&metrics_shards_claimed, __ATOMIC_RELAXED);
+    if (shard_count > METRICS_MAX_THREAD_SHARDS)
+        shard_count = METRICS_MAX_THREAD_SHARDS;
+    for (int s = 0; s < shard_count; ++s)
+    {
+        const MetricsShard *shard = &metrics_shards[s];
+        for (int t = 0; t < METRICS_MESSAGE_TYPES; ++t)
+        {
+            total->messages_in[t] += readCounter(&shard->messages_in[t]);
+            total->messages_out[t] += readCounter(&shard->messages_out[t]);
+        }
+        total->send_failures += readCounter(&shard->send_failures);
+        total->outbound_drops += readCounter(&shard->outbound_drops);
+        total->broadcast_recipients += readCounter(&shard->broadcast_recipients);
+        const MetricsHistogram *sources[2] = {&shard->broadcast_fanout_us, &shard->file_queue_wait_ms};
+        MetricsHistogram *targets[2] = {&total->broadcast_fanout_us, &total->file_queue_wait_ms};
+        for (int h = 0; h < 2; ++h)
+        {
+            for (int b = 0; b < METRICS_HISTOGRAM_BUCKETS; ++b)
+                targets[h]->buckets[b] += readCounter(&sources[h]->buckets[b]);
+            targets[h]->count += readCounter(&sources[h]->count);
+            targets[h]->sum += readCounter(&sources[h]->sum);
+        }
+    }
+}
+
+// Upper bound of the bucket holding the given percentile (0 if the histogram is empty).
+static unsigned long long histogramPercentileBound(const MetricsHistogram *histogram, double percentile)
+{
+    unsigned long long bucket_total = 0;
+    for (int b = 0; b < METRICS_HISTOGRAM_BUCKETS; ++b)
+        bucket_total += histogram->buckets[b];
+    if (bucket_total == 0)
+        return 0;
+    unsigned long long rank = (unsigned long long)(percentile / 100.0 * (double)bucket_total + 0.999999);
+    unsigned long long seen = 0;
+    for (int b = 0; b < METRICS_HISTOGRAM_BUCKETS; ++b)
+    {
+        seen += histogram->buckets[b];
+        if (seen >= rank)
+            return (b == 0) ? 0 : (1ULL << b);
+    }
+    return 1ULL << (METRICS_HISTOGRAM_BUCKETS - 1);
+}
+
+static unsigned long long sumMessageCounts(const unsigned long long *counts)
+{
+    unsigned long long total = 0;
+    for (int t = 0; t < METRICS_MESSAGE_TYPES; ++t)
+        total += counts[t];
+    return total;
+}
+
+// Gauges are read unlocked except the file queue depth, which is tiny to lock for.
+static void readServerGauges(int *clients, int *rooms, int *file_queue_depth)
+{
+    *clients = *rooms = *file_queue_depth = 0;
+    if (!g_server_state)
+        return;
+    *clients = g_server_state->active_client_count;
+    *rooms = g_server_state->current_room_count;
+    FileUploadQueue *ftm = &g_server_state->file_transfer_manager;
+    pthread_mutex_lock(&ftm->queue_access_mutex);
+    *file_queue_depth = ftm->current_queue_length;
+    pthread_mutex_unlock(&ftm->queue_access_mutex);
+}
+
+// Appends to out at *used, never writing past out_size.
+static void appendMetricsText(char *out, size_t out_size, size_t *used, const char *format, ...)
+{
+    if (*used >= out_size)
+        return;
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(out + *used, out_size - *used, format, args);
+    va_end(args);
+    if (written > 0)
+        *used = (*used + (size_t)written < out_size) ? *used + (size_t)written : out_size - 1;
+}
+
+static void appendHistogramText(char *out, size_t out_size, size_t *used, const char *name, const MetricsHistogram *histogram)
+{
+    appendMetricsText(out, out_size, used, "%s_count %llu\n%s_sum %llu\n", name, histogram->count, name, histogram->sum);
+    appendMetricsText(out, out_size, used, "%s_p50 %llu\n%s_p99 %llu\n%s_p999 %llu\n",
+                      name, histogramPercentileBound(histogram, 50.0), name, histogramPercentileBound(histogram, 99.0),
+                      name, histogramPercentileBound(histogram, 99.9));
+}
+
+// Appends the hit counters of every object pool (see shared/pool.h).
+static void appendPoolStatsText(char *out, size_t out_size, size_t *used)
+{
+    MemoryPoolStats pools[POOL_MAX_POOLS];
+    int pool_count = readMemoryPoolStats(pools, POOL_MAX_POOLS);
+    for (int i = 0; i < pool_count; ++i)
+    {
+        const MemoryPoolStats *pool = &pools[i];
+        unsigned long long in_use = pool->allocations > pool->releases ? pool->allocations - pool->releases : 0;
+        appendMetricsText(out, out_size, used,
+                          "pool_allocations{pool=\"%s\"} %llu\npool_cache_hits{pool=\"%s\"} %llu\n"
+                          "pool_shared_hits{pool=\"%s\"} %llu\npool_slab_carves{pool=\"%s\"} %llu\n"
+                          "pool_in_use{pool=\"%s\"} %llu\npool_bytes_reserved{pool=\"%s\"} %zu\n",
+                          pool->name, pool->allocations, pool->name, pool->cache_hits, pool->name, pool->shared_hits,
+                          pool->name, pool->slab_carves, pool->name, in_use, pool->name, pool->bytes_reserved);
+    }
+}
+
+// Appends the state and frame counters of every peer link (cluster mode only).
+static void appendClusterStatsText(char *out, size_t out_size, size_t *used)
+{
+    ClusterPeerStats peers[CLUSTER_MAX_NODES];
+    int peer_count = readClusterPeerStats(peers, CLUSTER_MAX_NODES);
+    for (int i = 0; i < peer_count; ++i)
+    {
+        const ClusterPeerStats *peer = &peers[i];
+        appendMetricsText(out, out_size, used,
+                          "cluster_link_up{node=\"%d\"} %d\ncluster_frames_sent{node=\"%d\"} %llu\n"
+                          "cluster_frames_received{node=\"%d\"} %llu\ncluster_frames_dropped{node=\"%d\"} %llu\n"
+                          "cluster_remote_users{node=\"%d\"} %d\n",
+                          peer->node_id, peer->is_connected, peer->node_id, peer->frames_sent, peer->node_id,
+                          peer->frames_received, peer->node_id, peer->frames_dropped, peer->node_id, peer->remote_users);
+    }
+}
+
+// Share of pool allocations that reused memory instead of carving a new slab, in percent.
+static double poolHitPercent(void)
+{
+    MemoryPoolStats pools[POOL_MAX_POOLS];
+    int pool_count = readMemoryPoolStats(pools, POOL_MAX_POOLS);
+    unsigned long long allocations = 0, carves = 0;
+    for (int i = 0; i < pool_count; ++i)
+    {
+        allocations += pools[i].allocations;
+        carves += pools[i].slab_carves;
+    }
+    return allocations > 0 ? 100.0 * (double)(allocations - carves) / (double)allocations : 100.0;
+}
+
+// Writes a "name value" snapshot of all metrics. Percentiles are bucket upper bounds.
+size_t formatServerMetrics(char *out, size_t out_size)
+{
+    if (!out || out_size == 0)
+        return 0;
+    MetricsShard total;
+    collectMetrics(&total);
+    int clients, rooms, file_queue_depth;
+    readServerGauges(&clients, &rooms, &file_queue_depth);
+
+    size_t used = 0;
+    out[0] = '\0';
+    appendMetricsText(out, out_size, &used, "clients_active %d\nrooms_active %d\nfile_queue_depth %d\n", clients, rooms, file_queue_depth);
+    for (int t = 0; t < METRICS_MESSAGE_TYPES; ++t)
+    {
+        if (total.messages_in[t] > 0)
+            appendMetricsText(out, out_size, &used, "messages_in{type=\"%s\"} %llu\n", metrics_message_type_names[t], total.messages_in[t]);
+    }
+    for (int t = 0; t < METRICS_MESSAGE_TYPES; ++t)
+    {
+        if (total.messages_out[t] > 0)
+            appendMetricsText(out, out_size, &used, "messages_out{type=\"%s\"} %llu\n", metrics_message_type_names[t], total.messages_out[t]);
+    }
+    appendMetricsText(out, out_size, &used, "send_failures %llu\noutbound_drops %llu\nbroadcast_recipients %llu\n",
+                      total.send_failures, total.outbound_drops, total.broadcast_recipients);
+    appendHistogramText(out, out_size, &used, "broadcast_fanout_us", &total.broadcast_fanout_us);
+    appendHistogramText(out, out_size, &used, "file_queue_wait_ms", &total.file_queue_wait_ms);
+    appendPoolStatsText(out, out_size, &used);
+    appendClusterStatsText(out, out_size, &used);
+    return used;
+}
+
+// One-line summary for the periodic STATS log entry.
+static void logServerStats(void)
+{
+    MetricsShard total;
+    collectMetrics(&total);
+    int clients, rooms, file_queue_depth;
+    readServerGauges(&clients, &rooms, &file_queue_depth);
+    logServerEvent("STATS", "clients=%d rooms=%d file_queue=%d msgs_in=%llu msgs_out=%llu send_failures=%llu outbound_drops=%llu "
+                            "fanout_p99_us<=%llu file_wait_p99_ms<=%llu pool_hit=%.1f%%",
+                   clients, rooms, file_queue_depth, sumMessageCounts(total.messages_in), sumMessageCounts(total.messages_out),
+                   total.send_failures, total.outbound_drops, histogramPercentileBound(&total.broadcast_fanout_us, 99.0),
+                   histogramPercentileBound(&total.file_queue_wait_ms, 99.0), poolHitPercent());
+}
+
+// Answers one admin connection with a snapshot and closes it.
+static void serveAdminConnection(void)
+{
+    int connection_fd = accept(metrics_admin_fd, NULL, NULL);
+    if (connection_fd < 0)
+        return;
+    char snapshot[METRICS_SNAPSHOT_MAX_SIZE];
+    size_t length = formatServerMetrics(snapshot, sizeof(snapshot));
+    size_t sent = 0;
+    while (sent < length)
+    {
+        ssize_t now = send(connection_fd, snapshot + sent, length - sent, MSG_NOSIGNAL);
+        if (now < 0 && errno == EINTR)
+            continue;
+        if (now <= 0)
+            break; // Reader went away
+        sent += (size_t)now;
+    }
+    close(connection_fd);
+}
+
+static long long monotonicMillis(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// Thread function: serves the admin socket and writes the periodic STATS line.
+static void *serverMetricsThread(void *unused_arg)
+{
+    (void)unused_arg;
+    struct pollfd watched[2] = {{metrics_wakeup_fd, POLLIN, 0}, {metrics_admin_fd, POLLIN, 0}};
+    int watched_count = (metrics_admin_fd >= 0) ? 2 : 1;
+    long long next_stats_ms = monotonicMillis() + (long long)metrics_stats_interval_seconds * 1000;
+
+    for (;;)
+    {
+        int timeout_ms = -1;
+        if (metrics_stats_interval_seconds > 0)
+        {
+            long long remaining = next_stats_ms - monotonicMillis();
+            timeout_ms = (remaining > 0) ? (int)remaining : 0;
+        }
+        int ready = poll(watched, (nfds_t)watched_count, timeout_ms);
+        if (ready < 0 && errno != EINTR)
+        {
+            logServerEvent("ERROR", "Metrics thread poll() failed: %s. Stopping metrics.", strerror(errno));
+            break;
+        }
+        if (ready > 0 && (watched[0].revents & POLLIN))
+            break; // shutdownServerMetrics
+        if (ready > 0 && watched_count > 1 && (watched[1].revents & POLLIN))
+            serveAdminConnection();
+        if (metrics_stats_interval_seconds > 0 && monotonicMillis() >= next_stats_ms)
+        {
+            logServerStats();
+            next_stats_ms += (long long)metrics_stats_interval_seconds * 1000;
+        }
+    }
+    return NULL;
+}
+
+// Opens the admin socket at path (replacing a stale one). Returns the fd, or -1 (logged).
+static int openAdminSocket(const char *path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        logServerEvent("ERROR", "Admin socket path '%s' is too long.", path);
+        return -1;
+    }
+    strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+    int admin_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (admin_fd < 0)
+    {
+        logServerEvent("ERROR", "Failed to create admin socket: %s", strerror(errno));
+        return -1;
+    }
+    unlink(path); // Left behind by a previous run that did not shut down cleanly
+    if (bind(admin_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(admin_fd, 8) < 0)
+    {
+        logServerEvent("ERROR", "Failed to bind admin socket '%s': %s", path, strerror(errno));
+        close(admin_fd);
+        return -1;
+    }
+    return admin_fd;
+}
+
+// Starts the metrics thread when a stats interval or an admin socket is configured.
+// Counters work either way. Returns 1 on success (or nothing to start), 0 on failure.
+int initializeServerMetrics(const ServerConfig *config)
+{
+    metrics_stats_interval_seconds = config->stats_interval_seconds;
+    strncpy(metrics_admin_path, config->admin_socket_path, sizeof(metrics_admin_path) - 1);
+    if (metrics_stats_interval_seconds <= 0 && metrics_admin_path[0] == '\0')
+        return 1;
+
+    if (metrics_admin_path[0] != '\0' && (metrics_admin_fd = openAdminSocket(metrics_admin_path)) < 0)
+        return 0;
+    metrics_wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (metrics_wakeup_fd < 0 || pthread_create(&metrics_thread_id, NULL, serverMetricsThread, NULL) != 0)
+    {
+        logServerEvent("ERROR", "Failed to start metrics thread: %s", strerror(errno));
+        shutdownServerMetrics();
+        return 0;
+    }
+    metrics_thread_started = 1;
+    if (metrics_admin_fd >= 0)
+        logServerEvent("INFO", "Metrics available on admin socket %s.", metrics_admin_path);
+    if (metrics_stats_interval_seconds > 0)
+        logServerEvent("INFO", "Logging server stats every %d second(s).", metrics_stats_interval_seconds);
+    return 1;
+}
+
+void shutdownServerMetrics(void)
+{
+    if (metrics_thread_started)
+    {
+        uint64_t one = 1;
+        if (write(metrics_wakeup_fd, &one, sizeof(one)) < 0)
+        { /* Thread is already awake */
+        }
+        pthread_join(metrics_thread_id, NULL);
+        metrics_thread_started = 0;
+        if (metrics_stats_interval_seconds > 0)
+            logServerStats(); // Final totals
+    }
+    if (metrics_wakeup_fd >= 0)
+        close(metrics_wakeup_fd);
+    metrics_wakeup_fd = -1;
+    if (metrics_admin_fd >= 0)
+    {
+        close(metrics_admin_fd);
+        unlink(metrics_admin_path);
+    }
+    metrics_admin_fd = -1;
+}
@@ -0,0 +1,370 @@
+#include "common.h"
+
+// Per-client outbound queues.
+// Every byte the server sends to a client goes through its queue, so frames from different
+// threads never interleave on the socket. Enqueueing never blocks: the caller attempts a
+// non-blocking send right away and, if the socket is full, the owning reactor loop finishes
+// the job when epoll reports EPOLLOUT. Queued buffers are refcounted, so a broadcast is
+// serialized once and shared by every member's queue.
+
+// Buffers come from two size classes: framed chat messages are small, fixed-size units and
+// unframed file headers fill the large class. A buffer is usually encoded on one thread and
+// freed on a reactor thread once sent; the pools' thread caches absorb that hand-off.
+#define OUTBOUND_SMALL_BUFFER_SIZE 256
+static MemoryPool outbound_small_pool = MEMORY_POOL_INITIALIZER("outbound_small", OUTBOUND_SMALL_BUFFER_SIZE);
+static MemoryPool outbound_large_pool = MEMORY_POOL_INITIALIZER("outbound_large", sizeof(OutboundBuffer) + WIRE_UNIT_MAX_SIZE);
+
+// Allocates a buffer with room for length bytes of inline data (reference count 1).
+OutboundBuffer *createOutboundBuffer(size_t length)
+{
+    size_t total_size = sizeof(OutboundBuffer) + length;
+    MemoryPool *pool = NULL;
+    if (total_size <= OUTBOUND_SMALL_BUFFER_SIZE)
+        pool = &outbound_small_pool;
+    else if (total_size <= sizeof(OutboundBuffer) + WIRE_UNIT_MAX_SIZE)
+        pool = &outbound_large_pool;
+    OutboundBuffer *buffer = pool ? poolAllocate(pool) : malloc(total_size);
+    if (!buffer)
+        return NULL;
+    buffer->pool = pool;
+    buffer->reference_count = 1;
+    buffer->length = length;
+    buffer->data = buffer->inline_data;
+    buffer->spool_fd = -1;
+    buffer->delivery_state = OUTBOUND_PENDING;
+    buffer->message_type = -1;
+    return buffer;
+}
+
+// Wraps the first length bytes of a spool file; the queue hands them to the socket with
+// sendfile(), so they never pass through user space. The descriptor is closed with the buffer.
+OutboundBuffer *createSpooledOutboundBuffer(int spool_fd, size_t length)
+{
+    OutboundBuffer *buffer = createOutboundBuffer(0);
+    if (!buffer)
+        return NULL;
+    buffer->length = length;
+    buffer->data = NULL;
+    buffer->spool_fd = spool_fd;
+    return buffer;
+}
+
+// Serializes a Message once in the given wire protocol.
+OutboundBuffer *encodeOutboundMessage(const Message *msg, int protocol_version)
+{
+    if (!msg)
+        return NULL;
+    if (protocol_version != WIRE_PROTOCOL_FRAMED)
+    {
+        OutboundBuffer *buffer = createOutboundBuffer(sizeof(Message));
+        if (buffer)
+        {
+            memcpy(buffer->data, msg, sizeof(Message));
+            buffer->message_type = msg->type;
+        }
+        return buffer;
+    }
+
+    unsigned char frame[FRAME_MAX_SIZE];
+    size_t frame_len = encodeMessageFrame(msg, frame, sizeof(frame));
+    OutboundBuffer *buffer = (frame_len > 0) ? createOutboundBuffer(frame_len) : NULL;
+    if (buffer)
+    {
+        memcpy(buffer->data, frame, frame_len);
+        buffer->message_type = msg->type;
+    }
+    return buffer;
+}
+
+void retainOutboundBuffer(OutboundBuffer *buffer)
+{
+    if (buffer)
+        __atomic_add_fetch(&buffer->reference_count, 1, __ATOMIC_RELAXED);
+}
+
+void releaseOutboundBuffer(OutboundBuffer *buffer)
+{
+    if (!buffer)
+        return;
+    if (__atomic_sub_fetch(&buffer->reference_count, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        if (buffer->spool_fd >= 0)
+            close(buffer->spool_fd);
+        if (buffer->pool)
+            poolRelease(buffer->pool, buffer);
+        else
+            free(buffer);
+    }
+}
+
+// Initializes the queue fields of a freshly allocated ClientInfo.
+// Returns 1 on success, 0 on failure.
+int initializeClientOutboundQueue(ClientInfo *client)
+{
+    client->outbound_head = 0;
+    client->outbound_count = 0;
+    client->outbound_head_offset = 0;
+    client->outbound_queued_bytes = 0;
+    client->outbound_write_armed = 0;
+    client->input_paused = 0;
+    client->outbound_closed = 0;
+    client->outbound_dropped_messages = 0;
+    if (pthread_mutex_init(&client->outbound_lock, NULL) != 0)
+        return 0;
+    if (pthread_cond_init(&client->outbound_progress_cond, NULL) != 0)
+    {
+        pthread_mutex_destroy(&client->outbound_lock);
+        return 0;
+    }
+    return 1;
+}
+
+void destroyClientOutboundQueue(ClientInfo *client)
+{
+    pthread_cond_destroy(&client->outbound_progress_cond);
+    pthread_mutex_destroy(&client->outbound_lock);
+}
+
+// Registers the client's socket for the given interest. outbound_lock must be HELD.
+// Returns 1 on success, 0 on failure.
+static int updateEpollInterestLocked(ClientInfo *client, int want_writable, int input_paused)
+{
+    struct epoll_event client_event;
+    memset(&client_event, 0, sizeof(client_event));
+    client_event.events = (input_paused ? 0 : EPOLLIN | EPOLLRDHUP) | (want_writable ? EPOLLOUT : 0);
+    client_event.data.ptr = client;
+    return epoll_ctl(g_server_state->io_loops[client->io_loop_index].epoll_fd, EPOLL_CTL_MOD, client->socket_fd, &client_event) == 0;
+}
+
+// Switches EPOLLOUT interest on or off for the client. outbound_lock must be HELD.
+static void setWriteInterestLocked(ClientInfo *client, int want_writable)
+{
+    if (client->outbound_write_armed == want_writable || client->socket_fd < 0 || !g_server_state)
+        return;
+    if (updateEpollInterestLocked(client, want_writable, client->input_paused))
+        client->outbound_write_armed = want_writable;
+}
+
+// Withholds or restores EPOLLIN (and EPOLLRDHUP). While paused, the reactor only
+// reports the socket for writing or hangup, and unread input stays in the kernel;
+// level-triggered epoll reports it again once input is resumed.
+void setClientInputPaused(ClientInfo *client, int paused)
+{
+    pthread_mutex_lock(&client->outbound_lock);
+    if (client->input_paused != paused && client->socket_fd >= 0 && g_server_state &&
+        updateEpollInterestLocked(client, client->outbound_write_armed, paused))
+        client->input_paused = paused;
+    pthread_mutex_unlock(&client->outbound_lock);
+}
+
+// Pops the head entry, marking it with the given delivery state. outbound_lock must be HELD.
+static void popHeadLocked(ClientInfo *client, int delivery_state)
+{
+    OutboundBuffer *head = client->outbound_ring[client->outbound_head];
+    client->outbound_ring[client->outbound_head] = NULL;
+    client->outbound_head = (client->outbound_head + 1) % CLIENT_OUTBOUND_QUEUE_CAPACITY;
+    client->outbound_count--;
+    client->outbound_queued_bytes -= head->length - client->outbound_head_offset;
+    client->outbound_head_offset = 0;
+    head->delivery_state = delivery_state;
+    releaseOutboundBuffer(head);
+}
+
+// Drops every queued entry (connection is going away). outbound_lock must be HELD.
+static void discardQueueLocked(ClientInfo *client)
+{
+    while (client->outbound_count > 0)
+        popHeadLocked(client, OUTBOUND_DISCARDED);
+    client->outbound_closed = 1;
+    pthread_cond_broadcast(&client->outbound_progress_cond);
+}
+
+// Sends as much of the queue as the socket accepts without blocking. outbound_lock must be HELD.
+// Arms EPOLLOUT while data remains. On a hard socket error the queue is discarded and the
+// socket is shut down so the owning reactor loop unregisters the client.
+static void flushQueueLocked(ClientInfo *client)
+{
+    int progressed = 0;
+    while (client->outbound_count > 0 && !client->outbound_closed)
+    {
+        OutboundBuffer *head = client->outbound_ring[client->outbound_head];
+        size_t send_len = head->length - client->outbound_head_offset;
+        ssize_t sent_now;
+        if (head->spool_fd >= 0)
+        { // The socket is non-blocking (see reactorAddClient), so sendfile() stops when it is full
+            off_t spool_offset = (off_t)client->outbound_head_offset;
+            sent_now = sendfile(client->socket_fd, head->spool_fd, &spool_offset, send_len);
+            if (sent_now == 0)
+            {
+                logServerEvent("FILE_ERROR", "Spooled data for %s ended early at offset %zu. Closing connection.",
+                               client->username, client->outbound_head_offset);
+                metricsCountSendFailure();
+                discardQueueLocked(client);
+                shutdown(client->socket_fd, SHUT_RDWR); // The stream is unusable after a partial file
+                return;
+            }
+        }
+        else
+        {
+            sent_now = send(client->socket_fd, head->data + client->outbound_head_offset, send_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+        }
+        if (sent_now < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break; // Socket buffer full; resume on EPOLLOUT
+            metricsCountSendFailure();
+            discardQueueLocked(client);
+            shutdown(client->socket_fd, SHUT_RDWR);
+            return;
+        }
+        progressed = 1;
+        client->outbound_head_offset += (size_t)sent_now;
+        client->outbound_queued_bytes -= (size_t)sent_now;
+        if (client->outbound_head_offset == head->length)
+            popHeadLocked(client, OUTBOUND_DELIVERED);
+    }
+    if (progressed)
+        pthread_cond_broadcast(&client->outbound_progress_cond);
+    setWriteInterestLocked(client, client->outbound_count > 0 && !client->outbound_closed);
+}
+
+// Applies the slow-consumer policy to a message that did not fit. outbound_lock must be HELD.
+static void handleQueueOverflowLocked(ClientInfo *client)
+{
+    client->outbound_dropped_messages++;
+    metricsCountOutboundDrop();
+    if (g_server_state && g_server_state->config.slow_consumer_policy == SLOW_CONSUMER_DISCONNECT && !client->outbound_closed)
+    {
+        logServerEvent("WARNING", "Client %s (fd %d) is not keeping up (%zu bytes queued). Disconnecting.",
+                       client->username, client->socket_fd, client->outbound_queued_bytes);
+        discardQueueLocked(client);
+        shutdown(client->socket_fd, SHUT_RDWR); // Owning reactor loop sees EOF and unregisters
+    }
+}
+
+// Appends buffers to the client's queue as one contiguous run and starts sending.
+// Chat traffic (is_bulk = 0) never waits: if the queue is over CLIENT_OUTBOUND_QUEUE_CAPACITY
+// entries or CLIENT_OUTBOUND_MAX_BYTES, the slow-consumer policy applies and 0 is returned.
+// Bulk traffic (file data) waits up to OUTBOUND_BULK_WAIT_SECONDS for free ring slots instead.
+// The queue takes its own references; callers keep theirs. Returns 1 if enqueued.
+int enqueueOutboundBuffers(ClientInfo *client, OutboundBuffer **buffers, int buffer_count, int is_bulk)
+{
+    if (!client || !buffers || buffer_count <= 0 || buffer_count > CLIENT_OUTBOUND_QUEUE_CAPACITY)
+        return 0;
+
+    size_t total_bytes = 0;
+    for (int i = 0; i < buffer_count; ++i)
+    {
+        if (!buffers[i])
+            return 0;
+        total_bytes += buffers[i]->length;
+    }
+
+    pthread_mutex_lock(&client->outbound_lock);
+    if (is_bulk)
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += OUTBOUND_BULK_WAIT_SECONDS;
+        while (!client->outbound_closed && client->outbound_count + buffer_count > CLIENT_OUTBOUND_QUEUE_CAPACITY)
+        {
+            if (pthread_cond_timedwait(&client->outbound_progress_cond, &client->outbound_lock, &deadline) == ETIMEDOUT)
+                break;
+        }
+    }
+
+    if (client->outbound_closed || client->socket_fd < 0)
+    {
+        pthread_mutex_unlock(&client->outbound_lock);
+        return 0;
+    }
+    if (client->outbound_count + buffer_count > CLIENT_OUTBOUND_QUEUE_CAPACITY ||
+        (!is_bulk && client->outbound_queued_bytes + total_bytes > CLIENT_OUTBOUND_MAX_BYTES))
+    {
+        handleQueueOverflowLocked(client);
+        pthread_mutex_unlock(&client->outbound_lock);
+        return 0;
+    }
+
+    for (int i = 0; i < buffer_count; ++i)
+    {
+        int tail = (client->outbound_head + client->outbound_count) % CLIENT_OUTBOUND_QUEUE_CAPACITY;
+        retainOutboundBuffer(buffers[i]);
+        client->outbound_ring[tail] = buffers[i];
+        client->outbound_count++;
+        if (buffers[i]->message_type >= 0)
+            metricsCountMessageOut(buffers[i]->message_type);
+    }
+    client->outbound_queued_bytes += total_bytes;
+
+    // Try the socket right away; whatever does not fit is finished on EPOLLOUT.
+    // (The owning loop may be busy in a handler, so do not rely on it alone.)
+    flushQueueLocked(client);
+    pthread_mutex_unlock(&client->outbound_lock);
+    return 1;
+}
+
+// Encodes a message in the client's negotiated protocol and queues it.
+int queueMessageToClient(ClientInfo *client, const Message *msg)
+{
+    if (!client)
+        return 0;
+    return queueMessageToClientWithProtocol(client, msg, client->wire_protocol);
+}
+
+// Encodes a message in an explicit protocol and queues it (login replies are always fixed-size).
+int queueMessageToClientWithProtocol(ClientInfo *client, const Message *msg, int protocol_version)
+{
+    OutboundBuffer *buffer = encodeOutboundMessage(msg, protocol_version);
+    if (!buffer)
+        return 0;
+    int queued = enqueueOutboundBuffers(client, &buffer, 1, 0);
+    releaseOutboundBuffer(buffer);
+    return queued;
+}
+
+// Called by the owning reactor loop when the socket becomes writable.
+void flushClientOutboundQueue(ClientInfo *client)
+{
+    pthread_mutex_lock(&client->outbound_lock);
+    flushQueueLocked(client);
+    pthread_mutex_unlock(&client->outbound_lock);
+}
+
+// Blocks until the given queued buffer has been fully sent or discarded, or timeout_seconds pass.
+// Returns the buffer's final delivery state (OUTBOUND_PENDING on timeout).
+int waitForOutboundDelivery(ClientInfo *client, OutboundBuffer *buffer, int timeout_seconds)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_seconds;
+
+    pthread_mutex_lock(&client->outbound_lock);
+    while (buffer->delivery_state == OUTBOUND_PENDING && !client->outbound_closed)
+    {
+        if (pthread_cond_timedwait(&client->outbound_progress_cond, &client->outbound_lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+    int state = buffer->delivery_state;
+    pthread_mutex_unlock(&client->outbound_lock);
+    return state;
+}
+
+// Closes the queue before the socket goes away: makes one last non-blocking attempt to
+// deliver what is queued (e.g., the goodbye message), then discards the rest.
+void closeClientOutboundQueue(ClientInfo *client)
+{
+    pthread_mutex_lock(&client->outbound_lock);
+    if (!client->outbound_closed)
+        flushQueueLocked(client);
+    discardQueueLocked(client);
+    pthread_mutex_unlock(&client->outbound_lock);
+
+    if (client->outbound_dropped_messages > 0)
+    {
+        logServerEvent("INFO", "Dropped %lu message(s) for slow client %s during its session.",
+                       client->outbound_dropped_messages, client->username);
+    }
+}
@@ -0,0 +1,285 @@
+#include "common.h"
+
+// Outcome of servicing a readable client socket.
+typedef enum ConnectionOutcome
+{
+    CONNECTION_KEEP_OPEN,         // Client stays registered on its loop
+    CONNECTION_CLOSE_GRACEFUL,    // Client sent /exit (MSG_DISCONNECT)
+    CONNECTION_CLOSE_UNEXPECTED,  // Peer closed, read error, or failed login
+    CONNECTION_CLOSE_BEFORE_LOGIN // Peer went away before sending a login message
+} ConnectionOutcome;
+
+// Creates the epoll loops and starts the fixed pool of I/O threads.
+// Returns 1 on success, 0 on failure (already logged).
+int initializeIoReactor()
+{
+    if (!g_server_state)
+        return 0;
+
+    for (int i = 0; i < SERVER_IO_THREADS; ++i)
+    { // Mark every loop as unopened so a partial failure can be cleaned up safely
+        g_server_state->io_loops[i].epoll_fd = -1;
+        g_server_state->io_loops[i].wakeup_event_fd = -1;
+        g_server_state->io_loops[i].thread_id = 0;
+    }
+
+    for (int i = 0; i < SERVER_IO_THREADS; ++i)
+    {
+        IoReactorLoop *loop = &g_server_state->io_loops[i];
+        loop->loop_index = i;
+        loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        loop->wakeup_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (loop->epoll_fd < 0 || loop->wakeup_event_fd < 0)
+        {
+            logServerEvent("CRITICAL", "Failed to create epoll/eventfd for I/O loop %d: %s", i, strerror(errno));
+            return 0;
+        }
+
+        // A NULL data pointer marks the wakeup descriptor; client sockets carry their ClientInfo.
+        struct epoll_event wakeup_event;
+        memset(&wakeup_event, 0, sizeof(wakeup_event));
+        wakeup_event.events = EPOLLIN;
+        wakeup_event.data.ptr = NULL;
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wakeup_event_fd, &wakeup_event) < 0)
+        {
+            logServerEvent("CRITICAL", "Failed to register wakeup eventfd for I/O loop %d: %s", i, strerror(errno));
+            return 0;
+        }
+
+        if (pthread_create(&loop->thread_id, NULL, ioReactorLoopThread, loop) != 0)
+        {
+            logServerEvent("CRITICAL", "Failed to create I/O thread %d: %s", i, strerror(errno));
+            loop->thread_id = 0;
+            return 0;
+        }
+    }
+    logServerEvent("INFO", "I/O reactor initialized with %d thread(s), capacity %d clients.",
+                   SERVER_IO_THREADS, g_server_state->max_clients);
+    return 1;
+}
+
+// Hands a registered (not yet logged-in) client to one of the reactor loops.
+// Loops are picked round-robin. Returns 1 on success, 0 on failure.
+int reactorAddClient(ClientInfo *client)
+{
+    if (!g_server_state || !client || client->socket_fd < 0)
+        return 0;
+
+    unsigned int loop_idx = __atomic_fetch_add(&g_server_state->next_io_loop, 1, __ATOMIC_RELAXED) % SERVER_IO_THREADS;
+    IoReactorLoop *loop = &g_server_state->io_loops[loop_idx];
+    client->io_loop_index = (int)loop_idx;
+    client->thread_id = loop->thread_id;
+    client->wire_protocol = WIRE_PROTOCOL_FIXED; // Login always arrives as a fixed struct
+    client->inbound_bytes_received = 0;
+
+    // All I/O on client sockets is non-blocking from here on; sendfile() has no MSG_DONTWAIT.
+    int socket_flags = fcntl(client->socket_fd, F_GETFL, 0);
+    if (socket_flags < 0 || fcntl(client->socket_fd, F_SETFL, socket_flags | O_NONBLOCK) < 0)
+    {
+        logServerEvent("ERROR", "Failed to make client fd %d non-blocking: %s", client->socket_fd, strerror(errno));
+        return 0;
+    }
+    // Chat traffic is many small writes; without this, Nagle plus delayed ACKs add ~40ms per reply.
+    int no_delay = 1;
+    setsockopt(client->socket_fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+    struct epoll_event client_event;
+    memset(&client_event, 0, sizeof(client_event));
+    client_event.events = EPOLLIN | EPOLLRDHUP;
+    client_event.data.ptr = client;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, client->socket_fd, &client_event) < 0)
+    {
+        logServerEvent("ERROR", "Failed to add client fd %d to I/O loop %u: %s", client->socket_fd, loop_idx, strerror(errno));
+        return 0;
+    }
+    return 1;
+}
+
+// Reads whatever is available on the client's socket, assembles complete wire units
+// (fixed Message structs or frames, per the negotiated protocol) and dispatches them.
+// Reads never go past the current unit, so the raw bytes of an accepted file upload
+// that follow its request are left on the socket and then streamed chunk by chunk.
+static ConnectionOutcome serviceReadableClient(ClientInfo *client)
+{
+    for (int handled = 0; handled < REACTOR_MESSAGES_PER_WAKEUP;)
+    {
+        if (client->upload_bytes_remaining > 0)
+        { // Raw upload data, not messages (each chunk counts against the wakeup budget)
+            int upload_progress = receiveFileUploadChunk(client);
+            if (upload_progress < 0)
+                return CONNECTION_CLOSE_UNEXPECTED; // unregisterClient drops the partial upload
+            if (upload_progress == 0)
+                return CONNECTION_KEEP_OPEN;
+            ++handled;
+            continue;
+        }
+
+        size_t unit_size = messageWireUnitSize(client->wire_protocol, client->inbound_buffer, client->inbound_bytes_received);
+        if (unit_size == 0 || unit_size > sizeof(client->inbound_buffer))
+        {
+            logServerEvent("WARNING", "Client %s (fd %d) sent a malformed frame header. Closing connection.",
+                           client->username, client->socket_fd);
+            return CONNECTION_CLOSE_UNEXPECTED;
+        }
+        unsigned char *fill_ptr = client->inbound_buffer + client->inbound_bytes_received;
+        size_t bytes_missing = unit_size - client->inbound_bytes_received;
+
+        ssize_t bytes_read = recv(client->socket_fd, fill_ptr, bytes_missing, MSG_DONTWAIT);
+        if (bytes_read < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return CONNECTION_KEEP_OPEN; // Drained for now, wait for the next readiness event
+            return (strlen(client->username) > 0) ? CONNECTION_CLOSE_UNEXPECTED : CONNECTION_CLOSE_BEFORE_LOGIN;
+        }
+        if (bytes_read == 0)
+        {
+            // Peer closed. A client that already sent /exit would have been closed after dispatch.
+            return (strlen(client->username) > 0) ? CONNECTION_CLOSE_UNEXPECTED : CONNECTION_CLOSE_BEFORE_LOGIN;
+        }
+
+        client->inbound_bytes_received += (size_t)bytes_read;
+        if (client->inbound_bytes_received < unit_size ||
+            messageWireUnitSize(client->wire_protocol, client->inbound_buffer, client->inbound_bytes_received) != unit_size)
+            continue; // Partial unit, or only the frame length prefix so far: keep reading
+
+        client->inbound_bytes_received = 0;
+        ++handled;
+        if (!decodeMessageWireUnit(client->wire_protocol, client->inbound_buffer, unit_size, &client->inbound_message))
+        {
+            logServerEvent("WARNING", "Client %s (fd %d) sent a malformed frame. Closing connection.",
+                           client->username, client->socket_fd);
+            return CONNECTION_CLOSE_UNEXPECTED;
+        }
+        metricsCountMessageIn(client->inbound_message.type);
+
+        // --- Login Phase ---
+        // The first message from a client must be MSG_LOGIN.
+        if (strlen(client->username) == 0)
+        {
+            if (!processClientLogin(client, &client->inbound_message))
+                return CONNECTION_CLOSE_UNEXPECTED; // processClientLogin sent the error to the client
+            continue;
+        }
+
+        handleClientMessage(client, &client->inbound_message);
+        if (!client->is_active)
+            return CONNECTION_CLOSE_GRACEFUL; // MSG_DISCONNECT was processed
+        if (client->input_paused)
+            return CONNECTION_KEEP_OPEN; // A cluster join must be answered before the next command
+    }
+    return CONNECTION_KEEP_OPEN; // Budget used up; level-triggered epoll will report the rest
+}
+
+// Removes a client from its loop and releases it (queued output gets one last flush attempt).
+static void closeReactorClient(IoReactorLoop *loop, ClientInfo *client, ConnectionOutcome outcome)
+{
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, client->socket_fd, NULL);
+
+    if (outcome == CONNECTION_CLOSE_BEFORE_LOGIN)
+    {
+        char client_ip_str[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &client->client_address.sin_addr, client_ip_str, INET_ADDRSTRLEN);
+        logServerEvent("INFO", "Client (fd %d from %s) disconnected before login attempt or initial read error.", client->socket_fd, client_ip_str);
+    }
+    unregisterClient(client, outcome != CONNECTION_CLOSE_GRACEFUL);
+}
+
+// Thread function running one reactor loop until the server shuts down.
+void *ioReactorLoopThread(void *loop_ptr_arg)
+{
+    IoReactorLoop *loop = (IoReactorLoop *)loop_ptr_arg;
+    struct epoll_event ready_events[REACTOR_MAX_EVENTS];
+
+    while (g_server_state && g_server_state->server_is_running)
+    {
+        int ready_count = epoll_wait(loop->epoll_fd, ready_events, REACTOR_MAX_EVENTS, -1);
+        if (ready_count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            logServerEvent("ERROR", "epoll_wait() failed on I/O loop %d: %s. Stopping loop.", loop->loop_index, strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < ready_count; ++i)
+        {
+            ClientInfo *client = (ClientInfo *)ready_events[i].data.ptr;
+            if (client == NULL)
+            {
+                uint64_t wakeup_count;
+                if (read(loop->wakeup_event_fd, &wakeup_count, sizeof(wakeup_count)) < 0)
+                { /* Counter already drained */
+                }
+                clusterFinishRoomJoins(loop->loop_index); // Verdicts recorded by the cluster threads
+                continue;                                 // Loop condition re-checks server_is_running
+            }
+            if (!g_server_state->server_is_running)
+                break; // Shutdown path notifies and unregisters the remaining clients
+
+            if (ready_events[i].events & EPOLLOUT)
+                flushClientOutboundQueue(client); // Queued replies/broadcasts can make progress
+            if (!(ready_events[i].events & ~(uint32_t)EPOLLOUT))
+                continue; // Writable only
+            if (client->input_paused)
+            { // Only a hangup is acted on until the pending join is answered
+                if (ready_events[i].events & (EPOLLHUP | EPOLLERR))
+                    closeReactorClient(loop, client, CONNECTION_CLOSE_UNEXPECTED);
+                continue;
+            }
+
+            ConnectionOutcome outcome = serviceReadableClient(client);
+            if (outcome != CONNECTION_KEEP_OPEN)
+                closeReactorClient(loop, client, outcome);
+        }
+    }
+    return NULL;
+}
+
+// Wakes a loop from another thread. eventfd writes never block; wakeups coalesce.
+void reactorWakeLoop(int loop_index)
+{
+    if (!g_server_state || loop_index < 0 || loop_index >= SERVER_IO_THREADS)
+        return;
+    IoReactorLoop *loop = &g_server_state->io_loops[loop_index];
+    uint64_t one = 1;
+    if (loop->wakeup_event_fd >= 0 && write(loop->wakeup_event_fd, &one, sizeof(one)) < 0)
+    { /* Counter saturated: the loop is awake anyway */
+    }
+}
+
+// Wakes and joins all I/O threads, then closes the loops' descriptors.
+// Clients still registered afterwards are owned by the caller (cleanupServerResources).
+void shutdownIoReactor()
+{
+    if (!g_server_state)
+        return;
+
+    for (int i = 0; i < SERVER_IO_THREADS; ++i)
+    {
+        IoReactorLoop *loop = &g_server_state->io_loops[i];
+        if (loop->wakeup_event_fd >= 0)
+        {
+            uint64_t one = 1;
+            if (write(loop->wakeup_event_fd, &one, sizeof(one)) < 0)
+            { /* Loop is already awake */
+            }
+        }
+    }
+    for (int i = 0; i < SERVER_IO_THREADS; ++i)
+    {
+        IoReactorLoop *loop = &g_server_state->io_loops[i];
+        if (loop->thread_id != 0 && pthread_join(loop->thread_id, NULL) != 0)
+        {
+            logServerEvent("ERROR", "Failed to join I/O thread %d: %s", i, strerror(errno));
+        }
+        loop->thread_id = 0;
+        if (loop->epoll_fd >= 0)
+            close(loop->epoll_fd);
+        if (loop->wakeup_event_fd >= 0)
+            close(loop->wakeup_event_fd);
+        loop->epoll_fd = loop->wakeup_event_fd = -1;
+    }
+    logServerEvent("INFO", "All I/O reactor threads joined.");
+}
@@ -0,0 +1,133 @@
+#include "common.h"
+
+// Hash index from a name (username or room name) to the structure that owns it.
+// Entries are embedded in the owning ClientInfo/ChatRoom, so indexing never allocates.
+// Buckets are guarded by REGISTRY_LOCK_STRIPES read-write locks: bucket i belongs to stripe
+// i % REGISTRY_LOCK_STRIPES, so lookups share a lock and unrelated names rarely contend.
+// Callers take the stripe lock for a key themselves (nameIndexLockFor), which lets them
+// combine a lookup with an insert or another update atomically.
+
+// FNV-1a over a NUL-terminated name.
+uint32_t hashIndexName(const char *name)
+{
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; ++p)
+    {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t bucketIndexFor(const NameIndex *index, const char *key)
+{
+    return (size_t)hashIndexName(key) & index->bucket_mask;
+}
+
+// Sets up an index sized for about expected_entries names (load factor <= 1).
+// Returns 1 on success, 0 on failure.
+int initializeNameIndex(NameIndex *index, size_t expected_entries)
+{
+    size_t bucket_count = REGISTRY_LOCK_STRIPES;
+    while (bucket_count < expected_entries)
+        bucket_count <<= 1;
+
+    index->buckets = calloc(bucket_count, sizeof(NameIndexEntry *));
+    if (!index->buckets)
+        return 0;
+    index->bucket_mask = bucket_count - 1;
+
+    for (int i = 0; i < REGISTRY_LOCK_STRIPES; ++i)
+    {
+        if (pthread_rwlock_init(&index->stripe_locks[i], NULL) != 0)
+        {
+            while (--i >= 0)
+                pthread_rwlock_destroy(&index->stripe_locks[i]);
+            free(index->buckets);
+            index->buckets = NULL;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void destroyNameIndex(NameIndex *index)
+{
+    if (!index->buckets)
+        return;
+    for (int i = 0; i < REGISTRY_LOCK_STRIPES; ++i)
+        pthread_rwlock_destroy(&index->stripe_locks[i]);
+    free(index->buckets);
+    index->buckets = NULL;
+}
+
+// Returns the lock guarding key's bucket. Take it for reading to look up, for writing to change.
+pthread_rwlock_t *nameIndexLockFor(NameIndex *index, const char *key)
+{
+    return &index->stripe_locks[bucketIndexFor(index, key) % REGISTRY_LOCK_STRIPES];
+}
+
+// Returns the owner indexed under key, or NULL. The key's stripe lock must be HELD.
+void *nameIndexLookupLocked(NameIndex *index, const char *key)
+{
+    for (NameIndexEntry *entry = index->buckets[bucketIndexFor(index, key)]; entry; entry = entry->next)
+    {
+        if (strcmp(entry->key, key) == 0)
+            return entry->owner;
+    }
+    return NULL;
+}
+
+// Adds an entry (key and owner already set). The key's stripe lock must be HELD for writing
+// and the key must not be indexed yet.
+void nameIndexInsertLocked(NameIndex *index, NameIndexEntry *entry)
+{
+    NameIndexEntry **bucket = &index->buckets[bucketIndexFor(index, entry->key)];
+    entry->next = *bucket;
+    *bucket = entry;
+}
+
+// Removes an indexed entry. The key's stripe lock must be HELD for writing.
+void nameIndexRemoveLocked(NameIndex *index, NameIndexEntry *entry)
+{
+    for (NameIndexEntry **link = &index->buckets[bucketIndexFor(index, entry->key)]; *link; link = &(*link)->next)
+    {
+        if (*link == entry)
+        {
+            *link = entry->next;
+            entry->next = NULL;
+            return;
+        }
+    }
+}
+
+// Unlinks every entry whose owner satisfies matches() and hands the owner to on_removed,
+// taking each stripe lock for writing in turn. Returns the number of entries removed.
+size_t nameIndexRemoveMatching(NameIndex *index, int (*matches)(const void *owner, void *context),
+                               void (*on_removed)(void *owner, void *context), void *context)
+{
+    size_t removed = 0;
+    for (int stripe = 0; stripe < REGISTRY_LOCK_STRIPES; ++stripe)
+    {
+        pthread_rwlock_wrlock(&index->stripe_locks[stripe]);
+        for (size_t bucket = (size_t)stripe; bucket <= index->bucket_mask; bucket += REGISTRY_LOCK_STRIPES)
+        {
+            NameIndexEntry **link = &index->buckets[bucket];
+            while (*link)
+            {
+                NameIndexEntry *entry = *link;
+                if (!matches(entry->owner, context))
+                {
+                    link = &entry->next;
+                    continue;
+                }
+                *link = entry->next;
+                entry->next = NULL;
+                on_removed(entry->owner, context);
+                removed++;
+            }
+        }
+        pthread_rwlock_unlock(&index->stripe_locks[stripe]);
+    }
+    return removed;
+}
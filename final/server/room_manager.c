@@ -1,7 +1,7 @@
 #include "common.h"
 
 // Initializes the room system.
-// Sets up mutexes for each potential room slot.
+// Allocates the reusable room slots (with their mutexes) and the room name index.
 void initializeRoomSystem()
 {
     if (!g_server_state)
@@ -11,12 +11,23 @@ void initializeRoomSystem()
         exit(EXIT_FAILURE); // Cannot proceed without server state
     }
 
-    // Lock the main rooms_list_mutex to safely initialize the chat_rooms array
+    // A listed room always has at least one member, so there can never be more rooms than clients.
+    int max_rooms = g_server_state->max_clients;
+    g_server_state->chat_rooms = calloc((size_t)max_rooms, sizeof(ChatRoom));
+    g_server_state->free_room_slots = malloc((size_t)max_rooms * sizeof(int));
+    if (!g_server_state->chat_rooms || !g_server_state->free_room_slots ||
+        !initializeNameIndex(&g_server_state->room_name_index, (size_t)max_rooms))
+    {
+        logServerEvent("CRITICAL", "Failed to allocate room registry for %d rooms.", max_rooms);
+        exit(EXIT_FAILURE);
+    }
+
     pthread_mutex_lock(&g_server_state->rooms_list_mutex);
-    for (int i = 0; i < MAX_ROOMS; ++i)
+    for (int i = 0; i < max_rooms; ++i)
     {
-        memset(&g_server_state->chat_rooms[i], 0, sizeof(ChatRoom)); // Zero out room structure
-        if (pthread_mutex_init(&g_server_state->chat_rooms[i].room_lock, NULL) != 0)
+        ChatRoom *room_slot = &g_server_state->chat_rooms[i];
+        room_slot->slot_index = i;
+        if (pthread_mutex_init(&room_slot->room_lock, NULL) != 0)
         {
             pthread_mutex_unlock(&g_server_state->rooms_list_mutex); // Unlock before logging/exiting
             logServerEvent("CRITICAL", "Failed to initialize mutex for room slot %d: %s", i, strerror(errno));
@@ -24,77 +35,93 @@ void initializeRoomSystem()
             // if we were to attempt recovery. For now, exit.
             exit(EXIT_FAILURE);
         }
-        // name field is already zeroed by memset, member_count is 0.
+        // Push in reverse so the lowest slots are handed out first
+        g_server_state->free_room_slots[i] = max_rooms - 1 - i;
     }
+    g_server_state->max_rooms = max_rooms;
+    g_server_state->free_room_slot_count = max_rooms;
     g_server_state->current_room_count = 0; // No rooms active yet
     pthread_mutex_unlock(&g_server_state->rooms_list_mutex);
-    logServerEvent("INFO", "Room management system initialized successfully.");
+    logServerEvent("INFO", "Room management system initialized successfully (%d room slots).", max_rooms);
 }
 
-// Finds an existing chat room by name or creates a new one if it doesn't exist and there's space.
-// Returns a pointer to the ChatRoom structure, or NULL on failure (e.g., max rooms reached).
-ChatRoom *findOrCreateChatRoom(const char *room_name_to_find)
+// Releases room slots and the room index. Called once every client has been unregistered.
+void cleanupRoomSystem()
 {
-    if (!g_server_state || !isValidRoomName(room_name_to_find))
-    {
-        return NULL; // Invalid input or server state
-    }
-
-    pthread_mutex_lock(&g_server_state->rooms_list_mutex); // Lock for accessing rooms list and current_room_count
-
-    // Try to find an existing room
-    for (int i = 0; i < g_server_state->current_room_count; ++i)
+    if (!g_server_state || !g_server_state->chat_rooms)
+        return;
+    for (int i = 0; i < g_server_state->max_rooms; ++i)
     {
-        // Safely compare names, assuming g_server_state->chat_rooms[i].name is null-terminated
-        if (strncmp(g_server_state->chat_rooms[i].name, room_name_to_find, ROOM_NAME_BUF_SIZE) == 0)
+        if (pthread_mutex_destroy(&g_server_state->chat_rooms[i].room_lock) != 0)
         {
-            pthread_mutex_unlock(&g_server_state->rooms_list_mutex);
-            return &g_server_state->chat_rooms[i]; // Room found
+            logServerEvent("WARNING_SHUTDOWN", "Room mutex for slot %d ('%s') is busy during cleanup. Forcing destroy.", i, g_server_state->chat_rooms[i].name);
         }
     }
+    destroyNameIndex(&g_server_state->room_name_index);
+    free(g_server_state->free_room_slots);
+    free(g_server_state->chat_rooms);
+    g_server_state->free_room_slots = NULL;
+    g_server_state->chat_rooms = NULL;
+}
 
-    // If room not found, try to create a new one
-    if (g_server_state->current_room_count < MAX_ROOMS)
+// Pops an unused room slot, or returns NULL if all slots are in use.
+static ChatRoom *takeFreeRoomSlot(void)
+{
+    ChatRoom *room = NULL;
+    pthread_mutex_lock(&g_server_state->rooms_list_mutex);
+    if (g_server_state->free_room_slot_count > 0)
     {
-        // Get the next available room slot
-        ChatRoom *new_room = &g_server_state->chat_rooms[g_server_state->current_room_count];
-        // The room_lock for this slot was initialized in initializeRoomSystem.
-
-        // Now, lock this specific room's mutex before modifying its contents
-        // (though not strictly necessary here as no other thread should access it yet, good practice)
-        // pthread_mutex_lock(&new_room->room_lock); // Not strictly needed for initialization of a new room slot
-
-        strncpy(new_room->name, room_name_to_find, ROOM_NAME_BUF_SIZE - 1);
-        new_room->name[ROOM_NAME_BUF_SIZE - 1] = '\0'; // Ensure null termination
-        new_room->member_count = 0;                    // Initialize member count
-        // members array is already zeroed from initialization or previous use if rooms are reused (not current model)
-
-        // pthread_mutex_unlock(&new_room->room_lock); // If locked above
-
-        g_server_state->current_room_count++; // Increment active room count
-
-        pthread_mutex_unlock(&g_server_state->rooms_list_mutex); // Unlock rooms list mutex
-        logEventRoomCreated(new_room->name);                     // Log room creation
-        return new_room;                                         // Return pointer to the new room
+        int slot = g_server_state->free_room_slots[--g_server_state->free_room_slot_count];
+        room = &g_server_state->chat_rooms[slot];
+        g_server_state->current_room_count++;
     }
+    pthread_mutex_unlock(&g_server_state->rooms_list_mutex);
+    return room;
+}
 
-    // Max rooms reached, cannot create new room
+// Returns an emptied room's slot to the free list so a later room can reuse it.
+static void releaseRoomSlot(ChatRoom *room)
+{
+    pthread_mutex_lock(&g_server_state->rooms_list_mutex);
+    memset(room->name, 0, ROOM_NAME_BUF_SIZE);
+    g_server_state->free_room_slots[g_server_state->free_room_slot_count++] = room->slot_index;
+    g_server_state->current_room_count--;
     pthread_mutex_unlock(&g_server_state->rooms_list_mutex);
-    logServerEvent("WARNING", "Could not create room '%s': Maximum room limit (%d) reached.", room_name_to_find, MAX_ROOMS);
-    return NULL;
+}
+
+// Returns the listed room with the given name, or lists a new one in a free slot (*created set).
+// The name's index stripe lock must be HELD for writing. Returns NULL if every slot is in use.
+static ChatRoom *findOrCreateRoomLocked(const char *room_name, int *created)
+{
+    NameIndex *room_index = &g_server_state->room_name_index;
+    *created = 0;
+    ChatRoom *room = nameIndexLookupLocked(room_index, room_name);
+    if (room)
+        return room;
+
+    room = takeFreeRoomSlot();
+    if (!room)
+        return NULL;
+    strncpy(room->name, room_name, ROOM_NAME_BUF_SIZE - 1);
+    room->name[ROOM_NAME_BUF_SIZE - 1] = '\0'; // Ensure null termination
+    room->member_count = 0;
+    room->remote_member_count = 0;
+    room->name_index_entry.key = room->name;
+    room->name_index_entry.owner = room;
+    nameIndexInsertLocked(room_index, &room->name_index_entry);
+    *created = 1;
+    return room;
 }
 
 // Adds a client to a specified chat room.
 // Handles checks for room capacity and if client is already a member.
+// The room's index stripe lock must be HELD for writing, so the room cannot be closed meanwhile.
 // Returns 1 on success, 0 on failure (e.g., room full).
-int addClientToRoom(ClientInfo *client, ChatRoom *room)
+static int addClientToRoomLocked(ClientInfo *client, ChatRoom *room)
 {
-    if (!client || !room)
-        return 0;
-
     pthread_mutex_lock(&room->room_lock); // Lock specific room for modifying its member list
 
-    if (room->member_count >= MAX_MEMBERS_PER_ROOM)
+    if (room->member_count + room->remote_member_count >= MAX_MEMBERS_PER_ROOM)
     {
         pthread_mutex_unlock(&room->room_lock);
         logServerEvent("INFO", "Client %s failed to join room '%s': Room is full (capacity %d).",
@@ -120,39 +147,63 @@ int addClientToRoom(ClientInfo *client, ChatRoom *room)
     // Update client's state to reflect current room
     strncpy(client->current_room_name, room->name, ROOM_NAME_BUF_SIZE - 1);
     client->current_room_name[ROOM_NAME_BUF_SIZE - 1] = '\0';
+    client->current_room = room;
     return 1; // Successfully added
 }
 
-// Removes a client from their currently associated chat room.
-// This function is called when a client leaves a room, disconnects, or switches rooms.
-void removeClientFromTheirRoom(ClientInfo *client)
+// Finds the room with the given name, creating it in a free slot if needed, and adds the client.
+// Lookup, creation and joining happen under the name's index stripe lock, so a room that is
+// being closed by its last member cannot be joined half-way.
+// Returns 1 on success (out_room set), 0 if the room is full, -1 if it could not be created.
+int joinChatRoom(ClientInfo *client, const char *room_name, ChatRoom **out_room)
 {
-    if (!client || strlen(client->current_room_name) == 0 || !g_server_state)
+    if (!client || !g_server_state || !isValidRoomName(room_name))
     {
-        return; // Client not in a room or invalid state
+        return -1; // Invalid input or server state
     }
 
-    ChatRoom *room_to_leave = NULL;
-    // Find the room structure. Requires locking rooms_list_mutex.
-    pthread_mutex_lock(&g_server_state->rooms_list_mutex);
-    for (int i = 0; i < g_server_state->current_room_count; ++i)
+    NameIndex *room_index = &g_server_state->room_name_index;
+    pthread_rwlock_t *stripe_lock = nameIndexLockFor(room_index, room_name);
+    pthread_rwlock_wrlock(stripe_lock);
+
+    int room_created = 0;
+    ChatRoom *room = findOrCreateRoomLocked(room_name, &room_created);
+    if (!room)
     {
-        if (strncmp(g_server_state->chat_rooms[i].name, client->current_room_name, ROOM_NAME_BUF_SIZE) == 0)
-        {
-            room_to_leave = &g_server_state->chat_rooms[i];
-            break;
-        }
+        pthread_rwlock_unlock(stripe_lock);
+        logServerEvent("WARNING", "Could not create room '%s': Maximum room limit (%d) reached.", room_name, g_server_state->max_rooms);
+        return -1;
     }
-    pthread_mutex_unlock(&g_server_state->rooms_list_mutex);
 
-    if (!room_to_leave)
+    int joined = addClientToRoomLocked(client, room);
+    pthread_rwlock_unlock(stripe_lock);
+
+    if (room_created)
+        logEventRoomCreated(room->name); // Log room creation
+    if (joined)
+        *out_room = room;
+    return joined;
+}
+
+// Removes a client from their currently associated chat room.
+// This function is called when a client leaves a room, disconnects, or switches rooms.
+// The last member to leave closes the room and frees its slot for reuse.
+void removeClientFromTheirRoom(ClientInfo *client)
+{
+    if (!client || !client->current_room || !g_server_state)
     {
-        logServerEvent("WARNING", "Client %s tried to leave room '%s', but room was not found in active list.",
-                       client->username, client->current_room_name);
-        memset(client->current_room_name, 0, ROOM_NAME_BUF_SIZE); // Clear client's room state anyway
-        return;
+        return; // Client not in a room or invalid state
     }
 
+    // The room cannot be closed while this client is still a member, so its name is stable here.
+    ChatRoom *room_to_leave = client->current_room;
+    char room_name[ROOM_NAME_BUF_SIZE];
+    strncpy(room_name, room_to_leave->name, ROOM_NAME_BUF_SIZE - 1);
+    room_name[ROOM_NAME_BUF_SIZE - 1] = '\0';
+
+    pthread_rwlock_t *stripe_lock = nameIndexLockFor(&g_server_state->room_name_index, room_name);
+    pthread_rwlock_wrlock(stripe_lock);
+
     // Now, lock the specific room to modify its member list
     pthread_mutex_lock(&room_to_leave->room_lock);
     int found_idx = -1;
@@ -176,20 +227,32 @@ void removeClientFromTheirRoom(ClientInfo *client)
         room_to_leave->member_count--;
     }
     // If found_idx == -1, client was not in member list - inconsistent state, but proceed.
+    int room_now_empty = (room_to_leave->member_count == 0 && room_to_leave->remote_member_count == 0);
     pthread_mutex_unlock(&room_to_leave->room_lock);
 
+    if (room_now_empty)
+        nameIndexRemoveLocked(&g_server_state->room_name_index, &room_to_leave->name_index_entry);
+    pthread_rwlock_unlock(stripe_lock);
+
     // Log the event if client was actually removed
     if (found_idx != -1)
     {
         // Log with the name of the room they *were* in, before clearing it.
-        logEventClientLeftRoom(client->username, room_to_leave->name);
+        logEventClientLeftRoom(client->username, room_name);
+    }
+    if (room_now_empty)
+    {
+        releaseRoomSlot(room_to_leave);
+        logServerEvent("INFO", "Room '%s' is empty and was closed.", room_name);
     }
 
-    // Clear the client's current room name state
-    memset(client->current_room_name, 0, ROOM_NAME_BUF_SIZE);
+    // The owning node counts this client among the room's members until told otherwise
+    if (clusterIsEnabled() && clusterRoomOwner(room_name) != clusterLocalNodeId())
+        clusterSendRoomLeave(client->username, room_name);
 
-    // Note: Room deletion if empty is not implemented as per common chat server designs.
-    // Rooms persist until server shutdown unless explicitly managed otherwise.
+    // Clear the client's current room state
+    memset(client->current_room_name, 0, ROOM_NAME_BUF_SIZE);
+    client->current_room = NULL;
 }
 
 // Notifies other members of a room about a client's action (join/leave).
@@ -213,7 +276,7 @@ void notifyRoomOfClientAction(ClientInfo *acting_client, ChatRoom *room, const c
     notification_msg.content[MESSAGE_BUF_SIZE - 1] = '\0';
 
     // Send to all members of the room, EXCLUDING the client who performed the action.
-    broadcastMessageToRoomMembers(room, &notification_msg, acting_client->username);
+    publishRoomMessage(room, &notification_msg, acting_client->username);
 }
 
 // Handles a client's request to join a room.
@@ -224,13 +287,18 @@ void handleJoinRoomRequest(ClientInfo *client, const char *room_name_requested)
 
     if (!isValidRoomName(room_name_requested))
     {
-        sendErrorToClient(client->socket_fd, "Invalid room name format. Must be alphanumeric, 1-32 chars, no spaces.");
+        sendErrorToClient(client, "Invalid room name format. Must be alphanumeric, 1-32 chars, no spaces.");
+        return;
+    }
+
+    if (client->pending_room_join)
+    {
+        sendErrorToClient(client, "Your previous join request is still waiting for an answer.");
         return;
     }
 
     char old_room_name_log[ROOM_NAME_BUF_SIZE];
     memset(old_room_name_log, 0, sizeof(old_room_name_log));
-    int was_in_another_room = 0;
 
     // If client is already in a room, handle leaving that room first
     if (strlen(client->current_room_name) > 0)
@@ -238,41 +306,70 @@ void handleJoinRoomRequest(ClientInfo *client, const char *room_name_requested)
         if (strncmp(client->current_room_name, room_name_requested, ROOM_NAME_BUF_SIZE) == 0)
         {
             // Client is trying to join the room they are already in
-            sendSuccessWithRoomToClient(client->socket_fd, "You are already in this room.", room_name_requested);
+            sendSuccessWithRoomToClient(client, "You are already in this room.", room_name_requested);
             return;
         }
         // Client is switching rooms
         strncpy(old_room_name_log, client->current_room_name, ROOM_NAME_BUF_SIZE - 1);
         old_room_name_log[ROOM_NAME_BUF_SIZE - 1] = '\0';
-        was_in_another_room = 1;
 
-        ChatRoom *old_room = findOrCreateChatRoom(client->current_room_name); // Should always find it if client->current_room_name is set
-        if (old_room)
+        if (client->current_room)
         {
-            notifyRoomOfClientAction(client, old_room, "left"); // Notify old room
+            notifyRoomOfClientAction(client, client->current_room, "left"); // Notify old room
         }
         removeClientFromTheirRoom(client); // This also logs the "left room" part for the old room.
     }
 
-    // Find or create the target room
-    ChatRoom *target_room = findOrCreateChatRoom(room_name_requested);
-    if (!target_room)
+    // In a cluster the room's owning node admits members from every node (and enforces the
+    // capacity); this node then lists the room too, holding only its own members. The reactor
+    // thread does not wait for the verdict: it finishes the join when the verdict is recorded.
+    if (clusterRoomOwner(room_name_requested) != clusterLocalNodeId())
+    {
+        if (!clusterRequestRoomJoin(client, room_name_requested, old_room_name_log))
+            finishRoomJoin(client, room_name_requested, old_room_name_log, -2);
+        return;
+    }
+    finishRoomJoin(client, room_name_requested, old_room_name_log, 1);
+}
+
+// Completes a join on the client's reactor thread, given the owning node's verdict (1 admitted,
+// 0 full, -1 no room slot, -2 unreachable; always 1 for rooms this node owns). The client has
+// already left old_room_name ("" if it was in no room).
+void finishRoomJoin(ClientInfo *client, const char *room_name, const char *old_room_name, int join_result)
+{
+    if (!client || !client->is_active)
+        return;
+    if (join_result < -1)
     {
-        sendErrorToClient(client->socket_fd, "Failed to find or create the requested room (server limit may be reached).");
-        // If client was switching rooms, they are now in no room. This needs careful state management if old room removal failed.
-        // However, findOrCreateChatRoom failure is rare (only if MAX_ROOMS hit).
+        sendErrorToClient(client, "The server node hosting this room is unreachable. Try again later.");
         return;
     }
 
-    // Attempt to add client to the target room
-    if (addClientToRoom(client, target_room))
+    // Find or create the target room and join it
+    int is_remote_owner = (clusterRoomOwner(room_name) != clusterLocalNodeId());
+    ChatRoom *target_room = NULL;
+    if (join_result > 0)
     {
-        sendSuccessWithRoomToClient(client->socket_fd, "Joined room", target_room->name); // Short success message
+        join_result = joinChatRoom(client, room_name, &target_room);
+        if (join_result <= 0 && is_remote_owner)
+            clusterSendRoomLeave(client->username, room_name); // Admitted there, not here
+    }
+    if (join_result < 0)
+    {
+        sendErrorToClient(client, "Failed to find or create the requested room (server limit may be reached).");
+        // If client was switching rooms, they are now in no room.
+        // Creation only fails when every room slot is in use.
+        return;
+    }
+
+    if (join_result > 0)
+    {
+        sendSuccessWithRoomToClient(client, "Joined room", target_room->name); // Short success message
 
         // Log event: either switched or joined for the first time/from no room
-        if (was_in_another_room)
+        if (old_room_name[0])
         {
-            logEventClientSwitchedRoom(client->username, old_room_name_log, target_room->name);
+            logEventClientSwitchedRoom(client->username, old_room_name, target_room->name);
         }
         else
         {
@@ -283,9 +380,9 @@ void handleJoinRoomRequest(ClientInfo *client, const char *room_name_requested)
     else
     {
         // Failed to add (e.g., room full)
-        sendErrorToClient(client->socket_fd, "Failed to join room (it might be full or an internal error occurred).");
-        // Client's current_room_name should still be empty or the old room if they were switching and add failed.
-        // addClientToRoom only updates client->current_room_name on success.
+        sendErrorToClient(client, "Failed to join room (it might be full or an internal error occurred).");
+        // Client's current_room_name is empty: a switching client already left the old room.
+        // joinChatRoom only updates client->current_room_name on success.
     }
 }
 
@@ -297,18 +394,17 @@ void handleLeaveRoomRequest(ClientInfo *client)
 
     if (strlen(client->current_room_name) == 0)
     {
-        sendErrorToClient(client->socket_fd, "You are not currently in any room.");
+        sendErrorToClient(client, "You are not currently in any room.");
         return;
     }
 
-    ChatRoom *room_being_left = findOrCreateChatRoom(client->current_room_name); // Should find existing
-    if (room_being_left)
+    if (client->current_room)
     {
-        notifyRoomOfClientAction(client, room_being_left, "left"); // Notify before actual removal
+        notifyRoomOfClientAction(client, client->current_room, "left"); // Notify before actual removal
     }
     // removeClientFromTheirRoom logs the leave and clears client->current_room_name
     removeClientFromTheirRoom(client);
-    sendSuccessToClient(client->socket_fd, "You have successfully left the room.");
+    sendSuccessToClient(client, "You have successfully left the room.");
 }
 
 // Handles a client's request to broadcast a message to their current room.
@@ -319,20 +415,20 @@ void handleBroadcastRequest(ClientInfo *client_sender, const char *message_conte
 
     if (strlen(client_sender->current_room_name) == 0)
     {
-        sendErrorToClient(client_sender->socket_fd, "You must be in a room to broadcast a message.");
+        sendErrorToClient(client_sender, "You must be in a room to broadcast a message.");
         return;
     }
     if (strlen(message_content) == 0 || strlen(message_content) >= MESSAGE_BUF_SIZE)
     {
-        sendErrorToClient(client_sender->socket_fd, "Invalid message content: Cannot be empty or too long.");
+        sendErrorToClient(client_sender, "Invalid message content: Cannot be empty or too long.");
         return;
     }
 
-    ChatRoom *current_room = findOrCreateChatRoom(client_sender->current_room_name); // Should find
+    ChatRoom *current_room = client_sender->current_room; // Only this client's thread changes it
     if (!current_room)
     {
-        // This indicates a server-side inconsistency if client->current_room_name is set but room not found.
-        sendErrorToClient(client_sender->socket_fd, "Error: Your current room seems to be invalid on the server.");
+        // This indicates a server-side inconsistency if client->current_room_name is set but no room is linked.
+        sendErrorToClient(client_sender, "Error: Your current room seems to be invalid on the server.");
         logServerEvent("ERROR", "Client %s in room '%s' which was not found during broadcast attempt.",
                        client_sender->username, client_sender->current_room_name);
         return;
@@ -350,7 +446,11 @@ void handleBroadcastRequest(ClientInfo *client_sender, const char *message_conte
     broadcast_msg.content[MESSAGE_BUF_SIZE - 1] = '\0';
 
     // Send to all members in the room (including the sender themselves, as per typical chat behavior)
-    broadcastMessageToRoomMembers(current_room, &broadcast_msg, NULL); // NULL for exclude_username means send to all
+    if (!publishRoomMessage(current_room, &broadcast_msg, NULL)) // NULL for exclude_username means send to all
+    {
+        sendErrorToClient(client_sender, "The server node hosting this room is unreachable. Message not sent.");
+        return;
+    }
 
     // Log the broadcast event (server-side)
     logEventBroadcast(client_sender->username, current_room->name, message_content);
@@ -359,7 +459,7 @@ void handleBroadcastRequest(ClientInfo *client_sender, const char *message_conte
     char confirmation_text[128];
     snprintf(confirmation_text, sizeof(confirmation_text), "Message sent to room '%s'", current_room->name);
     confirmation_text[sizeof(confirmation_text) - 1] = '\0';
-    sendSuccessToClient(client_sender->socket_fd, confirmation_text);
+    sendSuccessToClient(client_sender, confirmation_text);
 }
 
 // Handles a client's request to send a private message (whisper) to another user.
@@ -370,29 +470,17 @@ void handleWhisperRequest(ClientInfo *client_sender, const char *receiver_userna
 
     if (!isValidUsername(receiver_username_str))
     {
-        sendErrorToClient(client_sender->socket_fd, "Invalid recipient username format for whisper.");
+        sendErrorToClient(client_sender, "Invalid recipient username format for whisper.");
         return;
     }
     if (strlen(message_content) == 0 || strlen(message_content) >= MESSAGE_BUF_SIZE)
     {
-        sendErrorToClient(client_sender->socket_fd, "Invalid message content for whisper: Cannot be empty or too long.");
+        sendErrorToClient(client_sender, "Invalid message content for whisper: Cannot be empty or too long.");
         return;
     }
     if (strncmp(client_sender->username, receiver_username_str, USERNAME_BUF_SIZE) == 0)
     {
-        sendErrorToClient(client_sender->socket_fd, "You cannot whisper a message to yourself.");
-        return;
-    }
-
-    ClientInfo *receiver_client = NULL;
-    // Find the recipient client. Requires locking clients_list_mutex.
-    pthread_mutex_lock(&g_server_state->clients_list_mutex);
-    receiver_client = findClientByUsername(receiver_username_str); // This utility expects lock to be held
-    pthread_mutex_unlock(&g_server_state->clients_list_mutex);
-
-    if (!receiver_client || !receiver_client->is_active) // Check if found and if that client is still active
-    {
-        sendErrorToClient(client_sender->socket_fd, "Recipient user not found or is currently offline.");
+        sendErrorToClient(client_sender, "You cannot whisper a message to yourself.");
         return;
     }
 
@@ -407,30 +495,59 @@ void handleWhisperRequest(ClientInfo *client_sender, const char *receiver_userna
     strncpy(whisper_msg.content, message_content, MESSAGE_BUF_SIZE - 1);
     whisper_msg.content[MESSAGE_BUF_SIZE - 1] = '\0';
 
-    // Send the message to the recipient's socket
-    if (sendMessage(receiver_client->socket_fd, &whisper_msg))
+    // Find the recipient client; it stays retained until the whisper is queued.
+    ClientInfo *receiver_client = acquireClientByUsername(receiver_username_str);
+    if (!receiver_client) // Not found here: the recipient may be logged in on another node
+    {
+        int receiver_node = clusterFindUserNode(receiver_username_str);
+        if (receiver_node < 0)
+        {
+            sendErrorToClient(client_sender, "Recipient user not found or is currently offline.");
+            return;
+        }
+        if (!clusterForwardWhisper(&whisper_msg, receiver_node))
+        {
+            sendErrorToClient(client_sender, "Failed to deliver whisper message (the recipient's server node is unreachable).");
+            return;
+        }
+        char confirmation_text[128];
+        snprintf(confirmation_text, sizeof(confirmation_text), "Whisper successfully sent to %s", receiver_username_str);
+        sendSuccessToClient(client_sender, confirmation_text);
+        logEventWhisper(client_sender->username, receiver_username_str, message_content);
+        return;
+    }
+
+    // Queue the message for the recipient
+    if (queueMessageToClient(receiver_client, &whisper_msg))
     {
         char confirmation_text[128];
         snprintf(confirmation_text, sizeof(confirmation_text), "Whisper successfully sent to %s", receiver_username_str);
         confirmation_text[sizeof(confirmation_text) - 1] = '\0';
-        sendSuccessToClient(client_sender->socket_fd, confirmation_text);
+        sendSuccessToClient(client_sender, confirmation_text);
         logEventWhisper(client_sender->username, receiver_username_str, message_content); // Log full content for server record if desired, or preview
     }
     else
     {
-        sendErrorToClient(client_sender->socket_fd, "Failed to deliver whisper message (recipient connection issue or server error).");
-        logServerEvent("ERROR", "Failed to send whisper message from %s to %s via socket %d.",
+        sendErrorToClient(client_sender, "Failed to deliver whisper message (recipient connection issue or server error).");
+        logServerEvent("ERROR", "Failed to queue whisper message from %s to %s (fd %d).",
                        client_sender->username, receiver_username_str, receiver_client->socket_fd);
     }
+    releaseClient(receiver_client);
 }
 
 // Broadcasts a message to all active members of a given room.
 // Can optionally exclude one user (typically the sender of a broadcast or notifier of an action).
+// The message is encoded at most once per wire protocol and the same buffer is queued to every member.
 void broadcastMessageToRoomMembers(ChatRoom *room, const Message *message_to_send, const char *exclude_username)
 {
     if (!room || !message_to_send || !g_server_state)
         return;
 
+    OutboundBuffer *encoded_by_protocol[WIRE_PROTOCOL_LATEST + 1] = {NULL}; // Encoded lazily, on first member that needs it
+    int recipient_count = 0;
+    struct timespec fanout_start, fanout_end;
+    clock_gettime(CLOCK_MONOTONIC, &fanout_start);
+
     pthread_mutex_lock(&room->room_lock); // Lock the room to safely iterate its members
     for (int i = 0; i < room->member_count; ++i)
     {
@@ -441,15 +558,197 @@ void broadcastMessageToRoomMembers(ChatRoom *room, const Message *message_to_sen
             {
                 continue; // Skip the excluded user
             }
-            // Send the message. sendMessage handles errors internally (e.g., client disconnected).
-            if (!sendMessage(member->socket_fd, message_to_send))
-            {
-                // Log if sending to a specific member failed, might indicate that member disconnected abruptly.
-                // The main handler for that client will eventually clean them up.
-                // logServerEvent("DEBUG", "Failed to send broadcast/notification to %s in room %s (socket %d). Client might have disconnected.",
-                //                member->username, room->name, member->socket_fd);
-            }
+            int protocol = (member->wire_protocol == WIRE_PROTOCOL_FRAMED) ? WIRE_PROTOCOL_FRAMED : WIRE_PROTOCOL_FIXED;
+            if (!encoded_by_protocol[protocol])
+                encoded_by_protocol[protocol] = encodeOutboundMessage(message_to_send, protocol);
+            // Queuing never blocks; a member that is not keeping up is handled by the slow-consumer policy.
+            if (encoded_by_protocol[protocol])
+                enqueueOutboundBuffers(member, &encoded_by_protocol[protocol], 1, 0);
+            ++recipient_count;
         }
     }
     pthread_mutex_unlock(&room->room_lock);
+
+    clock_gettime(CLOCK_MONOTONIC, &fanout_end);
+    long long fanout_us = (long long)(fanout_end.tv_sec - fanout_start.tv_sec) * 1000000LL +
+                          (fanout_end.tv_nsec - fanout_start.tv_nsec) / 1000;
+    metricsRecordBroadcastFanout((unsigned long long)(fanout_us > 0 ? fanout_us : 0), recipient_count);
+
+    for (int p = 0; p <= WIRE_PROTOCOL_LATEST; ++p)
+        releaseOutboundBuffer(encoded_by_protocol[p]);
+}
+
+
+// Sends a room message to its members on every node. Without a cluster, and on the node owning
+// the room, local members get it directly and every node with remote members gets one copy.
+// Other nodes hand the message to the owner, which fans it out, so all members see a room's
+// messages in the same order.
+// Returns 1 on success, 0 if the owning node cannot be reached.
+int publishRoomMessage(ChatRoom *room, const Message *message_to_send, const char *exclude_username)
+{
+    if (!room || !message_to_send)
+        return 0;
+    if (clusterRoomOwner(room->name) != clusterLocalNodeId())
+        return clusterPublishToRoomOwner(message_to_send, exclude_username);
+
+    broadcastMessageToRoomMembers(room, message_to_send, exclude_username);
+    clusterDeliverToMemberNodes(room, message_to_send, exclude_username);
+    return 1;
+}
+
+// Looks a room up by name and sends a message on to its members, under the room's stripe lock
+// (held for reading, so the room cannot be closed meanwhile). On its owning node the message
+// also goes to the other member nodes when fan_out is set.
+static void passMessageToIndexedRoom(const char *room_name, const Message *message_to_send, const char *exclude_username, int fan_out)
+{
+    if (!room_name || !message_to_send || !g_server_state)
+        return;
+    NameIndex *room_index = &g_server_state->room_name_index;
+    pthread_rwlock_t *stripe_lock = nameIndexLockFor(room_index, room_name);
+    pthread_rwlock_rdlock(stripe_lock);
+    ChatRoom *room = nameIndexLookupLocked(room_index, room_name);
+    if (room && fan_out && clusterRoomOwner(room_name) == clusterLocalNodeId())
+        publishRoomMessage(room, message_to_send, exclude_username);
+    else if (room)
+        broadcastMessageToRoomMembers(room, message_to_send, exclude_username);
+    pthread_rwlock_unlock(stripe_lock);
+}
+
+// Delivers a message fanned out by the room's owning node to this node's members of the room.
+void deliverToLocalRoomMembers(const char *room_name, const Message *message_to_send, const char *exclude_username)
+{
+    passMessageToIndexedRoom(room_name, message_to_send, exclude_username, 0);
+}
+
+// Owner: publishes a message another node handed over to every member of the room.
+void fanOutPublishedRoomMessage(const char *room_name, const Message *message_to_send, const char *exclude_username)
+{
+    passMessageToIndexedRoom(room_name, message_to_send, exclude_username, 1);
+}
+
+// Adds a user logged in on another node to a room this node owns, creating the room if needed.
+// Returns 1 on success (or already a member), 0 if the room is full, -1 if it could not be created.
+int admitRemoteRoomMember(const char *username, int node_id, const char *room_name)
+{
+    if (!g_server_state || !isValidUsername(username) || !isValidRoomName(room_name))
+        return -1;
+
+    NameIndex *room_index = &g_server_state->room_name_index;
+    pthread_rwlock_t *stripe_lock = nameIndexLockFor(room_index, room_name);
+    pthread_rwlock_wrlock(stripe_lock);
+    int room_created = 0;
+    ChatRoom *room = findOrCreateRoomLocked(room_name, &room_created);
+    if (!room)
+    {
+        pthread_rwlock_unlock(stripe_lock);
+        logServerEvent("WARNING", "Could not create room '%s' for %s of node %d: Maximum room limit (%d) reached.",
+                       room_name, username, node_id, g_server_state->max_rooms);
+        return -1;
+    }
+
+    int result = 1;
+    pthread_mutex_lock(&room->room_lock);
+    int already_member = 0;
+    for (int i = 0; i < room->remote_member_count; ++i)
+    {
+        if (strcmp(room->remote_members[i].username, username) == 0)
+        {
+            room->remote_members[i].node_id = node_id; // Same user, possibly reconnected elsewhere
+            already_member = 1;
+            break;
+        }
+    }
+    if (!already_member && room->member_count + room->remote_member_count >= MAX_MEMBERS_PER_ROOM)
+    {
+        result = 0;
+    }
+    else if (!already_member)
+    {
+        RemoteRoomMember *member = &room->remote_members[room->remote_member_count++];
+        strncpy(member->username, username, USERNAME_BUF_SIZE - 1);
+        member->username[USERNAME_BUF_SIZE - 1] = '\0';
+        member->node_id = node_id;
+    }
+    pthread_mutex_unlock(&room->room_lock);
+    pthread_rwlock_unlock(stripe_lock);
+
+    if (room_created)
+        logEventRoomCreated(room_name);
+    if (result > 0 && !already_member)
+        logServerEvent("CLUSTER", "User %s of node %d joined room '%s'.", username, node_id, room_name);
+    else if (result == 0)
+        logServerEvent("INFO", "User %s of node %d failed to join room '%s': Room is full (capacity %d).",
+                       username, node_id, room_name, MAX_MEMBERS_PER_ROOM);
+    return result;
+}
+
+// Removes a user of another node from a room this node owns; the last member closes the room.
+void removeRemoteRoomMember(const char *username, int node_id, const char *room_name)
+{
+    if (!g_server_state || !username || !room_name)
+        return;
+
+    NameIndex *room_index = &g_server_state->room_name_index;
+    pthread_rwlock_t *stripe_lock = nameIndexLockFor(room_index, room_name);
+    pthread_rwlock_wrlock(stripe_lock);
+    ChatRoom *room = nameIndexLookupLocked(room_index, room_name);
+    if (!room)
+    {
+        pthread_rwlock_unlock(stripe_lock);
+        return;
+    }
+
+    int removed = 0;
+    pthread_mutex_lock(&room->room_lock);
+    for (int i = 0; i < room->remote_member_count; ++i)
+    {
+        if (room->remote_members[i].node_id == node_id && strcmp(room->remote_members[i].username, username) == 0)
+        {
+            room->remote_members[i] = room->remote_members[--room->remote_member_count];
+            removed = 1;
+            break;
+        }
+    }
+    int room_now_empty = (room->member_count == 0 && room->remote_member_count == 0);
+    pthread_mutex_unlock(&room->room_lock);
+    if (room_now_empty)
+        nameIndexRemoveLocked(room_index, &room->name_index_entry);
+    pthread_rwlock_unlock(stripe_lock);
+
+    if (removed)
+        logServerEvent("CLUSTER", "User %s of node %d left room '%s'.", username, node_id, room_name);
+    if (room_now_empty)
+    {
+        releaseRoomSlot(room);
+        logServerEvent("INFO", "Room '%s' is empty and was closed.", room_name);
+    }
+}
+
+// Drops every member of a node from the rooms this node owns, e.g. after its link closed.
+// The node lists them again when its link comes back (see server/cluster.c).
+void removeRemoteRoomMembersOfNode(int node_id)
+{
+    if (!g_server_state || !g_server_state->chat_rooms)
+        return;
+    for (int slot = 0; slot < g_server_state->max_rooms; ++slot)
+    {
+        ChatRoom *room = &g_server_state->chat_rooms[slot];
+        char room_name[ROOM_NAME_BUF_SIZE];
+        char usernames[MAX_MEMBERS_PER_ROOM][USERNAME_BUF_SIZE];
+        int user_count = 0;
+
+        // Collect under the room lock, then remove with the usual stripe-then-room locking
+        pthread_mutex_lock(&room->room_lock);
+        strncpy(room_name, room->name, ROOM_NAME_BUF_SIZE - 1);
+        room_name[ROOM_NAME_BUF_SIZE - 1] = '\0';
+        for (int i = 0; i < room->remote_member_count; ++i)
+        {
+            if (room->remote_members[i].node_id == node_id)
+                memcpy(usernames[user_count++], room->remote_members[i].username, USERNAME_BUF_SIZE);
+        }
+        pthread_mutex_unlock(&room->room_lock);
+
+        for (int i = 0; i < user_count; ++i)
+            removeRemoteRoomMember(usernames[i], node_id, room_name);
+    }
 }
\ No newline at end of file
@@ -1,29 +1,29 @@
 #include "common.h"
 
-// Finds an active client by username.
-// IMPORTANT: Assumes g_server_state->clients_list_mutex is HELD by the caller
-// to ensure thread-safe access to the shared client list.
-ClientInfo *findClientByUsername(const char *username_to_find)
+// Finds an active client by username through the username index.
+// The client is returned with an extra reference (retainClient), so it stays valid after the
+// index lock is dropped; callers must pair it with releaseClient. Returns NULL if not found.
+ClientInfo *acquireClientByUsername(const char *username_to_find)
 {
     if (!username_to_find || !g_server_state) // Basic validation
         return NULL;
 
-    for (int i = 0; i < MAX_SERVER_CLIENTS; i++)
-    {
-        if (g_server_state->connected_clients[i] != NULL &&
-            g_server_state->connected_clients[i]->is_active && // Only consider active (logged-in) clients
-            strncmp(g_server_state->connected_clients[i]->username, username_to_find, USERNAME_BUF_SIZE) == 0)
-        {
-            return g_server_state->connected_clients[i]; // Client found
-        }
-    }
-    return NULL; // Client not found
+    NameIndex *client_index = &g_server_state->client_name_index;
+    pthread_rwlock_t *stripe_lock = nameIndexLockFor(client_index, username_to_find);
+    pthread_rwlock_rdlock(stripe_lock);
+    ClientInfo *found_client = nameIndexLookupLocked(client_index, username_to_find);
+    if (found_client && found_client->is_active) // Only consider active (logged-in) clients
+        retainClient(found_client);
+    else
+        found_client = NULL;
+    pthread_rwlock_unlock(stripe_lock);
+    return found_client;
 }
 
 // Sends a standardized error message to the client.
-void sendErrorToClient(int client_socket_fd, const char *error_message)
+void sendErrorToClient(ClientInfo *client, const char *error_message)
 {
-    if (client_socket_fd < 0 || !error_message)
+    if (!client || !error_message)
         return;
 
     Message err_msg;
@@ -35,13 +35,13 @@ void sendErrorToClient(int client_socket_fd, const char *error_message)
     err_msg.sender[USERNAME_BUF_SIZE - 1] = '\0';
     err_msg.content[MESSAGE_BUF_SIZE - 1] = '\0';
 
-    sendMessage(client_socket_fd, &err_msg); // sendMessage handles actual send errors
+    queueMessageToClient(client, &err_msg); // The queue handles slow or disconnected clients
 }
 
 // Sends a standardized success message to the client.
-void sendSuccessToClient(int client_socket_fd, const char *success_message)
+void sendSuccessToClient(ClientInfo *client, const char *success_message)
 {
-    if (client_socket_fd < 0 || !success_message)
+    if (!client || !success_message)
         return;
 
     Message suc_msg;
@@ -52,14 +52,14 @@ void sendSuccessToClient(int client_socket_fd, const char *success_message)
     suc_msg.sender[USERNAME_BUF_SIZE - 1] = '\0';
     suc_msg.content[MESSAGE_BUF_SIZE - 1] = '\0';
 
-    sendMessage(client_socket_fd, &suc_msg);
+    queueMessageToClient(client, &suc_msg);
 }
 
 // Sends a success message that includes room context to the client.
 // Used, for example, when confirming joining a room.
-void sendSuccessWithRoomToClient(int client_socket_fd, const char *message, const char *room_name)
+void sendSuccessWithRoomToClient(ClientInfo *client, const char *message, const char *room_name)
 {
-    if (client_socket_fd < 0 || !message)
+    if (!client || !message)
         return;
 
     Message suc_msg;
@@ -75,13 +75,13 @@ void sendSuccessWithRoomToClient(int client_socket_fd, const char *message, cons
     suc_msg.sender[USERNAME_BUF_SIZE - 1] = '\0';
     suc_msg.content[MESSAGE_BUF_SIZE - 1] = '\0';
 
-    sendMessage(client_socket_fd, &suc_msg);
+    queueMessageToClient(client, &suc_msg);
 }
 
 // Sends a general server notification message to the client.
-void sendServerNotificationToClient(int client_socket_fd, const char *notification_message, const char *room_context)
+void sendServerNotificationToClient(ClientInfo *client, const char *notification_message, const char *room_context)
 {
-    if (client_socket_fd < 0 || !notification_message)
+    if (!client || !notification_message)
         return;
 
     Message notif_msg;
@@ -97,7 +97,7 @@ void sendServerNotificationToClient(int client_socket_fd, const char *notificati
     notif_msg.sender[USERNAME_BUF_SIZE - 1] = '\0';
     notif_msg.content[MESSAGE_BUF_SIZE - 1] = '\0';
 
-    sendMessage(client_socket_fd, &notif_msg);
+    queueMessageToClient(client, &notif_msg);
 }
 
 // Generates a new filename to resolve collisions, e.g., "file.txt" -> "file_1.txt".
@@ -0,0 +1,273 @@
+#include "pool.h"
+#include <stdlib.h> // For malloc, calloc, free
+#include <string.h> // For memset
+
+// Counter slots in PoolThreadCache.counters and MemoryPool.retired
+enum
+{
+    POOL_COUNTER_CACHE_HIT,
+    POOL_COUNTER_SHARED_HIT,
+    POOL_COUNTER_SLAB_CARVE,
+    POOL_COUNTER_RELEASE
+};
+
+#define POOL_SLAB_HEADER_SIZE 16 // Slab link, padded so objects stay 16-byte aligned
+
+// Free objects of one pool owned by one thread. Only the owner touches the free list;
+// the counters are also read (atomically) by readMemoryPoolStats.
+typedef struct PoolThreadCache
+{
+    MemoryPool *pool;
+    void *free_list;
+    int free_count;
+    unsigned long long counters[4];
+    struct PoolThreadCache *next; // In pool->caches, under pool->lock
+} PoolThreadCache;
+
+// Pools get a cache slot on first use; slot 0 means "not registered yet", -1 "no slot left".
+static MemoryPool *registered_pools[POOL_MAX_POOLS + 1];
+static int registered_pool_count = 0;
+static pthread_mutex_t pool_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread PoolThreadCache *thread_pool_caches[POOL_MAX_POOLS + 1];
+static pthread_key_t thread_cache_exit_key;
+static pthread_once_t thread_cache_key_once = PTHREAD_ONCE_INIT;
+
+static void **objectLink(void *object)
+{
+    return (void **)object;
+}
+
+static void countCacheEvent(PoolThreadCache *cache, int counter)
+{
+    __atomic_fetch_add(&cache->counters[counter], 1, __ATOMIC_RELAXED); // Uncontended: owner only
+}
+
+// Runs at thread exit: hands the thread's cached objects and counters back to their pools.
+static void flushThreadCaches(void *unused_value)
+{
+    (void)unused_value;
+    for (int slot = 1; slot <= POOL_MAX_POOLS; ++slot)
+    {
+        PoolThreadCache *cache = thread_pool_caches[slot];
+        if (!cache)
+            continue;
+        MemoryPool *pool = cache->pool;
+        pthread_mutex_lock(&pool->lock);
+        while (cache->free_list)
+        {
+            void *object = cache->free_list;
+            cache->free_list = *objectLink(object);
+            *objectLink(object) = pool->free_list;
+            pool->free_list = object;
+            pool->free_count++;
+        }
+        for (int c = 0; c < 4; ++c)
+            pool->retired[c] += cache->counters[c];
+        for (PoolThreadCache **link = &pool->caches; *link; link = &(*link)->next)
+        {
+            if (*link == cache)
+            {
+                *link = cache->next;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&pool->lock);
+        free(cache);
+        thread_pool_caches[slot] = NULL;
+    }
+}
+
+static void createThreadCacheKey(void)
+{
+    pthread_key_create(&thread_cache_exit_key, flushThreadCaches);
+}
+
+// Gives the pool a cache slot. Returns the slot, or -1 if every slot is taken.
+static int registerMemoryPool(MemoryPool *pool)
+{
+    pthread_mutex_lock(&pool_registry_lock);
+    int slot = pool->cache_slot;
+    if (slot == 0)
+    {
+        slot = (registered_pool_count < POOL_MAX_POOLS) ? ++registered_pool_count : -1;
+        if (slot > 0)
+            registered_pools[slot] = pool;
+        __atomic_store_n(&pool->cache_slot, slot, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&pool_registry_lock);
+    return slot;
+}
+
+// Returns the calling thread's cache for the pool, creating it on first use,
+// or NULL if the thread has to use the shared free list directly.
+static PoolThreadCache *threadCacheFor(MemoryPool *pool)
+{
+    int slot = __atomic_load_n(&pool->cache_slot, __ATOMIC_ACQUIRE);
+    if (slot == 0)
+        slot = registerMemoryPool(pool);
+    if (slot < 0)
+        return NULL;
+    PoolThreadCache *cache = thread_pool_caches[slot];
+    if (cache)
+        return cache;
+
+    pthread_once(&thread_cache_key_once, createThreadCacheKey);
+    cache = calloc(1, sizeof(PoolThreadCache));
+    if (!cache)
+        return NULL;
+    cache->pool = pool;
+    pthread_setspecific(thread_cache_exit_key, (void *)1); // Any non-NULL value runs the destructor
+    pthread_mutex_lock(&pool->lock);
+    cache->next = pool->caches;
+    pool->caches = cache;
+    pthread_mutex_unlock(&pool->lock);
+    thread_pool_caches[slot] = cache;
+    return cache;
+}
+
+// Allocates a slab and puts all of its objects on the shared free list. pool->lock must be HELD.
+// Returns 1 on success, 0 if malloc failed.
+static int carveSlabLocked(MemoryPool *pool)
+{
+    size_t slab_bytes = POOL_SLAB_BYTES;
+    if (slab_bytes < POOL_SLAB_HEADER_SIZE + pool->object_size)
+        slab_bytes = POOL_SLAB_HEADER_SIZE + pool->object_size;
+    unsigned char *slab = malloc(slab_bytes);
+    if (!slab)
+        return 0;
+    *objectLink(slab) = pool->slabs;
+    pool->slabs = slab;
+    pool->slab_count++;
+
+    size_t objects = (slab_bytes - POOL_SLAB_HEADER_SIZE) / pool->object_size;
+    for (size_t i = objects; i-- > 0;) // Lowest address ends up first on the list
+    {
+        void *object = slab + POOL_SLAB_HEADER_SIZE + i * pool->object_size;
+        *objectLink(object) = pool->free_list;
+        pool->free_list = object;
+    }
+    pool->free_count += objects;
+    return 1;
+}
+
+void *poolAllocate(MemoryPool *pool)
+{
+    PoolThreadCache *cache = threadCacheFor(pool);
+    if (cache && cache->free_list)
+    {
+        void *object = cache->free_list;
+        cache->free_list = *objectLink(object);
+        cache->free_count--;
+        countCacheEvent(cache, POOL_COUNTER_CACHE_HIT);
+        return object;
+    }
+
+    // Cache empty: take one object for the caller and a batch for the cache under one lock
+    pthread_mutex_lock(&pool->lock);
+    int counter = POOL_COUNTER_SHARED_HIT;
+    if (!pool->free_list)
+    {
+        if (!carveSlabLocked(pool))
+        {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        counter = POOL_COUNTER_SLAB_CARVE;
+    }
+    void *object = pool->free_list;
+    pool->free_list = *objectLink(object);
+    pool->free_count--;
+    if (cache)
+    {
+        while (pool->free_list && cache->free_count < POOL_REFILL_BATCH)
+        {
+            void *cached = pool->free_list;
+            pool->free_list = *objectLink(cached);
+            pool->free_count--;
+            *objectLink(cached) = cache->free_list;
+            cache->free_list = cached;
+            cache->free_count++;
+        }
+        countCacheEvent(cache, counter);
+    }
+    else
+    {
+        pool->retired[counter]++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return object;
+}
+
+void poolRelease(MemoryPool *pool, void *object)
+{
+    if (!object)
+        return;
+    PoolThreadCache *cache = threadCacheFor(pool);
+    if (!cache)
+    {
+        pthread_mutex_lock(&pool->lock);
+        *objectLink(object) = pool->free_list;
+        pool->free_list = object;
+        pool->free_count++;
+        pool->retired[POOL_COUNTER_RELEASE]++;
+        pthread_mutex_unlock(&pool->lock);
+        return;
+    }
+
+    *objectLink(object) = cache->free_list;
+    cache->free_list = object;
+    cache->free_count++;
+    countCacheEvent(cache, POOL_COUNTER_RELEASE);
+    if (cache->free_count <= POOL_THREAD_CACHE_LIMIT)
+        return;
+
+    // A thread that mostly frees (e.g., objects allocated elsewhere) hands half its cache back
+    void *batch_head = cache->free_list;
+    void *batch_tail = batch_head;
+    for (int i = 1; i < POOL_THREAD_CACHE_LIMIT / 2; ++i)
+        batch_tail = *objectLink(batch_tail);
+    cache->free_list = *objectLink(batch_tail);
+    cache->free_count -= POOL_THREAD_CACHE_LIMIT / 2;
+
+    pthread_mutex_lock(&pool->lock);
+    *objectLink(batch_tail) = pool->free_list;
+    pool->free_list = batch_head;
+    pool->free_count += POOL_THREAD_CACHE_LIMIT / 2;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int readMemoryPoolStats(MemoryPoolStats *stats, int max_pools)
+{
+    pthread_mutex_lock(&pool_registry_lock);
+    int count = registered_pool_count < max_pools ? registered_pool_count : max_pools;
+    for (int i = 0; i < count; ++i)
+    {
+        MemoryPool *pool = registered_pools[i + 1];
+        unsigned long long totals[4];
+        pthread_mutex_lock(&pool->lock);
+        memcpy(totals, pool->retired, sizeof(totals));
+        for (PoolThreadCache *cache = pool->caches; cache; cache = cache->next)
+        {
+            for (int c = 0; c < 4; ++c)
+                totals[c] += __atomic_load_n(&cache->counters[c], __ATOMIC_RELAXED);
+        }
+        size_t slab_bytes = POOL_SLAB_BYTES;
+        if (slab_bytes < POOL_SLAB_HEADER_SIZE + pool->object_size)
+            slab_bytes = POOL_SLAB_HEADER_SIZE + pool->object_size;
+        memset(&stats[i], 0, sizeof(stats[i]));
+        stats[i].name = pool->name;
+        stats[i].object_size = pool->object_size;
+        stats[i].slab_count = pool->slab_count;
+        stats[i].bytes_reserved = pool->slab_count * slab_bytes;
+        pthread_mutex_unlock(&pool->lock);
+
+        stats[i].cache_hits = totals[POOL_COUNTER_CACHE_HIT];
+        stats[i].shared_hits = totals[POOL_COUNTER_SHARED_HIT];
+        stats[i].slab_carves = totals[POOL_COUNTER_SLAB_CARVE];
+        stats[i].releases = totals[POOL_COUNTER_RELEASE];
+        stats[i].allocations = stats[i].cache_hits + stats[i].shared_hits + stats[i].slab_carves;
+    }
+    pthread_mutex_unlock(&pool_registry_lock);
+    return count;
+}
@@ -0,0 +1,63 @@
+#ifndef SHARED_POOL_H
+#define SHARED_POOL_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+// Fixed-size object pools.
+// Objects are carved from slabs and recycled through free lists, so a steady load stops
+// calling malloc()/free() once the pools have grown to its working set. Each thread keeps a
+// small cache of free objects per pool; only refilling or draining a cache takes the pool's
+// lock, a batch at a time. Pools are static and their slabs live as long as the process, since
+// other threads' caches may point into them until those threads exit.
+
+#define POOL_MAX_POOLS 16          // Pools a process may use simultaneously
+#define POOL_THREAD_CACHE_LIMIT 64 // Free objects a thread holds per pool before handing half back
+#define POOL_REFILL_BATCH 32       // Objects moved from the shared free list to a thread cache at once
+#define POOL_SLAB_BYTES 65536      // Slab size (a slab holds at least one object)
+
+struct PoolThreadCache; // Defined in pool.c
+
+typedef struct MemoryPool
+{
+    const char *name;   // Shown in statistics
+    size_t object_size; // Rounded up to 16 bytes
+    int cache_slot;     // Index of this pool's per-thread cache, 0 until first use
+
+    pthread_mutex_t lock;            // Protects everything below
+    void *free_list;                 // Shared free objects, linked through their first word
+    size_t free_count;               // Objects on free_list
+    void *slabs;                     // Slabs, linked through their first word
+    size_t slab_count;               // Slabs allocated so far
+    struct PoolThreadCache *caches;  // Live thread caches, for statistics
+    unsigned long long retired[4];   // Counters of thread caches that have gone away
+} MemoryPool;
+
+// Static initializer: static MemoryPool pool = MEMORY_POOL_INITIALIZER("name", sizeof(Thing));
+#define MEMORY_POOL_INITIALIZER(pool_name, size) \
+    {(pool_name), (((size) + 15) & ~(size_t)15), 0, PTHREAD_MUTEX_INITIALIZER, NULL, 0, NULL, 0, NULL, {0, 0, 0, 0}}
+
+// Hit counters of one pool. allocations = cache_hits + refills from the shared list or new slabs.
+typedef struct MemoryPoolStats
+{
+    const char *name;
+    size_t object_size;
+    unsigned long long allocations; // poolAllocate calls that returned an object
+    unsigned long long cache_hits;  // Served from the calling thread's cache without locking
+    unsigned long long shared_hits; // Served after refilling the cache from the shared free list
+    unsigned long long slab_carves; // Served after carving a new slab (the only case that calls malloc)
+    unsigned long long releases;    // poolRelease calls
+    size_t slab_count;
+    size_t bytes_reserved;          // Memory held in slabs
+} MemoryPoolStats;
+
+// Returns an uninitialized object of the pool's size, or NULL if memory is exhausted.
+void *poolAllocate(MemoryPool *pool);
+
+// Gives an object back; any thread may release objects allocated by another.
+void poolRelease(MemoryPool *pool, void *object);
+
+// Fills stats with the counters of every pool used so far and returns their number (at most max_pools).
+int readMemoryPoolStats(MemoryPoolStats *stats, int max_pools);
+
+#endif // SHARED_POOL_H
@@ -51,4 +51,29 @@ typedef struct Message
     size_t file_size;                 // File size for file transfers
 } Message;
 
+// Wire protocol versions, negotiated at login.
+// The client advertises the highest version it speaks in MSG_LOGIN.file_size (old clients send 0);
+// the server answers with the agreed version in MSG_LOGIN_SUCCESS.file_size (old servers send 0).
+// The login exchange itself always travels as fixed-size structs so old and new peers interoperate.
+#define WIRE_PROTOCOL_FIXED 0  // Whole Message struct per message (original format)
+#define WIRE_PROTOCOL_FRAMED 1 // Length-prefixed frames carrying only the fields a message type uses
+#define WIRE_PROTOCOL_LATEST WIRE_PROTOCOL_FRAMED
+
+// Framed format: [u16 body length, big endian][body]
+// Body: [u8 protocol version][u8 MessageType][u8 field mask], then each field whose mask bit is set,
+// in bit order. Strings are [u16 length, big endian][bytes, no terminator]; file_size is [u64 big endian].
+#define FRAME_HEADER_SIZE 2
+#define FRAME_FIELD_SENDER (1u << 0)
+#define FRAME_FIELD_RECEIVER (1u << 1)
+#define FRAME_FIELD_ROOM (1u << 2)
+#define FRAME_FIELD_CONTENT (1u << 3)
+#define FRAME_FIELD_FILENAME (1u << 4)
+#define FRAME_FIELD_FILE_SIZE (1u << 5)
+#define FRAME_FIELD_ALL 0x3Fu
+
+#define FRAME_MAX_BODY_SIZE (3 + 5 * 2 + 2 * USERNAME_BUF_SIZE + ROOM_NAME_BUF_SIZE + MESSAGE_BUF_SIZE + FILENAME_BUF_SIZE + 8)
+#define FRAME_MAX_SIZE (FRAME_HEADER_SIZE + FRAME_MAX_BODY_SIZE)
+// Largest unit either wire format can deliver for one message (sizes receive buffers)
+#define WIRE_UNIT_MAX_SIZE (sizeof(Message) > FRAME_MAX_SIZE ? sizeof(Message) : FRAME_MAX_SIZE)
+
 #endif // PROTOCOL_H
\ No newline at end of file
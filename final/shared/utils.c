@@ -7,55 +7,298 @@
 #include <stdio.h>      // For perror (though generally avoided here for library-style functions)
 #include <errno.h>      // For errno
 
-// Sends a Message struct over the socket.
+#define WIRE_PROTOCOL_TRACKED_FDS 65600 // Sockets above this fd always use WIRE_PROTOCOL_FIXED
+
+// Wire protocol per socket fd (0 = WIRE_PROTOCOL_FIXED). Written once per connection at login.
+static volatile unsigned char socket_wire_protocols[WIRE_PROTOCOL_TRACKED_FDS];
+
+// Sends exactly len bytes, retrying on short sends and EINTR.
+// Returns 1 on success, 0 on failure (errno is left for the caller, e.g. EPIPE).
+static int sendAllBytes(int socket_fd, const void *data, size_t len)
+{
+    const char *send_ptr = (const char *)data;
+    size_t total_sent = 0;
+    while (total_sent < len)
+    {
+        ssize_t bytes_sent = send(socket_fd, send_ptr + total_sent, len - total_sent, 0);
+        if (bytes_sent < 0 && errno == EINTR)
+            continue; // Interrupted by a signal before anything was sent, retry
+        if (bytes_sent <= 0)
+            return 0; // Send error
+        total_sent += (size_t)bytes_sent;
+    }
+    return 1;
+}
+
+// Receives exactly len bytes; a unit may arrive split across several TCP segments.
+// Returns 1 on success, 0 if the peer closed the connection or an error occurred.
+static int receiveAllBytes(int socket_fd, void *data, size_t len)
+{
+    char *recv_ptr = (char *)data;
+    size_t total_received = 0;
+    while (total_received < len)
+    {
+        ssize_t bytes_received = recv(socket_fd, recv_ptr + total_received, len - total_received, 0);
+        if (bytes_received < 0 && errno == EINTR)
+            continue;
+        if (bytes_received <= 0)
+            return 0; // Connection closed by peer or error
+        total_received += (size_t)bytes_received;
+    }
+    return 1;
+}
+
+void setSocketWireProtocol(int socket_fd, int protocol_version)
+{
+    if (socket_fd >= 0 && socket_fd < WIRE_PROTOCOL_TRACKED_FDS)
+        socket_wire_protocols[socket_fd] = (unsigned char)protocol_version;
+}
+
+int getSocketWireProtocol(int socket_fd)
+{
+    if (socket_fd < 0 || socket_fd >= WIRE_PROTOCOL_TRACKED_FDS)
+        return WIRE_PROTOCOL_FIXED;
+    return socket_wire_protocols[socket_fd];
+}
+
+// Fields each message type actually uses; everything else is left out of a frame.
+static unsigned int frameFieldsForType(MessageType type)
+{
+    switch (type)
+    {
+    case MSG_LOGIN:
+    case MSG_LEAVE_ROOM:
+    case MSG_DISCONNECT:
+        return FRAME_FIELD_SENDER;
+    case MSG_JOIN_ROOM:
+        return FRAME_FIELD_SENDER | FRAME_FIELD_ROOM;
+    case MSG_BROADCAST:
+        return FRAME_FIELD_SENDER | FRAME_FIELD_ROOM | FRAME_FIELD_CONTENT;
+    case MSG_WHISPER:
+        return FRAME_FIELD_SENDER | FRAME_FIELD_RECEIVER | FRAME_FIELD_CONTENT;
+    case MSG_FILE_TRANSFER_REQUEST:
+    case MSG_FILE_TRANSFER_DATA:
+        return FRAME_FIELD_SENDER | FRAME_FIELD_RECEIVER | FRAME_FIELD_FILENAME | FRAME_FIELD_FILE_SIZE;
+    case MSG_LOGIN_SUCCESS:
+    case MSG_LOGIN_FAILURE:
+        return FRAME_FIELD_CONTENT | FRAME_FIELD_FILE_SIZE;
+    case MSG_FILE_TRANSFER_ACCEPT:
+    case MSG_FILE_TRANSFER_REJECT:
+        return FRAME_FIELD_CONTENT | FRAME_FIELD_FILENAME;
+    case MSG_ERROR:
+    case MSG_SUCCESS:
+    case MSG_SERVER_NOTIFICATION:
+        return FRAME_FIELD_SENDER | FRAME_FIELD_ROOM | FRAME_FIELD_CONTENT;
+    default:
+        return FRAME_FIELD_ALL; // Unknown type: carry everything
+    }
+}
+
+static void putUint16(unsigned char *out, size_t value)
+{
+    out[0] = (unsigned char)((value >> 8) & 0xFF);
+    out[1] = (unsigned char)(value & 0xFF);
+}
+
+static size_t getUint16(const unsigned char *in)
+{
+    return ((size_t)in[0] << 8) | (size_t)in[1];
+}
+
+// Appends a string field ([u16 length][bytes]); returns the new write offset or 0 on overflow.
+static size_t putStringField(unsigned char *out, size_t offset, size_t out_size, const char *value, size_t value_buf_size)
+{
+    size_t len = strnlen(value, value_buf_size - 1);
+    if (offset + 2 + len > out_size)
+        return 0;
+    putUint16(out + offset, len);
+    memcpy(out + offset + 2, value, len);
+    return offset + 2 + len;
+}
+
+// Reads a string field into dest (null-terminated); returns the new read offset or 0 if malformed.
+static size_t getStringField(const unsigned char *in, size_t offset, size_t in_len, char *dest, size_t dest_buf_size)
+{
+    if (offset + 2 > in_len)
+        return 0;
+    size_t len = getUint16(in + offset);
+    if (len > dest_buf_size - 1 || offset + 2 + len > in_len)
+        return 0;
+    memcpy(dest, in + offset + 2, len);
+    dest[len] = '\0';
+    return offset + 2 + len;
+}
+
+size_t encodeMessageFrame(const Message *msg, unsigned char *out, size_t out_size)
+{
+    if (!msg || !out || out_size < FRAME_HEADER_SIZE + 3)
+        return 0;
+
+    // Only fields the type uses, and of those only the ones with a value.
+    unsigned int fields = frameFieldsForType(msg->type);
+    if (msg->sender[0] == '\0')
+        fields &= ~FRAME_FIELD_SENDER;
+    if (msg->receiver[0] == '\0')
+        fields &= ~FRAME_FIELD_RECEIVER;
+    if (msg->room[0] == '\0')
+        fields &= ~FRAME_FIELD_ROOM;
+    if (msg->content[0] == '\0')
+        fields &= ~FRAME_FIELD_CONTENT;
+    if (msg->filename[0] == '\0')
+        fields &= ~FRAME_FIELD_FILENAME;
+    if (msg->file_size == 0)
+        fields &= ~FRAME_FIELD_FILE_SIZE;
+
+    size_t offset = FRAME_HEADER_SIZE;
+    out[offset++] = WIRE_PROTOCOL_FRAMED;
+    out[offset++] = (unsigned char)msg->type;
+    out[offset++] = (unsigned char)fields;
+    if ((fields & FRAME_FIELD_SENDER) && !(offset = putStringField(out, offset, out_size, msg->sender, USERNAME_BUF_SIZE)))
+        return 0;
+    if ((fields & FRAME_FIELD_RECEIVER) && !(offset = putStringField(out, offset, out_size, msg->receiver, USERNAME_BUF_SIZE)))
+        return 0;
+    if ((fields & FRAME_FIELD_ROOM) && !(offset = putStringField(out, offset, out_size, msg->room, ROOM_NAME_BUF_SIZE)))
+        return 0;
+    if ((fields & FRAME_FIELD_CONTENT) && !(offset = putStringField(out, offset, out_size, msg->content, MESSAGE_BUF_SIZE)))
+        return 0;
+    if ((fields & FRAME_FIELD_FILENAME) && !(offset = putStringField(out, offset, out_size, msg->filename, FILENAME_BUF_SIZE)))
+        return 0;
+    if (fields & FRAME_FIELD_FILE_SIZE)
+    {
+        if (offset + 8 > out_size)
+            return 0;
+        unsigned long long size_value = (unsigned long long)msg->file_size;
+        for (int i = 7; i >= 0; --i)
+        {
+            out[offset + (size_t)i] = (unsigned char)(size_value & 0xFF);
+            size_value >>= 8;
+        }
+        offset += 8;
+    }
+    putUint16(out, offset - FRAME_HEADER_SIZE); // Body length excludes the prefix itself
+    return offset;
+}
+
+size_t messageWireUnitSize(int protocol_version, const unsigned char *unit, size_t have_bytes)
+{
+    if (protocol_version != WIRE_PROTOCOL_FRAMED)
+        return sizeof(Message);
+    if (have_bytes < FRAME_HEADER_SIZE)
+        return FRAME_HEADER_SIZE;
+    size_t body_len = getUint16(unit);
+    if (body_len < 3 || body_len > FRAME_MAX_BODY_SIZE)
+        return 0; // Malformed length prefix
+    return FRAME_HEADER_SIZE + body_len;
+}
+
+int decodeMessageWireUnit(int protocol_version, const unsigned char *unit, size_t unit_len, Message *msg)
+{
+    if (!unit || !msg)
+        return 0;
+    memset(msg, 0, sizeof(Message));
+
+    if (protocol_version != WIRE_PROTOCOL_FRAMED)
+    {
+        if (unit_len != sizeof(Message))
+            return 0;
+        memcpy(msg, unit, sizeof(Message));
+        sanitizeReceivedMessage(msg);
+        return 1;
+    }
+
+    if (unit_len < FRAME_HEADER_SIZE + 3 || messageWireUnitSize(protocol_version, unit, unit_len) != unit_len)
+        return 0;
+    size_t offset = FRAME_HEADER_SIZE;
+    if (unit[offset++] != WIRE_PROTOCOL_FRAMED)
+        return 0; // Version mismatch
+    msg->type = (MessageType)unit[offset++];
+    unsigned int fields = unit[offset++];
+    if (fields & ~FRAME_FIELD_ALL)
+        return 0;
+
+    if ((fields & FRAME_FIELD_SENDER) && !(offset = getStringField(unit, offset, unit_len, msg->sender, USERNAME_BUF_SIZE)))
+        return 0;
+    if ((fields & FRAME_FIELD_RECEIVER) && !(offset = getStringField(unit, offset, unit_len, msg->receiver, USERNAME_BUF_SIZE)))
+        return 0;
+    if ((fields & FRAME_FIELD_ROOM) && !(offset = getStringField(unit, offset, unit_len, msg->room, ROOM_NAME_BUF_SIZE)))
+        return 0;
+    if ((fields & FRAME_FIELD_CONTENT) && !(offset = getStringField(unit, offset, unit_len, msg->content, MESSAGE_BUF_SIZE)))
+        return 0;
+    if ((fields & FRAME_FIELD_FILENAME) && !(offset = getStringField(unit, offset, unit_len, msg->filename, FILENAME_BUF_SIZE)))
+        return 0;
+    if (fields & FRAME_FIELD_FILE_SIZE)
+    {
+        if (offset + 8 > unit_len)
+            return 0;
+        unsigned long long size_value = 0;
+        for (int i = 0; i < 8; ++i)
+            size_value = (size_value << 8) | unit[offset + (size_t)i];
+        msg->file_size = (size_t)size_value;
+        offset += 8;
+    }
+    return offset == unit_len; // Trailing garbage makes the frame invalid
+}
+
+// Sends a Message in the given wire protocol.
 // Returns 1 if the entire message was sent, 0 otherwise.
-int sendMessage(int socket_fd, const Message *msg)
+int sendMessageWithProtocol(int socket_fd, const Message *msg, int protocol_version)
 {
     if (socket_fd < 0 || !msg)
     {
         return 0; // Invalid arguments
     }
-    ssize_t bytes_sent = send(socket_fd, msg, sizeof(Message), 0);
-    if (bytes_sent < 0)
+    if (protocol_version != WIRE_PROTOCOL_FRAMED)
     {
-        // Caller can check errno if needed (e.g., EPIPE for broken pipe)
-        return 0; // Send error
+        return sendAllBytes(socket_fd, msg, sizeof(Message));
     }
-    return (bytes_sent == sizeof(Message)) ? 1 : 0; // Success only if all bytes sent
+    unsigned char frame[FRAME_MAX_SIZE];
+    size_t frame_len = encodeMessageFrame(msg, frame, sizeof(frame));
+    return frame_len > 0 && sendAllBytes(socket_fd, frame, frame_len);
+}
+
+// Sends a Message over the socket in the socket's negotiated wire protocol.
+// Returns 1 if the entire message was sent, 0 otherwise.
+int sendMessage(int socket_fd, const Message *msg)
+{
+    return sendMessageWithProtocol(socket_fd, msg, getSocketWireProtocol(socket_fd));
 }
 
-// Receives a Message struct from the socket.
-// Returns 1 if a complete message was received, 0 if connection closed or error.
+// Receives one Message from the socket in the socket's negotiated wire protocol.
+// Returns 1 if a complete message was received, 0 if connection closed, error, or malformed frame.
 int receiveMessage(int socket_fd, Message *msg)
 {
     if (socket_fd < 0 || !msg)
     {
         return 0; // Invalid arguments
     }
-    memset(msg, 0, sizeof(Message)); // Clear message struct before receiving
-    ssize_t bytes_received = recv(socket_fd, msg, sizeof(Message), 0);
+    int protocol_version = getSocketWireProtocol(socket_fd);
+    unsigned char unit[WIRE_UNIT_MAX_SIZE];
 
-    if (bytes_received == sizeof(Message))
-    {
-        // Ensure null termination for all string fields for safety,
-        // even if server/client is expected to send them null-terminated.
-        msg->sender[USERNAME_BUF_SIZE - 1] = '\0';
-        msg->receiver[USERNAME_BUF_SIZE - 1] = '\0';
-        msg->room[ROOM_NAME_BUF_SIZE - 1] = '\0';
-        msg->content[MESSAGE_BUF_SIZE - 1] = '\0';
-        msg->filename[FILENAME_BUF_SIZE - 1] = '\0';
-        return 1; // Successfully received a full message
-    }
-    else if (bytes_received == 0)
-    {
-        return 0; // Connection closed by peer
-    }
-    else
-    {
-        // Error (bytes_received < 0) or partial message (0 < bytes_received < sizeof(Message))
-        // For this project, partial messages are treated as errors.
+    size_t unit_len = messageWireUnitSize(protocol_version, unit, 0);
+    if (!receiveAllBytes(socket_fd, unit, unit_len))
         return 0;
+    if (protocol_version == WIRE_PROTOCOL_FRAMED)
+    {
+        // unit_len covered only the length prefix; now fetch the body it announces
+        size_t full_len = messageWireUnitSize(protocol_version, unit, unit_len);
+        if (full_len == 0 || !receiveAllBytes(socket_fd, unit + unit_len, full_len - unit_len))
+            return 0;
+        unit_len = full_len;
     }
+    return decodeMessageWireUnit(protocol_version, unit, unit_len, msg);
+}
+
+// Ensures null termination for all string fields for safety,
+// even if server/client is expected to send them null-terminated.
+void sanitizeReceivedMessage(Message *msg)
+{
+    if (!msg)
+        return;
+    msg->sender[USERNAME_BUF_SIZE - 1] = '\0';
+    msg->receiver[USERNAME_BUF_SIZE - 1] = '\0';
+    msg->room[ROOM_NAME_BUF_SIZE - 1] = '\0';
+    msg->content[MESSAGE_BUF_SIZE - 1] = '\0';
+    msg->filename[FILENAME_BUF_SIZE - 1] = '\0';
 }
 
 // Validates username: 1 to MAX_USERNAME_LEN characters, alphanumeric.
@@ -12,6 +12,30 @@ int sendMessage(int socket_fd, const Message *msg);
 // Returns 1 on success (all bytes of Message received), 0 on failure or if connection closed.
 int receiveMessage(int socket_fd, Message *msg);
 
+// Forces null termination of every string field of a freshly received Message.
+void sanitizeReceivedMessage(Message *msg);
+
+// Wire protocol selection (see WIRE_PROTOCOL_* in protocol.h)
+// Records which wire protocol is spoken on a socket; sendMessage/receiveMessage honour it.
+// Sockets default to WIRE_PROTOCOL_FIXED; reset a socket before closing it so a reused fd starts fresh.
+void setSocketWireProtocol(int socket_fd, int protocol_version);
+int getSocketWireProtocol(int socket_fd);
+
+// Sends a Message in an explicit wire protocol, ignoring the socket's recorded one (used for login replies).
+// Returns 1 on success, 0 on failure.
+int sendMessageWithProtocol(int socket_fd, const Message *msg, int protocol_version);
+
+// Encodes msg as one framed unit. Returns the frame length, or 0 if out_size is too small.
+size_t encodeMessageFrame(const Message *msg, unsigned char *out, size_t out_size);
+
+// Given the first have_bytes bytes of a wire unit, returns the unit's total size in bytes.
+// In framed mode this is FRAME_HEADER_SIZE until the length prefix is complete. Returns 0 for an invalid length.
+size_t messageWireUnitSize(int protocol_version, const unsigned char *unit, size_t have_bytes);
+
+// Decodes one complete wire unit into msg (all absent fields zeroed).
+// Returns 1 on success, 0 if the unit is malformed.
+int decodeMessageWireUnit(int protocol_version, const unsigned char *unit, size_t unit_len, Message *msg);
+
 // Validation functions (shared between client and server)
 // Checks if a username is valid (alphanumeric, correct length).
 // Returns 1 if valid, 0 otherwise.
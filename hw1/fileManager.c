@@ -1,5 +1,7 @@
 #include "fileManager.h"
 #include "utils.h" // Include utils.h for custom functions
+#include "walker.h"
+#include <stdio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -541,9 +543,112 @@ void deleteDirectory(const char *dirName)
     }
 }
 
+/* Check that dirName is a directory before walking it; reports the error otherwise */
+static int checkWalkRoot(const char *dirName)
+{
+    char error_msg[BUFFER_SIZE];
+    struct stat st;
+    if (lstat(dirName, &st) == -1)
+    {
+        snprintf(error_msg, sizeof(error_msg), "Error: Directory \"%s\" not found.\n", dirName);
+    }
+    else if (!S_ISDIR(st.st_mode))
+    {
+        snprintf(error_msg, sizeof(error_msg), "Error: \"%s\" is not a directory.\n", dirName);
+    }
+    else
+    {
+        return 0;
+    }
+    write(STDERR_FILENO, error_msg, strlen(error_msg));
+    return -1;
+}
+
+/* List a directory tree; entries are streamed as the walker threads find them */
+void listDirectoryRecursive(const char *dirName)
+{
+    if (checkWalkRoot(dirName) == -1)
+    {
+        return;
+    }
+
+    char message[BUFFER_SIZE];
+    snprintf(message, sizeof(message), "Contents of directory \"%s\" (recursive):\n", dirName);
+    write(STDOUT_FILENO, message, strlen(message));
+
+    WalkStats stats;
+    walkDirectory(dirName, WALK_LIST, NULL, &stats);
+
+    snprintf(message, sizeof(message), "%ld entries in %ld directories.\n", stats.entries, stats.directories);
+    write(STDOUT_FILENO, message, strlen(message));
+
+    snprintf(message, sizeof(message), "Directory \"%s\" listed recursively (%ld entries, %ld errors).",
+             dirName, stats.entries, stats.errors);
+    logOperation(message);
+}
+
+/* List files with a specific extension anywhere in a directory tree */
+void listFilesByExtensionRecursive(const char *dirName, const char *extension)
+{
+    if (checkWalkRoot(dirName) == -1)
+    {
+        return;
+    }
+
+    char message[BUFFER_SIZE];
+    snprintf(message, sizeof(message), "Files with extension \"%s\" in directory \"%s\" (recursive):\n",
+             extension, dirName);
+    write(STDOUT_FILENO, message, strlen(message));
+
+    WalkStats stats;
+    walkDirectory(dirName, WALK_FILTER, extension, &stats);
+
+    if (stats.matches == 0)
+    {
+        snprintf(message, sizeof(message), "No files with extension \"%s\" found in \"%s\".\n", extension, dirName);
+    }
+    else
+    {
+        snprintf(message, sizeof(message), "%ld of %ld entries matched.\n", stats.matches, stats.entries);
+    }
+    write(STDOUT_FILENO, message, strlen(message));
+
+    snprintf(message, sizeof(message), "Listed files with extension \"%s\" in directory \"%s\" recursively (%ld matches).",
+             extension, dirName, stats.matches);
+    logOperation(message);
+}
+
+/* Delete a directory and everything below it */
+void deleteDirectoryRecursive(const char *dirName)
+{
+    if (checkWalkRoot(dirName) == -1)
+    {
+        return;
+    }
+
+    WalkStats stats;
+    char message[BUFFER_SIZE];
+    if (walkDirectory(dirName, WALK_DELETE, NULL, &stats) == 0)
+    {
+        snprintf(message, sizeof(message), "Directory \"%s\" deleted successfully (%ld entries removed).",
+                 dirName, stats.matches);
+        logOperation(message);
+        write(STDOUT_FILENO, message, strlen(message));
+        write(STDOUT_FILENO, "\n", 1);
+    }
+    else
+    {
+        snprintf(message, sizeof(message), "Error: Directory \"%s\" partially deleted (%ld entries removed, %ld errors).\n",
+                 dirName, stats.matches, stats.errors);
+        write(STDERR_FILENO, message, strlen(message));
+    }
+}
+
 /* Show log file */
 void showLogs(void)
 {
+    flushLog(); // Records of earlier commands in a batch must be visible
+
     struct stat st = {0};
     if (stat(LOG_FILE, &st) == -1)
     {
@@ -578,4 +683,203 @@ void showLogs(void)
 
     char log_msg[BUFFER_SIZE] = "Logs displayed successfully.";
     logOperation(log_msg);
-}
\ No newline at end of file
+}
+
+/* Open the log for a query; pending batch records are written first */
+static int openLogForQuery(off_t *size)
+{
+    flushLog();
+
+    int fd = open(LOG_FILE, O_RDONLY);
+    if (fd == -1)
+    {
+        char error_msg[BUFFER_SIZE] = "Error: Log file not found.";
+        if (errno != ENOENT)
+        {
+            snprintf(error_msg, sizeof(error_msg), "Error opening log file: %s", strerror(errno));
+        }
+        write(STDERR_FILENO, error_msg, strlen(error_msg));
+        write(STDERR_FILENO, "\n", 1);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+    *size = st.st_size;
+    return fd;
+}
+
+/* Write log bytes [start, end) to stdout */
+static void copyLogRange(int fd, off_t start, off_t end)
+{
+    char message[] = "Operation logs:\n";
+    write(STDOUT_FILENO, message, strlen(message));
+
+    char buffer[BUFFER_SIZE];
+    while (start < end)
+    {
+        size_t chunk = (end - start < BUFFER_SIZE) ? (size_t)(end - start) : BUFFER_SIZE;
+        ssize_t bytes_read = pread(fd, buffer, chunk, start);
+        if (bytes_read <= 0)
+        {
+            break;
+        }
+        write(STDOUT_FILENO, buffer, bytes_read);
+        start += bytes_read;
+    }
+}
+
+/* Show the last count records, reading the log backwards from its end */
+void showLogTail(int count)
+{
+    off_t size;
+    int fd = openLogForQuery(&size);
+    if (fd == -1)
+    {
+        return;
+    }
+
+    // Walk back over count newlines, not counting the one that ends the last record
+    char buffer[BUFFER_SIZE];
+    off_t start = 0;
+    off_t pos = size;
+    int newlines = 0;
+    while (pos > 0 && start == 0)
+    {
+        size_t chunk = (pos < BUFFER_SIZE) ? (size_t)pos : BUFFER_SIZE;
+        if (pread(fd, buffer, chunk, pos - chunk) != (ssize_t)chunk)
+        {
+            break;
+        }
+        for (size_t i = chunk; i-- > 0;)
+        {
+            off_t offset = pos - chunk + i;
+            if (buffer[i] == '\n' && offset != size - 1 && ++newlines == count)
+            {
+                start = offset + 1;
+                break;
+            }
+        }
+        pos -= chunk;
+    }
+
+    copyLogRange(fd, start, size);
+    close(fd);
+
+    char log_msg[BUFFER_SIZE];
+    snprintf(log_msg, sizeof(log_msg), "Last %d log records displayed successfully.", count);
+    logOperation(log_msg);
+}
+
+/* Offset of the first record that starts at or after pos */
+static off_t nextRecordStart(int fd, off_t pos, off_t size)
+{
+    if (pos == 0)
+    {
+        return 0;
+    }
+
+    char buffer[BUFFER_SIZE];
+    for (pos--; pos < size;)
+    {
+        ssize_t bytes_read = pread(fd, buffer, sizeof(buffer), pos);
+        if (bytes_read <= 0)
+        {
+            break;
+        }
+        char *newline = memchr(buffer, '\n', bytes_read);
+        if (newline != NULL)
+        {
+            return pos + (newline - buffer) + 1;
+        }
+        pos += bytes_read;
+    }
+    return size;
+}
+
+/* Compare the timestamp of the record at start with a (possibly shortened) bound */
+static int compareRecordTime(int fd, off_t start, const char *bound)
+{
+    char timestamp[TIMESTAMP_SIZE] = {0};
+    size_t length = strlen(bound);
+    if (pread(fd, timestamp, length + 1, start) != (ssize_t)(length + 1))
+    {
+        return 1; // A cut-off record sorts after every bound
+    }
+    return strncmp(timestamp + 1, bound, length); // Skip the '['
+}
+
+/* Binary search for the first record whose time is >= bound (or > bound if after).
+ * Records are appended in time order, so only O(log n) records are read. */
+static off_t findRecord(int fd, off_t size, const char *bound, int after)
+{
+    off_t low = 0, high = size;
+    while (low < high)
+    {
+        off_t mid = low + (high - low) / 2;
+        off_t start = nextRecordStart(fd, mid, size);
+        int cmp = (start == size) ? 1 : compareRecordTime(fd, start, bound);
+        if (after ? cmp > 0 : cmp >= 0)
+        {
+            high = mid;
+        }
+        else
+        {
+            low = mid + 1;
+        }
+    }
+    return nextRecordStart(fd, low, size);
+}
+
+/* A bound is "YYYY-MM-DD HH:MM:SS" or a prefix of it, e.g. "YYYY-MM-DD" */
+static int isValidTimeBound(const char *bound)
+{
+    const char *pattern = "0000-00-00 00:00:00";
+    size_t length = strlen(bound);
+    if (length == 0 || length > strlen(pattern))
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < length; i++)
+    {
+        int digit = bound[i] >= '0' && bound[i] <= '9';
+        if ((pattern[i] == '0') ? !digit : bound[i] != pattern[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Show the records logged between since and until (either may be NULL).
+ * A shortened bound covers its whole period: --until 2025-03-10 includes that day. */
+void showLogRange(const char *since, const char *until)
+{
+    if ((since != NULL && !isValidTimeBound(since)) || (until != NULL && !isValidTimeBound(until)))
+    {
+        char error_msg[] = "Error: Times must look like \"YYYY-MM-DD HH:MM:SS\" (or a prefix of it).\n";
+        write(STDERR_FILENO, error_msg, strlen(error_msg));
+        return;
+    }
+
+    off_t size;
+    int fd = openLogForQuery(&size);
+    if (fd == -1)
+    {
+        return;
+    }
+
+    off_t start = (since != NULL) ? findRecord(fd, size, since, 0) : 0;
+    off_t end = (until != NULL) ? findRecord(fd, size, until, 1) : size;
+    copyLogRange(fd, start, end > start ? end : start);
+    close(fd);
+
+    char log_msg[BUFFER_SIZE];
+    snprintf(log_msg, sizeof(log_msg), "Log records from \"%s\" to \"%s\" displayed successfully.",
+             since ? since : "start", until ? until : "end");
+    logOperation(log_msg);
+}
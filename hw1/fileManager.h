@@ -16,7 +16,12 @@ void readFile(const char *fileName);
 void appendToFile(const char *fileName, const char *content);
 void deleteFile(const char *fileName);
 void deleteDirectory(const char *dirName);
+void listDirectoryRecursive(const char *dirName);
+void listFilesByExtensionRecursive(const char *dirName, const char *extension);
+void deleteDirectoryRecursive(const char *dirName);
 void showLogs(void);
+void showLogTail(int count);
+void showLogRange(const char *since, const char *until);
 void displayHelp(void);
 void logOperation(const char *message);
 void getCurrentTimestamp(char *timestamp);
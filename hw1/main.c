@@ -1,51 +1,214 @@
 #include "fileManager.h"
 #include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 
-int main(int argc, char *argv[])
+#define MAX_BATCH_ARGS 8
+
+/* Run one command; argv[0] is the command name. Returns 0 if it was recognized. */
+static int runCommand(int argc, char *argv[])
 {
-    if (argc < 2)
+    if (strcmp(argv[0], "createDir") == 0 && argc == 2)
     {
-        displayHelp();
-        return 0;
+        createDirectory(argv[1]);
     }
-
-    if (strcmp(argv[1], "createDir") == 0 && argc == 3)
+    else if (strcmp(argv[0], "createFile") == 0 && argc == 2)
+    {
+        createFile(argv[1]);
+    }
+    else if (strcmp(argv[0], "listDir") == 0 && argc == 2)
+    {
+        listDirectory(argv[1]);
+    }
+    else if (strcmp(argv[0], "listFilesByExtension") == 0 && argc == 3)
     {
-        createDirectory(argv[2]);
+        listFilesByExtension(argv[1], argv[2]);
     }
-    else if (strcmp(argv[1], "createFile") == 0 && argc == 3)
+    else if (strcmp(argv[0], "readFile") == 0 && argc == 2)
     {
-        createFile(argv[2]);
+        readFile(argv[1]);
     }
-    else if (strcmp(argv[1], "listDir") == 0 && argc == 3)
+    else if (strcmp(argv[0], "appendToFile") == 0 && argc == 3)
     {
-        listDirectory(argv[2]);
+        appendToFile(argv[1], argv[2]);
     }
-    else if (strcmp(argv[1], "listFilesByExtension") == 0 && argc == 4)
+    else if (strcmp(argv[0], "deleteFile") == 0 && argc == 2)
     {
-        listFilesByExtension(argv[2], argv[3]);
+        deleteFile(argv[1]);
     }
-    else if (strcmp(argv[1], "readFile") == 0 && argc == 3)
+    else if (strcmp(argv[0], "deleteDir") == 0 && argc == 2)
     {
-        readFile(argv[2]);
+        deleteDirectory(argv[1]);
     }
-    else if (strcmp(argv[1], "appendToFile") == 0 && argc == 4)
+    else if (strcmp(argv[0], "listDirRecursive") == 0 && argc == 2)
     {
-        appendToFile(argv[2], argv[3]);
+        listDirectoryRecursive(argv[1]);
     }
-    else if (strcmp(argv[1], "deleteFile") == 0 && argc == 3)
+    else if (strcmp(argv[0], "listFilesByExtensionRecursive") == 0 && argc == 3)
     {
-        deleteFile(argv[2]);
+        listFilesByExtensionRecursive(argv[1], argv[2]);
     }
-    else if (strcmp(argv[1], "deleteDir") == 0 && argc == 3)
+    else if (strcmp(argv[0], "deleteDirRecursive") == 0 && argc == 2)
     {
-        deleteDirectory(argv[2]);
+        deleteDirectoryRecursive(argv[1]);
     }
-    else if (strcmp(argv[1], "showLogs") == 0 && argc == 2)
+    else if (strcmp(argv[0], "showLogs") == 0 && argc == 1)
     {
         showLogs();
     }
+    else if (strcmp(argv[0], "showLogs") == 0 && argc == 3 && strcmp(argv[1], "-n") == 0 && atoi(argv[2]) > 0)
+    {
+        showLogTail(atoi(argv[2]));
+    }
+    else if (strcmp(argv[0], "showLogs") == 0 && argc == 3 && strcmp(argv[1], "--since") == 0)
+    {
+        showLogRange(argv[2], NULL);
+    }
+    else if (strcmp(argv[0], "showLogs") == 0 && argc == 3 && strcmp(argv[1], "--until") == 0)
+    {
+        showLogRange(NULL, argv[2]);
+    }
+    else if (strcmp(argv[0], "showLogs") == 0 && argc == 5 && strcmp(argv[1], "--since") == 0 &&
+             strcmp(argv[3], "--until") == 0)
+    {
+        showLogRange(argv[2], argv[4]);
+    }
     else
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/* Split a script line into words; double quotes group words containing spaces.
+ * The words point into line, which is modified. Returns the number of words. */
+static int splitLine(char *line, char *words[])
+{
+    int count = 0;
+    char *p = line;
+    while (*p != '\0')
+    {
+        while (*p == ' ' || *p == '\t')
+        {
+            p++;
+        }
+        if (*p == '\0' || (*p == '#' && count == 0))
+        {
+            break;
+        }
+        if (count == MAX_BATCH_ARGS)
+        {
+            return -1;
+        }
+
+        char quote = (*p == '"') ? *p++ : '\0';
+        words[count++] = p;
+        while (*p != '\0' && (quote ? *p != quote : (*p != ' ' && *p != '\t')))
+        {
+            p++;
+        }
+        if (*p != '\0')
+        {
+            *p++ = '\0';
+        }
+    }
+    return count;
+}
+
+/* Run a script of commands, one per line. Log records are written in groups
+ * instead of one write per command. */
+static int runBatch(const char *scriptName)
+{
+    int fd = strcmp(scriptName, "-") == 0 ? STDIN_FILENO : open(scriptName, O_RDONLY);
+    if (fd == -1)
+    {
+        char error_msg[100] = "Error opening script: ";
+        strcat(error_msg, strerror(errno));
+        write(STDERR_FILENO, error_msg, strlen(error_msg));
+        write(STDERR_FILENO, "\n", 1);
+        return EXIT_FAILURE;
+    }
+
+    beginLogBatch();
+
+    char buffer[BUFFER_SIZE];
+    size_t used = 0;
+    int lineNumber = 0, failed = 0;
+    for (;;)
+    {
+        ssize_t bytes_read = read(fd, buffer + used, sizeof(buffer) - 1 - used);
+        if (bytes_read > 0)
+        {
+            used += bytes_read;
+        }
+        else if (used == 0)
+        {
+            break;
+        }
+        else
+        {
+            buffer[used++] = '\n'; // Last line without a newline
+        }
+
+        char *lineStart = buffer;
+        char *newline;
+        while ((newline = memchr(lineStart, '\n', used - (lineStart - buffer))) != NULL)
+        {
+            *newline = '\0';
+            lineNumber++;
+
+            char *words[MAX_BATCH_ARGS];
+            int count = splitLine(lineStart, words);
+            if (count != 0 && (count < 0 || runCommand(count, words) != 0))
+            {
+                char error_msg[100];
+                snprintf(error_msg, sizeof(error_msg), "Error: Invalid command on line %d of the script.\n", lineNumber);
+                write(STDERR_FILENO, error_msg, strlen(error_msg));
+                failed = 1;
+            }
+            lineStart = newline + 1;
+        }
+
+        used -= lineStart - buffer;
+        memmove(buffer, lineStart, used);
+        if (used == sizeof(buffer) - 1)
+        {
+            char error_msg[] = "Error: Script line too long.\n";
+            write(STDERR_FILENO, error_msg, strlen(error_msg));
+            failed = 1;
+            break;
+        }
+        if (bytes_read <= 0)
+        {
+            break;
+        }
+    }
+
+    endLogBatch();
+    if (fd != STDIN_FILENO)
+    {
+        close(fd);
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        displayHelp();
+        return 0;
+    }
+
+    if (strcmp(argv[1], "batch") == 0 && argc == 3)
+    {
+        return runBatch(argv[2]);
+    }
+
+    if (runCommand(argc - 1, argv + 1) != 0)
     {
         displayHelp();
     }
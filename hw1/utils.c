@@ -6,6 +6,8 @@
 #include <time.h>
 #include <string.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <sys/uio.h>
 
 /* Get current timestamp in format: [YYYY-MM-DD HH:MM:SS] */
 void getCurrentTimestamp(char *timestamp)
@@ -15,27 +17,148 @@ void getCurrentTimestamp(char *timestamp)
     strftime(timestamp, TIMESTAMP_SIZE, "[%Y-%m-%d %H:%M:%S]", timeinfo);
 }
 
-/* Log operation to log file */
-void logOperation(const char *message)
+/* The log stays open for the whole run. In batch mode records are collected
+ * in logBatch and written together; a flush only ever writes whole records.
+ * Batched records are stamped again when they are written, so the log stays
+ * in time order while other runs append to it. */
+#define LOG_MIN_RECORD 23 /* "[YYYY-MM-DD HH:MM:SS]" plus a space and a newline */
+static int logFd = -1;
+static pid_t logOwner = 0; /* Forked children must not flush the parent's batch */
+static int logBatching = 0;
+static size_t logBatchUsed = 0;
+static char logBatch[LOG_BATCH_SIZE];
+static size_t logBatchCount = 0;
+static size_t logBatchRecords[LOG_BATCH_SIZE / LOG_MIN_RECORD]; /* Start of each record */
+static time_t logBatchStart = 0; /* When the oldest collected record was logged */
+
+/* Open the log file on first use */
+static int openLog(void)
 {
-    int fd = open(LOG_FILE, O_WRONLY | O_CREAT | O_APPEND, 0644);
-    if (fd == -1)
+    if (logFd != -1)
+    {
+        return 0;
+    }
+
+    logFd = open(LOG_FILE, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (logFd == -1)
     {
         const char *prefix = "Error opening log file: ";
         write(STDERR_FILENO, prefix, strlen(prefix));
         write(STDERR_FILENO, strerror(errno), strlen(strerror(errno)));
         write(STDERR_FILENO, "\n", 1);
+        return -1;
+    }
+    logOwner = getpid();
+    atexit(closeLog);
+    return 0;
+}
+
+/* Write the collected batch with a single write */
+void flushLog(void)
+{
+    if (logBatchUsed == 0 || logFd == -1 || logOwner != getpid())
+    {
         return;
     }
 
     char timestamp[TIMESTAMP_SIZE];
     getCurrentTimestamp(timestamp);
+    size_t stampLength = strlen(timestamp);
+    for (size_t i = 0; i < logBatchCount; i++)
+    {
+        char *record = logBatch + logBatchRecords[i];
+        if (record[stampLength] == ' ') /* Same width as the stamp it replaces */
+        {
+            memcpy(record, timestamp, stampLength);
+        }
+    }
+
+    size_t written = 0;
+    while (written < logBatchUsed)
+    {
+        ssize_t n = write(logFd, logBatch + written, logBatchUsed - written);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        written += n;
+    }
+    logBatchUsed = 0;
+    logBatchCount = 0;
+}
+
+/* Collect records until endLogBatch (or a full buffer) instead of writing each one */
+void beginLogBatch(void)
+{
+    logBatching = 1;
+}
+
+void endLogBatch(void)
+{
+    flushLog();
+    logBatching = 0;
+}
+
+/* Flush and close the log; also registered with atexit */
+void closeLog(void)
+{
+    flushLog();
+    if (logFd != -1 && logOwner == getpid())
+    {
+        close(logFd);
+        logFd = -1;
+    }
+}
+
+/* Log operation to log file */
+void logOperation(const char *message)
+{
+    if (openLog() == -1)
+    {
+        return;
+    }
+
+    char timestamp[TIMESTAMP_SIZE];
+    getCurrentTimestamp(timestamp);
+
+    struct iovec record[4] = {
+        {timestamp, strlen(timestamp)},
+        {" ", 1},
+        {(void *)message, strlen(message)},
+        {"\n", 1},
+    };
+    size_t length = record[0].iov_len + 1 + record[2].iov_len + 1;
+
+    if (logBatching && length <= sizeof(logBatch))
+    {
+        /* Never hold records back for more than about a second */
+        time_t now = time(NULL);
+        size_t maxRecords = sizeof(logBatchRecords) / sizeof(logBatchRecords[0]);
+        if (logBatchUsed + length > sizeof(logBatch) || logBatchCount == maxRecords ||
+            (logBatchCount > 0 && now != logBatchStart))
+        {
+            flushLog();
+        }
+        if (logBatchCount == 0)
+        {
+            logBatchStart = now;
+        }
+        logBatchRecords[logBatchCount++] = logBatchUsed;
+        for (int i = 0; i < 4; i++)
+        {
+            memcpy(logBatch + logBatchUsed, record[i].iov_base, record[i].iov_len);
+            logBatchUsed += record[i].iov_len;
+        }
+        return;
+    }
 
-    write(fd, timestamp, strlen(timestamp));
-    write(fd, " ", 1);
-    write(fd, message, strlen(message));
-    write(fd, "\n", 1);
-    close(fd);
+    /* One writev per record, so O_APPEND keeps concurrent records whole */
+    flushLog();
+    writev(logFd, record, 4);
 }
 
 /* Display help */
@@ -51,7 +174,13 @@ void displayHelp(void)
                       "  appendToFile \"fileName\" \"new content\" - Append content to a file\n"
                       "  deleteFile \"fileName\" - Delete a file\n"
                       "  deleteDir \"folderName\" - Delete an empty directory\n"
-                      "  showLogs - Display operation logs\n";
+                      "  listDirRecursive \"folderName\" - List a directory tree\n"
+                      "  listFilesByExtensionRecursive \"folderName\" \".txt\" - List matching files in a directory tree\n"
+                      "  deleteDirRecursive \"folderName\" - Delete a directory and all of its contents\n"
+                      "  showLogs - Display operation logs\n"
+                      "  showLogs -n N - Display the last N log records\n"
+                      "  showLogs --since \"YYYY-MM-DD HH:MM:SS\" [--until \"...\"] - Display records in a time range\n"
+                      "  batch \"scriptFile\" - Run one command per line (\"-\" reads stdin), logging in groups\n";
 
     write(STDOUT_FILENO, help_msg, strlen(help_msg));
 }
@@ -10,8 +10,15 @@ void getCurrentTimestamp(char *timestamp);
 void logOperation(const char *message);
 void displayHelp(void);
 
+/* Group-committed logging for batch mode */
+void beginLogBatch(void);
+void endLogBatch(void);
+void flushLog(void);
+void closeLog(void);
+
 #define BUFFER_SIZE 4096
 #define TIMESTAMP_SIZE 32
 #define LOG_FILE "log.txt"
+#define LOG_BATCH_SIZE 65536
 
 #endif /* UTILS_H */
\ No newline at end of file
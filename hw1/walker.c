@@ -0,0 +1,491 @@
+#define _GNU_SOURCE
+#include "walker.h"
+#include "utils.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#define WALK_MIN_THREADS 4 /* Directory reads block, so use more threads than cores */
+#define WALK_MAX_THREADS 16
+#define DENTS_BUFFER_SIZE (64 * 1024)
+#define OUTPUT_BUFFER_SIZE (16 * BUFFER_SIZE)
+
+/* Record layout returned by getdents64 */
+struct linuxDirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/* A directory waiting to be scanned. Directories below the root are opened
+ * relative to their parent's descriptor, so no symlink swapped in along the way
+ * is followed and paths may grow past PATH_MAX; path is only used for output.
+ * A descriptor stays open while the directory is scanned or has subdirectories
+ * queued, so at most one per level of the paths being walked is held. */
+typedef struct WalkDir
+{
+    char *path;
+    const char *name;       /* Last component of path (the whole path for the root) */
+    struct WalkDir *parent; /* Holds an fdRefs reference until opened (WALK_DELETE: a refs one until removed) */
+    int fd;                 /* Valid while fdRefs > 0 */
+    atomic_int fdRefs;      /* Own scan plus subdirectories queued but not yet opened */
+    atomic_int refs;        /* One while fd is open, plus (WALK_DELETE) subdirectories not yet removed */
+    struct WalkDir *next;   /* Link in the work stack */
+} WalkDir;
+
+typedef struct
+{
+    WalkMode mode;
+    const char *extension;
+    pthread_mutex_t mutex; /* Protects stack, active and done */
+    pthread_cond_t cond;   /* Signalled when work is pushed or the walk ends */
+    WalkDir *stack;        /* LIFO keeps the walk depth-first and the stack short */
+    int active;            /* Threads scanning a directory */
+    int done;
+    pthread_mutex_t outputMutex; /* Keeps lines of different threads apart */
+    atomic_long entries, directories, matches, errors;
+} Walk;
+
+/* Lines of one thread, written to stdout in large blocks */
+typedef struct
+{
+    size_t used;
+    char data[OUTPUT_BUFFER_SIZE];
+} OutputBuffer;
+
+static void flushOutput(Walk *walk, OutputBuffer *out)
+{
+    if (out->used == 0)
+    {
+        return;
+    }
+    pthread_mutex_lock(&walk->outputMutex);
+    size_t written = 0;
+    while (written < out->used)
+    {
+        ssize_t n = write(STDOUT_FILENO, out->data + written, out->used - written);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        written += n;
+    }
+    pthread_mutex_unlock(&walk->outputMutex);
+    out->used = 0;
+}
+
+/* Add "  <path>/<name><suffix>\n" to the thread's output */
+static void outputLine(Walk *walk, OutputBuffer *out, const char *path, const char *name, const char *suffix)
+{
+    struct iovec parts[5] = {
+        {"  ", 2},
+        {(void *)path, strlen(path)},
+        {"/", 1},
+        {(void *)name, strlen(name)},
+        {(void *)suffix, strlen(suffix)},
+    };
+    size_t length = 2 + parts[1].iov_len + 1 + parts[3].iov_len + parts[4].iov_len + 1;
+
+    if (out->used + length > sizeof(out->data))
+    {
+        flushOutput(walk, out);
+    }
+    if (length > sizeof(out->data))
+    {
+        /* Longer than the whole buffer: write it on its own */
+        struct iovec line[6];
+        memcpy(line, parts, sizeof(parts));
+        line[5].iov_base = "\n";
+        line[5].iov_len = 1;
+        pthread_mutex_lock(&walk->outputMutex);
+        writev(STDOUT_FILENO, line, 6);
+        pthread_mutex_unlock(&walk->outputMutex);
+        return;
+    }
+
+    for (int i = 0; i < 5; i++)
+    {
+        memcpy(out->data + out->used, parts[i].iov_base, parts[i].iov_len);
+        out->used += parts[i].iov_len;
+    }
+    out->data[out->used++] = '\n';
+}
+
+/* Report "Error <action> "<path>[/<name>]": <reason>" on stderr */
+static void reportError(Walk *walk, const char *action, const char *path, const char *name, int err)
+{
+    const char *reason = strerror(err);
+    struct iovec parts[8] = {
+        {"Error ", 6},
+        {(void *)action, strlen(action)},
+        {" \"", 2},
+        {(void *)path, strlen(path)},
+        {"/", name ? 1 : 0},
+        {(void *)(name ? name : ""), name ? strlen(name) : 0},
+        {"\": ", 3},
+        {(void *)reason, strlen(reason)},
+    };
+    pthread_mutex_lock(&walk->outputMutex);
+    writev(STDERR_FILENO, parts, 8);
+    write(STDERR_FILENO, "\n", 1);
+    pthread_mutex_unlock(&walk->outputMutex);
+    atomic_fetch_add(&walk->errors, 1);
+}
+
+static WalkDir *newWalkDir(const char *path, const char *name, WalkDir *parent)
+{
+    size_t pathLength = strlen(path);
+    size_t nameLength = name ? strlen(name) : 0;
+    WalkDir *dir = malloc(sizeof(WalkDir) + pathLength + nameLength + 2);
+    if (dir == NULL)
+    {
+        return NULL;
+    }
+    dir->path = (char *)(dir + 1);
+    memcpy(dir->path, path, pathLength);
+    dir->name = dir->path;
+    if (name)
+    {
+        dir->path[pathLength] = '/';
+        memcpy(dir->path + pathLength + 1, name, nameLength);
+        dir->name = dir->path + pathLength + 1;
+        pathLength += nameLength + 1;
+    }
+    dir->path[pathLength] = '\0';
+    dir->parent = parent;
+    dir->fd = -1;
+    atomic_init(&dir->fdRefs, 1);
+    atomic_init(&dir->refs, 1);
+    dir->next = NULL;
+    return dir;
+}
+
+static void pushDir(Walk *walk, WalkDir *dir)
+{
+    pthread_mutex_lock(&walk->mutex);
+    dir->next = walk->stack;
+    walk->stack = dir;
+    pthread_cond_signal(&walk->cond);
+    pthread_mutex_unlock(&walk->mutex);
+}
+
+/* WALK_DELETE: remove a directory whose contents are gone, through its parent.
+ * The parent is opened as ".." from dirFd, a descriptor of dir, and returned
+ * (or -1) so that it can be removed in turn. */
+static int removeDir(Walk *walk, WalkDir *dir, int dirFd)
+{
+    if (dir->parent == NULL)
+    {
+        if (rmdir(dir->path) == -1)
+            reportError(walk, "removing directory", dir->path, NULL, errno);
+        return -1;
+    }
+    int parentFd = openat(dirFd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (parentFd == -1 || unlinkat(parentFd, dir->name, AT_REMOVEDIR) == -1)
+        reportError(walk, "removing directory", dir->path, NULL, errno);
+    else
+        atomic_fetch_add(&walk->matches, 1);
+    return parentFd;
+}
+
+/* Drop one refs reference; the last one frees dir (WALK_DELETE: after removing it,
+ * then passes the reference on to its parent). dirFd is a descriptor of dir held
+ * by the caller, or -1 if the last reference cannot be dropped by this call. */
+static void releaseDir(Walk *walk, WalkDir *dir, int dirFd)
+{
+    int openedFd = -1; /* Parent descriptor opened by removeDir */
+    while (dir != NULL && atomic_fetch_sub(&dir->refs, 1) == 1)
+    {
+        WalkDir *parent = NULL;
+        int parentFd = -1;
+        if (walk->mode == WALK_DELETE)
+        {
+            parent = dir->parent;
+            parentFd = removeDir(walk, dir, dirFd);
+        }
+        free(dir);
+        if (openedFd != -1)
+            close(openedFd);
+        openedFd = dirFd = parentFd;
+        dir = parent;
+    }
+    if (openedFd != -1)
+        close(openedFd);
+}
+
+/* Drop one fdRefs reference; the last one closes the descriptor. The reference
+ * that the open descriptor holds on dir is dropped first, while it can still be
+ * used to remove dir. */
+static void releaseDirFd(Walk *walk, WalkDir *dir)
+{
+    if (atomic_fetch_sub(&dir->fdRefs, 1) == 1)
+    {
+        int fd = dir->fd;
+        releaseDir(walk, dir, fd);
+        close(fd);
+    }
+}
+
+/* Map a stat() mode to the matching d_type */
+static unsigned char modeToType(mode_t mode)
+{
+    if (S_ISDIR(mode))
+        return DT_DIR;
+    if (S_ISREG(mode))
+        return DT_REG;
+    if (S_ISLNK(mode))
+        return DT_LNK;
+    return DT_UNKNOWN;
+}
+
+static const char *typeSuffix(unsigned char type)
+{
+    switch (type)
+    {
+    case DT_DIR:
+        return " [Directory]";
+    case DT_REG:
+        return " [File]";
+    default:
+        return " [Other]";
+    }
+}
+
+/* Read one directory in large getdents64 batches. The type comes from d_type;
+ * only file systems that do not fill it in cost an fstatat() per entry. */
+static void scanDirectory(Walk *walk, WalkDir *dir, OutputBuffer *out, char *dents)
+{
+    atomic_fetch_add(&walk->directories, 1);
+
+    WalkDir *parent = dir->parent;
+    int fd;
+    if (parent == NULL)
+        fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    else
+        fd = openat(parent->fd, dir->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1)
+    {
+        /* Its contents cannot be removed either, so the parent's removal fails in turn */
+        reportError(walk, "opening directory", dir->path, NULL, errno);
+        free(dir);
+        if (parent != NULL)
+        {
+            if (walk->mode == WALK_DELETE)
+                releaseDir(walk, parent, parent->fd);
+            releaseDirFd(walk, parent);
+        }
+        return;
+    }
+    dir->fd = fd;
+    if (parent != NULL)
+    {
+        if (walk->mode != WALK_DELETE)
+            dir->parent = NULL; /* Only needed for the open */
+        releaseDirFd(walk, parent);
+    }
+
+    for (;;)
+    {
+        long n = syscall(SYS_getdents64, fd, dents, DENTS_BUFFER_SIZE);
+        if (n == -1)
+        {
+            reportError(walk, "reading directory", dir->path, NULL, errno);
+            break;
+        }
+        if (n == 0)
+        {
+            break;
+        }
+
+        for (long pos = 0; pos < n;)
+        {
+            struct linuxDirent64 *entry = (struct linuxDirent64 *)(dents + pos);
+            pos += entry->d_reclen;
+
+            const char *name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            {
+                continue;
+            }
+
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN)
+            {
+                struct stat st;
+                if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+                {
+                    type = modeToType(st.st_mode);
+                }
+            }
+            atomic_fetch_add(&walk->entries, 1);
+
+            if (type == DT_DIR)
+            {
+                WalkDir *child = newWalkDir(dir->path, name, dir);
+                if (child == NULL)
+                {
+                    reportError(walk, "queueing directory", dir->path, name, ENOMEM);
+                    continue;
+                }
+                atomic_fetch_add(&dir->fdRefs, 1);
+                if (walk->mode == WALK_DELETE)
+                {
+                    atomic_fetch_add(&dir->refs, 1);
+                }
+                pushDir(walk, child);
+            }
+
+            switch (walk->mode)
+            {
+            case WALK_LIST:
+                outputLine(walk, out, dir->path, name, typeSuffix(type));
+                break;
+            case WALK_FILTER:
+            {
+                const char *fileExt = strrchr(name, '.');
+                if (fileExt != NULL && strcmp(fileExt, walk->extension) == 0)
+                {
+                    outputLine(walk, out, dir->path, name, "");
+                    atomic_fetch_add(&walk->matches, 1);
+                }
+                break;
+            }
+            case WALK_DELETE:
+                if (type != DT_DIR)
+                {
+                    if (unlinkat(fd, name, 0) == -1)
+                        reportError(walk, "deleting", dir->path, name, errno);
+                    else
+                        atomic_fetch_add(&walk->matches, 1);
+                }
+                break;
+            }
+        }
+    }
+
+    releaseDirFd(walk, dir);
+}
+
+static void *walkWorker(void *arg)
+{
+    Walk *walk = arg;
+    OutputBuffer *out = malloc(sizeof(OutputBuffer));
+    char *dents = malloc(DENTS_BUFFER_SIZE);
+    if (out == NULL || dents == NULL)
+    {
+        free(out);
+        free(dents);
+        return NULL; /* The other threads take over the work */
+    }
+    out->used = 0;
+
+    pthread_mutex_lock(&walk->mutex);
+    for (;;)
+    {
+        while (walk->stack == NULL && !walk->done)
+        {
+            pthread_cond_wait(&walk->cond, &walk->mutex);
+        }
+        if (walk->done)
+        {
+            break;
+        }
+
+        WalkDir *dir = walk->stack;
+        walk->stack = dir->next;
+        walk->active++;
+        pthread_mutex_unlock(&walk->mutex);
+
+        scanDirectory(walk, dir, out, dents);
+
+        pthread_mutex_lock(&walk->mutex);
+        walk->active--;
+        if (walk->stack == NULL && walk->active == 0)
+        {
+            /* Nothing queued and nobody left to queue more */
+            walk->done = 1;
+            pthread_cond_broadcast(&walk->cond);
+        }
+    }
+    pthread_mutex_unlock(&walk->mutex);
+
+    flushOutput(walk, out);
+    free(out);
+    free(dents);
+    return NULL;
+}
+
+/* Walk the tree below root with a pool of threads, streaming output to stdout */
+int walkDirectory(const char *root, WalkMode mode, const char *extension, WalkStats *stats)
+{
+    Walk walk = {.mode = mode, .extension = extension};
+    pthread_mutex_init(&walk.mutex, NULL);
+    pthread_cond_init(&walk.cond, NULL);
+    pthread_mutex_init(&walk.outputMutex, NULL);
+    atomic_init(&walk.entries, 0);
+    atomic_init(&walk.directories, 0);
+    atomic_init(&walk.matches, 0);
+    atomic_init(&walk.errors, 0);
+
+    /* "dir/" would otherwise print as "dir//name" */
+    size_t rootLength = strlen(root);
+    while (rootLength > 1 && root[rootLength - 1] == '/')
+    {
+        rootLength--;
+    }
+    char *rootPath = strndup(root, rootLength);
+    WalkDir *rootDir = rootPath ? newWalkDir(rootPath, NULL, NULL) : NULL;
+    free(rootPath);
+    if (rootDir == NULL)
+    {
+        return -1;
+    }
+    walk.stack = rootDir;
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int numThreads = cpus < WALK_MIN_THREADS ? WALK_MIN_THREADS : cpus > WALK_MAX_THREADS ? WALK_MAX_THREADS : (int)cpus;
+    pthread_t threads[WALK_MAX_THREADS];
+    int started = 0;
+    for (int i = 0; i < numThreads; i++)
+    {
+        if (pthread_create(&threads[started], NULL, walkWorker, &walk) == 0)
+        {
+            started++;
+        }
+    }
+    if (started == 0)
+    {
+        /* No threads available: walk on the calling thread */
+        walkWorker(&walk);
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&walk.mutex);
+    pthread_cond_destroy(&walk.cond);
+    pthread_mutex_destroy(&walk.outputMutex);
+
+    stats->entries = atomic_load(&walk.entries);
+    stats->directories = atomic_load(&walk.directories);
+    stats->matches = atomic_load(&walk.matches);
+    stats->errors = atomic_load(&walk.errors);
+    return stats->errors == 0 ? 0 : -1;
+}
@@ -0,0 +1,25 @@
+#ifndef WALKER_H
+#define WALKER_H
+
+/* What the walker does with every entry below the root */
+typedef enum
+{
+    WALK_LIST,   /* Print every entry with its type */
+    WALK_FILTER, /* Print entries whose name ends in the extension */
+    WALK_DELETE  /* Remove every entry, then the directories bottom-up */
+} WalkMode;
+
+/* Counters filled in by walkDirectory */
+typedef struct
+{
+    long entries;     /* Entries seen below the root */
+    long directories; /* Directories scanned, including the root */
+    long matches;     /* WALK_FILTER: entries printed, WALK_DELETE: entries removed */
+    long errors;      /* Entries or directories that could not be handled */
+} WalkStats;
+
+/* Walk the tree below root with a pool of threads, streaming output to stdout.
+ * Returns 0 if every entry was handled, -1 otherwise. */
+int walkDirectory(const char *root, WalkMode mode, const char *extension, WalkStats *stats);
+
+#endif /* WALKER_H */
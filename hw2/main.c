@@ -9,17 +9,63 @@
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/signalfd.h>
 
 #define FIFO1 "/tmp/fifo1"
 #define FIFO2 "/tmp/fifo2"
 #define DAEMON_LOG "/tmp/daemon.log"
 #define LOG_FIFO "/tmp/log_fifo"
+#define POOL_JOB_FIFO "/tmp/pool_job_%d"       // Parent -> worker i
+#define POOL_RESULT_FIFO "/tmp/pool_result_%d" // Worker i -> parent
+
+// Log records: every record is sent with a single write() of at most PIPE_BUF
+// bytes, so records from different writers never interleave in the FIFO
+#define LOG_RECORD_MAGIC 0x4C47
+#define LOG_FIFO_READ_SIZE (16 * PIPE_BUF) // Holds a full pipe in one read
+
+// Daemon log file: lines are collected in a buffer and written together
+#define LOG_BUFFER_SIZE 65536         // Buffered bytes that force a write
+#define LOG_FLUSH_MS 200              // Longest time a line stays buffered
+#define LOG_MAX_SIZE (1024 * 1024)    // Rotate once the log reaches this size
+#define LOG_ROTATE_SECONDS (24 * 3600) // Rotate a log that is older than this
+#define LOG_KEEP 3                    // Rotated logs kept (daemon.log.1 .. .3)
+
+typedef struct
+{
+    uint16_t magic;  // LOG_RECORD_MAGIC, used to detect unframed data
+    uint16_t length; // Length of the text that follows
+    pid_t pid;       // Process that sent the record
+    time_t time;     // When the record was sent
+} log_record_header;
+
+#define LOG_RECORD_MAX (PIPE_BUF - sizeof(log_record_header))
+
+typedef struct
+{
+    log_record_header header;
+    char text[LOG_RECORD_MAX];
+} log_record;
+
+_Static_assert(sizeof(log_record) <= PIPE_BUF, "log records must be written atomically");
+
+typedef struct
+{
+    int fd;                        // Current log file
+    off_t size;                    // Bytes in the current log file
+    time_t opened;                 // When the current log file was started
+    struct timespec first_pending; // When the oldest buffered line was added
+    size_t used;                   // Bytes in data
+    char data[LOG_BUFFER_SIZE];    // Formatted lines not yet written
+} log_writer;
 
 // Global variables
 int num_children = 2;
 int child_counter = 0;
 pid_t daemon_pid = 0;
-int global_log_fifo_fd = -1;
 volatile sig_atomic_t daemon_running = 1;
 
 // Signal handler for SIGCHLD
@@ -44,48 +90,246 @@ void sigchld_handler(int sig __attribute__((unused)))
     }
 }
 
-// Signal handler for daemon termination
-void daemon_sigterm_handler(int sig __attribute__((unused)))
+// Sends one record to the daemon; the text is truncated to LOG_RECORD_MAX bytes
+// so the whole record goes out in a single atomic write
+void send_log(int fd, const char *format, ...)
+{
+    log_record record;
+    va_list args;
+
+    va_start(args, format);
+    int n = vsnprintf(record.text, sizeof(record.text), format, args);
+    va_end(args);
+    if (n < 0)
+    {
+        return;
+    }
+    if ((size_t)n >= sizeof(record.text))
+    {
+        n = sizeof(record.text) - 1;
+    }
+
+    record.header.magic = LOG_RECORD_MAGIC;
+    record.header.length = (uint16_t)n;
+    record.header.pid = getpid();
+    record.header.time = time(NULL);
+
+    size_t size = sizeof(record.header) + (size_t)n;
+    while (write(fd, &record, size) < 0 && errno == EINTR)
+    {
+        // Retry writes interrupted by SIGCHLD
+    }
+}
+
+// Opens DAEMON_LOG for appending and points stdout/stderr at it, so stray
+// output of the daemon also ends up in the current log
+int open_log_file(log_writer *log)
+{
+    log->fd = open(DAEMON_LOG, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (log->fd < 0)
+    {
+        perror("Failed to open daemon log file");
+        return -1;
+    }
+
+    struct stat st;
+    log->size = (fstat(log->fd, &st) == 0) ? st.st_size : 0;
+    log->opened = time(NULL);
+
+    dup2(log->fd, STDOUT_FILENO);
+    dup2(log->fd, STDERR_FILENO);
+    return 0;
+}
+
+// Shifts daemon.log -> daemon.log.1 -> ... -> daemon.log.LOG_KEEP and starts a new log
+void rotate_log_file(log_writer *log)
+{
+    char old_path[64], new_path[64];
+
+    close(log->fd);
+    for (int i = LOG_KEEP - 1; i >= 1; i--)
+    {
+        snprintf(old_path, sizeof(old_path), "%s.%d", DAEMON_LOG, i);
+        snprintf(new_path, sizeof(new_path), "%s.%d", DAEMON_LOG, i + 1);
+        rename(old_path, new_path);
+    }
+    snprintf(new_path, sizeof(new_path), "%s.1", DAEMON_LOG);
+    rename(DAEMON_LOG, new_path);
+
+    if (open_log_file(log) < 0)
+    {
+        // Keep logging to the rotated file rather than losing lines
+        log->fd = open(new_path, O_WRONLY | O_APPEND | O_CLOEXEC);
+    }
+}
+
+// Writes the buffered lines with one write() and rotates the log if it is due
+void flush_log(log_writer *log)
 {
-    // Log termination
-    time_t now;
-    char time_str[100];
-    time(&now);
-    strftime(time_str, sizeof(time_str), "[%Y-%m-%d %H:%M:%S]", localtime(&now));
-    fprintf(stderr, "%s Daemon received SIGTERM, shutting down gracefully\n", time_str);
+    size_t written = 0;
+    while (written < log->used)
+    {
+        ssize_t n = write(log->fd, log->data + written, log->used - written);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break; // Nowhere left to report the error; drop the lines
+        }
+        written += (size_t)n;
+    }
+    log->size += (off_t)written;
+    log->used = 0;
 
-    // Close resources
-    if (global_log_fifo_fd >= 0)
+    if (log->size >= LOG_MAX_SIZE || (log->size > 0 && time(NULL) - log->opened >= LOG_ROTATE_SECONDS))
     {
-        close(global_log_fifo_fd);
+        rotate_log_file(log);
     }
+}
 
-    // Set flag to exit the main loop
-    daemon_running = 0;
+// Milliseconds until the oldest buffered line must be written, -1 if the buffer is empty
+int ms_until_flush(const log_writer *log)
+{
+    if (log->used == 0)
+    {
+        return -1;
+    }
 
-    // Forcefully exit to ensure termination
-    _exit(EXIT_SUCCESS);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long elapsed = (now.tv_sec - log->first_pending.tv_sec) * 1000 +
+                   (now.tv_nsec - log->first_pending.tv_nsec) / 1000000;
+    return (elapsed >= LOG_FLUSH_MS) ? 0 : (int)(LOG_FLUSH_MS - elapsed);
 }
 
-// Signal handler for daemon reconfiguration
-void daemon_sighup_handler(int sig __attribute__((unused)))
+// Formats one line into the buffer, writing the buffer out first if it is full
+void append_log_line(log_writer *log, time_t when, pid_t pid, const char *text, size_t length)
 {
-    time_t now;
-    char time_str[100];
-    time(&now);
-    strftime(time_str, sizeof(time_str), "[%Y-%m-%d %H:%M:%S]", localtime(&now));
-    fprintf(stderr, "%s Daemon received SIGHUP, reconfiguring\n", time_str);
+    // Formatting the timestamp is the expensive part, so reuse it within a second
+    static time_t cached_time = -1;
+    static char time_str[32];
+
+    // Drop the trailing newline of senders that still add one
+    if (length > 0 && text[length - 1] == '\n')
+    {
+        length--;
+    }
 
-    // In a real implementation, this would reload configuration files
+    if (log->used + sizeof(time_str) + 32 + length + 1 > sizeof(log->data))
+    {
+        flush_log(log);
+    }
+    if (log->used == 0)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &log->first_pending);
+    }
+
+    if (when != cached_time)
+    {
+        strftime(time_str, sizeof(time_str), "[%Y-%m-%d %H:%M:%S]", localtime(&when));
+        cached_time = when;
+    }
+
+    char *out = log->data + log->used;
+    int n = snprintf(out, sizeof(log->data) - log->used, "%s [PID %d] %.*s\n",
+                     time_str, (int)pid, (int)length, text);
+    log->used += (size_t)n;
+}
+
+// Adds a message of the daemon itself to the log
+void daemon_log(log_writer *log, const char *format, ...)
+{
+    char text[512];
+    va_list args;
+
+    va_start(args, format);
+    int n = vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    if (n < 0)
+    {
+        return;
+    }
+    if ((size_t)n >= sizeof(text))
+    {
+        n = sizeof(text) - 1;
+    }
+    append_log_line(log, time(NULL), getpid(), text, (size_t)n);
+}
+
+// Turns the bytes read from the FIFO into log lines and returns how many bytes
+// of an incomplete record are left at the start of the buffer
+size_t parse_log_records(log_writer *log, char *data, size_t used)
+{
+    size_t pos = 0;
+
+    while (used - pos >= sizeof(log_record_header))
+    {
+        log_record_header header;
+        memcpy(&header, data + pos, sizeof(header));
+
+        if (header.magic != LOG_RECORD_MAGIC || header.length > LOG_RECORD_MAX)
+        {
+            // Records cannot be found again inside foreign data, so drop all of it
+            daemon_log(log, "Discarding %zu bytes of unframed data from the log FIFO", used - pos);
+            return 0;
+        }
+        if (used - pos < sizeof(header) + header.length)
+        {
+            break;
+        }
+
+        append_log_line(log, header.time, header.pid, data + pos + sizeof(header), header.length);
+        pos += sizeof(header) + header.length;
+    }
+
+    memmove(data, data + pos, used - pos);
+    return used - pos;
+}
+
+// Reads everything currently in the FIFO; returns 0 once all writers have
+// closed it, 1 otherwise
+int read_log_fifo(log_writer *log, int fifo_fd, char *data, size_t *used)
+{
+    while (1)
+    {
+        ssize_t n = read(fifo_fd, data + *used, LOG_FIFO_READ_SIZE - *used);
+        if (n > 0)
+        {
+            *used = parse_log_records(log, data, *used + (size_t)n);
+            continue;
+        }
+        if (n == 0)
+        {
+            return 0;
+        }
+        if (errno == EINTR)
+        {
+            continue;
+        }
+        if (errno != EAGAIN)
+        {
+            daemon_log(log, "Failed to read log FIFO: %s", strerror(errno));
+        }
+        return 1;
+    }
 }
 
 // Daemon process code
 void run_daemon()
 {
-    time_t now;
-    char time_str[100];
+    static log_writer log;
+    static char fifo_data[LOG_FIFO_READ_SIZE];
+    size_t fifo_used = 0;
     int log_fifo_fd;
 
+    // Redirect standard output and error to the log file
+    if (open_log_file(&log) < 0)
+    {
+        exit(EXIT_FAILURE);
+    }
+
     // Create and open the log FIFO - make sure it exists
     unlink(LOG_FIFO); // Remove if exists
     if (mkfifo(LOG_FIFO, 0666) < 0)
@@ -94,7 +338,30 @@ void run_daemon()
         exit(EXIT_FAILURE);
     }
 
-    fprintf(stderr, "Daemon: Opening log FIFO for reading\n");
+    // Block the signals the daemon handles and receive them through a signalfd,
+    // so they are handled in the event loop instead of interrupting it
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGALRM);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0)
+    {
+        fprintf(stderr, "Daemon: Failed to block signals: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    int signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signal_fd < 0)
+    {
+        fprintf(stderr, "Daemon: Failed to create signalfd: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    signal(SIGUSR1, SIG_IGN); // Can be implemented later if needed
+
+    daemon_log(&log, "Daemon: Opening log FIFO for reading");
+    flush_log(&log);
 
     // Open the log FIFO - blocking open to ensure synchronization with parent
     if ((log_fifo_fd = open(LOG_FIFO, O_RDONLY)) < 0)
@@ -103,84 +370,441 @@ void run_daemon()
         exit(EXIT_FAILURE);
     }
 
-    // Save to global for signal handlers
-    global_log_fifo_fd = log_fifo_fd;
-
-    // Set to non-blocking after opening
+    // Non-blocking after opening, so a wakeup can drain the whole FIFO
     int flags = fcntl(log_fifo_fd, F_GETFL, 0);
     fcntl(log_fifo_fd, F_SETFL, flags | O_NONBLOCK);
-    // Non-blocking mode is used to prevent the daemon from hanging indefinitely
-    // while waiting for input. This allows the daemon to perform other tasks
-    // and check for termination signals between read attempts.
-
-    // Set up signal handlers using sigaction for more reliability
-    struct sigaction sa_term, sa_hup, sa_alrm;
-
-    // SIGTERM handler
-    memset(&sa_term, 0, sizeof(sa_term));
-    sa_term.sa_handler = daemon_sigterm_handler;
-    sigaction(SIGTERM, &sa_term, NULL);
-
-    // SIGHUP handler
-    memset(&sa_hup, 0, sizeof(sa_hup));
-    sa_hup.sa_handler = daemon_sighup_handler;
-    sigaction(SIGHUP, &sa_hup, NULL);
-
-    // SIGALRM handler - use same as SIGTERM
-    memset(&sa_alrm, 0, sizeof(sa_alrm));
-    sa_alrm.sa_handler = daemon_sigterm_handler;
-    sigaction(SIGALRM, &sa_alrm, NULL);
-
-    // Other signals
-    signal(SIGUSR1, SIG_IGN);               // Can be implemented later if needed
-    signal(SIGINT, daemon_sigterm_handler); // Handle Ctrl+C as well
-
-    // Initialize daemon monitoring structures
-    time(&now);
-    strftime(time_str, sizeof(time_str), "[%Y-%m-%d %H:%M:%S]", localtime(&now));
-    fprintf(stderr, "%s Daemon started with PID: %d\n", time_str, getpid());
-
-    // Main daemon loop
-    char buffer[1024];
+
+    daemon_log(&log, "Daemon started with PID: %d", getpid());
+
     // Set up an alarm as a safety mechanism
     alarm(60); // Force termination after 60 seconds if other mechanisms fail
 
+    // Main daemon loop: sleep until a record arrives, a signal is delivered or
+    // the oldest buffered line is due to be written
+    struct pollfd fds[2] = {
+        {.fd = log_fifo_fd, .events = POLLIN},
+        {.fd = signal_fd, .events = POLLIN},
+    };
     while (daemon_running)
     {
-        time(&now);
-        strftime(time_str, sizeof(time_str), "[%Y-%m-%d %H:%M:%S]", localtime(&now));
-
-        // Non-blocking read from the log FIFO
-        int n = read(log_fifo_fd, buffer, sizeof(buffer) - 1);
-        if (n > 0)
+        if (poll(fds, 2, ms_until_flush(&log)) < 0)
         {
-            buffer[n] = '\0';
-            fprintf(stderr, "%s %s", time_str, buffer);
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            daemon_log(&log, "poll failed: %s", strerror(errno));
+            break;
         }
-        else if (n == 0)
+
+        // Records first, so lines sent before a signal are logged before it
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR))
         {
-            // EOF on FIFO - all writers have closed, we can exit
-            fprintf(stderr, "%s All writers closed FIFO, daemon exiting\n", time_str);
-            daemon_running = 0;
-            break;
+            if (read_log_fifo(&log, log_fifo_fd, fifo_data, &fifo_used) == 0)
+            {
+                // EOF on FIFO - all writers have closed, we can exit
+                daemon_log(&log, "All writers closed FIFO, daemon exiting");
+                daemon_running = 0;
+            }
         }
 
-        // Check for any inactive child processes (timeout mechanism)
-        // This is a simple implementation - a real one might be more complex
+        if (fds[1].revents & POLLIN)
+        {
+            struct signalfd_siginfo info;
+            while (read(signal_fd, &info, sizeof(info)) == sizeof(info))
+            {
+                if (info.ssi_signo == SIGHUP)
+                {
+                    // The log may have been moved away; continue in a fresh DAEMON_LOG
+                    daemon_log(&log, "Daemon received SIGHUP, reopening log file");
+                    flush_log(&log);
+                    close(log.fd);
+                    open_log_file(&log);
+                }
+                else if (info.ssi_signo == SIGCHLD)
+                {
+                    while (waitpid(-1, NULL, WNOHANG) > 0)
+                        ;
+                }
+                else
+                {
+                    const char *name = (info.ssi_signo == SIGTERM) ? "SIGTERM" : (info.ssi_signo == SIGINT) ? "SIGINT" : "SIGALRM";
+                    daemon_log(&log, "Daemon received %s, shutting down gracefully", name);
+                    daemon_running = 0;
+                }
+                if (!daemon_running)
+                {
+                    break;
+                }
+            }
+        }
 
-        // Sleep for a bit before checking again
-        usleep(500000); // 500 ms
+        if (ms_until_flush(&log) == 0)
+        {
+            flush_log(&log);
+        }
     }
 
+    // Keep the records that were sent just before the shutdown signal
+    read_log_fifo(&log, log_fifo_fd, fifo_data, &fifo_used);
+
     // Final cleanup
-    time(&now);
-    strftime(time_str, sizeof(time_str), "[%Y-%m-%d %H:%M:%S]", localtime(&now));
-    fprintf(stderr, "%s Daemon exiting cleanly\n", time_str);
+    daemon_log(&log, "Daemon exiting cleanly");
+    flush_log(&log);
 
     close(log_fifo_fd);
+    close(signal_fd);
+    close(log.fd);
+    exit(EXIT_SUCCESS);
+}
+
+// Worker pool mode: long-lived workers read a stream of jobs from their own
+// FIFO and answer on a second one, so fork and FIFO open happen once per
+// worker instead of once per computation
+#define POOL_MAX_WORKERS 64
+#define POOL_WINDOW 512             // Jobs in flight per worker; keeps both FIFOs below capacity
+#define POOL_IO_SIZE PIPE_BUF       // Frames are collected into writes of this size
+#define POOL_MAX_VALUES 16          // Largest job a worker accepts
+
+// A job is a job_header followed by length bytes of int values
+typedef struct
+{
+    uint32_t length; // Bytes of values that follow
+    uint32_t seq;    // Sequence number, echoed in the result
+} job_header;
+
+typedef struct
+{
+    uint32_t seq; // Sequence number of the job
+    int larger;   // Largest value of the job
+} job_result;
+
+typedef struct
+{
+    pid_t pid;
+    int job_fd;                   // Write end of the job FIFO
+    int result_fd;                // Read end of the result FIFO
+    size_t job_used;              // Bytes in job_data
+    char job_data[POOL_IO_SIZE];  // Jobs not yet written
+    size_t result_pos;            // First unread byte in result_data
+    size_t result_used;           // Bytes in result_data
+    char result_data[POOL_IO_SIZE];
+} pool_worker;
+
+// Writes all of data, retrying short writes and interrupted calls
+int write_all(int fd, const void *data, size_t size)
+{
+    const char *p = data;
+    while (size > 0)
+    {
+        ssize_t n = write(fd, p, size);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+// Worker side: answers jobs until the parent closes the job FIFO. Results are
+// collected and written whenever the worker is about to wait for more jobs.
+void run_pool_worker(int id)
+{
+    char path[64];
+    char in[POOL_IO_SIZE];
+    job_result out[POOL_IO_SIZE / sizeof(job_result)];
+    size_t in_used = 0, out_count = 0;
+
+    // Same open order as the parent (jobs first), so the rendezvous cannot deadlock
+    snprintf(path, sizeof(path), POOL_JOB_FIFO, id);
+    int job_fd = open(path, O_RDONLY);
+    snprintf(path, sizeof(path), POOL_RESULT_FIFO, id);
+    int result_fd = (job_fd < 0) ? -1 : open(path, O_WRONLY);
+    if (job_fd < 0 || result_fd < 0)
+    {
+        perror("Worker: Cannot open pool FIFOs");
+        exit(EXIT_FAILURE);
+    }
+
+    while (1)
+    {
+        size_t pos = 0;
+        while (in_used - pos >= sizeof(job_header))
+        {
+            job_header header;
+            memcpy(&header, in + pos, sizeof(header));
+            if (header.length == 0 || header.length % sizeof(int) != 0 ||
+                header.length > POOL_MAX_VALUES * sizeof(int))
+            {
+                fprintf(stderr, "Worker %d: Malformed job %u\n", id, header.seq);
+                exit(EXIT_FAILURE);
+            }
+            if (in_used - pos < sizeof(header) + header.length)
+            {
+                break;
+            }
+
+            int values[POOL_MAX_VALUES];
+            memcpy(values, in + pos + sizeof(header), header.length);
+            int larger = values[0];
+            for (size_t i = 1; i < header.length / sizeof(int); i++)
+            {
+                larger = (values[i] > larger) ? values[i] : larger;
+            }
+
+            out[out_count].seq = header.seq;
+            out[out_count].larger = larger;
+            if (++out_count == sizeof(out) / sizeof(out[0]))
+            {
+                if (write_all(result_fd, out, sizeof(out)) < 0)
+                {
+                    exit(EXIT_FAILURE);
+                }
+                out_count = 0;
+            }
+            pos += sizeof(header) + header.length;
+        }
+        memmove(in, in + pos, in_used - pos);
+        in_used -= pos;
+
+        // No complete job left: send what we have before blocking
+        if (out_count > 0)
+        {
+            if (write_all(result_fd, out, out_count * sizeof(job_result)) < 0)
+            {
+                exit(EXIT_FAILURE);
+            }
+            out_count = 0;
+        }
+
+        ssize_t n = read(job_fd, in + in_used, sizeof(in) - in_used);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break; // Parent closed the job FIFO
+        }
+        in_used += (size_t)n;
+    }
+
+    close(job_fd);
+    close(result_fd);
     exit(EXIT_SUCCESS);
 }
 
+// Sends the jobs collected for a worker
+int flush_pool_jobs(pool_worker *worker)
+{
+    if (worker->job_used == 0)
+    {
+        return 0;
+    }
+    int ret = write_all(worker->job_fd, worker->job_data, worker->job_used);
+    worker->job_used = 0;
+    return ret;
+}
+
+// Reads the next result of a worker; results of one worker arrive in job order
+int read_pool_result(pool_worker *worker, job_result *result)
+{
+    while (worker->result_used - worker->result_pos < sizeof(job_result))
+    {
+        memmove(worker->result_data, worker->result_data + worker->result_pos,
+                worker->result_used - worker->result_pos);
+        worker->result_used -= worker->result_pos;
+        worker->result_pos = 0;
+
+        ssize_t n = read(worker->result_fd, worker->result_data + worker->result_used,
+                         sizeof(worker->result_data) - worker->result_used);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        worker->result_used += (size_t)n;
+    }
+    memcpy(result, worker->result_data + worker->result_pos, sizeof(job_result));
+    worker->result_pos += sizeof(job_result);
+    return 0;
+}
+
+double elapsed_seconds(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Runs num_jobs "larger number" computations on a pool of workers and reports jobs/sec.
+// Job i goes to worker i % num_workers, so reading the workers in turn returns
+// the results in job order.
+int run_pool(int num_workers, int num_jobs)
+{
+    static pool_worker workers[POOL_MAX_WORKERS];
+    char path[64];
+    struct timespec start;
+    int status = EXIT_SUCCESS;
+
+    // Writing to a worker that died must fail with EPIPE, not kill the parent
+    signal(SIGPIPE, SIG_IGN);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < num_workers; i++)
+    {
+        snprintf(path, sizeof(path), POOL_JOB_FIFO, i);
+        unlink(path);
+        int ret = mkfifo(path, 0666);
+        snprintf(path, sizeof(path), POOL_RESULT_FIFO, i);
+        unlink(path);
+        if (ret < 0 || mkfifo(path, 0666) < 0)
+        {
+            perror("Failed to create pool FIFO");
+            num_workers = i + 1;
+            status = EXIT_FAILURE;
+            goto cleanup;
+        }
+
+        workers[i].pid = fork();
+        if (workers[i].pid < 0)
+        {
+            perror("Fork for pool worker failed");
+            num_workers = i + 1;
+            status = EXIT_FAILURE;
+            goto cleanup;
+        }
+        if (workers[i].pid == 0)
+        {
+            run_pool_worker(i); // Does not return
+        }
+    }
+
+    for (int i = 0; i < num_workers; i++)
+    {
+        snprintf(path, sizeof(path), POOL_JOB_FIFO, i);
+        workers[i].job_fd = open(path, O_WRONLY);
+        snprintf(path, sizeof(path), POOL_RESULT_FIFO, i);
+        workers[i].result_fd = (workers[i].job_fd < 0) ? -1 : open(path, O_RDONLY);
+        if (workers[i].job_fd < 0 || workers[i].result_fd < 0)
+        {
+            perror("Parent: Cannot open pool FIFOs");
+            status = EXIT_FAILURE;
+            goto cleanup;
+        }
+    }
+    double setup_time = elapsed_seconds(&start);
+
+    // expected[seq % window] holds the answer of every job in flight
+    int window = POOL_WINDOW * num_workers;
+    int *expected = malloc((size_t)window * sizeof(int));
+    if (expected == NULL)
+    {
+        perror("Failed to allocate result window");
+        status = EXIT_FAILURE;
+        goto cleanup;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    unsigned int seed = 42;
+    int next_result = 0, wrong = 0;
+    for (int next_job = 0; next_job < num_jobs || next_result < num_jobs;)
+    {
+        if (next_job < num_jobs && next_job - next_result < window)
+        {
+            pool_worker *worker = &workers[next_job % num_workers];
+            int values[2] = {rand_r(&seed) % 100000, rand_r(&seed) % 100000};
+            job_header header = {.length = sizeof(values), .seq = (uint32_t)next_job};
+
+            if (worker->job_used + sizeof(header) + sizeof(values) > sizeof(worker->job_data) &&
+                flush_pool_jobs(worker) < 0)
+            {
+                perror("Parent: Failed to send jobs");
+                status = EXIT_FAILURE;
+                break;
+            }
+            memcpy(worker->job_data + worker->job_used, &header, sizeof(header));
+            memcpy(worker->job_data + worker->job_used + sizeof(header), values, sizeof(values));
+            worker->job_used += sizeof(header) + sizeof(values);
+
+            expected[next_job % window] = (values[0] > values[1]) ? values[0] : values[1];
+            next_job++;
+            continue;
+        }
+
+        // Window full or all jobs queued: make sure the workers have their jobs, then wait
+        int failed = 0;
+        for (int i = 0; i < num_workers; i++)
+        {
+            failed |= flush_pool_jobs(&workers[i]);
+        }
+        job_result result;
+        if (failed || read_pool_result(&workers[next_result % num_workers], &result) < 0)
+        {
+            fprintf(stderr, "Parent: Lost contact with pool worker %d\n", next_result % num_workers);
+            status = EXIT_FAILURE;
+            break;
+        }
+        if (result.seq != (uint32_t)next_result || result.larger != expected[next_result % window])
+        {
+            wrong++;
+        }
+        next_result++;
+    }
+    double job_time = elapsed_seconds(&start);
+    free(expected);
+
+    if (status == EXIT_SUCCESS)
+    {
+        printf("Pool of %d workers started in %.3f ms\n", num_workers, setup_time * 1000);
+        printf("%d jobs in %.3f s (%.0f jobs/sec), %d wrong results\n", num_jobs, job_time,
+               job_time > 0 ? num_jobs / job_time : 0.0, wrong);
+        if (wrong > 0)
+        {
+            status = EXIT_FAILURE;
+        }
+    }
+
+cleanup:
+    // Closing the job FIFOs ends the workers
+    for (int i = 0; i < num_workers; i++)
+    {
+        if (workers[i].job_fd > 0)
+        {
+            close(workers[i].job_fd);
+        }
+        if (workers[i].result_fd > 0)
+        {
+            close(workers[i].result_fd);
+        }
+        if (workers[i].pid > 0 && status != EXIT_SUCCESS)
+        {
+            kill(workers[i].pid, SIGTERM);
+        }
+    }
+    for (int i = 0; i < num_workers; i++)
+    {
+        if (workers[i].pid > 0)
+        {
+            waitpid(workers[i].pid, NULL, 0);
+        }
+        snprintf(path, sizeof(path), POOL_JOB_FIFO, i);
+        unlink(path);
+        snprintf(path, sizeof(path), POOL_RESULT_FIFO, i);
+        unlink(path);
+    }
+    return status;
+}
+
 int main(int argc, char *argv[])
 {
     int n1, n2;
@@ -188,10 +812,24 @@ int main(int argc, char *argv[])
     volatile int result = 0;
     pid_t child1_pid = 0, child2_pid = 0;
 
+    // Worker pool benchmark mode
+    if (argc == 4 && strcmp(argv[1], "--pool") == 0)
+    {
+        int num_workers = atoi(argv[2]);
+        int num_jobs = atoi(argv[3]);
+        if (num_workers < 1 || num_workers > POOL_MAX_WORKERS || num_jobs < 0)
+        {
+            fprintf(stderr, "Pool needs 1-%d workers and a non-negative job count\n", POOL_MAX_WORKERS);
+            exit(EXIT_FAILURE);
+        }
+        return run_pool(num_workers, num_jobs);
+    }
+
     // Check command line arguments
     if (argc != 3)
     {
         fprintf(stderr, "Usage: %s <num1> <num2>\n", argv[0]);
+        fprintf(stderr, "       %s --pool <workers> <jobs>\n", argv[0]);
         exit(EXIT_FAILURE);
     }
 
@@ -255,26 +893,10 @@ int main(int argc, char *argv[])
             exit(EXIT_FAILURE);
         }
 
-        // Redirect standard file descriptors to log file
-        int log_fd = open(DAEMON_LOG, O_WRONLY | O_CREAT | O_APPEND, 0644);
-        if (log_fd < 0)
-        {
-            perror("Failed to open daemon log file");
-            exit(EXIT_FAILURE);
-        }
-
-        dup2(log_fd, STDOUT_FILENO);
-        dup2(log_fd, STDERR_FILENO);
-
-        if (log_fd > STDERR_FILENO)
-        {
-            close(log_fd);
-        }
-
         // Close the unnecessary file descriptors
         close(STDIN_FILENO);
 
-        // Run the daemon
+        // Run the daemon (it redirects stdout/stderr to the log file itself)
         run_daemon();
         exit(EXIT_SUCCESS); // Should never reach here
     }
@@ -307,17 +929,14 @@ int main(int argc, char *argv[])
     }
 
     // Write a message to the log
-    char log_msg[256];
-    snprintf(log_msg, sizeof(log_msg), "Parent process started with PID: %d\n", getpid());
-    write(log_fifo_fd, log_msg, strlen(log_msg));
+    send_log(log_fifo_fd, "Parent process started with PID: %d", getpid());
 
     // Create first child process
     child1_pid = fork();
     if (child1_pid < 0)
     {
         perror("Fork for child1 failed");
-        snprintf(log_msg, sizeof(log_msg), "Fork for child1 failed: %s\n", strerror(errno));
-        write(log_fifo_fd, log_msg, strlen(log_msg));
+        send_log(log_fifo_fd, "Fork for child1 failed: %s", strerror(errno));
 
         // Kill daemon and clean up
         if (daemon_pid > 0)
@@ -384,8 +1003,7 @@ int main(int argc, char *argv[])
     if (child2_pid < 0)
     {
         perror("Fork for child2 failed");
-        snprintf(log_msg, sizeof(log_msg), "Fork for child2 failed: %s\n", strerror(errno));
-        write(log_fifo_fd, log_msg, strlen(log_msg));
+        send_log(log_fifo_fd, "Fork for child2 failed: %s", strerror(errno));
 
         // Kill the first child and daemon, then clean up
         if (child1_pid > 0)
@@ -438,8 +1056,7 @@ int main(int argc, char *argv[])
     if (fd1 < 0)
     {
         perror("Parent: Cannot open FIFO1 for writing");
-        snprintf(log_msg, sizeof(log_msg), "Cannot open FIFO1 for writing: %s\n", strerror(errno));
-        write(log_fifo_fd, log_msg, strlen(log_msg));
+        send_log(log_fifo_fd, "Cannot open FIFO1 for writing: %s", strerror(errno));
 
         // Kill children and daemon, then clean up
         if (child1_pid > 0)
@@ -464,18 +1081,15 @@ int main(int argc, char *argv[])
     // Parent process continues here
 
     // Log child creation
-    snprintf(log_msg, sizeof(log_msg), "Created Child 1 with PID: %d\n", child1_pid);
-    write(log_fifo_fd, log_msg, strlen(log_msg));
+    send_log(log_fifo_fd, "Created Child 1 with PID: %d", child1_pid);
 
-    snprintf(log_msg, sizeof(log_msg), "Created Child 2 with PID: %d\n", child2_pid);
-    write(log_fifo_fd, log_msg, strlen(log_msg));
+    send_log(log_fifo_fd, "Created Child 2 with PID: %d", child2_pid);
 
     // Write the integers to FIFO1
     if (write(fd1, &n1, sizeof(int)) < 0 || write(fd1, &n2, sizeof(int)) < 0)
     {
         perror("Parent: Failed to write to FIFO1");
-        snprintf(log_msg, sizeof(log_msg), "Failed to write to FIFO1: %s\n", strerror(errno));
-        write(log_fifo_fd, log_msg, strlen(log_msg));
+        send_log(log_fifo_fd, "Failed to write to FIFO1: %s", strerror(errno));
         close(fd1);
 
         // Kill children and daemon, then clean up
@@ -505,8 +1119,7 @@ int main(int argc, char *argv[])
     {
         printf("Proceeding... (counter: %d)\n", child_counter);
 
-        snprintf(log_msg, sizeof(log_msg), "Parent: Proceeding... (counter: %d)\n", child_counter);
-        write(log_fifo_fd, log_msg, strlen(log_msg));
+        send_log(log_fifo_fd, "Parent: Proceeding... (counter: %d)", child_counter);
 
         sleep(2); // Print message every 2 seconds
     }
@@ -514,8 +1127,7 @@ int main(int argc, char *argv[])
     // All children have exited, cleanup
     printf("All children have exited, cleaning up...\n");
 
-    snprintf(log_msg, sizeof(log_msg), "All children have exited, cleaning up...\n");
-    write(log_fifo_fd, log_msg, strlen(log_msg));
+    send_log(log_fifo_fd, "All children have exited, cleaning up...");
 
     // Wait a moment for messages to be processed
     // sleep(1);
@@ -524,8 +1136,7 @@ int main(int argc, char *argv[])
     // In the parent process, where daemon termination is handled
     if (daemon_pid > 0)
     {
-        snprintf(log_msg, sizeof(log_msg), "Sending SIGTERM to daemon (PID: %d)\n", daemon_pid);
-        write(log_fifo_fd, log_msg, strlen(log_msg));
+        send_log(log_fifo_fd, "Sending SIGTERM to daemon (PID: %d)", daemon_pid);
 
         // Close the log FIFO from parent side - this helps daemon detect EOF
         close(log_fifo_fd);
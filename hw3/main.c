@@ -6,15 +6,25 @@
 #include <time.h>
 #include <errno.h>
 #include <stdbool.h>
-
-// --- Settings for the Simulation ---
-#define NUM_ENGINEERS 5                // How many engineers we have
-#define NUM_SATELLITES 3               // How many satellites will connect
-#define CONNECTION_TIMEOUT 5           // Max time (seconds) a satellite waits for an engineer
-#define MAX_PRIORITY 5                 // Highest priority number (1 is best, 5 is lowest)
-#define MIN_WORK_TIME 1                // Shortest time an engineer takes (seconds)
-#define MAX_WORK_TIME 3                // Longest time an engineer takes (seconds)
-#define SATELLITE_ARRIVAL_DELAY_MS 200 // Small delay between satellite starts (milliseconds)
+#include <string.h>
+
+// --- Settings for the Simulation (defaults, can be changed on the command line) ---
+#define DEFAULT_NUM_ENGINEERS 5                // How many engineers we have (-e)
+#define DEFAULT_NUM_SATELLITES 3               // How many satellites will connect (-s)
+#define DEFAULT_CONNECTION_TIMEOUT 5           // Max time (seconds) a satellite waits for an engineer (-t)
+#define MAX_PRIORITY 5                         // Highest priority number (1 is best, 5 is lowest)
+#define DEFAULT_MIN_WORK_MS 1000               // Shortest time an engineer takes (milliseconds, -w)
+#define DEFAULT_MAX_WORK_MS 3000               // Longest time an engineer takes (milliseconds, -w)
+#define DEFAULT_SATELLITE_ARRIVAL_DELAY_MS 200 // Small delay between satellite starts (milliseconds, -d)
+#define SATELLITE_STACK_SIZE (64 * 1024)       // Satellites only wait, so a small stack lets thousands of them run
+
+// What happened to a request
+typedef enum
+{
+    REQUEST_WAITING,  // In the queue, nobody has picked it up yet
+    REQUEST_HANDLED,  // An engineer took it
+    REQUEST_TIMED_OUT // The timer expired it before an engineer got to it
+} RequestState;
 
 // Structure to hold satellite request details
 typedef struct SatelliteRequest
@@ -22,11 +32,23 @@ typedef struct SatelliteRequest
     int id;                          // Which satellite is this?
     int priority;                    // Its priority level (lower number = more important)
     time_t requestTime;              // When did it ask for help? (Just for info)
-    struct timespec timeoutDeadline; // Absolute time when the satellite gives up
-    bool handled;                    // Did an engineer pick this up or did it time out?
-    struct SatelliteRequest *next;   // Pointer for making a linked list (our queue)
+    struct timespec timeoutDeadline; // Absolute time (CLOCK_MONOTONIC) when the satellite gives up
+    RequestState state;              // Waiting, picked up by an engineer, or timed out
+    int queueIndex;                  // Position in requestQueue (-1 when not in it)
+    int timerIndex;                  // Position in timerQueue (-1 when not in it)
+    sem_t outcome;                   // Posted once the request is handled or timed out
 } SatelliteRequest;
 
+// Binary min-heap of requests. The same code serves both queues:
+// requestQueue orders by priority then deadline, timerQueue by deadline only.
+typedef struct
+{
+    SatelliteRequest **items; // Heap array, items[0] comes first
+    int size;                 // Requests in the heap
+    int capacity;             // Allocated entries in items
+    bool byDeadline;          // true for the timer queue
+} RequestHeap;
+
 // Simple struct to pass satellite ID and priority to its thread
 typedef struct
 {
@@ -35,22 +57,32 @@ typedef struct
 } SatelliteThreadData;
 
 // --- Shared Stuff ---
-SatelliteRequest *requestQueue = NULL; // The list where waiting satellites go (starts empty)
-pthread_mutex_t engineerMutex;         // Lock to protect the requestQueue and availableEngineers count
-sem_t newRequest;                      // Semaphore: Satellites signal when they add a request
-sem_t requestHandled;                  // Semaphore: Engineers signal after taking a request
+RequestHeap requestQueue = {NULL, 0, 0, false}; // Waiting satellites, most important first
+RequestHeap timerQueue = {NULL, 0, 0, true};    // The same requests, earliest deadline first
+pthread_mutex_t engineerMutex;                  // Lock to protect both queues and availableEngineers count
+pthread_cond_t requestAvailable;                // Signaled when a request is added (or at shutdown)
+pthread_cond_t timerChanged;                    // Signaled when the earliest deadline changes (or at shutdown)
 
 // --- Global Variables ---
-volatile int availableEngineers = NUM_ENGINEERS; // How many engineers are free right now
-volatile int activeSatellites = 0;               // How many satellite threads are still running/waiting
-volatile bool allSatellitesLaunched = false;     // Flag to help engineers know when to stop
-pthread_mutex_t activeSatellitesMutex;           // Lock for the activeSatellites counter
+int numEngineers = DEFAULT_NUM_ENGINEERS;
+int numSatellites = DEFAULT_NUM_SATELLITES;
+int connectionTimeout = DEFAULT_CONNECTION_TIMEOUT;
+int minWorkMs = DEFAULT_MIN_WORK_MS;
+int maxWorkMs = DEFAULT_MAX_WORK_MS;
+int arrivalDelayMs = DEFAULT_SATELLITE_ARRIVAL_DELAY_MS;
+bool quiet = false;                    // -q: only print the summary
+int availableEngineers;                // How many engineers are free right now
+bool shutdownRequested = false;        // Set by main once every satellite is done
+int handledCount = 0;                  // Requests an engineer took
+int timedOutCount = 0;                 // Requests the timer expired
 
 // --- Function Declarations ---
 void *satellite(void *arg);
 void *engineer(void *arg);
-void addRequestToQueue(SatelliteRequest *newReq);          // Puts a new request into the list
-SatelliteRequest *findAndRemoveHighestPriority();          // Gets the most important request from the list
+void *timeoutTimer(void *arg);
+int addRequestToQueue(SatelliteRequest *newReq);           // Puts a new request into both queues
+SatelliteRequest *findAndRemoveHighestPriority();          // Gets the most important request from the queues
+int expireTimedOutRequests(const struct timespec *now);    // Removes every request whose deadline has passed
 void timespecAddSeconds(struct timespec *ts, int seconds); // Helper for timeouts
 
 // --- Helper Functions ---
@@ -61,71 +93,161 @@ void timespecAddSeconds(struct timespec *ts, int seconds)
     ts->tv_sec += seconds;
 }
 
-// Adds a new satellite request to the front of the queue list
-void addRequestToQueue(SatelliteRequest *newReq)
+// Compares two timespecs: negative if a is earlier, 0 if equal, positive if later
+static int timespecCompare(const struct timespec *a, const struct timespec *b)
 {
-    newReq->next = requestQueue; // Point the new request to the current start of the list
-    requestQueue = newReq;       // Make the new request the new start of the list
+    if (a->tv_sec != b->tv_sec)
+        return a->tv_sec < b->tv_sec ? -1 : 1;
+    if (a->tv_nsec != b->tv_nsec)
+        return a->tv_nsec < b->tv_nsec ? -1 : 1;
+    return 0;
 }
 
-// Find the request with the highest priority (lowest number), remove it from the list, and return it
-SatelliteRequest *findAndRemoveHighestPriority()
+// Sleeps for the given number of milliseconds
+static void sleepMs(int ms)
 {
-    if (requestQueue == NULL)
-    { // Check if the queue is empty
-        return NULL;
-    }
+    struct timespec ts = {ms / 1000, (long)(ms % 1000) * 1000000L};
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+        ; // Keep sleeping for the rest of the time if interrupted
+}
+
+// --- Request Heaps ---
 
-    // Assume the first node is the highest priority initially
-    SatelliteRequest *highestPriorityReq = requestQueue;
-    SatelliteRequest *prevForHighest = NULL; // Will store the node *before* the highest priority one
+// Does request a come before request b in this heap?
+static bool heapBefore(const RequestHeap *heap, const SatelliteRequest *a, const SatelliteRequest *b)
+{
+    if (!heap->byDeadline && a->priority != b->priority)
+        return a->priority < b->priority; // Lower number = more important
+    return timespecCompare(&a->timeoutDeadline, &b->timeoutDeadline) < 0; // Then whoever gives up first
+}
 
-    // Start iterating from the second node
-    SatelliteRequest *currentPrev = requestQueue;      // Node before currentReq
-    SatelliteRequest *currentReq = requestQueue->next; // Node being checked
+// Puts a request at position i and records that position in the request
+static void heapPlace(RequestHeap *heap, int i, SatelliteRequest *req)
+{
+    heap->items[i] = req;
+    if (heap->byDeadline)
+        req->timerIndex = i;
+    else
+        req->queueIndex = i;
+}
 
-    while (currentReq != NULL)
+// Moves the request at position i up until its parent comes before it
+static void heapSiftUp(RequestHeap *heap, int i)
+{
+    SatelliteRequest *req = heap->items[i];
+    while (i > 0)
     {
-        // Check if the current node has higher priority (lower number)
-        if (currentReq->priority < highestPriorityReq->priority)
-        {
-            // Found a new highest priority node
-            highestPriorityReq = currentReq;
-            // Record the node that comes *before* this new highest priority node
-            prevForHighest = currentPrev;
-        }
-        // Move to the next node
-        currentPrev = currentReq;
-        currentReq = currentReq->next;
+        int parent = (i - 1) / 2;
+        if (!heapBefore(heap, req, heap->items[parent]))
+            break;
+        heapPlace(heap, i, heap->items[parent]); // Pull the parent down one level
+        i = parent;
     }
+    heapPlace(heap, i, req);
+}
 
-    // Now, remove the highest priority node from the linked list
-    if (highestPriorityReq == requestQueue)
+// Moves the request at position i down until both children come after it
+static void heapSiftDown(RequestHeap *heap, int i)
+{
+    SatelliteRequest *req = heap->items[i];
+    while (true)
     {
-        // The highest priority node was the first one in the list
-        requestQueue = highestPriorityReq->next; // Update the head of the list
+        int child = 2 * i + 1;
+        if (child >= heap->size)
+            break;
+        if (child + 1 < heap->size && heapBefore(heap, heap->items[child + 1], heap->items[child]))
+            child++; // Take the child that comes first
+        if (!heapBefore(heap, heap->items[child], req))
+            break;
+        heapPlace(heap, i, heap->items[child]); // Pull the child up one level
+        i = child;
     }
-    else
+    heapPlace(heap, i, req);
+}
+
+// Adds a request to the heap, growing the array if needed. Returns 0 on success, -1 if out of memory
+static int heapPush(RequestHeap *heap, SatelliteRequest *req)
+{
+    if (heap->size == heap->capacity)
     {
-        // The highest priority node was somewhere in the middle or end.
-        // 'prevForHighest' should point to the node right before it.
-        if (prevForHighest != NULL)
-        {
-            // Make the previous node skip over the highest priority node
-            prevForHighest->next = highestPriorityReq->next;
-        }
+        int newCapacity = heap->capacity ? heap->capacity * 2 : 64;
+        SatelliteRequest **items = realloc(heap->items, newCapacity * sizeof(SatelliteRequest *));
+        if (!items)
+            return -1;
+        heap->items = items;
+        heap->capacity = newCapacity;
+    }
+    heap->items[heap->size++] = req;
+    heapSiftUp(heap, heap->size - 1);
+    return 0;
+}
+
+// Removes the request at position i (the last one fills the gap and is moved to its proper place)
+static SatelliteRequest *heapRemoveAt(RequestHeap *heap, int i)
+{
+    SatelliteRequest *removed = heap->items[i];
+    SatelliteRequest *last = heap->items[--heap->size];
+    if (i < heap->size)
+    {
+        heapPlace(heap, i, last);
+        if (i > 0 && heapBefore(heap, last, heap->items[(i - 1) / 2]))
+            heapSiftUp(heap, i);
         else
-        {
-            // This case should logically be impossible if highestPriorityReq wasn't the head.
-            // Indicates a potential issue if it ever occurs.
-            fprintf(stderr, "Critical Logic Error: prevForHighest is NULL but node is not head during removal.\n");
-            // Avoid modifying the list in an unknown state
-            return NULL; // Indicate failure
-        }
+            heapSiftDown(heap, i);
+    }
+    if (heap->byDeadline)
+        removed->timerIndex = -1;
+    else
+        removed->queueIndex = -1;
+    return removed;
+}
+
+// --- Queue Operations (caller holds engineerMutex) ---
+
+// Adds a new satellite request to both queues: O(log n). Returns 0 on success, -1 if out of memory
+int addRequestToQueue(SatelliteRequest *newReq)
+{
+    if (heapPush(&requestQueue, newReq) != 0)
+        return -1;
+    if (heapPush(&timerQueue, newReq) != 0)
+    {
+        heapRemoveAt(&requestQueue, newReq->queueIndex);
+        return -1;
+    }
+    pthread_cond_signal(&requestAvailable); // One engineer can take it
+    if (newReq->timerIndex == 0)
+        pthread_cond_signal(&timerChanged); // The timer has to wake up earlier now
+    return 0;
+}
+
+// Removes the most important request (lowest priority number, then earliest deadline) from both queues: O(log n)
+SatelliteRequest *findAndRemoveHighestPriority()
+{
+    if (requestQueue.size == 0)
+    { // Check if the queue is empty
+        return NULL;
     }
+    SatelliteRequest *req = heapRemoveAt(&requestQueue, 0);
+    heapRemoveAt(&timerQueue, req->timerIndex); // The timer doesn't need to watch it anymore
+    return req;
+}
 
-    highestPriorityReq->next = NULL; // Detach the removed node from the list completely
-    return highestPriorityReq;       // Return the node we found and removed
+// Removes every request whose deadline is not after now from both queues and wakes its satellite.
+// Expired requests sit at the top of the timer queue, so this costs O(log n) per expired request.
+// Returns how many requests timed out
+int expireTimedOutRequests(const struct timespec *now)
+{
+    int expired = 0;
+    while (timerQueue.size > 0 && timespecCompare(&timerQueue.items[0]->timeoutDeadline, now) <= 0)
+    {
+        SatelliteRequest *req = heapRemoveAt(&timerQueue, 0);
+        heapRemoveAt(&requestQueue, req->queueIndex);
+        req->state = REQUEST_TIMED_OUT;
+        sem_post(&req->outcome); // The satellite prints the timeout
+        expired++;
+    }
+    timedOutCount += expired;
+    return expired;
 }
 
 // --- Thread Functions ---
@@ -139,20 +261,11 @@ void *satellite(void *arg)
     int priority = data->priority;
     free(arg); // Don't need the data struct anymore
 
-    // Increment count of active satellites (using mutex for safety)
-    pthread_mutex_lock(&activeSatellitesMutex);
-    activeSatellites++;
-    pthread_mutex_unlock(&activeSatellitesMutex);
-
     // Create the request structure for this satellite
     SatelliteRequest *request = (SatelliteRequest *)malloc(sizeof(SatelliteRequest));
     if (!request) // Check if malloc failed
     {
         perror("Failed to allocate memory for satellite request");
-        // Need to decrement active count if we fail here
-        pthread_mutex_lock(&activeSatellitesMutex);
-        activeSatellites--;
-        pthread_mutex_unlock(&activeSatellitesMutex);
         return NULL;
     }
 
@@ -160,89 +273,47 @@ void *satellite(void *arg)
     request->id = id;
     request->priority = priority;
     request->requestTime = time(NULL); // Record current time
-    request->handled = false;          // Not handled yet
-    request->next = NULL;              // Not in the list yet
+    request->state = REQUEST_WAITING;  // Not handled yet
+    request->queueIndex = -1;          // Not in the queues yet
+    request->timerIndex = -1;
+    if (sem_init(&request->outcome, 0, 0) != 0)
+    {
+        perror("Semaphore outcome init failed");
+        free(request);
+        return NULL;
+    }
 
     // Calculate when this satellite's connection window closes
-    clock_gettime(CLOCK_REALTIME, &request->timeoutDeadline);          // Get current time
-    timespecAddSeconds(&request->timeoutDeadline, CONNECTION_TIMEOUT); // Add timeout duration
+    clock_gettime(CLOCK_MONOTONIC, &request->timeoutDeadline);        // Get current time
+    timespecAddSeconds(&request->timeoutDeadline, connectionTimeout); // Add timeout duration
 
-    // Add the request to the shared queue (needs protection with mutex)
+    // Add the request to the shared queues (needs protection with mutex)
     pthread_mutex_lock(&engineerMutex);
-    printf("[SATELLITE] Satellite %d requesting (priority %d)\n", id, priority);
-    addRequestToQueue(request);
+    if (!quiet)
+        printf("[SATELLITE] Satellite %d requesting (priority %d)\n", id, priority);
+    int addResult = addRequestToQueue(request);
     pthread_mutex_unlock(&engineerMutex);
-
-    // Signal using the semaphore that there's a new request waiting
-    sem_post(&newRequest);
-
-    // Now wait: either an engineer signals, or we time out
-    int waitResult;
-    bool timedOut = false;
-
-    // Keep trying sem_timedwait until it succeeds, times out, or gives a real error
-    while (true)
+    if (addResult != 0)
     {
-        // Wait on the 'requestHandled' semaphore until the deadline
-        waitResult = sem_timedwait(&requestHandled, &request->timeoutDeadline);
-
-        if (waitResult == 0)
-        {
-            // Got signaled by an engineer! Assume our request is being handled (or will be soon).
-            // The global semaphore makes it slightly ambiguous, but this is the simple way.
-            break; // Exit the waiting loop
-        }
-        else if (errno == ETIMEDOUT)
-        {
-            // We waited too long, the deadline passed.
-            timedOut = true;
-            break; // Exit the waiting loop
-        }
-        else if (errno == EINTR)
-        {
-            // Interrupted by OS signal, just try waiting again
-            continue;
-        }
-        else
-        {
-            // Some other semaphore error occurred
-            perror("sem_timedwait failed for satellite");
-            timedOut = true; // Treat as a failure for this satellite
-            break;           // Exit the waiting loop
-        }
+        fprintf(stderr, "Failed to queue request of satellite %d: out of memory\n", id);
+        sem_destroy(&request->outcome);
+        free(request);
+        return NULL;
     }
 
-    // Check if we timed out
-    if (timedOut)
-    {
-        printf("[TIMEOUT] Satellite %d timed out after %d seconds.\n", id, CONNECTION_TIMEOUT);
-        // If we timed out, try to find our request in the queue and mark it 'handled'.
-        // This tells the engineer to ignore it if they find it later.
-        pthread_mutex_lock(&engineerMutex);
-        SatelliteRequest *curr = requestQueue;
-        while (curr != NULL)
-        {
-            // Check if this node is the exact one we created (compare memory address)
-            if (curr == request)
-            {
-                curr->handled = true; // Mark it so engineer knows it's stale
-                break;                // Found it, stop searching
-            }
-            curr = curr->next;
-        }
-        // If curr is NULL, the engineer must have grabbed it right between our timeout and locking the mutex. That's fine.
-        pthread_mutex_unlock(&engineerMutex);
-    }
-    // If not timed out, we assume an engineer handled it (or is about to). The engineer prints the completion message.
+    // Now wait: either an engineer picks the request up, or the timer expires it.
+    // Nobody else posts this semaphore, so waking up always means one of the two happened.
+    while (sem_wait(&request->outcome) == -1 && errno == EINTR)
+        ; // Interrupted by OS signal, just try waiting again
 
-    // Satellite thread is finishing (either handled or timed out)
-    // Decrement the active satellite count (use mutex)
-    pthread_mutex_lock(&activeSatellitesMutex);
-    activeSatellites--;
-    pthread_mutex_unlock(&activeSatellitesMutex);
+    // No lock needed: state was set before the post, and nobody changes it afterwards
+    if (request->state == REQUEST_TIMED_OUT && !quiet)
+        printf("[TIMEOUT] Satellite %d timed out after %d seconds.\n", id, connectionTimeout);
+    // If handled, the engineer prints the completion message.
 
-    // VERY IMPORTANT: The satellite does *not* free the 'request' memory here.
-    // The engineer is responsible for freeing it when they handle or discard it.
+    // The request is out of both queues and whoever posted is done with it, so this thread frees it
+    sem_destroy(&request->outcome);
+    free(request);
     return NULL;
 }
 
@@ -256,159 +327,190 @@ void *engineer(void *arg)
     // Engineers keep working until explicitly told to stop
     while (true)
     {
-        // Wait for the 'newRequest' semaphore. This blocks until a satellite signals.
-        int semStatus;
-        do
-        {
-            semStatus = sem_wait(&newRequest); // Wait indefinitely
-        } while (semStatus == -1 && errno == EINTR); // Retry if interrupted by OS
+        // Wait until a request is waiting or it's time to shut down
+        pthread_mutex_lock(&engineerMutex);
+        while (requestQueue.size == 0 && !shutdownRequested)
+            pthread_cond_wait(&requestAvailable, &engineerMutex);
 
-        if (semStatus == -1)
+        // Take the most important request; timed-out ones were already removed by the timer
+        SatelliteRequest *reqToHandle = findAndRemoveHighestPriority();
+        if (reqToHandle == NULL)
         {
-            // If sem_wait fails for real, something's wrong
-            perror("Engineer sem_wait failed");
-            break; // Exit the loop/thread
+            // Queue is empty, so we only woke up because of the shutdown
+            pthread_mutex_unlock(&engineerMutex);
+            break;
         }
+        availableEngineers--;                  // Mark this engineer as busy
+        handledCount++;
+        reqToHandle->state = REQUEST_HANDLED;  // Mark request as being handled now
+        pthread_mutex_unlock(&engineerMutex); // *** Unlock mutex BEFORE signaling and doing work ***
 
-        // Woken up! Let's check for work or if it's time to shut down.
-        SatelliteRequest *reqToHandle = NULL;
-        bool shouldShutdown = false;
+        // --- Process the satellite request ---
+        // The satellite frees its request once woken, so keep what we need
+        int satelliteId = reqToHandle->id;
+        if (!quiet)
+            printf("[ENGINEER %d] Handling Satellite %d (Priority %d)\n", id, satelliteId, reqToHandle->priority);
 
-        // Lock the mutex to safely access shared queue and state
+        // Tell this satellite (and only this one) that its request was taken
+        sem_post(&reqToHandle->outcome);
+        reqToHandle = NULL;
+
+        // Simulate doing the update work
+        int workTime = (rand() % (maxWorkMs - minWorkMs + 1)) + minWorkMs;
+        sleepMs(workTime); // Pause for the simulated work duration
+
+        if (!quiet)
+            printf("[ENGINEER %d] Finished Satellite %d\n", id, satelliteId);
+
+        // Mark this engineer as available again (needs mutex protection)
         pthread_mutex_lock(&engineerMutex);
+        availableEngineers++;
+        pthread_mutex_unlock(&engineerMutex);
+    } // End of main engineer loop (while(true))
 
-        // --- Check if we should shut down ---
-        // Need to lock the other mutex briefly to check activeSatellites count
-        pthread_mutex_lock(&activeSatellitesMutex);
-        // Condition: All satellites created, no satellites running, queue is empty
-        shouldShutdown = allSatellitesLaunched && activeSatellites == 0 && requestQueue == NULL;
-        pthread_mutex_unlock(&activeSatellitesMutex);
+    if (!quiet)
+        printf("[ENGINEER %d] Exiting...\n", id);
+    return NULL;
+}
 
-        if (shouldShutdown)
+// Function run by the single timer thread: it sleeps until the earliest deadline of any waiting
+// request and then expires everything that is due at once, instead of every satellite waiting
+// with its own timeout
+void *timeoutTimer(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&engineerMutex);
+    while (!shutdownRequested)
+    {
+        if (timerQueue.size == 0)
         {
-            pthread_mutex_unlock(&engineerMutex); // Unlock before breaking
-            break;                                // Time to exit the engineer's main loop
+            pthread_cond_wait(&timerChanged, &engineerMutex); // Nothing to watch until a request arrives
+            continue;
         }
 
-        // --- If not shutting down, try to get a request ---
-        // Find and remove the highest priority request from the queue
-        reqToHandle = findAndRemoveHighestPriority();
+        // Sleep until the earliest deadline; a new earlier deadline or the shutdown wakes us sooner
+        struct timespec deadline = timerQueue.items[0]->timeoutDeadline;
+        pthread_cond_timedwait(&timerChanged, &engineerMutex, &deadline);
 
-        if (reqToHandle != NULL)
-        {
-            // We got a request! Now check if it timed out before we got it.
-            if (reqToHandle->handled)
-            {
-                // The 'handled' flag was already true, meaning the satellite timed out and marked it.
-                // We should just discard it.
-                pthread_mutex_unlock(&engineerMutex); // Unlock mutex *before* freeing memory
-                free(reqToHandle);                    // Free the timed-out request struct
-                reqToHandle = NULL;
-                // Don't signal requestHandled semaphore, as we didn't really handle it.
-                // Don't change availableEngineers count either.
-                continue; // Go back to wait for another newRequest signal
-            }
-            else
-            {
-                // This is a valid request we need to process!
-                availableEngineers--;                 // Mark this engineer as busy
-                reqToHandle->handled = true;          // Mark request as being handled now
-                pthread_mutex_unlock(&engineerMutex); // *** Unlock mutex BEFORE signaling and doing work ***
-
-                // --- Process the satellite request ---
-                printf("[ENGINEER %d] Handling Satellite %d (Priority %d)\n", id, reqToHandle->id, reqToHandle->priority);
-
-                // Signal the 'requestHandled' semaphore - lets waiting satellites know *someone* took a task
-                sem_post(&requestHandled);
-
-                // Simulate doing the update work
-                int workTime = (rand() % (MAX_WORK_TIME - MIN_WORK_TIME + 1)) + MIN_WORK_TIME;
-                sleep(workTime); // Pause for the simulated work duration
-
-                printf("[ENGINEER %d] Finished Satellite %d\n", id, reqToHandle->id);
-
-                // Free the memory used by the request struct now that we're done
-                free(reqToHandle);
-                reqToHandle = NULL;
-
-                // Mark this engineer as available again (needs mutex protection)
-                pthread_mutex_lock(&engineerMutex);
-                availableEngineers++;
-                pthread_mutex_unlock(&engineerMutex);
-            }
-        }
-        else
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        expireTimedOutRequests(&now);
+    }
+    pthread_mutex_unlock(&engineerMutex);
+    return NULL;
+}
+
+// Prints how to run the program
+static void printUsage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [-s satellites] [-e engineers] [-t timeout_s] [-w min_ms:max_ms] [-d arrival_delay_ms] [-q]\n"
+            "Defaults: %d satellites, %d engineers, %d s timeout, %d:%d ms work, %d ms between arrivals\n",
+            program, DEFAULT_NUM_SATELLITES, DEFAULT_NUM_ENGINEERS, DEFAULT_CONNECTION_TIMEOUT, DEFAULT_MIN_WORK_MS,
+            DEFAULT_MAX_WORK_MS, DEFAULT_SATELLITE_ARRIVAL_DELAY_MS);
+}
+
+// Reads the command line options into the settings. Returns 0 on success, -1 on bad input
+static int parseOptions(int argc, char *argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "s:e:t:w:d:q")) != -1)
+    {
+        switch (opt)
         {
-            // If reqToHandle is NULL, the queue was empty when we checked.
-            // This might happen if another engineer grabbed the request between sem_wait
-            // waking us and us locking the mutex (a "spurious" wakeup for us).
-            pthread_mutex_unlock(&engineerMutex); // Unlock mutex
-
-            // Briefly re-check shutdown condition here too, just in case.
-            pthread_mutex_lock(&activeSatellitesMutex);
-            shouldShutdown = allSatellitesLaunched && activeSatellites == 0;
-            pthread_mutex_unlock(&activeSatellitesMutex);
-            if (shouldShutdown)
-            {
-                pthread_mutex_lock(&engineerMutex);
-                if (requestQueue == NULL)
-                { // Double check queue is still empty
-                    pthread_mutex_unlock(&engineerMutex);
-                    break; // Exit loop
-                }
-                pthread_mutex_unlock(&engineerMutex);
-            }
-            // Otherwise, just loop back and wait on sem_wait(&newRequest) again.
+        case 's':
+            numSatellites = atoi(optarg);
+            break;
+        case 'e':
+            numEngineers = atoi(optarg);
+            break;
+        case 't':
+            connectionTimeout = atoi(optarg);
+            break;
+        case 'w':
+            if (sscanf(optarg, "%d:%d", &minWorkMs, &maxWorkMs) != 2)
+                return -1;
+            break;
+        case 'd':
+            arrivalDelayMs = atoi(optarg);
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        default:
+            return -1;
         }
-    } // End of main engineer loop (while(true))
-
-    printf("[ENGINEER %d] Exiting...\n", id);
-    return NULL;
+    }
+    if (optind != argc || numSatellites < 0 || numEngineers <= 0 || connectionTimeout < 0 || minWorkMs < 0 ||
+        maxWorkMs < minWorkMs || arrivalDelayMs < 0)
+        return -1;
+    return 0;
 }
 
 // --- Main Program ---
-int main()
+int main(int argc, char *argv[])
 {
-    pthread_t engineerThreads[NUM_ENGINEERS];   // Array to hold engineer thread IDs
-    pthread_t satelliteThreads[NUM_SATELLITES]; // Array to hold satellite thread IDs
+    if (parseOptions(argc, argv) != 0)
+    {
+        printUsage(argv[0]);
+        return 1;
+    }
+    availableEngineers = numEngineers;
+
+    pthread_t *engineerThreads = malloc(numEngineers * sizeof(pthread_t));   // Array to hold engineer thread IDs
+    pthread_t *satelliteThreads = malloc(numSatellites * sizeof(pthread_t)); // Array to hold satellite thread IDs
+    pthread_t timerThread;
+    if (!engineerThreads || (!satelliteThreads && numSatellites > 0))
+    {
+        perror("Failed to allocate memory for thread IDs");
+        free(engineerThreads);
+        free(satelliteThreads);
+        return 1;
+    }
 
     srand(time(NULL)); // Initialize random numbers (for priorities and work times)
 
-    // --- Set up Mutexes and Semaphores ---
+    // --- Set up Mutexes and Condition Variables ---
     if (pthread_mutex_init(&engineerMutex, NULL) != 0)
     {
         perror("Mutex engineerMutex init failed");
         return 1;
     }
-    if (pthread_mutex_init(&activeSatellitesMutex, NULL) != 0)
+    if (pthread_cond_init(&requestAvailable, NULL) != 0)
     {
-        perror("Mutex activeSatellitesMutex init failed");
-        pthread_mutex_destroy(&engineerMutex);
-        return 1;
-    }
-    // Initialize semaphores: 0 means they block initially
-    if (sem_init(&newRequest, 0, 0) != 0)
-    { // 0 = shared between threads in this process
-        perror("Semaphore newRequest init failed");
+        perror("Condition requestAvailable init failed");
         pthread_mutex_destroy(&engineerMutex);
-        pthread_mutex_destroy(&activeSatellitesMutex);
         return 1;
     }
-    if (sem_init(&requestHandled, 0, 0) != 0)
+    // Deadlines use CLOCK_MONOTONIC, so the timer's waits must too (wall clock changes don't matter)
+    pthread_condattr_t timerAttr;
+    pthread_condattr_init(&timerAttr);
+    pthread_condattr_setclock(&timerAttr, CLOCK_MONOTONIC);
+    if (pthread_cond_init(&timerChanged, &timerAttr) != 0)
     {
-        perror("Semaphore requestHandled init failed");
-        sem_destroy(&newRequest);
+        perror("Condition timerChanged init failed");
+        pthread_cond_destroy(&requestAvailable);
         pthread_mutex_destroy(&engineerMutex);
-        pthread_mutex_destroy(&activeSatellitesMutex);
         return 1;
     }
+    pthread_condattr_destroy(&timerAttr);
 
-    printf("Starting ground station simulation with %d engineers and %d satellites.\n", NUM_ENGINEERS, NUM_SATELLITES);
-    printf("Satellite timeout window: %d seconds. Work time: %d-%d sec. Lower priority number = higher priority.\n",
-           CONNECTION_TIMEOUT, MIN_WORK_TIME, MAX_WORK_TIME);
+    // Satellites just wait, so they get small stacks
+    pthread_attr_t satelliteAttr;
+    pthread_attr_init(&satelliteAttr);
+    pthread_attr_setstacksize(&satelliteAttr, SATELLITE_STACK_SIZE);
 
-    // --- Start the Engineer Threads ---
-    for (int i = 0; i < NUM_ENGINEERS; i++)
+    printf("Starting ground station simulation with %d engineers and %d satellites.\n", numEngineers, numSatellites);
+    printf("Satellite timeout window: %d seconds. Work time: %d-%d ms. Lower priority number = higher priority.\n",
+           connectionTimeout, minWorkMs, maxWorkMs);
+
+    // --- Start the Timer and Engineer Threads ---
+    if (pthread_create(&timerThread, NULL, timeoutTimer, NULL) != 0)
+    {
+        perror("Failed to create timer thread");
+        return 1;
+    }
+    for (int i = 0; i < numEngineers; i++)
     {
         // Need to pass the engineer's ID to the thread function
         int *id_ptr = malloc(sizeof(int)); // Allocate memory for the ID
@@ -427,7 +529,7 @@ int main()
     }
 
     // --- Start the Satellite Threads ---
-    for (int i = 0; i < NUM_SATELLITES; i++)
+    for (int i = 0; i < numSatellites; i++)
     {
         // Create data struct to pass ID and priority
         SatelliteThreadData *data = (SatelliteThreadData *)malloc(sizeof(SatelliteThreadData));
@@ -439,74 +541,73 @@ int main()
         data->id = i;                                 // Assign satellite ID
         data->priority = (rand() % MAX_PRIORITY) + 1; // Assign random priority (1 to MAX_PRIORITY)
 
-        if (pthread_create(&satelliteThreads[i], NULL, satellite, data) != 0)
+        if (pthread_create(&satelliteThreads[i], &satelliteAttr, satellite, data) != 0)
         {
             perror("Failed to create satellite thread");
             free(data); /* TODO: Add cleanup */
             return 1;
         }
         // Add a small delay between starting satellites to make the output less simultaneous
-        if (SATELLITE_ARRIVAL_DELAY_MS > 0)
+        if (arrivalDelayMs > 0)
         {
-            usleep(SATELLITE_ARRIVAL_DELAY_MS * 1000); // usleep takes microseconds
+            sleepMs(arrivalDelayMs);
         }
     }
-
-    // --- All threads launched ---
-    // Set the flag so engineers know no more satellites are coming
-    pthread_mutex_lock(&activeSatellitesMutex);
-    allSatellitesLaunched = true;
-    pthread_mutex_unlock(&activeSatellitesMutex);
+    pthread_attr_destroy(&satelliteAttr);
 
     printf("All satellite threads created and requesting...\n");
 
     // --- Wait for all Satellite Threads to finish ---
     // Main thread waits here until each satellite thread completes (either handled or timed out)
-    for (int i = 0; i < NUM_SATELLITES; i++)
+    for (int i = 0; i < numSatellites; i++)
     {
         pthread_join(satelliteThreads[i], NULL); // Wait for thread i to finish
     }
     printf("All satellite threads have finished (handled or timed out).\n");
 
-    // --- Tell Engineers to Check for Shutdown ---
-    // Since satellites might finish without new requests coming in,
-    // engineers might be stuck waiting on sem_wait(&newRequest).
-    // We post the semaphore enough times to wake them all up so they can check the shutdown condition.
+    // --- Tell Engineers and the Timer to Shut Down ---
+    // Every request is handled or timed out by now, so the queues are empty;
+    // engineers finish the work they have and exit.
     printf("Signaling engineers for final shutdown check...\n");
-    for (int i = 0; i < NUM_ENGINEERS; i++)
-    {
-        sem_post(&newRequest);
-    }
+    pthread_mutex_lock(&engineerMutex);
+    shutdownRequested = true;
+    pthread_cond_broadcast(&requestAvailable);
+    pthread_cond_signal(&timerChanged);
+    pthread_mutex_unlock(&engineerMutex);
 
     // --- Wait for all Engineer Threads to finish ---
     // Main thread waits here until each engineer thread exits its loop
-    for (int i = 0; i < NUM_ENGINEERS; i++)
+    for (int i = 0; i < numEngineers; i++)
     {
         pthread_join(engineerThreads[i], NULL); // Wait for engineer i to finish
     }
+    pthread_join(timerThread, NULL);
     printf("All engineer threads have exited.\n");
+    printf("Handled: %d, timed out: %d\n", handledCount, timedOutCount);
 
     // --- Clean up Resources ---
     pthread_mutex_destroy(&engineerMutex);
-    pthread_mutex_destroy(&activeSatellitesMutex);
-    sem_destroy(&newRequest);
-    sem_destroy(&requestHandled);
+    pthread_cond_destroy(&requestAvailable);
+    pthread_cond_destroy(&timerChanged);
 
     // Final check: Was the request queue properly emptied?
     // If not, it might indicate a logic error or memory leak.
-    if (requestQueue != NULL)
+    if (requestQueue.size != 0)
     {
         fprintf(stderr, "Warning: Request queue not empty at exit. Cleaning up...\n");
-        SatelliteRequest *cur = requestQueue;
-        while (cur != NULL)
+        for (int i = 0; i < requestQueue.size; i++)
         {
-            SatelliteRequest *next = cur->next;
-            fprintf(stderr, " - Removing leftover request for satellite %d (priority %d, handled=%d)\n", cur->id, cur->priority, cur->handled);
+            SatelliteRequest *cur = requestQueue.items[i];
+            fprintf(stderr, " - Removing leftover request for satellite %d (priority %d, state=%d)\n", cur->id, cur->priority, cur->state);
+            sem_destroy(&cur->outcome);
             free(cur); // Free any remaining nodes
-            cur = next;
         }
     }
+    free(requestQueue.items);
+    free(timerQueue.items);
+    free(engineerThreads);
+    free(satelliteThreads);
 
     printf("Simulation finished.\n");
     return 0; // Success!
-}
\ No newline at end of file
+}
@@ -4,12 +4,25 @@
  * Description: This program implements a multi-threaded log file analyzer
  *              using the producer-consumer pattern. One manager thread reads
  *              lines from a log file and multiple worker threads search for
- *              a specific term in these lines.
+ *              a specific term in these lines. With --mmap the file is
+ *              mapped instead and the manager hands out ranges of whole
+ *              lines that workers search in place, without copying.
+ *              Items move through the buffer in batches; --lock-free swaps
+ *              its mutex for a lock-free ring. Lines are matched by the
+ *              search engine (search.c): several terms can be searched at
+ *              once, without regard to case or as regular expressions.
+ *              Given a directory or several files, the workers read the
+ *              files themselves in line-aligned chunks handed out by a
+ *              work-stealing scheduler (scheduler.c). With --follow the
+ *              manager keeps reading lines appended to the file (follow.c),
+ *              and --checkpoint records how far the file has been searched.
+ *              Copied lines live in the buffer's line pool (pool.c).
  * Author: Recep Furkan Akın
  * Student ID: 210104004042
  *
  */
 
+#define _GNU_SOURCE // For memmem
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,12 +30,40 @@
 #include <signal.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "buffer.h"
+#include "search.h"
+#include "scheduler.h"
+#include "follow.h"
 
-// Marker to signal end of file processing
-#define EOF_MARKER "END"
 // Maximum size of a line read from the log file
 #define LINE_BUFFER_SIZE 1024
+// Lines moved per buffer operation by the manager and by each worker
+#define LINE_BATCH_SIZE 64
+// Line ranges moved per buffer operation in mmap mode
+#define SPAN_BATCH_SIZE 4
+// Approximate size of a line range handed to a worker in mmap mode (extended to the next newline)
+#define MMAP_CHUNK_SIZE (16 * 1024)
+// Size of a chunk scheduled in multi-file mode
+#define FILE_CHUNK_SIZE (1024 * 1024)
+// Bytes read at a time to finish a chunk's last line in multi-file mode
+#define CHUNK_EXTEND_SIZE 4096
+// Longest wait for a change of the file in follow mode, so progress is reported and shutdown noticed
+#define FOLLOW_POLL_MS 500
+
+/**
+ * LogFile structure - one file searched in multi-file mode
+ */
+typedef struct
+{
+    char *path;         // Path as given or built from the directory
+    int fd;             // Read with pread, shared by all workers
+    off_t size;         // Size when the search started
+    atomic_int matches; // Matching lines, summed over all chunks
+} LogFile;
 
 // Flag to control thread execution, volatile because it's modified in signal handler
 volatile int running = 1;
@@ -30,12 +71,334 @@ volatile int running = 1;
 int num_workers;
 // Array to store match counts for each worker thread
 int *match_counts;
-// The term to search for in the log file
-char *search_term;
+// The terms to search for in the log file (the positional term, then --term options)
+char **search_terms;
+int num_terms = 0;
+// SEARCH_IGNORE_CASE / SEARCH_REGEX, set by --ignore-case and --regex
+int search_flags = 0;
+// Substring kernel for a single literal term, set by --kernel
+SearchKernel search_kernel = KERNEL_AUTO;
+// One search engine per worker (engines keep per-line scratch state)
+SearchEngine *engines = NULL;
+// Per-worker, per-term line counts: term_counts[id * num_terms + term]
+int *term_counts = NULL;
 // Shared buffer for producer-consumer pattern
 Buffer buffer;
-// Barrier for synchronizing worker threads before displaying results
-pthread_barrier_t barrier;
+// Multi-file mode: set when log_file is a directory or --file is given
+int use_files = 0;
+// Extra files from --file options
+char **extra_files = NULL;
+int num_extra_files = 0;
+// Files searched in multi-file mode, and the scheduler handing out their chunks
+LogFile *log_files = NULL;
+int num_files = 0;
+Scheduler scheduler;
+// Set by --follow: keep reading lines appended to the log file until SIGINT
+int use_follow = 0;
+// Set by the first SIGINT in follow mode: stop following, finish the queued lines
+volatile int follow_stop = 0;
+// Set by --checkpoint: file recording how far the log file has been searched
+char *checkpoint_path = NULL;
+// Log file identity and the byte after the last line handed to the workers (manager only)
+dev_t log_dev;
+ino_t log_ino;
+off_t line_end_offset = 0;
+// Matches counted by the run a checkpoint came from, and whether this run resumed one
+long long resumed_matches = 0;
+int resumed = 0;
+// Follow mode progress: lines handed to the workers, lines searched, and their matches
+long long lines_queued = 0;
+atomic_llong lines_done;
+atomic_llong live_matches;
+// Set by --mmap: search the mapped file through LineSpan ranges instead of copied lines
+int use_mmap = 0;
+// Set by --lock-free: use the lock-free ring implementation of the buffer
+int use_lock_free = 0;
+// Lines read by the manager that have not been put into the buffer yet
+static char *pending_lines[LINE_BATCH_SIZE];
+static int pending_count = 0;
+// Mapping of the log file in mmap mode, unmapped by main after all threads finish
+char *mapped_file = NULL;
+size_t mapped_size = 0;
+
+/**
+ * Wakes every thread blocked on the buffer so it can notice that running is 0
+ */
+static void wake_all_threads(void)
+{
+    pthread_mutex_lock(&buffer.mutex);
+    pthread_cond_broadcast(&buffer.not_full);
+    pthread_cond_broadcast(&buffer.not_empty);
+    pthread_mutex_unlock(&buffer.mutex);
+}
+
+/**
+ * Puts the manager's pending lines into the buffer with one batch operation
+ */
+static void flush_lines(void)
+{
+    if (pending_count > 0)
+        lines_queued += add_batch_to_buffer(&buffer, pending_lines, pending_count);
+    pending_count = 0;
+}
+
+/**
+ * Queues a line for the buffer, flushing once a full batch has accumulated
+ *
+ * @param line - The line to add (dynamically allocated)
+ */
+static void queue_line(char *line)
+{
+    pending_lines[pending_count++] = line;
+    if (pending_count == LINE_BATCH_SIZE)
+        flush_lines();
+}
+
+/**
+ * Manager for mmap mode (producer)
+ * Maps the log file and publishes it as ranges of whole lines of about
+ * MMAP_CHUNK_SIZE bytes, SPAN_BATCH_SIZE ranges per buffer operation
+ *
+ * @param file_name - Path of the log file
+ */
+static void map_and_publish(const char *file_name)
+{
+    int fd = open(file_name, O_RDONLY);
+    if (fd == -1)
+    {
+        perror("Error opening file in manager");
+        running = 0;
+        wake_all_threads();
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        perror("Error reading file size in manager");
+        close(fd);
+        running = 0;
+        wake_all_threads();
+        return;
+    }
+
+    // An empty file cannot be mapped; it simply has no lines
+    if (st.st_size > 0)
+    {
+        void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            perror("Error mapping file in manager");
+            close(fd);
+            running = 0;
+            wake_all_threads();
+            return;
+        }
+        madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+        mapped_file = map;
+        mapped_size = (size_t)st.st_size;
+    }
+    close(fd); // The mapping stays valid after closing
+
+    // Cut the mapping into ranges that end right after a newline
+    LineSpan spans[SPAN_BATCH_SIZE];
+    int span_count = 0;
+    size_t pos = 0;
+    while (running && pos < mapped_size)
+    {
+        size_t end = pos + MMAP_CHUNK_SIZE;
+        if (end >= mapped_size)
+        {
+            end = mapped_size;
+        }
+        else
+        {
+            const char *nl = memchr(mapped_file + end - 1, '\n', mapped_size - (end - 1));
+            end = nl ? (size_t)(nl - mapped_file) + 1 : mapped_size;
+        }
+        spans[span_count].start = mapped_file + pos;
+        spans[span_count].length = end - pos;
+        if (++span_count == SPAN_BATCH_SIZE)
+        {
+            if (add_spans_to_buffer(&buffer, spans, span_count) != span_count)
+                return;
+            span_count = 0;
+        }
+        pos = end;
+    }
+    if (span_count > 0 && add_spans_to_buffer(&buffer, spans, span_count) != span_count)
+        return;
+
+    // Workers finish once the remaining ranges are taken
+    close_buffer(&buffer);
+}
+
+/**
+ * Creates one search engine per worker and the per-term counters
+ *
+ * @return 0 on success, -1 on failure (error already reported)
+ */
+static int init_engines(void)
+{
+    engines = calloc(num_workers, sizeof(SearchEngine));
+    term_counts = calloc((size_t)num_workers * num_terms, sizeof(int));
+    if (engines == NULL || term_counts == NULL)
+    {
+        perror("Failed to allocate search engines");
+        return -1;
+    }
+    for (int i = 0; i < num_workers; i++)
+    {
+        if (init_search(&engines[i], search_terms, num_terms, search_flags, search_kernel) != 0)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * Frees the search engines, the per-term counters and the term list
+ */
+static void free_engines(void)
+{
+    for (int i = 0; engines != NULL && i < num_workers; i++)
+        free_search(&engines[i]);
+    free(engines);
+    free(term_counts);
+    free(search_terms);
+}
+
+/**
+ * Records the log file's identity and, with --checkpoint, seeks past the
+ * lines searched by a previous run of the same file
+ *
+ * @param fd - The opened log file
+ * @param file_name - Path of the log file
+ * @return Offset to start reading at, or -1 on error
+ */
+static off_t resume_offset(int fd, const char *file_name)
+{
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        perror("Error reading file status in manager");
+        return -1;
+    }
+    log_dev = st.st_dev;
+    log_ino = st.st_ino;
+    if (checkpoint_path == NULL)
+        return 0;
+
+    Checkpoint checkpoint;
+    int ret = load_checkpoint(checkpoint_path, &checkpoint);
+    if (ret != 0)
+        return ret == 1 ? 0 : -1;
+    // A rotated or truncated log is a different file as far as the checkpoint is concerned
+    if (checkpoint.dev != st.st_dev || checkpoint.ino != st.st_ino || checkpoint.offset > st.st_size)
+    {
+        fprintf(stderr, "Manager: %s does not match checkpoint %s, starting over\n", file_name, checkpoint_path);
+        return 0;
+    }
+    if (lseek(fd, checkpoint.offset, SEEK_SET) == -1)
+    {
+        perror("Error seeking to checkpoint in manager");
+        return -1;
+    }
+    resumed = 1;
+    resumed_matches = checkpoint.matches;
+    printf("Resuming at byte %lld (%lld matches counted before)\n", (long long)checkpoint.offset, resumed_matches);
+    return checkpoint.offset;
+}
+
+/**
+ * Follow mode: reports live counts and saves a checkpoint once the workers
+ * have searched every line handed to them, so offset and counts agree
+ */
+static void report_progress(void)
+{
+    static long long last_reported = -1;
+    static off_t last_saved = -1;
+
+    if (atomic_load(&lines_done) != lines_queued)
+        return;
+    long long matches = resumed_matches + atomic_load(&live_matches);
+    if (matches != last_reported)
+    {
+        printf("Matches so far: %lld\n", matches);
+        fflush(stdout);
+        last_reported = matches;
+    }
+    if (checkpoint_path != NULL && line_end_offset != last_saved)
+    {
+        Checkpoint checkpoint = {.dev = log_dev, .ino = log_ino, .offset = line_end_offset, .matches = matches};
+        if (save_checkpoint(checkpoint_path, &checkpoint) == 0)
+            last_saved = line_end_offset;
+    }
+}
+
+/**
+ * Follow mode: waits at end of file until there is more to read
+ * Handles the file being truncated (read again from the start) and being
+ * rotated (the old file is read to its end, then the new one is opened).
+ *
+ * @param fd - The log file, replaced after a rotation
+ * @param file_name - Path of the log file
+ * @param watch - inotify watch of the log file
+ * @param file_pos - Offset of the next read, updated on truncation and rotation
+ * @param current_line_idx - Length of the unfinished line, reset when the file is replaced
+ * @return 0 when there is data to read, -1 to stop following
+ */
+static int follow_file(int *fd, const char *file_name, FileWatch *watch, off_t *file_pos, size_t *current_line_idx)
+{
+    // Hand everything read so far to the workers, so counts are up to date while waiting
+    flush_lines();
+    while (running && !follow_stop)
+    {
+        report_progress();
+        if (wait_for_change(watch, FOLLOW_POLL_MS) == -1)
+            return -1;
+
+        struct stat st, path_st;
+        if (fstat(*fd, &st) == -1)
+        {
+            perror("Error reading file status in manager");
+            return -1;
+        }
+        if (st.st_size > *file_pos)
+            return 0;
+        if (st.st_size < *file_pos)
+        {
+            fprintf(stderr, "Manager: %s was truncated, starting over\n", file_name);
+            if (lseek(*fd, 0, SEEK_SET) == -1)
+            {
+                perror("Error seeking in manager");
+                return -1;
+            }
+            *file_pos = 0;
+            line_end_offset = 0;
+            *current_line_idx = 0;
+            return 0;
+        }
+
+        // Rotated: the path names another file now (it may not exist yet)
+        if (stat(file_name, &path_st) == 0 && (path_st.st_dev != st.st_dev || path_st.st_ino != st.st_ino))
+        {
+            int new_fd = open(file_name, O_RDONLY);
+            if (new_fd == -1)
+                continue;
+            fprintf(stderr, "Manager: %s was rotated, following the new file\n", file_name);
+            close(*fd);
+            *fd = new_fd;
+            log_dev = path_st.st_dev;
+            log_ino = path_st.st_ino;
+            *file_pos = 0;
+            line_end_offset = 0;
+            *current_line_idx = 0;
+            rewatch_file(watch, file_name);
+            return 0;
+        }
+    }
+    return -1;
+}
 
 /**
  * Manager thread function (producer)
@@ -48,6 +411,12 @@ void *manager(void *arg)
 {
     char *file_name = (char *)arg;
 
+    if (use_mmap)
+    {
+        map_and_publish(file_name);
+        return NULL;
+    }
+
     // Open the log file in read-only mode
     int fd = open(file_name, O_RDONLY);
 
@@ -62,86 +431,109 @@ void *manager(void *arg)
         return NULL;
     }
 
+    // Resume after the lines searched by a previous run, and watch the file in follow mode
+    off_t file_pos = resume_offset(fd, file_name);
+    FileWatch watch = {.inotify_fd = -1, .watch = -1};
+    if (file_pos == -1 || (use_follow && init_file_watch(&watch, file_name) != 0))
+    {
+        close(fd);
+        running = 0;
+        wake_all_threads();
+        return NULL;
+    }
+    line_end_offset = file_pos;
+
     // Buffers for reading and line processing
     char read_buf[LINE_BUFFER_SIZE];
     char current_line[LINE_BUFFER_SIZE];
     size_t current_line_idx = 0;
-    ssize_t bytes_read;
+    ssize_t bytes_read = 0;
 
-    // Read chunks from file and process them line by line
-    while (running && (bytes_read = read(fd, read_buf, sizeof(read_buf))) > 0)
+    // Read chunks from file and process them line by line; in follow mode
+    // wait for more data at end of file instead of finishing
+    do
     {
-        for (int i = 0; i < bytes_read && running; ++i)
+        while (running && (bytes_read = read(fd, read_buf, sizeof(read_buf))) > 0)
         {
-            if (read_buf[i] == '\n')
+            for (int i = 0; i < bytes_read && running; ++i)
             {
-                // End of line found, process it
-                current_line[current_line_idx] = '\0';
-                if (current_line_idx > 0)
+                if (read_buf[i] == '\n')
                 {
-                    // Create a copy of the line to add to buffer
-                    char *line_copy = strdup(current_line);
-                    if (!line_copy)
+                    // End of line found, process it
+                    current_line[current_line_idx] = '\0';
+                    if (current_line_idx > 0)
                     {
-                        perror("strdup failed in manager");
-                        running = 0;
-                        pthread_mutex_lock(&buffer.mutex);
-                        pthread_cond_broadcast(&buffer.not_empty);
-                        pthread_mutex_unlock(&buffer.mutex);
-                        break;
+                        // Create a copy of the line to add to buffer
+                        char *line_copy = buffer_copy_line(&buffer, current_line, current_line_idx);
+                        if (!line_copy)
+                        {
+                            perror("Copying line failed in manager");
+                            running = 0;
+                            pthread_mutex_lock(&buffer.mutex);
+                            pthread_cond_broadcast(&buffer.not_empty);
+                            pthread_mutex_unlock(&buffer.mutex);
+                            break;
+                        }
+                        // Add the line to the shared buffer for workers
+                        queue_line(line_copy);
                     }
-                    // Add the line to the shared buffer for workers
-                    add_to_buffer(&buffer, line_copy);
-                }
-                current_line_idx = 0;
-            }
-            else
-            {
-                // Process each character in the line
-                if (current_line_idx < sizeof(current_line) - 1)
-                {
-                    current_line[current_line_idx++] = read_buf[i];
+                    current_line_idx = 0;
+                    line_end_offset = file_pos + i + 1;
                 }
                 else
                 {
-                    // Line too long, truncate and process what we have
-                    current_line[current_line_idx] = '\0';
-                    fprintf(stderr, "Manager: Line too long, truncating.\n");
-                    char *line_copy = strdup(current_line);
-                    if (!line_copy)
+                    // Process each character in the line
+                    if (current_line_idx < sizeof(current_line) - 1)
                     {
-                        perror("strdup failed for long line in manager");
-                        running = 0;
-                        
-                        pthread_mutex_lock(&buffer.mutex);
-                        pthread_cond_broadcast(&buffer.not_empty);
-                        pthread_mutex_unlock(&buffer.mutex);
-                        break;
+                        current_line[current_line_idx++] = read_buf[i];
+                    }
+                    else
+                    {
+                        // Line too long, truncate and process what we have
+                        current_line[current_line_idx] = '\0';
+                        fprintf(stderr, "Manager: Line too long, truncating.\n");
+                        char *line_copy = buffer_copy_line(&buffer, current_line, current_line_idx);
+                        if (!line_copy)
+                        {
+                            perror("Copying long line failed in manager");
+                            running = 0;
+
+                            pthread_mutex_lock(&buffer.mutex);
+                            pthread_cond_broadcast(&buffer.not_empty);
+                            pthread_mutex_unlock(&buffer.mutex);
+                            break;
+                        }
+                        queue_line(line_copy);
+                        current_line_idx = 0;
+                        line_end_offset = file_pos + i + 1;
                     }
-                    add_to_buffer(&buffer, line_copy);
-                    current_line_idx = 0;
                 }
             }
+            file_pos += bytes_read;
+            if (!running)
+                break;
         }
-        if (!running)
-            break;
-    }
+    } while (use_follow && running && bytes_read == 0 &&
+             follow_file(&fd, file_name, &watch, &file_pos, &current_line_idx) == 0);
+    free_file_watch(&watch);
 
-    // Handle last line if file doesn't end with newline
-    if (running && current_line_idx > 0 && bytes_read == 0)
+    // Handle last line if file doesn't end with newline; when following or
+    // checkpointing it may still be being written, so it is left for later
+    if (running && current_line_idx > 0 && bytes_read == 0 && !use_follow && checkpoint_path == NULL)
     {
         current_line[current_line_idx] = '\0';
-        char *line_copy = strdup(current_line);
+        char *line_copy = buffer_copy_line(&buffer, current_line, current_line_idx);
         if (!line_copy)
         {
-            perror("strdup for last line failed in manager");
+            perror("Copying last line failed in manager");
             running = 0;
         }
         else
         {
-            add_to_buffer(&buffer, line_copy);
+            queue_line(line_copy);
         }
     }
+    flush_lines();
 
     // Check for read errors
     if (bytes_read == -1 && running)
@@ -154,21 +546,8 @@ void *manager(void *arg)
         perror("Error closing file in manager");
     }
 
-    // Send EOF markers to all workers to signal them to terminate
-    for (int i = 0; i < num_workers && running; i++)
-    {
-        char *eof_marker = strdup(EOF_MARKER);
-        if (!eof_marker)
-        {
-            perror("strdup for EOF marker failed");
-            running = 0;
-            pthread_mutex_lock(&buffer.mutex);
-            pthread_cond_broadcast(&buffer.not_empty);
-            pthread_mutex_unlock(&buffer.mutex);
-            break;
-        }
-        add_to_buffer(&buffer, eof_marker);
-    }
+    // Workers finish once the remaining lines are taken
+    close_buffer(&buffer);
     return NULL;
 }
 
@@ -183,47 +562,406 @@ void *worker(void *arg)
 {
     int id = *(int *)arg;
     int count = 0;
+    SearchEngine *engine = &engines[id];
+    int *counts = &term_counts[id * num_terms];
+
+    // mmap mode: search ranges of the mapped file until the buffer is closed and drained
+    while (use_mmap && running)
+    {
+        LineSpan span;
+        if (remove_span_from_buffer(&buffer, &span) != 0)
+            break;
+        count += search_lines(engine, span.start, span.length, counts);
+    }
 
-    // Process lines until EOF marker or program termination
-    while (running)
+    // Process lines until the buffer is closed and drained, or program termination
+    char *lines[LINE_BATCH_SIZE];
+    while (!use_mmap && running)
     {
-        // Get a line from the buffer
-        char *line = remove_from_buffer(&buffer);
-        if (!line)
+        // Get a batch of lines from the buffer
+        int n = remove_batch_from_buffer(&buffer, lines, LINE_BATCH_SIZE);
+        if (n == 0)
             break;
 
-        // Check if this is the EOF marker
-        if (strcmp(line, EOF_MARKER) == 0)
+        // Check which lines contain a search term
+        int batch_matches = 0;
+        for (int i = 0; i < n; i++)
         {
-            free(line);
-            break;
+            if (search_line(engine, lines[i], strlen(lines[i]), counts))
+                batch_matches++;
+            buffer_release_line(&buffer, lines[i]);
         }
+        count += batch_matches;
 
-        // Check if line contains the search term
-        if (strstr(line, search_term))
-            count++;
-        free(line);
+        // Follow mode reports counts while running: matches first, so they are in once the lines are done
+        if (use_follow)
+        {
+            atomic_fetch_add(&live_matches, batch_matches);
+            atomic_fetch_add(&lines_done, n);
+        }
     }
 
-    // Save the count and report results
+    // Save the count and report results; main shows the totals after joining
     match_counts[id] = count;
     printf("Worker %d found %d matches\n", id, count);
+    return NULL;
+}
 
-    // Wait for all workers to finish before showing total
-    pthread_barrier_wait(&barrier);
+/**
+ * Reads a file range with pread, retrying on short reads
+ *
+ * @param fd - File to read
+ * @param offset - Offset of the first byte
+ * @param len - Number of bytes wanted
+ * @param dst - Receives the bytes
+ * @return Number of bytes read (less than len only at end of file), or -1 on error
+ */
+static ssize_t read_range(int fd, off_t offset, size_t len, char *dst)
+{
+    size_t done = 0;
+    while (done < len)
+    {
+        ssize_t n = pread(fd, dst + done, len - done, offset + (off_t)done);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n == -1)
+            return -1;
+        if (n == 0)
+            break;
+        done += (size_t)n;
+    }
+    return (ssize_t)done;
+}
 
-    // Worker 0 is responsible for calculating and showing the total
-    if (id == 0 && running)
+/**
+ * Makes sure a worker's read buffer holds at least len bytes
+ *
+ * @param buf - The buffer, replaced when it grows
+ * @param cap - Its capacity, updated when it grows
+ * @param len - Bytes needed
+ * @return 0 on success, -1 on failure
+ */
+static int reserve_read_buffer(char **buf, size_t *cap, size_t len)
+{
+    if (len <= *cap)
+        return 0;
+    size_t new_cap = *cap ? *cap : FILE_CHUNK_SIZE;
+    while (new_cap < len)
+        new_cap *= 2;
+    char *grown = realloc(*buf, new_cap);
+    if (grown == NULL)
     {
-        int total = 0;
-        printf("--------------------\n");
-        for (int i = 0; i < num_workers; i++)
+        perror("Failed to grow read buffer in worker");
+        return -1;
+    }
+    *buf = grown;
+    *cap = new_cap;
+    return 0;
+}
+
+/**
+ * Reads a chunk and searches the lines it owns
+ * The byte before the chunk is read too, so a line starting exactly at
+ * chunk->start is recognized; the partial line before it belongs to the
+ * previous chunk. The last line is read to its end, past chunk->end.
+ *
+ * @param chunk - The chunk to search
+ * @param engine - The worker's search engine
+ * @param counts - The worker's per-term counts
+ * @param buf - The worker's read buffer
+ * @param cap - Its capacity
+ * @return Number of matching lines
+ */
+static int search_chunk(const Chunk *chunk, SearchEngine *engine, int *counts, char **buf, size_t *cap)
+{
+    LogFile *file = &log_files[chunk->file];
+    off_t from = chunk->start > 0 ? chunk->start - 1 : 0;
+    size_t want = (size_t)(chunk->end - from);
+
+    if (reserve_read_buffer(buf, cap, want) != 0)
+        return 0;
+    ssize_t got = read_range(file->fd, from, want, *buf);
+    if (got == -1)
+    {
+        fprintf(stderr, "Error reading %s: %s\n", file->path, strerror(errno));
+        return 0;
+    }
+
+    // Skip the end of the line that started in the previous chunk
+    size_t begin = 0;
+    if (chunk->start > 0)
+    {
+        char *nl = memchr(*buf, '\n', (size_t)got);
+        if (nl == NULL)
+            return 0;
+        begin = (size_t)(nl - *buf) + 1;
+    }
+    if (begin >= (size_t)got)
+        return 0;
+
+    // Finish the last line, which may continue into the next chunk
+    size_t len = (size_t)got;
+    while (len == want && (*buf)[len - 1] != '\n')
+    {
+        if (reserve_read_buffer(buf, cap, len + CHUNK_EXTEND_SIZE) != 0)
+            break;
+        ssize_t n = read_range(file->fd, from + (off_t)len, CHUNK_EXTEND_SIZE, *buf + len);
+        if (n <= 0)
+            break;
+        char *nl = memchr(*buf + len, '\n', (size_t)n);
+        want = len + CHUNK_EXTEND_SIZE;
+        len = nl ? (size_t)(nl - *buf) + 1 : len + (size_t)n;
+    }
+
+    int matches = search_lines(engine, *buf + begin, len - begin, counts);
+    atomic_fetch_add(&file->matches, matches);
+    return matches;
+}
+
+/**
+ * Worker thread function for multi-file mode (reader and searcher)
+ * Takes chunks from the scheduler, stealing from other workers once its own
+ * run out, until no chunk is left or the program is terminating
+ *
+ * @param arg - Pointer to the worker's ID
+ * @return NULL
+ */
+void *file_worker(void *arg)
+{
+    int id = *(int *)arg;
+    int count = 0, chunks = 0, steals = 0;
+    SearchEngine *engine = &engines[id];
+    int *counts = &term_counts[id * num_terms];
+    char *buf = NULL;
+    size_t cap = 0;
+
+    Chunk chunk;
+    int stolen;
+    while (running && next_chunk(&scheduler, id, &chunk, &stolen) == 0)
+    {
+        count += search_chunk(&chunk, engine, counts, &buf, &cap);
+        chunks++;
+        steals += stolen;
+    }
+    free(buf);
+
+    match_counts[id] = count;
+    printf("Worker %d found %d matches (%d chunks, %d stolen)\n", id, count, chunks, steals);
+    return NULL;
+}
+
+/**
+ * Opens a file for multi-file mode and appends it to log_files
+ *
+ * @param path - Path of the file
+ * @param quiet - Non-zero to skip non-regular files without a message
+ * @return 0 if added or skipped, -1 on allocation failure
+ */
+static int add_log_file(const char *path, int quiet)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1)
+    {
+        fprintf(stderr, "Skipping %s: %s\n", path, strerror(errno));
+        if (fd != -1)
+            close(fd);
+        return 0;
+    }
+    if (!S_ISREG(st.st_mode))
+    {
+        if (!quiet)
+            fprintf(stderr, "Skipping %s: not a regular file\n", path);
+        close(fd);
+        return 0;
+    }
+
+    LogFile *grown = realloc(log_files, (num_files + 1) * sizeof(LogFile));
+    char *copy = strdup(path);
+    if (grown == NULL || copy == NULL)
+    {
+        perror("Failed to add log file");
+        free(copy);
+        close(fd);
+        if (grown != NULL)
+            log_files = grown;
+        return -1;
+    }
+    log_files = grown;
+    log_files[num_files].path = copy;
+    log_files[num_files].fd = fd;
+    log_files[num_files].size = st.st_size;
+    atomic_init(&log_files[num_files].matches, 0);
+    num_files++;
+    return 0;
+}
+
+/**
+ * Adds the regular files of a directory (not recursive, hidden files skipped)
+ * in name order
+ *
+ * @param dir - Path of the directory
+ * @return 0 on success, -1 on failure
+ */
+static int add_log_directory(const char *dir)
+{
+    struct dirent **entries;
+    int n = scandir(dir, &entries, NULL, alphasort);
+    if (n == -1)
+    {
+        fprintf(stderr, "Error reading directory %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+
+    int ret = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (ret == 0 && entries[i]->d_name[0] != '.')
+        {
+            size_t len = strlen(dir) + strlen(entries[i]->d_name) + 2;
+            char *path = malloc(len);
+            if (path == NULL)
+            {
+                perror("Failed to build file path");
+                ret = -1;
+            }
+            else
+            {
+                int slash = dir[strlen(dir) - 1] != '/';
+                snprintf(path, len, "%s%s%s", dir, slash ? "/" : "", entries[i]->d_name);
+                ret = add_log_file(path, 1);
+                free(path);
+            }
+        }
+        free(entries[i]);
+    }
+    free(entries);
+    return ret;
+}
+
+/**
+ * Collects the files for multi-file mode and schedules their chunks
+ * Each file's chunks are spread over the workers in contiguous runs, so
+ * every worker reads sequentially until it has to steal.
+ *
+ * @param log_file - The positional log file or directory
+ * @return 0 on success, -1 on failure
+ */
+static int init_log_files(const char *log_file)
+{
+    struct stat st;
+    int ret = (stat(log_file, &st) == 0 && S_ISDIR(st.st_mode)) ? add_log_directory(log_file) : add_log_file(log_file, 0);
+    for (int i = 0; ret == 0 && i < num_extra_files; i++)
+    {
+        ret = (stat(extra_files[i], &st) == 0 && S_ISDIR(st.st_mode)) ? add_log_directory(extra_files[i])
+                                                                       : add_log_file(extra_files[i], 0);
+    }
+    if (ret != 0)
+        return -1;
+    if (num_files == 0)
+    {
+        fprintf(stderr, "No log files to search\n");
+        return -1;
+    }
+
+    if (init_scheduler(&scheduler, num_workers) != 0)
+        return -1;
+    for (int f = 0; f < num_files; f++)
+    {
+        off_t num_chunks = (log_files[f].size + FILE_CHUNK_SIZE - 1) / FILE_CHUNK_SIZE;
+        for (off_t j = 0; j < num_chunks; j++)
         {
-            total += match_counts[i];
+            Chunk chunk = {.file = f, .start = j * FILE_CHUNK_SIZE, .end = (j + 1) * FILE_CHUNK_SIZE};
+            if (chunk.end > log_files[f].size)
+                chunk.end = log_files[f].size;
+            int owner = (int)((f + j * num_workers / num_chunks) % num_workers);
+            if (add_chunk(&scheduler, owner, chunk) != 0)
+                return -1;
         }
-        printf("Total matches found: %d\n", total);
     }
-    return NULL;
+    return 0;
+}
+
+/**
+ * Closes the files of multi-file mode and frees the scheduler
+ */
+static void free_log_files(void)
+{
+    for (int f = 0; f < num_files; f++)
+    {
+        close(log_files[f].fd);
+        free(log_files[f].path);
+    }
+    free(log_files);
+    log_files = NULL;
+    num_files = 0;
+    free_scheduler(&scheduler);
+    free(extra_files);
+    extra_files = NULL;
+}
+
+/**
+ * Prints the per-file (multi-file mode) and per-term (several terms) line
+ * counts and the total
+ */
+static void print_results(void)
+{
+    int total = 0;
+    printf("--------------------\n");
+    for (int i = 0; i < num_workers; i++)
+    {
+        total += match_counts[i];
+    }
+    for (int f = 0; f < num_files; f++)
+        printf("%s: %d matches\n", log_files[f].path, atomic_load(&log_files[f].matches));
+    // With several terms, also show how many lines contain each one
+    for (int t = 0; num_terms > 1 && t < num_terms; t++)
+    {
+        int term_total = 0;
+        for (int i = 0; i < num_workers; i++)
+            term_total += term_counts[i * num_terms + t];
+        printf("Matches for \"%s\": %d\n", search_terms[t], term_total);
+    }
+    printf("Total matches found: %d\n", total);
+    if (resumed)
+        printf("Total including previous runs: %lld\n", resumed_matches + total);
+
+    // Copied lines: how many were served without locking or calling malloc
+    if (!use_mmap && !use_files)
+    {
+        LinePoolStats stats;
+        get_line_pool_stats(&buffer.line_pool, &stats);
+        if (stats.allocations > 0)
+            printf("Line pool: %llu lines, %.1f%% from thread caches, %llu slabs, %llu oversized\n",
+                   stats.allocations, 100.0 * stats.cache_hits / stats.allocations,
+                   (unsigned long long)stats.slab_count, stats.oversized);
+    }
+}
+
+/**
+ * Saves the final checkpoint once every line read has been searched
+ */
+static void save_final_checkpoint(void)
+{
+    long long matches = resumed_matches;
+    for (int i = 0; i < num_workers; i++)
+        matches += match_counts[i];
+    Checkpoint checkpoint = {.dev = log_dev, .ino = log_ino, .offset = line_end_offset, .matches = matches};
+    save_checkpoint(checkpoint_path, &checkpoint);
+}
+
+/**
+ * Frees everything main set up before starting the threads
+ */
+static void cleanup(void)
+{
+    if (mapped_file != NULL)
+        munmap(mapped_file, mapped_size);
+    if (!use_files)
+        free_buffer(&buffer);
+    free(match_counts);
+    free_log_files();
+    free_engines();
 }
 
 /**
@@ -232,7 +970,16 @@ void *worker(void *arg)
  */
 void handle_signal()
 {
+    // In follow mode the first Ctrl+C only stops following; the manager notices within FOLLOW_POLL_MS
+    if (use_follow && !follow_stop)
+    {
+        follow_stop = 1;
+        return;
+    }
     running = 0;
+    // Multi-file workers check running between chunks and never wait on the buffer
+    if (use_files)
+        return;
     pthread_cond_broadcast(&buffer.not_full);
     pthread_cond_broadcast(&buffer.not_empty);
 }
@@ -248,10 +995,48 @@ void handle_signal()
  */
 int main(int argc, char *argv[])
 {
-    // Validate command-line arguments
-    if (argc != 5)
+    // Validate command-line arguments (options follow the positional arguments)
+    int bad_option = argc < 5;
+    search_terms = malloc((argc > 4 ? argc - 3 : 1) * sizeof(char *));
+    extra_files = malloc((argc > 4 ? argc - 3 : 1) * sizeof(char *));
+    if (search_terms == NULL || extra_files == NULL)
+    {
+        perror("Failed to allocate memory for search terms");
+        free(search_terms);
+        free(extra_files);
+        return 1;
+    }
+    if (!bad_option)
+        search_terms[num_terms++] = argv[4];
+    for (int i = 5; i < argc && !bad_option; i++)
+    {
+        if (strcmp(argv[i], "--mmap") == 0)
+            use_mmap = 1;
+        else if (strcmp(argv[i], "--lock-free") == 0)
+            use_lock_free = 1;
+        else if (strcmp(argv[i], "--ignore-case") == 0)
+            search_flags |= SEARCH_IGNORE_CASE;
+        else if (strcmp(argv[i], "--regex") == 0)
+            search_flags |= SEARCH_REGEX;
+        else if (strncmp(argv[i], "--term=", 7) == 0)
+            search_terms[num_terms++] = argv[i] + 7;
+        else if (strncmp(argv[i], "--file=", 7) == 0)
+            extra_files[num_extra_files++] = argv[i] + 7;
+        else if (strcmp(argv[i], "--follow") == 0)
+            use_follow = 1;
+        else if (strncmp(argv[i], "--checkpoint=", 13) == 0 && argv[i][13] != '\0')
+            checkpoint_path = argv[i] + 13;
+        else if (strncmp(argv[i], "--kernel=", 9) != 0 || parse_search_kernel(argv[i] + 9, &search_kernel) != 0)
+            bad_option = 1;
+    }
+    if (bad_option)
     {
-        fprintf(stderr, "Usage: %s <buffer_size> <num_workers> <log_file> <search_term>\n", argv[0]);
+        fprintf(stderr,
+                "Usage: %s <buffer_size> <num_workers> <log_file> <search_term> [--term=<term>]... [--ignore-case] "
+                "[--regex] [--kernel=auto|scalar|sse2|avx2] [--mmap] [--lock-free] [--file=<log_file>]... [--follow] [--checkpoint=<file>]\n",
+                argv[0]);
+        free(search_terms);
+        free(extra_files);
         return 1;
     }
 
@@ -259,32 +1044,60 @@ int main(int argc, char *argv[])
     int buffer_size = atoi(argv[1]);
     num_workers = atoi(argv[2]);
     char *log_file = argv[3];
-    search_term = argv[4];
 
     // Validate numeric arguments
     if (buffer_size <= 0 || num_workers <= 0)
     {
         fprintf(stderr, "Buffer size and number of workers must be positive\n");
+        free(search_terms);
+        free(extra_files);
         return 1;
     }
 
-    // Initialize the shared buffer
-    init_buffer(&buffer, buffer_size);
+    // Prepare the search engines before any thread starts
+    if (init_engines() != 0)
+    {
+        free(extra_files);
+        free_engines();
+        return 1;
+    }
 
-    // Allocate memory for worker match counts
-    match_counts = calloc(num_workers, sizeof(int));
-    if (match_counts == NULL)
+    // Multi-file mode: a directory as log_file, or extra files with --file
+    struct stat log_st;
+    use_files = num_extra_files > 0 || (stat(log_file, &log_st) == 0 && S_ISDIR(log_st.st_mode));
+    if ((use_follow || checkpoint_path != NULL) && (use_files || use_mmap))
     {
-        perror("Failed to allocate memory for match_counts");
+        fprintf(stderr, "--follow and --checkpoint need a single log file and cannot be combined with --mmap\n");
+        free(extra_files);
+        free_engines();
+        return 1;
+    }
+    atomic_init(&lines_done, 0);
+    atomic_init(&live_matches, 0);
+    if (use_files && init_log_files(log_file) != 0)
+    {
+        free_log_files();
+        free_engines();
         return 1;
     }
 
-    // Initialize barrier for worker synchronization
-    int barrier_ret = pthread_barrier_init(&barrier, NULL, num_workers);
-    if (barrier_ret != 0)
+    // Initialize the shared buffer (single-file mode only)
+    int buffer_ret = 0;
+    if (!use_files)
+        buffer_ret = use_lock_free ? init_lock_free_buffer(&buffer, buffer_size) : init_buffer(&buffer, buffer_size);
+    if (buffer_ret != 0)
     {
-        fprintf(stderr, "Error initializing barrier: %s\n", strerror(barrier_ret));
-        free(match_counts);
+        free(extra_files);
+        free_engines();
+        return 1;
+    }
+
+    // Allocate memory for worker match counts
+    match_counts = calloc(num_workers, sizeof(int));
+    if (match_counts == NULL)
+    {
+        perror("Failed to allocate memory for match_counts");
+        cleanup();
         return 1;
     }
 
@@ -296,44 +1109,38 @@ int main(int argc, char *argv[])
     if (sigaction(SIGINT, &sa, NULL) == -1)
     {
         perror("Error setting up SIGINT handler");
-        free(match_counts);
-        pthread_barrier_destroy(&barrier);
+        cleanup();
         return 1;
     }
 
-    // Create manager thread (producer)
+    // Create manager thread (producer); in multi-file mode the workers read the files themselves
     pthread_t manager_thread;
-    int pt_ret = pthread_create(&manager_thread, NULL, manager, log_file);
-    if (pt_ret != 0)
+    if (!use_files)
     {
-        fprintf(stderr, "Error creating manager thread: %s\n", strerror(pt_ret));
-        free(match_counts);
-        pthread_barrier_destroy(&barrier);
-        return 1;
+        int pt_ret = pthread_create(&manager_thread, NULL, manager, log_file);
+        if (pt_ret != 0)
+        {
+            fprintf(stderr, "Error creating manager thread: %s\n", strerror(pt_ret));
+            cleanup();
+            return 1;
+        }
     }
 
-    // Allocate memory for worker thread handles
+    // Allocate memory for worker thread handles and IDs
     pthread_t *workers = malloc(num_workers * sizeof(pthread_t));
-    if (workers == NULL)
-    {
-        perror("Failed to allocate memory for workers array");
-        running = 0;
-        pthread_join(manager_thread, NULL);
-        free(match_counts);
-        pthread_barrier_destroy(&barrier);
-        return 1;
-    }
-
-    // Allocate memory for worker thread IDs
     int *ids = malloc(num_workers * sizeof(int));
-    if (ids == NULL)
+    if (workers == NULL || ids == NULL)
     {
-        perror("Failed to allocate memory for ids array");
+        perror("Failed to allocate memory for worker threads");
         running = 0;
+        if (!use_files)
+        {
+            wake_all_threads();
+            pthread_join(manager_thread, NULL);
+        }
         free(workers);
-        pthread_join(manager_thread, NULL);
-        free(match_counts);
-        pthread_barrier_destroy(&barrier);
+        free(ids);
+        cleanup();
         return 1;
     }
 
@@ -341,39 +1148,45 @@ int main(int argc, char *argv[])
     for (int i = 0; i < num_workers; i++)
     {
         ids[i] = i;
-        int pt_ret = pthread_create(&workers[i], NULL, worker, &ids[i]);
+        int pt_ret = pthread_create(&workers[i], NULL, use_files ? file_worker : worker, &ids[i]);
         if (pt_ret != 0)
         {
             fprintf(stderr, "Error creating worker thread %d: %s\n", i, strerror(pt_ret));
             running = 0;
-            pthread_cond_broadcast(&buffer.not_full);
-            pthread_cond_broadcast(&buffer.not_empty);
-            pthread_join(manager_thread, NULL);
+            if (!use_files)
+            {
+                wake_all_threads();
+                pthread_join(manager_thread, NULL);
+            }
             for (int j = 0; j < i; ++j)
             {
                 pthread_join(workers[j], NULL);
             }
             free(ids);
             free(workers);
-            free(match_counts);
-            pthread_barrier_destroy(&barrier);
+            cleanup();
             return 1;
         }
     }
 
     // Wait for all threads to finish
-    pthread_join(manager_thread, NULL);
+    if (!use_files)
+        pthread_join(manager_thread, NULL);
     for (int i = 0; i < num_workers; i++)
     {
         pthread_join(workers[i], NULL);
     }
 
+    // Every worker has stored its counts, so the totals can be shown
+    if (running)
+        print_results();
+    if (running && checkpoint_path != NULL)
+        save_final_checkpoint();
+
     // Clean up resources
-    free_buffer(&buffer);
-    free(match_counts);
     free(workers);
     free(ids);
-    pthread_barrier_destroy(&barrier);
+    cleanup();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -3,15 +3,29 @@
  * Assignment: HW4 - Producer-Consumer Problem with pthread
  * Description: Implementation of the thread-safe circular buffer for the
  *              producer-consumer pattern. Provides functions for initialization,
- *              adding/removing items, and cleanup.
+ *              adding/removing items (single or batched), and cleanup, for both
+ *              the mutex-protected queue and the lock-free ring.
  * Author: Recep Furkan Akın
  * Student ID: 210104004042
  */
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <sched.h>
+#include <time.h>
 #include "buffer.h"
 
+#define LOCK_FREE_SPIN_LIMIT 64 // Yields on a full/empty ring before sleeping on a condition variable
+#define LOCK_FREE_SLEEP_MS 50   // Upper bound on one sleep, so shutdown is always noticed
+
+// Kinds of items a buffer slot can hold
+typedef enum
+{
+    ITEM_LINE, // char * in data
+    ITEM_SPAN  // LineSpan in spans
+} ItemKind;
+
 extern volatile int running; // Flag to control thread execution
 
 /**
@@ -33,18 +47,34 @@ int init_buffer(Buffer *buffer, int size)
 
     // Initialize all buffer fields to a known state for safety
     buffer->data = NULL; // Initialize pointers to NULL for safety in cleanup
+    buffer->spans = NULL;
     buffer->size = 0;    // Initialize fields to known state
     buffer->count = 0;
     buffer->head = 0;
     buffer->tail = 0;
+    atomic_init(&buffer->closed, 0);
+    buffer->lock_free = 0;
+    buffer->seq = NULL;
+    atomic_init(&buffer->enqueue_pos, 0);
+    atomic_init(&buffer->dequeue_pos, 0);
+    atomic_init(&buffer->waiting_producers, 0);
+    atomic_init(&buffer->waiting_consumers, 0);
 
-    // Allocate memory for the buffer data array
-    buffer->data = malloc(size * sizeof(char *));
+    // Allocate memory for the buffer data array (zeroed: slots filled by spans stay NULL)
+    buffer->data = calloc(size, sizeof(char *));
     if (buffer->data == NULL)
     {
         perror("init_buffer: Failed to allocate buffer data array");
         return -1; // Error: Malloc failed
     }
+    buffer->spans = malloc(size * sizeof(LineSpan));
+    if (buffer->spans == NULL)
+    {
+        perror("init_buffer: Failed to allocate buffer span array");
+        free(buffer->data);
+        buffer->data = NULL;
+        return -1; // Error: Malloc failed
+    }
 
     // Initialize buffer metadata *after* successful allocation
     buffer->size = size;
@@ -56,6 +86,8 @@ int init_buffer(Buffer *buffer, int size)
         perror("init_buffer: pthread_mutex_init failed");
         free(buffer->data);  // Clean up allocated memory
         buffer->data = NULL; // Prevent double free in caller if they try cleanup
+        free(buffer->spans);
+        buffer->spans = NULL;
         return -1;           // Error: Mutex init failed
     }
 
@@ -67,6 +99,8 @@ int init_buffer(Buffer *buffer, int size)
         pthread_mutex_destroy(&buffer->mutex); // Clean up successfully initialized mutex
         free(buffer->data);
         buffer->data = NULL;
+        free(buffer->spans);
+        buffer->spans = NULL;
         return -1; // Error: Cond init failed
     }
 
@@ -79,114 +113,551 @@ int init_buffer(Buffer *buffer, int size)
         pthread_mutex_destroy(&buffer->mutex);   // Clean up successfully initialized mutex
         free(buffer->data);
         buffer->data = NULL;
+        free(buffer->spans);
+        buffer->spans = NULL;
         return -1; // Error: Cond init failed
     }
 
+    // Pool the lines are copied into
+    if (init_line_pool(&buffer->line_pool) != 0)
+    {
+        fprintf(stderr, "init_buffer: init_line_pool failed\n");
+        pthread_cond_destroy(&buffer->not_empty);
+        pthread_cond_destroy(&buffer->not_full);
+        pthread_mutex_destroy(&buffer->mutex);
+        free(buffer->data);
+        buffer->data = NULL;
+        free(buffer->spans);
+        buffer->spans = NULL;
+        return -1;
+    }
+
     // All initializations successful
     return 0;
 }
 
 /**
- * Adds a line to the buffer (producer function)
- * If the buffer is full, this function will block until space is available
+ * Initializes the buffer as a lock-free MPMC ring
+ * Slot i starts with sequence number i, i.e. free for the producer claiming position i
+ * A size of 1 is raised to 2
  *
- * @param buffer - Pointer to the buffer structure
- * @param line - The string to add to the buffer (dynamically allocated)
+ * @param buffer - Pointer to the buffer structure to initialize
+ * @param size - Maximum number of items the buffer can hold
+ * @return 0 on success, -1 on failure
  */
-void add_to_buffer(Buffer *buffer, char *line)
+int init_lock_free_buffer(Buffer *buffer, int size)
+{
+    // With a single slot "published at position p" and "free for position p + 1"
+    // would share the same sequence number, so the ring needs at least two slots
+    if (size == 1)
+        size = 2;
+    if (init_buffer(buffer, size) != 0)
+        return -1;
+
+    buffer->seq = malloc(size * sizeof(atomic_size_t));
+    if (buffer->seq == NULL)
+    {
+        perror("init_lock_free_buffer: Failed to allocate sequence array");
+        free_buffer(buffer);
+        return -1;
+    }
+    for (int i = 0; i < size; i++)
+        atomic_init(&buffer->seq[i], (size_t)i);
+    buffer->lock_free = 1;
+    return 0;
+}
+
+// --- Slot Contents ---
+
+/**
+ * Copies item i of a caller array into slot idx
+ */
+static void store_item(Buffer *buffer, int idx, ItemKind kind, const void *items, int i)
+{
+    if (kind == ITEM_LINE)
+    {
+        buffer->data[idx] = ((char *const *)items)[i];
+    }
+    else
+    {
+        buffer->spans[idx] = ((const LineSpan *)items)[i];
+        buffer->data[idx] = NULL; // No string to free for this slot
+    }
+}
+
+/**
+ * Copies slot idx into item i of a caller array
+ */
+static void load_item(Buffer *buffer, int idx, ItemKind kind, void *items, int i)
+{
+    if (kind == ITEM_LINE)
+    {
+        ((char **)items)[i] = buffer->data[idx];
+        buffer->data[idx] = NULL; // Clear the pointer for safety
+    }
+    else
+    {
+        ((LineSpan *)items)[i] = buffer->spans[idx];
+    }
+}
+
+// --- Mutex-Protected Queue ---
+
+/**
+ * Adds up to n items, filling all free slots on every lock acquisition
+ * Blocks while the buffer is full, unless the program is shutting down
+ *
+ * @return Number of items added
+ */
+static int put_locked(Buffer *buffer, ItemKind kind, const void *items, int n)
 {
+    int added = 0;
+
     // Lock the mutex to ensure exclusive access to the buffer
     pthread_mutex_lock(&buffer->mutex);
-
-    // If buffer is full, wait until there's space available
-    // This condition may be signaled by remove_from_buffer
-    while (buffer->count == buffer->size)
+    while (added < n)
     {
-        if (!running)
+        // If buffer is full, wait until there's space available
+        while (buffer->count == buffer->size)
         {
-            pthread_mutex_unlock(&buffer->mutex);
-            free(line); // Free the line if not added to buffer
-            return;
+            if (!running)
+            {
+                pthread_mutex_unlock(&buffer->mutex);
+                return added;
+            }
+            pthread_cond_wait(&buffer->not_full, &buffer->mutex);
+        }
+
+        // Copy as many items as fit at the head position
+        int k = buffer->size - buffer->count;
+        if (k > n - added)
+            k = n - added;
+        for (int i = 0; i < k; i++)
+        {
+            store_item(buffer, buffer->head, kind, items, added + i);
+            buffer->head = (buffer->head + 1) % buffer->size;
         }
-        pthread_cond_wait(&buffer->not_full, &buffer->mutex);
-        if (!running && buffer->count == buffer->size)
+        buffer->count += k;
+        added += k;
+
+        // Signal waiting consumers; several items can feed several of them
+        if (k == 1)
+            pthread_cond_signal(&buffer->not_empty);
+        else
+            pthread_cond_broadcast(&buffer->not_empty);
+    }
+    pthread_mutex_unlock(&buffer->mutex);
+    return added;
+}
+
+/**
+ * Removes up to max items with one lock acquisition
+ * Blocks while the buffer is empty, unless it is closed or the program is shutting down
+ *
+ * @return Number of items removed
+ */
+static int take_locked(Buffer *buffer, ItemKind kind, void *items, int max)
+{
+    // Lock the mutex to ensure exclusive access to the buffer
+    pthread_mutex_lock(&buffer->mutex);
+
+    // If buffer is empty, wait until there's at least one item
+    while (buffer->count == 0)
+    {
+        if (!running || atomic_load(&buffer->closed))
         {
             pthread_mutex_unlock(&buffer->mutex);
-            free(line); // Line was strdup'd by manager, must be freed if not added
-            return;
+            return 0;
         }
+        pthread_cond_wait(&buffer->not_empty, &buffer->mutex);
     }
 
-    // Add the line to the buffer at the head position
-    buffer->data[buffer->head] = line;
+    // Take the items from the tail position
+    int k = buffer->count < max ? buffer->count : max;
+    for (int i = 0; i < k; i++)
+    {
+        load_item(buffer, buffer->tail, kind, items, i);
+        buffer->tail = (buffer->tail + 1) % buffer->size;
+    }
+    buffer->count -= k;
 
-    // Update head using modulo arithmetic for circular buffer
-    buffer->head = (buffer->head + 1) % buffer->size;
+    // Signal waiting producers that the buffer is not full
+    if (k == 1)
+        pthread_cond_signal(&buffer->not_full);
+    else
+        pthread_cond_broadcast(&buffer->not_full);
+    pthread_mutex_unlock(&buffer->mutex);
+    return k;
+}
 
-    // Increment count to track number of items in buffer
-    buffer->count++;
+// --- Lock-Free Ring ---
 
-    // Signal any waiting consumers that the buffer is not empty
-    pthread_cond_signal(&buffer->not_empty);
+/**
+ * Claims the next position and stores item i in its slot
+ *
+ * @return 1 on success, 0 if the ring is full
+ */
+static int try_put_lock_free(Buffer *buffer, ItemKind kind, const void *items, int i)
+{
+    size_t pos = atomic_load_explicit(&buffer->enqueue_pos, memory_order_relaxed);
+    for (;;)
+    {
+        int idx = (int)(pos % (size_t)buffer->size);
+        size_t seq = atomic_load_explicit(&buffer->seq[idx], memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
 
-    // Release the mutex
-    pthread_mutex_unlock(&buffer->mutex);
+        if (diff == 0)
+        {
+            // Slot is free for this position; try to claim the position
+            if (atomic_compare_exchange_weak_explicit(&buffer->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                store_item(buffer, idx, kind, items, i);
+                atomic_store_explicit(&buffer->seq[idx], pos + 1, memory_order_release); // Publish
+                return 1;
+            }
+        }
+        else if (diff < 0)
+        {
+            return 0; // Slot still holds an item from the previous lap: full
+        }
+        else
+        {
+            pos = atomic_load_explicit(&buffer->enqueue_pos, memory_order_relaxed);
+        }
+    }
 }
 
 /**
- * Removes and returns a line from the buffer (consumer function)
- * If the buffer is empty, this function will block until an item is available
+ * Claims the oldest published position and copies its slot into item i
  *
- * @param buffer - Pointer to the buffer structure
- * @return A dynamically allocated string that must be freed by the caller
+ * @return 1 on success, 0 if the ring is empty
  */
-char *remove_from_buffer(Buffer *buffer)
+static int try_take_lock_free(Buffer *buffer, ItemKind kind, void *items, int i)
+{
+    size_t pos = atomic_load_explicit(&buffer->dequeue_pos, memory_order_relaxed);
+    for (;;)
+    {
+        int idx = (int)(pos % (size_t)buffer->size);
+        size_t seq = atomic_load_explicit(&buffer->seq[idx], memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&buffer->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+            {
+                load_item(buffer, idx, kind, items, i);
+                // Free the slot for the producer one lap ahead
+                atomic_store_explicit(&buffer->seq[idx], pos + buffer->size, memory_order_release);
+                return 1;
+            }
+        }
+        else if (diff < 0)
+        {
+            return 0; // Not published yet: empty
+        }
+        else
+        {
+            pos = atomic_load_explicit(&buffer->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * Wakes the threads sleeping on cond if the matching waiter counter says there are any
+ * The fence orders the caller's slot updates before the counter check; sleepers
+ * increment the counter before re-checking the ring, so no wake-up is lost.
+ */
+static void wake_lock_free_waiters(Buffer *buffer, atomic_int *waiters, pthread_cond_t *cond)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(waiters) > 0)
+    {
+        pthread_mutex_lock(&buffer->mutex);
+        pthread_cond_broadcast(cond);
+        pthread_mutex_unlock(&buffer->mutex);
+    }
+}
+
+/**
+ * Sleeps on cond until woken, unless ring_ready() already holds
+ * The wait is bounded so a shutdown is noticed even if its broadcast was missed.
+ */
+static void sleep_lock_free(Buffer *buffer, atomic_int *waiters, pthread_cond_t *cond,
+                            int (*ring_ready)(Buffer *))
 {
-    // Lock the mutex to ensure exclusive access to the buffer
     pthread_mutex_lock(&buffer->mutex);
+    atomic_fetch_add(waiters, 1);
+    if (running && !ring_ready(buffer))
+    {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LOCK_FREE_SLEEP_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(cond, &buffer->mutex, &deadline);
+    }
+    atomic_fetch_sub(waiters, 1);
+    pthread_mutex_unlock(&buffer->mutex);
+}
 
-    // If buffer is empty, wait until there's at least one item
-    // This condition may be signaled by add_to_buffer
-    while (buffer->count == 0)
+/**
+ * Returns non-zero if the slot at enqueue_pos is free (a producer could proceed)
+ */
+static int lock_free_has_room(Buffer *buffer)
+{
+    size_t pos = atomic_load(&buffer->enqueue_pos);
+    return atomic_load(&buffer->seq[pos % (size_t)buffer->size]) == pos;
+}
+
+/**
+ * Returns non-zero if the slot at dequeue_pos is published or the buffer is closed
+ */
+static int lock_free_has_items(Buffer *buffer)
+{
+    size_t pos = atomic_load(&buffer->dequeue_pos);
+    return atomic_load(&buffer->seq[pos % (size_t)buffer->size]) == pos + 1 || atomic_load(&buffer->closed);
+}
+
+/**
+ * Adds n items to the ring, spinning briefly and then sleeping while it is full
+ *
+ * @return Number of items added (less than n only on shutdown)
+ */
+static int put_lock_free(Buffer *buffer, ItemKind kind, const void *items, int n)
+{
+    int added = 0;
+    int spins = 0;
+    while (added < n)
     {
+        if (try_put_lock_free(buffer, kind, items, added))
+        {
+            added++;
+            spins = 0;
+            continue;
+        }
         if (!running)
+            break;
+        // Full: let sleeping consumers drain what is already published, then wait
+        wake_lock_free_waiters(buffer, &buffer->waiting_consumers, &buffer->not_empty);
+        if (++spins < LOCK_FREE_SPIN_LIMIT)
         {
-            pthread_mutex_unlock(&buffer->mutex);
-            return NULL;
+            sched_yield();
+            continue;
         }
-        pthread_cond_wait(&buffer->not_empty, &buffer->mutex);
-        if (!running && buffer->count == 0)
+        sleep_lock_free(buffer, &buffer->waiting_producers, &buffer->not_full, lock_free_has_room);
+        spins = 0;
+    }
+    if (added > 0)
+        wake_lock_free_waiters(buffer, &buffer->waiting_consumers, &buffer->not_empty);
+    return added;
+}
+
+/**
+ * Removes up to max items from the ring without locking
+ * Spins briefly and then sleeps while it is empty, unless it is closed
+ *
+ * @return Number of items removed
+ */
+static int take_lock_free(Buffer *buffer, ItemKind kind, void *items, int max)
+{
+    int spins = 0;
+    for (;;)
+    {
+        int k = 0;
+        while (k < max && try_take_lock_free(buffer, kind, items, k))
+            k++;
+        if (k > 0)
         {
-            pthread_mutex_unlock(&buffer->mutex);
-            return NULL;
+            wake_lock_free_waiters(buffer, &buffer->waiting_producers, &buffer->not_full);
+            return k;
+        }
+        if (!running)
+            return 0;
+        // Items added before close_buffer are visible once closed is seen, so re-check once
+        if (atomic_load(&buffer->closed))
+            return try_take_lock_free(buffer, kind, items, 0);
+        if (++spins < LOCK_FREE_SPIN_LIMIT)
+        {
+            sched_yield();
+            continue;
         }
+        sleep_lock_free(buffer, &buffer->waiting_consumers, &buffer->not_empty, lock_free_has_items);
+        spins = 0;
     }
+}
 
-    // Get the line from the buffer at the tail position
-    char *line = buffer->data[buffer->tail];
+/**
+ * Adds items using the buffer's implementation
+ */
+static int put_items(Buffer *buffer, ItemKind kind, const void *items, int n)
+{
+    return buffer->lock_free ? put_lock_free(buffer, kind, items, n) : put_locked(buffer, kind, items, n);
+}
 
-    // Clear the pointer for safety
-    buffer->data[buffer->tail] = NULL;
+/**
+ * Removes items using the buffer's implementation
+ */
+static int take_items(Buffer *buffer, ItemKind kind, void *items, int max)
+{
+    return buffer->lock_free ? take_lock_free(buffer, kind, items, max) : take_locked(buffer, kind, items, max);
+}
 
-    // Update tail using modulo arithmetic for circular buffer
-    buffer->tail = (buffer->tail + 1) % buffer->size;
+// --- Public Interface ---
 
-    // Decrement count to track number of items in buffer
-    buffer->count--;
+/**
+ * Adds a line to the buffer (producer function)
+ * If the buffer is full, this function will block until space is available
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param line - The string to add to the buffer (dynamically allocated)
+ */
+void add_to_buffer(Buffer *buffer, char *line)
+{
+    if (put_items(buffer, ITEM_LINE, &line, 1) == 0)
+        buffer_release_line(buffer, line); // Line was copied by manager, must be released if not added
+}
 
-    // Signal any waiting producers that the buffer is not full
-    pthread_cond_signal(&buffer->not_full);
+/**
+ * Removes and returns a line from the buffer (consumer function)
+ * If the buffer is empty, this function will block until an item is available
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @return A line that must be given back with buffer_release_line,
+ *         or NULL if the buffer is closed and empty or the program is shutting down
+ */
+char *remove_from_buffer(Buffer *buffer)
+{
+    char *line = NULL;
+    if (take_items(buffer, ITEM_LINE, &line, 1) == 0)
+        return NULL;
+    return line; // Caller is responsible for releasing it
+}
 
-    // Release the mutex
-    pthread_mutex_unlock(&buffer->mutex);
+/**
+ * Adds several lines to the buffer (producer function)
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param lines - The strings to add (from buffer_copy_line)
+ * @param n - Number of lines
+ * @return Number of lines added; the others are released
+ */
+int add_batch_to_buffer(Buffer *buffer, char **lines, int n)
+{
+    int added = put_items(buffer, ITEM_LINE, lines, n);
+    for (int i = added; i < n; i++)
+        buffer_release_line(buffer, lines[i]);
+    return added;
+}
+
+/**
+ * Removes up to max lines from the buffer (consumer function)
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param lines - Receives the strings, which must be given back with buffer_release_line
+ * @param max - Capacity of lines
+ * @return Number of lines removed, 0 once the buffer is closed and empty
+ */
+int remove_batch_from_buffer(Buffer *buffer, char **lines, int max)
+{
+    return take_items(buffer, ITEM_LINE, lines, max);
+}
+
+/**
+ * Copies a line into the buffer's line pool
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param line - The characters of the line (need not be terminated)
+ * @param len - Number of characters
+ * @return The NUL-terminated copy, or NULL if memory is exhausted
+ */
+char *buffer_copy_line(Buffer *buffer, const char *line, size_t len)
+{
+    return pool_copy_line(&buffer->line_pool, line, len);
+}
+
+/**
+ * Gives a line back to the buffer's line pool
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param line - A line from buffer_copy_line, or NULL
+ */
+void buffer_release_line(Buffer *buffer, char *line)
+{
+    pool_release_line(&buffer->line_pool, line);
+}
+
+/**
+ * Adds a range of lines to the buffer (producer function, mmap mode)
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param span - The line range to add (points into the mapping, nothing is copied)
+ * @return 0 on success, -1 if the program is shutting down
+ */
+int add_span_to_buffer(Buffer *buffer, LineSpan span)
+{
+    return put_items(buffer, ITEM_SPAN, &span, 1) == 1 ? 0 : -1;
+}
 
-    // Return the line (caller is responsible for freeing it)
-    return line;
+/**
+ * Removes a range of lines from the buffer (consumer function, mmap mode)
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param span - Receives the line range
+ * @return 0 on success, -1 if the buffer is closed and empty or the program is shutting down
+ */
+int remove_span_from_buffer(Buffer *buffer, LineSpan *span)
+{
+    return take_items(buffer, ITEM_SPAN, span, 1) == 1 ? 0 : -1;
+}
+
+/**
+ * Adds several line ranges to the buffer (producer function, mmap mode)
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param spans - The line ranges to add
+ * @param n - Number of ranges
+ * @return Number of ranges added
+ */
+int add_spans_to_buffer(Buffer *buffer, const LineSpan *spans, int n)
+{
+    return put_items(buffer, ITEM_SPAN, spans, n);
+}
+
+/**
+ * Removes up to max line ranges from the buffer (consumer function, mmap mode)
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param spans - Receives the line ranges
+ * @param max - Capacity of spans
+ * @return Number of ranges removed, 0 once the buffer is closed and empty
+ */
+int remove_spans_from_buffer(Buffer *buffer, LineSpan *spans, int max)
+{
+    return take_items(buffer, ITEM_SPAN, spans, max);
+}
+
+/**
+ * Marks the end of input and wakes every waiting consumer
+ *
+ * @param buffer - Pointer to the buffer structure
+ */
+void close_buffer(Buffer *buffer)
+{
+    atomic_store(&buffer->closed, 1);
+    pthread_mutex_lock(&buffer->mutex);
+    pthread_cond_broadcast(&buffer->not_empty);
+    pthread_mutex_unlock(&buffer->mutex);
 }
 
 /**
  * Frees all resources associated with the buffer
- * Frees any remaining strings in the buffer and destroys synchronization objects
+ * Releases any remaining strings in the buffer, frees the line pool and
+ * destroys synchronization objects
  *
  * @param buffer - Pointer to the buffer structure to free
  */
@@ -199,18 +670,34 @@ void free_buffer(Buffer *buffer)
     // Free any remaining strings in the buffer
     if (buffer->data != NULL)
     {
+        // Lock-free ring: published slots lie between dequeue_pos and enqueue_pos
+        if (buffer->lock_free)
+        {
+            size_t end = atomic_load(&buffer->enqueue_pos);
+            for (size_t pos = atomic_load(&buffer->dequeue_pos); pos < end; pos++)
+            {
+                int idx = (int)(pos % (size_t)buffer->size);
+                if (atomic_load(&buffer->seq[idx]) == pos + 1 && buffer->data[idx] != NULL)
+                    buffer_release_line(buffer, buffer->data[idx]);
+            }
+        }
         // Iterate through all items currently in the buffer
-        for (int i = 0; i < buffer->count; i++)
+        for (int i = 0; !buffer->lock_free && i < buffer->count; i++)
         {
             // Calculate the actual index using modulo arithmetic
             if (buffer->data[(buffer->tail + i) % buffer->size] != NULL)
             {
-                free(buffer->data[(buffer->tail + i) % buffer->size]);
+                buffer_release_line(buffer, buffer->data[(buffer->tail + i) % buffer->size]);
             }
         }
         // Free the buffer's data array
         free(buffer->data);
         buffer->data = NULL; // Mark as freed
+        free(buffer->spans); // Spans only point into the mapping
+        buffer->spans = NULL;
+        free(buffer->seq);
+        buffer->seq = NULL;
+        free_line_pool(&buffer->line_pool);
     }
 
     // Clean up synchronization objects
@@ -3,7 +3,10 @@
  * Assignment: HW4 - Producer-Consumer Problem with pthread
  * Description: Header file for the circular buffer implementation used in
  *              the producer-consumer pattern. This buffer is thread-safe and
- *              supports blocking operations when full or empty.
+ *              supports blocking operations when full or empty. Items can be
+ *              moved one at a time or in batches, and the buffer can run as a
+ *              mutex-protected queue or as a lock-free MPMC ring. Lines
+ *              are copied into the buffer's line pool (pool.c).
  * Author: Recep Furkan Akın
  * Student ID: 210104004042
  */
@@ -12,14 +15,33 @@
 #define BUFFER_H
 
 #include <pthread.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "pool.h"
+
+/**
+ * LineSpan structure - a range of whole lines inside a memory-mapped log file
+ * Spans point into the mapping and are never copied or freed.
+ */
+typedef struct
+{
+    const char *start; // First byte of the first line in the range
+    size_t length;     // Bytes in the range (ends right after a '\n' or at end of file)
+} LineSpan;
 
 /**
  * Buffer structure - implements a thread-safe circular buffer
  * Used for communication between manager (producer) and worker (consumer) threads
+ *
+ * In lock-free mode (init_lock_free_buffer) slots are claimed with compare-and-swap
+ * on enqueue_pos/dequeue_pos and every slot carries a sequence number (bounded MPMC
+ * queue in the style of Vyukov); head/tail/count are unused. The mutex and condition
+ * variables are then only used to sleep when the ring stays full or empty.
  */
 typedef struct
 {
     char **data;              // Array of strings (lines from the log file)
+    LineSpan *spans;          // Array of line ranges (used instead of data in mmap mode)
     int size;                 // Maximum capacity of the buffer
     int count;                // Current number of items in the buffer
     int head;                 // Index where the next item will be added
@@ -27,6 +49,16 @@ typedef struct
     pthread_mutex_t mutex;    // Mutex for thread-safe access
     pthread_cond_t not_full;  // Condition variable to signal when buffer is not full
     pthread_cond_t not_empty; // Condition variable to signal when buffer is not empty
+    atomic_int closed;        // Set by close_buffer: no more items will be added
+    LinePool line_pool;       // Blocks holding the lines (see buffer_copy_line)
+
+    // Lock-free mode
+    int lock_free;                                 // Non-zero if created by init_lock_free_buffer
+    atomic_size_t *seq;                            // Per-slot sequence numbers
+    _Alignas(64) atomic_size_t enqueue_pos;        // Next position claimed by a producer
+    _Alignas(64) atomic_size_t dequeue_pos;        // Next position claimed by a consumer
+    _Alignas(64) atomic_int waiting_producers;     // Producers sleeping on not_full
+    atomic_int waiting_consumers;                  // Consumers sleeping on not_empty
 } Buffer;
 
 /**
@@ -38,12 +70,22 @@ typedef struct
  */
 int init_buffer(Buffer *buffer, int size);
 
+/**
+ * Initializes the buffer as a lock-free MPMC ring with the given size
+ * (at least 2). All other buffer functions work the same way on it
+ *
+ * @param buffer - Pointer to the buffer structure to initialize
+ * @param size - Maximum number of items the buffer can hold
+ * @return 0 on success, -1 on failure
+ */
+int init_lock_free_buffer(Buffer *buffer, int size);
+
 /**
  * Adds a line to the buffer
  * If the buffer is full, this function will block until space is available
  *
  * @param buffer - Pointer to the buffer structure
- * @param line - The string to add to the buffer (must be dynamically allocated)
+ * @param line - The string to add (from buffer_copy_line); freed if not added on shutdown
  */
 void add_to_buffer(Buffer *buffer, char *line);
 
@@ -52,16 +94,109 @@ void add_to_buffer(Buffer *buffer, char *line);
  * If the buffer is empty, this function will block until an item is available
  *
  * @param buffer - Pointer to the buffer structure
- * @return A dynamically allocated string that must be freed by the caller
+ * @return A line that must be given back with buffer_release_line,
+ *         or NULL if the buffer is closed and empty or the program is shutting down
  */
 char *remove_from_buffer(Buffer *buffer);
 
+/**
+ * Adds several lines to the buffer, as many per lock acquisition as fit
+ * Blocks until all of them are added
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param lines - The strings to add (from buffer_copy_line); lines that cannot be
+ *                added because the program is shutting down are released
+ * @param n - Number of lines
+ * @return Number of lines added (less than n only on shutdown)
+ */
+int add_batch_to_buffer(Buffer *buffer, char **lines, int n);
+
+/**
+ * Removes up to max lines from the buffer with one lock acquisition
+ * If the buffer is empty, this function will block until an item is available
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param lines - Receives the strings, which must be given back with buffer_release_line
+ * @param max - Capacity of lines
+ * @return Number of lines removed, or 0 if the buffer is closed and empty
+ *         or the program is shutting down
+ */
+int remove_batch_from_buffer(Buffer *buffer, char **lines, int max);
+
+/**
+ * Copies a line into the buffer's line pool (replaces strdup for lines)
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param line - The characters of the line (need not be terminated)
+ * @param len - Number of characters
+ * @return The NUL-terminated copy, or NULL if memory is exhausted
+ */
+char *buffer_copy_line(Buffer *buffer, const char *line, size_t len);
+
+/**
+ * Gives a line removed from the buffer back to the line pool (replaces free)
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param line - A line from buffer_copy_line, or NULL
+ */
+void buffer_release_line(Buffer *buffer, char *line);
+
+/**
+ * Adds a range of lines to the buffer (mmap mode)
+ * If the buffer is full, this function will block until space is available
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param span - The line range to add; it is copied, the lines themselves are not
+ * @return 0 on success, -1 if the program is shutting down and the span was not added
+ */
+int add_span_to_buffer(Buffer *buffer, LineSpan span);
+
+/**
+ * Removes a range of lines from the buffer (mmap mode)
+ * If the buffer is empty, this function will block until an item is available
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param span - Receives the line range
+ * @return 0 on success, -1 if the buffer is closed and empty or the program is shutting down
+ */
+int remove_span_from_buffer(Buffer *buffer, LineSpan *span);
+
+/**
+ * Adds several line ranges to the buffer, as many per lock acquisition as fit
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param spans - The line ranges to add
+ * @param n - Number of ranges
+ * @return Number of ranges added (less than n only on shutdown)
+ */
+int add_spans_to_buffer(Buffer *buffer, const LineSpan *spans, int n);
+
+/**
+ * Removes up to max line ranges from the buffer with one lock acquisition
+ *
+ * @param buffer - Pointer to the buffer structure
+ * @param spans - Receives the line ranges
+ * @param max - Capacity of spans
+ * @return Number of ranges removed, or 0 if the buffer is closed and empty
+ *         or the program is shutting down
+ */
+int remove_spans_from_buffer(Buffer *buffer, LineSpan *spans, int max);
+
+/**
+ * Marks the end of input: once the remaining items are removed, the remove
+ * functions return NULL/0/-1 instead of blocking. Wakes all waiting consumers.
+ *
+ * @param buffer - Pointer to the buffer structure
+ */
+void close_buffer(Buffer *buffer);
+
 /**
  * Frees all resources associated with the buffer
- * Frees any remaining strings in the buffer and destroys synchronization objects
+ * Releases any remaining strings in the buffer, frees the line pool and
+ * destroys synchronization objects
  *
  * @param buffer - Pointer to the buffer structure to free
  */
 void free_buffer(Buffer *buffer);
 
-#endif // BUFFER_H
\ No newline at end of file
+#endif // BUFFER_H
@@ -0,0 +1,90 @@
+/**
+ * File: follow.h
+ * Assignment: HW4 - Producer-Consumer Problem with pthread
+ * Description: Header file for follow mode support: an inotify watch that
+ *              wakes the manager when the log file changes, and checkpoint
+ *              files that record how far the log has been searched.
+ * Author: Recep Furkan Akın
+ * Student ID: 210104004042
+ */
+
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include <sys/types.h>
+
+/**
+ * FileWatch structure - inotify watch on one log file
+ */
+typedef struct
+{
+    int inotify_fd; // inotify instance, -1 if not initialized
+    int watch;      // Watch descriptor of the file, -1 if not watched
+} FileWatch;
+
+/**
+ * Checkpoint structure - how far a log file has been searched
+ * dev/ino identify the file, so a rotated log is not resumed at the old offset.
+ */
+typedef struct
+{
+    dev_t dev;         // Device of the log file
+    ino_t ino;         // Inode of the log file
+    off_t offset;      // Byte after the last line that was searched
+    long long matches; // Matching lines before offset
+} Checkpoint;
+
+/**
+ * Starts watching a file for appends, truncation and renames
+ *
+ * @param watch - Pointer to the watch structure to initialize
+ * @param path - Path of the file
+ * @return 0 on success, -1 on failure
+ */
+int init_file_watch(FileWatch *watch, const char *path);
+
+/**
+ * Moves the watch to the file now at path (after the log was rotated)
+ *
+ * @param watch - Pointer to the watch structure
+ * @param path - Path of the file
+ * @return 0 on success, -1 on failure
+ */
+int rewatch_file(FileWatch *watch, const char *path);
+
+/**
+ * Waits until the watched file changes or the timeout passes
+ * Pending events are drained, so one call covers any number of changes.
+ *
+ * @param watch - Pointer to the watch structure
+ * @param timeout_ms - Longest wait in milliseconds
+ * @return 1 if the file changed, 0 on timeout or interruption, -1 on error
+ */
+int wait_for_change(FileWatch *watch, int timeout_ms);
+
+/**
+ * Stops watching and closes the inotify instance
+ *
+ * @param watch - Pointer to the watch structure
+ */
+void free_file_watch(FileWatch *watch);
+
+/**
+ * Reads a checkpoint file
+ *
+ * @param path - Path of the checkpoint file
+ * @param checkpoint - Receives the checkpoint
+ * @return 0 on success, 1 if there is no checkpoint yet, -1 on error
+ */
+int load_checkpoint(const char *path, Checkpoint *checkpoint);
+
+/**
+ * Writes a checkpoint file atomically (temporary file, fsync, rename)
+ *
+ * @param path - Path of the checkpoint file
+ * @param checkpoint - The checkpoint to write
+ * @return 0 on success, -1 on error
+ */
+int save_checkpoint(const char *path, const Checkpoint *checkpoint);
+
+#endif // FOLLOW_H
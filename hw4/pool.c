@@ -0,0 +1,363 @@
+/**
+ * File: pool.c
+ * Assignment: HW4 - Producer-Consumer Problem with pthread
+ * Description: Implementation of the line pool. Blocks of six size classes
+ *              are carved from 64 KB slabs and linked into free lists; each
+ *              block starts with a header naming its class, so a line can be
+ *              released without knowing its length. Threads allocate from and
+ *              release to their own cache, and the shared lists are only
+ *              locked to refill a cache or take back half of a full one.
+ * Author: Recep Furkan Akın
+ * Student ID: 210104004042
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "pool.h"
+
+#define BLOCK_HEADER_SIZE 8  // Class index stored in front of the line (keeps lines 8-byte aligned)
+#define SLAB_HEADER_SIZE 16  // Slab link, padded so blocks stay aligned
+#define OVERSIZED_CLASS LINE_POOL_CLASSES // Header value of lines copied with malloc
+
+/**
+ * ThreadCache structure - free blocks and counters of one thread
+ * Only the owning thread touches it, so nothing here needs a lock.
+ */
+typedef struct
+{
+    LinePool *pool;                            // Pool the cache belongs to, NULL until first use
+    void *free_list[LINE_POOL_CLASSES];        // Free blocks per class, linked through their first word
+    int free_count[LINE_POOL_CLASSES];         // Blocks on each free_list
+    LinePoolStats counters;                    // Folded into the pool's totals when the thread exits
+} ThreadCache;
+
+static __thread ThreadCache thread_cache;
+
+/**
+ * Returns the link word of a free block
+ *
+ * @param block - The block
+ * @return Pointer to the first word of the block
+ */
+static void **block_link(void *block)
+{
+    return (void **)block;
+}
+
+/**
+ * Adds a thread's counters to the pool's totals. pool->mutex must be held
+ *
+ * @param pool - Pointer to the pool
+ * @param counters - The counters to add
+ */
+static void add_counters(LinePool *pool, const LinePoolStats *counters)
+{
+    pool->totals.cache_hits += counters->cache_hits;
+    pool->totals.shared_hits += counters->shared_hits;
+    pool->totals.slab_carves += counters->slab_carves;
+    pool->totals.oversized += counters->oversized;
+    pool->totals.releases += counters->releases;
+}
+
+/**
+ * Hands the calling thread's cached blocks and counters back to its pool
+ * Runs as the destructor of pool->cache_key when the thread exits
+ *
+ * @param arg - The pool (value stored under cache_key)
+ */
+static void flush_thread_cache(void *arg)
+{
+    LinePool *pool = arg;
+    if (thread_cache.pool != pool)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    for (int c = 0; c < LINE_POOL_CLASSES; c++)
+    {
+        while (thread_cache.free_list[c] != NULL)
+        {
+            void *block = thread_cache.free_list[c];
+            thread_cache.free_list[c] = *block_link(block);
+            *block_link(block) = pool->classes[c].free_list;
+            pool->classes[c].free_list = block;
+        }
+        thread_cache.free_count[c] = 0;
+    }
+    add_counters(pool, &thread_cache.counters);
+    pthread_mutex_unlock(&pool->mutex);
+    memset(&thread_cache, 0, sizeof(thread_cache));
+}
+
+/**
+ * Returns the calling thread's cache for the pool, claiming the cache on first use
+ *
+ * @param pool - Pointer to the pool
+ * @return The cache, or NULL if the thread's cache already belongs to another pool
+ */
+static ThreadCache *cache_for(LinePool *pool)
+{
+    if (thread_cache.pool == pool)
+        return &thread_cache;
+    if (thread_cache.pool != NULL)
+        return NULL; // One cache per thread; other pools use the shared lists directly
+    thread_cache.pool = pool;
+    pthread_setspecific(pool->cache_key, pool); // Registers flush_thread_cache for this thread
+    return &thread_cache;
+}
+
+/**
+ * Allocates a slab and splits it into blocks of one class. pool->mutex must be held
+ *
+ * @param pool - Pointer to the pool
+ * @param c - Index of the class
+ * @return 0 on success, -1 if malloc failed
+ */
+static int carve_slab(LinePool *pool, int c)
+{
+    unsigned char *slab = malloc(LINE_POOL_SLAB_SIZE);
+    if (slab == NULL)
+        return -1;
+    *block_link(slab) = pool->slabs;
+    pool->slabs = slab;
+    pool->totals.slab_count++;
+
+    size_t block_size = pool->classes[c].block_size;
+    size_t blocks = (LINE_POOL_SLAB_SIZE - SLAB_HEADER_SIZE) / block_size;
+    for (size_t i = blocks; i-- > 0;) // Lowest address ends up first on the list
+    {
+        void *block = slab + SLAB_HEADER_SIZE + i * block_size;
+        *block_link(block) = pool->classes[c].free_list;
+        pool->classes[c].free_list = block;
+    }
+    return 0;
+}
+
+/**
+ * Takes a block of one class, from the thread cache if possible
+ *
+ * @param pool - Pointer to the pool
+ * @param c - Index of the class
+ * @return The block, or NULL if memory is exhausted
+ */
+static void *take_block(LinePool *pool, int c)
+{
+    ThreadCache *cache = cache_for(pool);
+    if (cache != NULL && cache->free_list[c] != NULL)
+    {
+        void *block = cache->free_list[c];
+        cache->free_list[c] = *block_link(block);
+        cache->free_count[c]--;
+        cache->counters.cache_hits++;
+        return block;
+    }
+
+    // Cache empty: take one block for the caller and a batch for the cache under one lock
+    pthread_mutex_lock(&pool->mutex);
+    LinePoolClass *cls = &pool->classes[c];
+    int carved = 0;
+    if (cls->free_list == NULL)
+    {
+        if (carve_slab(pool, c) != 0)
+        {
+            pthread_mutex_unlock(&pool->mutex);
+            return NULL;
+        }
+        carved = 1;
+    }
+    void *block = cls->free_list;
+    cls->free_list = *block_link(block);
+    if (cache != NULL)
+    {
+        while (cls->free_list != NULL && cache->free_count[c] < LINE_POOL_REFILL_BATCH)
+        {
+            void *cached = cls->free_list;
+            cls->free_list = *block_link(cached);
+            *block_link(cached) = cache->free_list[c];
+            cache->free_list[c] = cached;
+            cache->free_count[c]++;
+        }
+        if (carved)
+            cache->counters.slab_carves++;
+        else
+            cache->counters.shared_hits++;
+    }
+    else if (carved)
+        pool->totals.slab_carves++;
+    else
+        pool->totals.shared_hits++;
+    pthread_mutex_unlock(&pool->mutex);
+    return block;
+}
+
+/**
+ * Initializes an empty line pool; slabs are allocated on demand
+ *
+ * @param pool - Pointer to the pool structure to initialize
+ * @return 0 on success, -1 on failure
+ */
+int init_line_pool(LinePool *pool)
+{
+    memset(pool, 0, sizeof(*pool));
+    for (int c = 0; c < LINE_POOL_CLASSES; c++)
+        pool->classes[c].block_size = (size_t)LINE_POOL_MIN_BLOCK << c;
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0)
+        return -1;
+    if (pthread_key_create(&pool->cache_key, flush_thread_cache) != 0)
+    {
+        pthread_mutex_destroy(&pool->mutex);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Copies a line into a block of the smallest class that holds it
+ * Lines longer than the largest class are copied with malloc
+ *
+ * @param pool - Pointer to the pool
+ * @param line - The characters to copy (need not be terminated)
+ * @param len - Number of characters
+ * @return The NUL-terminated copy, or NULL if memory is exhausted
+ */
+char *pool_copy_line(LinePool *pool, const char *line, size_t len)
+{
+    size_t needed = BLOCK_HEADER_SIZE + len + 1;
+    int c = 0;
+    while (c < LINE_POOL_CLASSES && pool->classes[c].block_size < needed)
+        c++;
+
+    unsigned char *block;
+    if (c < LINE_POOL_CLASSES)
+    {
+        block = take_block(pool, c);
+    }
+    else
+    {
+        block = malloc(needed);
+        if (block != NULL)
+        {
+            ThreadCache *cache = cache_for(pool);
+            if (cache != NULL)
+            {
+                cache->counters.oversized++;
+            }
+            else
+            {
+                pthread_mutex_lock(&pool->mutex);
+                pool->totals.oversized++;
+                pthread_mutex_unlock(&pool->mutex);
+            }
+        }
+    }
+    if (block == NULL)
+        return NULL;
+
+    *(size_t *)block = (size_t)c;
+    char *copy = (char *)block + BLOCK_HEADER_SIZE;
+    memcpy(copy, line, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+/**
+ * Puts a line's block back on the thread's cache; a cache over
+ * LINE_POOL_CACHE_LIMIT (a thread that mostly releases, like a worker)
+ * hands half of its blocks back to the shared list
+ *
+ * @param pool - Pointer to the pool the line came from
+ * @param line - The line, or NULL
+ */
+void pool_release_line(LinePool *pool, char *line)
+{
+    if (line == NULL)
+        return;
+    unsigned char *block = (unsigned char *)line - BLOCK_HEADER_SIZE;
+    int c = (int)*(size_t *)block;
+    ThreadCache *cache = cache_for(pool);
+
+    if (cache == NULL)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        if (c == OVERSIZED_CLASS)
+        {
+            free(block);
+        }
+        else
+        {
+            *block_link(block) = pool->classes[c].free_list;
+            pool->classes[c].free_list = block;
+        }
+        pool->totals.releases++;
+        pthread_mutex_unlock(&pool->mutex);
+        return;
+    }
+
+    cache->counters.releases++;
+    if (c == OVERSIZED_CLASS)
+    {
+        free(block);
+        return;
+    }
+    *block_link(block) = cache->free_list[c];
+    cache->free_list[c] = block;
+    if (++cache->free_count[c] <= LINE_POOL_CACHE_LIMIT)
+        return;
+
+    // Cache full: hand the most recently released half back in one batch
+    int moved = LINE_POOL_CACHE_LIMIT / 2;
+    void *head = cache->free_list[c];
+    void *tail = head;
+    for (int i = 1; i < moved; i++)
+        tail = *block_link(tail);
+    cache->free_list[c] = *block_link(tail);
+    cache->free_count[c] -= moved;
+
+    pthread_mutex_lock(&pool->mutex);
+    *block_link(tail) = pool->classes[c].free_list;
+    pool->classes[c].free_list = head;
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * Returns the counters of the pool: those of threads that have exited plus
+ * the calling thread's
+ *
+ * @param pool - Pointer to the pool
+ * @param stats - Receives the counters
+ */
+void get_line_pool_stats(LinePool *pool, LinePoolStats *stats)
+{
+    pthread_mutex_lock(&pool->mutex);
+    *stats = pool->totals;
+    pthread_mutex_unlock(&pool->mutex);
+    if (thread_cache.pool == pool)
+    {
+        stats->cache_hits += thread_cache.counters.cache_hits;
+        stats->shared_hits += thread_cache.counters.shared_hits;
+        stats->slab_carves += thread_cache.counters.slab_carves;
+        stats->oversized += thread_cache.counters.oversized;
+        stats->releases += thread_cache.counters.releases;
+    }
+    stats->allocations = stats->cache_hits + stats->shared_hits + stats->slab_carves + stats->oversized;
+}
+
+/**
+ * Frees every slab of the pool. Only call once no other thread uses it
+ *
+ * @param pool - Pointer to the pool structure to free
+ */
+void free_line_pool(LinePool *pool)
+{
+    // The caller's cache points into the slabs about to be freed
+    if (thread_cache.pool == pool)
+        memset(&thread_cache, 0, sizeof(thread_cache));
+    pthread_key_delete(pool->cache_key);
+
+    while (pool->slabs != NULL)
+    {
+        void *slab = pool->slabs;
+        pool->slabs = *block_link(slab);
+        free(slab);
+    }
+    pthread_mutex_destroy(&pool->mutex);
+}
@@ -0,0 +1,105 @@
+/**
+ * File: pool.h
+ * Assignment: HW4 - Producer-Consumer Problem with pthread
+ * Description: Header file for the line pool: copies of log lines are taken
+ *              from fixed-size classes carved out of slabs instead of being
+ *              strdup'd and freed one by one. Every thread keeps a small
+ *              cache of free blocks per class, so the manager and the workers
+ *              only lock the pool to move blocks in batches.
+ * Author: Recep Furkan Akın
+ * Student ID: 210104004042
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#define LINE_POOL_CLASSES 6          // Block sizes 64, 128, ..., 2048 bytes (header included)
+#define LINE_POOL_MIN_BLOCK 64       // Smallest block size
+#define LINE_POOL_SLAB_SIZE 65536    // Bytes carved into blocks at a time
+#define LINE_POOL_CACHE_LIMIT 128    // Free blocks a thread keeps per class before handing half back
+#define LINE_POOL_REFILL_BATCH 64    // Blocks moved from the shared list into a thread cache at once
+
+/**
+ * LinePoolClass structure - the shared free list of one block size
+ */
+typedef struct
+{
+    void *free_list;   // Free blocks, linked through their first word
+    size_t block_size; // Bytes per block, including the header
+} LinePoolClass;
+
+/**
+ * LinePoolStats structure - counters of a line pool
+ * allocations = cache_hits + shared_hits + slab_carves + oversized
+ */
+typedef struct
+{
+    unsigned long long allocations; // Lines copied into the pool
+    unsigned long long cache_hits;  // Served from the calling thread's cache without locking
+    unsigned long long shared_hits; // Served after refilling the cache from the shared list
+    unsigned long long slab_carves; // Served after carving a new slab (the only calls to malloc)
+    unsigned long long oversized;   // Lines too long for any class, copied with malloc
+    unsigned long long releases;    // Lines given back
+    size_t slab_count;              // Slabs allocated
+} LinePoolStats;
+
+/**
+ * LinePool structure - size classes, their slabs and the counters of threads that have exited
+ */
+typedef struct
+{
+    LinePoolClass classes[LINE_POOL_CLASSES];
+    void *slabs;             // Slabs, linked through their first word
+    pthread_mutex_t mutex;   // Protects everything in the pool
+    pthread_key_t cache_key; // Flushes a thread's caches back when the thread exits
+    LinePoolStats totals;    // Counters folded in from exited threads' caches
+} LinePool;
+
+/**
+ * Initializes an empty line pool; slabs are allocated on demand
+ *
+ * @param pool - Pointer to the pool structure to initialize
+ * @return 0 on success, -1 on failure
+ */
+int init_line_pool(LinePool *pool);
+
+/**
+ * Copies a line into a block of the pool
+ *
+ * @param pool - Pointer to the pool
+ * @param line - The characters to copy (need not be terminated)
+ * @param len - Number of characters
+ * @return The NUL-terminated copy, to be given back with pool_release_line,
+ *         or NULL if memory is exhausted
+ */
+char *pool_copy_line(LinePool *pool, const char *line, size_t len);
+
+/**
+ * Gives a line copied by pool_copy_line back; any thread may release lines
+ * copied by another
+ *
+ * @param pool - Pointer to the pool the line came from
+ * @param line - The line, or NULL
+ */
+void pool_release_line(LinePool *pool, char *line);
+
+/**
+ * Returns the counters of the pool: those of threads that have exited plus
+ * the calling thread's
+ *
+ * @param pool - Pointer to the pool
+ * @param stats - Receives the counters
+ */
+void get_line_pool_stats(LinePool *pool, LinePoolStats *stats);
+
+/**
+ * Frees every slab of the pool. Only call once no other thread uses it
+ *
+ * @param pool - Pointer to the pool structure to free
+ */
+void free_line_pool(LinePool *pool);
+
+#endif // POOL_H
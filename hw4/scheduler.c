@@ -0,0 +1,143 @@
+/**
+ * File: scheduler.c
+ * Assignment: HW4 - Producer-Consumer Problem with pthread
+ * Description: Implementation of the work-stealing chunk scheduler. Each
+ *              queue has its own mutex, so workers only contend with a
+ *              thief that picked the same queue.
+ * Author: Recep Furkan Akın
+ * Student ID: 210104004042
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include "scheduler.h"
+
+/**
+ * Initializes the scheduler with an empty queue per worker
+ *
+ * @param scheduler - Pointer to the scheduler structure to initialize
+ * @param num_queues - Number of workers
+ * @return 0 on success, -1 on failure
+ */
+int init_scheduler(Scheduler *scheduler, int num_queues)
+{
+    if (scheduler == NULL || num_queues <= 0)
+    {
+        fprintf(stderr, "init_scheduler: Invalid arguments (scheduler is NULL or num_queues <= 0).\n");
+        return -1;
+    }
+
+    // aligned_alloc keeps every queue's mutex on its own cache line
+    size_t bytes = (size_t)num_queues * sizeof(ChunkQueue);
+    scheduler->queues = aligned_alloc(_Alignof(ChunkQueue), bytes);
+    if (scheduler->queues == NULL)
+    {
+        perror("init_scheduler: Failed to allocate queues");
+        return -1;
+    }
+    scheduler->num_queues = num_queues;
+
+    for (int i = 0; i < num_queues; i++)
+    {
+        ChunkQueue *queue = &scheduler->queues[i];
+        queue->chunks = NULL;
+        queue->capacity = 0;
+        queue->head = 0;
+        queue->tail = 0;
+        int ret = pthread_mutex_init(&queue->mutex, NULL);
+        if (ret != 0)
+        {
+            fprintf(stderr, "init_scheduler: Failed to initialize mutex\n");
+            for (int j = 0; j < i; j++)
+                pthread_mutex_destroy(&scheduler->queues[j].mutex);
+            free(scheduler->queues);
+            scheduler->queues = NULL;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Adds a chunk to a worker's queue, growing the queue as needed
+ *
+ * @param scheduler - Pointer to the scheduler structure
+ * @param owner - Index of the worker that owns the chunk
+ * @param chunk - The chunk to add
+ * @return 0 on success, -1 on failure
+ */
+int add_chunk(Scheduler *scheduler, int owner, Chunk chunk)
+{
+    ChunkQueue *queue = &scheduler->queues[owner];
+    if (queue->tail == queue->capacity)
+    {
+        int capacity = queue->capacity ? queue->capacity * 2 : 16;
+        Chunk *chunks = realloc(queue->chunks, (size_t)capacity * sizeof(Chunk));
+        if (chunks == NULL)
+        {
+            perror("add_chunk: Failed to grow queue");
+            return -1;
+        }
+        queue->chunks = chunks;
+        queue->capacity = capacity;
+    }
+    queue->chunks[queue->tail++] = chunk;
+    return 0;
+}
+
+/**
+ * Takes the next chunk for a worker
+ * The worker's own chunks come first, in file order. Once they run out,
+ * the other queues are tried starting with the next worker, and a chunk is
+ * taken from their tail, the part of the file their owner reaches last.
+ *
+ * @param scheduler - Pointer to the scheduler structure
+ * @param self - Index of the calling worker
+ * @param chunk - Receives the chunk
+ * @param stolen - Set to 1 if the chunk came from another worker's queue, 0 otherwise
+ * @return 0 on success, -1 if every queue is empty
+ */
+int next_chunk(Scheduler *scheduler, int self, Chunk *chunk, int *stolen)
+{
+    for (int i = 0; i < scheduler->num_queues; i++)
+    {
+        int victim = (self + i) % scheduler->num_queues;
+        ChunkQueue *queue = &scheduler->queues[victim];
+        int found = 0;
+
+        pthread_mutex_lock(&queue->mutex);
+        if (queue->head < queue->tail)
+        {
+            *chunk = (victim == self) ? queue->chunks[queue->head++] : queue->chunks[--queue->tail];
+            found = 1;
+        }
+        pthread_mutex_unlock(&queue->mutex);
+
+        if (found)
+        {
+            *stolen = victim != self;
+            return 0;
+        }
+    }
+    // No chunks are added after the workers start, so empty queues stay empty
+    return -1;
+}
+
+/**
+ * Frees all resources associated with the scheduler
+ *
+ * @param scheduler - Pointer to the scheduler structure to free
+ */
+void free_scheduler(Scheduler *scheduler)
+{
+    if (scheduler == NULL || scheduler->queues == NULL)
+        return;
+    for (int i = 0; i < scheduler->num_queues; i++)
+    {
+        pthread_mutex_destroy(&scheduler->queues[i].mutex);
+        free(scheduler->queues[i].chunks);
+    }
+    free(scheduler->queues);
+    scheduler->queues = NULL;
+    scheduler->num_queues = 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * File: scheduler.h
+ * Assignment: HW4 - Producer-Consumer Problem with pthread
+ * Description: Header file for the work-stealing chunk scheduler used when
+ *              several log files are searched. Every worker owns a queue of
+ *              byte ranges; a worker whose queue runs dry takes ranges from
+ *              the far end of another worker's queue.
+ * Author: Recep Furkan Akın
+ * Student ID: 210104004042
+ */
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+/**
+ * Chunk structure - a byte range of one log file
+ * A chunk owns every line that starts inside [start, end), including the
+ * part of its last line that lies past end, so chunks can be cut anywhere.
+ */
+typedef struct
+{
+    int file;    // Index of the file
+    off_t start; // First byte of the range
+    off_t end;   // One past the last byte of the range
+} Chunk;
+
+/**
+ * ChunkQueue structure - the chunks owned by one worker
+ * The owner takes chunks from head (in file order), thieves from tail.
+ */
+typedef struct
+{
+    _Alignas(64) pthread_mutex_t mutex; // Protects head and tail
+    Chunk *chunks;                      // Queued chunks
+    int capacity;                       // Allocated entries in chunks
+    int head;                           // Next chunk for the owner
+    int tail;                           // One past the last queued chunk
+} ChunkQueue;
+
+/**
+ * Scheduler structure - one chunk queue per worker
+ */
+typedef struct
+{
+    ChunkQueue *queues; // Queue of every worker
+    int num_queues;     // Number of workers
+} Scheduler;
+
+/**
+ * Initializes the scheduler with an empty queue per worker
+ *
+ * @param scheduler - Pointer to the scheduler structure to initialize
+ * @param num_queues - Number of workers
+ * @return 0 on success, -1 on failure
+ */
+int init_scheduler(Scheduler *scheduler, int num_queues);
+
+/**
+ * Adds a chunk to a worker's queue
+ * All chunks must be added before the workers start taking them
+ *
+ * @param scheduler - Pointer to the scheduler structure
+ * @param owner - Index of the worker that owns the chunk
+ * @param chunk - The chunk to add
+ * @return 0 on success, -1 on failure
+ */
+int add_chunk(Scheduler *scheduler, int owner, Chunk chunk);
+
+/**
+ * Takes the next chunk for a worker: from its own queue first, then from
+ * the tail of the other queues
+ *
+ * @param scheduler - Pointer to the scheduler structure
+ * @param self - Index of the calling worker
+ * @param chunk - Receives the chunk
+ * @param stolen - Set to 1 if the chunk came from another worker's queue, 0 otherwise
+ * @return 0 on success, -1 if every queue is empty
+ */
+int next_chunk(Scheduler *scheduler, int self, Chunk *chunk, int *stolen);
+
+/**
+ * Frees all resources associated with the scheduler
+ *
+ * @param scheduler - Pointer to the scheduler structure to free
+ */
+void free_scheduler(Scheduler *scheduler);
+
+#endif // SCHEDULER_H
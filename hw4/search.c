@@ -0,0 +1,637 @@
+/**
+ * File: search.c
+ * Assignment: HW4 - Producer-Consumer Problem with pthread
+ * Description: Implementation of the search engine used by the worker threads.
+ *              Literal terms are found with a first/last byte SIMD filter
+ *              (SSE2 or AVX2, picked at run time from the CPU's features) or
+ *              an Aho-Corasick automaton when there are several of them;
+ *              regular expressions go through regexec.
+ * Author: Recep Furkan Akın
+ * Student ID: 210104004042
+ */
+
+#define _GNU_SOURCE // For memmem
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "search.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+// --- Literal Search Kernels ---
+
+/**
+ * Lower-cases an ASCII letter, leaving every other byte unchanged
+ *
+ * @param c - The byte to fold
+ * @return The folded byte
+ */
+static inline unsigned char fold_byte(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c | 0x20) : c;
+}
+
+/**
+ * Compares text against an already folded pattern
+ *
+ * @param text - Bytes to compare
+ * @param pattern - Pattern bytes (lower-cased when ignoring case)
+ * @param len - Number of bytes to compare
+ * @param ignore_case - Non-zero to fold text before comparing
+ * @return 1 if equal, 0 otherwise
+ */
+static inline int bytes_equal(const unsigned char *text, const unsigned char *pattern, size_t len, int ignore_case)
+{
+    if (!ignore_case)
+        return memcmp(text, pattern, len) == 0;
+    for (size_t i = 0; i < len; i++)
+    {
+        if (fold_byte(text[i]) != pattern[i])
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * Finds the first occurrence of the needle byte by byte
+ *
+ * @param hay - Text to search
+ * @param n - Length of the text
+ * @param needle - Pattern (lower-cased when ignoring case), at least 1 byte
+ * @param k - Length of the pattern
+ * @param ignore_case - Non-zero to ignore the case of ASCII letters
+ * @return Start of the first occurrence, or NULL
+ */
+static const unsigned char *find_scalar(const unsigned char *hay, size_t n, const unsigned char *needle, size_t k,
+                                        int ignore_case)
+{
+    if (!ignore_case)
+        return memmem(hay, n, needle, k);
+    for (size_t i = 0; i + k <= n; i++)
+    {
+        if (fold_byte(hay[i]) == needle[0] && bytes_equal(hay + i + 1, needle + 1, k - 1, 1))
+            return hay + i;
+    }
+    return NULL;
+}
+
+#ifdef HAVE_X86_KERNELS
+
+/**
+ * Searches the last few positions a SIMD kernel cannot cover with a full block
+ * A plain loop: these tails are too short for memmem's setup to pay off
+ *
+ * @param hay - Text to search
+ * @param n - Length of the text
+ * @param needle - Pattern (lower-cased when ignoring case), at least 1 byte
+ * @param k - Length of the pattern
+ * @param ignore_case - Non-zero to ignore the case of ASCII letters
+ * @return Start of the first occurrence, or NULL
+ */
+static inline const unsigned char *find_tail(const unsigned char *hay, size_t n, const unsigned char *needle,
+                                             size_t k, int ignore_case)
+{
+    for (size_t i = 0; i + k <= n; i++)
+    {
+        unsigned char first = ignore_case ? fold_byte(hay[i]) : hay[i];
+        unsigned char last = ignore_case ? fold_byte(hay[i + k - 1]) : hay[i + k - 1];
+        if (first == needle[0] && last == needle[k - 1] && bytes_equal(hay + i + 1, needle + 1, k - 1, ignore_case))
+            return hay + i;
+    }
+    return NULL;
+}
+
+/**
+ * Lower-cases the ASCII letters of 16 bytes
+ * 'A'..'Z' is shifted to the bottom of the signed range so one compare finds it
+ *
+ * @param v - The bytes to fold
+ * @return The folded bytes
+ */
+__attribute__((target("sse2"))) static inline __m128i fold_sse2(__m128i v)
+{
+    __m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char)(0x80 - 'A')));
+    __m128i upper = _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(-0x80 + 26)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+/**
+ * Finds the first occurrence of the needle 16 positions at a time
+ * A position is a candidate when both its first and its last byte match;
+ * only candidates are compared in full. The tail is searched with find_tail.
+ *
+ * @param hay - Text to search
+ * @param n - Length of the text
+ * @param needle - Pattern (lower-cased when ignoring case), at least 1 byte
+ * @param k - Length of the pattern
+ * @param ignore_case - Non-zero to ignore the case of ASCII letters
+ * @return Start of the first occurrence, or NULL
+ */
+__attribute__((target("sse2"))) static const unsigned char *find_sse2(const unsigned char *hay, size_t n,
+                                                                      const unsigned char *needle, size_t k,
+                                                                      int ignore_case)
+{
+    size_t i = 0;
+    const __m128i first = _mm_set1_epi8((char)needle[0]);
+    const __m128i last = _mm_set1_epi8((char)needle[k - 1]);
+
+    for (; n >= k && i + k - 1 + 16 <= n; i += 16)
+    {
+        __m128i block_first = _mm_loadu_si128((const __m128i *)(hay + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *)(hay + i + k - 1));
+        if (ignore_case)
+        {
+            block_first = fold_sse2(block_first);
+            block_last = fold_sse2(block_last);
+        }
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last)));
+        while (mask != 0)
+        {
+            size_t bit = (size_t)__builtin_ctz(mask);
+            if (k <= 2 || bytes_equal(hay + i + bit + 1, needle + 1, k - 2, ignore_case))
+                return hay + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return find_tail(hay + i, n - i, needle, k, ignore_case);
+}
+
+/**
+ * Lower-cases the ASCII letters of 32 bytes (see fold_sse2)
+ *
+ * @param v - The bytes to fold
+ * @return The folded bytes
+ */
+__attribute__((target("avx2"))) static inline __m256i fold_avx2(__m256i v)
+{
+    __m256i shifted = _mm256_add_epi8(v, _mm256_set1_epi8((char)(0x80 - 'A')));
+    __m256i upper = _mm256_cmpgt_epi8(_mm256_set1_epi8((char)(-0x80 + 26)), shifted);
+    return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+/**
+ * Finds the first occurrence of the needle 32 positions at a time (see find_sse2)
+ *
+ * @param hay - Text to search
+ * @param n - Length of the text
+ * @param needle - Pattern (lower-cased when ignoring case), at least 1 byte
+ * @param k - Length of the pattern
+ * @param ignore_case - Non-zero to ignore the case of ASCII letters
+ * @return Start of the first occurrence, or NULL
+ */
+__attribute__((target("avx2"))) static const unsigned char *find_avx2(const unsigned char *hay, size_t n,
+                                                                      const unsigned char *needle, size_t k,
+                                                                      int ignore_case)
+{
+    size_t i = 0;
+    const __m256i first = _mm256_set1_epi8((char)needle[0]);
+    const __m256i last = _mm256_set1_epi8((char)needle[k - 1]);
+
+    for (; n >= k && i + k - 1 + 32 <= n; i += 32)
+    {
+        __m256i block_first = _mm256_loadu_si256((const __m256i *)(hay + i));
+        __m256i block_last = _mm256_loadu_si256((const __m256i *)(hay + i + k - 1));
+        if (ignore_case)
+        {
+            block_first = fold_avx2(block_first);
+            block_last = fold_avx2(block_last);
+        }
+        unsigned mask = (unsigned)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, block_first), _mm256_cmpeq_epi8(last, block_last)));
+        while (mask != 0)
+        {
+            size_t bit = (size_t)__builtin_ctz(mask);
+            if (k <= 2 || bytes_equal(hay + i + bit + 1, needle + 1, k - 2, ignore_case))
+                return hay + i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return find_tail(hay + i, n - i, needle, k, ignore_case);
+}
+
+#endif // HAVE_X86_KERNELS
+
+/**
+ * Checks whether the CPU can run a kernel
+ *
+ * @param kernel - The kernel to check (not KERNEL_AUTO)
+ * @return 1 if supported, 0 otherwise
+ */
+static int kernel_supported(SearchKernel kernel)
+{
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (kernel == KERNEL_AVX2)
+        return __builtin_cpu_supports("avx2");
+    if (kernel == KERNEL_SSE2)
+        return __builtin_cpu_supports("sse2");
+#endif
+    return kernel == KERNEL_SCALAR;
+}
+
+/**
+ * Finds the engine's single literal term with its kernel
+ *
+ * @param engine - Pointer to the search engine
+ * @param hay - Text to search
+ * @param n - Length of the text
+ * @return Start of the first occurrence, or NULL
+ */
+static const unsigned char *find_literal(const SearchEngine *engine, const unsigned char *hay, size_t n)
+{
+    int ignore_case = (engine->flags & SEARCH_IGNORE_CASE) != 0;
+
+    // An empty term is found at the start of any text
+    if (engine->needle_len == 0)
+        return hay;
+    switch (engine->kernel)
+    {
+#ifdef HAVE_X86_KERNELS
+    case KERNEL_AVX2:
+        return find_avx2(hay, n, engine->needle, engine->needle_len, ignore_case);
+    case KERNEL_SSE2:
+        return find_sse2(hay, n, engine->needle, engine->needle_len, ignore_case);
+#endif
+    default:
+        return find_scalar(hay, n, engine->needle, engine->needle_len, ignore_case);
+    }
+}
+
+// --- Aho-Corasick Automaton ---
+
+/**
+ * Builds the automaton for several literal terms
+ * The trie's missing transitions are filled in from the failure links, so
+ * searching costs one table lookup per byte regardless of the number of terms.
+ *
+ * @param engine - Pointer to the search engine (num_terms and flags set)
+ * @param terms - The terms
+ * @return 0 on success, -1 on failure
+ */
+static int build_automaton(SearchEngine *engine, char **terms)
+{
+    int ignore_case = (engine->flags & SEARCH_IGNORE_CASE) != 0;
+    size_t max_states = 1;
+    for (int t = 0; t < engine->num_terms; t++)
+        max_states += strlen(terms[t]);
+
+    engine->next = malloc(max_states * 256 * sizeof(int));
+    engine->out_term = malloc(max_states * sizeof(int));
+    engine->out_link = malloc(max_states * sizeof(int));
+    engine->same_term = malloc(engine->num_terms * sizeof(int));
+    int *fail = malloc(max_states * sizeof(int));
+    int *queue = malloc(max_states * sizeof(int));
+    if (!engine->next || !engine->out_term || !engine->out_link || !engine->same_term || !fail || !queue)
+    {
+        perror("init_search: Failed to allocate automaton");
+        free(fail);
+        free(queue);
+        return -1;
+    }
+
+    // Trie of the (folded) terms; -1 marks a missing transition
+    memset(engine->next, -1, max_states * 256 * sizeof(int));
+    engine->out_term[0] = -1;
+    engine->num_states = 1;
+    for (int t = 0; t < engine->num_terms; t++)
+    {
+        int state = 0;
+        for (const unsigned char *c = (const unsigned char *)terms[t]; *c; c++)
+        {
+            unsigned char byte = ignore_case ? fold_byte(*c) : *c;
+            int *slot = &engine->next[state * 256 + byte];
+            if (*slot == -1)
+            {
+                *slot = engine->num_states;
+                engine->out_term[engine->num_states++] = -1;
+            }
+            state = *slot;
+        }
+        // Identical terms share a state and are chained through same_term
+        engine->same_term[t] = engine->out_term[state];
+        engine->out_term[state] = t;
+    }
+
+    // Breadth-first: failure links, output links and the full transition table
+    int head = 0, tail = 0;
+    engine->out_link[0] = -1;
+    for (int c = 0; c < 256; c++)
+    {
+        int child = engine->next[c];
+        if (child == -1)
+        {
+            engine->next[c] = 0;
+        }
+        else
+        {
+            fail[child] = 0;
+            queue[tail++] = child;
+        }
+    }
+    while (head < tail)
+    {
+        int state = queue[head++];
+        int f = fail[state];
+        engine->out_link[state] = engine->out_term[f] >= 0 ? f : engine->out_link[f];
+        for (int c = 0; c < 256; c++)
+        {
+            int *slot = &engine->next[state * 256 + c];
+            if (*slot == -1)
+            {
+                *slot = engine->next[f * 256 + c];
+            }
+            else
+            {
+                fail[*slot] = engine->next[f * 256 + c];
+                queue[tail++] = *slot;
+            }
+        }
+    }
+
+    // Upper-case input takes the same transitions as lower-case input
+    if (ignore_case)
+    {
+        for (int state = 0; state < engine->num_states; state++)
+        {
+            for (int c = 'A'; c <= 'Z'; c++)
+                engine->next[state * 256 + c] = engine->next[state * 256 + (c | 0x20)];
+        }
+    }
+
+    free(fail);
+    free(queue);
+    return 0;
+}
+
+/**
+ * Records a term found on the current line, once per line
+ *
+ * @param engine - Pointer to the search engine
+ * @param term - Index of the term
+ * @param term_counts - Per-term line counts
+ * @return 1 if the term had not been found on this line yet, 0 otherwise
+ */
+static inline int record_term(SearchEngine *engine, int term, int *term_counts)
+{
+    if (engine->seen[term] == engine->line_no)
+        return 0;
+    engine->seen[term] = engine->line_no;
+    term_counts[term]++;
+    return 1;
+}
+
+/**
+ * Runs the automaton over one line
+ * Stops early once every term has been found on the line
+ *
+ * @param engine - Pointer to the search engine
+ * @param line - The line
+ * @param len - Length of the line
+ * @param term_counts - Per-term line counts
+ * @return 1 if at least one term was found, 0 otherwise
+ */
+static int search_automaton(SearchEngine *engine, const unsigned char *line, size_t len, int *term_counts)
+{
+    const int *next = engine->next;
+    int state = 0;
+    int found = 0;
+
+    for (size_t i = 0; i < len && found < engine->num_terms; i++)
+    {
+        state = next[state * 256 + line[i]];
+        int s = engine->out_term[state] >= 0 ? state : engine->out_link[state];
+        for (; s >= 0; s = engine->out_link[s])
+        {
+            for (int t = engine->out_term[s]; t >= 0; t = engine->same_term[t])
+                found += record_term(engine, t, term_counts);
+        }
+    }
+    return found > 0;
+}
+
+// --- Public Interface ---
+
+/**
+ * Initializes the search engine for the given terms
+ *
+ * @param engine - Pointer to the engine structure to initialize
+ * @param terms - The terms to search for
+ * @param num_terms - Number of terms (at least 1)
+ * @param flags - SEARCH_IGNORE_CASE and/or SEARCH_REGEX
+ * @param kernel - Kernel to use for a single literal term
+ * @return 0 on success, -1 on failure (error already reported)
+ */
+int init_search(SearchEngine *engine, char **terms, int num_terms, int flags, SearchKernel kernel)
+{
+    memset(engine, 0, sizeof(*engine));
+    if (terms == NULL || num_terms <= 0)
+    {
+        fprintf(stderr, "init_search: Invalid arguments (no search terms).\n");
+        return -1;
+    }
+    engine->num_terms = num_terms;
+    engine->flags = flags;
+
+    // Resolve the kernel: AVX2 if available, then SSE2, then scalar
+    if (kernel == KERNEL_AUTO)
+        kernel = kernel_supported(KERNEL_AVX2) ? KERNEL_AVX2 : kernel_supported(KERNEL_SSE2) ? KERNEL_SSE2 : KERNEL_SCALAR;
+    if (!kernel_supported(kernel))
+    {
+        fprintf(stderr, "init_search: The requested search kernel is not supported on this CPU.\n");
+        return -1;
+    }
+    engine->kernel = kernel;
+
+    // Line numbers start at 0, so no term counts as seen
+    engine->seen = malloc(num_terms * sizeof(int));
+    if (engine->seen == NULL)
+    {
+        perror("init_search: Failed to allocate term state");
+        return -1;
+    }
+    for (int t = 0; t < num_terms; t++)
+        engine->seen[t] = -1;
+
+    if (flags & SEARCH_REGEX)
+    {
+        engine->regexes = malloc(num_terms * sizeof(regex_t));
+        if (engine->regexes == NULL)
+        {
+            perror("init_search: Failed to allocate regular expressions");
+            free_search(engine);
+            return -1;
+        }
+        int cflags = REG_EXTENDED | REG_NOSUB | ((flags & SEARCH_IGNORE_CASE) ? REG_ICASE : 0);
+        for (int t = 0; t < num_terms; t++)
+        {
+            int ret = regcomp(&engine->regexes[t], terms[t], cflags);
+            if (ret != 0)
+            {
+                char message[256];
+                regerror(ret, &engine->regexes[t], message, sizeof(message));
+                fprintf(stderr, "Invalid regular expression '%s': %s\n", terms[t], message);
+                // Only the expressions before this one were compiled
+                engine->num_terms = t;
+                free_search(engine);
+                return -1;
+            }
+        }
+        return 0;
+    }
+
+    if (num_terms > 1)
+    {
+        if (build_automaton(engine, terms) != 0)
+        {
+            free_search(engine);
+            return -1;
+        }
+        return 0;
+    }
+
+    engine->needle_len = strlen(terms[0]);
+    engine->needle = malloc(engine->needle_len + 1);
+    if (engine->needle == NULL)
+    {
+        perror("init_search: Failed to allocate search term");
+        free_search(engine);
+        return -1;
+    }
+    for (size_t i = 0; i <= engine->needle_len; i++)
+    {
+        unsigned char c = (unsigned char)terms[0][i];
+        engine->needle[i] = (flags & SEARCH_IGNORE_CASE) ? fold_byte(c) : c;
+    }
+    // A match found in a block then always lies within one non-empty line
+    engine->block_search = engine->needle_len > 0 && memchr(engine->needle, '\n', engine->needle_len) == NULL;
+    return 0;
+}
+
+/**
+ * Searches one line for the terms
+ *
+ * @param engine - Pointer to the search engine
+ * @param line - The line (no terminator needed, must not contain '\n')
+ * @param len - Length of the line
+ * @param term_counts - Incremented once for every term found on the line
+ * @return 1 if at least one term was found, 0 otherwise
+ */
+int search_line(SearchEngine *engine, const char *line, size_t len, int *term_counts)
+{
+    engine->line_no++;
+
+    if (engine->regexes != NULL)
+    {
+        int found = 0;
+        for (int t = 0; t < engine->num_terms; t++)
+        {
+            // REG_STARTEND bounds the match by length, so the line needs no terminator
+            regmatch_t range = {.rm_so = 0, .rm_eo = (regoff_t)len};
+            if (regexec(&engine->regexes[t], line, 1, &range, REG_STARTEND) == 0)
+                found += record_term(engine, t, term_counts);
+        }
+        return found > 0;
+    }
+
+    if (engine->next != NULL)
+        return search_automaton(engine, (const unsigned char *)line, len, term_counts);
+
+    if (find_literal(engine, (const unsigned char *)line, len) == NULL)
+        return 0;
+    term_counts[0]++;
+    return 1;
+}
+
+/**
+ * Searches a block of newline-separated lines for the terms
+ * A single literal term is searched across the whole block and each match
+ * skips to the next line; otherwise the block is split into lines first.
+ *
+ * @param engine - Pointer to the search engine
+ * @param text - First byte of the first line
+ * @param len - Bytes in the block
+ * @param term_counts - Incremented once per line for every term found on it
+ * @return Number of lines with at least one term
+ */
+int search_lines(SearchEngine *engine, const char *text, size_t len, int *term_counts)
+{
+    const unsigned char *pos = (const unsigned char *)text;
+    const unsigned char *limit = pos + len;
+    int count = 0;
+
+    if (engine->block_search)
+    {
+        while (pos < limit)
+        {
+            const unsigned char *hit = find_literal(engine, pos, (size_t)(limit - pos));
+            if (hit == NULL)
+                break;
+            count++;
+            const unsigned char *match_end = hit + engine->needle_len;
+            const unsigned char *nl = memchr(match_end, '\n', (size_t)(limit - match_end));
+            if (nl == NULL)
+                break;
+            pos = nl + 1;
+        }
+        term_counts[0] += count;
+        return count;
+    }
+
+    while (pos < limit)
+    {
+        const unsigned char *nl = memchr(pos, '\n', (size_t)(limit - pos));
+        size_t line_len = nl ? (size_t)(nl - pos) : (size_t)(limit - pos);
+        // Empty lines are skipped, as in the read() mode
+        if (line_len > 0)
+            count += search_line(engine, (const char *)pos, line_len, term_counts);
+        pos += line_len + 1;
+    }
+    return count;
+}
+
+/**
+ * Parses a kernel name ("auto", "scalar", "sse2" or "avx2")
+ *
+ * @param name - The name to parse
+ * @param kernel - Receives the kernel
+ * @return 0 on success, -1 if the name is unknown
+ */
+int parse_search_kernel(const char *name, SearchKernel *kernel)
+{
+    static const char *names[] = {"auto", "scalar", "sse2", "avx2"};
+    for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++)
+    {
+        if (strcmp(name, names[i]) == 0)
+        {
+            *kernel = (SearchKernel)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Frees all resources associated with the search engine
+ *
+ * @param engine - Pointer to the engine structure to free
+ */
+void free_search(SearchEngine *engine)
+{
+    if (engine->regexes != NULL)
+    {
+        for (int t = 0; t < engine->num_terms; t++)
+            regfree(&engine->regexes[t]);
+        free(engine->regexes);
+    }
+    free(engine->needle);
+    free(engine->next);
+    free(engine->out_term);
+    free(engine->out_link);
+    free(engine->same_term);
+    free(engine->seen);
+    memset(engine, 0, sizeof(*engine));
+}
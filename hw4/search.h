@@ -0,0 +1,113 @@
+/**
+ * File: search.h
+ * Assignment: HW4 - Producer-Consumer Problem with pthread
+ * Description: Header file for the search engine used by the worker threads.
+ *              A single literal term is found with a SIMD substring kernel
+ *              (SSE2/AVX2, chosen at run time), several literal terms with an
+ *              Aho-Corasick automaton, and terms can also be matched without
+ *              regard to case or as POSIX extended regular expressions.
+ * Author: Recep Furkan Akın
+ * Student ID: 210104004042
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stddef.h>
+#include <regex.h>
+
+// Option flags for init_search
+#define SEARCH_IGNORE_CASE 0x1 // Match ASCII letters regardless of case
+#define SEARCH_REGEX 0x2       // Terms are POSIX extended regular expressions
+
+/**
+ * SearchKernel - substring search implementation for literal terms
+ */
+typedef enum
+{
+    KERNEL_AUTO,   // Best kernel the CPU supports
+    KERNEL_SCALAR, // Byte-by-byte search (memmem when case matters)
+    KERNEL_SSE2,   // 16 bytes per step, first/last byte filter
+    KERNEL_AVX2    // 32 bytes per step, first/last byte filter
+} SearchKernel;
+
+/**
+ * SearchEngine structure - matches lines against one or more terms
+ * An engine keeps per-line scratch state, so each thread needs its own.
+ */
+typedef struct
+{
+    int num_terms;         // Number of terms
+    int flags;             // SEARCH_IGNORE_CASE / SEARCH_REGEX
+    SearchKernel kernel;   // Kernel used for a single literal term
+    int *seen;             // Per term: number of the last line it was found on
+    int line_no;           // Number of the line being searched
+
+    // Single literal term
+    unsigned char *needle; // The term (lower-cased when ignoring case)
+    size_t needle_len;     // Length of the term
+    int block_search;      // Non-zero if search_lines may scan a whole block at once
+
+    // Several literal terms (Aho-Corasick automaton)
+    int num_states;        // States in the automaton
+    int *next;             // Transition table, 256 entries per state
+    int *out_term;         // Per state: term ending in this state, or -1
+    int *out_link;         // Per state: next state on the failure chain with a term, or -1
+    int *same_term;        // Per term: next term with the same text, or -1
+
+    // Regular expressions
+    regex_t *regexes;      // One compiled expression per term
+} SearchEngine;
+
+/**
+ * Initializes the search engine for the given terms
+ *
+ * @param engine - Pointer to the engine structure to initialize
+ * @param terms - The terms to search for
+ * @param num_terms - Number of terms (at least 1)
+ * @param flags - SEARCH_IGNORE_CASE and/or SEARCH_REGEX
+ * @param kernel - Kernel to use for a single literal term
+ * @return 0 on success, -1 on failure (error already reported)
+ */
+int init_search(SearchEngine *engine, char **terms, int num_terms, int flags, SearchKernel kernel);
+
+/**
+ * Searches one line for the terms
+ *
+ * @param engine - Pointer to the search engine
+ * @param line - The line (no terminator needed, must not contain '\n')
+ * @param len - Length of the line
+ * @param term_counts - Incremented once for every term found on the line
+ * @return 1 if at least one term was found, 0 otherwise
+ */
+int search_line(SearchEngine *engine, const char *line, size_t len, int *term_counts);
+
+/**
+ * Searches a block of newline-separated lines for the terms
+ * Empty lines are skipped
+ *
+ * @param engine - Pointer to the search engine
+ * @param text - First byte of the first line
+ * @param len - Bytes in the block
+ * @param term_counts - Incremented once per line for every term found on it
+ * @return Number of lines with at least one term
+ */
+int search_lines(SearchEngine *engine, const char *text, size_t len, int *term_counts);
+
+/**
+ * Parses a kernel name ("auto", "scalar", "sse2" or "avx2")
+ *
+ * @param name - The name to parse
+ * @param kernel - Receives the kernel
+ * @return 0 on success, -1 if the name is unknown
+ */
+int parse_search_kernel(const char *name, SearchKernel *kernel);
+
+/**
+ * Frees all resources associated with the search engine
+ *
+ * @param engine - Pointer to the engine structure to free
+ */
+void free_search(SearchEngine *engine);
+
+#endif // SEARCH_H
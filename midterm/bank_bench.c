@@ -0,0 +1,635 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <limits.h>
+#include <libgen.h>    // basename
+#include <stdbool.h>   // For bool type
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "common.h"
+
+// Throughput and latency benchmark for the bank server.
+// Starts a private bank_server in a scratch directory, opens the accounts, then runs
+// --clients bank_client processes on generated command files at the same time. Each
+// client records per-command latency (--latency=FILE); the report lists ops/s,
+// p50/p99/max per operation and the CPU time used by the server and its Tellers
+// while the clients ran, so queue, locking and logging changes can be compared.
+
+#define BENCH_DEFAULT_CLIENTS 8
+#define BENCH_DEFAULT_OPS 500        // Commands per client.
+#define BENCH_DEFAULT_ACCOUNTS 32    // Accounts opened before the timed phase.
+#define BENCH_DEFAULT_HOT_ACCOUNTS 4
+#define BENCH_INITIAL_BALANCE 1000000 // Large enough that generated withdrawals never close an account.
+#define BENCH_MAX_AMOUNT 100          // Deposits and withdrawals are 1..BENCH_MAX_AMOUNT credits.
+#define BENCH_MAX_SERVER_ARGS 16
+#define BENCH_STARTUP_TIMEOUT_MS 5000 // How long to wait for the server FIFO to appear.
+
+// --- Operation Classes (as written by bank_client --latency) ---
+typedef enum
+{
+    BENCH_OP_CREATE,
+    BENCH_OP_DEPOSIT,
+    BENCH_OP_WITHDRAW,
+    BENCH_OP_INVALID,
+    BENCH_OP_COUNT
+} bench_op_t;
+
+static const char *op_names[BENCH_OP_COUNT] = {"create", "deposit", "withdraw", "invalid"};
+
+// --- Latency Samples of One Operation Class ---
+typedef struct
+{
+    long long *samples; // Microseconds, sorted before reporting.
+    size_t count;
+    size_t capacity;
+} latency_set_t;
+
+// --- Benchmark Configuration ---
+typedef struct
+{
+    int clients;
+    int ops;
+    int accounts;
+    int hot_accounts;
+    double hot_ratio;     // Fraction of existing-account commands that go to the hot accounts.
+    double deposit_ratio; // Fraction of existing-account commands that are deposits.
+    double new_rate;      // Fraction of all commands that open a new account.
+    bool batch;
+    bool shm;
+    unsigned int seed;
+    bool keep;            // Keep the scratch directory for inspection.
+    const char *bin_dir;
+    const char *server_args[BENCH_MAX_SERVER_ARGS];
+    int server_argc;
+} bench_config_t;
+
+// --- CPU Time of the Server's Process Group (clock ticks) ---
+typedef struct
+{
+    long long server_user, server_sys;   // Server process, all threads.
+    long long teller_user, teller_sys;   // Live Tellers plus Tellers the server has reaped.
+} cpu_sample_t;
+
+/**
+ * @brief Prints usage information and exits.
+ * @param prog The program name (argv[0]).
+ */
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [options]\n", basename((char *)prog));
+    fprintf(stderr, "  --clients=N        concurrent bank_client processes (default %d)\n", BENCH_DEFAULT_CLIENTS);
+    fprintf(stderr, "  --ops=N            commands per client (default %d)\n", BENCH_DEFAULT_OPS);
+    fprintf(stderr, "  --accounts=N       accounts opened before the run (default %d)\n", BENCH_DEFAULT_ACCOUNTS);
+    fprintf(stderr, "  --deposit-ratio=F  share of deposits among existing-account commands (default 0.5)\n");
+    fprintf(stderr, "  --hot-accounts=N   size of the hot account set (default %d)\n", BENCH_DEFAULT_HOT_ACCOUNTS);
+    fprintf(stderr, "  --hot-ratio=F      share of existing-account commands on the hot set (default 0.8)\n");
+    fprintf(stderr, "  --new-rate=F       share of commands that open a new account (default 0.01)\n");
+    fprintf(stderr, "  --batch            clients send BATCH blocks (bank_client --batch)\n");
+    fprintf(stderr, "  --shm              clients use session channels instead of FIFOs (bank_client --shm)\n");
+    fprintf(stderr, "  --server-arg=ARG   extra bank_server argument, repeatable (e.g. --server-arg=--queue=futex)\n");
+    fprintf(stderr, "  --seed=N           command generator seed (default 1)\n");
+    fprintf(stderr, "  --bin-dir=DIR      directory holding bank_server and bank_client (default .)\n");
+    fprintf(stderr, "  --keep             keep the scratch directory\n");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Parses a non-negative integer option value, exiting via usage() on error.
+ */
+static int parse_int_option(const char *value, const char *prog)
+{
+    char *endptr;
+    long n = strtol(value, &endptr, 10);
+    if (*value == '\0' || *endptr != '\0' || n < 0 || n > INT_MAX)
+        usage(prog);
+    return (int)n;
+}
+
+/**
+ * @brief Parses a ratio in [0, 1], exiting via usage() on error.
+ */
+static double parse_ratio_option(const char *value, const char *prog)
+{
+    char *endptr;
+    double f = strtod(value, &endptr);
+    if (*value == '\0' || *endptr != '\0' || f < 0.0 || f > 1.0)
+        usage(prog);
+    return f;
+}
+
+/**
+ * @brief Returns a monotonic timestamp in seconds.
+ */
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Uniform random number in [0, 1) from a caller-owned rand_r state.
+ */
+static double random_unit(unsigned int *state)
+{
+    return (double)rand_r(state) / ((double)RAND_MAX + 1.0);
+}
+
+/**
+ * @brief Writes the command file of one client according to the configured mix.
+ * @param path File to create.
+ * @param cfg Benchmark configuration.
+ * @param state rand_r state of this client.
+ * @return 0 on success, -1 on I/O error.
+ */
+static int write_client_file(const char *path, const bench_config_t *cfg, unsigned int *state)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+    {
+        fprintf(stderr, "bank_bench: Cannot create '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    int cold_accounts = cfg->accounts - cfg->hot_accounts;
+    for (int i = 0; i < cfg->ops; ++i)
+    {
+        int amount = 1 + rand_r(state) % BENCH_MAX_AMOUNT;
+        if (random_unit(state) < cfg->new_rate)
+        {
+            fprintf(f, "N deposit %d\n", amount);
+            continue;
+        }
+        int id;
+        if (cold_accounts == 0 || (cfg->hot_accounts > 0 && random_unit(state) < cfg->hot_ratio))
+            id = rand_r(state) % cfg->hot_accounts;
+        else
+            id = cfg->hot_accounts + rand_r(state) % cold_accounts;
+        fprintf(f, "BankID_%02d %s %d\n", id,
+                random_unit(state) < cfg->deposit_ratio ? "deposit" : "withdraw", amount);
+    }
+    if (fclose(f) != 0)
+    {
+        perror("bank_bench: fclose");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Forks and execs a program with stdout (and optionally stderr) redirected to a file.
+ * @param argv NULL-terminated argument vector; argv[0] is the program path.
+ * @param out_path File receiving stdout; /dev/null to discard.
+ * @param workdir Directory to run in, or NULL to stay in the current one.
+ * @param own_group Start a new process group (used for the server so its Tellers can be found).
+ * @return PID of the child, or -1 on fork error.
+ */
+static pid_t spawn(char *const argv[], const char *out_path, const char *workdir, bool own_group)
+{
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        perror("bank_bench: fork");
+        return -1;
+    }
+    if (pid == 0)
+    {
+        if (own_group)
+            setpgid(0, 0);
+        if (workdir && chdir(workdir) == -1)
+            _exit(127);
+        int fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd != -1)
+        {
+            dup2(fd, STDOUT_FILENO);
+            if (own_group)
+                dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        execv(argv[0], argv);
+        fprintf(stderr, "bank_bench: exec '%s': %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+    return pid;
+}
+
+/**
+ * @brief Reads utime/stime (and cutime/cstime) of a process from /proc/<pid>/stat.
+ * @param pid Process to inspect.
+ * @param pgrp Receives the process group.
+ * @param times Receives utime, stime, cutime, cstime in clock ticks.
+ * @return 0 on success, -1 if the process is gone.
+ */
+static int read_proc_times(pid_t pid, pid_t *pgrp, long long times[4])
+{
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return -1;
+    buf[n] = '\0';
+
+    // The command name may contain spaces; fields are counted from the last ')'.
+    char *p = strrchr(buf, ')');
+    if (!p)
+        return -1;
+    int parsed_pgrp;
+    if (sscanf(p + 2, "%*c %*d %d %*d %*d %*d %*u %*u %*u %*u %*u %lld %lld %lld %lld",
+               &parsed_pgrp, &times[0], &times[1], &times[2], &times[3]) != 5)
+        return -1;
+    *pgrp = (pid_t)parsed_pgrp;
+    return 0;
+}
+
+/**
+ * @brief Samples the CPU time of the server and of every Teller in its process group.
+ * @param server_pid PID (and process group) of the server.
+ * @param out Receives the sample.
+ */
+static void sample_cpu(pid_t server_pid, cpu_sample_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    long long t[4];
+    pid_t pgrp;
+    if (read_proc_times(server_pid, &pgrp, t) == 0)
+    {
+        out->server_user = t[0];
+        out->server_sys = t[1];
+        out->teller_user = t[2]; // Tellers the server already reaped.
+        out->teller_sys = t[3];
+    }
+
+    DIR *dir = opendir("/proc");
+    if (!dir)
+        return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        char *endptr;
+        long pid = strtol(entry->d_name, &endptr, 10);
+        if (*endptr != '\0' || pid <= 0 || pid == server_pid)
+            continue;
+        if (read_proc_times((pid_t)pid, &pgrp, t) == 0 && pgrp == server_pid)
+        {
+            out->teller_user += t[0];
+            out->teller_sys += t[1];
+        }
+    }
+    closedir(dir);
+}
+
+/**
+ * @brief Appends a sample to a latency set.
+ */
+static int latency_add(latency_set_t *set, long long usec)
+{
+    if (set->count == set->capacity)
+    {
+        size_t capacity = set->capacity ? set->capacity * 2 : 1024;
+        long long *grown = realloc(set->samples, capacity * sizeof(*grown));
+        if (!grown)
+            return -1;
+        set->samples = grown;
+        set->capacity = capacity;
+    }
+    set->samples[set->count++] = usec;
+    return 0;
+}
+
+static int compare_ll(const void *a, const void *b)
+{
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Nearest-rank percentile of a sorted latency set.
+ */
+static long long percentile(const latency_set_t *set, double p)
+{
+    if (set->count == 0)
+        return 0;
+    size_t rank = (size_t)(p * (double)set->count + 0.999999);
+    if (rank < 1)
+        rank = 1;
+    if (rank > set->count)
+        rank = set->count;
+    return set->samples[rank - 1];
+}
+
+/**
+ * @brief Loads the latency records written by one client.
+ * @param path Latency file of the client.
+ * @param sets One set per bench_op_t.
+ * @return Number of records read, or -1 on error.
+ */
+static long load_latencies(const char *path, latency_set_t sets[BENCH_OP_COUNT])
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+    {
+        fprintf(stderr, "bank_bench: Missing latency file '%s'\n", path);
+        return -1;
+    }
+    char op[32];
+    long long usec;
+    long records = 0;
+    while (fscanf(f, "%31s %lld", op, &usec) == 2)
+    {
+        int k = BENCH_OP_INVALID;
+        for (int i = 0; i < BENCH_OP_COUNT; ++i)
+            if (strcmp(op, op_names[i]) == 0)
+                k = i;
+        if (latency_add(&sets[k], usec) != 0)
+        {
+            fclose(f);
+            return -1;
+        }
+        records++;
+    }
+    fclose(f);
+    return records;
+}
+
+/**
+ * @brief Waits for a client process and reports whether it exited cleanly.
+ */
+static bool wait_client(pid_t pid)
+{
+    int status;
+    while (waitpid(pid, &status, 0) == -1)
+        if (errno != EINTR)
+            return false;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * @brief Runs one client to completion (used for the untimed account setup).
+ */
+static bool run_client(const char *client_bin, const char *cmd_path, const char *fifo_path)
+{
+    char *argv[] = {(char *)client_bin, (char *)cmd_path, (char *)fifo_path, NULL};
+    pid_t pid = spawn(argv, "/dev/null", NULL, false);
+    return pid != -1 && wait_client(pid);
+}
+
+/**
+ * @brief Removes the scratch directory and the files the benchmark put in it.
+ */
+static void remove_scratch(const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (!d)
+        return;
+    struct dirent *entry;
+    char path[PATH_MAX];
+    while ((entry = readdir(d)) != NULL)
+    {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        unlink(path);
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+int main(int argc, char *argv[])
+{
+    bench_config_t cfg = {
+        .clients = BENCH_DEFAULT_CLIENTS,
+        .ops = BENCH_DEFAULT_OPS,
+        .accounts = BENCH_DEFAULT_ACCOUNTS,
+        .hot_accounts = BENCH_DEFAULT_HOT_ACCOUNTS,
+        .hot_ratio = 0.8,
+        .deposit_ratio = 0.5,
+        .new_rate = 0.01,
+        .seed = 1,
+        .bin_dir = ".",
+    };
+    for (int i = 1; i < argc; ++i)
+    {
+        const char *a = argv[i];
+        if (strncmp(a, "--clients=", 10) == 0) cfg.clients = parse_int_option(a + 10, argv[0]);
+        else if (strncmp(a, "--ops=", 6) == 0) cfg.ops = parse_int_option(a + 6, argv[0]);
+        else if (strncmp(a, "--accounts=", 11) == 0) cfg.accounts = parse_int_option(a + 11, argv[0]);
+        else if (strncmp(a, "--hot-accounts=", 15) == 0) cfg.hot_accounts = parse_int_option(a + 15, argv[0]);
+        else if (strncmp(a, "--hot-ratio=", 12) == 0) cfg.hot_ratio = parse_ratio_option(a + 12, argv[0]);
+        else if (strncmp(a, "--deposit-ratio=", 16) == 0) cfg.deposit_ratio = parse_ratio_option(a + 16, argv[0]);
+        else if (strncmp(a, "--new-rate=", 11) == 0) cfg.new_rate = parse_ratio_option(a + 11, argv[0]);
+        else if (strncmp(a, "--seed=", 7) == 0) cfg.seed = (unsigned int)parse_int_option(a + 7, argv[0]);
+        else if (strncmp(a, "--bin-dir=", 10) == 0) cfg.bin_dir = a + 10;
+        else if (strcmp(a, "--batch") == 0) cfg.batch = true;
+        else if (strcmp(a, "--shm") == 0) cfg.shm = true;
+        else if (strcmp(a, "--keep") == 0) cfg.keep = true;
+        else if (strncmp(a, "--server-arg=", 13) == 0 && cfg.server_argc < BENCH_MAX_SERVER_ARGS)
+            cfg.server_args[cfg.server_argc++] = a + 13;
+        else
+            usage(argv[0]);
+    }
+    if (cfg.clients < 1 || cfg.ops < 1 || cfg.accounts < 1 || cfg.hot_accounts > cfg.accounts)
+        usage(argv[0]);
+    // Expected account creations must fit next to the pre-opened accounts.
+    double expected_new = cfg.new_rate * (double)cfg.clients * (double)cfg.ops;
+    if ((double)cfg.accounts + expected_new * 1.5 > MAX_ACCOUNTS)
+    {
+        fprintf(stderr, "bank_bench: %d accounts plus ~%.0f creations exceed MAX_ACCOUNTS (%d)\n",
+                cfg.accounts, expected_new, MAX_ACCOUNTS);
+        exit(EXIT_FAILURE);
+    }
+
+    char resolved[PATH_MAX], server_bin[PATH_MAX + 16], client_bin[PATH_MAX + 16];
+    if (!realpath(cfg.bin_dir, resolved))
+    {
+        fprintf(stderr, "bank_bench: Bad --bin-dir '%s': %s\n", cfg.bin_dir, strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    snprintf(server_bin, sizeof(server_bin), "%s/bank_server", resolved);
+    snprintf(client_bin, sizeof(client_bin), "%s/bank_client", resolved);
+    if (access(server_bin, X_OK) != 0 || access(client_bin, X_OK) != 0)
+    {
+        fprintf(stderr, "bank_bench: bank_server and bank_client must be built in '%s'\n", resolved);
+        exit(EXIT_FAILURE);
+    }
+
+    // --- Scratch Directory (the server writes its log, WAL and snapshot into its cwd) ---
+    char scratch[] = "/tmp/bankbench.XXXXXX";
+    if (!mkdtemp(scratch))
+    {
+        perror("bank_bench: mkdtemp");
+        exit(EXIT_FAILURE);
+    }
+    char fifo_path[PATH_MAX], path[PATH_MAX];
+    snprintf(fifo_path, sizeof(fifo_path), "%s/bench.fifo", scratch);
+
+    // --- Start the Server ---
+    char *server_argv[BENCH_MAX_SERVER_ARGS + 3];
+    int sargc = 0;
+    server_argv[sargc++] = server_bin;
+    server_argv[sargc++] = fifo_path;
+    for (int i = 0; i < cfg.server_argc; ++i)
+        server_argv[sargc++] = (char *)cfg.server_args[i];
+    server_argv[sargc] = NULL;
+    snprintf(path, sizeof(path), "%s/server.out", scratch);
+    pid_t server_pid = spawn(server_argv, path, scratch, true);
+    if (server_pid == -1)
+        exit(EXIT_FAILURE);
+
+    int status = EXIT_FAILURE;
+    pid_t *client_pids = calloc((size_t)cfg.clients, sizeof(pid_t));
+    latency_set_t sets[BENCH_OP_COUNT];
+    memset(sets, 0, sizeof(sets));
+    if (!client_pids)
+    {
+        perror("bank_bench: calloc");
+        goto out;
+    }
+
+    struct stat st;
+    for (int waited = 0; stat(fifo_path, &st) != 0; waited += 10)
+    {
+        if (waited >= BENCH_STARTUP_TIMEOUT_MS || waitpid(server_pid, NULL, WNOHANG) == server_pid)
+        {
+            fprintf(stderr, "bank_bench: Server did not start (see %s/server.out)\n", scratch);
+            cfg.keep = true;
+            goto out;
+        }
+        usleep(10 * 1000);
+    }
+
+    // --- Untimed Setup: open the accounts and generate the command files ---
+    snprintf(path, sizeof(path), "%s/setup.file", scratch);
+    FILE *setup = fopen(path, "w");
+    if (!setup)
+    {
+        perror("bank_bench: setup file");
+        goto out;
+    }
+    for (int i = 0; i < cfg.accounts; ++i)
+        fprintf(setup, "N deposit %d\n", BENCH_INITIAL_BALANCE);
+    fclose(setup);
+    if (!run_client(client_bin, path, fifo_path))
+    {
+        fprintf(stderr, "bank_bench: Account setup client failed\n");
+        goto out;
+    }
+    for (int i = 0; i < cfg.clients; ++i)
+    {
+        unsigned int state = cfg.seed * 7919u + (unsigned int)i;
+        snprintf(path, sizeof(path), "%s/client%d.file", scratch, i);
+        if (write_client_file(path, &cfg, &state) != 0)
+            goto out;
+    }
+
+    // --- Timed Phase ---
+    cpu_sample_t cpu_before, cpu_after;
+    sample_cpu(server_pid, &cpu_before);
+    double started = now_seconds();
+    for (int i = 0; i < cfg.clients; ++i)
+    {
+        char cmd_path[PATH_MAX], latency_arg[PATH_MAX + 16];
+        snprintf(cmd_path, sizeof(cmd_path), "%s/client%d.file", scratch, i);
+        snprintf(latency_arg, sizeof(latency_arg), "--latency=%s/client%d.lat", scratch, i);
+        char *client_argv[] = {client_bin, cmd_path, fifo_path, latency_arg, NULL, NULL, NULL};
+        int client_argc = 4;
+        if (cfg.batch)
+            client_argv[client_argc++] = "--batch";
+        if (cfg.shm)
+            client_argv[client_argc++] = "--shm";
+        client_pids[i] = spawn(client_argv, "/dev/null", NULL, false);
+    }
+    int failed_clients = 0;
+    for (int i = 0; i < cfg.clients; ++i)
+        if (client_pids[i] == -1 || !wait_client(client_pids[i]))
+            failed_clients++;
+    double elapsed = now_seconds() - started;
+    sample_cpu(server_pid, &cpu_after);
+
+    // --- Collect Latencies ---
+    long total_ops = 0;
+    for (int i = 0; i < cfg.clients; ++i)
+    {
+        snprintf(path, sizeof(path), "%s/client%d.lat", scratch, i);
+        long n = load_latencies(path, sets);
+        if (n > 0)
+            total_ops += n;
+    }
+    latency_set_t all = {0};
+    for (int k = 0; k < BENCH_OP_COUNT; ++k)
+    {
+        qsort(sets[k].samples, sets[k].count, sizeof(long long), compare_ll);
+        for (size_t j = 0; j < sets[k].count; ++j)
+            latency_add(&all, sets[k].samples[j]);
+    }
+    qsort(all.samples, all.count, sizeof(long long), compare_ll);
+
+    // --- Report ---
+    printf("bank_bench: %d clients x %d ops, deposit ratio %.2f, %d/%d hot accounts at %.2f, new-account rate %.3f%s%s\n",
+           cfg.clients, cfg.ops, cfg.deposit_ratio, cfg.hot_accounts, cfg.accounts, cfg.hot_ratio,
+           cfg.new_rate, cfg.batch ? ", batched" : "", cfg.shm ? ", shm channels" : "");
+    if (cfg.server_argc > 0)
+    {
+        printf("server args:");
+        for (int i = 0; i < cfg.server_argc; ++i)
+            printf(" %s", cfg.server_args[i]);
+        printf("\n");
+    }
+    printf("throughput: %ld ops in %.3f s = %.0f ops/s\n", total_ops, elapsed,
+           elapsed > 0 ? (double)total_ops / elapsed : 0.0);
+    printf("%-10s %10s %10s %10s %10s\n", "op", "count", "p50(us)", "p99(us)", "max(us)");
+    for (int k = 0; k < BENCH_OP_COUNT; ++k)
+    {
+        if (sets[k].count == 0)
+            continue;
+        printf("%-10s %10zu %10lld %10lld %10lld\n", op_names[k], sets[k].count,
+               percentile(&sets[k], 0.50), percentile(&sets[k], 0.99), sets[k].samples[sets[k].count - 1]);
+    }
+    if (all.count > 0)
+        printf("%-10s %10zu %10lld %10lld %10lld\n", "all", all.count,
+               percentile(&all, 0.50), percentile(&all, 0.99), all.samples[all.count - 1]);
+
+    double tick = (double)sysconf(_SC_CLK_TCK);
+    double server_user = (double)(cpu_after.server_user - cpu_before.server_user) / tick;
+    double server_sys = (double)(cpu_after.server_sys - cpu_before.server_sys) / tick;
+    double teller_user = (double)(cpu_after.teller_user - cpu_before.teller_user) / tick;
+    double teller_sys = (double)(cpu_after.teller_sys - cpu_before.teller_sys) / tick;
+    printf("server cpu: %.3f s user, %.3f s sys; tellers: %.3f s user, %.3f s sys",
+           server_user, server_sys, teller_user, teller_sys);
+    if (total_ops > 0)
+        printf(" (%.1f us/op total)", (server_user + server_sys + teller_user + teller_sys) * 1e6 / (double)total_ops);
+    printf("\n");
+    free(all.samples);
+
+    if (failed_clients > 0)
+        fprintf(stderr, "bank_bench: %d client(s) failed\n", failed_clients);
+    else if (total_ops != (long)cfg.clients * cfg.ops)
+        fprintf(stderr, "bank_bench: Expected %ld latency records, got %ld\n", (long)cfg.clients * cfg.ops, total_ops);
+    else
+        status = EXIT_SUCCESS;
+
+out:
+    // --- Stop the Server (SIGINT is its graceful shutdown) ---
+    kill(server_pid, SIGINT);
+    while (waitpid(server_pid, NULL, 0) == -1 && errno == EINTR)
+        ;
+    free(client_pids);
+    for (int k = 0; k < BENCH_OP_COUNT; ++k)
+        free(sets[k].samples);
+    if (cfg.keep)
+        printf("scratch directory kept: %s\n", scratch);
+    else
+        remove_scratch(scratch);
+    return status;
+}
@@ -9,9 +9,12 @@
 #include <sys/types.h> // pid_t
 #include <libgen.h>    // basename
 #include <stdbool.h>   // For bool type
+#include <time.h>
 
 #include "common.h"
 
+static FILE *latency_fp = NULL; // Per-command latency records (--latency=FILE), read by bank_bench.
+
 /**
  * @brief Prints usage information and exits.
  * @param prog The program name (argv[0]).
@@ -19,12 +22,46 @@
 static void usage(const char *prog)
 {
     char *pcopy = strdup(prog);
-    fprintf(stderr, "Usage: %s <cmdfile> [fifo]\n", pcopy ? basename(pcopy) : "<prog>");
+    fprintf(stderr, "Usage: %s <cmdfile> [fifo] [--batch] [--shm] [--latency=FILE]\n", pcopy ? basename(pcopy) : "<prog>");
     if (pcopy) free(pcopy);
     fprintf(stderr, "  fifo defaults to %s\n", DEFAULT_SERVER_FIFO_NAME);
+    fprintf(stderr, "  --batch sends up to %d commands per request and reads one batched response\n", BATCH_MAX_COMMANDS);
+    fprintf(stderr, "  --shm talks to the Teller over a shared memory channel instead of FIFOs\n");
+    fprintf(stderr, "        (with --batch, up to %d commands are in flight at once)\n", CHANNEL_RING_LEN);
+    fprintf(stderr, "  --latency=FILE appends \"<op> <microseconds>\" for every command to FILE\n");
     exit(1);
 }
 
+/**
+ * @brief Returns a monotonic timestamp in microseconds.
+ */
+static long long now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Appends one latency record if --latency was given. The operation is
+ *        classified from the command line: create, deposit, withdraw or invalid.
+ * @param line The command line that was sent.
+ * @param usec Time from sending the command to receiving its response.
+ */
+static void record_latency(const char *line, long long usec)
+{
+    if (!latency_fp)
+        return;
+    char b_id_str[64] = "", op_str[32] = "";
+    sscanf(line, "%63s %31s", b_id_str, op_str);
+    const char *op = "invalid";
+    if (strcmp(op_str, "deposit") == 0)
+        op = (strcmp(b_id_str, "N") == 0 || strcmp(b_id_str, "BankID_None") == 0) ? "create" : "deposit";
+    else if (strcmp(op_str, "withdraw") == 0)
+        op = "withdraw";
+    fprintf(latency_fp, "%s %lld\n", op, usec);
+}
+
 /**
  * @brief Counts the number of valid commands (non-empty, non-comment lines) in a file.
  * @param filename Path to the command file.
@@ -47,10 +84,333 @@ int count_commands(const char *filename)
     return count;
 }
 
+/**
+ * @brief Prints the "connected.." status line for a command about to be sent.
+ * @param line The command line.
+ * @param command_no Number of the command within this client.
+ */
+static void announce_command(const char *line, int command_no)
+{
+    // Parse command locally for printing status message.
+    char b_id_str[64]="", op_str[32]="", am_str[32]=""; // Init to empty strings
+    sscanf(line, "%63s %31s %31s", b_id_str, op_str, am_str);
+    const char *action_str = "unknown action";
+    if (strcmp(op_str, "deposit") == 0) action_str = "depositing";
+    else if (strcmp(op_str, "withdraw") == 0) action_str = "withdrawing";
+    printf("Client%d connected..%s %s credits\n", command_no, action_str, am_str);
+}
+
+/**
+ * @brief Parses one response line from the Teller and prints the matching result.
+ * @param resp The response (a single line, trailing newline allowed).
+ * @param pid This client's PID, which the Teller echoes in every response.
+ * @param command_no Number of the command the response belongs to.
+ */
+static void report_response(const char *resp, pid_t pid, int command_no)
+{
+    // Expected response prefixes.
+    char expected_wrong_prefix[64];
+    char expected_closed_prefix[64];
+    char expected_served_prefix[64]; // Includes BankID_ part.
+    snprintf(expected_wrong_prefix, sizeof(expected_wrong_prefix), "Client%d something went WRONG", pid);
+    snprintf(expected_closed_prefix, sizeof(expected_closed_prefix), "Client%d served.. account closed", pid);
+    snprintf(expected_served_prefix, sizeof(expected_served_prefix), "Client%d served.. BankID_", pid);
+
+    bool matched = false;
+
+    // Use strncmp for robust prefix matching (handles potential trailing newline).
+    // 1. Check for general error response.
+    if (strncmp(resp, expected_wrong_prefix, strlen(expected_wrong_prefix)) == 0) {
+        printf("Client%d something went WRONG\n", command_no);
+        matched = true;
+    }
+    // 2. Check for account closed response.
+    else if (strncmp(resp, expected_closed_prefix, strlen(expected_closed_prefix)) == 0) {
+         printf("Client%d served.. account closed\n", command_no);
+         matched = true;
+    }
+    // 3. Check for successful operation response (includes BankID).
+    else if (strncmp(resp, expected_served_prefix, strlen(expected_served_prefix)) == 0) {
+         int parsed_bank_id = -1;
+         // Point to the expected start of the numeric ID after the prefix.
+         const char *id_ptr = resp + strlen(expected_served_prefix);
+         // Attempt to parse the integer ID.
+         if (sscanf(id_ptr, "%d", &parsed_bank_id) == 1) {
+              printf("Client%d served.. BankID_%d\n", command_no, parsed_bank_id);
+              matched = true;
+         } else {
+              // Prefix matched, but failed to parse the ID number - treat as an error.
+              fprintf(stderr, "Client%d Warning: Matched BankID prefix but failed to parse ID in response: [%s]\n", command_no, resp);
+              printf("Client%d something went WRONG\n", command_no); // Report as WRONG.
+              matched = true; // Indicate the response was handled (as an error).
+         }
+    }
+
+    // 4. Fallback if none of the expected patterns matched.
+    if (!matched) {
+        // Trim potential trailing newline from the unexpected response before printing.
+        int len = (int)strcspn(resp, "\n\r");
+        fprintf(stderr, "Client%d Warning: Unparsed response format from Teller: [%.*s]\n", command_no, len, resp);
+        printf("Client%d something went WRONG\n", command_no); // Default to WRONG.
+    }
+
+     printf("..\n"); // Print delimiter as per example output.
+     fflush(stdout);
+}
+
+/**
+ * @brief Sends the command file in "BATCH <count>" blocks of up to BATCH_MAX_COMMANDS
+ *        commands, each answered by the Teller with one write of count response lines.
+ * @param fp Open command file.
+ * @param req_fd Request FIFO (client -> Teller).
+ * @param res_fd Response FIFO (Teller -> client).
+ * @param pid This client's PID.
+ * @return 0 on success, -1 if the Teller went away or an I/O error occurred.
+ */
+static int run_batched(FILE *fp, int req_fd, int res_fd, pid_t pid)
+{
+    char line[128];
+    char *out = malloc((size_t)BATCH_MAX_COMMANDS * sizeof(line) + 32);
+    char *in = malloc((size_t)BATCH_MAX_COMMANDS * 64 + 1);
+    if (!out || !in)
+    {
+        perror("Client batch alloc");
+        free(out);
+        free(in);
+        return -1;
+    }
+
+    int command_no = 0;
+    int ret = 0;
+    bool eof = false;
+    while (!eof && ret == 0)
+    {
+        // --- Collect up to BATCH_MAX_COMMANDS commands ---
+        size_t body_len = 0;
+        int count = 0;
+        char *body = out + 32; // Room for the "BATCH <count>" header in front.
+        size_t offsets[BATCH_MAX_COMMANDS]; // Start of each command in body (for latency records).
+        while (count < BATCH_MAX_COMMANDS)
+        {
+            if (!fgets(line, sizeof(line), fp)) { eof = true; break; }
+            line[strcspn(line, "\n\r")] = '\0'; // Strip newline/cr.
+            if (strlen(line) == 0 || line[0] == '#') // Skip empty lines and comments.
+                continue;
+            announce_command(line, command_no + count + 1);
+            offsets[count] = body_len;
+            body_len += (size_t)sprintf(body + body_len, "%s\n", line);
+            count++;
+        }
+        if (count == 0)
+            break;
+        fflush(stdout);
+
+        // --- Send the whole batch with a single write ---
+        char header[32];
+        int header_len = snprintf(header, sizeof(header), "BATCH %d\n", count);
+        char *msg = body - header_len;
+        memcpy(msg, header, (size_t)header_len);
+        size_t msg_len = (size_t)header_len + body_len;
+        long long sent_at = now_us();
+        for (size_t sent = 0; sent < msg_len;)
+        {
+            ssize_t n = write(req_fd, msg + sent, msg_len - sent);
+            if (n == -1)
+            {
+                if (errno == EINTR) continue;
+                if (errno == EPIPE) fprintf(stderr, "Client (PID %d): Teller closed connection (EPIPE).\n", pid);
+                else perror("Client write batch");
+                ret = -1;
+                break;
+            }
+            sent += (size_t)n;
+        }
+        if (ret != 0)
+            break;
+
+        // --- Read count response lines ---
+        size_t in_len = 0;
+        int lines = 0;
+        while (lines < count)
+        {
+            ssize_t n = read(res_fd, in + in_len, (size_t)BATCH_MAX_COMMANDS * 64 - in_len);
+            if (n == -1 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                if (n == 0) printf("Client (PID %d): Teller closed connection unexpectedly.\n", pid);
+                else perror("Client read batch response");
+                ret = -1;
+                break;
+            }
+            for (ssize_t i = 0; i < n; ++i)
+                if (in[in_len + (size_t)i] == '\n')
+                    lines++;
+            in_len += (size_t)n;
+        }
+        in[in_len] = '\0';
+
+        // Every command of a batch is charged the batch's round-trip time.
+        long long batch_us = now_us() - sent_at;
+        for (int i = 0; ret == 0 && i < count; ++i)
+            record_latency(body + offsets[i], batch_us);
+
+        // --- Report each response in command order ---
+        char *resp = in;
+        for (int i = 0; i < lines && i < count; ++i)
+        {
+            char *nl = strchr(resp, '\n');
+            *nl = '\0';
+            report_response(resp, pid, ++command_no);
+            resp = nl + 1;
+        }
+    }
+
+    free(out);
+    free(in);
+    return ret;
+}
+
+/**
+ * @brief Prints the result of a request answered over the session channel, in the
+ *        same form as report_response prints the Teller's text responses.
+ * @param rq The request as submitted, or NULL if the command was invalid.
+ * @param resp The Teller's answer (ignored if rq is NULL).
+ * @param command_no Number of the command the answer belongs to.
+ */
+static void report_result(const request_t *rq, const request_t *resp, int command_no)
+{
+    if (rq == NULL || resp->op_status != 0)
+        printf("Client%d something went WRONG\n", command_no);
+    else if (rq->type == REQ_WITHDRAW && resp->result_balance == 0)
+        printf("Client%d served.. account closed\n", command_no);
+    else
+        printf("Client%d served.. BankID_%d\n", command_no, resp->bank_id);
+    printf("..\n");
+    fflush(stdout);
+}
+
+typedef struct
+{
+    char line[128];     // Command line (for latency records).
+    request_t rq;       // Parsed request.
+    bool valid;         // False if the command did not parse; it is answered locally.
+    uint32_t ticket;    // Channel ticket while in flight.
+    long long sent_at;  // Submission time.
+} channel_entry_t;
+
+/**
+ * @brief Waits for the answers of every pending command and reports them in order.
+ * @param ch The session channel.
+ * @param window Pending commands, oldest first.
+ * @param count Number of pending commands; reset to 0.
+ * @param command_no Number of the last command reported; advanced per report.
+ * @param pid This client's PID.
+ * @return 0 on success, -1 if the Teller went away.
+ */
+static int drain_channel(session_channel_t *ch, channel_entry_t *window, int *count, int *command_no, pid_t pid)
+{
+    for (int i = 0; i < *count; ++i)
+    {
+        channel_entry_t *entry = &window[i];
+        request_t resp;
+        if (entry->valid)
+        {
+            if (channel_wait_answer(ch, entry->ticket, &resp) != 0)
+            {
+                printf("Client (PID %d): Teller closed connection unexpectedly.\n", pid);
+                *count = 0;
+                return -1;
+            }
+            record_latency(entry->line, now_us() - entry->sent_at);
+        }
+        report_result(entry->valid ? &entry->rq : NULL, &resp, ++*command_no);
+    }
+    *count = 0;
+    return 0;
+}
+
+/**
+ * @brief Runs the command file over the session channel. The client parses each command
+ *        itself and publishes it as a binary request; the Teller passes it to the server
+ *        queue without text parsing. Up to depth commands are in flight. As with a Teller
+ *        serving a batch, the client first waits for everything outstanding before an
+ *        account creation or a command on an account that already has a request in flight.
+ * @param fp Open command file.
+ * @param ch The session channel, already attached by a Teller.
+ * @param pid This client's PID.
+ * @param depth Commands in flight at most (1 without --batch, CHANNEL_RING_LEN with it).
+ * @return 0 on success, -1 if the Teller went away.
+ */
+static int run_channel(FILE *fp, session_channel_t *ch, pid_t pid, int depth)
+{
+    channel_entry_t window[CHANNEL_RING_LEN];
+    char who[32];
+    int count = 0, announced = 0, reported = 0;
+    snprintf(who, sizeof(who), "Client(PID %d)", pid);
+
+    char line[128];
+    while (fgets(line, sizeof(line), fp))
+    {
+        line[strcspn(line, "\n\r")] = '\0'; // Strip newline/cr.
+        if (strlen(line) == 0 || line[0] == '#') // Skip empty lines and comments.
+            continue;
+        announce_command(line, ++announced);
+        fflush(stdout);
+
+        channel_entry_t *entry = &window[count];
+        snprintf(entry->line, sizeof(entry->line), "%s", line);
+        entry->valid = (parse_command(line, pid, who, &entry->rq) == 0);
+        if (entry->valid)
+        {
+            bool must_drain = (entry->rq.bank_id == -1);
+            for (int i = 0; i < count && !must_drain; ++i)
+                must_drain = (window[i].valid && window[i].rq.bank_id == entry->rq.bank_id);
+            if (must_drain)
+            {
+                channel_entry_t pending = *entry;
+                if (drain_channel(ch, window, &count, &reported, pid) != 0)
+                    return -1;
+                entry = &window[0];
+                *entry = pending;
+            }
+            entry->sent_at = now_us();
+            entry->ticket = channel_submit(ch, &entry->rq);
+        }
+        count++;
+
+        // A new account's ID is reported before any later command is sent.
+        if ((count == depth || (entry->valid && entry->rq.bank_id == -1)) &&
+            drain_channel(ch, window, &count, &reported, pid) != 0)
+            return -1;
+    }
+    return drain_channel(ch, window, &count, &reported, pid);
+}
+
 // --- Main Client Entry Point ---
 int main(int argc, char *argv[])
 {
+    bool batch_mode = false;
+    bool shm_mode = false;
+    const char *latency_path = NULL;
+    while (argc > 2 && strncmp(argv[argc - 1], "--", 2) == 0) // Trailing options.
+    {
+        if (strcmp(argv[argc - 1], "--batch") == 0) batch_mode = true;
+        else if (strcmp(argv[argc - 1], "--shm") == 0) shm_mode = true;
+        else if (strncmp(argv[argc - 1], "--latency=", 10) == 0) latency_path = argv[argc - 1] + 10;
+        else usage(argv[0]);
+        argc--;
+    }
     if (argc < 2 || argc > 3) usage(argv[0]);
+    if (latency_path)
+    {
+        latency_fp = fopen(latency_path, "a");
+        if (!latency_fp)
+        {
+            fprintf(stderr, "Client: Error opening '%s': %s\n", latency_path, strerror(errno));
+            exit(1);
+        }
+    }
 
     const char *cmdfile = argv[1];
     char server_fifo_path[256];
@@ -81,16 +441,37 @@ int main(int argc, char *argv[])
     }
     printf("Connected to Adabank..\n");
 
-    // Send client PID to the server so it can spawn a dedicated Teller.
-    if (dprintf(srv_fd, "%d\n", pid) < 0)
+    if (shm_mode)
     {
-        perror("Client write PID");
+        // --- Session Channel ---
+        // Created before the PID is announced, so the Teller finds it in place of FIFOs.
+        session_channel_t *ch = channel_create(pid);
+        if (!ch)
+        {
+            perror("Client channel create");
+            close(srv_fd);
+            fclose(fp);
+            exit(1);
+        }
+        int ret = -1;
+        if (dprintf(srv_fd, "%d\n", pid) < 0)
+            perror("Client write PID");
+        else if (channel_wait_attached(ch) != 0)
+            fprintf(stderr, "Client (PID %d): No Teller attached to the session channel.\n", pid);
+        else
+            ret = 0;
         close(srv_fd);
+        channel_unlink(pid); // The Teller has it mapped (or never will); the name is no longer needed.
+
+        if (ret == 0)
+            run_channel(fp, ch, pid, batch_mode ? CHANNEL_RING_LEN : 1);
+        channel_close_client(ch);
+        channel_unmap(ch);
         fclose(fp);
-        exit(1);
+        if (latency_fp) fclose(latency_fp);
+        printf("exiting..\n");
+        return ret == 0 ? 0 : 1;
     }
-    // Close the server FIFO fd; its purpose (sending PID) is done.
-    close(srv_fd);
 
     // --- Create Client-Specific FIFOs ---
     // These FIFOs are used for communication between this client and its dedicated Teller.
@@ -98,14 +479,17 @@ int main(int argc, char *argv[])
     snprintf(req_path, sizeof(req_path), "/tmp/bank_%d_req", pid); // Client -> Teller
     snprintf(res_path, sizeof(res_path), "/tmp/bank_%d_res", pid); // Teller -> Client
 
-    // Remove any potential stale FIFOs from previous runs.
+    // Remove any potential stale FIFOs from previous runs, and a stale session channel
+    // that would make the Teller expect a --shm client.
     unlink(req_path);
     unlink(res_path);
+    channel_unlink(pid);
 
     // Create the FIFOs.
     if (mkfifo(req_path, 0600) == -1)
     {
         perror("mkfifo req");
+        close(srv_fd);
         fclose(fp);
         exit(1);
     }
@@ -113,12 +497,28 @@ int main(int argc, char *argv[])
     {
         perror("mkfifo res");
         unlink(req_path); // Clean up partially created FIFOs.
+        close(srv_fd);
         fclose(fp);
         exit(1);
     }
 
+    // Send client PID to the server so it can assign a Teller. The FIFOs exist at
+    // this point, so the Teller can open them right away without retrying.
+    if (dprintf(srv_fd, "%d\n", pid) < 0)
+    {
+        perror("Client write PID");
+        close(srv_fd);
+        unlink(req_path); unlink(res_path);
+        fclose(fp);
+        exit(1);
+    }
+    // Close the server FIFO fd; its purpose (sending PID) is done.
+    close(srv_fd);
+
     // --- Open Client-Specific FIFOs ---
     // Open request FIFO for writing commands to the Teller.
+    // Both opens block until the Teller opens the other end; the kernel wakes us
+    // the moment it does, so there is no polling on either side.
     int req_fd = open(req_path, O_WRONLY);
     if (req_fd == -1)
     {
@@ -144,16 +544,10 @@ int main(int argc, char *argv[])
     int line_num = 0;
     int client_command_counter = 0; // Tracks which command this "client instance" is processing.
 
-    // Pre-calculate expected response prefixes for efficient parsing.
-    char expected_wrong_prefix[64];
-    char expected_closed_prefix[64];
-    char expected_served_prefix[64]; // Includes BankID_ part.
-    snprintf(expected_wrong_prefix, sizeof(expected_wrong_prefix), "Client%d something went WRONG", pid);
-    snprintf(expected_closed_prefix, sizeof(expected_closed_prefix), "Client%d served.. account closed", pid);
-    snprintf(expected_served_prefix, sizeof(expected_served_prefix), "Client%d served.. BankID_", pid);
-
+    if (batch_mode)
+        run_batched(fp, req_fd, res_fd, pid);
 
-    while (fgets(line, sizeof(line), fp)) // Read commands from the file.
+    while (!batch_mode && fgets(line, sizeof(line), fp)) // Read commands from the file one at a time.
     {
         line_num++;
         line[strcspn(line, "\n\r")] = '\0'; // Strip newline/cr.
@@ -161,20 +555,14 @@ int main(int argc, char *argv[])
             continue;
 
         client_command_counter++;
-
-        // Parse command locally for printing status message.
-        char b_id_str[64]="", op_str[32]="", am_str[32]=""; // Init to empty strings
-        sscanf(line, "%63s %31s %31s", b_id_str, op_str, am_str);
-        const char *action_str = "unknown action";
-        if (strcmp(op_str, "deposit") == 0) action_str = "depositing";
-        else if (strcmp(op_str, "withdraw") == 0) action_str = "withdrawing";
-        printf("Client%d connected..%s %s credits\n", client_command_counter, action_str, am_str);
+        announce_command(line, client_command_counter);
         fflush(stdout);
 
         // Send the command line to the Teller via the request FIFO.
         char write_buf[130];
         snprintf(write_buf, sizeof(write_buf), "%s\n", line); // Add newline delimiter.
         ssize_t write_len = strlen(write_buf);
+        long long sent_at = now_us();
         if (write(req_fd, write_buf, write_len) != write_len)
         {
             if (errno == EPIPE) fprintf(stderr, "Client%d: Teller closed connection (EPIPE).\n", client_command_counter);
@@ -188,46 +576,8 @@ int main(int argc, char *argv[])
         if (n > 0)
         {
             resp[n] = '\0'; // Null-terminate the response.
-            bool matched = false;
-
-            // Use strncmp for robust prefix matching (handles potential trailing newline).
-            // 1. Check for general error response.
-            if (strncmp(resp, expected_wrong_prefix, strlen(expected_wrong_prefix)) == 0) {
-                printf("Client%d something went WRONG\n", client_command_counter);
-                matched = true;
-            }
-            // 2. Check for account closed response.
-            else if (strncmp(resp, expected_closed_prefix, strlen(expected_closed_prefix)) == 0) {
-                 printf("Client%d served.. account closed\n", client_command_counter);
-                 matched = true;
-            }
-            // 3. Check for successful operation response (includes BankID).
-            else if (strncmp(resp, expected_served_prefix, strlen(expected_served_prefix)) == 0) {
-                 int parsed_bank_id = -1;
-                 // Point to the expected start of the numeric ID after the prefix.
-                 char *id_ptr = resp + strlen(expected_served_prefix);
-                 // Attempt to parse the integer ID.
-                 if (sscanf(id_ptr, "%d", &parsed_bank_id) == 1) {
-                      printf("Client%d served.. BankID_%d\n", client_command_counter, parsed_bank_id);
-                      matched = true;
-                 } else {
-                      // Prefix matched, but failed to parse the ID number - treat as an error.
-                      fprintf(stderr, "Client%d Warning: Matched BankID prefix but failed to parse ID in response: [%s]\n", client_command_counter, resp);
-                      printf("Client%d something went WRONG\n", client_command_counter); // Report as WRONG.
-                      matched = true; // Indicate the response was handled (as an error).
-                 }
-            }
-
-            // 4. Fallback if none of the expected patterns matched.
-            if (!matched) {
-                // Trim potential trailing newline from the unexpected response before printing.
-                resp[strcspn(resp, "\n\r")] = 0;
-                fprintf(stderr, "Client%d Warning: Unparsed response format from Teller: [%s]\n", client_command_counter, resp);
-                printf("Client%d something went WRONG\n", client_command_counter); // Default to WRONG.
-            }
-
-             printf("..\n"); // Print delimiter as per example output.
-             fflush(stdout);
+            record_latency(line, now_us() - sent_at);
+            report_response(resp, pid, client_command_counter);
         }
         else if (n == 0) // EOF on response pipe.
         {
@@ -247,6 +597,7 @@ int main(int argc, char *argv[])
 
     // --- Cleanup ---
     fclose(fp);    // Close command file.
+    if (latency_fp) fclose(latency_fp);
     close(req_fd); // Close request FIFO.
     close(res_fd); // Close response FIFO.
 
@@ -18,6 +18,7 @@
 #include <limits.h>  // For INT_MAX
 #include <stdint.h>  // For intptr_t
 #include <stdbool.h> // For bool type
+#include <pthread.h>
 
 #include "common.h"
 
@@ -29,6 +30,16 @@ static int dummy_fd = -1;                   // Write end of main server FIFO (ke
 static const char *server_fifo_path = NULL; // Path to the main server FIFO.
 static volatile sig_atomic_t running = 1;   // Flag to control the main server loop, set to 0 by signal handler.
 static int teller_spawn_counter = 0;        // Counter for assigning sequential IDs to spawned Tellers for logging.
+static FILE *journal_fp = NULL;             // Runtime text log (LOG_FILE_NAME), kept open in append mode and fully buffered.
+static bool wal_ready = false;              // True once the WAL is open and state has been restored.
+static queue_mode_t queue_mode = QUEUE_MODE_SEM; // Request queue implementation selected with --queue=.
+static int worker_count = DEFAULT_WORKER_THREADS; // Request processing threads, set with --workers=.
+static pthread_t *worker_threads = NULL;    // Threads consuming the request queue.
+static int workers_started = 0;             // Number of worker_threads that must be joined.
+static int teller_pool_size = DEFAULT_TELLER_POOL; // Pre-forked Tellers, set with --tellers= (0 = fork per client).
+static pid_t teller_pool_pids[MAX_TELLER_POOL];    // PIDs of the pooled Tellers, respawned when one exits.
+static teller_pool_arg_t teller_pool_args[MAX_TELLER_POOL]; // Arguments of the pooled Tellers (copied by fork).
+static int teller_ctl_fds[2] = {-1, -1};           // Control pipe: client PIDs are written to [1], pooled Tellers read [0].
 
 // --- Log Event Type Enum ---
 // Used to categorize detailed log entries during runtime.
@@ -54,78 +65,120 @@ typedef struct
 } AccountSummary;
 
 // --- Function Declarations ---
-static void log_transaction(log_event_type_t type, int id, long amount, long balance);
+static uint64_t log_transaction(log_event_type_t type, int id, long amount, long balance);
+static int commit_transaction(uint64_t lsn, int id);
 static void load_state_from_log();
-static int find_free_account_id();
+static void restore_state();
+static int checkpoint_state();
+static void init_free_account_ids();
+static int take_free_account_id();
+static void release_account_id(int id);
+static sem_t *account_lock(int id);
 static void sigint_handler(int signo);
 static void cleanup();
 static void process_deposit(request_t *req, int slot_idx);
 static void process_withdraw(request_t *req, int slot_idx);
-pid_t Teller(void *func, void *arg_func); // Provided API function.
-int waitTeller(pid_t pid, int *status);   // Provided API function.
-extern void *teller_main(void *);         // Entry point for teller process (defined in teller.c).
+static void send_response(request_t *req, int slot_idx);
+static int pop_queued_request(request_t *out);
+static void *worker_main(void *arg);
+static int start_workers();
+static void stop_workers();
+static void usage(const char *prog);
+static pid_t spawn_pooled_teller(int slot);
+static int start_teller_pool();
+static void stop_teller_pool();
+static void respawn_pooled_teller(pid_t ended);
+static int assign_client(pid_t client_pid);
 
 // --- Function Implementations ---
 
 /**
- * @brief Appends a detailed transaction record to the runtime log file.
- *        This log captures every state change event. The summary format is
- *        generated separately during cleanup.
+ * @brief Records a state change. The change is queued for the binary write-ahead log
+ *        (group commit, see wal.c) and a detailed text line is appended to the runtime
+ *        log file, from which the summary format is generated during cleanup. Neither
+ *        waits for the disk: callers append under the account's lock stripe, so
+ *        per-account entries stay ordered, and pass the returned LSN to
+ *        commit_transaction() after releasing it. The text log is fully buffered;
+ *        commit_transaction() flushes it, so concurrent requests share one write().
  * @param type The type of event (CREATE, DEPOSIT, WITHDRAW, CLOSE).
  * @param id The account ID involved.
  * @param amount The transaction amount (relevant for CREATE, DEPOSIT, WITHDRAW).
  * @param balance The account balance *after* the transaction (relevant for DEPOSIT, WITHDRAW).
+ * @return The WAL record's LSN.
  */
-static void log_transaction(log_event_type_t type, int id, long amount, long balance)
+static uint64_t log_transaction(log_event_type_t type, int id, long amount, long balance)
 {
-    // <<< ADDED: Wait for log mutex
-    if (region != NULL && region != MAP_FAILED)
-    { // Check if region is mapped
-        if (sem_wait(&region->logmutex) == -1)
+    // The WAL stores the resulting balance for every event so replay is idempotent.
+    long wal_balance = balance;
+    if (type == LOG_CREATE)
+        wal_balance = amount;
+    else if (type == LOG_CLOSE)
+        wal_balance = ACCOUNT_INACTIVE;
+    uint64_t lsn = wal_append(type, id, amount, wal_balance);
+
+    if (sem_wait(&region->logmutex) == -1)
+        perror("SERVER ERROR: sem_wait(logmutex)");
+    if (!journal_fp)
+    {
+        journal_fp = fopen(LOG_FILE_NAME, "a");
+        if (!journal_fp)
         {
-            perror("SERVER ERROR: sem_wait(logmutex)");
-            // Decide how to handle: maybe return, maybe proceed without lock?
-            // Proceeding without lock risks corruption but might be better than deadlock/exit
+            perror("SERVER ERROR: Log append failed");
+            sem_post(&region->logmutex);
+            return lsn;
         }
-    }
-    else
-    {
-        fprintf(stderr, "SERVER WARNING: SHM region not available in log_transaction\n");
-        // Cannot use semaphore if region is not mapped (e.g., during early init/late cleanup?)
+        setvbuf(journal_fp, NULL, _IOFBF, JOURNAL_BUFFER_SIZE);
     }
 
-    FILE *log_fp = fopen(LOG_FILE_NAME, "a");
-    if (!log_fp)
-    {
-        perror("SERVER ERROR: Log append failed");
-        if (region != NULL && region != MAP_FAILED) sem_post(&region->logmutex);
-        return;
-    }
-
-    // Log events in a detailed format for state reconstruction.
+    // Log events in a detailed format for the shutdown summary.
     switch (type)
     {
     case LOG_CREATE:
-        fprintf(log_fp, "CREATE %d %ld\n", id, amount); // Log initial balance on creation.
+        fprintf(journal_fp, "CREATE %d %ld\n", id, amount); // Log initial balance on creation.
         break;
     case LOG_DEPOSIT:
-        fprintf(log_fp, "DEPOSIT %d %ld %ld\n", id, amount, balance); // Log amount and resulting balance.
+        fprintf(journal_fp, "DEPOSIT %d %ld %ld\n", id, amount, balance); // Log amount and resulting balance.
         break;
     case LOG_WITHDRAW:
-        fprintf(log_fp, "WITHDRAW %d %ld %ld\n", id, amount, balance); // Log amount and resulting balance.
+        fprintf(journal_fp, "WITHDRAW %d %ld %ld\n", id, amount, balance); // Log amount and resulting balance.
         break;
     case LOG_CLOSE:
-        fprintf(log_fp, "CLOSE %d\n", id); // Log explicit closure event (balance reached 0).
+        fprintf(journal_fp, "CLOSE %d\n", id); // Log explicit closure event (balance reached 0).
         break;
     default:
-        fprintf(log_fp, "UNKNOWN_EVENT %d %ld %ld\n", id, amount, balance);
+        fprintf(journal_fp, "UNKNOWN_EVENT %d %ld %ld\n", id, amount, balance);
         break;
     }
-    fflush(log_fp);
-    fsync(fileno(log_fp)); // Ensure data is written to disk for recovery.
-    fclose(log_fp);
+    sem_post(&region->logmutex);
+    return lsn;
+}
+
+/**
+ * @brief Writes out the buffered text log and waits until a request's WAL records are
+ *        on disk. Called once per request, after the account's lock stripe is released,
+ *        with the LSN of its last record. If another request already flushed the text
+ *        log, the flush finds an empty buffer and costs nothing.
+ * @param lsn LSN returned by the request's last log_transaction call.
+ * @param id The account ID involved, for the error message.
+ * @return 0 if the records are durable, -1 if the WAL failed (the request must report an error).
+ *         Only requests already logged when the WAL failed get here: later ones are
+ *         refused. Their changes stay in memory, but checkpoints fail from then on, so
+ *         a restart recovers whatever part of the failed group reached the disk.
+ */
+static int commit_transaction(uint64_t lsn, int id)
+{
+    // Keep the text log complete if the server process dies; the summary is built from it.
+    sem_wait(&region->logmutex);
+    if (journal_fp)
+        fflush(journal_fp);
+    sem_post(&region->logmutex);
 
-    if (region != NULL && region != MAP_FAILED) sem_post(&region->logmutex);
+    if (wal_wait_durable(lsn) != 0)
+    {
+        fprintf(stderr, "SERVER ERROR: Transaction on BankID_%d is not durable\n", id);
+        return -1;
+    }
+    return 0;
 }
 
 /**
@@ -258,29 +311,123 @@ static void load_state_from_log()
 }
 
 /**
- * @brief Finds an available (inactive) account ID slot in the balances array.
- *        Uses linear probing starting from `region->next_id`. Protected by `dbmutex`.
- * @return The index of a free slot, or -1 if the bank is full.
+ * @brief Restores the bank state at startup and opens the write-ahead log.
+ *        The text log file is the bank's database: if it exists, the state comes from
+ *        the latest snapshot plus the WAL records after it, falling back to parsing the
+ *        text log when no binary files exist yet. Without a text log the bank starts
+ *        empty and stale binary files are discarded. The free account ID queue is
+ *        rebuilt, and a checkpoint records the restored state so the next recovery
+ *        starts from it.
  */
-static int find_free_account_id()
+static void restore_state()
 {
-    sem_wait(&region->dbmutex); // Protect access to balances and next_id.
-    int start_idx = region->next_id;
-    int current_idx = start_idx;
-    do
+    bool have_log = (access(LOG_FILE_NAME, F_OK) == 0);
+    if (!have_log)
     {
-        if (region->balances[current_idx] == ACCOUNT_INACTIVE)
-        {
-            // Found a free slot.
-            region->next_id = (current_idx + 1) % MAX_ACCOUNTS; // Update hint for next search.
-            sem_post(&region->dbmutex);
-            return current_idx;
-        }
-        current_idx = (current_idx + 1) % MAX_ACCOUNTS; // Move to the next slot.
-    } while (current_idx != start_idx); // Loop until all slots are checked.
+        unlink(WAL_FILE_NAME);
+        unlink(SNAPSHOT_FILE_NAME);
+    }
+    if (wal_open(WAL_FILE_NAME) != 0)
+    {
+        fprintf(stderr, "FATAL: Cannot open write-ahead log\n");
+        cleanup();
+        exit(EXIT_FAILURE);
+    }
+
+    long replayed = 0;
+    if (have_log && wal_recover(SNAPSHOT_FILE_NAME, region->balances, &region->next_id, &replayed) == 1)
+        printf("Recovered bank state from snapshot and %ld WAL records\n", replayed);
+    else
+        load_state_from_log(); // First run, or a text log written before the WAL existed.
+    init_free_account_ids();   // Queue every inactive ID for allocation.
+    wal_ready = true;
+
+    if (checkpoint_state() != 0)
+        fprintf(stderr, "SERVER WARNING: Initial checkpoint failed; recovery will use the full WAL\n");
+}
+
+/**
+ * @brief Writes a snapshot of all balances and truncates the WAL. Every account lock
+ *        stripe is held meanwhile, so no transaction is half-applied; the caller must
+ *        not hold any stripe itself.
+ * @return 0 on success, -1 on failure.
+ */
+static int checkpoint_state()
+{
+    for (int i = 0; i < ACCOUNT_LOCK_STRIPES; ++i)
+        sem_wait(&region->account_locks[i].lock);
+
+    // The next ID the free queue would hand out, so ID assignment continues in order.
+    sem_wait(&region->dbmutex);
+    int next_id = (region->free_count > 0) ? region->free_ids[region->free_head] : region->next_id;
+    sem_post(&region->dbmutex);
+
+    int ret = wal_checkpoint(SNAPSHOT_FILE_NAME, region->balances, next_id);
+
+    for (int i = ACCOUNT_LOCK_STRIPES - 1; i >= 0; --i)
+        sem_post(&region->account_locks[i].lock);
+    return ret;
+}
+
+/**
+ * @brief Rebuilds the free account ID queue from the balances array.
+ *        IDs are queued starting at `region->next_id` and wrapping around, so new
+ *        accounts keep receiving increasing IDs after a restart. Called with no
+ *        Tellers running (startup), so it does not lock.
+ */
+static void init_free_account_ids()
+{
+    region->free_head = 0;
+    region->free_count = 0;
+    for (int i = 0; i < MAX_ACCOUNTS; ++i)
+    {
+        int id = (region->next_id + i) % MAX_ACCOUNTS;
+        if (region->balances[id] == ACCOUNT_INACTIVE)
+            region->free_ids[region->free_count++] = id;
+    }
+}
+
+/**
+ * @brief Takes the next available account ID from the free queue in O(1).
+ *        Protected by `dbmutex`.
+ * @return A free account ID, or -1 if the bank is full.
+ */
+static int take_free_account_id()
+{
+    int id = -1;
+    sem_wait(&region->dbmutex);
+    if (region->free_count > 0)
+    {
+        id = region->free_ids[region->free_head];
+        region->free_head = (region->free_head + 1) % MAX_ACCOUNTS;
+        region->free_count--;
+    }
+    sem_post(&region->dbmutex);
+    return id;
+}
 
+/**
+ * @brief Returns a closed account's ID to the back of the free queue, so it is
+ *        reused only after the IDs already waiting. Protected by `dbmutex`.
+ * @param id The account ID that became inactive.
+ */
+static void release_account_id(int id)
+{
+    sem_wait(&region->dbmutex);
+    region->free_ids[(region->free_head + region->free_count) % MAX_ACCOUNTS] = id;
+    region->free_count++;
     sem_post(&region->dbmutex);
-    return -1; // No free accounts found.
+}
+
+/**
+ * @brief Returns the striped lock guarding an account's balance.
+ *        Holding it also keeps that account's log entries in balance order.
+ * @param id A valid account ID.
+ * @return Pointer to the stripe semaphore.
+ */
+static sem_t *account_lock(int id)
+{
+    return &region->account_locks[id % ACCOUNT_LOCK_STRIPES].lock;
 }
 
 /**
@@ -309,6 +456,25 @@ static void cleanup()
         close(dummy_fd);
     server_fd = dummy_fd = -1;
 
+    // --- Final Checkpoint ---
+    // Workers are stopped, so the snapshot holds the final state and the WAL can be emptied.
+    if (wal_ready)
+    {
+        uint64_t wal_records, wal_syncs;
+        wal_stats(&wal_records, &wal_syncs);
+        printf("WAL: %llu records committed with %llu syncs\n",
+               (unsigned long long)wal_records, (unsigned long long)wal_syncs);
+        if (checkpoint_state() != 0)
+            fprintf(stderr, "WARN: Final checkpoint failed; recovery will replay the WAL\n");
+        wal_close();
+        wal_ready = false;
+    }
+    if (journal_fp)
+    {
+        fclose(journal_fp);
+        journal_fp = NULL;
+    }
+
     // --- Log Summarization ---
     // Reads the detailed runtime log and overwrites it with a summarized format.
     printf("Updating log file... ");
@@ -432,7 +598,10 @@ static void cleanup()
         sem_destroy(&region->items);
         sem_destroy(&region->qmutex);
         sem_destroy(&region->dbmutex);
+        for (int i = 0; i < ACCOUNT_LOCK_STRIPES; ++i)
+            sem_destroy(&region->account_locks[i].lock);
         sem_destroy(&region->logmutex);
+        sem_destroy(&region->answer_slots);
         for (int i = 0; i < REQ_QUEUE_LEN; ++i)
             sem_destroy(&region->resp_ready[i]);
 
@@ -468,29 +637,38 @@ static void cleanup()
  * @brief Processes a deposit request from the shared memory queue.
  *        Handles both creating new accounts (req->bank_id == -1) and
  *        depositing into existing accounts. Updates balance, logs transaction,
- *        and signals completion via resp_ready semaphore. Protected by dbmutex.
+ *        and signals completion to the waiting Teller. Only the target account's
+ *        lock stripe is held, so requests for other accounts can proceed in parallel;
+ *        it is released before waiting for the WAL, and a WAL failure is reported as an error.
+ *        Once the WAL has failed, deposits are refused without touching any balance.
  * @param req Pointer to the request structure in the SHM queue.
- * @param slot_idx The index of the request in the SHM queue.
+ * @param slot_idx The answer slot (semaphore mode) or ring slot the request came from.
  */
 static void process_deposit(request_t *req, int slot_idx)
 {
     int op_status = 2; // Default to error status.
     long current_balance = 0;
     int account_id = req->bank_id; // Use a local variable for the target ID.
+    uint64_t lsn = 0;              // WAL record to wait for before answering (0 = none).
 
+    // A failed WAL cannot record the change, so applying it would only leave memory ahead of the disk.
+    if (wal_failed())
+    {
+        printf("Client%d deposit %ld failed (log unavailable)... operation not permitted.\n", req->client_pid, req->amount);
+    }
     // Handle account creation request.
-    if (req->bank_id == -1)
+    else if (req->bank_id == -1)
     {
-        int new_id = find_free_account_id(); // Atomically finds and reserves an ID slot.
+        int new_id = take_free_account_id(); // Reserves an ID exclusively for this request.
         if (new_id != -1)
         {
             account_id = new_id;
-            sem_wait(&region->dbmutex); // Lock for balance write.
+            sem_wait(account_lock(account_id)); // Lock for balance write and ordered logging.
             region->balances[account_id] = req->amount;
             current_balance = req->amount;
-            sem_post(&region->dbmutex);                                  // Unlock.
             op_status = 0;                                               // OK.
-            log_transaction(LOG_CREATE, account_id, current_balance, 0); // Log creation with initial balance.
+            lsn = log_transaction(LOG_CREATE, account_id, current_balance, 0); // Log creation with initial balance.
+            sem_post(account_lock(account_id));
             printf("Client%d deposited %ld credits... updating log\n", req->client_pid, req->amount);
         }
         else
@@ -506,32 +684,26 @@ static void process_deposit(request_t *req, int slot_idx)
     // Handle deposit to existing account.
     else if (req->bank_id >= 0 && req->bank_id < MAX_ACCOUNTS)
     {
-        sem_wait(&region->dbmutex);                             // Lock for balance read/write.
-        if (region->balances[req->bank_id] != ACCOUNT_INACTIVE) // Check if account exists and is active.
+        sem_wait(account_lock(account_id));                  // Lock for balance read/write.
+        if (region->balances[account_id] != ACCOUNT_INACTIVE) // Check if account exists and is active.
         {
-            account_id = req->bank_id;
-            long *bal_ptr = &region->balances[account_id];
+            long new_balance;
             // Check for potential integer overflow before adding.
-            if (__builtin_add_overflow(*bal_ptr, req->amount, bal_ptr))
+            if (__builtin_add_overflow(region->balances[account_id], req->amount, &new_balance))
             {
                 // Overflow detected. Operation fails. Balance remains unchanged.
-                op_status = 2;              // Error status.
-                                            // Restore previous balance before overflow attempt (though bal_ptr might be corrupted depending on overflow behavior)
-                                            // Re-reading is safer: current_balance = region->balances[account_id];
-                sem_post(&region->dbmutex); // Unlock BEFORE potential re-read inside lock
-                sem_wait(&region->dbmutex);
-                current_balance = region->balances[account_id]; // Read the balance *before* failed attempt
-                sem_post(&region->dbmutex);
-                sem_wait(&region->dbmutex); // Re-acquire lock if needed later? No, logic ends here for error.
+                op_status = 2;                                  // Error status.
+                current_balance = region->balances[account_id]; // Balance before the failed attempt.
                 printf("Client%d deposit %ld failed (OVERFLOW)... operation not permitted.\n", req->client_pid, req->amount);
                 // No log entry for overflow error.
             }
             else
             {
                 // Deposit successful.
-                current_balance = *bal_ptr; // New balance after successful addition.
-                op_status = 0;              // OK status.
-                log_transaction(LOG_DEPOSIT, account_id, req->amount, current_balance);
+                region->balances[account_id] = new_balance;
+                current_balance = new_balance; // New balance after successful addition.
+                op_status = 0;                 // OK status.
+                lsn = log_transaction(LOG_DEPOSIT, account_id, req->amount, current_balance);
                 printf("Client%d deposited %ld credits... updating log\n", req->client_pid, req->amount);
             }
         }
@@ -543,7 +715,7 @@ static void process_deposit(request_t *req, int slot_idx)
             printf("Client%d deposit %ld failed (BankID_%d inactive)... operation not permitted.\n", req->client_pid, req->amount, account_id);
             // No log entry for attempting deposit to inactive account.
         }
-        sem_post(&region->dbmutex); // Unlock.
+        sem_post(account_lock(account_id)); // Unlock.
     }
     // Handle invalid Bank ID provided in request.
     else
@@ -554,32 +726,44 @@ static void process_deposit(request_t *req, int slot_idx)
         // No log entry for invalid ID.
     }
 
-    // Update the response fields in the shared memory request slot.
-    region->queue[slot_idx].bank_id = account_id;             // Return the actual account ID used (or -1 on creation failure).
-    region->queue[slot_idx].result_balance = current_balance; // Return balance *after* operation (or relevant error value).
-    region->queue[slot_idx].op_status = op_status;            // Return operation status code.
+    // Answer only once the change is durable; the stripe is already free for other requests.
+    if (lsn != 0 && commit_transaction(lsn, account_id) != 0)
+        op_status = 2;
 
-    // Signal the waiting Teller that the response is ready.
-    sem_post(&region->resp_ready[slot_idx]);
+    // Fill in the response fields and hand them back to the waiting Teller.
+    req->bank_id = account_id;             // Return the actual account ID used (or -1 on creation failure).
+    req->result_balance = current_balance; // Return balance *after* operation (or relevant error value).
+    req->op_status = op_status;            // Return operation status code.
+    send_response(req, slot_idx);
 }
 
 /**
  * @brief Processes a withdraw request from the shared memory queue.
  *        Checks for valid account, sufficient funds, updates balance,
  *        logs transaction (including potential closure), and signals completion.
- *        Protected by dbmutex.
+ *        Protected by the account's lock stripe; a closed account's ID is
+ *        returned to the free queue. The reply waits once for the WAL, after the stripe
+ *        is released, and a WAL failure is reported as an error. Once the WAL has failed,
+ *        withdrawals are refused without touching any balance.
  * @param req Pointer to the request structure in the SHM queue.
- * @param slot_idx The index of the request in the SHM queue.
+ * @param slot_idx The answer slot (semaphore mode) or ring slot the request came from.
  */
 static void process_withdraw(request_t *req, int slot_idx)
 {
     int op_status = 2; // Default to error status.
     long current_balance = 0;
     int account_id = req->bank_id; // Should be a valid, active ID for withdrawal.
+    uint64_t lsn = 0;              // Last WAL record to wait for before answering (0 = none).
 
-    if (account_id >= 0 && account_id < MAX_ACCOUNTS)
+    // A failed WAL cannot record the change, so applying it would only leave memory ahead of the disk.
+    if (wal_failed())
+    {
+        printf("Client%d withdraws %ld failed (log unavailable)... operation not permitted.\n", req->client_pid, req->amount);
+    }
+    else if (account_id >= 0 && account_id < MAX_ACCOUNTS)
     {
-        sem_wait(&region->dbmutex);                           // Lock for balance read/write.
+        bool closed = false;
+        sem_wait(account_lock(account_id));                   // Lock for balance read/write.
         if (region->balances[account_id] != ACCOUNT_INACTIVE) // Check if account is active.
         {
             long *bal_ptr = &region->balances[account_id];
@@ -589,20 +773,21 @@ static void process_withdraw(request_t *req, int slot_idx)
                 *bal_ptr -= req->amount;
                 current_balance = *bal_ptr;
                 op_status = 0; // OK status.
-                log_transaction(LOG_WITHDRAW, account_id, req->amount, current_balance);
-                printf("Client%d withdraws %ld credits... updating log", req->client_pid, req->amount);
+                lsn = log_transaction(LOG_WITHDRAW, account_id, req->amount, current_balance);
 
-                // Check if the withdrawal emptied the account.
+                // Check if the withdrawal emptied the account. Both records go to the
+                // WAL together and a single wait below covers them.
                 if (current_balance == 0)
                 {
-                    *bal_ptr = ACCOUNT_INACTIVE;                   // Mark the account slot as inactive.
-                    log_transaction(LOG_CLOSE, account_id, 0, 0);  // Log the closure event.
-                    printf("... Bye Client%d\n", req->client_pid); // Indicate account closure.
+                    *bal_ptr = ACCOUNT_INACTIVE;                        // Mark the account slot as inactive.
+                    lsn = log_transaction(LOG_CLOSE, account_id, 0, 0); // Log the closure event.
+                    closed = true;
                 }
+                // One printf per line so output from parallel workers does not interleave.
+                if (closed)
+                    printf("Client%d withdraws %ld credits... updating log... Bye Client%d\n", req->client_pid, req->amount, req->client_pid);
                 else
-                {
-                    printf("\n"); // End the line if account remains open.
-                }
+                    printf("Client%d withdraws %ld credits... updating log\n", req->client_pid, req->amount);
             }
             else
             {
@@ -621,7 +806,9 @@ static void process_withdraw(request_t *req, int slot_idx)
             printf("Client%d withdraws %ld failed (BankID_%d inactive)... operation not permitted.\n", req->client_pid, req->amount, account_id);
             // No log entry for inactive account withdrawal attempt.
         }
-        sem_post(&region->dbmutex); // Unlock.
+        sem_post(account_lock(account_id)); // Unlock.
+        if (closed)
+            release_account_id(account_id); // The ID may now be handed out again.
     }
     else
     {
@@ -632,15 +819,273 @@ static void process_withdraw(request_t *req, int slot_idx)
         // No log entry for invalid ID.
     }
 
-    // Update the response fields in the shared memory request slot.
-    region->queue[slot_idx].bank_id = account_id;             // Account ID remains the same for withdraw.
-    region->queue[slot_idx].result_balance = current_balance; // Balance after operation (or before if failed).
-    region->queue[slot_idx].op_status = op_status;            // Result status code.
+    // Answer only once the change is durable; the stripe is already free for other requests.
+    if (lsn != 0 && commit_transaction(lsn, account_id) != 0)
+        op_status = 2;
+
+    // Fill in the response fields and hand them back to the waiting Teller.
+    req->bank_id = account_id;             // Account ID remains the same for withdraw.
+    req->result_balance = current_balance; // Balance after operation (or before if failed).
+    req->op_status = op_status;            // Result status code.
+    send_response(req, slot_idx);
+}
+
+/**
+ * @brief Delivers a processed request's response fields to the Teller waiting on slot_idx.
+ *        Semaphore mode copies them into answers[slot_idx] and posts resp_ready[slot_idx];
+ *        ring mode stores them in the ring slot and wakes the Teller only if it sleeps.
+ * @param req The processed request carrying bank_id, result_balance and op_status.
+ * @param slot_idx The answer slot (semaphore mode) or ring slot the request came from.
+ */
+static void send_response(request_t *req, int slot_idx)
+{
+    if (queue_mode == QUEUE_MODE_FUTEX)
+    {
+        ring_complete(&region->ring, slot_idx, req);
+        return;
+    }
+    region->answers[slot_idx] = *req;
 
     // Signal the waiting Teller that the response is ready.
     sem_post(&region->resp_ready[slot_idx]);
 }
 
+/**
+ * @brief Takes the next request from the semaphore-guarded queue (QUEUE_MODE_SEM).
+ *        Waits at most 250 ms so workers notice shutdown.
+ * @param out Receives a copy of the request.
+ * @return The answer slot of the request, or -1 if no request arrived in time.
+ */
+static int pop_queued_request(request_t *out)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += 250 * 1000 * 1000;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    if (sem_timedwait(&region->items, &deadline) == -1)
+        return -1;
+
+    // Get mutex to access queue head index.
+    sem_wait(&region->qmutex);
+    int idx = region->head;                            // Index of the request to process.
+    *out = region->queue[idx];                         // Copy request data locally.
+    region->head = (region->head + 1) % REQ_QUEUE_LEN; // Advance head index.
+    sem_post(&region->qmutex);                         // Release mutex.
+
+    // Signal that a slot is now free in the queue; the answer goes to the request's own answer slot.
+    sem_post(&region->slots);
+    return out->answer_slot;
+}
+
+/**
+ * @brief Request processing thread. Several run in parallel; requests for accounts
+ *        in different lock stripes are processed concurrently. In ring mode a worker
+ *        sleeps on the ring's doorbell futex when the ring is empty.
+ * @param arg Unused.
+ * @return Always NULL.
+ */
+static void *worker_main(void *arg)
+{
+    (void)arg;
+    request_t req;
+    while (running)
+    {
+        int idx;
+        if (queue_mode == QUEUE_MODE_FUTEX)
+        {
+            idx = ring_pop(&region->ring, &req);
+            if (idx == -1)
+            {
+                ring_wait_for_requests(&region->ring, 250);
+                continue;
+            }
+        }
+        else
+        {
+            idx = pop_queued_request(&req);
+            if (idx == -1)
+                continue; // Timed out (or interrupted): re-check running.
+        }
+
+        // Dispatch request to appropriate processing function.
+        if (req.type == REQ_DEPOSIT)
+            process_deposit(&req, idx);
+        else // REQ_WITHDRAW
+            process_withdraw(&req, idx);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Starts worker_count request processing threads. Shutdown signals are
+ *        blocked in the workers so they keep interrupting the main thread's poll().
+ * @return 0 on success, -1 if no thread could be created.
+ */
+static int start_workers()
+{
+    worker_threads = calloc((size_t)worker_count, sizeof(pthread_t));
+    if (!worker_threads)
+    {
+        perror("FATAL: calloc (worker threads)");
+        return -1;
+    }
+
+    sigset_t block, old;
+    sigemptyset(&block);
+    sigaddset(&block, SIGINT);
+    sigaddset(&block, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &block, &old);
+    for (int i = 0; i < worker_count; ++i)
+    {
+        int err = pthread_create(&worker_threads[workers_started], NULL, worker_main, NULL);
+        if (err != 0)
+        {
+            fprintf(stderr, "Server WARN: pthread_create (worker %d): %s\n", i, strerror(err));
+            break;
+        }
+        workers_started++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return (workers_started > 0) ? 0 : -1;
+}
+
+/**
+ * @brief Wakes and joins all worker threads. Must run after 'running' was cleared.
+ */
+static void stop_workers()
+{
+    if (workers_started > 0 && queue_mode == QUEUE_MODE_FUTEX)
+        ring_wake_consumers(&region->ring);
+    for (int i = 0; i < workers_started; ++i)
+        pthread_join(worker_threads[i], NULL);
+    workers_started = 0;
+    free(worker_threads);
+    worker_threads = NULL;
+}
+
+/**
+ * @brief Prints usage information and exits.
+ * @param prog The program name (argv[0]).
+ */
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s <ServerFIFO_Name> [--queue=sem|futex] [--workers=N] [--tellers=N]\n", basename((char *)prog));
+    fprintf(stderr, "  --workers defaults to %d request processing threads\n", DEFAULT_WORKER_THREADS);
+    fprintf(stderr, "  --tellers defaults to %d pre-forked Tellers (0 forks one per client)\n", DEFAULT_TELLER_POOL);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * @brief Forks the pooled Teller for pool slot `slot`.
+ * @param slot Index into teller_pool_pids.
+ * @return PID of the new Teller, or -1 on fork error.
+ */
+static pid_t spawn_pooled_teller(int slot)
+{
+    teller_pool_args[slot].ctl_fd = teller_ctl_fds[0];
+    teller_pool_args[slot].slot = slot;
+    pid_t pid = Teller(teller_pool_main, &teller_pool_args[slot]);
+    teller_pool_pids[slot] = pid;
+    return pid;
+}
+
+/**
+ * @brief Creates the control pipe and pre-forks teller_pool_size Tellers. They map
+ *        SHM once and then block on the pipe until a client is assigned to them.
+ * @return 0 on success, -1 if the pipe could not be created or no Teller was forked.
+ */
+static int start_teller_pool()
+{
+    if (teller_pool_size == 0)
+        return 0;
+    if (pipe(teller_ctl_fds) == -1)
+    {
+        perror("FATAL: Teller control pipe");
+        return -1;
+    }
+
+    int started = 0;
+    for (int i = 0; i < teller_pool_size; ++i)
+        if (spawn_pooled_teller(i) != -1)
+            started++;
+    if (started == 0)
+    {
+        fprintf(stderr, "FATAL: Could not fork any pooled Teller\n");
+        stop_teller_pool();
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Closes the control pipe. Idle pooled Tellers read EOF and exit; busy ones
+ *        exit once their current client disconnects.
+ */
+static void stop_teller_pool()
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        if (teller_ctl_fds[i] != -1)
+            close(teller_ctl_fds[i]);
+        teller_ctl_fds[i] = -1;
+    }
+    teller_pool_size = 0; // Nothing left to respawn.
+}
+
+/**
+ * @brief Replaces a pooled Teller that has exited (e.g., crashed) so the pool keeps its size.
+ *        A Teller that died while waiting on the control pipe still has its slot flagged
+ *        idle, so the flag is cleared before the replacement sets it again.
+ * @param ended PID returned by waitpid; ignored if it was an on-demand Teller.
+ */
+static void respawn_pooled_teller(pid_t ended)
+{
+    for (int i = 0; i < teller_pool_size; ++i)
+    {
+        if (teller_pool_pids[i] != ended)
+            continue;
+        __atomic_store_n(&region->teller_idle[i], 0, __ATOMIC_SEQ_CST);
+        if (spawn_pooled_teller(i) == -1)
+            fprintf(stderr, "Server WARN: Could not respawn pooled Teller %d\n", i);
+        return;
+    }
+}
+
+/**
+ * @brief Hands a client to an idle pooled Teller over the control pipe, or forks a
+ *        dedicated Teller if every pooled one is busy.
+ * @param client_pid PID announced by the client on the server FIFO.
+ * @return 0 on success, -1 if the client could not be given a Teller.
+ */
+static int assign_client(pid_t client_pid)
+{
+    // Pooled Tellers flagged idle, minus the PIDs already waiting in the pipe for one of them.
+    // Only this thread increments pool_unread, so a positive difference cannot be taken by anyone else.
+    if (teller_ctl_fds[1] != -1)
+    {
+        int idle = -__atomic_load_n(&region->pool_unread, __ATOMIC_SEQ_CST);
+        for (int i = 0; i < teller_pool_size; ++i)
+            idle += __atomic_load_n(&region->teller_idle[i], __ATOMIC_SEQ_CST);
+        if (idle > 0)
+        {
+            __atomic_fetch_add(&region->pool_unread, 1, __ATOMIC_SEQ_CST);
+            if (write(teller_ctl_fds[1], &client_pid, sizeof(client_pid)) == (ssize_t)sizeof(client_pid))
+                return 0;
+            perror("Server ERROR: Teller control pipe write");
+            __atomic_fetch_sub(&region->pool_unread, 1, __ATOMIC_SEQ_CST);
+        }
+    }
+
+    void *teller_arg = (void *)(intptr_t)client_pid; // Pass client PID as argument.
+    if (Teller(teller_main, teller_arg) == -1)
+        return -1;
+    return 0;
+}
+
 /**
  * @brief Forks a new process to execute the specified teller function.
  * @param func Pointer to the teller entry function (e.g., teller_main).
@@ -657,7 +1102,10 @@ pid_t Teller(void *func, void *arg_func)
     }
     else if (pid == 0)
     {
-        // Child process (Teller).
+        // Child process (Teller). Only the server may hold the control pipe's write
+        // end, otherwise pooled Tellers would never see EOF when it exits.
+        if (teller_ctl_fds[1] != -1)
+            close(teller_ctl_fds[1]);
         teller_main_func_t fn = (teller_main_func_t)func;
         fn(arg_func);        // Execute the teller main function.
         _exit(EXIT_SUCCESS); // Teller process exits cleanly.
@@ -685,12 +1133,33 @@ int waitTeller(pid_t pid, int *status)
 // --- Main Server Entry Point ---
 int main(int argc, char *argv[])
 {
-    if (argc != 2)
+    if (argc < 2 || argv[1][0] == '-')
+        usage(argv[0]);
+    server_fifo_path = argv[1];
+    for (int i = 2; i < argc; ++i)
     {
-        fprintf(stderr, "Usage: %s <ServerFIFO_Name>\n", basename(argv[0]));
-        exit(EXIT_FAILURE);
+        char *endptr;
+        if (strcmp(argv[i], "--queue=futex") == 0)
+            queue_mode = QUEUE_MODE_FUTEX;
+        else if (strcmp(argv[i], "--queue=sem") == 0)
+            queue_mode = QUEUE_MODE_SEM;
+        else if (strncmp(argv[i], "--workers=", 10) == 0)
+        {
+            long n = strtol(argv[i] + 10, &endptr, 10);
+            if (*endptr != '\0' || n < 1 || n > 64)
+                usage(argv[0]);
+            worker_count = (int)n;
+        }
+        else if (strncmp(argv[i], "--tellers=", 10) == 0)
+        {
+            long n = strtol(argv[i] + 10, &endptr, 10);
+            if (*endptr != '\0' || n < 0 || n > MAX_TELLER_POOL)
+                usage(argv[0]);
+            teller_pool_size = (int)n;
+        }
+        else
+            usage(argv[0]);
     }
-    server_fifo_path = argv[1];
     printf("BankServer %s\n", server_fifo_path);
 
     // --- Signal Handling Setup ---
@@ -761,9 +1230,14 @@ int main(int argc, char *argv[])
         if (sem_init(&region->items, 1, 0) == -1)
             ok = 0; // Available items (requests)
         if (sem_init(&region->dbmutex, 1, 1) == -1)
-            ok = 0; // Mutex for balance array & next_id
+            ok = 0; // Mutex for the free account ID queue
+        for (int i = 0; i < ACCOUNT_LOCK_STRIPES; ++i)
+            if (sem_init(&region->account_locks[i].lock, 1, 1) == -1)
+                ok = 0; // Striped balance locks
         if (sem_init(&region->logmutex, 1, 1) == -1)
             ok = 0; // Mutex for log file access
+        if (sem_init(&region->answer_slots, 1, REQ_QUEUE_LEN) == -1)
+            ok = 0; // Unused answer slots
         for (int i = 0; i < REQ_QUEUE_LEN; ++i)
             if (sem_init(&region->resp_ready[i], 1, 0) == -1)
                 ok = 0; // Response signals (initially 0)
@@ -775,7 +1249,10 @@ int main(int argc, char *argv[])
             exit(EXIT_FAILURE);
         }
         region->head = region->tail = 0; // Initialize queue indices.
-        load_state_from_log();           // Load initial state from log file (or create it).
+        for (int i = 0; i < REQ_QUEUE_LEN; ++i)
+            region->answer_free[i] = i; // Every answer slot starts unused.
+        region->answer_free_count = REQ_QUEUE_LEN;
+        restore_state();                 // Load state from snapshot + WAL or the log file (or create it).
     }
     else
     {
@@ -793,9 +1270,14 @@ int main(int argc, char *argv[])
         }
         // Acquired mutex, assume we can proceed with recovery.
         printf("Reloading state from log due to existing SHM...\n");
-        load_state_from_log();      // Reload state from the detailed log.
-        sem_post(&region->dbmutex); // Release the mutex.
+        sem_post(&region->dbmutex); // Release the mutex (restore_state takes it for the free ID queue).
+        restore_state();            // Reload state from snapshot + WAL or the detailed log.
     }
+    // Tellers read the queue mode from SHM, so it must be set before the first fork.
+    ring_init(&region->ring);
+    region->queue_mode = queue_mode;
+    memset(region->teller_idle, 0, sizeof(region->teller_idle));
+    region->pool_unread = 0;
 
     // --- Server FIFO Setup ---
     unlink(server_fifo_path); // Remove any old server FIFO.
@@ -824,6 +1306,14 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    // Pre-fork the Teller pool before the worker threads exist.
+    if (start_teller_pool() != 0 || start_workers() != 0)
+    {
+        stop_teller_pool();
+        cleanup();
+        exit(EXIT_FAILURE);
+    }
+
     printf("Adabank is active….\n");
     printf("Waiting for clients @%s…\n", server_fifo_path);
 
@@ -878,12 +1368,9 @@ int main(int argc, char *argv[])
                     if (first_client_pid_in_batch == -1)
                         first_client_pid_in_batch = current_client_pid;
 
-                    // Spawn a Teller process for this client.
-                    teller_spawn_counter++;                                  // Increment global teller ID counter.
-                    void *teller_arg = (void *)(intptr_t)current_client_pid; // Pass client PID as argument.
-                    pid_t current_teller_pid = Teller(teller_main, teller_arg);
-
-                    if (current_teller_pid != -1)
+                    // Assign a pooled Teller (or spawn one) for this client.
+                    teller_spawn_counter++; // Increment global teller ID counter.
+                    if (assign_client(current_client_pid) == 0)
                     {
                         // Store info for batched logging message.
                         batch_client_pids[clients_in_batch] = current_client_pid;
@@ -933,83 +1420,30 @@ int main(int argc, char *argv[])
             running = 0; // Trigger shutdown.
         }
 
-        // 2. Process Pending Requests from the Shared Memory Queue (Consumer Role).
-        bool processed_item = false; // Track if any work was done in this cycle.
-        // Use sem_trywait for non-blocking check if items are available.
-        while (sem_trywait(&region->items) == 0)
-        {
-            processed_item = true; // We got an item to process.
-            // Check running flag again in case a signal arrived while waiting/polling.
-            if (!running)
-            {
-                sem_post(&region->items); // Put the item back if shutting down.
-                break;
-            }
-
-            // Get mutex to access queue head index.
-            sem_wait(&region->qmutex);
-            int idx = region->head;                            // Index of the request to process.
-            request_t req = region->queue[idx];                // Copy request data locally.
-            region->head = (region->head + 1) % REQ_QUEUE_LEN; // Advance head index.
-            sem_post(&region->qmutex);                         // Release mutex.
-
-            // Signal that a slot is now free in the queue.
-            sem_post(&region->slots);
-
-            // Dispatch request to appropriate processing function.
-            if (req.type == REQ_DEPOSIT)
-                process_deposit(&req, idx);
-            else // REQ_WITHDRAW
-                process_withdraw(&req, idx);
-
-        } // End while sem_trywait (processing items)
-
-        // 3a. Reap Zombie Teller Processes (opportunistic, after processing items).
-        // This helps catch Tellers that finish right after their last request is processed.
-        if (processed_item)
-        { // Only reap if we might have freed up a Teller.
-            int status_reap;
-            pid_t ended_pid;
-            while ((ended_pid = waitpid(-1, &status_reap, WNOHANG)) > 0)
-            {
-                // Optionally log reaped Teller PID here.
-            }
-            if (ended_pid == -1 && errno != ECHILD)
-            { // Check for errors other than "no children".
-                perror("Server waitpid error during post-processing reap");
-            }
-        }
+        // 2. Checkpoint once enough WAL records have accumulated, bounding recovery time.
+        if (wal_records_since_checkpoint() >= WAL_CHECKPOINT_RECORDS && checkpoint_state() != 0)
+            fprintf(stderr, "Server WARN: Periodic checkpoint failed\n");
 
-        // 3b. Reap Zombie Teller Processes (general check in main loop).
+        // 3. Reap Zombie Teller Processes (requests in the SHM queue are handled by the worker threads).
         // This ensures Tellers that exit for other reasons (e.g., client disconnect) are eventually reaped.
         int status_reap_main;
         pid_t ended_pid_main;
         while ((ended_pid_main = waitpid(-1, &status_reap_main, WNOHANG)) > 0)
         {
-            // Optionally log reaped Teller PID here.
+            if (running)
+                respawn_pooled_teller(ended_pid_main);
         }
         if (ended_pid_main == -1 && errno != ECHILD)
         {
             perror("Server waitpid error during main loop reap");
         }
 
-        // 4. Brief sleep if idle to prevent busy-waiting.
-        // Sleep only if no new clients arrived AND no requests were processed in this iteration.
-        if (running && poll_res <= 0 && !processed_item)
-        {
-            int item_count;
-            // Double-check queue is empty before sleeping (sem_trywait might fail for other reasons).
-            if (sem_getvalue(&region->items, &item_count) == 0 && item_count == 0)
-            {
-                struct timespec ts = {0, 5 * 1000 * 1000}; // 5 milliseconds sleep.
-                nanosleep(&ts, NULL);
-            }
-        }
-
     } // End while(running) main loop.
 
     // --- Server Shutdown ---
     printf("Server shutting down...\n");
+    stop_teller_pool(); // Idle pooled Tellers exit on EOF.
+    stop_workers();     // Let in-progress requests finish before SHM is torn down.
 
     // Final non-blocking reap of any remaining zombie Tellers before cleanup.
     int status_final;
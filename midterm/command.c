@@ -0,0 +1,114 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "common.h"
+
+// Parsing of client command lines ("<BankID> <deposit|withdraw> <amount>") into requests.
+// Tellers parse the lines read from a client's request FIFO; --shm clients parse their
+// command file themselves and send the binary requests over their session channel.
+
+/**
+ * @brief Parses a bank ID string provided by the client.
+ *        Accepts "N" (or "BankID_None") for new account, "BankID_X" format, or plain numeric "X".
+ * @param bank_id_str The string to parse.
+ * @return Parsed bank ID (>= 0), -1 for new account request, or -2 for invalid format/value.
+ */
+int parse_bank_id(const char *bank_id_str)
+{
+    int bank_id = -2; // Default to invalid format indicator.
+    if (bank_id_str == NULL)
+        return bank_id;
+
+    // Check for "N" -> New account request.
+    if (strcmp(bank_id_str, "N") == 0 || strcmp(bank_id_str, "BankID_None") == 0)
+    {
+        bank_id = -1; // Special value indicates new account request.
+    }
+    // Check for "BankID_X" format.
+    else if (strncmp(bank_id_str, "BankID_", 7) == 0)
+    {
+        char *e;
+        errno = 0;                                // Reset errno before strtol
+        long v = strtol(bank_id_str + 7, &e, 10); // Parse number after "BankID_".
+        // Check for successful parse, valid range, and no trailing characters.
+        if (errno == 0 && *e == '\0' && v >= 0 && v < MAX_ACCOUNTS)
+            bank_id = (int)v;
+    }
+    // Check for plain numeric format "X".
+    else
+    {
+        char *e;
+        errno = 0;
+        long v = strtol(bank_id_str, &e, 10);
+        // Check for successful parse, valid range, and no trailing characters.
+        if (errno == 0 && *e == '\0' && v >= 0 && v < MAX_ACCOUNTS)
+            bank_id = (int)v;
+    }
+    return bank_id;
+}
+
+/**
+ * @brief Parses one "<BankID> <deposit|withdraw> <amount>" command line into a request.
+ *        Prints a warning describing the problem if the command is invalid.
+ * @param line The command line (newline already stripped).
+ * @param client_pid PID of the client being served.
+ * @param who Prefix of the warnings, e.g. "Teller(PID42)".
+ * @param rq Receives the request on success.
+ * @return 0 if rq is ready to submit, -1 if the command is invalid.
+ */
+int parse_command(const char *line, pid_t client_pid, const char *who, request_t *rq)
+{
+    memset(rq, 0, sizeof(*rq)); // Initialize request struct for SHM.
+    rq->client_pid = client_pid; // Store client PID for server logging.
+
+    char bank_id_str[64] = "", op_str[32] = "", am_str[32] = "";
+    long parsed_amount;
+
+    // Basic parsing of the command line.
+    if (sscanf(line, "%63s %31s %31s", bank_id_str, op_str, am_str) != 3)
+    {
+        fprintf(stderr, "%s WARN: Invalid command format: %s\n", who, line);
+        return -1;
+    }
+
+    // Parse Bank ID string ("N", "BankID_X", "X").
+    rq->bank_id = parse_bank_id(bank_id_str);
+    if (rq->bank_id == -2)
+    { // Handle invalid BankID format.
+        fprintf(stderr, "%s WARN: Invalid BankID format: %s\n", who, bank_id_str);
+        return -1;
+    }
+
+    // Parse Operation Type ("deposit", "withdraw").
+    if (strcmp(op_str, "deposit") == 0)
+        rq->type = REQ_DEPOSIT;
+    else if (strcmp(op_str, "withdraw") == 0)
+        rq->type = REQ_WITHDRAW;
+    else
+    {
+        fprintf(stderr, "%s WARN: Invalid operation type: %s\n", who, op_str);
+        return -1;
+    }
+
+    // Parse Amount (must be a positive integer).
+    char *e;
+    errno = 0;
+    parsed_amount = strtol(am_str, &e, 10);
+    if (errno != 0 || *e != '\0' || parsed_amount <= 0)
+    {
+        fprintf(stderr, "%s WARN: Invalid or non-positive amount: %s\n", who, am_str);
+        return -1;
+    }
+    rq->amount = parsed_amount;
+
+    // Semantic check: Cannot withdraw from a non-existent account ("N").
+    if (rq->bank_id == -1 && rq->type == REQ_WITHDRAW)
+    {
+        fprintf(stderr, "%s WARN: Cannot withdraw from new account request ('N')\n", who);
+        return -1;
+    }
+    return 0;
+}
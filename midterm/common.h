@@ -2,16 +2,33 @@
 #define BANKSIM_COMMON_H
 
 #include <semaphore.h>
+#include <signal.h> // For sig_atomic_t
+#include <stdbool.h>
 #include <stdint.h>
 #include <sys/types.h> // For pid_t
 
 // --- Constants ---
 #define MAX_ACCOUNTS 1024                  // Maximum number of bank accounts supported.
 #define REQ_QUEUE_LEN 64                   // Size of the shared request queue.
+#define QUEUE_FULL (-2)                    // Returned by a non-blocking submit when no slot is free.
 #define SHM_NAME "/adabank_shm"            // Name for the POSIX shared memory segment.
 #define DEFAULT_SERVER_FIFO_NAME "AdaBank" // Default name for the main server FIFO.
 #define LOG_FILE_NAME "AdaBank.bankLog"    // Name of the transaction log file.
+#define WAL_FILE_NAME "AdaBank.wal"        // Binary write-ahead log (durable record of every change).
+#define SNAPSHOT_FILE_NAME "AdaBank.snap"  // Latest balance snapshot; recovery replays the WAL on top of it.
+#define WAL_CHECKPOINT_RECORDS 4096        // WAL records after which the server writes a new snapshot.
+#define JOURNAL_BUFFER_SIZE 65536          // stdio buffer of the text log, shared by the requests of one flush.
 #define ACCOUNT_INACTIVE -1                // Indicates an account slot is not currently in use.
+#define CACHE_LINE_SIZE 64                 // Alignment used to keep hot shared words on separate cache lines.
+#define ACCOUNT_LOCK_STRIPES 64            // Number of balance locks; account i is guarded by stripe i % ACCOUNT_LOCK_STRIPES.
+#define BATCH_MAX_COMMANDS 128             // Most commands a client may send in one "BATCH <count>" block.
+#define DEFAULT_WORKER_THREADS 4           // Request processing threads started by the server by default.
+#define DEFAULT_TELLER_POOL 8              // Pre-forked Tellers waiting for client assignments by default.
+#define MAX_TELLER_POOL 64                 // Largest pool accepted by --tellers=.
+#define TELLER_CONNECT_TIMEOUT_S 5         // Seconds a Teller waits for its client to open the FIFOs.
+#define CHANNEL_SHM_NAME_FMT "/adabank_ch_%d" // Per-session channel of a --shm client, named after its PID.
+#define CHANNEL_RING_LEN 16                // Requests a --shm client may have in flight on its channel.
+#define CHANNEL_ATTACH_TIMEOUT_S 10        // Seconds a --shm client waits for a Teller to map its channel.
 
 // --- Request Type Enum ---
 typedef enum
@@ -28,6 +45,7 @@ typedef struct
     int bank_id;      // Target account ID; -1 signifies a request to create a new account.
     req_type_t type;  // Type of operation: REQ_DEPOSIT or REQ_WITHDRAW.
     long amount;      // Amount to deposit or withdraw (must be positive).
+    int answer_slot;  // Answer slot the server replies through (QUEUE_MODE_SEM); set by push_request.
 
     // --- Server Response Fields (updated in place) ---
     long result_balance; // Balance after the operation completes (or relevant value on error).
@@ -36,6 +54,67 @@ typedef struct
 
 } request_t;
 
+// --- Request Queue Modes ---
+typedef enum
+{
+    QUEUE_MODE_SEM = 0,  // Circular buffer guarded by the slots/items/qmutex semaphores (default).
+    QUEUE_MODE_FUTEX = 1 // Lock-free request_ring_t; waiting falls back to futexes only when needed.
+} queue_mode_t;
+
+// --- Lock-Free Request Ring Slot ---
+// One request per cache line so Tellers publishing into neighbouring slots do not false-share.
+typedef struct
+{
+    uint32_t seq;        // Slot sequence: ticket = free, ticket + 1 = published, ticket + REQ_QUEUE_LEN = free next lap.
+    uint32_t resp_state; // Futex word: RING_RESP_PENDING, RING_RESP_READY or RING_RESP_SLEEPING.
+    request_t req;       // Request written by the Teller, response fields filled in by the server.
+} __attribute__((aligned(CACHE_LINE_SIZE))) ring_slot_t;
+
+// --- Lock-Free Request Ring (used when queue_mode == QUEUE_MODE_FUTEX) ---
+// Tellers claim tickets with a CAS on enqueue_pos; server consumers claim with a CAS on dequeue_pos.
+// A slot is handed back to producers by the Teller once it has read its response, so the
+// response fields stay valid until they are consumed.
+typedef struct
+{
+    uint32_t enqueue_pos __attribute__((aligned(CACHE_LINE_SIZE))); // Next ticket handed to a Teller.
+    uint32_t dequeue_pos __attribute__((aligned(CACHE_LINE_SIZE))); // Next ticket taken by the server.
+    uint32_t doorbell __attribute__((aligned(CACHE_LINE_SIZE)));    // Futex word bumped to wake sleeping consumers.
+    uint32_t consumers_waiting;                                     // Consumers blocked (or about to block) on doorbell.
+    uint32_t producers_waiting;                                     // Tellers blocked on a full ring.
+    ring_slot_t slots[REQ_QUEUE_LEN];
+} request_ring_t;
+
+// --- Per-Session Channel Slot ---
+typedef struct
+{
+    request_t req; // Written by the client, response fields filled in by the Teller.
+} __attribute__((aligned(CACHE_LINE_SIZE))) channel_slot_t;
+
+// --- Per-Session Channel (bank_client --shm) ---
+// Single-producer/single-consumer ring between one client and its Teller, mapped instead
+// of the request/response FIFOs. Requests and answers travel as binary request_t; ticket
+// T uses slot T % CHANNEL_RING_LEN, and the client reuses a slot only after reading its answer.
+typedef struct
+{
+    uint32_t submitted __attribute__((aligned(CACHE_LINE_SIZE))); // Futex word: requests published by the client.
+    uint32_t client_done;                                         // Set by the client after its last request.
+    uint32_t teller_waiting;                                      // Teller blocked (or about to block) on submitted.
+    uint32_t answered __attribute__((aligned(CACHE_LINE_SIZE)));  // Futex word: requests answered by the Teller.
+    uint32_t attached;                                            // Futex word: set once a Teller mapped the channel.
+    uint32_t teller_done;                                         // Set by the Teller when it stops serving.
+    uint32_t client_waiting;                                      // Client blocked on answered or attached.
+    pid_t client_pid;                                             // Client that created the channel.
+    pid_t teller_pid;                                             // Teller serving the channel, valid once attached.
+    channel_slot_t slots[CHANNEL_RING_LEN];
+} session_channel_t;
+
+// --- Account Lock Stripe ---
+// Padded so that threads working on neighbouring stripes do not bounce the same cache line.
+typedef struct
+{
+    sem_t lock; // Guards balances[i] (and its log entry order) for every account i in this stripe.
+} __attribute__((aligned(CACHE_LINE_SIZE))) account_lock_t;
+
 // --- Shared Memory Region Layout ---
 typedef struct
 {
@@ -51,15 +130,43 @@ typedef struct
 
     // Database Semaphores & Data
     sem_t logmutex;               // Mutex protecting access to the log file.
-    sem_t dbmutex;               // Mutex protecting access to the 'balances' array and 'next_id'.
+    sem_t dbmutex;               // Mutex protecting the free account ID queue (free_ids/free_head/free_count).
     long balances[MAX_ACCOUNTS]; // Array storing account balances; ACCOUNT_INACTIVE indicates unused slot.
-    int next_id;                 // Hint for the server when searching for the next free account ID.
+    int next_id;                 // Highest recovered account ID + 1; the free ID queue starts here.
+    account_lock_t account_locks[ACCOUNT_LOCK_STRIPES]; // Striped balance locks, see ACCOUNT_LOCK_STRIPES.
+    int free_ids[MAX_ACCOUNTS];  // Circular FIFO of inactive account IDs, handed out in order.
+    int free_head;               // Index of the next ID to hand out in free_ids.
+    int free_count;              // Number of IDs currently queued in free_ids.
 
-    // Response Semaphores
-    sem_t resp_ready[REQ_QUEUE_LEN]; // Array of semaphores; server posts resp_ready[i] when request in queue[i] is processed. Teller waits on the corresponding semaphore.
+    // Answer Slots
+    // A queue slot is free again as soon as the server has copied the request out, but the
+    // Teller may read its answer much later (batches keep several requests in flight), so
+    // answers live in slots of their own that the Teller takes before pushing and returns
+    // once it has read the answer.
+    request_t answers[REQ_QUEUE_LEN];  // answers[i]: response fields of the request owning answer slot i.
+    int answer_free[REQ_QUEUE_LEN];    // Stack of unused answer slot indices, guarded by qmutex.
+    int answer_free_count;             // Number of indices in answer_free.
+    sem_t answer_slots;                // Counts unused answer slots. Tellers wait on this before pushing.
+    sem_t resp_ready[REQ_QUEUE_LEN];   // Server posts resp_ready[i] once answers[i] holds the response. Teller waits on the corresponding semaphore.
+
+    // Lock-Free Queue Alternative
+    int queue_mode;      // queue_mode_t selected by the server at startup; Tellers follow it.
+    request_ring_t ring; // Request ring used instead of queue/slots/items/qmutex/resp_ready in QUEUE_MODE_FUTEX.
+
+    // Teller Pool
+    int teller_idle[MAX_TELLER_POOL]; // 1 while the pooled Teller of that pool slot waits on the control pipe. Set and cleared by the Teller; the server clears the slot of a Teller that exited.
+    int pool_unread;                  // Client PIDs in the control pipe not yet taken by a pooled Teller. The server increments it, Tellers decrement it.
 
 } shm_region_t;
 
+// --- Pooled Teller Argument ---
+// Passed by pointer to teller_pool_main; the forked Teller reads its own copy.
+typedef struct
+{
+    int ctl_fd; // Read end of the server's control pipe.
+    int slot;   // Pool slot of the Teller (index into teller_idle).
+} teller_pool_arg_t;
+
 // --- Teller Function Type ---
 // Signature for the function executed by a Teller process.
 typedef void *(*teller_main_func_t)(void *);
@@ -70,4 +177,79 @@ pid_t Teller(void *func, void *arg_func);
 // Function to wait for a specific Teller process to terminate.
 int waitTeller(pid_t pid, int *status);
 
+// --- Teller Entry Points (teller.c) ---
+// Serves the single client whose PID is passed as arg, then returns.
+void *teller_main(void *arg);
+// Pooled Teller: serves one client per PID read from the control pipe, until EOF. arg is a teller_pool_arg_t *.
+void *teller_pool_main(void *arg);
+
+// --- Request Ring Functions (shm_ring.c) ---
+// Prepares an empty ring; must run before any Teller attaches.
+void ring_init(request_ring_t *ring);
+// Teller side: publishes a request and returns its slot index, QUEUE_FULL if the ring is full and
+// wait is false, or -1 if keep_running was cleared.
+int ring_push(request_ring_t *ring, const request_t *src, bool wait, const volatile sig_atomic_t *keep_running);
+// Teller side: waits for the server's answer in slot idx, copies it to out and frees the slot. Returns 0 or -1.
+int ring_wait_response(request_ring_t *ring, int idx, request_t *out, const volatile sig_atomic_t *keep_running);
+// Server side: takes the oldest published request without blocking. Returns its slot index, or -1 if empty.
+int ring_pop(request_ring_t *ring, request_t *out);
+// Server side: sleeps until a request may be available or timeout_ms elapses.
+void ring_wait_for_requests(request_ring_t *ring, int timeout_ms);
+// Server side: stores the response fields of resp in slot idx and wakes its Teller.
+void ring_complete(request_ring_t *ring, int idx, const request_t *resp);
+// Server side: wakes all consumers sleeping in ring_wait_for_requests (used at shutdown).
+void ring_wake_consumers(request_ring_t *ring);
+
+// --- Per-Session Channel Functions (shm_ring.c) ---
+// Client side: creates and maps the channel named after client_pid, replacing a stale one. Returns NULL on error.
+session_channel_t *channel_create(pid_t client_pid);
+// Client side: waits up to CHANNEL_ATTACH_TIMEOUT_S for a Teller to attach. Returns 0, or -1 on timeout.
+int channel_wait_attached(session_channel_t *ch);
+// Client side: publishes a request and returns its ticket. At most CHANNEL_RING_LEN may be unanswered.
+uint32_t channel_submit(session_channel_t *ch, const request_t *rq);
+// Client side: waits for the answer to ticket and copies it to out. Returns 0, or -1 if the Teller is gone.
+int channel_wait_answer(session_channel_t *ch, uint32_t ticket, request_t *out);
+// Client side: tells the Teller no more requests will follow.
+void channel_close_client(session_channel_t *ch);
+// Teller side: maps the channel of client_pid and announces the Teller. Returns NULL (errno ENOENT) if there is none.
+session_channel_t *channel_attach(pid_t client_pid);
+// Teller side: waits until requests beyond ticket next are published; *end receives the first unpublished ticket.
+// Returns 0, or -1 once the client is done or gone, or keep_running was cleared.
+int channel_wait_requests(session_channel_t *ch, uint32_t next, uint32_t *end, const volatile sig_atomic_t *keep_running);
+// Teller side: stores the answer for ticket (answers are given in ticket order) and wakes the client.
+void channel_answer(session_channel_t *ch, uint32_t ticket, const request_t *resp);
+// Teller side: tells the client no more answers will follow.
+void channel_close_teller(session_channel_t *ch);
+// Removes the name of client_pid's channel; existing mappings stay valid.
+void channel_unlink(pid_t client_pid);
+// Unmaps a channel returned by channel_create or channel_attach.
+void channel_unmap(session_channel_t *ch);
+
+// --- Command Parsing Functions (command.c) ---
+// Parses "N", "BankID_X" or "X". Returns the ID, -1 for a new account, or -2 if invalid.
+int parse_bank_id(const char *bank_id_str);
+// Parses "<BankID> <deposit|withdraw> <amount>" into rq, warning on stderr as "<who> WARN: ...". Returns 0 or -1.
+int parse_command(const char *line, pid_t client_pid, const char *who, request_t *rq);
+
+// --- Write-Ahead Log Functions (wal.c, server only) ---
+// Opens (or creates) the WAL file. Returns 0 or -1.
+int wal_open(const char *path);
+// Closes the WAL file.
+void wal_close();
+// Loads the snapshot and replays the WAL tail into balances. Returns 1 if state was found, 0 if none.
+int wal_recover(const char *snapshot_path, long *balances, int *next_id, long *replayed);
+// Queues a record for the next group commit and returns its LSN (caller holds the account's lock stripe).
+uint64_t wal_append(int type, int id, long amount, long balance);
+// Waits until the record with this LSN is on disk, syncing a whole group if no one else is.
+// Returns 0, or -1 once a group commit at or before this LSN has failed (sticky until restart).
+int wal_wait_durable(uint64_t lsn);
+// True once a group commit has failed: no later change can become durable until restart.
+bool wal_failed();
+// Number of WAL records appended since the last checkpoint.
+uint64_t wal_records_since_checkpoint();
+// Records written and fdatasync calls issued so far.
+void wal_stats(uint64_t *records, uint64_t *syncs);
+// Writes a snapshot of balances (which must not change meanwhile) and empties the WAL. Returns 0 or -1.
+int wal_checkpoint(const char *snapshot_path, const long *balances, int next_id);
+
 #endif // BANKSIM_COMMON_H
\ No newline at end of file
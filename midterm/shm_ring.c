@@ -0,0 +1,534 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>  // For INT_MAX
+#include <stdbool.h> // For bool type
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "common.h"
+
+// Lock-free request ring shared by the server and its Tellers (QUEUE_MODE_FUTEX).
+// Every slot carries a sequence number (bounded MPMC queue in the style of Vyukov):
+// a Teller owning ticket T may fill slot T % REQ_QUEUE_LEN once seq == T, publishes it
+// by storing seq = T + 1, and frees it for the next lap (seq = T + REQ_QUEUE_LEN) after
+// reading the response. Blocking only happens through futexes, and only when the other
+// side has advertised that it is asleep, so an uncontended round-trip makes no syscalls.
+//
+// The per-session channels of --shm clients use the same spin-then-futex waits on a
+// simpler single-producer/single-consumer ring: the client advances 'submitted', its
+// Teller advances 'answered', and each side only wakes the other if it is asleep.
+
+#define RING_RESP_PENDING 0  // Server has not answered yet.
+#define RING_RESP_READY 1    // Response fields are valid.
+#define RING_RESP_SLEEPING 2 // Teller is blocked in FUTEX_WAIT and needs a wake-up.
+
+#define RING_SPIN_LIMIT 256      // Polls before falling back to FUTEX_WAIT.
+#define RING_WAIT_SLICE_MS 100   // Futex sleeps are bounded so shutdown flags are re-checked.
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ring_cpu_relax() __builtin_ia32_pause()
+#else
+#define ring_cpu_relax() __atomic_signal_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/**
+ * @brief FUTEX_WAIT on a word in shared memory (not FUTEX_PRIVATE: the ring is
+ *        mapped by several processes).
+ * @param addr Futex word.
+ * @param expected Value the caller last observed; the call returns at once if it changed.
+ * @param timeout_ms Relative timeout in milliseconds.
+ */
+static void futex_wait(uint32_t *addr, uint32_t expected, int timeout_ms)
+{
+    struct timespec ts = {timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000L};
+    if (syscall(SYS_futex, addr, FUTEX_WAIT, expected, &ts, NULL, 0) == -1 &&
+        errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT)
+        perror("ring futex wait");
+}
+
+/**
+ * @brief FUTEX_WAKE on a word in shared memory.
+ * @param addr Futex word.
+ * @param count Maximum number of waiters to wake.
+ */
+static void futex_wake(uint32_t *addr, int count)
+{
+    if (syscall(SYS_futex, addr, FUTEX_WAKE, count, NULL, NULL, 0) == -1)
+        perror("ring futex wake");
+}
+
+/**
+ * @brief Initializes an empty ring: slot i is free for ticket i.
+ * @param ring The ring inside the shared memory region.
+ */
+void ring_init(request_ring_t *ring)
+{
+    memset(ring, 0, sizeof(*ring));
+    for (uint32_t i = 0; i < REQ_QUEUE_LEN; ++i)
+        ring->slots[i].seq = i;
+}
+
+/**
+ * @brief Claims a ticket, copies the request into its slot and publishes it.
+ *        Waits (spin, then futex) while the ring is full, unless wait is false.
+ * @param ring The shared ring.
+ * @param src Request to submit.
+ * @param wait Whether to wait for a full ring to drain. A Teller that still has answers to
+ *        read must not wait: the slot it needs may be the one holding its own answer.
+ * @param keep_running Flag checked while waiting; the push is abandoned once it is cleared.
+ * @return The slot index used, QUEUE_FULL if the ring is full and wait is false, or -1 on shutdown.
+ */
+int ring_push(request_ring_t *ring, const request_t *src, bool wait, const volatile sig_atomic_t *keep_running)
+{
+    ring_slot_t *slot;
+    uint32_t pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    int spins = 0;
+
+    for (;;)
+    {
+        slot = &ring->slots[pos % REQ_QUEUE_LEN];
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(seq - pos);
+
+        if (diff == 0)
+        {
+            // Slot is free for this ticket; try to take the ticket.
+            if (__atomic_compare_exchange_n(&ring->enqueue_pos, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+            continue; // pos was reloaded by the failed CAS.
+        }
+        if (diff > 0)
+        {
+            // Another Teller took this ticket first.
+            pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        // Ring full: the slot still belongs to the previous lap.
+        if (!*keep_running)
+            return -1;
+        if (!wait)
+            return QUEUE_FULL;
+        if (++spins < RING_SPIN_LIMIT)
+        {
+            ring_cpu_relax();
+        }
+        else
+        {
+            __atomic_fetch_add(&ring->producers_waiting, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_SEQ_CST) == seq)
+                futex_wait(&slot->seq, seq, RING_WAIT_SLICE_MS);
+            __atomic_fetch_sub(&ring->producers_waiting, 1, __ATOMIC_SEQ_CST);
+            spins = 0;
+        }
+        pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    }
+
+    slot->req = *src;
+    __atomic_store_n(&slot->resp_state, RING_RESP_PENDING, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_SEQ_CST); // Publish.
+
+    // Ring the doorbell only if a consumer said it is going to sleep.
+    if (__atomic_load_n(&ring->consumers_waiting, __ATOMIC_SEQ_CST) != 0)
+    {
+        __atomic_fetch_add(&ring->doorbell, 1, __ATOMIC_SEQ_CST);
+        futex_wake(&ring->doorbell, 1);
+    }
+    return (int)(pos % REQ_QUEUE_LEN);
+}
+
+/**
+ * @brief Waits for the server to answer the request in slot idx, copies the
+ *        slot (with response fields) to out and hands the slot back to producers.
+ * @param ring The shared ring.
+ * @param idx Slot index returned by ring_push.
+ * @param out Receives the answered request.
+ * @param keep_running Flag checked while sleeping. If it is cleared the slot is
+ *        abandoned (only expected during shutdown).
+ * @return 0 on success, -1 if abandoned.
+ */
+int ring_wait_response(request_ring_t *ring, int idx, request_t *out, const volatile sig_atomic_t *keep_running)
+{
+    ring_slot_t *slot = &ring->slots[idx];
+
+    for (int spins = 0; __atomic_load_n(&slot->resp_state, __ATOMIC_ACQUIRE) != RING_RESP_READY; ++spins)
+    {
+        if (spins < RING_SPIN_LIMIT)
+        {
+            ring_cpu_relax();
+            continue;
+        }
+        // Tell the server we are going to sleep; if it answered meanwhile the CAS fails.
+        uint32_t expected = RING_RESP_PENDING;
+        if (__atomic_compare_exchange_n(&slot->resp_state, &expected, RING_RESP_SLEEPING, false,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ||
+            expected == RING_RESP_SLEEPING)
+        {
+            futex_wait(&slot->resp_state, RING_RESP_SLEEPING, RING_WAIT_SLICE_MS);
+            if (!*keep_running && __atomic_load_n(&slot->resp_state, __ATOMIC_ACQUIRE) != RING_RESP_READY)
+                return -1;
+        }
+    }
+
+    *out = slot->req;
+
+    // Free the slot for the ticket one lap ahead (seq is ticket + 1 while in use).
+    uint32_t next_seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) - 1 + REQ_QUEUE_LEN;
+    __atomic_store_n(&slot->seq, next_seq, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->producers_waiting, __ATOMIC_SEQ_CST) != 0)
+        futex_wake(&slot->seq, INT_MAX);
+    return 0;
+}
+
+/**
+ * @brief Takes the oldest published request, if any. Safe for several consumer threads.
+ * @param ring The shared ring.
+ * @param out Receives a copy of the request.
+ * @return The slot index (pass it to ring_complete), or -1 if nothing is published.
+ */
+int ring_pop(request_ring_t *ring, request_t *out)
+{
+    uint32_t pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+    for (;;)
+    {
+        ring_slot_t *slot = &ring->slots[pos % REQ_QUEUE_LEN];
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t)(seq - (pos + 1));
+
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&ring->dequeue_pos, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                *out = slot->req;
+                return (int)(pos % REQ_QUEUE_LEN);
+            }
+        }
+        else if (diff < 0)
+        {
+            return -1; // Not published yet: ring empty.
+        }
+        else
+        {
+            pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/**
+ * @brief Blocks the calling consumer until a Teller publishes a request or the timeout expires.
+ *        Returns immediately if a request is already waiting.
+ * @param ring The shared ring.
+ * @param timeout_ms Upper bound on the sleep, in milliseconds.
+ */
+void ring_wait_for_requests(request_ring_t *ring, int timeout_ms)
+{
+    uint32_t bell = __atomic_load_n(&ring->doorbell, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&ring->consumers_waiting, 1, __ATOMIC_SEQ_CST);
+
+    // Re-check after advertising: a Teller that published before seeing our counter
+    // left its request in the ring, one that publishes afterwards bumps the doorbell.
+    uint32_t pos = __atomic_load_n(&ring->dequeue_pos, __ATOMIC_SEQ_CST);
+    uint32_t seq = __atomic_load_n(&ring->slots[pos % REQ_QUEUE_LEN].seq, __ATOMIC_SEQ_CST);
+    if (seq != pos + 1)
+        futex_wait(&ring->doorbell, bell, timeout_ms);
+
+    __atomic_fetch_sub(&ring->consumers_waiting, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Publishes the server's answer for slot idx and wakes its Teller if it sleeps.
+ * @param ring The shared ring.
+ * @param idx Slot index returned by ring_pop.
+ * @param resp Request whose response fields (bank_id, result_balance, op_status) are copied.
+ */
+void ring_complete(request_ring_t *ring, int idx, const request_t *resp)
+{
+    ring_slot_t *slot = &ring->slots[idx];
+    slot->req.bank_id = resp->bank_id;
+    slot->req.result_balance = resp->result_balance;
+    slot->req.op_status = resp->op_status;
+
+    if (__atomic_exchange_n(&slot->resp_state, RING_RESP_READY, __ATOMIC_ACQ_REL) == RING_RESP_SLEEPING)
+        futex_wake(&slot->resp_state, 1);
+}
+
+/**
+ * @brief Wakes every consumer sleeping in ring_wait_for_requests.
+ * @param ring The shared ring.
+ */
+void ring_wake_consumers(request_ring_t *ring)
+{
+    __atomic_fetch_add(&ring->doorbell, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&ring->doorbell, INT_MAX);
+}
+
+
+// --- Per-Session Channel ---
+
+/**
+ * @brief Builds the shared memory name of a client's channel.
+ * @param name Output buffer.
+ * @param size Size of name.
+ * @param client_pid PID of the client owning the channel.
+ */
+static void channel_name(char *name, size_t size, pid_t client_pid)
+{
+    snprintf(name, size, CHANNEL_SHM_NAME_FMT, client_pid);
+}
+
+/**
+ * @brief Returns how many polls a channel wait makes before sleeping. On a single CPU
+ *        the other side cannot run while we spin, so the wait sleeps at once.
+ */
+static int channel_spin_limit()
+{
+    static int limit = -1; // Same value in every thread, so the unsynchronized cache is harmless.
+    if (limit == -1)
+        limit = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? RING_SPIN_LIMIT : 0;
+    return limit;
+}
+
+/**
+ * @brief Stores a new value in a channel counter and wakes the other side if it sleeps on it.
+ * @param counter Futex word (submitted, answered or attached).
+ * @param value New value.
+ * @param waiting Sleep counter of the side waiting on counter.
+ */
+static void channel_advance(uint32_t *counter, uint32_t value, uint32_t *waiting)
+{
+    __atomic_store_n(counter, value, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST) != 0)
+        futex_wake(counter, 1);
+}
+
+/**
+ * @brief Waits until a channel counter has moved past target. Spins first (see
+ *        channel_spin_limit), then sleeps on the counter in RING_WAIT_SLICE_MS slices,
+ *        checking between slices whether the other side has stopped or exited.
+ * @param counter Futex word advanced by the other side.
+ * @param waiting Sleep counter the other side reads before waking us.
+ * @param target The wait ends once *counter is beyond this value.
+ * @param peer_done Flag the other side sets when it stops, or NULL.
+ * @param peer_pid Process on the other side, or 0 if not known yet.
+ * @param keep_running Flag cleared on shutdown, or NULL.
+ * @param timeout_ms Upper bound on the wait, or -1 for none.
+ * @return 0 once the counter moved, -1 if the other side is gone, on shutdown or on timeout.
+ */
+static int channel_wait_past(uint32_t *counter, uint32_t *waiting, uint32_t target, const uint32_t *peer_done,
+                             pid_t peer_pid, const volatile sig_atomic_t *keep_running, int timeout_ms)
+{
+    int slept_ms = 0;
+    int spin_limit = channel_spin_limit();
+    for (int spins = 0;; ++spins)
+    {
+        uint32_t seen = __atomic_load_n(counter, __ATOMIC_ACQUIRE);
+        if ((int32_t)(seen - target) > 0)
+            return 0;
+        if (spins < spin_limit)
+        {
+            ring_cpu_relax();
+            continue;
+        }
+
+        // The other side sets its done flag after its last counter update, so a set flag
+        // means the counter is final.
+        if (peer_done && __atomic_load_n(peer_done, __ATOMIC_SEQ_CST))
+            return ((int32_t)(__atomic_load_n(counter, __ATOMIC_SEQ_CST) - target) > 0) ? 0 : -1;
+        if (keep_running && !*keep_running)
+            return -1;
+        if (peer_pid > 0 && kill(peer_pid, 0) == -1 && errno == ESRCH)
+            return -1; // Exited without closing the channel (e.g. killed).
+        if (timeout_ms >= 0 && slept_ms >= timeout_ms)
+            return -1;
+
+        __atomic_fetch_add(waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(counter, __ATOMIC_SEQ_CST) == seen)
+            futex_wait(counter, seen, RING_WAIT_SLICE_MS);
+        __atomic_fetch_sub(waiting, 1, __ATOMIC_SEQ_CST);
+        slept_ms += RING_WAIT_SLICE_MS;
+    }
+}
+
+/**
+ * @brief Creates and maps the channel of a client. A channel left behind under the same
+ *        name (by an earlier process with this PID) is replaced.
+ * @param client_pid PID of the calling client.
+ * @return The zero-initialized channel, or NULL on error (errno set).
+ */
+session_channel_t *channel_create(pid_t client_pid)
+{
+    char name[64];
+    channel_name(name, sizeof(name), client_pid);
+    shm_unlink(name);
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1)
+        return NULL;
+    if (ftruncate(fd, sizeof(session_channel_t)) == -1) // Zero-fills the new object.
+    {
+        int saved = errno;
+        close(fd);
+        shm_unlink(name);
+        errno = saved;
+        return NULL;
+    }
+    session_channel_t *ch = mmap(NULL, sizeof(session_channel_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ch == MAP_FAILED)
+    {
+        int saved = errno;
+        shm_unlink(name);
+        errno = saved;
+        return NULL;
+    }
+    ch->client_pid = client_pid;
+    return ch;
+}
+
+/**
+ * @brief Waits until a Teller has mapped the channel.
+ * @param ch The client's channel.
+ * @return 0 once attached, -1 after CHANNEL_ATTACH_TIMEOUT_S.
+ */
+int channel_wait_attached(session_channel_t *ch)
+{
+    return channel_wait_past(&ch->attached, &ch->client_waiting, 0, NULL, 0, NULL,
+                             CHANNEL_ATTACH_TIMEOUT_S * 1000);
+}
+
+/**
+ * @brief Copies a request into the next slot and publishes it. The caller must have read
+ *        the answer of the request CHANNEL_RING_LEN tickets back, which used the same slot.
+ * @param ch The client's channel.
+ * @param rq Request to submit.
+ * @return The request's ticket, to pass to channel_wait_answer.
+ */
+uint32_t channel_submit(session_channel_t *ch, const request_t *rq)
+{
+    uint32_t ticket = __atomic_load_n(&ch->submitted, __ATOMIC_RELAXED); // Only the client writes it.
+    ch->slots[ticket % CHANNEL_RING_LEN].req = *rq;
+    channel_advance(&ch->submitted, ticket + 1, &ch->teller_waiting);
+    return ticket;
+}
+
+/**
+ * @brief Waits for the Teller's answer to a request.
+ * @param ch The client's channel.
+ * @param ticket Ticket returned by channel_submit.
+ * @param out Receives the request with its response fields filled in.
+ * @return 0 on success, -1 if the Teller stopped or exited first.
+ */
+int channel_wait_answer(session_channel_t *ch, uint32_t ticket, request_t *out)
+{
+    if (channel_wait_past(&ch->answered, &ch->client_waiting, ticket, &ch->teller_done,
+                          ch->teller_pid, NULL, -1) != 0)
+        return -1;
+    *out = ch->slots[ticket % CHANNEL_RING_LEN].req;
+    return 0;
+}
+
+/**
+ * @brief Tells the Teller that the client will not submit any more requests.
+ * @param ch The client's channel.
+ */
+void channel_close_client(session_channel_t *ch)
+{
+    __atomic_store_n(&ch->client_done, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&ch->submitted, 1);
+}
+
+/**
+ * @brief Maps the channel of a client and tells the client which Teller serves it.
+ * @param client_pid PID announced by the client.
+ * @return The channel, or NULL if the client has none (errno ENOENT) or on error.
+ */
+session_channel_t *channel_attach(pid_t client_pid)
+{
+    char name[64];
+    channel_name(name, sizeof(name), client_pid);
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd == -1)
+        return NULL;
+    session_channel_t *ch = mmap(NULL, sizeof(session_channel_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ch == MAP_FAILED)
+        return NULL;
+
+    ch->teller_pid = getpid();
+    channel_advance(&ch->attached, 1, &ch->client_waiting); // Publishes teller_pid as well.
+    return ch;
+}
+
+/**
+ * @brief Waits until the client has published requests beyond the ones already taken.
+ * @param ch The Teller's channel.
+ * @param next First ticket the Teller has not taken yet.
+ * @param end Receives the first ticket not published yet.
+ * @param keep_running Flag checked while sleeping.
+ * @return 0 if tickets next .. *end - 1 are ready, -1 once the client is done or gone,
+ *         or keep_running was cleared.
+ */
+int channel_wait_requests(session_channel_t *ch, uint32_t next, uint32_t *end, const volatile sig_atomic_t *keep_running)
+{
+    if (channel_wait_past(&ch->submitted, &ch->teller_waiting, next, &ch->client_done,
+                          ch->client_pid, keep_running, -1) != 0)
+        return -1;
+    *end = __atomic_load_n(&ch->submitted, __ATOMIC_ACQUIRE);
+    return 0;
+}
+
+/**
+ * @brief Stores the response fields for a ticket and wakes the client if it sleeps.
+ * @param ch The Teller's channel.
+ * @param ticket The ticket answered; must be the oldest unanswered one.
+ * @param resp Request whose response fields (bank_id, result_balance, op_status) are copied.
+ */
+void channel_answer(session_channel_t *ch, uint32_t ticket, const request_t *resp)
+{
+    request_t *slot = &ch->slots[ticket % CHANNEL_RING_LEN].req;
+    slot->bank_id = resp->bank_id;
+    slot->result_balance = resp->result_balance;
+    slot->op_status = resp->op_status;
+    channel_advance(&ch->answered, ticket + 1, &ch->client_waiting);
+}
+
+/**
+ * @brief Tells the client that no more answers will follow.
+ * @param ch The Teller's channel.
+ */
+void channel_close_teller(session_channel_t *ch)
+{
+    __atomic_store_n(&ch->teller_done, 1, __ATOMIC_SEQ_CST);
+    futex_wake(&ch->answered, 1);
+}
+
+/**
+ * @brief Removes the name of a client's channel. Mappings stay valid until unmapped.
+ * @param client_pid PID of the client owning the channel.
+ */
+void channel_unlink(pid_t client_pid)
+{
+    char name[64];
+    channel_name(name, sizeof(name), client_pid);
+    shm_unlink(name);
+}
+
+/**
+ * @brief Unmaps a channel.
+ * @param ch The channel, or NULL.
+ */
+void channel_unmap(session_channel_t *ch)
+{
+    if (ch != NULL)
+        munmap(ch, sizeof(session_channel_t));
+}
@@ -21,6 +21,7 @@
 // --- Static Variables ---
 static shm_region_t *region = NULL;              // Pointer to the mapped shared memory region.
 static volatile sig_atomic_t teller_running = 1; // Flag to control the main teller loop, set by signal handler.
+static volatile sig_atomic_t teller_stop = 0;    // Set only by the signal handler; a pooled Teller exits instead of taking the next client.
 
 // --- Signal Handler for Teller ---
 /**
@@ -31,6 +32,34 @@ static void teller_sig_handler(int signo)
 {
     (void)signo;        // Unused parameter.
     teller_running = 0; // Signal the main loop to terminate.
+    teller_stop = 1;
+}
+
+/**
+ * @brief SIGALRM handler. Installed without SA_RESTART, so it only makes a FIFO
+ *        open blocked on a vanished client fail with EINTR.
+ */
+static void teller_alarm_handler(int signo)
+{
+    (void)signo; // Unused parameter.
+}
+
+/**
+ * @brief Installs the Teller's signal handlers.
+ */
+static void setup_teller_signals()
+{
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = teller_sig_handler; // Use Teller-specific handler.
+    sa.sa_flags = SA_RESTART;           // Restart syscalls if possible after signal.
+    sigaction(SIGINT, &sa, NULL);       // Handle SIGINT (e.g., Ctrl+C on server).
+    sigaction(SIGTERM, &sa, NULL);      // Handle SIGTERM from server shutdown.
+    signal(SIGPIPE, SIG_IGN);           // Ignore SIGPIPE if client closes read end of response FIFO.
+
+    sa.sa_handler = teller_alarm_handler;
+    sa.sa_flags = 0; // Interrupt the blocking FIFO opens.
+    sigaction(SIGALRM, &sa, NULL);
 }
 
 // --- SHM Management ---
@@ -75,199 +104,522 @@ static void detach_shm()
 }
 
 // --- Request Queue Interaction ---
+/**
+ * @brief Waits on a queue semaphore, retrying after signals while the Teller keeps running.
+ * @param sem The semaphore.
+ * @param what Name used in the error message.
+ * @return 0 once acquired, -1 on shutdown or semaphore error.
+ */
+static int wait_queue_sem(sem_t *sem, const char *what)
+{
+    while (sem_wait(sem) == -1)
+    {
+        if (errno == EINTR && teller_running)
+            continue; // Interrupted, but still running: retry.
+        if (teller_running)
+        {
+            char msg[64];
+            snprintf(msg, sizeof(msg), "Teller sem_wait(%s)", what);
+            perror(msg);
+        }
+        return -1;
+    }
+    if (!teller_running)
+    {
+        sem_post(sem); // Signaled after acquiring it: give it back and exit.
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Hands an answer slot back once its answer has been read.
+ * @param answer_idx The slot returned by push_request.
+ */
+static void release_answer_slot(int answer_idx)
+{
+    // The slot must not leak, so signals do not abandon this wait.
+    while (sem_wait(&region->qmutex) == -1 && errno == EINTR)
+        ;
+    region->answer_free[region->answer_free_count++] = answer_idx;
+    sem_post(&region->qmutex);
+    sem_post(&region->answer_slots);
+}
+
 /**
  * @brief Pushes a client request onto the shared memory request queue for the server.
- *        Handles synchronization using semaphores (slots, items, qmutex).
+ *        Takes an answer slot first, then a queue slot; synchronization uses the
+ *        answer_slots, slots, items and qmutex semaphores.
  *        Checks the 'teller_running' flag to allow graceful exit if signaled.
  * @param src Pointer to the request_t structure to be pushed.
- * @return The index (slot_idx) in the queue where the request was placed, or -1 on failure or shutdown.
+ * @param wait Whether to wait for an answer slot. A Teller that still has answers to read
+ *        must not wait, since every slot may be held by unread answers, some of them its own.
+ * @return The answer slot to wait on, QUEUE_FULL if none is free and wait is false,
+ *         or -1 on failure or shutdown.
  */
-static int push_request(const request_t *src)
+static int push_request(const request_t *src, bool wait)
 {
     if (!region)
         return -1; // SHM must be attached.
 
-    int idx = -1; // Index where request is placed.
-
-    // 1. Wait for an empty slot in the queue.
-    // Loop handles EINTR in case sem_wait is interrupted by a signal.
-    while (sem_wait(&region->slots) == -1)
+    // 1. Take an answer slot. Every queued request owns one, so the queue never holds more
+    //    than REQ_QUEUE_LEN requests and the wait for a queue slot below is short.
+    if (!wait)
     {
-        if (errno == EINTR && teller_running)
-            continue; // Interrupted, but still running: retry.
-        if (!teller_running)
-            return -1; // Interrupted and should exit.
-        perror("Teller sem_wait(slots)");
-        return -1; // Other semaphore error.
+        if (sem_trywait(&region->answer_slots) == -1)
+        {
+            if (errno == EAGAIN)
+                return QUEUE_FULL;
+            perror("Teller sem_trywait(answer_slots)");
+            return -1;
+        }
     }
+    else if (wait_queue_sem(&region->answer_slots, "answer_slots") != 0)
+        return -1;
 
-    // If signaled *after* acquiring a slot, release the slot and exit.
-    if (!teller_running)
+    // 2. Wait for an empty slot in the queue.
+    if (wait_queue_sem(&region->slots, "slots") != 0)
     {
-        sem_post(&region->slots);
+        sem_post(&region->answer_slots);
         return -1;
     }
 
-    // 2. Acquire mutex to protect queue indices (head/tail).
-    while (sem_wait(&region->qmutex) == -1)
+    // 3. Acquire mutex to protect queue indices (head/tail) and the free answer slots.
+    if (wait_queue_sem(&region->qmutex, "qmutex") != 0)
     {
-        if (errno == EINTR && teller_running)
-            continue; // Interrupted, retry.
-        if (!teller_running)
-        {
-            sem_post(&region->slots); // Release the slot we acquired earlier.
-            return -1;
-        }
-        perror("Teller sem_wait(qmutex)");
-        sem_post(&region->slots); // Release slot before returning error.
+        sem_post(&region->slots); // Release the slots we acquired earlier.
+        sem_post(&region->answer_slots);
         return -1;
     }
 
     // --- Critical Section (Queue Index Access) ---
-    idx = region->tail;                                // Get index to write to.
+    int answer_idx = region->answer_free[--region->answer_free_count];
+    int idx = region->tail;                            // Get index to write to.
     region->queue[idx] = *src;                         // Copy request data into the queue slot.
+    region->queue[idx].answer_slot = answer_idx;       // Tell the server where to answer.
     region->tail = (region->tail + 1) % REQ_QUEUE_LEN; // Advance tail index (circular).
     // --- End Critical Section ---
 
     sem_post(&region->qmutex); // Release queue mutex.
 
-    // 3. Signal the server that a new item is available in the queue.
+    // 4. Signal the server that a new item is available in the queue.
     sem_post(&region->items);
 
-    return idx; // Return the slot index used.
+    return answer_idx; // Return the answer slot to wait on.
 }
 
-// --- Utility ---
 /**
- * @brief Parses a bank ID string provided by the client.
- *        Accepts "N" (or "BankID_None") for new account, "BankID_X" format, or plain numeric "X".
- * @param bank_id_str The string to parse.
- * @return Parsed bank ID (>= 0), -1 for new account request, or -2 for invalid format/value.
+ * @brief Submits a request to the server through the queue selected in SHM.
+ * @param rq The parsed request.
+ * @param wait Whether to wait while the queue is full; pass false while other requests
+ *        of this Teller are still unanswered, and collect their answers on QUEUE_FULL.
+ * @return The slot index to wait on, QUEUE_FULL (only if wait is false), or -1 on failure or shutdown.
  */
-static int parse_bank_id(const char *bank_id_str)
+static int submit_request(const request_t *rq, bool wait)
 {
-    int bank_id = -2; // Default to invalid format indicator.
-    if (bank_id_str == NULL)
-        return bank_id;
+    if (region->queue_mode == QUEUE_MODE_FUTEX)
+        return ring_push(&region->ring, rq, wait, &teller_running);
+    return push_request(rq, wait);
+}
 
-    // Check for "N" -> New account request.
-    if (strcmp(bank_id_str, "N") == 0 || strcmp(bank_id_str, "BankID_None") == 0)
+/**
+ * @brief Waits for the server's answer to the request in slot_idx.
+ *        Ring mode spins briefly on the slot's response word, then futex-waits on it;
+ *        semaphore mode waits on the answer slot's resp_ready semaphore.
+ *        Either way the slot is handed back once the answer is read.
+ * @param slot_idx Slot index returned by submit_request.
+ * @param resp Receives the request with its response fields filled in.
+ * @return 0 on success, -1 on failure or shutdown.
+ */
+static int await_response(int slot_idx, request_t *resp)
+{
+    if (region->queue_mode == QUEUE_MODE_FUTEX)
+        return ring_wait_response(&region->ring, slot_idx, resp, &teller_running);
+
+    int wait_ret;
+    while ((wait_ret = sem_wait(&region->resp_ready[slot_idx])) == -1)
     {
-        bank_id = -1; // Special value indicates new account request.
+        if (errno == EINTR && teller_running)
+            continue; // Interrupted, but still running: retry wait.
+        break;        // Exit wait loop if not running or other semaphore error.
     }
-    // Check for "BankID_X" format.
-    else if (strncmp(bank_id_str, "BankID_", 7) == 0)
+    if (wait_ret == -1)
     {
-        char *e;
-        errno = 0;                                // Reset errno before strtol
-        long v = strtol(bank_id_str + 7, &e, 10); // Parse number after "BankID_".
-        // Check for successful parse, valid range, and no trailing characters.
-        if (errno == 0 && *e == '\0' && v >= 0 && v < MAX_ACCOUNTS)
-            bank_id = (int)v;
+        if (teller_running) // An error here likely indicates a server-side problem or semaphore issue.
+            perror("Teller sem_wait(resp_ready)");
+        return -1; // The answer slot is abandoned; only expected during shutdown.
     }
-    // Check for plain numeric format "X".
-    else
+
+    // Accessing the answer slot here is safe without qmutex because:
+    // 1. Server wrote results *before* posting resp_ready[slot_idx].
+    // 2. Only this Teller was waiting on this specific semaphore.
+    // 3. The slot is only handed out again after release_answer_slot below.
+    *resp = region->answers[slot_idx];
+    release_answer_slot(slot_idx);
+    return 0;
+}
+
+/**
+ * @brief Formats the client-facing response line for a processed request.
+ * @param buf Output buffer.
+ * @param size Size of buf.
+ * @param client_pid PID of the client being served.
+ * @param rq The request as submitted, or NULL if it was never served.
+ * @param resp The server's answer (ignored if rq is NULL).
+ * @return Number of characters written (as snprintf).
+ */
+static int format_response(char *buf, size_t size, pid_t client_pid, const request_t *rq, const request_t *resp)
+{
+    if (rq == NULL || resp->op_status != 0)
     {
-        char *e;
-        errno = 0;
-        long v = strtol(bank_id_str, &e, 10);
-        // Check for successful parse, valid range, and no trailing characters.
-        if (errno == 0 && *e == '\0' && v >= 0 && v < MAX_ACCOUNTS)
-            bank_id = (int)v;
+        // Insufficient funds (1), general error (2, invalid ID, bank full, overflow, etc.)
+        // and unknown status codes are all reported as errors.
+        return snprintf(buf, size, "Client%d something went WRONG\n", client_pid);
     }
-    return bank_id;
+    if (rq->type == REQ_WITHDRAW && resp->result_balance == 0)
+    {
+        // Successful WITHDRAW that closed the account (balance is now 0).
+        return snprintf(buf, size, "Client%d served.. account closed\n", client_pid);
+    }
+    // Successful CREATE (deposit with 'N') returns the new BankID; a DEPOSIT to an
+    // existing account or a regular WITHDRAW returns the account's BankID.
+    return snprintf(buf, size, "Client%d served.. BankID_%d\n", client_pid, resp->bank_id);
 }
 
-// --- Main Teller Logic (Internal) ---
 /**
- * @brief Core logic executed by the Teller process. Handles communication
- *        with a single client via dedicated FIFOs, parses commands, interacts
- *        with the server via the SHM queue, and sends responses back to the client.
- * @param arg The client's PID, passed as a void pointer.
- * @return Always returns NULL.
+ * @brief Writes a whole buffer to the response FIFO, retrying short writes.
+ * @param fd Response FIFO descriptor.
+ * @param buf Data to write.
+ * @param len Number of bytes.
+ * @return 0 on success, -1 on error (errno set).
  */
-static void *teller_main_inner(void *arg)
+static int write_all(int fd, const char *buf, size_t len)
 {
-    pid_t client_pid = (pid_t)(intptr_t)arg; // Extract client PID from argument.
-    pid_t teller_pid = getpid();             // This Teller's own PID.
-    char req_path[128], res_path[128];       // Paths for client-specific FIFOs.
-    int req_fd = -1, res_fd = -1;            // File descriptors for FIFOs.
-    FILE *req_fp = NULL;                     // File stream for easier reading from request FIFO.
-    char first_line_buffer[128] = {0};       // Buffer for the first command line (for "Welcome back").
-    bool processed_first_line = false;       // Flag to track if the first line has been read/processed.
+    while (len > 0)
+    {
+        ssize_t n = write(fd, buf, len);
+        if (n == -1)
+        {
+            if (errno == EINTR && teller_running)
+                continue;
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
 
-    // Construct FIFO paths using the client's PID.
-    snprintf(req_path, sizeof(req_path), "/tmp/bank_%d_req", client_pid); // Client -> Teller
-    snprintf(res_path, sizeof(res_path), "/tmp/bank_%d_res", client_pid); // Teller -> Client
+// --- Batched Commands ---
+#define BATCH_MAX_IN_FLIGHT (REQ_QUEUE_LEN / 4) // Requests one Teller may have queued at once.
 
-    // --- Setup: Signal Handling & SHM ---
-    struct sigaction sa;
-    memset(&sa, 0, sizeof(sa));
-    sa.sa_handler = teller_sig_handler; // Use Teller-specific handler.
-    sa.sa_flags = SA_RESTART;           // Restart syscalls if possible after signal.
-    sigaction(SIGINT, &sa, NULL);       // Handle SIGINT (e.g., Ctrl+C on server).
-    sigaction(SIGTERM, &sa, NULL);      // Handle SIGTERM from server shutdown.
-    signal(SIGPIPE, SIG_IGN);           // Ignore SIGPIPE if client closes read end of response FIFO.
+typedef struct
+{
+    request_t rq;   // Parsed request.
+    request_t resp; // Server's answer.
+    int slot_idx;   // Queue slot while in flight.
+    bool served;    // True once resp holds a valid answer.
+} batch_entry_t;
 
-    // Attach to shared memory; exit if unsuccessful.
-    if (attach_shm() != 0)
+/**
+ * @brief Waits for every in-flight request of a batch.
+ * @param entries The batch.
+ * @param in_flight Indices of in-flight entries; emptied on return.
+ * @param in_flight_count Number of indices in in_flight; reset to 0.
+ * @return 0 if all answers arrived, -1 if any wait failed.
+ */
+static int drain_batch(batch_entry_t *entries, int *in_flight, int *in_flight_count)
+{
+    int ret = 0;
+    for (int i = 0; i < *in_flight_count; ++i)
     {
-        fprintf(stderr, "Teller(PID%d) for Client%d: Cannot attach SHM, exiting.\n", teller_pid, client_pid);
-        return NULL;
+        batch_entry_t *entry = &entries[in_flight[i]];
+        if (await_response(entry->slot_idx, &entry->resp) == 0)
+            entry->served = true;
+        else
+            ret = -1;
     }
+    *in_flight_count = 0;
+    return ret;
+}
 
-    // --- Open FIFOs (with retries) ---
-    // The client creates the FIFOs; the Teller opens them. Retries handle the
-    // race condition where the Teller might start slightly before the client finishes FIFO creation.
-    const int MAX_FIFO_ATTEMPTS = 15;
-    const useconds_t RETRY_DELAY_US = 100 * 1000; // 100ms delay between attempts.
+/**
+ * @brief Serves a "BATCH <count>" block: reads count command lines, keeps up to
+ *        BATCH_MAX_IN_FLIGHT of them queued at the server at once, and answers with
+ *        a single write holding one response line per command, in order.
+ *        Requests are only overlapped when that cannot change the outcome: an
+ *        account creation, or a command on an account that already has a request
+ *        in flight, first waits for everything outstanding.
+ * @param req_fp Request FIFO stream.
+ * @param res_fd Response FIFO descriptor.
+ * @param client_pid PID of the client being served.
+ * @param who Prefix of this Teller's warnings.
+ * @param count Number of commands announced by the client.
+ * @return 0 to keep serving the client, -1 to stop (I/O error, queue failure or shutdown).
+ */
+static int serve_batch(FILE *req_fp, int res_fd, pid_t client_pid, const char *who, int count)
+{
+    batch_entry_t *entries = calloc((size_t)count, sizeof(*entries));
+    char *out = malloc((size_t)count * 64);
+    if (!entries || !out)
+    {
+        perror("Teller batch alloc");
+        free(entries);
+        free(out);
+        return -1;
+    }
 
-    // Open Request FIFO (Read-Only by Teller).
-    for (int i = 0; i < MAX_FIFO_ATTEMPTS && teller_running; ++i)
+    int in_flight[BATCH_MAX_IN_FLIGHT];
+    int in_flight_count = 0;
+    int ret = 0;
+    int received = 0;
+    char line[128];
+
+    // --- Read and Submit the Batch ---
+    for (; received < count && teller_running; ++received)
     {
-        req_fd = open(req_path, O_RDONLY);
-        if (req_fd != -1)
-            break; // Success.
-        if (errno == ENOENT)
+        if (fgets(line, sizeof(line), req_fp) == NULL)
         {
-            usleep(RETRY_DELAY_US); // FIFO not created yet, wait and retry.
+            ret = -1; // Client disconnected mid-batch.
+            break;
         }
-        else
+        line[strcspn(line, "\n\r")] = 0;
+
+        batch_entry_t *entry = &entries[received];
+        if (parse_command(line, client_pid, who, &entry->rq) != 0 || ret != 0)
+            continue; // Answered with WRONG below.
+
+        bool must_drain = (entry->rq.bank_id == -1 || in_flight_count == BATCH_MAX_IN_FLIGHT);
+        for (int i = 0; i < in_flight_count && !must_drain; ++i)
+            must_drain = (entries[in_flight[i]].rq.bank_id == entry->rq.bank_id);
+        if (must_drain && drain_batch(entries, in_flight, &in_flight_count) != 0)
+            ret = -1;
+        if (ret != 0)
+            continue;
+
+        entry->slot_idx = submit_request(&entry->rq, in_flight_count == 0);
+        if (entry->slot_idx == QUEUE_FULL)
         {
-            perror("Teller open req FIFO");
-            break; // Other error, stop trying.
+            // Other Tellers' requests fill the queue; collect our own answers so their
+            // slots come free, then wait for a slot like a single request would.
+            if (drain_batch(entries, in_flight, &in_flight_count) != 0)
+            {
+                ret = -1;
+                continue;
+            }
+            entry->slot_idx = submit_request(&entry->rq, true);
         }
+        if (entry->slot_idx == -1)
+        {
+            if (teller_running)
+                fprintf(stderr, "%s ERROR: Failed to push request to server queue.\n", who);
+            ret = -1; // Remaining commands are answered with WRONG.
+            continue;
+        }
+        in_flight[in_flight_count++] = received;
+
+        // A new account's ID must be known before any later command can refer to it.
+        if (entry->rq.bank_id == -1 && drain_batch(entries, in_flight, &in_flight_count) != 0)
+            ret = -1;
     }
-    if (req_fd == -1)
+    if (drain_batch(entries, in_flight, &in_flight_count) != 0)
+        ret = -1;
+
+    // --- One Batched Response ---
+    size_t len = 0;
+    for (int i = 0; i < received; ++i)
     {
-        fprintf(stderr, "Teller(PID%d) for Client%d: Failed to open request FIFO '%s' after retries, exiting.\n", teller_pid, client_pid, req_path);
-        detach_shm();
-        return NULL;
+        const batch_entry_t *entry = &entries[i];
+        len += (size_t)format_response(out + len, 64, client_pid,
+                                       entry->served ? &entry->rq : NULL, &entry->resp);
+    }
+    if (len > 0 && write_all(res_fd, out, len) != 0)
+    {
+        if (errno != EPIPE) // EPIPE: client closed the response pipe, i.e. disconnected.
+            perror("Teller write batch response");
+        ret = -1;
+    }
+
+    free(entries);
+    free(out);
+    return (received == count) ? ret : -1;
+}
+
+/**
+ * @brief Prints the "Welcome back" line if a client's first command refers to an
+ *        existing account.
+ * @param bank_id Account ID of the first command (negative for none or invalid).
+ * @param client_pid PID of the client being served.
+ */
+static void greet_client(int bank_id, pid_t client_pid)
+{
+    // A single atomic read of the balance is enough for this informational check.
+    if (bank_id >= 0 && bank_id < MAX_ACCOUNTS &&
+        __atomic_load_n(&region->balances[bank_id], __ATOMIC_RELAXED) != ACCOUNT_INACTIVE)
+    {
+        printf("-- Teller PID%d is active serving Client%d… Welcome back Client%d\n",
+               getpid(), client_pid, client_pid);
+        fflush(stdout);
     }
+}
 
-    // Open Response FIFO (Write-Only by Teller).
-    // This might block until the client opens the read end.
-    for (int i = 0; i < MAX_FIFO_ATTEMPTS && teller_running; ++i)
+// --- Session Channel (bank_client --shm) ---
+/**
+ * @brief Checks a binary request from a session channel: the client parsed the command
+ *        itself, so only the fields the server relies on are validated here.
+ * @param rq The request as read from the channel.
+ * @return true if it may be submitted.
+ */
+static bool channel_request_valid(const request_t *rq)
+{
+    if (rq->bank_id < -1 || rq->bank_id >= MAX_ACCOUNTS || rq->amount <= 0)
+        return false;
+    if (rq->type == REQ_DEPOSIT)
+        return true;
+    return rq->type == REQ_WITHDRAW && rq->bank_id != -1; // Cannot withdraw from 'N'.
+}
+
+/**
+ * @brief Writes the answers of the channel requests from *next up to queued back to the
+ *        client, in ticket order.
+ * @param ch The mapped channel.
+ * @param slot_idx Queue slot of each ticket (by ticket % CHANNEL_RING_LEN), -1 if invalid.
+ * @param next First unanswered ticket; advanced past every answered one.
+ * @param queued Ticket after the last submitted one.
+ * @return 0 on success, -1 if waiting for the server failed.
+ */
+static int answer_channel(session_channel_t *ch, const int *slot_idx, uint32_t *next, uint32_t queued)
+{
+    for (; *next != queued; ++*next)
     {
-        res_fd = open(res_path, O_WRONLY);
-        if (res_fd != -1)
-            break; // Success.
-        if (errno == ENOENT)
-        { // Should be less common here if req_fd opened.
-            usleep(RETRY_DELAY_US);
+        request_t resp;
+        memset(&resp, 0, sizeof(resp));
+        resp.op_status = 2; // Invalid request.
+        int idx = slot_idx[*next % CHANNEL_RING_LEN];
+        if (idx != -1 && await_response(idx, &resp) != 0)
+        {
+            if (teller_running)
+                fprintf(stderr, "Teller(PID%d) ERROR: Failed waiting for server response.\n", getpid());
+            return -1;
         }
-        else
+        channel_answer(ch, *next, &resp);
+    }
+    return 0;
+}
+
+/**
+ * @brief Serves a client over its session channel instead of FIFOs. Every request the
+ *        client has published is passed to the server queue as it is, then the answers
+ *        are written back in ticket order. The client already waits for outstanding
+ *        requests before those that depend on them, so they may all be queued at once.
+ *        If the server queue is full, the answers queued so far are written back first.
+ * @param ch The mapped channel.
+ * @param client_pid PID of the client being served.
+ */
+static void serve_channel(session_channel_t *ch, pid_t client_pid)
+{
+    pid_t teller_pid = getpid();
+    int slot_idx[CHANNEL_RING_LEN];
+    uint32_t next = 0, end;
+
+    while (teller_running && channel_wait_requests(ch, next, &end, &teller_running) == 0)
+    {
+        if (next == 0)
+            greet_client(ch->slots[0].req.bank_id, client_pid);
+
+        // --- Queue Every Published Request ---
+        uint32_t queued = next;
+        for (; queued != end; ++queued)
         {
-            perror("Teller open res FIFO");
-            break; // Other error.
+            request_t rq = ch->slots[queued % CHANNEL_RING_LEN].req;
+            rq.client_pid = client_pid; // The server logs the PID the session was opened with.
+            slot_idx[queued % CHANNEL_RING_LEN] = -1;
+            if (!channel_request_valid(&rq))
+            {
+                fprintf(stderr, "Teller(PID%d) WARN: Invalid request on channel of Client%d\n", teller_pid, client_pid);
+                continue;
+            }
+            int idx = submit_request(&rq, next == queued);
+            if (idx == QUEUE_FULL)
+            {
+                // Our own unread answers may be what fills the queue: hand them out first.
+                if (answer_channel(ch, slot_idx, &next, queued) != 0)
+                    return;
+                idx = submit_request(&rq, true);
+            }
+            if (idx == -1)
+            {
+                if (teller_running)
+                    fprintf(stderr, "Teller(PID%d) ERROR: Failed to push request to server queue.\n", teller_pid);
+                break;
+            }
+            slot_idx[queued % CHANNEL_RING_LEN] = idx;
         }
+
+        // --- Answer Them in Order ---
+        if (answer_channel(ch, slot_idx, &next, queued) != 0)
+            return;
+        if (queued != end)
+            return; // Queue failure: the remaining requests stay unanswered.
+    }
+}
+
+// --- Main Teller Logic (Internal) ---
+/**
+ * @brief Serves one client: opens its dedicated FIFOs, parses commands, interacts
+ *        with the server via the SHM queue, and sends responses back to the client.
+ *        SHM must already be attached.
+ * @param client_pid The client's PID, which names its FIFOs.
+ */
+static void serve_client(pid_t client_pid)
+{
+    pid_t teller_pid = getpid();             // This Teller's own PID.
+    char who[32];                            // Prefix of command warnings.
+    char req_path[128], res_path[128];       // Paths for client-specific FIFOs.
+    int req_fd = -1, res_fd = -1;            // File descriptors for FIFOs.
+    FILE *req_fp = NULL;                     // File stream for easier reading from request FIFO.
+    char first_line_buffer[128] = {0};       // Buffer for the first command line (for "Welcome back").
+    bool processed_first_line = false;       // Flag to track if the first line has been read/processed.
+
+    // --- Session Channel ---
+    // A --shm client creates its channel before announcing its PID; FIFO clients have none.
+    session_channel_t *ch = channel_attach(client_pid);
+    if (ch != NULL)
+    {
+        serve_channel(ch, client_pid);
+        channel_close_teller(ch);
+        channel_unmap(ch);
+        return;
+    }
+    if (errno != ENOENT)
+        fprintf(stderr, "Teller(PID%d) for Client%d: Failed to map session channel: %s\n",
+                teller_pid, client_pid, strerror(errno));
+
+    // Construct FIFO paths using the client's PID.
+    snprintf(req_path, sizeof(req_path), "/tmp/bank_%d_req", client_pid); // Client -> Teller
+    snprintf(res_path, sizeof(res_path), "/tmp/bank_%d_res", client_pid); // Teller -> Client
+
+    // --- Open FIFOs ---
+    // The client creates both FIFOs before sending its PID, so they exist by now. Each
+    // blocking open returns as soon as the client opens the other end (same order on
+    // both sides); the alarm only matters if the client died in between.
+    alarm(TELLER_CONNECT_TIMEOUT_S);
+    req_fd = open(req_path, O_RDONLY); // Request FIFO (Read-Only by Teller).
+    if (req_fd == -1)
+    {
+        alarm(0);
+        fprintf(stderr, "Teller(PID%d) for Client%d: Failed to open request FIFO '%s': %s\n",
+                teller_pid, client_pid, req_path, strerror(errno));
+        return;
     }
+    res_fd = open(res_path, O_WRONLY); // Response FIFO (Write-Only by Teller).
+    alarm(0);
     if (res_fd == -1)
     {
-        fprintf(stderr, "Teller(PID%d) for Client%d: Failed to open response FIFO '%s' after retries, exiting.\n", teller_pid, client_pid, res_path);
+        fprintf(stderr, "Teller(PID%d) for Client%d: Failed to open response FIFO '%s': %s\n",
+                teller_pid, client_pid, res_path, strerror(errno));
         close(req_fd); // Close request FIFO if it was opened.
-        detach_shm();
-        return NULL;
+        return;
     }
 
     // Associate a file stream with the request FIFO for convenient line-based reading (fgets).
@@ -277,8 +629,7 @@ static void *teller_main_inner(void *arg)
         perror("Teller fdopen req_fd");
         close(req_fd);
         close(res_fd);
-        detach_shm();
-        return NULL;
+        return;
     }
 
     // --- "Welcome Back" Logic ---
@@ -293,21 +644,7 @@ static void *teller_main_inner(void *arg)
             char b_id_str[64] = "", op_str[32] = "", am_str[32] = "";
             if (sscanf(first_line_buffer, "%63s %31s %31s", b_id_str, op_str, am_str) == 3)
             {
-                int first_cmd_bank_id = parse_bank_id(b_id_str);
-                // Check if it's a valid existing account ID (>=0).
-                if (first_cmd_bank_id >= 0)
-                {
-                    // Safely check the balance array in SHM.
-                    sem_wait(&region->dbmutex);
-                    if (region->balances[first_cmd_bank_id] != ACCOUNT_INACTIVE)
-                    {
-                        // Account exists, print the welcome message using the Teller's PID.
-                        printf("-- Teller PID%d is active serving Client%d… Welcome back Client%d\n",
-                               teller_pid, client_pid, client_pid);
-                        fflush(stdout);
-                    }
-                    sem_post(&region->dbmutex);
-                }
+                greet_client(parse_bank_id(b_id_str), client_pid);
             }
             // Mark the first line as buffered, regardless of welcome message print.
             processed_first_line = true;
@@ -330,11 +667,11 @@ static void *teller_main_inner(void *arg)
         // Cleanup and exit if the first interaction fails.
         fclose(req_fp); // Closes req_fd too.
         close(res_fd);
-        detach_shm();
-        return NULL;
+        return;
     }
 
     // --- Main Command Processing Loop ---
+    snprintf(who, sizeof(who), "Teller(PID%d)", teller_pid);
     char line[128];
     while (teller_running)
     {
@@ -367,66 +704,29 @@ static void *teller_main_inner(void *arg)
         if (strlen(line) == 0 || line[0] == '#')
             continue;
 
-        // --- Parse Client Request ---
-        request_t rq = {0};         // Initialize request struct for SHM.
-        rq.client_pid = client_pid; // Store client PID for server logging.
-
-        char bank_id_str[64] = "", op_str[32] = "", am_str[32] = "";
-        long parsed_amount;
-
-        // Basic parsing of the command line.
-        if (sscanf(line, "%63s %31s %31s", bank_id_str, op_str, am_str) != 3)
+        // --- Batched Commands ("BATCH <count>" followed by count command lines) ---
+        int batch_count;
+        char batch_tail;
+        if (sscanf(line, "BATCH %d %c", &batch_count, &batch_tail) == 1)
         {
-            fprintf(stderr, "Teller(PID%d) WARN: Invalid command format: %s\n", teller_pid, line);
-            // Send error response back to client. Check for EPIPE.
-            if (dprintf(res_fd, "Client%d something went WRONG\n", client_pid) < 0 && errno == EPIPE)
-                teller_running = 0;
-            continue; // Skip to next command.
-        }
-
-        // Parse Bank ID string ("N", "BankID_X", "X").
-        rq.bank_id = parse_bank_id(bank_id_str);
-        if (rq.bank_id == -2)
-        { // Handle invalid BankID format.
-            fprintf(stderr, "Teller(PID%d) WARN: Invalid BankID format: %s\n", teller_pid, bank_id_str);
-            if (dprintf(res_fd, "Client%d something went WRONG\n", client_pid) < 0 && errno == EPIPE)
-                teller_running = 0;
-            continue;
-        }
-
-        // Parse Operation Type ("deposit", "withdraw").
-        if (strcmp(op_str, "deposit") == 0)
-            rq.type = REQ_DEPOSIT;
-        else if (strcmp(op_str, "withdraw") == 0)
-            rq.type = REQ_WITHDRAW;
-        else
-        {
-            fprintf(stderr, "Teller(PID%d) WARN: Invalid operation type: %s\n", teller_pid, op_str);
-            if (dprintf(res_fd, "Client%d something went WRONG\n", client_pid) < 0 && errno == EPIPE)
-                teller_running = 0;
-            continue;
-        }
-
-        // Parse Amount (must be a positive integer).
-        char *e;
-        errno = 0;
-        parsed_amount = strtol(am_str, &e, 10);
-        if (errno != 0 || *e != '\0' || parsed_amount <= 0)
-        {
-            fprintf(stderr, "Teller(PID%d) WARN: Invalid or non-positive amount: %s\n", teller_pid, am_str);
-            if (dprintf(res_fd, "Client%d something went WRONG\n", client_pid) < 0 && errno == EPIPE)
-                teller_running = 0;
+            if (batch_count <= 0 || batch_count > BATCH_MAX_COMMANDS)
+            {
+                fprintf(stderr, "Teller(PID%d) WARN: Invalid batch size: %s\n", teller_pid, line);
+                break; // The following lines cannot be framed reliably.
+            }
+            if (serve_batch(req_fp, res_fd, client_pid, who, batch_count) != 0)
+                break;
             continue;
         }
-        rq.amount = parsed_amount;
 
-        // Semantic check: Cannot withdraw from a non-existent account ("N").
-        if (rq.bank_id == -1 && rq.type == REQ_WITHDRAW)
+        // --- Parse Client Request ---
+        request_t rq;
+        if (parse_command(line, client_pid, who, &rq) != 0)
         {
-            fprintf(stderr, "Teller(PID%d) WARN: Cannot withdraw from new account request ('N')\n", teller_pid);
+            // Send error response back to client. Check for EPIPE.
             if (dprintf(res_fd, "Client%d something went WRONG\n", client_pid) < 0 && errno == EPIPE)
                 teller_running = 0;
-            continue;
+            continue; // Skip to next command.
         }
 
         // If signaled to stop during parsing, exit before pushing request.
@@ -434,7 +734,7 @@ static void *teller_main_inner(void *arg)
             break;
 
         // --- Submit Request to Server via SHM Queue ---
-        int slot_idx = push_request(&rq);
+        int slot_idx = submit_request(&rq, true);
         if (slot_idx == -1)
         {
             // Failed to push request (queue full, server issue, or shutdown signal).
@@ -449,79 +749,28 @@ static void *teller_main_inner(void *arg)
         }
 
         // --- Wait for Response from Server ---
-        // Wait on the specific semaphore corresponding to the queue slot used.
-        int wait_ret;
-        while ((wait_ret = sem_wait(&region->resp_ready[slot_idx])) == -1)
-        {
-            if (errno == EINTR && teller_running)
-                continue; // Interrupted, but still running: retry wait.
-            break;        // Exit wait loop if not running or other semaphore error.
-        }
-
-        // Check if wait succeeded or if we should exit.
-        if (wait_ret == -1)
+        request_t resp;
+        if (await_response(slot_idx, &resp) != 0)
         {
             if (!teller_running)
                 break; // Exiting due to signal.
-            // An error here likely indicates a server-side problem or semaphore issue.
-            perror("Teller sem_wait(resp_ready)");
             fprintf(stderr, "Teller(PID%d) ERROR: Failed waiting for server response.\n", teller_pid);
             if (dprintf(res_fd, "Client%d something went WRONG\n", client_pid) < 0 && errno == EPIPE)
                 teller_running = 0;
             break; // Stop processing on response wait failure.
         }
 
-        // --- Process Server Results (Read from SHM Queue Slot) ---
-        // Accessing the queue slot here is safe without qmutex because:
-        // 1. Server wrote results *before* posting resp_ready[slot_idx].
-        // 2. Only this Teller was waiting on this specific semaphore.
-        // 3. Server won't reuse this slot until the Teller pushes another request
-        //    (which first requires sem_wait(&region->slots)).
-        long res_bal = region->queue[slot_idx].result_balance; // Resulting balance from server.
-        int res_id = region->queue[slot_idx].bank_id;          // Resulting bank ID (may differ on CREATE).
-        int status = region->queue[slot_idx].op_status;        // Operation status code from server.
-
         // --- Format and Send Response Back to Client ---
-        int dprintf_ret = -1;
-        switch (status)
-        {
-        case 0: // OK - Success
-            if (rq.type == REQ_DEPOSIT && rq.bank_id == -1)
-            {
-                // Successful CREATE (deposit with 'N') -> return the new BankID.
-                dprintf_ret = dprintf(res_fd, "Client%d served.. BankID_%d\n", client_pid, res_id);
-            }
-            else if (rq.type == REQ_WITHDRAW && res_bal == 0)
-            {
-                // Successful WITHDRAW that closed the account (balance is now 0).
-                dprintf_ret = dprintf(res_fd, "Client%d served.. account closed\n", client_pid);
-            }
-            else
-            {
-                // Successful DEPOSIT to existing account or regular WITHDRAW (account still open).
-                dprintf_ret = dprintf(res_fd, "Client%d served.. BankID_%d\n", client_pid, res_id);
-            }
-            break;
-        case 1:  // Insufficient funds (specific error code from server).
-        case 2:  // General error (invalid ID, bank full, overflow, etc.).
-        default: // Handle unknown/unexpected status codes as errors.
-            dprintf_ret = dprintf(res_fd, "Client%d something went WRONG\n", client_pid);
-            break;
-        }
+        char out[128];
+        int out_len = format_response(out, sizeof(out), client_pid, &rq, &resp);
 
         // Check the result of writing to the response FIFO.
-        if (dprintf_ret < 0)
+        if (write_all(res_fd, out, (size_t)out_len) != 0)
         {
-            if (errno == EPIPE)
-            {
-                // Client closed the read end of the response pipe. Treat as disconnection.
-                teller_running = 0; // Signal Teller loop to stop.
-            }
-            else
-            {
+            // EPIPE: client closed the read end of the response pipe. Treat as disconnection.
+            if (errno != EPIPE)
                 perror("Teller write response");
-                teller_running = 0; // Stop on other unexpected write errors.
-            }
+            teller_running = 0; // Signal Teller loop to stop.
         }
 
     } // End while(teller_running) - Main Command Processing Loop
@@ -535,21 +784,81 @@ static void *teller_main_inner(void *arg)
         close(req_fd); // Close fd if fdopen failed but open succeeded.
     if (res_fd != -1)
         close(res_fd); // Close response FIFO fd.
-    detach_shm();      // Detach from shared memory.
 
     // Note: Teller does NOT unlink the FIFOs; the client is responsible for that.
-    return NULL; // Teller process/thread exits.
 }
 
-// --- Teller Entry Point ---
+// --- Teller Entry Points ---
 /**
- * @brief The entry function called by the Server's `Teller` wrapper (fork).
- *        Simply calls the internal logic function.
+ * @brief The entry function called by the Server's `Teller` wrapper (fork) for a
+ *        client that no pooled Teller could take.
  * @param arg Argument passed from the server (client PID).
  * @return Always returns NULL.
  */
 void *teller_main(void *arg)
 {
-    teller_main_inner(arg);
+    pid_t client_pid = (pid_t)(intptr_t)arg; // Extract client PID from argument.
+
+    setup_teller_signals();
+    // Attach to shared memory; exit if unsuccessful.
+    if (attach_shm() != 0)
+    {
+        fprintf(stderr, "Teller(PID%d) for Client%d: Cannot attach SHM, exiting.\n", getpid(), client_pid);
+        return NULL;
+    }
+    serve_client(client_pid);
+    detach_shm(); // Detach from shared memory.
     return NULL;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Entry function of a pre-forked Teller. SHM stays mapped while the Teller
+ *        serves one client after another; each client PID arrives on the control
+ *        pipe, and the Teller flags its pool slot idle in SHM while it waits for one.
+ *        Returns when the server closes the pipe (shutdown or crash) or on SIGINT/SIGTERM.
+ * @param arg The Teller's teller_pool_arg_t.
+ * @return Always returns NULL.
+ */
+void *teller_pool_main(void *arg)
+{
+    const teller_pool_arg_t *pool_arg = (const teller_pool_arg_t *)arg;
+    int ctl_fd = pool_arg->ctl_fd;
+    int *idle_flag;
+
+    setup_teller_signals();
+    if (attach_shm() != 0)
+    {
+        fprintf(stderr, "Teller(PID%d): Cannot attach SHM, exiting.\n", getpid());
+        return NULL;
+    }
+    idle_flag = &region->teller_idle[pool_arg->slot];
+
+    while (!teller_stop)
+    {
+        __atomic_store_n(idle_flag, 1, __ATOMIC_SEQ_CST);
+
+        // The server writes each PID with a single write (< PIPE_BUF), so exactly one
+        // pooled Teller receives the whole value.
+        pid_t client_pid;
+        ssize_t n;
+        do
+            n = read(ctl_fd, &client_pid, sizeof(client_pid));
+        while (n == -1 && errno == EINTR && !teller_stop);
+        if (n != (ssize_t)sizeof(client_pid))
+        {
+            if (n == -1 && errno != EINTR)
+                perror("Teller read control pipe");
+            break; // EOF: the server is gone.
+        }
+        __atomic_store_n(idle_flag, 0, __ATOMIC_SEQ_CST);
+        __atomic_fetch_sub(&region->pool_unread, 1, __ATOMIC_SEQ_CST);
+
+        teller_running = 1; // Per-client errors clear it; teller_stop survives.
+        serve_client(client_pid);
+    }
+
+    __atomic_store_n(idle_flag, 0, __ATOMIC_SEQ_CST);
+    close(ctl_fd);
+    detach_shm();
+    return NULL;
+}
@@ -0,0 +1,126 @@
+#!/bin/bash
+# test_batch.sh - Tests batched submissions (bank_client --batch) against one-at-a-time submissions
+
+echo "Creating test client file..."
+
+# Creations, dependent operations on the new accounts, an invalid line, a failing
+# withdrawal and an account closure, spread over more than one BATCH block.
+rm -f batch_client.file
+for i in $(seq 0 7); do
+    echo "N deposit $((100 * (i + 1)))" >> batch_client.file
+done
+for round in $(seq 1 20); do
+    for i in $(seq 0 7); do
+        printf "BankID_%02d deposit 10\n" $i >> batch_client.file
+        printf "BankID_%02d withdraw 5\n" $i >> batch_client.file
+    done
+done
+echo "not a command" >> batch_client.file
+echo "BankID_03 withdraw 999999" >> batch_client.file
+echo "BankID_00 withdraw 200" >> batch_client.file
+
+# Runs the client file against a fresh server and stores the summary log (minus its
+# timestamp header) and the client's output in the given files.
+run_scenario() {
+    LOG_OUT=$1
+    CLIENT_OUT=$2
+    shift 2
+    rm -f AdaBank.bankLog
+    ./bank_server AdaBank "$@" > /dev/null &
+    SERVER_PID=$!
+    sleep 1
+    ./bank_client batch_client.file AdaBank $CLIENT_FLAGS > "$CLIENT_OUT"
+    CLIENT_STATUS=$?
+    kill -SIGINT $SERVER_PID
+    wait $SERVER_PID
+    grep -v "^# Adabank Log file updated" AdaBank.bankLog > "$LOG_OUT"
+    return $CLIENT_STATUS
+}
+
+CLIENT_FLAGS=""
+run_scenario expected.batchlog expected.batchout --workers=1 || { echo "ERROR: unbatched client failed"; exit 1; }
+
+for mode in sem futex; do
+    echo "Running batched client (--queue=$mode)..."
+    CLIENT_FLAGS="--batch"
+    run_scenario batched.batchlog batched.batchout --queue=$mode --workers=4 || { echo "ERROR: batched client failed"; exit 1; }
+
+    if ! diff -q expected.batchlog batched.batchlog > /dev/null; then
+        echo "ERROR: Batched run ($mode) produced a different log:"
+        diff expected.batchlog batched.batchlog
+        exit 1
+    fi
+    if [ "$(grep -c "served\|WRONG" batched.batchout)" -ne "$(grep -c "served\|WRONG" expected.batchout)" ] ||
+       [ "$(grep -c "account closed" batched.batchout)" -ne 1 ] ||
+       [ "$(grep -c "WRONG" batched.batchout)" -ne 2 ]; then
+        echo "ERROR: Batched run ($mode) reported unexpected results."
+        exit 1
+    fi
+    echo "Batched run ($mode) matches the unbatched run."
+done
+
+# --- Concurrent Batched Clients ---
+# Each client works on its own 16 accounts, so every Teller keeps a full window of requests
+# in flight and together they hold far more answers than the 64 queue slots.
+NUM_CLIENTS=10
+ACCOUNTS_PER_CLIENT=16
+ROUNDS=10
+
+rm -f batch_setup.file
+for i in $(seq 1 $((NUM_CLIENTS * ACCOUNTS_PER_CLIENT))); do
+    echo "N deposit 100" >> batch_setup.file
+done
+for c in $(seq 0 $((NUM_CLIENTS - 1))); do
+    rm -f batch_client${c}.file
+    for round in $(seq 1 $ROUNDS); do
+        for a in $(seq 0 $((ACCOUNTS_PER_CLIENT - 1))); do
+            printf "BankID_%02d deposit 30\n" $((c * ACCOUNTS_PER_CLIENT + a)) >> batch_client${c}.file
+        done
+        for a in $(seq 0 $((ACCOUNTS_PER_CLIENT - 1))); do
+            printf "BankID_%02d withdraw 20\n" $((c * ACCOUNTS_PER_CLIENT + a)) >> batch_client${c}.file
+        done
+    done
+done
+
+echo "Running $NUM_CLIENTS concurrent batched clients..."
+rm -f AdaBank.bankLog
+./bank_server AdaBank --workers=4 > /dev/null &
+SERVER_PID=$!
+sleep 1
+if ! ./bank_client batch_setup.file AdaBank > /dev/null; then
+    echo "ERROR: Account setup client failed"
+    kill -SIGINT $SERVER_PID
+    exit 1
+fi
+CLIENT_PIDS=()
+for c in $(seq 0 $((NUM_CLIENTS - 1))); do
+    ./bank_client batch_client${c}.file AdaBank --batch > batch_client${c}.out &
+    CLIENT_PIDS+=($!)
+done
+CLIENT_FAIL=0
+for pid in "${CLIENT_PIDS[@]}"; do
+    wait $pid || CLIENT_FAIL=1
+done
+kill -SIGINT $SERVER_PID
+wait $SERVER_PID
+if [ $CLIENT_FAIL -ne 0 ] || cat batch_client*.out | grep -q "WRONG"; then
+    echo "ERROR: A concurrent batched client failed."
+    exit 1
+fi
+
+# Every account: 100 + ROUNDS * (30 - 20)
+EXPECTED=$((100 + ROUNDS * 10))
+for i in $(seq 0 $((NUM_CLIENTS * ACCOUNTS_PER_CLIENT - 1))); do
+    ACCOUNT=$(printf "BankID_%02d" $i)
+    if ! grep -q "^${ACCOUNT} .* ${EXPECTED}$" AdaBank.bankLog; then
+        echo "ERROR: $ACCOUNT does not have the expected balance $EXPECTED"
+        grep "^${ACCOUNT} " AdaBank.bankLog | awk '{print $1, $NF}'
+        exit 1
+    fi
+done
+echo "Concurrent batched clients kept every balance."
+
+rm -f batch_client.file expected.batchlog expected.batchout batched.batchlog batched.batchout
+rm -f batch_setup.file batch_client*.file batch_client*.out
+echo "Batch test passed!"
+exit 0
@@ -0,0 +1,121 @@
+#!/bin/bash
+# test_futex_queue.sh - Tests the lock-free request ring (--queue=futex) under concurrent load
+
+rm -f AdaBank.bankLog # Ensure clean state
+
+echo "Creating test client files..."
+
+# Each client submits enough operations that together they lap the 64-slot ring many times.
+NUM_CLIENTS=12
+NUM_OPS=40
+# Batched clients each keep a full window in flight on 16 accounts of their own, so together
+# they hold more unread answers than the ring has slots.
+NUM_BATCH_CLIENTS=10
+BATCH_ACCOUNTS=16
+BATCH_ROUNDS=10
+
+# Accounts are opened by one client first so every concurrent client knows its BankID.
+rm -f futex_setup.file
+for i in $(seq 1 $NUM_CLIENTS); do
+    echo "N deposit 500" >> futex_setup.file
+done
+for i in $(seq 1 $((NUM_BATCH_CLIENTS * BATCH_ACCOUNTS))); do
+    echo "N deposit 100" >> futex_setup.file
+done
+
+for i in $(seq 1 $NUM_CLIENTS); do
+    rm -f futex_client${i}.file
+    BANK_ID=$(($i-1))
+    for j in $(seq 1 $NUM_OPS); do
+        if [ $((j % 2)) -eq 0 ]; then
+            printf "BankID_%02d withdraw 20\n" $BANK_ID >> futex_client${i}.file
+        else
+            printf "BankID_%02d deposit 30\n" $BANK_ID >> futex_client${i}.file
+        fi
+    done
+done
+
+for c in $(seq 1 $NUM_BATCH_CLIENTS); do
+    rm -f futex_batch${c}.file
+    FIRST_ID=$((NUM_CLIENTS + (c - 1) * BATCH_ACCOUNTS))
+    for round in $(seq 1 $BATCH_ROUNDS); do
+        for a in $(seq 0 $((BATCH_ACCOUNTS - 1))); do
+            printf "BankID_%02d deposit 30\n" $((FIRST_ID + a)) >> futex_batch${c}.file
+        done
+        for a in $(seq 0 $((BATCH_ACCOUNTS - 1))); do
+            printf "BankID_%02d withdraw 20\n" $((FIRST_ID + a)) >> futex_batch${c}.file
+        done
+    done
+done
+
+echo "Starting bank server in futex queue mode..."
+./bank_server AdaBank --queue=futex &
+SERVER_PID=$!
+
+# Wait for server to initialize
+sleep 1
+
+if ! ./bank_client futex_setup.file AdaBank > /dev/null; then
+    echo "ERROR: Account setup client failed"
+    kill -SIGINT $SERVER_PID
+    exit 1
+fi
+
+echo "Starting $NUM_CLIENTS clients with $NUM_OPS operations each and $NUM_BATCH_CLIENTS batched clients..."
+CLIENT_PIDS=()
+for i in $(seq 1 $NUM_CLIENTS); do
+    ./bank_client futex_client${i}.file AdaBank > /dev/null &
+    CLIENT_PIDS+=($!)
+done
+for c in $(seq 1 $NUM_BATCH_CLIENTS); do
+    ./bank_client futex_batch${c}.file AdaBank --batch > futex_batch${c}.out &
+    CLIENT_PIDS+=($!)
+done
+
+CLIENT_FAIL=0
+for pid in "${CLIENT_PIDS[@]}"; do
+    wait $pid
+    if [ $? -ne 0 ]; then
+        echo "ERROR: Client with PID $pid failed"
+        CLIENT_FAIL=1
+    fi
+done
+
+echo "Gracefully stopping server..."
+kill -SIGINT $SERVER_PID
+wait $SERVER_PID
+
+if [ $CLIENT_FAIL -ne 0 ] || cat futex_batch*.out | grep -q "WRONG"; then
+    echo "ERROR: A client failed or got an error response"
+    exit 1
+fi
+
+# Every account: 500 + 20 * 30 - 20 * 20 = 700
+EXPECTED=$((500 + (NUM_OPS / 2) * 30 - (NUM_OPS / 2) * 20))
+if [ ! -f AdaBank.bankLog ]; then
+    echo "ERROR: Log file doesn't exist."
+    exit 1
+fi
+for i in $(seq 0 $(($NUM_CLIENTS - 1))); do
+    ACCOUNT=$(printf "BankID_%02d" $i)
+    if ! grep -q "^${ACCOUNT} .* ${EXPECTED}$" AdaBank.bankLog; then
+        echo "ERROR: $ACCOUNT does not have the expected balance $EXPECTED"
+        grep "^${ACCOUNT} " AdaBank.bankLog | awk '{print $1, $NF}'
+        exit 1
+    fi
+done
+
+# Every batched account: 100 + 10 * (30 - 20) = 200
+EXPECTED=$((100 + BATCH_ROUNDS * 10))
+for i in $(seq $NUM_CLIENTS $((NUM_CLIENTS + NUM_BATCH_CLIENTS * BATCH_ACCOUNTS - 1))); do
+    ACCOUNT=$(printf "BankID_%02d" $i)
+    if ! grep -q "^${ACCOUNT} .* ${EXPECTED}$" AdaBank.bankLog; then
+        echo "ERROR: $ACCOUNT does not have the expected balance $EXPECTED"
+        grep "^${ACCOUNT} " AdaBank.bankLog | awk '{print $1, $NF}'
+        exit 1
+    fi
+done
+
+rm -f futex_setup.file futex_client*.file futex_batch*.file futex_batch*.out
+echo "Futex queue test passed!"
+exit 0
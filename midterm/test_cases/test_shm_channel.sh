@@ -0,0 +1,158 @@
+#!/bin/bash
+# test_shm_channel.sh - Tests --shm session channels next to FIFO clients, in both queue modes
+
+echo "Creating test client files..."
+
+# Clients alternate between the channel (one at a time and pipelined) and the FIFO path.
+NUM_CLIENTS=9
+NUM_OPS=40
+# Pipelined clients then each keep a full channel of requests in flight on 16 accounts of their
+# own, so together they hold more unread answers than the server queue has slots.
+NUM_PIPELINED=10
+PIPELINED_ACCOUNTS=16
+PIPELINED_ROUNDS=10
+
+rm -f shm_setup.file
+for i in $(seq 1 $NUM_CLIENTS); do
+    echo "N deposit 500" >> shm_setup.file
+done
+for i in $(seq 1 $((NUM_PIPELINED * PIPELINED_ACCOUNTS))); do
+    echo "N deposit 100" >> shm_setup.file
+done
+for i in $(seq 1 $NUM_CLIENTS); do
+    rm -f shm_client${i}.file
+    BANK_ID=$(($i-1))
+    for j in $(seq 1 $NUM_OPS); do
+        if [ $((j % 2)) -eq 0 ]; then
+            printf "BankID_%02d withdraw 20\n" $BANK_ID >> shm_client${i}.file
+        else
+            printf "BankID_%02d deposit 30\n" $BANK_ID >> shm_client${i}.file
+        fi
+    done
+done
+
+for c in $(seq 1 $NUM_PIPELINED); do
+    rm -f shm_pipelined${c}.file
+    FIRST_ID=$((NUM_CLIENTS + (c - 1) * PIPELINED_ACCOUNTS))
+    for round in $(seq 1 $PIPELINED_ROUNDS); do
+        for a in $(seq 0 $((PIPELINED_ACCOUNTS - 1))); do
+            printf "BankID_%02d deposit 30\n" $((FIRST_ID + a)) >> shm_pipelined${c}.file
+        done
+        for a in $(seq 0 $((PIPELINED_ACCOUNTS - 1))); do
+            printf "BankID_%02d withdraw 20\n" $((FIRST_ID + a)) >> shm_pipelined${c}.file
+        done
+    done
+done
+
+# A session whose answers must match the FIFO path line for line.
+cat > shm_mixed.file << EOF
+N deposit 300
+BankID_999 withdraw 1
+N withdraw 5
+BankID_00 deposit 0
+N deposit 40
+BANKID_XX deposit 10
+EOF
+
+# Every account: 500 + 20 * 30 - 20 * 20 = 700
+EXPECTED=$((500 + (NUM_OPS / 2) * 30 - (NUM_OPS / 2) * 20))
+# Every pipelined account: 100 + 10 * (30 - 20) = 200
+PIPELINED_EXPECTED=$((100 + PIPELINED_ROUNDS * 10))
+
+for QUEUE in sem futex; do
+    rm -f AdaBank.bankLog AdaBank.wal AdaBank.snap # Ensure clean state
+    echo "Starting bank server with --queue=$QUEUE..."
+    ./bank_server AdaBank --queue=$QUEUE > /dev/null &
+    SERVER_PID=$!
+    sleep 1
+
+    if ! ./bank_client shm_setup.file AdaBank --shm > /dev/null; then
+        echo "ERROR: Account setup client failed"
+        kill -SIGINT $SERVER_PID
+        exit 1
+    fi
+
+    CLIENT_PIDS=()
+    for i in $(seq 1 $NUM_CLIENTS); do
+        case $((i % 3)) in
+            0) ./bank_client shm_client${i}.file AdaBank --shm > /dev/null & ;;
+            1) ./bank_client shm_client${i}.file AdaBank --shm --batch > /dev/null & ;;
+            2) ./bank_client shm_client${i}.file AdaBank > /dev/null & ;;
+        esac
+        CLIENT_PIDS+=($!)
+    done
+    for pid in "${CLIENT_PIDS[@]}"; do
+        if ! wait $pid; then
+            echo "ERROR: Client with PID $pid failed"
+            kill -SIGINT $SERVER_PID
+            exit 1
+        fi
+    done
+
+    CLIENT_PIDS=()
+    for c in $(seq 1 $NUM_PIPELINED); do
+        ./bank_client shm_pipelined${c}.file AdaBank --shm --batch > shm_pipelined${c}.out &
+        CLIENT_PIDS+=($!)
+    done
+    for pid in "${CLIENT_PIDS[@]}"; do
+        if ! wait $pid; then
+            echo "ERROR: Pipelined client with PID $pid failed"
+            kill -SIGINT $SERVER_PID
+            exit 1
+        fi
+    done
+    if cat shm_pipelined[0-9]*.out | grep -q "WRONG"; then
+        echo "ERROR: A pipelined client got an error response ($QUEUE)"
+        kill -SIGINT $SERVER_PID
+        exit 1
+    fi
+
+    ./bank_client shm_mixed.file AdaBank 2> /dev/null | grep -v "^Reading" > shm_fifo.out
+    ./bank_client shm_mixed.file AdaBank --shm 2> /dev/null | grep -v "^Reading" > shm_channel.out
+    ./bank_client shm_mixed.file AdaBank --shm --batch 2> /dev/null | grep -v "^Reading" > shm_pipelined.out
+
+    echo "Gracefully stopping server..."
+    kill -SIGINT $SERVER_PID
+    wait $SERVER_PID
+
+    # The mixed session opens two accounts, so only compare the lines that do not name them.
+    for OUT in shm_channel.out shm_pipelined.out; do
+        if ! diff <(sort shm_fifo.out | grep -v "BankID_") <(sort $OUT | grep -v "BankID_") > /dev/null; then
+            echo "ERROR: $OUT differs from the FIFO session"
+            diff shm_fifo.out $OUT
+            exit 1
+        fi
+        if [ "$(grep -c "served.. BankID_" $OUT)" -ne 2 ] || [ "$(grep -c "something went WRONG" $OUT)" -ne 4 ]; then
+            echo "ERROR: Unexpected results in $OUT"
+            cat $OUT
+            exit 1
+        fi
+    done
+
+    for i in $(seq 0 $(($NUM_CLIENTS - 1))); do
+        ACCOUNT=$(printf "BankID_%02d" $i)
+        if ! grep -q "^${ACCOUNT} .* ${EXPECTED}$" AdaBank.bankLog; then
+            echo "ERROR: $ACCOUNT does not have the expected balance $EXPECTED ($QUEUE)"
+            grep "^${ACCOUNT} " AdaBank.bankLog | awk '{print $1, $NF}'
+            exit 1
+        fi
+    done
+    for i in $(seq $NUM_CLIENTS $((NUM_CLIENTS + NUM_PIPELINED * PIPELINED_ACCOUNTS - 1))); do
+        ACCOUNT=$(printf "BankID_%02d" $i)
+        if ! grep -q "^${ACCOUNT} .* ${PIPELINED_EXPECTED}$" AdaBank.bankLog; then
+            echo "ERROR: $ACCOUNT does not have the expected balance $PIPELINED_EXPECTED ($QUEUE)"
+            grep "^${ACCOUNT} " AdaBank.bankLog | awk '{print $1, $NF}'
+            exit 1
+        fi
+    done
+done
+
+if ls /dev/shm/adabank_ch_* > /dev/null 2>&1; then
+    echo "ERROR: Session channels were left behind"
+    exit 1
+fi
+
+rm -f shm_setup.file shm_client*.file shm_mixed.file shm_fifo.out shm_channel.out shm_pipelined.out
+rm -f shm_pipelined*.file shm_pipelined*.out
+echo "Shared memory channel test passed!"
+exit 0
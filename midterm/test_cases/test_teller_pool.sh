@@ -0,0 +1,106 @@
+#!/bin/bash
+# test_teller_pool.sh - Tests the pre-forked Teller pool, its fork-per-client overflow path and pool shutdown
+
+echo "Creating test client files..."
+
+# More concurrent clients than pooled Tellers, so some of them get a dedicated Teller.
+NUM_CLIENTS=6
+NUM_OPS=30
+
+rm -f pool_setup.file
+for i in $(seq 1 $NUM_CLIENTS); do
+    echo "N deposit 100" >> pool_setup.file
+done
+for i in $(seq 1 $NUM_CLIENTS); do
+    rm -f pool_client${i}.file
+    for j in $(seq 1 $NUM_OPS); do
+        printf "BankID_%02d deposit 2\n" $(($i-1)) >> pool_client${i}.file
+    done
+done
+
+for POOL in 2 0; do
+    rm -f AdaBank.bankLog AdaBank.wal AdaBank.snap # Ensure clean state
+    echo "Starting bank server with --tellers=$POOL..."
+    ./bank_server AdaBank --tellers=$POOL > /dev/null &
+    SERVER_PID=$!
+    sleep 1
+
+    if [ "$POOL" -gt 0 ] && [ "$(pgrep -c -P $SERVER_PID)" -ne "$POOL" ]; then
+        echo "ERROR: Expected $POOL pre-forked Tellers."
+        kill -SIGINT $SERVER_PID
+        exit 1
+    fi
+
+    if ! ./bank_client pool_setup.file AdaBank > /dev/null; then
+        echo "ERROR: Account setup client failed"
+        kill -SIGINT $SERVER_PID
+        exit 1
+    fi
+
+    CLIENT_PIDS=()
+    for i in $(seq 1 $NUM_CLIENTS); do
+        ./bank_client pool_client${i}.file AdaBank > /dev/null &
+        CLIENT_PIDS+=($!)
+    done
+    for pid in "${CLIENT_PIDS[@]}"; do
+        if ! wait $pid; then
+            echo "ERROR: Client with PID $pid failed"
+            kill -SIGINT $SERVER_PID
+            exit 1
+        fi
+    done
+
+    # Every client has disconnected; at most the pool should be left.
+    sleep 0.5
+    if [ "$(pgrep -c -P $SERVER_PID)" -gt "$POOL" ]; then
+        echo "ERROR: Tellers outlived their clients."
+        kill -SIGINT $SERVER_PID
+        exit 1
+    fi
+
+    kill -SIGINT $SERVER_PID
+    wait $SERVER_PID
+    sleep 0.5
+    if pgrep -x bank_server > /dev/null; then
+        echo "ERROR: Teller processes still running after shutdown."
+        pkill -x bank_server
+        exit 1
+    fi
+
+    EXPECTED=$((100 + NUM_OPS * 2))
+    for i in $(seq 0 $(($NUM_CLIENTS - 1))); do
+        ACCOUNT=$(printf "BankID_%02d" $i)
+        if ! grep -q "^${ACCOUNT} .* ${EXPECTED}$" AdaBank.bankLog; then
+            echo "ERROR: $ACCOUNT does not have the expected balance $EXPECTED (--tellers=$POOL)"
+            exit 1
+        fi
+    done
+    echo "Run with --tellers=$POOL passed."
+done
+
+# A pooled Teller killed while idle is respawned; the pool must not count it twice,
+# or a client arriving while the only live Teller is busy waits for that Teller.
+echo "Checking that a Teller killed while idle is not counted as idle..."
+rm -f AdaBank.bankLog AdaBank.wal AdaBank.snap
+(echo "N deposit 100"; for j in $(seq 1 20000); do echo "BankID_00 deposit 1"; done) > pool_long.file
+./bank_server AdaBank --tellers=1 > /dev/null &
+SERVER_PID=$!
+sleep 1
+kill -9 $(pgrep -P $SERVER_PID)
+sleep 0.5
+./bank_client pool_long.file AdaBank > /dev/null &
+LONG_PID=$!
+sleep 0.3
+if ! timeout 3 ./bank_client pool_setup.file AdaBank > /dev/null; then
+    echo "ERROR: Client waited for a busy Teller instead of getting its own."
+    kill $LONG_PID 2>/dev/null
+    kill -SIGINT $SERVER_PID
+    exit 1
+fi
+wait $LONG_PID
+kill -SIGINT $SERVER_PID
+wait $SERVER_PID
+
+rm -f pool_setup.file pool_client*.file pool_long.file
+echo "Teller pool test passed!"
+exit 0
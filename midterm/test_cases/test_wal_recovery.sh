@@ -0,0 +1,85 @@
+#!/bin/bash
+# test_wal_recovery.sh - Tests that the WAL and snapshots restore every committed operation after a crash
+
+rm -f AdaBank.bankLog AdaBank.wal AdaBank.snap # Ensure clean state
+
+echo "Creating test client files..."
+
+# Enough operations in total to pass WAL_CHECKPOINT_RECORDS, so recovery has to
+# combine a periodic snapshot with the WAL records written after it.
+NUM_CLIENTS=4
+NUM_OPS=1200
+
+rm -f wal_setup.file
+for i in $(seq 1 $NUM_CLIENTS); do
+    echo "N deposit 100" >> wal_setup.file
+done
+
+for i in $(seq 1 $NUM_CLIENTS); do
+    rm -f wal_client${i}.file
+    BANK_ID=$(($i-1))
+    for j in $(seq 1 $NUM_OPS); do
+        printf "BankID_%02d deposit 1\n" $BANK_ID >> wal_client${i}.file
+    done
+done
+
+echo "Starting bank server..."
+./bank_server AdaBank > /dev/null &
+SERVER_PID=$!
+sleep 1
+
+if ! ./bank_client wal_setup.file AdaBank > /dev/null; then
+    echo "ERROR: Account setup client failed"
+    kill -SIGINT $SERVER_PID
+    exit 1
+fi
+
+CLIENT_PIDS=()
+for i in $(seq 1 $NUM_CLIENTS); do
+    ./bank_client wal_client${i}.file AdaBank --batch > /dev/null &
+    CLIENT_PIDS+=($!)
+done
+for pid in "${CLIENT_PIDS[@]}"; do
+    if ! wait $pid; then
+        echo "ERROR: Client with PID $pid failed"
+        kill -SIGINT $SERVER_PID
+        exit 1
+    fi
+done
+
+# Every answered request is durable, so nothing may be lost by a crash from here on.
+echo "Crashing server with SIGKILL..."
+kill -KILL $SERVER_PID
+wait $SERVER_PID 2>/dev/null
+
+if [ ! -f AdaBank.snap ] || [ ! -f AdaBank.wal ]; then
+    echo "ERROR: Snapshot or WAL missing after crash."
+    exit 1
+fi
+
+echo "Restarting server..."
+./bank_server AdaBank > wal_restart.log &
+SERVER_PID=$!
+sleep 1
+kill -SIGINT $SERVER_PID
+wait $SERVER_PID
+
+if ! grep -q "Recovered bank state from snapshot" wal_restart.log; then
+    echo "ERROR: Server did not recover from the snapshot and WAL."
+    cat wal_restart.log
+    exit 1
+fi
+
+EXPECTED=$((100 + NUM_OPS))
+for i in $(seq 0 $(($NUM_CLIENTS - 1))); do
+    ACCOUNT=$(printf "BankID_%02d" $i)
+    if ! grep -q "^${ACCOUNT} .* ${EXPECTED}$" AdaBank.bankLog; then
+        echo "ERROR: $ACCOUNT does not have the expected balance $EXPECTED"
+        grep "^${ACCOUNT} " AdaBank.bankLog | awk '{print $1, $NF}'
+        exit 1
+    fi
+done
+
+rm -f wal_setup.file wal_client*.file wal_restart.log
+echo "WAL recovery test passed!"
+exit 0
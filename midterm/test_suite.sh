@@ -17,7 +17,7 @@ cleanup() {
     rm -f /tmp/bank_*_req
     rm -f /tmp/bank_*_res
     # Remove shared memory segments
-    rm -f /dev/shm/adabank_shm 2>/dev/null
+    rm -f /dev/shm/adabank_shm /dev/shm/adabank_ch_* 2>/dev/null
     sleep 1
 }
 
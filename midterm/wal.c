@@ -0,0 +1,443 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdbool.h> // For bool type
+#include <stddef.h>  // For offsetof
+#include <sys/stat.h>
+
+#include "common.h"
+
+// Binary write-ahead log for the bank server.
+// Every state change is appended as a fixed-size, CRC-32 protected wal_record_t
+// carrying the account's resulting balance, so replay is idempotent. Callers that
+// need durability wait in wal_wait_durable(); the first waiter becomes the leader,
+// writes every pending record with one write() and one fdatasync(), and wakes the
+// rest, so concurrent worker threads share the cost of a sync (group commit).
+// A checkpoint stores all balances in a snapshot file and empties the log, so
+// recovery reads the latest snapshot plus the records appended after it.
+// A failed write or sync is sticky: the records from the failed group on are never
+// reported durable, and no further records are written until the server restarts.
+// The server refuses every change from then on (see wal_failed).
+
+#define WAL_GROUP_MAX 256          // Records buffered while the leader is syncing.
+#define SNAPSHOT_MAGIC 0x4e534241u // "ABSN"
+
+// --- On-Disk Formats ---
+typedef struct
+{
+    uint32_t crc;     // CRC-32 of the bytes that follow.
+    uint32_t type;    // log_event_type_t of the change.
+    uint64_t lsn;     // Log sequence number, increasing by one per record.
+    int32_t bank_id;  // Account involved.
+    int32_t reserved; // Zero; keeps the 64-bit fields aligned.
+    int64_t amount;   // Transaction amount.
+    int64_t balance;  // Balance after the change (ACCOUNT_INACTIVE for LOG_CLOSE).
+} wal_record_t;
+
+typedef struct
+{
+    uint32_t magic;    // SNAPSHOT_MAGIC.
+    uint32_t crc;      // CRC-32 of the rest of the header and the balances that follow.
+    uint64_t lsn;      // Last log record reflected in the snapshot.
+    int32_t next_id;   // First account ID to hand out after loading.
+    int32_t accounts;  // Number of balances stored (MAX_ACCOUNTS).
+} snapshot_header_t;
+
+// --- Log State ---
+static struct
+{
+    int fd;                               // Log file, opened O_APPEND.
+    pthread_mutex_t lock;                 // Guards everything below.
+    pthread_cond_t changed;               // Signalled after each group commit.
+    wal_record_t pending[WAL_GROUP_MAX];  // Records appended but not yet written.
+    int pending_count;                    // Number of records in pending.
+    uint64_t next_lsn;                    // LSN given to the next appended record.
+    uint64_t durable_lsn;                 // Every record up to this LSN is on disk.
+    bool flushing;                        // A leader is writing a group.
+    bool failed;                          // A group commit failed; see failed_lsn.
+    uint64_t failed_lsn;                  // First LSN of the failed group; it and later LSNs are not durable.
+    uint64_t since_checkpoint;            // Records appended since the last checkpoint.
+    uint64_t syncs;                       // fdatasync calls issued.
+    uint64_t records;                     // Records written.
+} wal = {.fd = -1, .lock = PTHREAD_MUTEX_INITIALIZER, .changed = PTHREAD_COND_INITIALIZER, .next_lsn = 1};
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_table_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Fills crc_table for the reflected IEEE polynomial.
+ */
+static void build_crc_table(void)
+{
+    for (uint32_t i = 0; i < 256; ++i)
+    {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k)
+            c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        crc_table[i] = c;
+    }
+}
+
+/**
+ * @brief Computes the IEEE CRC-32 of a buffer.
+ * @param crc Running CRC (0 to start).
+ * @param data Bytes to add.
+ * @param len Number of bytes.
+ * @return The updated CRC.
+ */
+static uint32_t crc32_update(uint32_t crc, const void *data, size_t len)
+{
+    pthread_once(&crc_table_once, build_crc_table);
+
+    const unsigned char *p = data;
+    crc = ~crc;
+    while (len--)
+        crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+/**
+ * @brief CRC of a record, excluding its crc field.
+ */
+static uint32_t record_crc(const wal_record_t *rec)
+{
+    return crc32_update(0, (const char *)rec + sizeof(rec->crc), sizeof(*rec) - sizeof(rec->crc));
+}
+
+/**
+ * @brief Writes a whole buffer, retrying short writes and EINTR.
+ * @return 0 on success, -1 on error (errno set).
+ */
+static int write_full(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0)
+    {
+        ssize_t n = write(fd, p, len);
+        if (n == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/**
+ * @brief Opens (creating if needed) the write-ahead log file.
+ * @param path Log file path.
+ * @return 0 on success, -1 on failure.
+ */
+int wal_open(const char *path)
+{
+    wal.fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0600);
+    if (wal.fd == -1)
+    {
+        perror("SERVER ERROR: open WAL");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Closes the log file. All waiters must have returned.
+ */
+void wal_close()
+{
+    if (wal.fd != -1)
+    {
+        close(wal.fd);
+        wal.fd = -1;
+    }
+}
+
+/**
+ * @brief Rebuilds balances from the snapshot file and the log records after it.
+ *        A torn or corrupt tail (crash during a write) is detected by its CRC and cut off.
+ * @param snapshot_path Snapshot file path.
+ * @param balances Receives MAX_ACCOUNTS balances (ACCOUNT_INACTIVE for unused IDs).
+ * @param next_id Receives the first account ID to hand out.
+ * @param replayed Receives the number of log records applied.
+ * @return 1 if a snapshot or log records were found, 0 if there was nothing to recover.
+ */
+int wal_recover(const char *snapshot_path, long *balances, int *next_id, long *replayed)
+{
+    bool found = false;
+    uint64_t snapshot_lsn = 0;
+    *replayed = 0;
+    *next_id = 0;
+    for (int i = 0; i < MAX_ACCOUNTS; ++i)
+        balances[i] = ACCOUNT_INACTIVE;
+
+    // --- Latest Snapshot ---
+    int snap_fd = open(snapshot_path, O_RDONLY);
+    if (snap_fd != -1)
+    {
+        snapshot_header_t header;
+        static int64_t stored[MAX_ACCOUNTS];
+        if (read(snap_fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+            header.magic == SNAPSHOT_MAGIC && header.accounts == MAX_ACCOUNTS &&
+            read(snap_fd, stored, sizeof(stored)) == (ssize_t)sizeof(stored))
+        {
+            uint32_t crc = crc32_update(0, (const char *)&header + offsetof(snapshot_header_t, lsn),
+                                        sizeof(header) - offsetof(snapshot_header_t, lsn));
+            crc = crc32_update(crc, stored, sizeof(stored));
+            if (crc == header.crc)
+            {
+                for (int i = 0; i < MAX_ACCOUNTS; ++i)
+                    balances[i] = (long)stored[i];
+                snapshot_lsn = header.lsn;
+                *next_id = header.next_id;
+                found = true;
+            }
+        }
+        if (!found)
+            fprintf(stderr, "SERVER WARNING: Ignoring invalid snapshot '%s'\n", snapshot_path);
+        close(snap_fd);
+    }
+
+    // --- Log Tail ---
+    wal_record_t rec;
+    off_t offset = 0;
+    uint64_t last_lsn = snapshot_lsn;
+    while (pread(wal.fd, &rec, sizeof(rec), offset) == (ssize_t)sizeof(rec))
+    {
+        if (record_crc(&rec) != rec.crc || rec.bank_id < 0 || rec.bank_id >= MAX_ACCOUNTS)
+            break; // Torn or corrupt record: everything from here on is discarded.
+        offset += (off_t)sizeof(rec);
+        if (rec.lsn <= snapshot_lsn)
+            continue; // Already part of the snapshot.
+        balances[rec.bank_id] = (long)rec.balance;
+        if (rec.balance != ACCOUNT_INACTIVE && rec.bank_id + 1 > *next_id)
+            *next_id = rec.bank_id + 1; // Like the text log: continue after the highest ID used.
+        last_lsn = rec.lsn;
+        (*replayed)++;
+        found = true;
+    }
+    struct stat st;
+    if (fstat(wal.fd, &st) == 0 && st.st_size != offset)
+    {
+        fprintf(stderr, "SERVER WARNING: Discarding %ld bytes of incomplete WAL records\n", (long)(st.st_size - offset));
+        if (ftruncate(wal.fd, offset) == -1)
+            perror("SERVER ERROR: ftruncate WAL");
+    }
+
+    if (*next_id >= MAX_ACCOUNTS)
+        *next_id = 0; // Wrap around if max ID reached the limit.
+
+    pthread_mutex_lock(&wal.lock);
+    wal.next_lsn = last_lsn + 1;
+    wal.durable_lsn = last_lsn;
+    pthread_mutex_unlock(&wal.lock);
+    return found ? 1 : 0;
+}
+
+/**
+ * @brief Queues a record for the next group commit. Does not wait for the disk.
+ *        Callers hold the account's lock stripe, so records of one account keep their order.
+ *        After a failed commit the record is dropped; waiting on its LSN returns -1.
+ * @param type log_event_type_t of the change.
+ * @param id Account ID.
+ * @param amount Transaction amount.
+ * @param balance Balance after the change.
+ * @return The record's LSN, to pass to wal_wait_durable.
+ */
+uint64_t wal_append(int type, int id, long amount, long balance)
+{
+    pthread_mutex_lock(&wal.lock);
+    while (wal.pending_count == WAL_GROUP_MAX && !wal.failed)
+        pthread_cond_wait(&wal.changed, &wal.lock); // A leader is about to take the group.
+    if (wal.failed)
+    {
+        uint64_t lsn = wal.next_lsn++;
+        pthread_mutex_unlock(&wal.lock);
+        return lsn;
+    }
+
+    wal_record_t *rec = &wal.pending[wal.pending_count++];
+    memset(rec, 0, sizeof(*rec));
+    rec->type = (uint32_t)type;
+    rec->lsn = wal.next_lsn++;
+    rec->bank_id = id;
+    rec->amount = amount;
+    rec->balance = balance;
+    rec->crc = record_crc(rec);
+    wal.since_checkpoint++;
+    uint64_t lsn = rec->lsn;
+    pthread_mutex_unlock(&wal.lock);
+    return lsn;
+}
+
+/**
+ * @brief Blocks until the record with the given LSN is on disk. If no other thread
+ *        is syncing, the caller writes and syncs every pending record itself.
+ * @param lsn LSN returned by wal_append.
+ * @return 0 on success, -1 if the record is in or after a group whose write or sync failed.
+ */
+int wal_wait_durable(uint64_t lsn)
+{
+    static wal_record_t group[WAL_GROUP_MAX]; // Only touched by the current leader.
+    int ret = 0;
+
+    pthread_mutex_lock(&wal.lock);
+    while (wal.durable_lsn < lsn)
+    {
+        if (wal.failed && lsn >= wal.failed_lsn)
+        {
+            ret = -1;
+            break;
+        }
+        if (wal.flushing || wal.pending_count == 0)
+        {
+            pthread_cond_wait(&wal.changed, &wal.lock);
+            continue;
+        }
+
+        // Become the leader for everything appended so far.
+        int count = wal.pending_count;
+        memcpy(group, wal.pending, (size_t)count * sizeof(group[0]));
+        wal.pending_count = 0;
+        wal.flushing = true;
+        pthread_cond_broadcast(&wal.changed); // Appenders blocked on a full buffer may continue.
+        pthread_mutex_unlock(&wal.lock);
+
+        int io_ret = write_full(wal.fd, group, (size_t)count * sizeof(group[0]));
+        if (io_ret == 0)
+            io_ret = fdatasync(wal.fd);
+        if (io_ret != 0)
+            perror("SERVER ERROR: WAL write/fdatasync");
+
+        pthread_mutex_lock(&wal.lock);
+        if (io_ret != 0)
+        {
+            // The group may be partly on disk; recovery cuts it off by its CRC. Nothing
+            // after it can be made durable, so later records are dropped as well.
+            wal.failed = true;
+            wal.failed_lsn = group[0].lsn;
+            wal.pending_count = 0;
+        }
+        else
+        {
+            wal.durable_lsn = group[count - 1].lsn;
+            wal.records += (uint64_t)count;
+        }
+        wal.flushing = false;
+        wal.syncs++;
+        pthread_cond_broadcast(&wal.changed);
+    }
+    pthread_mutex_unlock(&wal.lock);
+    return ret;
+}
+
+/**
+ * @brief Whether a group commit has failed. The failure is sticky until restart.
+ * @return true if no further record can become durable.
+ */
+bool wal_failed()
+{
+    pthread_mutex_lock(&wal.lock);
+    bool failed = wal.failed;
+    pthread_mutex_unlock(&wal.lock);
+    return failed;
+}
+
+/**
+ * @brief Number of records appended since the last checkpoint.
+ */
+uint64_t wal_records_since_checkpoint()
+{
+    pthread_mutex_lock(&wal.lock);
+    uint64_t n = wal.since_checkpoint;
+    pthread_mutex_unlock(&wal.lock);
+    return n;
+}
+
+/**
+ * @brief Reports group commit statistics.
+ * @param records Receives the number of records written.
+ * @param syncs Receives the number of fdatasync calls.
+ */
+void wal_stats(uint64_t *records, uint64_t *syncs)
+{
+    pthread_mutex_lock(&wal.lock);
+    *records = wal.records;
+    *syncs = wal.syncs;
+    pthread_mutex_unlock(&wal.lock);
+}
+
+/**
+ * @brief Writes a snapshot of balances and empties the log. The caller must keep
+ *        the balances from changing (hold every account lock stripe) for the duration.
+ *        The snapshot is written to a temporary file, synced and renamed into place,
+ *        so a crash leaves either the old snapshot plus the full log or the new one.
+ * @param snapshot_path Snapshot file path.
+ * @param balances MAX_ACCOUNTS balances to store.
+ * @param next_id First account ID to hand out after loading the snapshot.
+ * @return 0 on success, -1 on failure (the log is left untouched).
+ */
+int wal_checkpoint(const char *snapshot_path, const long *balances, int next_id)
+{
+    // Everything appended so far must be durable before it can be dropped from the log.
+    pthread_mutex_lock(&wal.lock);
+    uint64_t lsn = wal.next_lsn - 1;
+    pthread_mutex_unlock(&wal.lock);
+    if (wal_wait_durable(lsn) != 0)
+        return -1;
+
+    static int64_t stored[MAX_ACCOUNTS];
+    for (int i = 0; i < MAX_ACCOUNTS; ++i)
+        stored[i] = balances[i];
+    snapshot_header_t header = {SNAPSHOT_MAGIC, 0, lsn, next_id, MAX_ACCOUNTS};
+    header.crc = crc32_update(0, (const char *)&header + offsetof(snapshot_header_t, lsn),
+                              sizeof(header) - offsetof(snapshot_header_t, lsn));
+    header.crc = crc32_update(header.crc, stored, sizeof(stored));
+
+    char tmp_path[256];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", snapshot_path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd == -1)
+    {
+        perror("SERVER ERROR: open snapshot");
+        return -1;
+    }
+    if (write_full(fd, &header, sizeof(header)) != 0 || write_full(fd, stored, sizeof(stored)) != 0 ||
+        fsync(fd) != 0)
+    {
+        perror("SERVER ERROR: write snapshot");
+        close(fd);
+        unlink(tmp_path);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp_path, snapshot_path) == -1)
+    {
+        perror("SERVER ERROR: rename snapshot");
+        unlink(tmp_path);
+        return -1;
+    }
+    int dir_fd = open(".", O_RDONLY | O_DIRECTORY);
+    if (dir_fd != -1)
+    {
+        fsync(dir_fd); // Make the rename itself durable.
+        close(dir_fd);
+    }
+
+    // The snapshot covers every record: start a fresh log.
+    if (ftruncate(wal.fd, 0) == -1)
+    {
+        perror("SERVER ERROR: ftruncate WAL");
+        return -1;
+    }
+    pthread_mutex_lock(&wal.lock);
+    wal.since_checkpoint = 0;
+    pthread_mutex_unlock(&wal.lock);
+    return 0;
+}